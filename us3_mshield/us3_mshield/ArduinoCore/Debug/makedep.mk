@@ -64,6 +64,10 @@ src\core\wiring_analog.c
 
 src\core\wiring_digital.c
 
+src\core\wiring_dmac.c
+
+src\core\wiring_evsys.c
+
 src\core\wiring_private.c
 
 src\core\wiring_shift.c
@@ -82,12 +86,16 @@ src\libraries\dht_sensor_library\DHT_U.cpp
 
 src\libraries\Filters-master\FilterDerivative.cpp
 
+src\libraries\Filters-master\FilterFixed.cpp
+
 src\libraries\Filters-master\FilterOnePole.cpp
 
 src\libraries\Filters-master\FilterTwoPole.cpp
 
 src\libraries\Filters-master\RunningStatistics.cpp
 
+src\libraries\Filters-master\WindowStatistics.cpp
+
 src\libraries\LiquidCrystal_I2C-master\LiquidCrystal_I2C.cpp
 
 src\libraries\MAX6675_library\max6675.cpp
@@ -112,12 +120,30 @@ src\libraries\SPIMemory\src\SPIMemory.cpp
 
 src\libraries\SPI\SPI.cpp
 
+src\libraries\ssni_coap_server\adcscan.cpp
+
 src\libraries\ssni_coap_server\arduino_time.cpp
 
+src\libraries\ssni_coap_server\backlog.cpp
+
+src\libraries\ssni_coap_server\bench.cpp
+
+src\libraries\ssni_coap_server\bootseq.cpp
+
 src\libraries\ssni_coap_server\bufutil.cpp
 
+src\libraries\ssni_coap_server\burst.cpp
+
+src\libraries\ssni_coap_server\cal.cpp
+
+src\libraries\ssni_coap_server\cbor_decode.cpp
+
 src\libraries\ssni_coap_server\cbor_encode.cpp
 
+src\libraries\ssni_coap_server\cfg.cpp
+
+src\libraries\ssni_coap_server\chan.cpp
+
 src\libraries\ssni_coap_server\coapmsg.cpp
 
 src\libraries\ssni_coap_server\coapobserve.cpp
@@ -134,18 +160,88 @@ src\libraries\ssni_coap_server\coap_rsp_msg.cpp
 
 src\libraries\ssni_coap_server\coap_server.cpp
 
+src\libraries\ssni_coap_server\cpuload.cpp
+
+src\libraries\ssni_coap_server\crash.cpp
+
 src\libraries\ssni_coap_server\crc_xmodem.cpp
 
+src\libraries\ssni_coap_server\duty.cpp
+
+src\libraries\ssni_coap_server\fw.cpp
+
 src\libraries\ssni_coap_server\hbuf.cpp
 
 src\libraries\ssni_coap_server\hdlc.cpp
 
 src\libraries\ssni_coap_server\hdlcs.cpp
 
+src\libraries\ssni_coap_server\health.cpp
+
+src\libraries\ssni_coap_server\hshrink.cpp
+
+src\libraries\ssni_coap_server\irqprio.cpp
+
+src\libraries\ssni_coap_server\lcdframe.cpp
+
 src\libraries\ssni_coap_server\log.cpp
 
+src\libraries\ssni_coap_server\logfmt.cpp
+
+src\libraries\ssni_coap_server\lpidle.cpp
+
+src\libraries\ssni_coap_server\mbbatch.cpp
+
+src\libraries\ssni_coap_server\mbimage.cpp
+
+src\libraries\ssni_coap_server\mbmap.cpp
+
+src\libraries\ssni_coap_server\mbpoll.cpp
+
+src\libraries\ssni_coap_server\mbrtu.cpp
+
+src\libraries\ssni_coap_server\mbscan.cpp
+
+src\libraries\ssni_coap_server\mbslave.cpp
+
+src\libraries\ssni_coap_server\nmea.cpp
+
+src\libraries\ssni_coap_server\pace.cpp
+
+src\libraries\ssni_coap_server\perflvl.cpp
+
+src\libraries\ssni_coap_server\pps.cpp
+
+src\libraries\ssni_coap_server\prov.cpp
+
+src\libraries\ssni_coap_server\pulsecnt.cpp
+
+src\libraries\ssni_coap_server\pwrdom.cpp
+
+src\libraries\ssni_coap_server\relay.cpp
+
+src\libraries\ssni_coap_server\reqlat.cpp
+
+src\libraries\ssni_coap_server\retain.cpp
+
 src\libraries\ssni_coap_server\sapi.cpp
 
+src\libraries\ssni_coap_server\sblk.cpp
+
+src\libraries\ssni_coap_server\sched.cpp
+
+src\libraries\ssni_coap_server\serline.cpp
+
+src\libraries\ssni_coap_server\sermap.cpp
+
+src\libraries\ssni_coap_server\sertunnel.cpp
+
+src\libraries\ssni_coap_server\sha256.cpp
+
+src\libraries\ssni_coap_server\total.cpp
+
+src\libraries\ssni_coap_server\trace.cpp
+
 src\libraries\Wire\Wire.cpp
 
 src\variants\variant.cpp
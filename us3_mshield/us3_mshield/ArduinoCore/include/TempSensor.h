@@ -34,8 +34,15 @@ Networks, Inc.
 #include <Arduino.h>
 #include <DHT_U.h>
 #include "sapi_error.h"
+#include "sapi.h"
 #include "arduino_time.h"
 #include "log.h"
+#include "mbpoll.h"
+#include "mbmap.h"
+#include "mbslave.h"
+#include "mbbatch.h"
+#include "mbscan.h"
+#include "chan.h"
 
 //////////////////////////////////////////////////////////////////////////
 //
@@ -48,8 +55,113 @@ Networks, Inc.
 
 // DHT11 temp sensor type
 #define TEMP_SENSOR_TYPE		"US3-C-D1"
-char* Send(byte * cmd, byte* ret);
-void sendCommand(byte *cmd);
+
+// Sample data type of the level, and the level value until the RS485 read is back
+#define TEMP_DATATYPE_LEVEL		3
+#define TEMP_LEVEL_STANDIN		12.00f
+
+// Longest text payload, NUL included
+#define TEMP_PAYLOAD_LEN		128
+
+// The DHT11 is read in the background this often, its temperature and
+// humidity together. It slews slowly and takes 2 s between reads at least.
+#define TEMP_DHT_POLL_MS		2000
+// It answers from 1 s after power up, the first read waits that long
+#define TEMP_DHT_WARM_MS		1000
+
+// FL900 on the RS485 port (PORT_RS485_UART, D4 = RE, D5 = DE). Each value is
+// two holding registers, a CDAB float, see temp_map in TempSensor.cpp. The
+// format is this unless commissioning saved another, see temp_detect_modbus.
+#define TEMP_MODBUS_BAUD		PORT_RS485_BAUD
+#define TEMP_MODBUS_CONFIG		PORT_RS485_CONFIG
+#define TEMP_MODBUS_SLAVE		1
+#define TEMP_REG_BATTERY		0x000C
+#define TEMP_REG_LEVEL			0x000E
+#define TEMP_REG_VELOCITY		0x0010
+#define TEMP_REG_FLOW			0x0012
+#define TEMP_REG_QUALITY		0x0014
+
+// Wanted ranges at most this many registers apart share one read
+#define TEMP_MODBUS_GAP			4
+// How often the main loop reads the FL900 in the background, the bound of
+// its adaptive reply timeout (MB_RTO_K) and the retries before it backs off
+#define TEMP_FL900_POLL_MS		5000
+#define TEMP_FL900_TIMEOUT_MS	200
+#define TEMP_FL900_RETRIES		2
+// Register image of the FL900, 0x0C-0x15, and the age it reads as stale at
+#define TEMP_IMAGE_BASE			TEMP_REG_BATTERY
+#define TEMP_IMAGE_COUNT		10
+#define TEMP_FL900_MAX_AGE_MS	(3 * TEMP_FL900_POLL_MS)
+// Poll table of the RS485 bus, the FL900 and the slaves a scan found, each
+// of those read for its probe register on the FL900's interval
+#define TEMP_MODBUS_POLLS		4
+
+// A second FL900 on the second RS485 bus (PORT_RS485B_UART, D8 = RE,
+// D9 = DE), where ports.h gives that bus a UART. It has a master and a
+// poller of its own, and is read into image2 on the same interval while
+// the first bus is busy with its own slave.
+#define TEMP_BUS2_SLAVE			1
+#define TEMP_BUS2_RE_PIN		D8
+#define TEMP_BUS2_DE_PIN		D9
+
+// Power the FL900 from relay 1 (D6/D7) only around its reads, after a
+// warm-up. Leave the Relay1 parameter unset, this drives the same pins.
+//#define TEMP_POWER_RELAY
+#define TEMP_POWER_WARMUP_MS	3000
+
+// Answer local panels as a Modbus slave on the RS232 port (no DE/RE), from
+// the register image only. Holding registers are the FL900's own, input
+// registers TEMP_LOCAL_ROW_REGS per map row: the value as a CDAB float,
+// its MB_Q_* quality and its age in seconds.
+//#define TEMP_LOCAL_SLAVE
+#define TEMP_LOCAL_BAUD			PORT_RS232_BAUD
+#define TEMP_LOCAL_CONFIG		PORT_RS232_CONFIG
+#if defined(TEMP_LOCAL_SLAVE) && (PORT_RS232_SERIAL == PORT_NONE)
+#error "TEMP_LOCAL_SLAVE needs an RS232 port, see ports.h"
+#endif
+#define TEMP_LOCAL_ADDR			1
+#define TEMP_LOCAL_ROW_REGS		4
+
+// Sample the level from the FL900 instead of TEMP_LEVEL_STANDIN
+//#define TEMP_LEVEL_MODBUS
+
+// Level alarms, checked at every sample and reported at once: high and low
+// limits in inches with their hysteresis, and the fastest rise or fall in
+// inches a minute. Leave a limit undefined for no alarm.
+//#define TEMP_LEVEL_HIGH		48.0f
+//#define TEMP_LEVEL_LOW		2.0f
+//#define TEMP_LEVEL_RATE		6.0f
+#define TEMP_LEVEL_HYST			0.5f
+
+// False echoes of the ultrasonic level taken out before the alarms and the
+// deadband see them, a Hampel filter over the last TEMP_LEVEL_WINDOW samples
+// rejecting those more than TEMP_LEVEL_REJECT deviations off their median.
+// Leave TEMP_LEVEL_WINDOW undefined to report the level as read.
+#define TEMP_LEVEL_WINDOW		5
+#define TEMP_LEVEL_REJECT		3.0f
+
+// Totalize the FL900 flow on the device, into a volume reported with each
+// notification and kept across resets. The flow is published as a channel
+// too, the totals integrate samples. TEMP_FLOW_SCALE takes a flow per
+// minute to a volume.
+//#define TEMP_FLOW_TOTAL
+#define TEMP_DATATYPE_FLOW		4
+#define TEMP_DATATYPE_VOLUME	5
+#define TEMP_FLOW_SCALE			(1.0f / 60.0f)
+
+// Last read of the DHT11, both values of one acquisition
+typedef struct temp_dht
+{
+	float				temp_c;							// Temperature, Celsius
+	float				temp_f;							// and Fahrenheit
+	float				humidity;						// Relative humidity, %
+	uint32_t			stamp_ms;						// millis() of the read
+	time_t				epoch;							// and its epoch
+	uint8_t				valid;							// 0 until the first good read
+	uint32_t			reads;							// Reads done, good or not
+	uint32_t			fails;							// Reads that failed
+} temp_dht_t;
+
 /*
  * @brief Initialize DHT11 temp sensor. Callback called by sapi_init_sensor function.
  *
@@ -70,6 +182,17 @@ sapi_error_t temp_init_sensor();
 sapi_error_t temp_read_sensor(char *payload, uint8_t *len);
 
 
+/*
+ * @brief Samples the level. Callback called by the SAPI sampler every SampleRate, and on
+ *   CoAP Get sensor value
+ *
+ * @param samples     Pointer to the samples.
+ * @param count       Pointer to the sample count, set to 1.
+ * @return SAPI Error Code
+ */
+sapi_error_t temp_read_samples(sapi_sample_t *samples, uint8_t *count);
+
+
 /*
  * @brief Read sensor configuration. Builds and returns the payload. Callback called on
  *   CoAP Get configuration value
@@ -81,6 +204,27 @@ sapi_error_t temp_read_sensor(char *payload, uint8_t *len);
 sapi_error_t temp_read_cfg(char *payload, uint8_t *len);
 
 
+/*
+ * @brief Read sensor. Writes the payload in place by the text writer. Callback called on
+ *   CoAP Get sensor value
+ *
+ * @param tb          Text writer of the payload.
+ * @return SAPI Error Code
+ */
+sapi_error_t temp_read_txt(struct txt_buf *tb);
+
+
+/*
+ * @brief Read sensor configuration. Writes the payload straight into the response by
+ *   the text writer. Callback called on
+ *   CoAP Get configuration value
+ *
+ * @param tb          Text writer of the payload.
+ * @return SAPI Error Code
+ */
+sapi_error_t temp_read_cfg_txt(struct txt_buf *tb);
+
+
 /*
  * @brief Write sensor configuration. Processes payload sent from client. Callback called on
  *   CoAP Put configuration value
@@ -117,6 +261,91 @@ sapi_error_t temp_build_payload(char *buf, float *reading);
 sapi_error_t read_dht11(float *reading);
 
 
+/*
+ * @brief The last DHT11 read, shared by every reader. It is taken in the
+ *   background by temp_poll every TEMP_DHT_POLL_MS, the sensor is never
+ *   read on demand.
+ *
+ * @return The record, valid 0 until the first good read
+ */
+const temp_dht_t *temp_dht(void);
+
+
+/*
+ * @brief Read one FL900 value from the register image, decoded as its row of
+ *   the register map. Does not touch the bus.
+ *
+ * @param addr        First register, one of TEMP_REG_*.
+ * @param reading     Pointer to a float to contain the value.
+ * @param quality     Set to its MB_Q_GOOD or MB_Q_STALE quality.
+ * @param age_ms      Set to how long ago it was read.
+ * @return SAPI Error Code, SAPI_ERR_FAIL if it has not been read yet
+ */
+sapi_error_t temp_read_register(uint16_t addr, float *reading, uint8_t *quality, uint32_t *age_ms);
+
+
+/*
+ * @brief Read all the FL900 values into the register image now, in as few
+ *   Modbus transactions as the register map allows (one for 0x0C-0x15).
+ *
+ * @return SAPI Error Code
+ */
+sapi_error_t temp_read_fl900(void);
+
+
+/*
+ * @brief Commissioning: find the serial format the FL900 answers in, see
+ *   mb_rtu_detect, and save it in the configuration for the next boots.
+ *   A CoAP PUT "cfg=detect" runs it. Takes seconds, the bus is left in
+ *   the format found.
+ *
+ * @return SAPI Error Code, SAPI_ERR_FAIL if no format had a reply
+ */
+sapi_error_t temp_detect_modbus(void);
+
+
+/*
+ * @brief Commissioning: scan the RS485 bus for slaves, see mb_scan_start,
+ *   in the background. A CoAP PUT "cfg=scan" starts it. The slaves found
+ *   are logged with their latency and join the poll table, up to
+ *   TEMP_MODBUS_POLLS entries, with their stats in GET /sys/stats?mod=modbus.
+ *
+ * @return SAPI Error Code, SAPI_ERR_IN_PROGRESS while the bus is busy
+ */
+sapi_error_t temp_scan_modbus(void);
+
+
+/*
+ * @brief Run the Modbus master from the main loop. Moves the transaction in
+ *   flight along without waiting on the line, and starts the next read due
+ *   in the poll table, the FL900 values every TEMP_FL900_POLL_MS for
+ *   temp_read_samples. Answers the local slave port too, and takes the
+ *   DHT11 reads.
+ */
+void temp_poll(void);
+
+/*
+ * @brief Time until temp_poll has anything to do, 0 while a transaction is
+ *   on the bus or the DHT11 is being read, or a request may come in on the
+ *   local slave port.
+ */
+uint32_t temp_wait_ms(void);
+
+
+/*
+ * @brief Pass a batch of Modbus reads from the head-end through to the bus.
+ *   Exchange callback, a POST with the CBOR array [[slave, fc, addr, count], ...]
+ *   of 0x03/0x04 reads. They are queued on the master between the background
+ *   reads and the answers, in the same order, go back in one separate response
+ *   through sapi_exchange_complete, see mbbatch.h.
+ *
+ * @param payload     Pointer to the CBOR request.
+ * @param len         Request length.
+ * @return SAPI Error Code, SAPI_ERR_IN_PROGRESS while the last batch runs
+ */
+sapi_error_t temp_exchange(const uint8_t *payload, uint16_t len);
+
+
 /*
  * @brief Enable the sensor in its context.
  *
@@ -165,5 +394,50 @@ typedef struct temp_ctx
 	uint8_t				enable;
 } temp_ctx_t;
 
+// FL900 values, in the order of the rows of temp_map
+typedef enum
+{
+	TEMP_FL900_BATTERY = 0,
+	TEMP_FL900_LEVEL,
+	TEMP_FL900_VELOCITY,
+	TEMP_FL900_FLOW,
+	TEMP_FL900_QUALITY,
+	TEMP_FL900_COUNT
+} temp_fl900_t;
+
+// Temp Sensor working set, from the Modbus master to the reading
+typedef struct temp_state
+{
+	struct mb_rtu		bus;							// Modbus RTU master on the RS485 port
+	struct mb_image		image;							// FL900 registers, from the poller
+	uint16_t			img_regs[TEMP_IMAGE_COUNT];
+	uint32_t			img_stamp[TEMP_IMAGE_COUNT];	// millis() of each register's read
+	uint8_t				img_quality[TEMP_IMAGE_COUNT];
+	struct mb_reg_want	want[TEMP_FL900_COUNT];			// Registers wanted, into the image
+	struct mb_poll		poll[TEMP_MODBUS_POLLS];		// Poll table, one per slave
+	struct mb_poller	poller;							// Background reads in turn
+	struct mb_scan		scan;							// Bus scan for commissioning
+	uint8_t				scan_wait;						// 1 -> scan waits for the supply
+	uint8_t				scan_table;						// 1 -> scan done, into the poll table
+#if (PORT_RS485B_SERIAL != PORT_NONE)
+	struct mb_rtu		bus2;							// Modbus RTU master on the second RS485 port
+	struct mb_image		image2;							// Second FL900 registers
+	uint16_t			img2_regs[TEMP_IMAGE_COUNT];
+	uint32_t			img2_stamp[TEMP_IMAGE_COUNT];
+	uint8_t				img2_quality[TEMP_IMAGE_COUNT];
+	struct mb_reg_want	want2[TEMP_FL900_COUNT];
+	struct mb_poll		poll2[1];
+	struct mb_poller	poller2;						// Reads on the second bus, beside poller
+#endif
+	struct pwr_domain	power;							// FL900 supply, on relay 1
+	struct mb_batch		batch;							// Passthrough reads from the head-end
+	uint8_t				batch_wait;						// 1 -> batch waits for the supply
+	temp_dht_t			dht;							// DHT11 temperature and humidity
+	uint32_t			dht_start_ms;					// millis() the last DHT11 read began
+#ifdef TEMP_LOCAL_SLAVE
+	struct mb_slave		local;							// Local panel port
+#endif
+} temp_state_t;
+
 
 #endif /* TEMPSENSOR_H_ */
\ No newline at end of file
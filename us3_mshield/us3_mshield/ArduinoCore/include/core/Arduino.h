@@ -96,6 +96,8 @@ extern "C"{
 #include "wiring_analog.h"
 #include "wiring_shift.h"
 #include "WInterrupts.h"
+#include "wiring_dmac.h"
+#include "wiring_evsys.h"
 
 // undefine stdlib's abs if encountered
 #ifdef abs
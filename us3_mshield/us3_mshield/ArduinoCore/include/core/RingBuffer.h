@@ -27,26 +27,66 @@
 // location from which to read.
 #define SERIAL_BUFFER_SIZE 64
 
-class RingBuffer
+// Ring buffer logic over storage owned by the derived RingBufferN<N>, so
+// buffers of different sizes can be handed around as one type (e.g. by Uart).
+// The size must be a power of two; indexes wrap with a mask, not a modulo.
+//
+// One producer (store) and one consumer (read, consume), for example an IRQ
+// and the loop, need no lock: each writes only its own index, and a barrier
+// puts the bytes in memory before the index that hands them over moves.
+//
+// Arduino.h reaches this through WVariant.h inside extern "C", where a
+// template is not allowed, so the classes say their linkage themselves.
+extern "C++" {
+
+class RingBufferBase
 {
 public:
-  uint8_t _aucBuffer[SERIAL_BUFFER_SIZE] ;
+  uint8_t * const _aucBuffer ;
+  const int _iMask ;
   volatile int _iHead ;
   volatile int _iTail ;
 
 public:
-  RingBuffer( void ) ;
   void store_char( uint8_t c ) ;
+  // As much of data as fits, with one head update; the count stored
+  int store( const uint8_t *data, int count ) ;
   void clear();
   int read_char();
+  // Up to count bytes out, with one tail update; the count read
+  int read( uint8_t *data, int count ) ;
+  // The readable bytes from the tail up to the end of the storage, in place;
+  // consume() then frees them, all or the first count
+  int peek_contiguous( const uint8_t **data ) ;
+  void consume( int count ) ;
   int available();
   int availableForStore();
   int peek();
   bool isFull();
+  int size() { return _iMask + 1; }
+
+protected:
+  RingBufferBase( uint8_t *buffer, int size ) ;
 
 private:
-  int nextIndex(int index);
+  int nextIndex(int index) { return (index + 1) & _iMask; }
+  static void barrier() { __sync_synchronize(); }
 } ;
 
-#endif /* _RING_BUFFER_ */
+template <int N>
+class RingBufferN : public RingBufferBase
+{
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "RingBufferN size must be a power of two");
+
+public:
+  RingBufferN( void ) : RingBufferBase( _aucStorage, N ) { }
 
+private:
+  uint8_t _aucStorage[N] ;
+} ;
+
+typedef RingBufferN<SERIAL_BUFFER_SIZE> RingBuffer;
+
+} // extern "C++"
+
+#endif /* _RING_BUFFER_ */
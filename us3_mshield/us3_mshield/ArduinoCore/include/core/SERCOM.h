@@ -19,6 +19,7 @@
 #ifndef _SERCOM_CLASS_
 #define _SERCOM_CLASS_
 
+#include <stddef.h>
 #include "sam.h"
 
 #if (SAMD51 && (VARIANT_MCK == 120000000ul))
@@ -29,6 +30,9 @@
 
 #define SERCOM_NVIC_PRIORITY ((1<<__NVIC_PRIO_BITS) - 1)
 
+// DMAC channels of the SERCOMs, SERCOM_DMAC_*, are in wiring_dmac.h
+#include "wiring_dmac.h"
+
 typedef enum
 {
 	UART_EXT_CLOCK = 0,
@@ -88,6 +92,9 @@ typedef enum
 	UART_TX_PAD_0 = 0x0ul,	// Only for UART
 	UART_TX_PAD_2 = 0x1ul,  // Only for UART, not supported with D51
 	UART_TX_RTS_CTS_PAD_0_2_3 = 0x2ul,  // Only for UART with TX on PAD0, RTS on PAD2 and CTS on PAD3
+#if (SAMD51 || SAMC21)
+	UART_TX_RS485_PAD_0_2 = 0x3ul,  // Only for UART with TX on PAD0 and the RS485 TE on PAD2, not on the L21
+#endif
 } SercomUartTXPad;
 
 typedef enum
@@ -155,9 +162,11 @@ class SERCOM
 		void initUART(SercomUartMode mode, SercomUartSampleRate sampleRate, uint32_t baudrate=0) ;
 		void initFrame(SercomUartCharSize charSize, SercomDataOrder dataOrder, SercomParityMode parityMode, SercomNumberStopBit nbStopBits) ;
 		void initPads(SercomUartTXPad txPad, SercomRXPad rxPad) ;
+		void setBaudUART(uint32_t baudrate) ;
 
 		void resetUART( void ) ;
 		void enableUART( void ) ;
+		void setRunStandbyUART( bool on ) ;
 		void flushUART( void ) ;
 		void clearStatusUART( void ) ;
 		bool availableDataUART( void ) ;
@@ -171,6 +180,18 @@ class SERCOM
 		void acknowledgeUARTError() ;
 		void enableDataRegisterEmptyInterruptUART();
 		void disableDataRegisterEmptyInterruptUART();
+		bool isTransmitCompleteInterruptUART();
+#if (SAMD51 || SAMC21)
+		void setGuardTimeUART(uint8_t bits);
+#endif
+		void enableTransmitCompleteInterruptUART();
+		void disableTransmitCompleteInterruptUART();
+		volatile void *getDataRegisterUART( void ) ;
+		uint8_t getDmacTriggerTx( void ) ;
+		uint8_t getDmacTriggerRx( void ) ;
+#if defined(SERCOM_DMAC_CHANNELS)
+		static DmacDescriptor *getDmacDescriptor(uint8_t channel) ;
+#endif
 
 		/* ========== SPI ========== */
 		void initSPI(SercomSpiTXPad mosi, SercomRXPad miso, SercomSpiCharSize charSize, SercomDataOrder dataOrder) ;
@@ -184,6 +205,12 @@ class SERCOM
 		void setBaudrateSPI(uint8_t divider) ;
 		void setClockModeSPI(SercomSpiClockMode clockMode) ;
 		uint8_t transferDataSPI(uint8_t data) ;
+		void transferDataSPI(const uint8_t *txData, uint8_t *rxData, size_t count) ;
+#if defined(SERCOM_DMAC_CHANNELS)
+		bool transferDmaSPI(const uint8_t *txData, uint8_t *rxData, size_t count) ;
+		bool startDmaSPI(const uint8_t *txData, uint8_t *rxData, size_t count) ;
+		void endDmaSPI( void ) ;
+#endif
 		bool isBufferOverflowErrorSPI( void ) ;
 		bool isDataRegisterEmptySPI( void ) ;
 		bool isTransmitCompleteSPI( void ) ;
@@ -214,12 +241,36 @@ class SERCOM
     bool isRXNackReceivedWIRE( void ) ;
 		int availableWIRE( void ) ;
 		uint8_t readDataWIRE( void ) ;
+		/* Master without waiting, driven from the SERCOM interrupt */
+		void startAddressWIRE(uint8_t address, SercomWireReadWriteFlag flag) ;
+		void writeDataMasterWIRE(uint8_t data) ;
+		uint8_t readDataMasterWIRE( void ) ;
+		uint8_t getInterruptFlagsWIRE( void ) ;
+		bool isMasterErrorWIRE( void ) ;
+		void clearMasterErrorWIRE( void ) ;
+		void enableMasterInterruptsWIRE( void ) ;
+		void disableMasterInterruptsWIRE( void ) ;
+
+		/* NVIC priority of its IRQ, as set by its role, see ports.h */
+		uint32_t getNvicPriority( void ) ;
+
+		/* Take the generator 0 rate from SystemCoreClock again, after the core
+		 * clock was switched. The SPI rate follows on its next transaction,
+		 * a UART needs setBaudUART(). */
+		static void clockChanged( void ) ;
 
 	private:
 		Sercom* sercom;
+#if !(SAMD51)
+		IRQn_Type irqn;
+#endif
 		uint32_t calculateBaudrateSynchronous(uint32_t baudrate) ;
+		void setBaudFracUART(uint16_t sampleRateValue, uint32_t baudrate) ;
 		uint32_t division(uint32_t dividend, uint32_t divisor) ;
 		void initClockNVIC( void ) ;
+#if defined(SERCOM_DMAC_CHANNELS)
+		bool armDmaSPI(const uint8_t *txData, uint8_t *rxData, size_t count, bool interrupt) ;
+#endif
 };
 
 #endif
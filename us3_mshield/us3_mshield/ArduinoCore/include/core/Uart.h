@@ -24,11 +24,21 @@
 
 #include <cstddef>
 
+#define NO_RTS_PIN 255
+#define NO_CTS_PIN 255
+
+// Scatter-gather transmit through the DMAC
+#if defined(SERCOM_DMAC_CHANNELS)
+  #define UART_DMA_TX             1
+  #define UART_DMA_CHANNEL        SERCOM_DMAC_UART_TX
+  #define UART_DMA_MAX_SEGMENTS   4
+#endif
+
 class Uart : public HardwareSerial
 {
   public:
-    Uart(SERCOM *_s, uint8_t _pinRX, uint8_t _pinTX, SercomRXPad _padRX, SercomUartTXPad _padTX);
-    Uart(SERCOM *_s, uint8_t _pinRX, uint8_t _pinTX, SercomRXPad _padRX, SercomUartTXPad _padTX, uint8_t _pinRTS, uint8_t _pinCTS);
+    Uart(SERCOM *_s, uint8_t _pinRX, uint8_t _pinTX, SercomRXPad _padRX, SercomUartTXPad _padTX, RingBufferBase &_rx, RingBufferBase &_tx);
+    Uart(SERCOM *_s, uint8_t _pinRX, uint8_t _pinTX, SercomRXPad _padRX, SercomUartTXPad _padTX, uint8_t _pinRTS, uint8_t _pinCTS, RingBufferBase &_rx, RingBufferBase &_tx);
     void begin(unsigned long baudRate);
     void begin(unsigned long baudrate, uint16_t config);
     void end();
@@ -36,14 +46,57 @@ class Uart : public HardwareSerial
     int availableForWrite();
     int peek();
     int read();
+    // What has been received, up to size bytes, without waiting
+    size_t read(uint8_t *buffer, size_t size);
     void flush();
     size_t write(const uint8_t data);
+    // Into the TX ring as much at a time as fits, the DRE interrupt enabled once
+    size_t write(const uint8_t *buffer, size_t size);
     using Print::write; // pull in write(str) and write(buf, size) from Print
 
+    // Hand every received byte to callback from the IRQ instead of the RX buffer
+    void onReceive(void (*callback)(uint8_t));
+
+    // Call callback from the IRQ once the last character written has left
+    // the shifter, to drop an RS485 driver enable. Not for writeDMA().
+    void onTransmitComplete(void (*callback)(void));
+
+    // Flow control on plain GPIOs, call before begin(). RTS is driven low
+    // while we can take data and CTS low means the far end can.
+    void setFlowControl(uint8_t _pinRTS, uint8_t _pinCTS);
+    // RTS for an onReceive() consumer, which bypasses the RX buffer threshold
+    void rxReady(bool ready);
+    bool ctsReady();
+
+    // Keep receiving and sending in standby, after begin(). Each interrupt
+    // wakes the core, on a generator left running in standby.
+    void runInStandby(bool on);
+
+    // The rate of begin() again on the SERCOM clock now, once the core clock
+    // was switched. Nothing while characters are still queued or sending.
+    void clockChanged();
+    bool isSending();
+
+#if (SAMD51 || SAMC21)
+    // RS485 on a UART_TX_RS485_PAD_0_2 port, call before begin(). The SERCOM
+    // drives TE (DE) on pinTE while it sends and guardBits bits after.
+    void setRS485(uint8_t _pinTE, uint8_t guardBits);
+#endif
+
+#if defined(UART_DMA_TX)
+    // Send count buffers back to back without CPU involvement. The buffers
+    // must stay valid until done() is called from the DMAC IRQ. Returns false
+    // if the DMAC channel or the TX ring buffer is still busy.
+    bool writeDMA(const uint8_t * const *buf, const uint16_t *len, uint8_t count, void (*done)(void));
+    bool isBusyDMA() { return dmaBusy; }
+    void dmaHandler();
+#endif
+
 #if (SAMD51)
     void availableDataHandler();
     void dataRegisterEmptyHandler();
     void errorHandler();
+    void transmitCompleteHandler();
 #else
     void IrqHandler();
 #endif
@@ -52,9 +105,16 @@ class Uart : public HardwareSerial
 
   private:
     SERCOM *sercom;
-    RingBuffer rxBuffer;
-    RingBuffer txBuffer;
+    RingBufferBase &rxBuffer;
+    RingBufferBase &txBuffer;
+    void (*volatile rxCallback)(uint8_t);
+    void (*volatile txDoneCallback)(void);
+#if defined(UART_DMA_TX)
+    volatile bool dmaBusy;
+    void (*dmaDone)(void);
+#endif
 
+    uint32_t ul_baudrate;
     uint8_t uc_pinRX;
     uint8_t uc_pinTX;
     SercomRXPad uc_padRX;
@@ -64,6 +124,10 @@ class Uart : public HardwareSerial
     volatile uint32_t* pul_outclrRTS;
     uint32_t ul_pinMaskRTS;
     uint8_t uc_pinCTS;
+#if (SAMD51 || SAMC21)
+    uint8_t uc_pinTE;
+    uint8_t uc_guardTime;
+#endif
 
     SercomNumberStopBit extractNbStopBit(uint16_t config);
     SercomUartCharSize extractCharSize(uint16_t config);
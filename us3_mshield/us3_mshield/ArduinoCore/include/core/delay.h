@@ -55,6 +55,23 @@ extern unsigned long micros( void ) ;
  */
 extern void delay( unsigned long dwMs ) ;
 
+/**
+ * \brief Moves millis() on by ms, for the time SysTick did not count while the core was in standby.
+ * Call with interrupts off.
+ *
+ * \param ms the number of milliseconds the core slept (uint32_t)
+ */
+extern void tickAdvance( uint32_t ms ) ;
+
+/**
+ * \brief Reloads SysTick, micros() and delayMicroseconds() for SystemCoreClock, after the core clock
+ * was switched. Call with interrupts off.
+ */
+extern void tickRescale( void ) ;
+
+/** Loops of delayMicroseconds() in a us, for the core clock now */
+extern uint32_t _ulDelayLoopsPerUs ;
+
 /**
  * \brief Pauses the program for the amount of time (in microseconds) specified as parameter.
  *
@@ -82,11 +99,12 @@ static __inline__ void delayMicroseconds( unsigned int usec )
    *      bne.n loop         // 1 Core cycle + 1 if branch is taken
    */
 
-  // VARIANT_MCK / 1000000 == cycles needed to delay 1uS
-  //                     3 == cycles used in a loop
+  // SystemCoreClock / 1000000 == cycles needed to delay 1uS
+  //                         3 == cycles used in a loop
   // Divide by 3 before multiplication with usec, so that the maximum usable usec value
   // with the D51 @ 120MHz is at least what it was when multipling by usec first at 48MHz.
-  uint32_t n = usec * ((VARIANT_MCK / 1000000) / 3);
+  // Set by tickRescale(), as the core clock may be switched at run time.
+  uint32_t n = usec * _ulDelayLoopsPerUs;
   __asm__ __volatile__(
     "1:              \n"
     "   sub %0, #1   \n" // substract 1 from %0 (n)
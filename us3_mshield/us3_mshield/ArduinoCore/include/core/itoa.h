@@ -19,6 +19,8 @@
 
 #pragma once
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C"{
 #endif
@@ -30,6 +32,18 @@ extern char* itoa(int value, char*string, int radix);
         extern char* utoa(unsigned value, char*string, int radix);
         extern char* ultoa(unsigned long value, char*string, int radix);
 
+// Fixed-point decimal formatting, shared by Print, the payload writer and
+// the log: the mantissa times 10^decimals in a 64-bit integer, shifted and
+// rounded as printf would to a scaled 32-bit integer, then integer digits.
+// Returns the length written, or -1, nothing written, for NaN, infinity
+// and values whose scaled magnitude is 2^32 or more. decimals is at most 9.
+#define FTOA_FIXED_LEN 22
+        extern int ftoa_fixed(float value, char*string, uint8_t decimals);
+// The same for a double, exactly up to 3 decimals. With more it goes
+// through float, and only where the scaled magnitude is under 2^24; -1
+// otherwise, for the caller's own path.
+        extern int ftoa_fixed_exact(double value, char*string, uint8_t decimals);
+
 # ifdef __cplusplus
     } // extern "C"
 #endif
\ No newline at end of file
@@ -46,6 +46,11 @@ enum BitOrder {
 	MSBFIRST = 1
 };
 
+// Runs from SRAM, clear of the flash wait states at 48 MHz, for the
+// per byte IRQ paths. Copied out of flash with .data by the startup code,
+// see .ramfunc in the linker scripts; long_call as SRAM is past a bl.
+#define RAMFUNC __attribute__ ((long_call, section (".ramfunc")))
+
 // moved to WInterrupts.h
 ////      LOW 0
 ////      HIGH 1
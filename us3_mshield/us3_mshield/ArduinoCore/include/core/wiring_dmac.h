@@ -0,0 +1,86 @@
+/*
+  Copyright (c) 2015 Arduino LLC.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Includes Atmel CMSIS
+#include "sam.h"
+
+// DMAC channels, their first descriptors and the write-back table, and the
+// DMAC IRQ handing each channel's flags to its owner. The descriptor table
+// has a slot per channel up to DMAC_CHANNELS_MAX; further descriptors of a
+// linked list are the owner's own, DMAC_DESCRIPTOR_ALIGN'd.
+#if (SAML21 || SAMD21)
+#ifndef DMAC_CHANNELS_MAX
+#define DMAC_CHANNELS_MAX         8
+#endif
+
+#define DMAC_NO_CHANNEL           0xff
+
+// DMAC channels of the SERCOMs, kept out of dmacAlloc() (same DMAC layout
+// on D21 and L21). The UART channel raises the DMAC IRQ, and the SPI receive
+// one for SPIClass's transfers without waiting, through dmacAttach().
+#define SERCOM_DMAC_UART_TX       0
+#define SERCOM_DMAC_SPI_TX        1
+#define SERCOM_DMAC_SPI_RX        2
+#define SERCOM_DMAC_CHANNELS      3
+#define DMAC_DESCRIPTOR_ALIGN     __attribute__ ((aligned (16)))
+
+// From the DMAC IRQ, the enabled flags of the channel (TCMPL, TERR, SUSP),
+// already cleared. CHID is restored after it returns.
+typedef void (*dmacCallback)( uint8_t flags, void *context );
+
+// A free channel, now owned by the caller, or DMAC_NO_CHANNEL. The fixed
+// channels of the SERCOMs in SERCOM.h are never handed out.
+uint8_t dmacAlloc( void );
+
+// Stop a channel, drop its callback and give it back
+void dmacFree( uint8_t channel );
+
+// The first descriptor of a channel, in the table, the DMAC set up on first use
+DmacDescriptor *dmacDescriptor( uint8_t channel );
+
+// Continue with next after the block of d, NULL to end there
+static inline void dmacLink( DmacDescriptor *d, DmacDescriptor *next )
+{
+  d->DESCADDR.reg = (uint32_t)next;
+}
+
+// The flags of the channel given to the callback from the DMAC IRQ
+void dmacAttach( uint8_t channel, dmacCallback callback, void *context );
+
+// Reset the channel and start it on the descriptors: DMAC_CHCTRLB_* bits
+// (trigger, trigger action, priority), the DMAC_CHINTENSET_* flags for the
+// callback, and RUNSTDBY. The caller's CHID is restored.
+void dmacStart( uint8_t channel, uint32_t chctrlb, uint8_t interrupts, bool runStandby );
+
+// Disable the channel and its interrupts, waiting for a burst to end
+void dmacStop( uint8_t channel );
+#endif
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,77 @@
+/*
+  Copyright (c) 2015 Arduino LLC.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Includes Atmel CMSIS
+#include "sam.h"
+
+// Event System channels, handed out to the drivers that chain one
+// peripheral to another (TC overflow -> ADC start, EIC -> TC count, ...)
+// so two of them never program the same channel. Implemented on the L21,
+// elsewhere evsysAlloc() has no channel to give.
+
+#define EVSYS_NO_CHANNEL  0xff
+
+// Channel configuration for evsysRoute(), the CHANNEL register bits other
+// than EVGEN. Asynchronous needs no clock and also runs in standby; the
+// other paths get GCLK0 on the channel and may select an edge.
+#if (SAML21)
+#define EVSYS_ROUTE_ASYNC             EVSYS_CHANNEL_PATH_ASYNCHRONOUS
+#define EVSYS_ROUTE_SYNC              EVSYS_CHANNEL_PATH_SYNCHRONOUS
+#define EVSYS_ROUTE_RESYNC            EVSYS_CHANNEL_PATH_RESYNCHRONIZED
+#define EVSYS_ROUTE_RISING            EVSYS_CHANNEL_EDGSEL_RISING_EDGE
+#define EVSYS_ROUTE_FALLING           EVSYS_CHANNEL_EDGSEL_FALLING_EDGE
+#define EVSYS_ROUTE_BOTH              EVSYS_CHANNEL_EDGSEL_BOTH_EDGES
+#define EVSYS_ROUTE_STANDBY           EVSYS_CHANNEL_RUNSTDBY
+#else
+#define EVSYS_ROUTE_ASYNC             0
+#define EVSYS_ROUTE_SYNC              0
+#define EVSYS_ROUTE_RESYNC            0
+#define EVSYS_ROUTE_RISING            0
+#define EVSYS_ROUTE_FALLING           0
+#define EVSYS_ROUTE_BOTH              0
+#define EVSYS_ROUTE_STANDBY           0
+#endif
+
+// A free channel, now owned by the caller, or EVSYS_NO_CHANNEL
+uint8_t evsysAlloc( void );
+
+// Disconnect the users of an owned channel and give it back
+void evsysFree( uint8_t channel );
+
+// Drive an owned channel from an EVSYS_ID_GEN_* generator
+int evsysRoute( uint8_t channel, uint8_t generator, uint32_t config );
+
+// Feed an EVSYS_ID_USER_* input from an owned channel, or stop feeding it
+int evsysConnect( uint8_t channel, uint8_t user );
+void evsysDisconnect( uint8_t user );
+
+// evsysAlloc(), evsysRoute() and evsysConnect() in one; the channel or
+// EVSYS_NO_CHANNEL, with nothing taken
+uint8_t evsysChain( uint8_t generator, uint8_t user, uint32_t config );
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,106 @@
+#ifndef FilterFixed_h
+#define FilterFixed_h
+
+#include <Arduino.h>
+#include "FilterOnePole.h"
+#include "FilterTwoPole.h"
+
+// fixed point versions of FilterOnePole and FilterTwoPole, for cores without an FPU
+//
+// the coefficients are worked out once, in float, by setFilter() for a fixed sample
+// period, so input() is a few integer multiplies. The samples are integers, the raw
+// counts of a sensor or a value scaled to them.
+//
+// only LOWPASS and HIGHPASS of the one pole types, INTEGRATOR and DIFFERENTIATOR
+// scale by tau in seconds, and are left to the float filter
+
+// exp(-r / 65536), Q31, from a table of 1/64 steps, linearly interpolated
+uint32_t expNegQ16( uint32_t r );
+
+// one pole, int16 samples, Q15 coefficient
+//   Y += (1 - exp(-dt/tau)) * (X - Y)
+// the state keeps 15 bits below the sample, the coefficient is coarse for a tau of
+// more than a few hundred samples, FilterOnePoleQ31 is for those
+struct FilterOnePoleQ15 {
+  FILTER_TYPE FT;
+  int16_t K;      // 1 - exp(-dt/tau), Q15
+  int32_t Y;      // output, Q15 below the sample
+  int16_t X;      // most recent input value
+
+  FilterOnePoleQ15( FILTER_TYPE ft=LOWPASS, float fc=1.0, float sampleS=1.0, int16_t initialValue=0 );
+
+  // sets or resets the parameters and state of the filter, for input() every sampleS seconds
+  void setFilter( FILTER_TYPE ft, float fc, float sampleS, int16_t initialValue );
+
+  int16_t input( int16_t inVal );
+
+  int16_t output();
+
+  void setToNewValue( int16_t newVal );  // resets the filter to a new value
+};
+
+// one pole, int32 samples, Q31 coefficient
+struct FilterOnePoleQ31 {
+  FILTER_TYPE FT;
+  int32_t K;      // 1 - exp(-dt/tau), Q31
+  int64_t Y;      // output, Q31 below the sample
+  int32_t X;
+
+  FilterOnePoleQ31( FILTER_TYPE ft=LOWPASS, float fc=1.0, float sampleS=1.0, int32_t initialValue=0 );
+
+  void setFilter( FILTER_TYPE ft, float fc, float sampleS, int32_t initialValue );
+
+  int32_t input( int32_t inVal );
+
+  int32_t output();
+
+  void setToNewValue( int32_t newVal );
+};
+
+// one pole, int32 samples, at any interval, as FilterOnePole is
+// the coefficient is worked out at each input(), from the elapsed time and expNegQ16()
+struct FilterOnePoleQ31Var {
+  FILTER_TYPE FT;
+  uint32_t TauInv;  // 2^32 / tau in us
+  int64_t Y;        // output, Q31 below the sample
+  int32_t X;
+  unsigned long LastUS;
+
+  FilterOnePoleQ31Var( FILTER_TYPE ft=LOWPASS, float fc=1.0, int32_t initialValue=0 );
+
+  void setFilter( FILTER_TYPE ft, float fc, int32_t initialValue );
+
+  // timed by micros()
+  int32_t input( int32_t inVal );
+
+  // elapsedUS since the last one
+  int32_t input( int32_t inVal, uint32_t elapsedUS );
+
+  int32_t output();
+
+  void setToNewValue( int32_t newVal );
+};
+
+// two pole lowpass, int32 samples, the Bessel or Butterworth of FilterTwoPole
+// as a biquad for a fixed sample period, the bilinear transform of the oscillator
+// coefficients are Q29, the rounding carried to the next sample (error feedback),
+// so a slow filter settles on the input, not short of it. Samples to +-2^27.
+struct FilterTwoPoleQ31 {
+  int32_t Num0;        // b0, b1 = 2 * b0, b2 = b0
+  int32_t Den1, Den2;  // a1, a2
+  int32_t X1, X2;      // last inputs
+  int32_t Y1, Y2;      // last outputs
+  int32_t Err;         // rounding of the last output, Q29
+
+  FilterTwoPoleQ31( OSCILLATOR_TYPE ft=LOWPASS_BUTTERWORTH, float frequency3db=1.0, float sampleS=1.0, int32_t initialValue=0 );
+
+  void setAsFilter( OSCILLATOR_TYPE ft, float frequency3db, float sampleS, int32_t initialValue=0 );
+
+  int32_t input( int32_t drive );
+
+  int32_t output();
+
+  void setToNewValue( int32_t newVal );
+};
+
+#endif
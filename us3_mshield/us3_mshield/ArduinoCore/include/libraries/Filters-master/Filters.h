@@ -19,5 +19,7 @@
 #include "FilterTwoPole.h"
 #include "FilterDerivative.h"
 #include "RunningStatistics.h"
+#include "FilterFixed.h"
+#include "WindowStatistics.h"
 
 #endif
\ No newline at end of file
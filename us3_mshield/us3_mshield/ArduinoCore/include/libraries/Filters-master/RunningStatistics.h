@@ -7,6 +7,7 @@ struct RunningStatistics {
   // in statistics, SigmaSqr is:
   //   σ^2 = <x^2> - <x>^2
   // averages can be taken by low-pass smoothing with a (two-pole) filter
+  // WindowStatistics does the same per window in fixed point, without the clamp
   
   float AverageSecs;   // seconds to average over
   
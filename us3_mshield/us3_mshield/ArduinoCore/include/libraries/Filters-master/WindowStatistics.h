@@ -0,0 +1,43 @@
+#ifndef WindowStatistics_h
+#define WindowStatistics_h
+
+#include <Arduino.h>
+
+// statistics of the samples since the last reset(), a reporting interval
+//
+// Welford's update, in fixed point: the mean moves by (x - mean) / n and the
+// sum of squared deviations by (x - old mean) * (x - new mean), which is never
+// negative, so unlike RunningStatistics there is nothing to clamp. No float and
+// no transcendental math per sample, only at the report.
+//
+// the samples are integers, the counts of a sensor or a value scaled to them,
+// within +-2^23 of their mean. The mean is kept 16 bits below the sample.
+struct WindowStatistics {
+  uint32_t N;       // samples since the reset
+  int32_t Min;
+  int32_t Max;
+  int64_t MeanQ;    // mean, Q16
+  uint64_t M2Q;     // sum of squared deviations from the mean, Q16
+
+  WindowStatistics();
+
+  void input( int32_t inVal );
+
+  // starts the next window
+  void reset();
+
+  uint32_t count();
+
+  float mean();
+
+  // of the samples, over n - 1, 0 for fewer than 2
+  float variance();
+
+  float sigma();
+
+  int32_t minimum();
+
+  int32_t maximum();
+};
+
+#endif
@@ -52,6 +52,12 @@
 #define Rw B00000010  // Read/Write bit
 #define Rs B00000001  // Register select bit
 
+// Expander bytes per character in writeRun: each nibble set up, En high, En low.
+// An I2C byte time is the enable pulse and the settle time, so no delays.
+// A burst of them fits the Wire TX buffer.
+#define LCD_RUN_BYTES 5
+#define LCD_RUN_MAX 12
+
 class LiquidCrystal_I2C : public Print {
 public:
   LiquidCrystal_I2C(uint8_t lcd_Addr,uint8_t lcd_cols,uint8_t lcd_rows);
@@ -81,6 +87,7 @@ public:
   // Example: 	const char bell[8] PROGMEM = {B00100,B01110,B01110,B01110,B11111,B00000,B00100,B00000};
   
   void setCursor(uint8_t, uint8_t); 
+  void writeRun(const uint8_t *, uint8_t);
 #if defined(ARDUINO) && ARDUINO >= 100
   virtual size_t write(uint8_t);
 #else
@@ -6,16 +6,38 @@
 #else
  #include "WProgram.h"
 #endif
+#include <SPI.h>
+
+// Longest conversion, started each time CS goes high. Taking CS low
+// before it ends stops it, and the old reading is read again.
+#define MAX6675_CONV_MS 220
+
+// 4.3 MHz at most, mode 0
+#define MAX6675_SPI_HZ 4000000
 
 class MAX6675 {
  public:
   MAX6675(int8_t SCLK, int8_t CS, int8_t MISO);
+  // On a SERCOM SPI bus, shared by transactions with its other devices.
+  // Call begin() from setup().
+  MAX6675(int8_t CS, SPIClass &spi = SPI);
+
+  void begin(void);
+  // A new conversion was finished since the last read
+  bool ready(void);
 
+  // Read only once ready(), else the last reading again. The first
+  // read waits out the conversion begun at power-up.
   double readCelsius(void);
   double readFahrenheit(void);
   // For compatibility with older versions:
   double readFarenheit(void) { return readFahrenheit(); }
  private:
   int8_t sclk, miso, cs;
+  SPIClass *_spi;
+  uint32_t _start;
+  uint16_t _raw;
+  bool _read;
+  uint16_t read16(void);
   uint8_t spiread(void);
 };
@@ -34,6 +34,9 @@
 // SPI_HAS_NOTUSINGINTERRUPT means that SPI has notUsingInterrupt() method
 #define SPI_HAS_NOTUSINGINTERRUPT 1
 
+// Shortest transfer(txbuf, rxbuf, count) worth setting up the DMAC for
+#define SPI_DMA_MIN 16
+
 #define SPI_MODE0 0x02
 #define SPI_MODE1 0x00
 #define SPI_MODE2 0x03
@@ -114,6 +117,12 @@ class SPIClass {
   byte transfer(uint8_t data);
   uint16_t transfer16(uint16_t data);
   void transfer(void *buf, size_t count);
+  void transfer(const void *txbuf, void *rxbuf, size_t count);
+  // Without waiting, onComplete(context) from the DMAC IRQ at the end; false
+  // if one is running. Without DMAC triggers it is done, onComplete too, on return.
+  bool transfer(const void *txbuf, void *rxbuf, size_t count, void (*onComplete)(void *), void *context);
+  bool transferBusy(void) { return _dmaBusy; }
+  void dmaHandler(void);
 
   // Transaction Functions
   void usingInterrupt(int interruptNumber);
@@ -145,6 +154,9 @@ class SPIClass {
   SercomRXPad _padRx;
 
   bool initialized;
+  volatile bool _dmaBusy;
+  void (*_dmaComplete)(void *);
+  void *_dmaContext;
   uint8_t interruptMode;
   char interruptSave;
   uint32_t interruptMask;
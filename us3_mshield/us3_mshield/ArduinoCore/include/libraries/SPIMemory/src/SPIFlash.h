@@ -58,6 +58,8 @@ public:
   uint16_t sizeofStr(String &inputStr);
   uint32_t getCapacity(void);
   uint32_t getMaxPage(void);
+  uint16_t getPageSize(void);
+  uint32_t getEraseSize(void);
   float    functionRunTime(void);
   //-------------------------------- Write / Read Bytes ---------------------------------//
   bool     writeByte(uint32_t _addr, uint8_t data, bool errorCheck = true);
@@ -158,6 +160,7 @@ private:
   #ifdef SPI_HAS_TRANSACTION
     SPISettings _settings;
     bool _SPISettingsSet = false;
+    uint32_t _clockSpeed = SPI_CLK;
   #else
     uint8_t _clockdiv;
   #endif
@@ -210,7 +213,8 @@ private:
               uint32_t time;
             } kb4Erase, kb32Erase, kb64Erase, kb256Erase, chipErase;
   uint8_t     _noOfParamHeaders, _noOfBasicParamDwords;
-  uint16_t    _eraseTimeMultiplier, _prgmTimeMultiplier, _pageSize;
+  uint16_t    _eraseTimeMultiplier, _prgmTimeMultiplier, _pageSize = SPI_PAGESIZE;
+  uint8_t     _fastRead = FASTREAD;    // Opcode of a fastRead read, chosen by begin()
   uint32_t    currentAddress, _currentAddress = 0;
   uint32_t    _addressOverflow = false;
   uint32_t    _BasicParamTableAddr, _SectorMapParamTableAddr, _byteFirstPrgmTime, _byteAddnlPrgmTime, _pagePrgmTime;
@@ -313,7 +317,7 @@ template <class T> bool SPIFlash::_write(uint32_t _addr, const T& value, uint32_
   //Serial.print(F("Address being written to: "));
   //Serial.println(_addr);
   uint32_t length = _sz;
-  uint16_t maxBytes = SPI_PAGESIZE-(_addrIn % SPI_PAGESIZE);  // Force the first set of bytes to stay within the first page
+  uint16_t maxBytes = _pageSize-(_addrIn % _pageSize);  // Force the first set of bytes to stay within the first page
 
   if (!SPIBusState) {
     _startSPIBus();
@@ -334,7 +338,7 @@ template <class T> bool SPIFlash::_write(uint32_t _addr, const T& value, uint32_
 
     do {
       writeBufSz = (length<=maxBytes) ? length : maxBytes;
-      if(_currentAddress % SPI_PAGESIZE==0){
+      if(_currentAddress % _pageSize==0){
         CHIP_SELECT
         _nextByte(WRITE, PAGEPROG);
         _transferAddress();
@@ -354,7 +358,7 @@ template <class T> bool SPIFlash::_write(uint32_t _addr, const T& value, uint32_
       }
       data_offset += writeBufSz;
       length -= writeBufSz;
-      maxBytes = SPI_PAGESIZE;   // Now we can do up to 256 bytes per loop
+      maxBytes = _pageSize;   // Now we can do up to a page per loop
       if(!_notBusy() || !_writeEnable()) {
         return false;
       }
@@ -408,7 +412,7 @@ template <class T> bool SPIFlash::_read(uint32_t _addr, T& value, uint32_t _sz,
     else {
       CHIP_SELECT
       if (fastRead) {
-        _beginSPI(FASTREAD);
+        _beginSPI(_fastRead);
       }
       else {
         _beginSPI(READDATA);
@@ -193,6 +193,7 @@
 #else
 #define SPI_CLK       104000000       //Hz equivalent of 104MHz
 #endif
+#define READDATA_MAX_CLK 25000000     //Hz READDATA is rated for on the supported chips, FASTREAD above it
 #define ENFASTREAD    0x01
 #define WRTEN         0x02
 #define SUS           0x80
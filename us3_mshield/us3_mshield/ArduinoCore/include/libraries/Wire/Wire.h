@@ -30,6 +30,25 @@
  // WIRE_HAS_END means Wire has end()
 #define WIRE_HAS_END 1
 
+// A transaction for TwoWire::submit(): txLength bytes written, then rxLength
+// read after a repeated start, one of them may be 0. status is 0 in a new one,
+// WIRE_PENDING once submitted, then as endTransmission() returns. onComplete
+// runs in the interrupt and may submit, but not block on the bus.
+#define WIRE_PENDING 0xff
+
+struct WireTransaction
+{
+  uint8_t address;
+  const uint8_t *txData;
+  size_t txLength;
+  uint8_t *rxData;
+  size_t rxLength;
+  void (*onComplete)(WireTransaction *);
+  void *context;
+  volatile uint8_t status;
+  WireTransaction *next;
+};
+
 class TwoWire : public Stream
 {
   public:
@@ -56,6 +75,10 @@ class TwoWire : public Stream
     void onReceive(void(*)(int));
     void onRequest(void(*)(void));
 
+    // Queue a transaction, started at once if the bus is free; false if pending already
+    bool submit(WireTransaction *t);
+    bool busy(void) { return asyncHead != NULL; }
+
     inline size_t write(unsigned long n) { return write((uint8_t)n); }
     inline size_t write(long n) { return write((uint8_t)n); }
     inline size_t write(unsigned int n) { return write((uint8_t)n); }
@@ -72,6 +95,16 @@ class TwoWire : public Stream
 
   private:
     SERCOM * sercom;
+
+    // Transactions queued by submit(), the head on the bus
+    WireTransaction * volatile asyncHead;
+    WireTransaction *asyncTail;
+    size_t asyncPos;
+    bool asyncReading;
+
+    void asyncStart(void);
+    void asyncFinish(uint8_t status);
+    void onMasterService(void);
     uint8_t _uc_pinSDA;
     uint8_t _uc_pinSCL;
 
@@ -34,6 +34,15 @@ written by Adafruit Industries
 #define DHT21 21
 #define AM2301 21
 
+// Result of poll(): a read going on, or how the last one ended.
+#define DHT_OK    0
+#define DHT_BUSY  1
+#define DHT_ERR  -1
+
+// Falling edges kept of a frame, 42 in one: the response, the 40 bits and
+// the closing low pulse.
+#define DHT_EDGES 48
+
 
 class DHT {
   public:
@@ -46,18 +55,30 @@ class DHT {
    float readHumidity(bool force=false);
    boolean read(bool force=false);
 
+   // Read in the background: start() sends the start signal, then poll()
+   // moves the read on until it returns DHT_OK or DHT_ERR. Interrupts stay
+   // on throughout, the bits are timed by the pin interrupt.
+   bool start(void);
+   int8_t poll(void);
+   bool busy(void);
+   // Values of the last read, NAN if it failed, without reading again
+   float temperature(bool S=false);
+   float humidity(void);
+
  private:
   uint8_t data[5];
   uint8_t _pin, _type;
-  #ifdef __AVR
-    // Use direct GPIO access on an 8-bit AVR so keep track of the port and bitmask
-    // for the digital pin connected to the DHT.  Other platforms will use digitalRead.
-    uint8_t _bit, _port;
-  #endif
-  uint32_t _lastreadtime, _maxcycles;
+  uint8_t _state;
+  uint32_t _lastreadtime, _statetime;
   bool _lastresult;
 
-  uint32_t expectPulse(bool level);
+  // micros() of the falling edges, taken by edge() while the frame comes in
+  volatile uint16_t _edges[DHT_EDGES];
+  volatile uint8_t _nedges;
+  static DHT *_active;
+
+  static void edge(void);
+  bool decode(void);
 
 };
 
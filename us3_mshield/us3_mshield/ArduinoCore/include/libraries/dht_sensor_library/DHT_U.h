@@ -64,6 +64,11 @@ public:
     return _humidity;
   }
 
+  // Both values come from one read, see DHT::start() and DHT::poll()
+  DHT& dht() {
+    return _dht;
+  }
+
 private:
   DHT _dht;
   uint8_t _type;
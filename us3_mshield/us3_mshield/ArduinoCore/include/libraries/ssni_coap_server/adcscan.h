@@ -0,0 +1,128 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+/*
+ * Background scan of the ADC inputs.
+ *
+ * TC4 overflows at the scan rate and its event, over an asynchronous
+ * EVSYS channel, starts the ADC. The ADC sequencer then converts every
+ * input of the scan in turn, lowest AIN first, each one oversampled by
+ * AVGCTRL, and the DMAC takes each result as it is ready into one half
+ * of a double buffer. The two descriptors of the buffer link to each
+ * other, so the DMAC goes on into the other half on its own and the CPU
+ * is only interrupted once a half is full. TC, ADC and DMAC all run in
+ * standby, on the main clock lpidle keeps there.
+ *
+ * Accumulating 4^k samples and shifting the sum right by k gives k bits
+ * past the 12 of the ADC, so 16 samples give 14 bits and 256 the whole
+ * 16 of RESULT. Noise on the input of an LSB or so is what makes this
+ * work, in the way the input of a dither would.
+ *
+ * The scan takes the ADC off analogRead(), which is not to be used while
+ * it runs, and the ADC is left as analogRead() had it when it stops.
+ * TC4 is the PWM timer of PB08 and PB09 on some boards, which can then
+ * not be used for analogWrite().
+ */
+
+#ifndef _ADCSCAN_H_
+#define _ADCSCAN_H_
+
+#include <Arduino.h>
+
+/* Inputs a scan takes */
+#define ADC_SCAN_MAX            4
+
+/* Scans in each half of the buffer, so the IRQ rate is rate_hz / this */
+#ifndef ADC_SCAN_BLOCK
+#define ADC_SCAN_BLOCK          32
+#endif
+
+/* Oversampling is 1 << avg_log2 samples, up to 256 */
+#define ADC_SCAN_AVG_MAX        8
+
+/* ADC clock, 48 MHz / 16, and the sampling time in its half cycles */
+#define ADC_SCAN_PRESCALER      ADC_CTRLB_PRESCALER_DIV16
+#define ADC_SCAN_SAMPLEN        3
+
+/* Conversions a second the ADC keeps up with at that clock, with margin */
+#define ADC_SCAN_CONV_HZ        150000
+
+#define ADC_SCAN_OK             0
+#define ADC_SCAN_ERR_ARG        -1  /* no inputs, too many, or one not an ADC pin */
+#define ADC_SCAN_ERR_RATE       -2  /* more conversions than the ADC can make */
+#define ADC_SCAN_ERR_CHIP       -3  /* no DMAC for the ADC on this chip */
+#define ADC_SCAN_ERR_EVSYS      -4  /* no free EVSYS channel from TC4 to the ADC */
+#define ADC_SCAN_ERR_DMAC       -5  /* no free DMAC channel */
+
+/* What a scan was started with, to start it again after another */
+struct adc_scan_cfg {
+    uint8_t pins[ADC_SCAN_MAX];
+    uint8_t n;                  /* 0 for no scan */
+    uint32_t rate_hz;
+    uint8_t avg_log2;
+};
+
+/*
+ * A filled half of the buffer, len results of the inputs in scan order,
+ * from the DMAC IRQ. Valid until the half after it is full.
+ */
+typedef void (*adc_scan_block_fn)(const uint16_t *block, uint16_t len);
+
+/*
+ * Scan the n pins, rate_hz times a second, each conversion oversampled
+ * by 1 << avg_log2. A scan already running is stopped first.
+ */
+int adc_scan_start(const uint8_t *pins, uint8_t n, uint32_t rate_hz, uint8_t avg_log2);
+
+void adc_scan_stop(void);
+
+/* 1 while scanning, 0 if stopped or the DMAC gave up on a bus error */
+uint8_t adc_scan_running(void);
+
+/* The scan running, n 0 if none */
+void adc_scan_get(struct adc_scan_cfg *cfg);
+
+/* Hand each filled half to fn as well, NULL for none */
+void adc_scan_on_block(adc_scan_block_fn fn);
+
+/* Bits of each result, 12 + avg_log2 / 2 */
+uint8_t adc_scan_bits(void);
+
+/* Halves of the buffer filled since adc_scan_start */
+uint32_t adc_scan_blocks(void);
+
+/*
+ * Mean of pin over the last half filled, at adc_scan_bits(). -1 if the
+ * pin is not scanned or no half has been filled yet.
+ */
+int32_t adc_scan_value(uint8_t pin);
+
+#endif /* _ADCSCAN_H_ */
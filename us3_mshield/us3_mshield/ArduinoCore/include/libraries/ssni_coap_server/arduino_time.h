@@ -45,6 +45,19 @@ extern RTCDue rtc;
 #define setEpoch setClock
 #endif
 
+// How often the millis() count of get_rtc_epoch() is checked against the RTC
+#ifndef RTC_EPOCH_SYNC_MS
+#define RTC_EPOCH_SYNC_MS	600000UL
+#endif
+
+// Shortest time between network time sets the RTC drift is measured over, 1 s in it is ~12 ppm
+#ifndef RTC_DRIFT_MIN_SECS
+#define RTC_DRIFT_MIN_SECS	86400L
+#endif
+
+// Largest RTC frequency correction, FREQCORR steps of 1/1048576 (~0.95 ppm)
+#define RTC_CORR_MAX		127
+
 
 /**
  * @brief Set time zone
@@ -65,6 +78,49 @@ error_t rtc_time_init( int32_t zone );
  */
 time_t get_rtc_epoch();
 
+/**
+ *
+ * @brief Get the epoch at a millis() time, for sub-second timestamps
+ *
+ * @param at_ms millis() of the moment
+ * @param ms    Set to the milliseconds past the epoch returned, 0-999. May be NULL.
+ * @return time_t The epoch of the moment
+ */
+time_t get_rtc_epoch_at(uint32_t at_ms, uint16_t *ms);
+
+/**
+ *
+ * @brief Set the RTC, and the epoch get_rtc_epoch() counts from
+ *
+ */
+void set_rtc_epoch(time_t epoch);
+
+/**
+ *
+ * @brief Set the epoch of the second that began at millis() at_ms
+ *
+ * For a second boundary known to the ms, a GPS PPS edge. The RTC is only
+ * written when it is a whole second or more off.
+ *
+ */
+void set_rtc_epoch_at(time_t epoch, uint32_t at_ms);
+
+/**
+ *
+ * @brief Set the RTC frequency correction
+ *
+ * @param corr 1/1048576 steps, > 0 slows the RTC, clamped to RTC_CORR_MAX
+ */
+void set_rtc_corr(int16_t corr);
+
+/**
+ *
+ * @brief RTC frequency correction worked out from the network time sets
+ *
+ * @return int16_t 1/1048576 steps, > 0 when the crystal runs fast
+ */
+int16_t get_rtc_corr(void);
+
 /**
 * @brief
 * Prints the current time
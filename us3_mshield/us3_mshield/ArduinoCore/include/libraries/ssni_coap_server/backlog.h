@@ -0,0 +1,139 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+/*
+ * The sample log, samples SAPI could not forward when they were taken.
+ *
+ * A circular log of BACKLOG_SECTORS sectors in the SPI flash. Each sector
+ * starts with a header carrying its sequence number, backlog_load finds
+ * the head in the newest sector at boot and the tail at the first record
+ * not sent, from the oldest on. backlog_put appends at the head, the
+ * oldest sector goes when the log wraps, and backlog_commit marks records
+ * sent from the tail. Only the sent byte of a record is written again, to
+ * 0, so nothing is rewritten before an erase.
+ *
+ * Records are appended to a page buffer in RAM the caller gives, programmed
+ * once the page is full or on backlog_flush. They are not read back, the
+ * record CRC is checked where they are read. A sector's header gets the
+ * epochs it spans once it is done, so a RAM index of them, rebuilt at boot
+ * from the headers alone, finds where a since query starts in one sector
+ * read.
+ */
+
+#ifndef _BACKLOG_H_
+#define _BACKLOG_H_
+
+#include <stdint.h>
+#include "sapi.h"
+
+#define BACKLOG_ADDR            0x20000UL
+#define BACKLOG_SECTOR          4096
+#define BACKLOG_SECTORS         16
+#define BACKLOG_PAGE            256         /* SPI flash program page */
+#define BACKLOG_MAGIC           0x4C42      /* "BL" */
+#define BACKLOG_REC_MARK        0x42        /* "B" */
+
+/* A sample of the log. Only sent is written again, from 0xFF to 0, as the
+ * SPI flash can not overwrite the other bytes without an erase. */
+struct backlog_rec {
+    uint8_t mark;               /* BACKLOG_REC_MARK, 0xFF -> free */
+    uint8_t sensor_id;          /* Sensor sampled */
+    uint16_t crc;               /* crc_xmodem of sensor_id and the sample */
+    uint32_t epoch;             /* The sample */
+    float value;
+    uint8_t datatype;
+    uint8_t sent;               /* 0xFF until sent, then 0 */
+    uint16_t ms;                /* Past epoch, 0xFFFF in records from before */
+};
+
+/* Where the log stands, in flash addresses. Only backlog.cpp changes it. */
+struct backlog {
+    uint32_t seq;               /* Sequence of the head sector, 0 -> no sector yet */
+    uint32_t head;              /* Next free record, its sector's end once full */
+    uint32_t tail;              /* Oldest record not sent, head -> none */
+    uint32_t page;              /* Page in the page buffer, 0 -> none */
+    uint32_t page_ms;           /* millis() of its first record not programmed */
+    uint16_t page_from;         /* Its records not programmed, offsets in the page */
+    uint16_t page_to;
+    uint16_t dropped;           /* Records lost to a wrap, or not written */
+    uint8_t sector;             /* Sector of head */
+};
+
+extern struct backlog backlog;
+
+/* Recover the head and tail at boot. buf is the page buffer, BACKLOG_PAGE
+ * bytes. */
+void backlog_load(uint8_t *buf);
+
+/* Carry on with the records the last run left in the page buffer, kept
+ * over the reset with where they stood: seq of the head sector, page and
+ * the records not programmed, from and to. Only if the flash head is still
+ * where they start, up to the first that fails its CRC. Returns how many. */
+uint16_t backlog_resume(uint32_t seq, uint32_t page, uint16_t from, uint16_t to);
+
+/* Append a sample of a sensor at the head */
+bool backlog_put(uint8_t sensor_id, const sapi_sample_t *sample);
+
+/* Program the records of the page buffer, one page program */
+void backlog_flush(void);
+
+/* Mark n records sent, from the tail, and move the tail past them */
+void backlog_commit(uint8_t n);
+
+/* Record slots from the tail to the head */
+uint32_t backlog_waiting(void);
+
+/* The record after addr, past the header of the next sector at the end of
+ * one. head is returned as it is. */
+uint32_t backlog_next(uint32_t addr);
+
+/* Read the record at addr, from the page buffer while it is there */
+void backlog_read(uint32_t addr, struct backlog_rec *rec);
+
+/* Read up to n records from addr on in one burst, which ends at the head
+ * or the end of the sector. Returns the records read. */
+uint8_t backlog_read_run(uint32_t addr, struct backlog_rec *recs, uint8_t n);
+
+/* The first samples of a sensor at or after since still in the log, sent
+ * or not, oldest sector first, up to want. Returns how many, -1 without
+ * the scratch to read them. */
+int backlog_find(uint8_t sensor_id, uint32_t since, sapi_sample_t *samples, uint8_t want);
+
+/* A record that was written whole */
+bool backlog_rec_good(const struct backlog_rec *rec);
+
+/* A record that was written whole and not sent yet */
+bool backlog_rec_live(const struct backlog_rec *rec);
+
+/* The sample of a record */
+void backlog_sample(const struct backlog_rec *rec, sapi_sample_t *sample);
+
+#endif /* _BACKLOG_H_ */
@@ -0,0 +1,67 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+/*
+ * Cycle counts of the library's hot paths, on the mShield itself.
+ *
+ * The M0+ has no DWT cycle counter, and the TCs of the G18B are taken,
+ * TC0 by pulsecnt, TC1 by Tone and TC4 by adcscan. SysTick, which runs
+ * millis() off the core clock, is the counter instead: the milliseconds it
+ * has counted and how far it is down the current one make a count of core
+ * cycles, read without the sync wait of a TC. Each case is run
+ * BENCH_RUNS times, over the same inputs each time, with the cost of
+ * reading the counter taken off, and printed as the least, mean and most
+ * cycles and the mean in us.
+ *
+ * The first run takes the flash wait states and cache misses, so min is
+ * the steady cost and max the cold one. Interrupts stay on, a SysTick or
+ * UART IRQ in a run shows in max only.
+ *
+ * Run from the boot menu, "!". Left out unless BENCH is 1.
+ */
+
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <Arduino.h>
+
+#ifndef BENCH
+#define BENCH                   0
+#endif
+
+#define BENCH_RUNS              32
+
+#if BENCH
+/* Time each case and print the table on out */
+void bench_run(Print *out);
+#endif
+
+#endif /* _BENCH_H_ */
@@ -0,0 +1,78 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+/*
+ * Boot sequence, setup() steps run as a task after it.
+ *
+ * The steps a first CoAP response does not need, device warm-ups, startup
+ * commands, the drivers of optional ports, are left to a table run by one
+ * scheduler task once setup() returns, so they overlap the mNIC link
+ * coming up instead of holding it back. A step runs once the steps in its
+ * after mask are done, one step a pass so the link and observe tasks run
+ * in between. It returns BOOT_STEP_DONE, or the ms to wait before it is
+ * run again, for a device still warming up.
+ */
+
+#ifndef _BOOTSEQ_H_
+#define _BOOTSEQ_H_
+
+#include <Arduino.h>
+
+#define BOOT_MAX_STEPS          16
+
+/* A step's return when it is done */
+#define BOOT_STEP_DONE          0
+
+/* The after mask of a step waiting for step i of the table */
+#define BOOT_AFTER(i)           (1U << (i))
+
+typedef uint32_t (*boot_step_fn)(void);
+
+struct boot_step {
+    const char *name;
+    boot_step_fn run;
+    uint16_t after;             /* steps done before this one, BOOT_AFTER() each */
+};
+
+/*
+ * Run the n steps of tab, at most BOOT_MAX_STEPS, from the task's first
+ * pass. tab is kept. Returns -1 if the scheduler had no room for the task.
+ */
+int boot_seq_start(const struct boot_step *tab, uint8_t n);
+
+/* Non-zero once every step is done */
+uint8_t boot_seq_done(void);
+
+/* Print the steps, done or waiting, and when each was done, on the console */
+void boot_seq_dump(void);
+
+#endif /* _BOOTSEQ_H_ */
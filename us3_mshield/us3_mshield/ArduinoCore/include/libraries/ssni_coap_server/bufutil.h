@@ -51,5 +51,25 @@ float buf_lefloat(const void *buf, int idx);
 double buf_bedouble(const void *buf, int idx);
 double buf_ledouble(const void *buf, int idx);
 
+/*
+ * Bounded text writer, for payloads. Writes past the end set err and are
+ * dropped whole, the text stays NUL terminated. No printf: the number
+ * formatters are plain integer arithmetic.
+ */
+struct txt_buf {
+    char *head;
+    char *tail;     /* last byte, kept for the NUL */
+    char *next;
+    int err;
+};
+
+void txt_init(struct txt_buf *tb, char *buf, int len);
+int txt_len(const struct txt_buf *tb);
+int txt_append_str(struct txt_buf *tb, const char *s);
+int txt_append_char(struct txt_buf *tb, char c);
+int txt_append_u32(struct txt_buf *tb, uint32_t val);
+int txt_append_i32(struct txt_buf *tb, int32_t val);
+int txt_append_fixed(struct txt_buf *tb, float val, uint8_t decimals);
+
 
 #endif
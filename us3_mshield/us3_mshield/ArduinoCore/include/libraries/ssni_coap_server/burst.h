@@ -0,0 +1,105 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+/*
+ * Burst capture of one ADC input.
+ *
+ * A burst takes the ADC scan of adcscan over for a few seconds, at the
+ * hundreds of Hz a surge of a pump or a gauge needs, and the DMAC IRQ
+ * copies each filled half of the scan buffer on into a RAM buffer until
+ * it holds the samples asked for. The scan that ran before is then
+ * started again. Min, max, mean, RMS and the peaks over a level are
+ * worked out once, at the end, with WindowStatistics, so what goes over
+ * the air can be those few figures rather than the samples. The samples
+ * stay until the next burst, for burst_csv() to send them on request.
+ *
+ * A peak is a rise to the level or above, counted again only after a
+ * fall below the level by a quarter of its height over the mean.
+ */
+
+#ifndef _BURST_H_
+#define _BURST_H_
+
+#include <Arduino.h>
+
+/* Samples a burst holds, 2 bytes each */
+#ifndef BURST_MAX_SAMPLES
+#define BURST_MAX_SAMPLES       2048
+#endif
+
+/* Time past the one the samples take before a burst is given up on */
+#define BURST_SLACK_MS          1000
+
+/* Each sample as burst_csv() writes it, 5 digits and a newline */
+#define BURST_CSV_WIDTH         6
+
+#define BURST_OK                0
+#define BURST_ERR_ARG           -1  /* no samples, or more than BURST_MAX_SAMPLES */
+#define BURST_ERR_BUSY          -4  /* a burst runs */
+
+struct burst_summary {
+    uint16_t n;             /* samples, 0 if the burst failed */
+    uint32_t rate_hz;
+    uint8_t bits;           /* of each sample, adc_scan_bits() */
+    uint16_t min;
+    uint16_t max;
+    float mean;
+    float rms;
+    float sigma;
+    uint16_t level;         /* peaks counted over */
+    uint16_t peaks;
+};
+
+/*
+ * Take samples of pin at rate_hz, oversampled as adc_scan_start. Peaks
+ * are counted over level, 0 for halfway from the mean to the max.
+ * Returns BURST_OK, a BURST_ERR, or an ADC_SCAN_ERR of the scan.
+ */
+int burst_start(uint8_t pin, uint32_t rate_hz, uint16_t samples, uint8_t avg_log2, uint16_t level);
+
+/*
+ * From the main loop. Returns 1 once, when the burst ended, with the
+ * summary worked out and the scan before it started again.
+ */
+uint8_t burst_poll(void);
+
+uint8_t burst_busy(void);
+
+/* The last burst, n 0 if none or it failed. Returns n */
+uint16_t burst_summary_get(struct burst_summary *s);
+
+/*
+ * Its samples as text, from offset into buf, up to size bytes. Returns
+ * the bytes written, more set if they go on past them.
+ */
+uint16_t burst_csv(char *buf, uint32_t offset, uint16_t size, uint8_t *more);
+
+#endif /* _BURST_H_ */
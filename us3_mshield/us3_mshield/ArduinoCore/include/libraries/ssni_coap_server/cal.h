@@ -0,0 +1,81 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+/*
+ * Piecewise linear calibration of sampled values, see sapi_set_calibration.
+ *
+ * Up to CAL_MAX tables, one per sensor and datatype, of up to
+ * SAPI_CAL_POINTS breakpoints in Q16.16. The slope of each segment is
+ * kept, so a sample takes a multiply and no division to map. Saved in a
+ * log sector of the SPI flash, a record per change, the last of a sensor
+ * and datatype counts. Once the log is full it is erased and the tables
+ * written at its start.
+ */
+
+#ifndef _CAL_H_
+#define _CAL_H_
+
+#include <stdint.h>
+#include "sapi.h"
+
+#define CAL_MAX                 4
+#define CAL_LOG_ADDR            0x14000UL
+#define CAL_LOG_SIZE            4096
+#define CAL_REC_MARK            0x43        /* "C" */
+
+struct cal {
+    sapi_cal_point_t pt[SAPI_CAL_POINTS];   /* Raw ascending */
+    int32_t slope[SAPI_CAL_POINTS - 1];     /* Q16.16 eng per raw, from pt[i] on */
+    uint8_t n;                              /* Breakpoints, 0 -> unused */
+    uint8_t sensor_id;                      /* Sensor sampled */
+    uint8_t datatype;                       /* Data type calibrated */
+};
+
+/* The tables saved before the restart, and where the log ends */
+void cal_load(void);
+
+/* The table of a sensor's datatype, NULL if none */
+const struct cal *cal_find(uint8_t sensor_id, uint8_t datatype);
+
+/* Set the table of a sensor's datatype to n breakpoints, saved once
+ * changed, n 0 removes it. SAPI_ERR_BAD_DATA unless raw ascends,
+ * SAPI_ERR_NO_MEM without a free table, SAPI_ERR_FAIL if it was not
+ * saved. */
+sapi_error_t cal_set(uint8_t sensor_id, uint8_t datatype, const sapi_cal_point_t *pt, uint8_t n);
+
+/* Map a Q16.16 raw value along a table, saturated */
+int32_t cal_eval(const struct cal *c, int32_t raw);
+
+/* Map the samples of a read of a sensor, those of the datatypes
+ * calibrated */
+void cal_apply(uint8_t sensor_id, sapi_sample_t *samples, uint8_t count);
+
+#endif /* _CAL_H_ */
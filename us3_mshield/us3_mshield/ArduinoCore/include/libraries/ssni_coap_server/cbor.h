@@ -22,7 +22,13 @@
 #define CBOR_PRIM_BOOL_TRUE           0x15
 #define CBOR_PRIM_NULL                0x16
 #define CBOR_PRIM_UNDEF               0x17
+#define CBOR_PRIM_FLOAT16             0x19
 #define CBOR_PRIM_FLOAT32             0x1A
+
+/* RFC 8746 typed array tags, the tagged item is a byte string */
+#define CBOR_TAG_TA_SINT16_BE         73
+#define CBOR_TAG_TA_FLOAT16_BE        80
+#define CBOR_TAG_TA_FLOAT32_BE        81
 /* END CBOR PRIMITIVE VALUES */
 
 #define CBOR_MJR0_THRESHOLD           0x17
@@ -42,6 +48,9 @@
 #define CBOR_INV_ADDNL_INFO       (1 << 3)
 #define CBOR_NOT_WELL_FRMD        (1 << 4)
 
+#define CBOR_DEC_INDEF            -2  /* indefinite length array or map */
+#define CBOR_DEC_DEPTH_MAX        8   /* nesting limit of cbor_dec_skip */
+
 #define CBOR_DBG                  0
 #if CBOR_DBG
 #define CBOR_DBG_PRINT(...) printf(__VA_ARGS__)
@@ -73,6 +82,13 @@ void cbor_enc_indef_term(struct cbor_buf *cbuf);
 int cbor_enc_prim_float32(struct cbor_buf *cbuf, float val);
 void cbor_enc_prim_undef(struct cbor_buf *cbuf);
 int cbor_enc_uint(struct cbor_buf *cbuf, uint32_t val);
+int cbor_enc_prim_float16(struct cbor_buf *cbuf, float val);
+int cbor_enc_tag(struct cbor_buf *cbuf, uint32_t tag);
+int cbor_enc_typed_float16(struct cbor_buf *cbuf, const float *vals, int num_elements);
+int cbor_enc_typed_float32(struct cbor_buf *cbuf, const float *vals, int num_elements);
+int cbor_enc_typed_sint16(struct cbor_buf *cbuf, const int16_t *vals, int num_elements);
+int cbor_enc_series(struct cbor_buf *cbuf, uint32_t epoch, uint32_t step,
+                    const int32_t *vals, int num_elements);
 
 /* CBOR Decoder API */
 void cbor_dec_init(struct cbor_buf *cbuf, void *buf, int len);
@@ -87,6 +103,7 @@ bool cbor_dec_indef_break(struct cbor_buf *cbuf);
 int cbor_dec_primitive(struct cbor_buf *cbuf);
 int cbor_dec_prim_float32(struct cbor_buf *cbuf, float *val);
 int cbor_dec_uint(struct cbor_buf *cbuf, uint32_t *val);
+int cbor_dec_skip(struct cbor_buf *cbuf);
 
 
 #if CBOR_64_BIT /* include support for 64-bit integers on 32-bit CPU */
@@ -0,0 +1,161 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+/*
+ * The configuration, its parameters by CFG_* index and their store in the
+ * SPI flash.
+ *
+ * The store is over CFG_SECTORS sectors used in turn. The one in use, of
+ * the highest sequence, starts with a header and an image of all the
+ * values, loaded with one read. Each parameter changed since is a record
+ * after it. Only once the sector is full are the values compacted into an
+ * image in the next one, its header written last, so a reset midway leaves
+ * the last sector in use. The boot menu text of older firmware, at
+ * CFG_TEXT_ADDR, is imported when there is no image, and the image and log
+ * of the layout before, with the image at CFG_V2_IMG_ADDR and the log in
+ * the first sector, are taken over.
+ *
+ * The values are read through a sapi_config_t snapshot. cfg_publish builds
+ * it in the snapshot not in use, then swaps it in with one pointer store.
+ */
+
+#ifndef _CFG_H_
+#define _CFG_H_
+
+#include <Arduino.h>
+#include "sapi.h"
+
+#define CFG_TEXT_ADDR           1
+#define CFG_ADDR                0x10000UL
+#define CFG_SECTOR              4096
+#define CFG_SECTORS             2
+#define CFG_V2_IMG_ADDR         0x11000UL
+#define CFG_HDR_MAGIC           0x5343      /* "CS" */
+#define CFG_MAGIC               0x4643      /* "CF" */
+#define CFG_VERSION             2
+#define CFG_REC_MARK            0x5A
+
+/* Values in a version 1 image, which had their size in place of the count */
+#define CFG_V1_COUNT            8
+
+/* Parameter indexes, in the image order. Add new ones at the end, an older
+ * image leaves them at their defaults. */
+enum {
+    CFG_SEND_INTERVAL,
+    CFG_SAMPLE_RATE,
+    CFG_DIGITAL10,
+    CFG_DIGITAL11,
+    CFG_RELAY1,
+    CFG_RELAY2,
+    CFG_ANALOG4,
+    CFG_ANALOG5,
+    CFG_FAST_BOOT,
+    CFG_MB_BAUD,
+    CFG_MB_FORMAT,
+    CFG_RULE1_CHAN,
+    CFG_RULE1_OP,
+    CFG_RULE1_LIMIT,
+    CFG_RULE1_HYST,
+    CFG_RULE1_ACTION,
+    CFG_RULE1_MIN_ON,
+    CFG_RULE1_MIN_OFF,
+    CFG_RULE2_CHAN,
+    CFG_RULE2_OP,
+    CFG_RULE2_LIMIT,
+    CFG_RULE2_HYST,
+    CFG_RULE2_ACTION,
+    CFG_RULE2_MIN_ON,
+    CFG_RULE2_MIN_OFF,
+    CFG_COUNT
+};
+
+/* Parameters of a relay rule, from CFG_RULE1_CHAN on, one rule after the other */
+#define CFG_RULE_PARAMS         7
+
+/* A parameter, set by setValue, the boot menu and a CBOR PUT "cfg" */
+struct cfg_param {
+    const char *name;           /* Parameter name, as in the flash string */
+    int *value;                 /* Current value */
+    uint8_t timing;             /* 1 -> re-arms the sensors following the configuration */
+};
+
+extern const struct cfg_param cfg_params[CFG_COUNT];
+
+/* The values, by their parameter names */
+extern int sendInterval;
+extern int sampleRate;
+extern int Digital10;
+extern int Digital11;
+extern int Relay1;
+extern int Relay2;
+extern int Analog4;
+extern int Analog5;
+extern int FastBoot;
+extern int ModbusBaud;
+extern int ModbusFormat;
+
+/* Index of a parameter, CFG_COUNT if unknown */
+uint8_t cfg_find(const char *name, int len);
+
+/* Set a parameter, then sapi_cfg_applied for the pins that follow it */
+void cfg_apply(uint8_t index, int value);
+
+/* Publish the values as a new snapshot, if one changed */
+void cfg_publish(void);
+
+/* The snapshot in effect */
+const sapi_config_t *cfg_config(void);
+
+/* Import the boot menu text, "<name>:<value>,...,." Returns the number of
+ * parameters set, unknown names are skipped. */
+int cfg_import(const char *text);
+
+/* Export the values as the boot menu text */
+void cfg_export(Print *out);
+
+/* Load the sector in use, else the layout before, compacted into the
+ * store. False if there is neither. */
+bool cfg_load(void);
+
+/* A parameter as cfg_load will set it, without setting it */
+int cfg_peek(uint8_t index);
+
+/* Compact the values into the next sector */
+bool cfg_save(void);
+
+/* Persist a changed parameter, one record, or cfg_save once the sector is full */
+bool cfg_log(uint8_t index, int value);
+
+/* Erase the store and the boot menu text */
+bool cfg_erase(void);
+
+#endif /* _CFG_H_ */
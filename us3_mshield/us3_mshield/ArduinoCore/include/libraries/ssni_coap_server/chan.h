@@ -0,0 +1,104 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+/*
+ * Acquisition channels.
+ *
+ * A channel is one value a sensor publishes, wherever it comes from: a
+ * point of a Modbus register image, a field of an RS232 record, a digital
+ * pin, an analog pin or a function. Sensors describe theirs in a const table, and the samples
+ * and the text payload are built from it in one pass, the same way for
+ * every source. A reading comes with its quality and age, MB_Q_* as the
+ * register images report them; the pins are always good and current.
+ */
+
+#ifndef _CHAN_H_
+#define _CHAN_H_
+
+#include "mbmap.h"
+#include "sermap.h"
+#include "bufutil.h"
+#include "sapi.h"
+
+/* Sources */
+#define CHAN_MODBUS             0   /* point of a register image */
+#define CHAN_GPIO               1   /* digital pin, 0 or 1 */
+#define CHAN_ADC                2   /* analog pin, raw * scale + offset */
+#define CHAN_COMPUTED           3   /* fn */
+#define CHAN_SERIAL             4   /* field of an RS232 record */
+
+/* Flags */
+#define CHAN_F_INVERT           0x01    /* GPIO active low */
+#define CHAN_F_PULLUP           0x02    /* GPIO pulled up */
+
+/* Most channels a table may have, for the one pass payload */
+#define CHAN_MAX                8
+
+struct chan;
+typedef uint8_t (*chan_fn)(const struct chan *c, float *value, uint32_t *age_ms);
+
+struct chan {
+    const char *name;
+    uint8_t source;             /* CHAN_* */
+    uint8_t datatype;           /* sample datatype, 0 if not published */
+    const char *unit;
+    uint8_t pin;                /* GPIO, ADC */
+    uint8_t flags;              /* CHAN_F_* */
+    float scale;                /* ADC */
+    float offset;
+    const struct mb_point *point;   /* Modbus */
+    const struct mb_image *image;
+    chan_fn fn;                 /* computed */
+    const struct ser_field *field;  /* RS232 */
+    const struct ser_record *record;
+};
+
+/* Set up the pins of the table, once. Reads do not touch the pin modes. */
+void chan_init(const struct chan *tab, uint8_t n);
+
+/* Read one channel. Returns its MB_Q_* quality, sets age_ms to how old it is. */
+uint8_t chan_read(const struct chan *c, float *value, uint32_t *age_ms);
+
+/*
+ * A sample per published channel, stamped to the ms with when it was
+ * read, up to *count. SAPI_ERR_FAIL if one has never been read.
+ */
+sapi_error_t chan_samples(const struct chan *tab, uint8_t n, sapi_sample_t *samples, uint8_t *count);
+
+/*
+ * The text record of the published channels, <epoch>,<value>,... with
+ * epoch less the oldest age and two decimals, or with units set their
+ * units <unit>,... SAPI_ERR_FAIL if one has never been read,
+ * SAPI_ERR_NO_MEM if tb is full.
+ */
+sapi_error_t chan_payload(const struct chan *tab, uint8_t n, uint32_t epoch,
+                          struct txt_buf *tb, uint8_t units);
+
+#endif /* _CHAN_H_ */
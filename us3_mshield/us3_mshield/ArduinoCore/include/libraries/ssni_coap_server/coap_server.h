@@ -37,8 +37,10 @@ Networks, Inc.
 /**
  * @brief Init HDLCS and the CoAP Server 
  *
+ * @param[in] link Baud and flow control of the mNIC link, NULL for defaults
  */
-void coap_s_init( HardwareSerial * pSerial, uint32_t max_age, uint32_t uart_timeout_ms, uint32_t max_info_len, const char * uri, ObsFuncPtr p );
+struct hdlc_link_cfg;
+void coap_s_init( HardwareSerial * pSerial, const struct hdlc_link_cfg * link, uint32_t max_age, uint32_t uart_timeout_ms, uint32_t max_info_len, const char * uri, ObsFuncPtr p );
 
 
 
@@ -49,6 +51,17 @@ void coap_s_init( HardwareSerial * pSerial, uint32_t max_age, uint32_t uart_time
 void coap_s_run();
 
 
+/**
+ * @brief Run HDLCS and the CoAP Server without blocking
+ *
+ * Handles a frame only if one has already arrived and returns right away,
+ * so it can be called from a loop() that has other work to do. Unlike
+ * coap_s_run it leaves the observe notifications to the caller, do_observe
+ * once observe_due.
+ */
+void coap_s_poll();
+
+
 /** 
  * @brief Primary CoAP process function.
  * Set up REQ and RSP contexts.
@@ -36,6 +36,7 @@ Networks, Inc.
 #include "errors.h"
 #include "hbuf.h"
 #include "exp_coap.h"
+#include "hdlc.h"
 
 /* Resource data types, for TLV from the sensor, system data like time, etc. */
 typedef enum packed_t {
@@ -61,6 +62,16 @@ typedef enum packed_t {
     crdt_upg_img_ver_sys,
 	crdt_upg_img_info_sys,
 	crdt_upg_state_sys,
+    crdt_stat_hdlc,
+    crdt_stat_mem,
+    crdt_stat_sens,
+    crdt_stat_modbus,
+    crdt_stat_task,
+    crdt_stat_duty,
+    crdt_stat_lat,
+    crdt_stat_slow,
+    crdt_stat_pace,
+    crdt_stat_load,
     crdt_none,                  /* no resource */
     crdt_max = crdt_none
 } coap_res_data_type_t;
@@ -180,6 +191,159 @@ typedef struct {
     struct coap_stats cs;   /* CoAP stats */
 } coap_sys_coap_stats_t;
 
+/* HDLC link stats */
+typedef struct {
+    coap_sens_tl_t tl;      /* type and length */
+    char pad[2];            /* align */
+    struct hdlc_link_stats hs;  /* HDLC link stats */
+} coap_sys_hdlc_stats_t;
+
+/* Memory use, high-water marks since boot */
+struct coap_mem_stats {
+    uint32_t stack_used;        /* stack high-water mark, bytes */
+    uint32_t free_min;          /* least free RAM between heap and stack */
+    uint32_t mbuf_big_cnt;      /* big mbufs in the pool */
+    uint32_t mbuf_big_peak;     /* most big mbufs in use at once */
+    uint32_t mbuf_small_cnt;    /* small mbufs in the pool */
+    uint32_t mbuf_small_peak;   /* most small mbufs in use at once */
+    uint32_t mbuf_empty;        /* allocations failed for an empty pool */
+    uint32_t opt_max;           /* options a message can hold */
+    uint32_t opt_peak;          /* most options a message has held */
+    uint32_t scratch_size;      /* scratch arena, bytes */
+    uint32_t scratch_peak;      /* most of it in use at once */
+};
+
+typedef struct {
+    coap_sens_tl_t tl;      /* type and length */
+    char pad[2];            /* align */
+    struct coap_mem_stats ms;   /* memory stats */
+} coap_sys_mem_stats_t;
+
+/* SAPI sensor reads since boot, one per sensor */
+struct coap_sens_stats {
+    uint32_t sensor_id;         /* SAPI sensor id */
+    uint32_t reads;             /* reads completed, failed ones too */
+    uint32_t errors;            /* reads that failed */
+    uint32_t timeouts;          /* split-phase reads never completed */
+    uint32_t min_us;            /* quickest read, microseconds */
+    uint32_t avg_us;            /* mean read */
+    uint32_t max_us;            /* slowest read */
+};
+
+typedef struct {
+    coap_sens_tl_t tl;      /* type and length */
+    char pad[2];            /* align */
+    struct coap_sens_stats ss;  /* sensor read stats */
+} coap_sys_sens_stats_t;
+
+/* Modbus RS485 bus diagnostics since boot, the bus then each polled slave */
+#define COAP_MODBUS_LAT_BINS    8
+struct coap_modbus_stats {
+    uint32_t slave;             /* Modbus slave, 0 for the whole bus */
+    uint32_t requests;          /* transactions done */
+    uint32_t timeouts;          /* no reply */
+    uint32_t crc_errors;        /* reply CRC mismatch */
+    uint32_t frame_errors;      /* reply short, broken or not ours */
+    uint32_t exceptions;        /* exception replies */
+    uint32_t retries;           /* requests repeated */
+    uint32_t latency[COAP_MODBUS_LAT_BINS]; /* first reply byte within 1, 2 .. 64 ms, then later */
+};
+
+typedef struct {
+    coap_sens_tl_t tl;      /* type and length */
+    char pad[2];            /* align */
+    struct coap_modbus_stats mb;    /* Modbus stats */
+} coap_sys_modbus_stats_t;
+
+/* Main loop tasks since boot, one per task */
+#define COAP_TASK_NAME_LEN      8
+struct coap_task_stats {
+    char name[COAP_TASK_NAME_LEN];  /* task name, NUL padded */
+    uint32_t runs;              /* runs done */
+    uint32_t max_us;            /* longest run, microseconds */
+    uint32_t late_ms;           /* latest run past its deadline */
+    uint32_t misses;            /* runs later than the budget */
+    uint32_t budget_ms;         /* 0 if not supervised */
+};
+
+typedef struct {
+    coap_sens_tl_t tl;      /* type and length */
+    char pad[2];            /* align */
+    struct coap_task_stats ts;  /* task stats */
+} coap_sys_task_stats_t;
+
+/* Request latency of a stage since boot or the last clear, one per stage and the total */
+#define COAP_LAT_NAME_LEN       8
+struct coap_lat_stats {
+    char name[COAP_LAT_NAME_LEN];   /* stage name, NUL padded */
+    uint32_t count;             /* requests */
+    uint32_t min_us;            /* quickest, microseconds */
+    uint32_t avg_us;            /* mean */
+    uint32_t max_us;            /* slowest */
+};
+
+typedef struct {
+    coap_sens_tl_t tl;      /* type and length */
+    char pad[2];            /* align */
+    struct coap_lat_stats ls;   /* stage latency */
+} coap_sys_lat_stats_t;
+
+/* One of the slowest requests, slowest first */
+#define COAP_SLOW_PATH_LEN      24
+#define COAP_SLOW_STAGES        5
+struct coap_slow_req {
+    char path[COAP_SLOW_PATH_LEN];  /* Uri-Path, NUL padded, cut to fit */
+    uint32_t age_s;             /* seconds since it came in */
+    uint32_t total_us;          /* closing flag in to response out */
+    uint32_t stage_us[COAP_SLOW_STAGES];    /* link, parse, handler, rsp, send */
+};
+
+typedef struct {
+    coap_sens_tl_t tl;      /* type and length */
+    char pad[2];            /* align */
+    struct coap_slow_req sr;    /* slow request */
+} coap_sys_slow_req_t;
+
+/* Link pace, see pace.h */
+struct coap_pace_stats {
+    uint8_t level;              /* 0 at full pace, each doubles the report interval */
+    uint8_t skip_pct;           /* smoothed share of notifications held back */
+    char pad[2];
+    uint32_t srtt_ms;           /* smoothed ACK round trip */
+    uint32_t rtt_max_ms;
+    uint32_t acks;              /* ACKs timed */
+    uint32_t resends;           /* CONs sent again */
+    uint32_t sent;              /* notifications of samples */
+    uint32_t skipped;           /* held back, the last one still queued */
+    uint32_t changes;           /* of level */
+};
+
+typedef struct {
+    coap_sens_tl_t tl;      /* type and length */
+    char pad[2];            /* align */
+    struct coap_pace_stats ps;  /* link pace */
+} coap_sys_pace_stats_t;
+
+/* CPU load of the main loop, see cpuload.h */
+#define COAP_LOAD_BINS          8
+struct coap_load_stats {
+    uint16_t load_1s;           /* 0.01 % busy, the last second */
+    uint16_t load_1m;           /* smoothed over a minute */
+    uint16_t load_15m;          /* over 15 */
+    char pad[2];
+    uint32_t idle_ms;           /* core parked */
+    uint32_t busy_ms;
+    uint32_t iters;             /* main loop iterations */
+    uint32_t iter_max_us;       /* the longest */
+    uint32_t hist[COAP_LOAD_BINS];  /* iterations under 64 us, 256 us, ... 262 ms, and over */
+};
+
+typedef struct {
+    coap_sens_tl_t tl;      /* type and length */
+    char pad[2];            /* align */
+    struct coap_load_stats ls;  /* CPU load */
+} coap_sys_load_stats_t;
+
 #define MAX_DEVID_LEN	10
 
 typedef struct {
@@ -187,6 +351,20 @@ typedef struct {
     uint32_t ms;                /* milliseconds */
 } coap_pwr_time_t;
 
+/* Time in each run state since boot or the last clear, one per state */
+#define COAP_DUTY_NAME_LEN      8
+struct coap_duty_stats {
+    char name[COAP_DUTY_NAME_LEN];  /* state name, NUL padded */
+    coap_pwr_time_t time;       /* time in the state */
+    uint32_t entries;           /* times it was entered */
+};
+
+typedef struct {
+    coap_sens_tl_t tl;      /* type and length */
+    char pad[2];            /* align */
+    struct coap_duty_stats ds;  /* run state stats */
+} coap_sys_duty_stats_t;
+
 
 
 typedef struct  {
@@ -65,6 +65,15 @@ Networks, Inc.
 #define COAP_CODE_PUT           (3)     /* 0.03 */
 #define COAP_CODE_DELETE        (4)     /* 0.04 */
 
+/*
+ * What coap_msg_parse found, in ctx->kind. Only a request has its options
+ * parsed, the rest are told apart by the header alone.
+ */
+#define COAP_MSG_REQUEST        0       /* a request, to answer */
+#define COAP_MSG_PING           1       /* an empty CON, answered by an RST */
+#define COAP_MSG_ACK            2       /* an ACK, of a CON we sent */
+#define COAP_MSG_IGNORE         3       /* an RST, an empty NON, or a response */
+
 #define SID_MAX_LEN             32      /* Sensor component of URI, max */
 
 /* maximum length of a Uri string */
@@ -76,11 +85,54 @@ Networks, Inc.
  */
 #define COAP_OBS_HDR_SZ     	(28)
 
+/* Response header, as above + Block2, Block1 (1 + 3 each), ETag (1 + 4) */
+#define COAP_RSP_HDR_SZ     	(COAP_OBS_HDR_SZ + 8 + 5)
+
+/* Headroom reserved in response mbufs, the header is written in place */
+#define COAP_RSP_HEADROOM   	((COAP_RSP_HDR_SZ + 3) & ~3)
+
+/* Block1/Block2 option value, RFC 7959 */
+struct coap_block {
+    uint32_t num;               /* block number */
+    uint8_t  m;                 /* more blocks follow */
+    uint8_t  szx;               /* size exponent, block is 16 << szx bytes */
+};
+
+#define COAP_BLOCK_SZX_MAX      (6)
+#define COAP_BLOCK_SIZE(szx)    (16 << (szx))
+
+/* One Uri-Query option, "key=val" or "key", pointing into the message */
+struct coap_query {
+    const char *key;
+    const char *val;            /* NULL if there is no '=' */
+    uint8_t klen;
+    uint8_t vlen;
+};
+
+struct optlv {
+    uint16_t ot;				/* Option type				*/
+    uint16_t ol;				/* Option length?			*/ 
+    const void *ov;				/* Pointer to option value	*/
+};
+
+/* Most options a message can carry */
+#define COAP_OPT_MAX            (12)
+/* Option numbers below this have the first option of their type indexed */
+#define COAP_OPT_IDX_MAX        (32)
+
+/* Options of a message, kept sorted by option number as on the wire */
+struct sl_co {
+    uint8_t n;                          /* options in o[] */
+    uint8_t first[COAP_OPT_IDX_MAX];    /* 1 + index of first of type, 0 none */
+    struct optlv o[COAP_OPT_MAX];
+};
+
 struct coap_msg_ctx {
     /* version always 01 on send, silently discarded on error recv */
     uint8_t type;               /* conf(0), nconf(1), ack(2), reset(3) */
     uint8_t tkl;                /* token length 0-8 bytes*/
     uint8_t  code;              /* Code - Request Method / Response Code */
+    uint8_t  kind;              /* COAP_MSG_, of a message parsed */
     uint16_t mid;               /* message id */
     uint8_t token[8];           /* Token */
    
@@ -95,7 +147,8 @@ struct coap_msg_ctx {
 
     void        *client;        /* Opaque client handle */
     int         final;          /* One shot REQ/RSP or ongoing aka observe */
-    SLIST_HEAD(sl_co, coap_opt) oh;  /* Options list head. */
+    struct sl_co oh;            /* Options, zeroed is empty. */
+    uint8_t     blkv[2][3];     /* Block2, Block1 values for the response */
 
     struct mbuf *msg;           /* complete message - header + payload */
 
@@ -103,20 +156,11 @@ struct coap_msg_ctx {
 
 struct mbuf;
 
-struct optlv {
-    uint16_t ot;				/* Option type				*/
-    uint16_t ol;				/* Option length?			*/ 
-    const void *ov;				/* Pointer to option value	*/
-};
-
-typedef struct coap_opt {
-    struct optlv          o;    /* option TLV, absolute values. */
-    SLIST_ENTRY(coap_opt) nxt;  /* next option */
-} coap_opt;
-
 int coap_opt_strncmp(const struct optlv *opt, const char *str, uint8_t len);
 int coap_opt_strcmp(const struct optlv *opt, const char *str);
 char *coap_pathstr(const struct coap_msg_ctx *ctx);
+int coap_path_cmp(const struct coap_msg_ctx *ctx, const char *path);
+int coap_path_copy(const struct coap_msg_ctx *ctx, char *buf, int size);
 
 int coap_opt_parse(struct optlv *o, const uint8_t *b, int len);
 
@@ -124,6 +168,19 @@ error_t coap_msg_parse(struct coap_msg_ctx *ctx, struct mbuf *m, uint8_t *code);
 error_t coap_rsp_parse(struct coap_msg_ctx *ctx, struct mbuf *m);
 error_t coap_msg_response(struct coap_msg_ctx *rsp);
 
+int coap_block_get(const struct coap_msg_ctx *ctx, uint16_t ot, 
+                    struct coap_block *blk);
+error_t coap_block_set(struct coap_msg_ctx *rsp, uint16_t ot, 
+                    const struct coap_block *blk);
+uint8_t coap_block_szx(uint8_t szx);
+
+int coap_query_next(const struct coap_msg_ctx *ctx, void **it, 
+                    struct coap_query *q);
+int coap_query_key(const struct coap_query *q, const char *key);
+int coap_query_val(const struct coap_query *q, const char *val);
+int coap_query_uint(const struct coap_query *q, uint32_t *v);
+int coap_query_hex(const struct coap_query *q, uint8_t *buf, uint8_t len);
+
 void coap_init_rsp(const struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, 
                     struct mbuf *m);
 
@@ -134,7 +191,7 @@ uint32_t co_uint32_n2h(const struct optlv *o);
 int coap_opt_add(const struct optlv *o, uint8_t *b, int len);
 error_t coap_opt_rpl(struct coap_msg_ctx *ctx);
 
-/* coap_opt accessor functions */
+/* option accessor functions, iterators start out NULL */
 void copt_init(struct sl_co *hd);
 error_t copt_add_opt(struct sl_co *hd, struct optlv *opt);
 struct optlv *copt_get_next_opt_type(const struct sl_co *hd, uint16_t ot, 
@@ -144,13 +201,27 @@ error_t copt_del_opt_type(struct sl_co *hd, uint16_t ot);
 void copt_del_all(struct sl_co *hd);
 struct optlv *copt_get_next_opt(const struct sl_co *co, void **it);
 void copt_dump(struct sl_co *hd);
+int copt_peak(void);
 int coap_uristr_to_opt(const char *us, uint8_t *buf, int bufsize); 
 
 /*** CON/ACK support. ***/
-/* Add entry to midcb registry. Called when sending CON. */
-error_t coap_con_add(uint16_t mid, coap_ack_cb_info_t *cbi);
+/* CON retransmission, RFC 7252 4.8 */
+#define COAP_ACK_TIMEOUT_MS         (2000)
+#define COAP_ACK_RANDOM_FACTOR_PCT  (150)
+#define COAP_MAX_RETRANSMIT         (4)
+/* EXCHANGE_LIFETIME, RFC 7252 4.8.2, how long a CON may still be repeated */
+#define COAP_EXCHANGE_LIFETIME_MS   (247000UL)
+
+/* 
+ * Add entry to midcb registry. Called when sending CON. A copy of m, if
+ * given, is requeued with obs_q_add(qid) until ACKed or out of retries.
+ */
+error_t coap_con_add(uint16_t mid, coap_ack_cb_info_t *cbi, struct mbuf *m, 
+                     uint8_t qid);
 /* Notify callback when ACK rxed. */
 error_t coap_ack_rx(uint16_t mid, struct mbuf *m);
+/* Retransmit CONs whose ACK timeout has passed. Call from the run loop. */
+void coap_con_poll(void);
 
 /**
  * @brief Set Max-Age Option 14
@@ -158,13 +229,9 @@ error_t coap_ack_rx(uint16_t mid, struct mbuf *m);
  *
  */ 
 void coap_set_max_age( uint32_t max_age );
+extern uint32_t coap_max_age_in_seconds;
 
 
-/******************************************************************************
- * Memory pool code, NIC only.
- *****************************************************************************/
-void copt_pool_init(void);
-
 
 #endif /* INC_COAPMGS_H */
 
@@ -46,12 +46,17 @@ Networks, Inc.
 #define MAX_OBSERVERS       4
 
 
-error_t enable_obs(const char *urip, struct coap_msg_ctx *req, void *client);
-error_t disable_obs(const char *urip, struct coap_msg_ctx *req, void **client, 
-                uint8_t force);
+/* The resource is the Uri-Path of req */
+error_t enable_obs(struct coap_msg_ctx *req, void *client);
+error_t disable_obs(struct coap_msg_ctx *req, void **client, uint8_t force);
 uint32_t get_obs_val(void);
 error_t get_obs_by_uri(const char *uri, uint8_t *tkl, uint8_t *token, void **client,
                    uint8_t *nxt);
+/* O(1) after the first call for oid, see coapobserve.cpp */
+error_t get_obs_by_id(uint8_t oid, const char *uri, uint8_t *tkl, uint8_t *token,
+                   void **client);
 error_t get_obs_by_sid_tok(const char *sid, uint8_t tkl, const uint8_t *token, 
                   void **client, uint8_t *nxt);
+/* The relations from before a reset, see retain.h */
+uint8_t obs_restore(void);
 #endif /* _INC_COAPOBSERVE_H_ */
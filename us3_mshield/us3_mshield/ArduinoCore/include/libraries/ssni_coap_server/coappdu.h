@@ -297,6 +297,9 @@ draft-tcs-coap-no-response-option-12
 #define COAP_CF_APPLICATION_EXI             (47)
 #define COAP_CF_APPLICATION_JSON            (50)
 #define COAP_CF_APPLICATION_CBOR            (60) 
+/* Private, one byte as cf is: the same compressed, see hshrink.h */
+#define COAP_CF_CSV_HSHRINK                 (202)
+#define COAP_CF_CBOR_HSHRINK                (203)
 
 /* CF_TEXT_PLAIN (0) is _not_ the default media type.
    Server needs to differentiate whether specific type was requested
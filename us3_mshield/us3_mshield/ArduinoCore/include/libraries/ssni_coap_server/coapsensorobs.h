@@ -59,6 +59,12 @@ typedef struct observe_reg_info
 	uint32_t				ack_seqno;					// Sequence number used in notification acks
 	uint8_t					obs_flag;					// 1 -> observer has registered
 	uint8_t					sensor_id;					// SAPI sensor id (0 used for backward compatibility)
+	uint8_t					con_every_n;				// NON mode: CON every n notifications, 0/1 -> all CON
+	uint8_t					non_cnt;					// NON notifications since the last CON
+	uint32_t				con_every_s;				// NON mode: CON at least every s seconds
+	time_t					con_epoch;					// Time of the last CON notification
+	uint8_t					cf;							// Content-Format of the notifications
+	uint8_t					compress;					// 1 -> notifications compressed, see hshrink.h
 } observe_reg_info_t;
 
 
@@ -75,12 +81,98 @@ typedef struct observe_reg_info
 //
 #define OBSERVATION_FREQUENCY  60
 
+// Longest do_observe goes unchecked when no observer is due sooner, in seconds
+#define OBS_RECHECK_SECS       60
+
+// Observer deadlines on multiples of their period counted from the RTC's
+// epoch, so that those of the same or harmonic frequencies fall due
+// together and share a wake-up, with those due up to OBS_ALIGN_WINDOW_S
+// later sent along. 0 for a full period from each one's last notification.
+#ifndef OBS_ALIGN
+#define OBS_ALIGN              1
+#endif
+#define OBS_ALIGN_WINDOW_S     2
+
+// Longest an observer in NON mode goes without a CON notification (RFC 7641 4.5)
+#define OBS_NON_CON_MAX_SECS   86400
+
+// Messages for the mNIC held until the next RR poll
+#define OBS_Q_MAX              4
+
+// obs_q_add observer id of a message that isn't an observe notification
+#define OBS_Q_NO_OBSERVER      0xFF
+
+// A message for the mNIC wakes it this long after it was queued, so that
+// those queued meanwhile go on the same wake-up. Alarms wake it at once.
+#define MNIC_WAKE_HOLD_MS      250
+
+// The mNIC polls for a while after its last frame, it isn't woken for
+// what is queued in that time
+#define MNIC_AWAKE_MS          500
+
+
+/**
+ * @brief Queue a message for the mNIC, moved to the HDLC transmit queue on
+ *   the next RR poll. Alarms are sent before other messages. A message for
+ *   an observer replaces an unsent one for the same observer. When full, the
+ *   oldest non-alarm message is dropped to make room.
+ *
+ * @param m The message, owned by the queue on success
+ * @param observer_id Observer Id, or OBS_Q_NO_OBSERVER
+ * @param alarm Non-zero for an alarm
+ * @return error_t ERR_NO_MEM if full of alarms, the caller still owns m
+ */
+error_t obs_q_add(struct mbuf *m, uint8_t observer_id, uint8_t alarm);
+
+/**
+ * @brief Check for an unsent message for an observer
+ *
+ * @param observer_id Observer Id
+ * @return boolean True if one is queued
+ */
+boolean obs_q_has(uint8_t observer_id);
+
+/**
+ * @brief The next message for the mNIC, left queued
+ *
+ * @return struct mbuf* The message, NULL if none
+ */
+struct mbuf *obs_q_head();
+
+/**
+ * @brief Remove the obs_q_head message, which the caller now owns
+ *
+ */
+void obs_q_pop();
+
+/**
+ * @brief Free all queued messages, on link disconnect
+ *
+ */
+void obs_q_flush();
+
+/**
+ * @brief Ask for the mNIC to be woken for what was just queued. It is woken
+ *   once MNIC_WAKE_HOLD_MS after the first ask, at once for an alarm or a
+ *   full queue, and not at all if it polled within MNIC_AWAKE_MS. Its polls
+ *   then drain the whole queue on the one wake-up.
+ *
+ * @param alarm Non-zero to wake it now
+ */
+void obs_q_wake(uint8_t alarm);
+
+/**
+ * @brief Wake the mNIC if a held wake-up is due, from the link poll
+ *
+ */
+void obs_q_wake_poll();
+
 
 /**
  * @brief Set the URI and attributes needed for generating observation notifications
  *   (used for obtaining token etc in CoAP Observe response msg). Called from SAPI.
  *
- * 
+ * @return Observer Id, OBS_Q_NO_OBSERVER if all MAX_OBSERVERS are taken
  */
 uint8_t set_observer_sapi(const char * uri, ObsFuncPtr p, uint32_t frequency, uint8_t sensor_id);
 
@@ -93,12 +185,73 @@ uint8_t set_observer_sapi(const char * uri, ObsFuncPtr p, uint32_t frequency, ui
 void set_observer(const char * uri, ObsFuncPtr p);
 
 /**
- * @brief Checks if Observe is turned on and if so, checks if a response should be sent
+ * @brief Sends the notifications that are due, in deadline order. Each observer
+ *   due is sent once and re-armed a full period from now.
  *
  * @return boolean Returns a boolean that tells whether or not Observe is turned on
  */
 boolean do_observe();
 
+/**
+ * @brief Checks if an observation notification may be due, so do_observe
+ * (and its RTC read) can be skipped until then.
+ *
+ * @return boolean True once do_observe should be called again
+ */
+boolean observe_due();
+
+/**
+ * @brief Time until observe_due turns true, 0 if it is.
+ *
+ * @return uint32_t Milliseconds to wait before calling do_observe
+ */
+uint32_t observe_wait_ms();
+
+/**
+ * @brief Send an observer's periodic notifications NON, with a CON every
+ *   con_every_n notifications or con_every_s seconds, whichever comes first,
+ *   to check the observer is still there. Alarms are always CON.
+ *
+ * @param observer_id Observer Id
+ * @param con_every_n CON every n notifications, 0 or 1 sends all CON
+ * @param con_every_s CON at least every s seconds, up to OBS_NON_CON_MAX_SECS
+ * @return error_t
+ */
+error_t coap_obs_set_non(uint8_t observer_id, uint8_t con_every_n, uint32_t con_every_s);
+
+/**
+ * @brief Set the Content-Format of an observer's notifications, COAP_CF_CSV by default.
+ *
+ * @return error_t
+ */
+error_t coap_obs_set_cf(uint8_t observer_id, uint8_t cf);
+
+/**
+ * @brief Compress an observer's notifications of HSHRINK_MIN_LEN bytes or more,
+ *   COAP_CF_CSV and COAP_CF_APPLICATION_CBOR ones, sent as COAP_CF_CSV_HSHRINK
+ *   and COAP_CF_CBOR_HSHRINK. Off by default.
+ *
+ * @param observer_id Observer Id
+ * @param on 1 to compress
+ * @return error_t
+ */
+error_t coap_obs_set_compress(uint8_t observer_id, uint8_t on);
+
+/**
+ * @brief 1 if the observer's notifications are compressed
+ */
+uint8_t coap_obs_compress(uint8_t observer_id);
+
+/**
+ * @brief Change an observer's notification frequency. The next notification
+ *   is a full period from now.
+ *
+ * @param observer_id Observer Id
+ * @param frequency Seconds between notifications
+ * @return error_t
+ */
+error_t coap_obs_set_freq(uint8_t observer_id, uint32_t frequency);
+
 /**
  * @brief CoAP Register Observer. Called by SAPI.
  *
@@ -106,6 +259,15 @@ boolean do_observe();
  */
 error_t coap_obs_reg_sapi(uint8_t observer_id);
 
+/**
+ * @brief Register again the observers that were before a reset, see
+ *   retain.h, matched by URI. Called once all observers are set, their
+ *   first notification is due at once.
+ *
+ * @return uint8_t The number registered
+ */
+uint8_t coap_obs_restore();
+
 /**
 * @brief CoAP Register Observer.
  *
@@ -139,4 +301,11 @@ error_t observe_rx_ack(void *cbctx, struct mbuf *m);
  */
 error_t coap_observe_rsp(uint8_t observer_id);
 
+/**
+ * @brief CoAP Observe response, queued ahead of periodic notifications.
+ *
+ * @return error_t
+ */
+error_t coap_observe_alarm(uint8_t observer_id);
+
 #endif
@@ -51,13 +51,28 @@ Networks, Inc.
 //* \typedef coap_cb */
 typedef error_t (*coap_cb)(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp);
 
-//* \struct coap_cb_reg */
-struct coap_cb_reg {
-    const char *path;       /* top level Uri-Path */
-    coap_cb cb;             /* resource handler for Uri-Path */
-    const char *link;       /* CoRE Link Attributes (if any) */
+//* \typedef coap_uri_cb */
+/* it is the Uri-Path iterator past the segments matched to reach the node */
+typedef error_t (*coap_uri_cb)(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, void *it);
+
+//* \struct coap_uri_node */
+/* One Uri-Path segment of the static resource tree.  A request goes to the
+ * deepest node its path matches, which handles whatever path is left. */
+struct coap_uri_node {
+    const char *seg;                    /* Uri-Path segment */
+    coap_uri_cb cb;                     /* resource handler */
+    const char *link;                   /* CoRE Link Attributes (if any) */
+    const struct coap_uri_node *sub;    /* child segments */
+    uint8_t nsub;
+    uint8_t noobs;                      /* no observe at or below this node */
 };
 
+// Deepest resource path listed in .well-known/core
+#define COAP_URI_DEPTH_MAX          (4)
+
+// Longest .well-known/core document, served block-wise past one message
+#define COAP_LINKS_MAX_LEN          (256)
+
 /** @brief
  * This structure is opaque to the core sensor code, like haiku. It is to be
  * passed back into coap_local_obs_rsp for looking up the URI and the content
@@ -71,23 +86,6 @@ struct sensor_ctx {
 };
 
 
-/**
- * @brief Register CoAP URI
- *
- * @param[in] path URI Path
- * @param[in] cbfunc CoAP Request/Response Handler
- * @param[in] corelink corelink
- * @return error_t
- */
-error_t coap_uri_register(const char *path, coap_cb cbfunc, const char *corelink);
-
-
-/**
- * @brief Initialize CoAP URI registry
- *
- */
-void coap_registry_init(void);
-
 /** @brief
  * Call registered handler for given URI in the request
  *
@@ -97,4 +95,12 @@ void coap_registry_init(void);
  */
 error_t coap_s_uri_proc(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp);
 
+/** @brief
+ * Render the .well-known/core link-format document from the resource tree.
+ * Discovery requests copy it. Call after the URL classifier changes.
+ *
+ * @return error_t, ERR_NO_MEM if over COAP_LINKS_MAX_LEN
+ */
+error_t coap_uri_links_update(void);
+
 #endif /* INC_COAPURI_H */
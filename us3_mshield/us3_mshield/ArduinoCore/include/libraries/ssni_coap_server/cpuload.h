@@ -0,0 +1,90 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+/*
+ * CPU load of the main loop, for the headroom left.
+ *
+ * sched_idle marks where the loop parks the core, in WFI or a sleep
+ * hook, and where it takes up again. The time parked is idle, the rest
+ * is busy, interrupts included. The share busy is taken over each
+ * CPULOAD_WIN_MS, and smoothed from those over a minute and 15, as the
+ * load averages of Unix. A window that a long sleep or task stretches
+ * counts as that many. Each iteration, from sched_idle back to it, goes
+ * into a histogram of CPULOAD_BINS, the first under CPULOAD_BIN0_US and
+ * each four times the last. GET /sys/stats?mod=load. Left out unless
+ * CPULOAD is 1.
+ */
+
+#ifndef _CPULOAD_H_
+#define _CPULOAD_H_
+
+#include <stdint.h>
+
+#ifndef CPULOAD
+#define CPULOAD                 1
+#endif
+
+#define CPULOAD_WIN_MS          1000
+#define CPULOAD_BINS            8
+#define CPULOAD_BIN0_US         64
+
+struct cpuload_stats {
+    uint16_t load_1s;           /* 0.01 % busy, the last window */
+    uint16_t load_1m;           /* smoothed over a minute */
+    uint16_t load_15m;          /* over 15 */
+    uint32_t idle_ms;           /* parked, since boot or cpuload_clear */
+    uint32_t busy_ms;
+    uint32_t iters;             /* of the main loop */
+    uint32_t iter_max_us;       /* the longest */
+    uint32_t hist[CPULOAD_BINS];    /* iterations by time */
+};
+
+#if CPULOAD
+/* The loop parks the core, returns micros() for cpuload_exit */
+uint32_t cpuload_enter(void);
+
+/* The next iteration starts, the core parked since idle_us if parked */
+void cpuload_exit(uint32_t idle_us, uint8_t parked);
+
+void cpuload_get(struct cpuload_stats *s);
+
+/* Start the counts and histogram again, the load windows stay */
+void cpuload_clear(void);
+
+#define CPULOAD_ENTER()         uint32_t cpuload_us = cpuload_enter()
+#define CPULOAD_EXIT(parked)    cpuload_exit(cpuload_us, parked)
+#else
+#define CPULOAD_ENTER()
+#define CPULOAD_EXIT(parked)
+#endif
+
+#endif /* _CPULOAD_H_ */
@@ -0,0 +1,111 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+/*
+ * Post-mortem records.
+ *
+ * A hard fault, or the watchdog early warning, saves the stacked
+ * registers, the stack above them and the last log records in RAM the
+ * startup code leaves alone, then resets. At boot crash_boot logs a
+ * record that checks out, its log records as text, and appends it to a
+ * log sector of the SPI flash, erased once full. It goes with the reboot
+ * event and GET /sys/crash?n=<k> gives the k-th newest. A watchdog reset
+ * without a record is kept with the reset cause alone.
+ *
+ * On SAML21 the watchdog also supervises the sapi_run tasks, see
+ * sched_watchdog: a pass feeds it unless a task ran, or waits, past its
+ * budget, and the early warning saves the pc of what held up the loop.
+ * Left off unless CRASH_WDT is 1.
+ */
+
+#ifndef _CRASH_H_
+#define _CRASH_H_
+
+#include <stdint.h>
+#include "log.h"
+#include "errors.h"
+
+#define CRASH_LOG_ADDR          0x13000UL   /* SPI flash log sector */
+#define CRASH_LOG_SIZE          4096
+#define CRASH_MAGIC             0x5243      /* "CR" */
+#define CRASH_STACK_WORDS       16
+#define CRASH_LOG_RECS          4
+#define CRASH_LINE              56
+#define CRASH_QUERY             "n="
+
+#define CRASH_CAUSE_HARDFAULT   1
+#define CRASH_CAUSE_WDT         2
+
+#ifndef CRASH_WDT
+#define CRASH_WDT               1
+#endif
+#define CRASH_WDT_PER           WDT_CONFIG_PER_CYC8192      /* Reset 8 s unfed */
+#define CRASH_WDT_EW            WDT_EWCTRL_EWOFFSET_CYC4096 /* Early warning at 4 s */
+#define CRASH_WDT_FEED_MS       2000        /* Longest idle between feeds */
+
+/* What a fault left, the same in RAM and in the SPI flash */
+struct crash_regs {
+    uint16_t magic;                     /* CRASH_MAGIC */
+    uint8_t cause;                      /* CRASH_CAUSE_HARDFAULT or WDT */
+    uint8_t rcause;                     /* RSTC RCAUSE of the reset after it */
+    uint32_t ms;                        /* millis() at the fault */
+    uint32_t frame[8];                  /* r0-r3, r12, lr, pc, xpsr as stacked */
+    uint32_t sp;                        /* Where they were stacked */
+    uint32_t stack[CRASH_STACK_WORDS];  /* The words above them */
+};
+
+/* Fault record in the SPI flash, its log records as text */
+struct crash_rec {
+    struct crash_regs regs;
+    char log[CRASH_LOG_RECS][CRASH_LINE];
+    uint32_t crc;                       /* crc32 of the above */
+};
+
+struct coap_msg_ctx;
+
+/* Log and keep a fault before this boot, once log_init ran */
+void crash_boot(void);
+
+/* The fault before this boot for the reboot event, as a CBOR map of its
+ * cause, the reset cause, pc, lr and when it was. Returns 0 if there was
+ * none, -1 if it doesn't fit in size. */
+int crash_payload(uint8_t *buf, int size);
+
+/* GET /sys/crash?n=<k>, the k-th newest record of the log */
+error_t crash_rsp(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, void *it);
+
+#if CRASH_WDT && defined(SAML21)
+/* Start the watchdog with its early warning, fed by the scheduler, once
+ * the tasks run */
+void crash_wdt_init(void);
+#endif
+
+#endif /* _CRASH_H_ */
@@ -32,6 +32,19 @@ Networks, Inc.
 
 #include <arduino.h>
 
+/* CRC kernel, picked at build time:
+ * CRC_KERNEL_TABLE  - one 256 entry table lookup per byte
+ * CRC_KERNEL_SLICE4 - four bytes per round, 1.5KB more flash per polynomial
+ * CRC_KERNEL_NIBBLE - two 16 entry lookups per byte, for tight flash
+ */
+#define CRC_KERNEL_TABLE    (1)
+#define CRC_KERNEL_SLICE4   (2)
+#define CRC_KERNEL_NIBBLE   (3)
+
+#ifndef CRC_KERNEL
+#define CRC_KERNEL          CRC_KERNEL_SLICE4
+#endif
+
 uint16_t crc_xmodem_init(void);
 uint16_t crc_xmodem(uint16_t crc, const void *addr, unsigned int len);
 
@@ -45,9 +58,25 @@ uint16_t crc_xmodem(uint16_t crc, const void *addr, unsigned int len);
 #define CRC16_FINAL     (0xf0b8)  /* Good final FCS value */
 uint16_t crc16_init(void);
 uint16_t crc16(uint16_t crc, const  void *addr_v, unsigned int len);
+uint16_t crc16_byte(uint16_t crc, uint8_t ch);
 int crc16_validate(const void *addr_v, unsigned int len);
 
 /* CRC-DNP implementation for dnp3/m-bus */
 uint16_t crc_dnp(const uint8_t *data, int len);
 
+/* Modbus RTU CRC, appended LSB first after the frame */
+uint16_t crc_modbus(const uint8_t *data, int len);
+
+/* CRC-32 of zlib and IEEE 802.3, for firmware images. The value of
+ * crc32_init is updated block by block, crc32_final gives the CRC. */
+uint32_t crc32_init(void);
+uint32_t crc32(uint32_t crc, const void *addr_v, unsigned int len);
+uint32_t crc32_final(uint32_t crc);
+
+#ifdef CRC_BENCH
+/* Log the cycles taken by the selected kernel and by the plain byte table
+ * loop, for each CRC over a range of frame sizes */
+void crc_bench(void);
+#endif
+
 #endif
@@ -0,0 +1,100 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+/*
+ * Time spent in each run state, for the power budget.
+ *
+ * The code marks where it enters a state with duty_enter and where it
+ * leaves it with duty_exit, given what duty_enter returned. The time in
+ * between goes to the state, less that of any state entered inside it,
+ * so the counts add up to the time since boot, or since duty_clear.
+ * Time not in any state is DUTY_RUN.
+ *
+ *   DUTY_IDLE      the core parked in WFI between tasks
+ *   DUTY_STANDBY   asleep in standby, see lpidle.h
+ *   DUTY_LINK      the mNIC link: frames in and out, CoAP, and waiting
+ *                  on the UART for the HDLC frames sent
+ *   DUTY_SENSOR    reading the sensors, Modbus and RS232 included
+ *   DUTY_LOG       printing the log on the console
+ *
+ * Times are from micros(), which standby moves on as it does millis().
+ * With DUTY_PINS defined as a pin per state, -1 for none, the pins of
+ * the states entered are driven high, for a scope. States are entered
+ * from thread mode only. Left out unless DUTY is 1.
+ */
+
+#ifndef _DUTY_H_
+#define _DUTY_H_
+
+#include <Arduino.h>
+
+#ifndef DUTY
+#define DUTY                    1
+#endif
+
+#define DUTY_RUN                0
+#define DUTY_IDLE               1
+#define DUTY_STANDBY            2
+#define DUTY_LINK               3
+#define DUTY_SENSOR             4
+#define DUTY_LOG                5
+#define DUTY_STATES             6
+
+#if DUTY
+/* Set up the state pins, if any */
+void duty_init(void);
+
+/* Enter state, returns the one left for duty_exit */
+uint8_t duty_enter(uint8_t state);
+
+/* Go back to prev, from the duty_enter of the state left */
+void duty_exit(uint8_t prev);
+
+/* Us in state since boot or duty_clear, the current one up to now */
+uint64_t duty_us(uint8_t state);
+
+/* Times state was entered */
+uint32_t duty_entries(uint8_t state);
+
+/* Name of state, at most 7 characters */
+const char *duty_name(uint8_t state);
+
+/* Start the counts again from zero */
+void duty_clear(void);
+
+#define DUTY_ENTER(state)       uint8_t duty_prev = duty_enter(state)
+#define DUTY_EXIT()             duty_exit(duty_prev)
+#else
+#define DUTY_ENTER(state)
+#define DUTY_EXIT()
+#endif
+
+#endif /* _DUTY_H_ */
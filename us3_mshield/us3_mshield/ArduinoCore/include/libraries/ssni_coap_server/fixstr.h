@@ -0,0 +1,147 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+/*
+ * Strings without the heap, for the boot and configuration paths that run
+ * just before the long-lived mbufs are allocated.
+ *
+ * FixedString<N> holds up to N - 1 characters in itself, on the stack or
+ * in a static. What does not fit is dropped and truncated() says so; it
+ * never allocates. StrView is a pointer and a length into text owned by
+ * something else, a FixedString, a literal or a flash buffer.
+ */
+
+#ifndef _FIXSTR_H_
+#define _FIXSTR_H_
+
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+struct StrView {
+    const char *ptr;
+    size_t len;
+
+    StrView() : ptr(""), len(0) {}
+    StrView(const char *s) : ptr(s), len(strlen(s)) {}
+    StrView(const char *s, size_t n) : ptr(s), len(n) {}
+
+    size_t length() const { return len; }
+    bool equals(StrView o) const { return len == o.len && !memcmp(ptr, o.ptr, len); }
+    /* As String::toInt, the leading decimal digits; 0 if there are none */
+    long toInt() const;
+};
+
+inline long
+StrView::toInt() const
+{
+    char buf[12];
+    size_t n = len < sizeof(buf) - 1 ? len : sizeof(buf) - 1;
+
+    memcpy(buf, ptr, n);
+    buf[n] = '\0';
+    return strtol(buf, NULL, 10);
+}
+
+template <size_t N>
+class FixedString {
+public:
+    FixedString() : len_(0), cut_(false) { buf_[0] = '\0'; }
+    FixedString(const char *s) : len_(0), cut_(false) { buf_[0] = '\0'; append(s); }
+
+    const char *c_str() const { return buf_; }
+    size_t length() const { return len_; }
+    bool truncated() const { return cut_; }
+    operator StrView() const { return StrView(buf_, len_); }
+
+    void clear() { len_ = 0; cut_ = false; buf_[0] = '\0'; }
+
+    FixedString &append(char c)
+    {
+        if (len_ < N - 1) {
+            buf_[len_++] = c;
+            buf_[len_] = '\0';
+        } else {
+            cut_ = true;
+        }
+        return *this;
+    }
+
+    FixedString &append(StrView s)
+    {
+        size_t n = s.len;
+
+        if (n > N - 1 - len_) {
+            n = N - 1 - len_;
+            cut_ = true;
+        }
+        memcpy(buf_ + len_, s.ptr, n);
+        len_ += n;
+        buf_[len_] = '\0';
+        return *this;
+    }
+
+    /* Hex digits of v, upper case and without leading zeros, as String(v, HEX) */
+    FixedString &appendHex(uint32_t v)
+    {
+        char d[8];
+        int k = 0;
+
+        do {
+            d[k++] = "0123456789ABCDEF"[v & 0xf];
+            v >>= 4;
+        } while (v);
+        while (k) {
+            append(d[--k]);
+        }
+        return *this;
+    }
+
+    FixedString &operator+=(char c) { return append(c); }
+    FixedString &operator+=(StrView s) { return append(s); }
+    FixedString &operator+=(const char *s) { return append(StrView(s)); }
+
+    void toUpperCase()
+    {
+        for (size_t i = 0; i < len_; i++) {
+            if (buf_[i] >= 'a' && buf_[i] <= 'z') {
+                buf_[i] -= 'a' - 'A';
+            }
+        }
+    }
+
+private:
+    char buf_[N];
+    size_t len_;
+    bool cut_;
+};
+
+#endif /* _FIXSTR_H_ */
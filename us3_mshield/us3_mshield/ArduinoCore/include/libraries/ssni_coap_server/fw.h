@@ -0,0 +1,120 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+/*
+ * Firmware staging, /sys/fw.
+ *
+ * An image PUT block-wise to /sys/fw, in order, is programmed into the SPI
+ * flash after a header sector, erased as the blocks reach into it, its
+ * CRC-32 and MAC kept as they arrive. Once the last block matches both as
+ * given with the first, PUT /sys/fw?crc=<8 hex>&mac=<64 hex>, the header is
+ * written pending. POST /sys/fw reboots into it.
+ *
+ * The MAC is the HMAC-SHA256 under the key of the device of the image, then
+ * the len and crc of its header as little endian words. The key is set
+ * over the provisioning frames once, PROV_KEY, into the RWW EEPROM and
+ * never read back out. With no key set no image is taken. The CRC only
+ * keeps out a corrupt image, the MAC one not made with the key.
+ *
+ * An image is the application alone, us3_mshield_fw.bin, from its vectors
+ * on. The rows ahead of it, where the bootloader jumps, hold the install
+ * stub, .fwstub of the linker script. No image carries it and no install
+ * writes it. At boot a pending image is checked once more, CRC and MAC,
+ * the header marked installing and the stub copies it over the application
+ * a row at a time, each marked in the header sector at FW_MARKS once
+ * written. The
+ * first row, the vectors, is erased before any other and written last. A
+ * reset in between leaves it erased, the stub then finds the header still
+ * installing and copies the rows not marked. FW_DONE once the application
+ * checks out. The stub reads the header and the marks as they are here,
+ * they stay the same across images.
+ */
+
+#ifndef _FW_H_
+#define _FW_H_
+
+#include <stdint.h>
+#include "errors.h"
+#include "sha256.h"
+
+#define FW_ADDR                 0x40000UL
+#define FW_SECTOR               4096
+#define FW_IMG_ADDR             (FW_ADDR + FW_SECTOR)
+#define FW_MAGIC                0x5746      /* "FW" */
+#define FW_PENDING              0x7E
+#define FW_INSTALLING           0x3C
+#define FW_DONE                 0x00
+#define FW_QUERY_CRC            "crc"
+#define FW_QUERY_MAC            "mac"
+#define FW_RESET_MS             250
+
+/* A byte a row of the image after the header, 0 once copied */
+#define FW_MARKS                (FW_ADDR + 256)
+
+/* The MAC key, the first row of the RWW EEPROM, erased if none is set */
+#define FW_KEY_ADDR             0x00400000UL
+#define FW_KEY_SIZE             32
+
+/* The SPI flash of the variant for the stub, which reads no pin table */
+#define FW_SPI_MISO             PINMUX_PB03D_SERCOM5_PAD1
+#define FW_SPI_MOSI             PINMUX_PB22D_SERCOM5_PAD2
+#define FW_SPI_SCK              PINMUX_PB23D_SERCOM5_PAD3
+#define FW_SPI_CS               PIN_PA13
+#define FW_SPI_BAUD             2           /* GCLK0 / 6 */
+#define FW_SPI_RES_LOOPS        500         /* Out of deep power-down, 30 us at 48 MHz */
+
+/* Header of the staged firmware, written once the image checks out */
+struct fw_hdr {
+    uint16_t magic;             /* FW_MAGIC */
+    uint8_t state;              /* FW_PENDING, INSTALLING or DONE */
+    uint8_t pad;
+    uint32_t len;               /* Image bytes, from FW_IMG_ADDR */
+    uint32_t crc;               /* crc32 of the image */
+    uint8_t mac[SHA256_SIZE];   /* HMAC-SHA256 of the image, len and crc */
+};
+
+struct coap_msg_ctx;
+
+/* At boot, install a staged image that is pending, or mark the one the
+ * stub installed done */
+void fw_boot(void);
+
+/* Add the reset task of POST /sys/fw */
+void fw_start(void);
+
+/* Set the MAC key, FW_KEY_SIZE bytes. False if it did not take. */
+bool fw_key_set(const uint8_t *key);
+
+/* GET, PUT and POST /sys/fw */
+error_t fw_rsp(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, void *it);
+
+#endif /* _FW_H_ */
@@ -40,11 +40,20 @@ Networks, Inc.
 struct mbuf {
     uint16_t len;
     uint16_t size;
+    uint16_t off;       /* headroom, the data starts at data[off] */
+    uint16_t ref;       /* holders, m_free drops one; also keeps data aligned */
+    struct mbuf *next;  /* next buffer of the chain, NULL in the last */
     uint8_t data[0];    /* allocated to actual size */
 };
 
 typedef struct mbuf * mbuf_ptr_t;
 
+/* static mbuf pools, big for a reassembled message, small for an HDLC frame */
+#define MBUF_POOL_BIG_SIZE      (1024)
+#define MBUF_POOL_BIG_CNT       (5)
+#define MBUF_POOL_SMALL_SIZE    (320)
+#define MBUF_POOL_SMALL_CNT     (10)
+
 /**
  * @brief Set the size of the mbuf data buffer
  *
@@ -64,14 +73,37 @@ int get_mbuf_data_size();
 
 
 /**
- * @brief Allocate memory for the mbuf including the data buffer
+ * @brief Allocate a big mbuf, get_mbuf_data_size() bytes, from the pool
  *
+ * @return The mbuf, or NULL if the pool is empty
  *
  */
 struct mbuf *m_get();
 
 /**
- * @brief De-allocate the mbuf memory including the data buffer
+ * @brief Allocate an mbuf for at least len bytes
+ *
+ * Takes a small mbuf if len fits, a big one otherwise or if the small pool
+ * is empty.
+ *
+ * @param[in] len Number of bytes needed, headroom included
+ * @return The mbuf, or NULL if no pool has one free
+ *
+ */
+struct mbuf *m_get_len(int len);
+
+/**
+ * @brief Most mbufs of a pool ever in use at once
+ *
+ * @param[in] big 1 for the big pool, 0 for the small one
+ *
+ */
+int m_pool_peak(int big);
+
+extern int pool_empty_cnt;     /* allocations failed for an empty pool */
+
+/**
+ * @brief Drop a reference, the mbuf goes back to its pool with the last one
  *
  * @param[in] m Pointer to the mbuf
  *
@@ -79,10 +111,14 @@ struct mbuf *m_get();
 void m_free(struct mbuf *m);
 
 /**
- * @brief Append bytes to the mbuf data buffer
+ * @brief Append bytes to the end of the mbuf chain
+ *
+ * Chains another mbuf if the last one hasn't room for len bytes, so the
+ * returned bytes are always contiguous.
  *
  * @param[in] mp Pointer to the mbuf
  * @param[in] len Number of bytes to append
+ * @return Pointer to the appended bytes, or NULL if no mbuf is free
  *
  */
 void *m_append(struct mbuf *mp, int16_t len);
@@ -91,12 +127,39 @@ void *m_append(struct mbuf *mp, int16_t len);
 /**
  * @brief Prepend bytes to the mbuf data buffer
  *
+ * Takes the bytes from the headroom if there is enough, otherwise moves the
+ * data up.
+ *
  * @param[in] m Pointer to the mbuf
  * @param[in] len Number of bytes to prepend
  *
  */
 struct mbuf *m_prepend(struct mbuf *m, int len);
 
+/**
+ * @brief Reserve headroom in an empty mbuf, for headers prepended later
+ *
+ * Rounded up to 4 bytes, so that the payload stays 32 bit aligned.
+ *
+ * @param[in] m Pointer to the mbuf
+ * @param[in] len Number of bytes to reserve
+ * @return 0, or -1 if the mbuf isn't empty or is too small
+ *
+ */
+int m_reserve(struct mbuf *m, int len);
+
+/**
+ * @brief Take another reference to the mbuf
+ *
+ * Shares the buffer instead of copying it; each holder calls m_free once.
+ * A shared mbuf is read-only, m_dup one to change it.
+ *
+ * @param[in] m Pointer to the mbuf
+ * @return m
+ *
+ */
+struct mbuf *m_ref(struct mbuf *m);
+
 /**
  * @brief Duplicate the mbuf
  *
@@ -106,16 +169,67 @@ struct mbuf *m_prepend(struct mbuf *m, int len);
 struct mbuf *m_dup(struct mbuf *);
 
 
+/**
+ * @brief Length of the data in the whole mbuf chain
+ *
+ * @param[in] m Pointer to the first mbuf of the chain
+ *
+ */
+int m_length(struct mbuf *m);
+
 int m_copydata(struct mbuf *m, uint32_t off, uint32_t len, void *vp);
 void m_adj(struct mbuf *mp, int req_len);
 
+/*
+ * Scratch arena, for the temporary buffers of a request instead of the stack.
+ * A bump allocator, main loop only: take a mark, allocate, release the mark.
+ * coap_s_proc resets it at the end of each request, dropping anything the
+ * request path didn't release itself.
+ */
+#define SCRATCH_SIZE    (1024)
+
+/**
+ * @brief Allocate len bytes, 32 bit aligned, from the scratch arena
+ *
+ * @param[in] len Number of bytes
+ * @return Pointer to the bytes, or NULL if the arena is full
+ *
+ */
+void *scratch_alloc(int len);
+
+/**
+ * @brief Current top of the scratch arena, for scratch_release
+ *
+ */
+int scratch_mark(void);
+
+/**
+ * @brief Free everything allocated since the mark was taken
+ *
+ * @param[in] mark From scratch_mark
+ *
+ */
+void scratch_release(int mark);
+
+/**
+ * @brief Empty the scratch arena
+ *
+ */
+void scratch_reset(void);
+
+/**
+ * @brief Most of the scratch arena ever in use at once
+ *
+ */
+int scratch_peak(void);
+
 /* Compatibility macros for full mbuf - use only these to access mbuf */
 #define m_gethdr()  m_get()
 #define MGETHDR(m) (m = m_gethdr())
-#define M_TRAILINGSPACE(m) (MLEN - (m)->len)
-#define m_pktlen    len
-#define m_data      data
+#define M_TRAILINGSPACE(m) ((m)->size - (m)->off - (m)->len)
+#define M_LEADINGSPACE(m) ((m)->off)
+#define m_pktlen(m) m_length(m)
  /* mtod(m, t)   -- Convert mbuf pointer to data pointer of correct type. */
-#define mtod(m, t)      ((t)((m)->m_data))
+#define mtod(m, t)      ((t)((m)->data + (m)->off))
 
 #endif /* _INC_MBUF_H */
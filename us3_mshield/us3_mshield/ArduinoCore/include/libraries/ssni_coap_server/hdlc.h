@@ -35,11 +35,11 @@ Networks, Inc.
 
 #define HDLC_FLAG           (0x7e)
 
-/* The UART time-out period in milliseconds */
+/* A partial frame is dropped if the UART is idle this many milliseconds */
 #define READ_BUF_TIMEOUT		400
 
-/* The maximum number of bytes we can receive in one chunk over the UART */
-#define UART_MAX_BUF_LEN		1024
+/* Longest wait for CTS before a frame is given up */
+#define HDLC_CTS_TIMEOUT		100
 
 /* The max payload size in the mNIC */
 #define MNIC_MAX_PAYLOAD_SIZE	255
@@ -94,8 +94,24 @@ Networks, Inc.
 #define HDLC_ERROR_RX_OVERRUN       (HDLC_ERROR_BASE + 12)
 #define HDLC_ERROR_UNKNOWN_STATE    (HDLC_ERROR_BASE + 13)
 
-/* Set pointer to Serial object */
-void hdlc_init( HardwareSerial * pUART, uint32_t max_info_len );
+/* Serial link to the mNIC */
+#define HDLC_LINK_NO_PIN    (0xff)
+
+struct hdlc_link_cfg {
+    uint32_t baud;          /* until the data link is up */
+    uint32_t fast_baud;     /* once SNRM is acked, 0 to stay at baud */
+    uint8_t pin_rts;        /* HDLC_LINK_NO_PIN if not wired */
+    uint8_t pin_cts;
+};
+
+/* Set pointer to Serial object, link may be NULL for 38400 without flow
+ * control */
+void hdlc_init( HardwareSerial * pUART, const struct hdlc_link_cfg *link, 
+                uint32_t max_info_len );
+
+/* Move the UART to the fast baud while the data link is up, back when not.
+ * Waits for anything being sent to go out first. */
+void hdlc_link_up( int up );
 
 /* Frame / data parsers used by send/recv implementers */
 struct hdlc_hdr_fields {
@@ -152,6 +168,18 @@ int hdlc_parse_addr(const uint8_t *buf, int len, uint32_t *eaddr, int *al);
 int hdlc_hdr(int segment, int16_t fcontrol, uint32_t dst, uint32_t src,
     uint8_t *buf, int *hdrlen);
 
+/* Header with the connection's encoded addresses, built once per
+ * connection so each frame only needs format, control and HCS */
+struct hdlc_hdr_tmpl {
+    uint8_t h[HDLC_HDR_SIZE - HDLC_CRC_SIZE - 1];  /* format, dst, src */
+    uint16_t crc;       /* CRC over h, with the length of a bare header */
+};
+void hdlc_hdr_tmpl_init(struct hdlc_hdr_tmpl *t, uint8_t dst, uint8_t src);
+/* The header carries the final frame length, so hdlc_send_frame doesn't
+ * patch the length and HCS again */
+int hdlc_hdr_tmpl_fill(const struct hdlc_hdr_tmpl *t, int segment, 
+    int16_t fcontrol, int infolen, uint8_t *buf);
+
 
 
 struct hdlc_conn;
@@ -249,15 +277,71 @@ struct hdlcstat {
     uint32_t recv_recovery;
     uint32_t data_buf_overrun;
     uint32_t send_i_recovery;
+    uint32_t send_i_rexmit;     /* I frames resent by go back N */
+    uint32_t recv_snrm;
+    uint32_t recv_disc;
+    uint32_t recv_busy;         /* I frames refused, request queue full */
+};
+
+/* RX to TX latency histogram buckets, in ms: <1, 1-2, 2-4 ... 64+ */
+#define HDLC_LAT_BUCKETS    (8)
+
+/* Link counters reported in GET /sys/stats?mod=hdlc - 32 bit values only */
+struct hdlc_link_stats {
+    uint32_t rx_frames;         /* frames deframed */
+    uint32_t rx_good;           /* frames passed up */
+    uint32_t tx_frames;
+    uint32_t hcs_err;
+    uint32_t fcs_err;
+    uint32_t hdr_err;           /* bad format, address or length field */
+    uint32_t len_err;           /* length field didn't match the wire */
+    uint32_t oversize;          /* info larger than we accept */
+    uint32_t overrun;           /* frame lost, both RX slots full */
+    uint32_t nomem;
+    uint32_t idle_discard;      /* partial frame dropped, UART went quiet */
+    uint32_t seqnum_err;
+    uint32_t rexmit;            /* I frames resent */
+    uint32_t send_err;          /* frames not sent, CTS timeout or bad data */
+    uint32_t snrm;
+    uint32_t disc;
+    uint32_t lat_hist[HDLC_LAT_BUCKETS];    /* frame in to next frame out */
 };
 
+/* Snapshot the link counters */
+void hdlc_get_stats(struct hdlc_link_stats *s);
+
+/* micros() at the closing flag of the last frame handed up */
+uint32_t hdlc_rx_us(void);
+
 
 
 int hdlc_recv_frame(uint8_t *hdr, uint8_t *info, int framesz, int timeout);
-int hdlc_rx(uint8_t *hdr, uint8_t *info, int framesz, int timeout);
+/* Wait for a frame.  If it carries info, *info is set to an mbuf holding
+ * it which the caller must free.
+ */
+struct mbuf;
+int hdlc_rx(uint8_t *hdr, struct mbuf **info, int timeout);
+/* As hdlc_rx without the wait: -1 if no frame is complete yet */
+int hdlc_rx_poll(uint8_t *hdr, struct mbuf **info);
+
+/* Have fn called from the UART IRQ each time a frame is complete, so the
+ * task polling for frames can be woken.  NULL for none. */
+void hdlc_rx_notify(void (*fn)(void));
+
+/* Feed one received byte to the deframer, called from the UART IRQ */
+void hdlc_rx_byte(uint8_t c);
 
 int hdlc_send_frame(const uint8_t *hdr, const uint8_t *info, int infolen);
 
+/* Queue a frame and return without waiting for it to go out.  info must stay
+ * valid until done is called (from interrupt context when sent by DMA).
+ */
+typedef void (*hdlc_tx_done)(void *arg);
+int hdlc_send_frame_async(const uint8_t *hdr, const uint8_t *info, int infolen,
+                          hdlc_tx_done done, void *arg);
+int hdlc_tx_busy(void);
+void hdlc_tx_wait(void);
+
 int
 hdlc_parse_hdr(struct hdlc_hdr_fields *hh, const uint8_t *buf, int buflen);
 
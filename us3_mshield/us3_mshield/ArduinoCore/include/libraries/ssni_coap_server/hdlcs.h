@@ -33,20 +33,42 @@ Networks, Inc.
 #include <HardwareSerial.h>
 #include "errors.h"
 
-/* Open HDLCS connection */
-error_t hdlcs_open( HardwareSerial * pUART, uint32_t timeout_ms, uint32_t max_hdlc_info_len );
+/* Largest I frame window we offer in the SNRM-UA, frames are held for
+ * retransmit until acked so each one costs an mbuf */
+#define HDLCS_WINDOW_MAX    (4)
+/* Frames that may be queued (sent or not) - modulo 8 allows 7 */
+#define HDLCS_TXQ_MAX       (7)
+/* Largest app layer message, bigger than max_info it is carried in
+ * segmented I frames.  This is also the mbuf data size. */
+#define HDLCS_MSG_MAX       (1024)
+/* Reassembled requests waiting for hdlcs_read, an mbuf each.  With the
+ * queue full the next request is refused, left for the primary to resend */
+#define HDLCS_RXQ_MAX       (4)
+
+/* Open HDLCS connection, link may be NULL for the default link settings */
+struct hdlc_link_cfg;
+error_t hdlcs_open( HardwareSerial * pUART, const struct hdlc_link_cfg *link, 
+                    uint32_t timeout_ms, uint32_t max_hdlc_info_len );
 
 /* shut down state machine */
 int hdlcs_close(void);
 
-/* process pending transaction */
+/* process pending transaction, waits for a frame up to the UART time-out */
 int hdlcs_run(void);
+/* as above without waiting, for callers that poll from their main loop,
+ * 1 if a frame was handled */
+int hdlcs_poll(void);
 
 /* get incoming reassembled app layer data */
 struct mbuf;
 struct mbuf *hdlcs_read(void);
+/* micros() at the last frame of the request hdlcs_read last returned */
+uint32_t hdlcs_read_us(void);
 /* hand outgoing app layer data to HDLC */
 int hdlcs_write(const void *data, uint16_t len);
+/* as above, without the copy; takes ownership of m and frees it once
+ * the primary acks it.  Frames go out as the negotiated window allows. */
+int hdlcs_write_mbuf(struct mbuf *m);
 
 /* Exposed to clients so they can signal no response. */
 int hdlcs_rr(void);
@@ -61,5 +83,9 @@ void hdlcs_data_register(hdlcs_data_handler f);
  */
 boolean hdlcs_is_connected();
 
+/* info field of one transmitted I frame, as negotiated by the last SNRM,
+ * the configured max before one.  Longer messages go out segmented. */
+uint16_t hdlcs_max_info_tx(void);
+
 #endif /* _INC_HDLC_SECONDARY_H_ */
 
@@ -0,0 +1,70 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+/*
+ * Health heartbeat sent with the data notifications, see sapi_set_health.
+ *
+ * Once due, every period_s, a CBOR map of the uptime, the reset cause,
+ * the stack and heap low water marks, the buffer pool peaks, the HDLC,
+ * CoAP and Modbus counters, the worst task times and the battery is
+ * encoded, and it waits until a notification of samples takes it.
+ */
+
+#ifndef _HEALTH_H_
+#define _HEALTH_H_
+
+#include <stdint.h>
+#include "sapi.h"
+
+#define HEALTH_ENC_MAX          112
+#define HEALTH_PERIOD_S         86400UL
+#define HEALTH_MAX_S            (49 * 86400UL)  /* millis() wraps at 49 days */
+
+struct cbor_buf;
+
+/* Encode a heartbeat every period_s, 0 stops it, with the battery read
+ * by batt_mv if not NULL. SAPI_ERR_BAD_DATA past HEALTH_MAX_S. */
+sapi_error_t health_set(uint32_t period_s, SensorBattFuncPtr batt_mv);
+
+/* Encode the heartbeat if it is due */
+void health_poll(void);
+
+/* Encoded length of the heartbeat waiting, 0 if none */
+uint8_t health_len(void);
+
+/* A notification took the heartbeat waiting */
+void health_taken(void);
+
+/* Append the heartbeat waiting, already CBOR, CBOR_ERR without room */
+uint8_t health_enc(struct cbor_buf *cbuf);
+
+#endif /* _HEALTH_H_ */
@@ -0,0 +1,83 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+/*
+ * Compression of the payload of a notification, heatshrink's format.
+ *
+ * Batches of samples repeat themselves, the same sensor type, epochs a
+ * period apart and values that barely move, so an LZSS pass makes them
+ * 3-5 times shorter. The bitstream is that of heatshrink with a window of
+ * 2^HSHRINK_WINDOW_SZ2 bytes and a lookahead of 2^HSHRINK_LOOKAHEAD_SZ2,
+ * so the head-end decodes it with the stock library: MSB first, 1 and a
+ * byte for a literal, 0, offset - 1 and length - 1 for a back reference
+ * of 2 bytes or more, zero bits to the end of the last byte.
+ *
+ * The whole payload is in RAM, so it is its own window: there is no state
+ * beyond the output, in the scratch arena. The match search is brute
+ * force, a few ms for a full frame. coapsensorobs compresses notifications
+ * of HSHRINK_MIN_LEN bytes or more of the observers it is asked to, and
+ * says so by their Content-Format, see coappdu.h. Left out unless HSHRINK
+ * is 1.
+ */
+
+#ifndef _HSHRINK_H_
+#define _HSHRINK_H_
+
+#include <stdint.h>
+#include "hbuf.h"
+
+#ifndef HSHRINK
+#define HSHRINK                 1
+#endif
+
+#define HSHRINK_WINDOW_SZ2      8
+#define HSHRINK_LOOKAHEAD_SZ2   4
+#define HSHRINK_MIN_LEN         64
+
+/* A samples notification of a compressed observer takes 2^this times the room */
+#define HSHRINK_ROOM_SHIFT      1
+
+#if HSHRINK
+/*
+ * Compress len bytes of in to out, at most size bytes.
+ * Returns the bytes written, 0 if they don't fit.
+ */
+uint16_t hshrink(const uint8_t *in, uint16_t len, uint8_t *out, uint16_t size);
+
+/*
+ * Compress the payload of m in place, if it is at least HSHRINK_MIN_LEN
+ * bytes in a single mbuf and comes out shorter. Returns 1 if it did.
+ */
+uint8_t hshrink_mbuf(struct mbuf *m);
+#endif
+
+#endif /* _HSHRINK_H_ */
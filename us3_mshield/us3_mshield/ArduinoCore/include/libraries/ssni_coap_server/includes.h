@@ -122,6 +122,13 @@ Networks, Inc.
 
 
 // Network order macros. Always use the gcc pre-defined macros!
+// A host libc has its own in <endian.h>, these are the ones used
+#undef htobe64
+#undef htobe32
+#undef htobe16
+#undef htole64
+#undef htole32
+#undef htole16
 #if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
 #define ntohll(x)  ((uint64_t)(x))
 #define htonll(x)  ((uint64_t)(x))
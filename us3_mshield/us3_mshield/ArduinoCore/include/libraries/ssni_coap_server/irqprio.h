@@ -0,0 +1,54 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+/*
+ * The interrupt priority plan of ports.h, checked at run time.
+ *
+ * The core sets each IRQ it enables from the plan, but a library that
+ * sets its own, or a core update, would quietly put a long handler above
+ * UART RX again. irq_prio_check compares the NVIC with the plan for every
+ * IRQ in it, puts back those that moved and logs them. sapi runs it once
+ * the drivers have begun, and again with the event task.
+ */
+
+#ifndef _IRQPRIO_H_
+#define _IRQPRIO_H_
+
+#include <stdint.h>
+
+/* Check the NVIC against the plan and fix it. Returns the IRQs that were off. */
+uint8_t irq_prio_check(void);
+
+/* IRQs found off the plan since boot */
+uint32_t irq_prio_fixed(void);
+
+#endif /* _IRQPRIO_H_ */
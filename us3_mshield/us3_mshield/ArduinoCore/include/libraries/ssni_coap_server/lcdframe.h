@@ -0,0 +1,80 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+/*
+ * A frame buffer for an HD44780 display on a PCF8574 backpack.
+ *
+ * Text goes into the next frame, in RAM, without a byte to the display.
+ * lcd_frame_flush() compares it with the shadow of what the display
+ * shows and sends the cells that changed, a cursor address and a run of
+ * characters to one I2C transaction each, see LiquidCrystal_I2C::writeRun.
+ * A status line whose seconds tick costs a few hundred microseconds of
+ * bus time rather than the tens of milliseconds of reprinting it all.
+ */
+
+#ifndef _LCDFRAME_H_
+#define _LCDFRAME_H_
+
+#include <Arduino.h>
+#include "LiquidCrystal_I2C.h"
+
+#define LCD_FRAME_COLS_MAX      20
+#define LCD_FRAME_ROWS_MAX      4
+
+/* Unchanged cells sent again rather than setting the cursor past them */
+#define LCD_FRAME_GAP           1
+
+struct lcd_frame {
+    LiquidCrystal_I2C *lcd;
+    uint8_t cols;
+    uint8_t rows;
+    uint8_t valid;                  /* shown is what the display has */
+    char next[LCD_FRAME_ROWS_MAX][LCD_FRAME_COLS_MAX];
+    char shown[LCD_FRAME_ROWS_MAX][LCD_FRAME_COLS_MAX];
+};
+
+/* The display has been begun, its contents unknown */
+void lcd_frame_init(struct lcd_frame *f, LiquidCrystal_I2C *lcd, uint8_t cols, uint8_t rows);
+
+/* Blank the next frame */
+void lcd_frame_clear(struct lcd_frame *f);
+
+/* Text at col, row of the next frame, clipped at the end of the row; the cells written */
+uint8_t lcd_frame_put(struct lcd_frame *f, uint8_t col, uint8_t row, const char *s);
+uint8_t lcd_frame_printf(struct lcd_frame *f, uint8_t col, uint8_t row, const char *fmt, ...);
+
+/* Send all of the next frame at the next flush, the display having been reset */
+void lcd_frame_invalidate(struct lcd_frame *f);
+
+/* Send the changed cells of the next frame; the cells sent */
+uint16_t lcd_frame_flush(struct lcd_frame *f);
+
+#endif /* _LCDFRAME_H_ */
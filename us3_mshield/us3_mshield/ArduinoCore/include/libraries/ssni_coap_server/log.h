@@ -66,6 +66,117 @@ Networks, Inc.
 #define LOG_INFO        (6)         /* informational */
 #define LOG_DEBUG       (7)         /* debug-level messages */
 
+/*
+ * Messages above LOG_BUILD_LEVEL are compiled out by DLOG and DDUMP,
+ * format strings and arguments too. The run time level, dlog_level,
+ * filters the rest. Build with -DLOG_BUILD_LEVEL=LOG_ERR for production.
+ */
+#ifndef LOG_BUILD_LEVEL
+#define LOG_BUILD_LEVEL LOG_DEBUG
+#endif
+
+#define DLOG(level, ...)    do { if ((level) <= LOG_BUILD_LEVEL) dlog((level), __VA_ARGS__); } while (0)
+#define DDUMP(level, ...)   do { if ((level) <= LOG_BUILD_LEVEL) ddump((level), __VA_ARGS__); } while (0)
+
+/*
+ * One macro a level, for a level known where it is logged. Above
+ * LOG_BUILD_LEVEL the preprocessor drops the call, its arguments are not
+ * even evaluated. DLOG and DDUMP are for a level known at run time.
+ */
+#if LOG_BUILD_LEVEL >= LOG_EMERG
+#define DLOG_EMERG(...)    LOG_EMIT(LOG_EMERG, __VA_ARGS__)
+#define DDUMP_EMERG(...)   ddump(LOG_EMERG, __VA_ARGS__)
+#else
+#define DLOG_EMERG(...)    do { } while (0)
+#define DDUMP_EMERG(...)   do { } while (0)
+#endif
+#if LOG_BUILD_LEVEL >= LOG_ALERT
+#define DLOG_ALERT(...)    LOG_EMIT(LOG_ALERT, __VA_ARGS__)
+#define DDUMP_ALERT(...)   ddump(LOG_ALERT, __VA_ARGS__)
+#else
+#define DLOG_ALERT(...)    do { } while (0)
+#define DDUMP_ALERT(...)   do { } while (0)
+#endif
+#if LOG_BUILD_LEVEL >= LOG_CRIT
+#define DLOG_CRIT(...)     LOG_EMIT(LOG_CRIT, __VA_ARGS__)
+#define DDUMP_CRIT(...)    ddump(LOG_CRIT, __VA_ARGS__)
+#else
+#define DLOG_CRIT(...)     do { } while (0)
+#define DDUMP_CRIT(...)    do { } while (0)
+#endif
+#if LOG_BUILD_LEVEL >= LOG_ERR
+#define DLOG_ERR(...)      LOG_EMIT(LOG_ERR, __VA_ARGS__)
+#define DDUMP_ERR(...)     ddump(LOG_ERR, __VA_ARGS__)
+#else
+#define DLOG_ERR(...)      do { } while (0)
+#define DDUMP_ERR(...)     do { } while (0)
+#endif
+#if LOG_BUILD_LEVEL >= LOG_WARNING
+#define DLOG_WARNING(...)  LOG_EMIT(LOG_WARNING, __VA_ARGS__)
+#define DDUMP_WARNING(...) ddump(LOG_WARNING, __VA_ARGS__)
+#else
+#define DLOG_WARNING(...)  do { } while (0)
+#define DDUMP_WARNING(...) do { } while (0)
+#endif
+#if LOG_BUILD_LEVEL >= LOG_NOTICE
+#define DLOG_NOTICE(...)   LOG_EMIT(LOG_NOTICE, __VA_ARGS__)
+#define DDUMP_NOTICE(...)  ddump(LOG_NOTICE, __VA_ARGS__)
+#else
+#define DLOG_NOTICE(...)   do { } while (0)
+#define DDUMP_NOTICE(...)  do { } while (0)
+#endif
+#if LOG_BUILD_LEVEL >= LOG_INFO
+#define DLOG_INFO(...)     LOG_EMIT(LOG_INFO, __VA_ARGS__)
+#define DDUMP_INFO(...)    ddump(LOG_INFO, __VA_ARGS__)
+#else
+#define DLOG_INFO(...)     do { } while (0)
+#define DDUMP_INFO(...)    do { } while (0)
+#endif
+#if LOG_BUILD_LEVEL >= LOG_DEBUG
+#define DLOG_DEBUG(...)    LOG_EMIT(LOG_DEBUG, __VA_ARGS__)
+#define DDUMP_DEBUG(...)   ddump(LOG_DEBUG, __VA_ARGS__)
+#else
+#define DLOG_DEBUG(...)    do { } while (0)
+#define DDUMP_DEBUG(...)   do { } while (0)
+#endif
+
+/*
+ * dlog doesn't print, it packs millis(), the level, the format pointer and
+ * the arguments into a record of a RAM ring that log_drain prints later,
+ * from the idle loop. The format has to be a literal. %s strings are
+ * copied, cut to what is left of LOG_ARG_BYTES. A full ring is drained in
+ * place, records from an interrupt are dropped and counted instead. The
+ * other print functions drain the ring first, to keep the console in order.
+ */
+#define LOG_RING_RECS   16          /* records, a power of 2 */
+#define LOG_ARG_BYTES   48          /* packed arguments of a record */
+#define LOG_DRAIN_IDLE  4           /* records printed per idle loop pass */
+
+/*
+ * Everything for the console is gathered into packets of LOG_OUT_LEN, a
+ * full USB CDC bulk packet, so a line goes out in one transfer with the
+ * ones around it rather than one per print call. A packet is sent once
+ * full, by log_poll once its first byte is LOG_OUT_MS old, or by
+ * log_flush. log_drain of the whole ring flushes too.
+ */
+#ifndef LOG_OUT_LEN
+#define LOG_OUT_LEN     64
+#endif
+#define LOG_OUT_MS      10
+
+// A deferred message, of dlog or of a tokenized call
+struct log_rec
+{
+	uint32_t			ms;						// millis() when logged
+	const char			*format;				// In .logfmt for a token
+	uint8_t				level;
+	uint8_t				len;					// Argument bytes packed
+	uint8_t				cut;					// 1 -> the arguments after len didn't fit
+	uint8_t				tok;					// 1 -> sent as a token frame
+	volatile uint8_t	ready;					// 0 while it is filled
+	uint8_t				args[LOG_ARG_BYTES];
+};
+
 
 /**
 * @brief
@@ -73,9 +184,28 @@ Networks, Inc.
 *
 * @param Serial_ pointer to Serial object used for printing to console
 * @param baun The baud rate for printing to console
+* @param wait Non-zero to give the monitor 16s to connect, else logging starts
+*   from log_poll once it does
 *
 */
-void log_init( Serial_ * pSerial, uint32_t baud, uint32_t log_level );
+void log_init( Serial_ * pSerial, uint32_t baud, uint32_t log_level, uint8_t wait = 1 );
+
+
+/**
+* @brief
+* Start logging once the monitor connects, checked at most once a second,
+* and send a packet gathered LOG_OUT_MS ago. Call from the main loop after
+* log_init.
+*
+*/
+void log_poll();
+
+/**
+* @brief
+* Send what the console packet holds now, see LOG_OUT_LEN
+*
+*/
+void log_flush();
 
 
 /**
@@ -88,6 +218,16 @@ void log_init( Serial_ * pSerial, uint32_t baud, uint32_t log_level );
 */
 extern void dlog_level(int level);
 
+/**
+* @brief
+* Check if a message at this level would be output, to skip building it
+*
+* @param level The log level
+* @return int Non-zero if dlog would print at level
+*
+*/
+extern int dlog_on(int level);
+
 /**
 * @brief
 * Output a debug message to serial port
@@ -97,10 +237,46 @@ extern void dlog_level(int level);
 * @param ... any number of variables
 * @return void
 *
+* The message is printed by log_drain, see LOG_RING_RECS.
+*
 */
 extern void dlog (int level, const char *my_format, ...)
             __attribute__ ((format (printf, 2, 3)));
 
+/**
+* @brief
+* Print the records dlog left in the ring, oldest first
+*
+* @param max Most records to print, 0 for all of them and a log_flush
+* @return int Records still in the ring
+*
+*/
+int log_drain(int max = 0);
+
+/**
+* @brief
+* Copy the last records taken, printed or not, oldest first. Takes no
+* lock and formats nothing, so a fault handler may call it.
+*
+* @param dst Where the records go
+* @param max Most records to copy
+* @return int Records copied
+*
+*/
+int log_last(struct log_rec *dst, int max);
+
+/**
+* @brief
+* Format a record copied by log_last, "<ms> <level>: <message>". A token
+* record gives its token, its format isn't in the image.
+*
+* @param r The record
+* @param buf Where the text goes, NUL terminated
+* @param size Size of buf
+*
+*/
+void log_rec_text(const struct log_rec *r, char *buf, int size);
+
 /**
 * @brief
 * Dump a list
@@ -114,6 +290,20 @@ extern void dlog (int level, const char *my_format, ...)
 */
 extern void ddump(int level, const char *label, const void *data, int len);
 
+/**
+* @brief
+* Write bytes as hex digits, from a table
+*
+* @param buf Where the text goes, 3 characters a byte with sep, 2 without,
+*   and the NUL
+* @param data The bytes
+* @param len Number of bytes
+* @param sep Put between the bytes, 0 for none
+* @return int Characters written, without the NUL
+*
+*/
+int log_hex(char *buf, const void *data, int len, char sep);
+
 /**
 * @brief Print buffer without newline
 *
@@ -180,6 +370,129 @@ void capture_dump( uint8_t * p, int count );
 */
 int free_ram();
 
+/**
+* mem_paint
+*
+* @brief Paint the free RAM between heap and stack, once at boot
+*
+* Lets mem_stack_used() and mem_free_min() find how deep the stack has been.
+*
+*/
+void mem_paint();
+
+/**
+* mem_stack_used
+*
+* @brief Stack high-water mark in bytes, 0 if mem_paint() wasn't called
+*
+*/
+uint32_t mem_stack_used();
+
+/**
+* mem_free_min
+*
+* @brief Least free RAM seen between heap and stack, since mem_paint()
+*
+*/
+uint32_t mem_free_min();
+
+
+/*
+ * Tokenized logging, built with -DLOG_TOKENS. The DLOG_<LEVEL> macros put
+ * their format in .logfmt, a section the linker scripts keep out of flash,
+ * and pack the arguments by their C++ type. log_drain sends the record as
+ * a frame, see logfmt.h, that tools/logdec turns back into text with the
+ * ELF. dlog, DLOG and the other print functions stay text.
+ */
+struct log_tok_buf
+{
+    uint8_t n;
+    uint8_t cut;
+    uint8_t b[LOG_ARG_BYTES];
+};
+
+/* Copy a string and its NUL to args at *n, cut to LOG_ARG_BYTES, 0 if no room */
+int log_put_str(uint8_t *args, int *n, const char *str);
+
+/* Queue a tokenized record, format being in .logfmt */
+void dlog_tok_put(int level, const char *format, const struct log_tok_buf *t);
+
+#ifdef LOG_TOKENS
+static inline void log_tok_raw(struct log_tok_buf *t, const void *v, uint8_t size)
+{
+    if (t->cut || t->n + size > LOG_ARG_BYTES) {
+        t->cut = 1;
+        return;
+    }
+    memcpy(&t->b[t->n], v, size);
+    t->n += size;
+}
+
+static inline void log_tok_arg(struct log_tok_buf *t, const char *s)
+{
+    int n = t->n;
+
+    if (t->cut || !log_put_str(t->b, &n, s ? s : "(null)")) {
+        t->cut = 1;
+        return;
+    }
+    t->n = n;
+}
+
+static inline void log_tok_arg(struct log_tok_buf *t, char *s)    { log_tok_arg(t, (const char *)s); }
+static inline void log_tok_arg(struct log_tok_buf *t, double d)   { log_tok_raw(t, &d, sizeof(d)); }
+static inline void log_tok_arg(struct log_tok_buf *t, float f)    { log_tok_arg(t, (double)f); }
+
+/* Other pointers, for %p, in 4 bytes as on the SAML21 */
+template <typename T>
+static inline void log_tok_arg(struct log_tok_buf *t, T *p)
+{
+    uint32_t u = (uint32_t)(uintptr_t)p;
+
+    log_tok_raw(t, &u, sizeof(u));
+}
+
+/* Integers, in 4 bytes or 8 for long long */
+template <typename T>
+static inline void log_tok_arg(struct log_tok_buf *t, T v)
+{
+    if (sizeof(T) > 4) {
+        uint64_t u = (uint64_t)v;
+        log_tok_raw(t, &u, sizeof(u));
+    } else {
+        uint32_t u = (uint32_t)v;
+        log_tok_raw(t, &u, sizeof(u));
+    }
+}
+
+static inline void log_tok_pack(struct log_tok_buf *t) { }
+
+template <typename T, typename... R>
+static inline void log_tok_pack(struct log_tok_buf *t, T v, R... rest)
+{
+    log_tok_arg(t, v);
+    log_tok_pack(t, rest...);
+}
+
+template <typename... A>
+static inline void dlog_tok(int level, const char *format, A... args)
+{
+    struct log_tok_buf t;
+
+    if (!dlog_on(level)) {
+        return;
+    }
+    t.n = 0;
+    t.cut = 0;
+    log_tok_pack(&t, args...);
+    dlog_tok_put(level, format, &t);
+}
+
+#define LOG_FMT(f)              ({ static const char log_fmt_[] __attribute__ ((section (".logfmt"), used)) = f; log_fmt_; })
+#define LOG_EMIT(level, f, ...) dlog_tok((level), LOG_FMT(f), ##__VA_ARGS__)
+#else
+#define LOG_EMIT(level, ...)    dlog((level), __VA_ARGS__)
+#endif
 
 
 #endif /* INC_LOG_H */
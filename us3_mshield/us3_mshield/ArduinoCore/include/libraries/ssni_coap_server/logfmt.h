@@ -0,0 +1,76 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+/*
+ * Formats of packed log records, shared by log.cpp and the host decoder
+ * in tools/logdec. Records carry the arguments one after the other, in
+ * format order, at the sizes of the SAML21 build whatever builds them:
+ * 4 bytes for int, long and pointers, 8 for long long and double, all
+ * little endian, and strings with their NUL.
+ *
+ * A tokenized frame, LOG_TOKENS, is
+ *   LOG_TOK_SOF, length, level, token (2), millis() (4), arguments
+ * with the length counting the bytes after it. The token is the offset of
+ * the format in the .logfmt section of the ELF, kept out of flash. The
+ * level has LOG_TOK_CUT set when arguments were left out.
+ */
+
+#ifndef _LOGFMT_H_
+#define _LOGFMT_H_
+
+#include <stdint.h>
+
+#define LOG_TOK_SOF     (0xF7)      /* never in the console text */
+#define LOG_TOK_HDR     (7)         /* level, token and millis() */
+#define LOG_TOK_CUT     (0x80)
+
+/* Argument types of a conversion, as vsnprintf would take them */
+#define LOG_ARG_NONE    (0)         /* %% */
+#define LOG_ARG_INT     (1)
+#define LOG_ARG_LONG    (2)
+#define LOG_ARG_LLONG   (3)
+#define LOG_ARG_DOUBLE  (4)
+#define LOG_ARG_PTR     (5)
+#define LOG_ARG_STR     (6)
+#define LOG_ARG_BAD     (7)         /* '*', %n and the rest, not packed */
+
+/* Parse the conversion after a '%'. Returns where it ends, at its type. */
+const char *log_spec(const char *p, uint8_t *type);
+
+/* Bytes an argument takes in a record, 0 for a string */
+uint8_t log_arg_size(uint8_t type);
+
+/*
+ * Format a record into buf, the way vsnprintf would have. Past an
+ * argument that isn't in args the format is copied as it is.
+ */
+void log_format(char *buf, int size, const char *format, const uint8_t *args, int len);
+
+#endif /* _LOGFMT_H_ */
@@ -0,0 +1,89 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+/*
+ * Standby between tasks.
+ *
+ * sched_idle calls lp_standby when no task is due within LP_STANDBY_MIN_MS.
+ * The core then sleeps in standby instead of waking for every SysTick,
+ * until the next deadline or an interrupt. SysTick stops in standby, so
+ * the RTC ticks at LP_TICK_HZ from its prescaler and each tick moves
+ * millis() on. millis() so keeps time to within a tick.
+ *
+ * The UARTs given to lp_uart keep their clock in standby. A byte is then
+ * taken by the SERCOM as when awake, and its interrupt wakes the core,
+ * in tens of us rather than the full character time. So no HDLC or
+ * Modbus byte is lost. The start-of-frame detector would allow the clock
+ * to stop too, but only with OSC16M as the SERCOM clock, which the baud
+ * settings of Uart do not use.
+ *
+ * A subsystem that cannot be left in standby, a DMA transfer for one,
+ * registers a busy check with lp_veto. While any says busy the core only
+ * idles.
+ */
+
+#ifndef _LPIDLE_H_
+#define _LPIDLE_H_
+
+#include <Arduino.h>
+
+/* Shortest wait slept in standby, a few RTC ticks */
+#ifndef LP_STANDBY_MIN_MS
+#define LP_STANDBY_MIN_MS       20
+#endif
+
+/* RTC periodic interval 0 of the 1024 Hz clock */
+#define LP_TICK_HZ              128
+
+#define LP_VETO_MAX             6
+
+typedef uint8_t (*lp_busy_fn)(void);
+
+/* Keep the main clock generator running in standby and hook into sched_idle */
+void lp_init(void);
+
+/* Let port receive and send in standby, after its begin() */
+void lp_uart(Uart *port);
+
+/* No standby while busy() returns non-zero, at most LP_VETO_MAX of them */
+int lp_veto(lp_busy_fn busy);
+
+/*
+ * Sleep in standby for up to wait_ms, or idle if vetoed. Called by
+ * sched_idle with interrupts off, returns with them still off after the
+ * first wake that was not just an RTC tick.
+ */
+void lp_standby(uint32_t wait_ms);
+
+/* Ms slept in standby since boot */
+uint32_t lp_standby_ms(void);
+
+#endif /* _LPIDLE_H_ */
@@ -0,0 +1,96 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+/*
+ * Modbus request batch, for passthrough from the head-end.
+ *
+ * A CBOR array of reads, [[slave, fc, addr, count], ...], taken apart into
+ * a batch, run through the master one after the other and answered as one
+ * CBOR array in the same order. A read that went through is the array of
+ * its registers, one that did not is its result: negative for an MB_ERR_,
+ * positive for the exception code the slave sent. Only 0x03/0x04 reads
+ * are taken, writes stay with the firmware.
+ */
+
+#ifndef _MBBATCH_H_
+#define _MBBATCH_H_
+
+#include "mbrtu.h"
+
+/* Reads in a batch, and registers all of them together */
+#ifndef MB_BATCH_MAX
+#define MB_BATCH_MAX            8
+#endif
+#ifndef MB_BATCH_MAX_REGS
+#define MB_BATCH_MAX_REGS       48
+#endif
+
+struct mb_batch_op {
+    uint8_t slave;
+    uint8_t fc;
+    uint16_t addr;
+    uint16_t count;
+    uint16_t off;               /* its first register in regs */
+    int rc;
+};
+
+struct mb_batch;
+typedef void (*mb_batch_fn)(struct mb_batch *b);
+
+struct mb_batch {
+    struct mb_rtu *mb;
+    struct mb_batch_op op[MB_BATCH_MAX];
+    uint8_t n;
+    uint8_t step;
+    uint16_t regs[MB_BATCH_MAX_REGS];
+    struct mb_req req;
+    mb_batch_fn done;           /* from mb_rtu_poll, may be NULL */
+    void *arg;
+    volatile uint8_t busy;
+    uint16_t timeout_ms;        /* set before the start, 0 for the master's */
+};
+
+/*
+ * Take the reads of the CBOR array in buf into b. Returns how many, or
+ * MB_ERR_ARG if the array is malformed, a read is not valid or they do
+ * not fit. MB_ERR_BUSY while b runs.
+ */
+int mb_batch_parse(struct mb_batch *b, const uint8_t *buf, int len);
+
+/*
+ * Queue the reads of b, one at a time. done is called once the last is
+ * done, each with its rc set.
+ */
+int mb_batch_start(struct mb_rtu *mb, struct mb_batch *b, mb_batch_fn done);
+
+/* Encode the results of b into buf. Returns the length, MB_ERR_ARG if it does not fit. */
+int mb_batch_encode(const struct mb_batch *b, uint8_t *buf, int len);
+
+#endif /* _MBBATCH_H_ */
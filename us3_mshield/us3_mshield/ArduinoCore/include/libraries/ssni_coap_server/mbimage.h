@@ -0,0 +1,85 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+/*
+ * Modbus register image.
+ *
+ * A RAM copy of a block of one slave's registers, kept current by the
+ * poller, with when each register was last read and its quality. Every
+ * consumer reads the image instead of the bus, so the bus load is the
+ * poll table's however many ask. A read reports the worst quality and the
+ * oldest age of the registers it covers: never read, stale (the last poll
+ * failed or the value is older than max_age_ms) or good.
+ */
+
+#ifndef _MBIMAGE_H_
+#define _MBIMAGE_H_
+
+#include "mbrtu.h"
+
+/* Register quality */
+#define MB_Q_NONE               0   /* never read */
+#define MB_Q_STALE              1   /* last poll failed, or too old */
+#define MB_Q_GOOD               2
+
+struct mb_image {
+    uint8_t slave;
+    uint16_t base;              /* first register */
+    uint16_t count;
+    uint16_t *regs;             /* count of each */
+    uint32_t *stamp_ms;
+    uint8_t *quality;
+    uint32_t max_age_ms;        /* older reads as stale, 0 for never */
+};
+
+/* An image of count registers from base on slave, in the arrays given */
+void mb_image_init(struct mb_image *img, uint8_t slave, uint16_t base,
+                   uint16_t count, uint16_t *regs, uint32_t *stamp_ms,
+                   uint8_t *quality, uint32_t max_age_ms);
+
+/* Where register addr is kept, NULL if count from it is not in the image */
+uint16_t *mb_image_regs(struct mb_image *img, uint16_t addr, uint16_t count);
+
+/*
+ * Mark the ranges of want, which read into the image, as just read if rc
+ * is MB_OK and as stale otherwise. The values of a failed read are kept.
+ */
+void mb_image_result(struct mb_image *img, const struct mb_reg_want *want,
+                     int n, int rc);
+
+/*
+ * Copy count registers from addr into regs. Returns their worst quality,
+ * MB_Q_NONE if they are not in the image, and sets age_ms to the oldest
+ * if not NULL.
+ */
+uint8_t mb_image_read(const struct mb_image *img, uint16_t addr,
+                      uint16_t count, uint16_t *regs, uint32_t *age_ms);
+
+#endif /* _MBIMAGE_H_ */
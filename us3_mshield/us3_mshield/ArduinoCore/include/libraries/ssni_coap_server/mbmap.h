@@ -0,0 +1,88 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+/*
+ * Modbus register map.
+ *
+ * A device is described by a const table of points, one per value: where
+ * it is (slave, function, address), how it is coded (type, byte order,
+ * scale and offset) and how it is published (sample datatype and unit).
+ * The table stays in flash. The group reads, the decoding and the payload
+ * all loop over it, so a new device or value is a new row. The values
+ * are read from each slave's register image, not the bus.
+ */
+
+#ifndef _MBMAP_H_
+#define _MBMAP_H_
+
+#include "mbimage.h"
+
+/* Point types, the size follows from the type */
+#define MB_T_U16                0
+#define MB_T_S16                1
+#define MB_T_U32                2
+#define MB_T_S32                3
+#define MB_T_FLOAT              4
+
+/* Most registers one point takes */
+#define MB_POINT_MAX_REGS       2
+
+struct mb_point {
+    const char *name;
+    uint8_t slave;
+    uint8_t fc;                 /* 0x03 or 0x04 */
+    uint16_t addr;
+    uint8_t type;               /* MB_T_* */
+    uint8_t order;              /* enum mb_order */
+    float scale;                /* value = raw * scale + offset */
+    float offset;
+    uint8_t datatype;           /* sample datatype, 0 if not published */
+    const char *unit;
+};
+
+/* Registers the point takes */
+uint8_t mb_point_regs(const struct mb_point *pt);
+
+/* The point's value from its registers, as read */
+float mb_point_value(const struct mb_point *pt, const uint16_t *regs);
+
+/* The point's value from the image, returns its quality as mb_image_read */
+uint8_t mb_point_read(const struct mb_point *pt, const struct mb_image *img,
+                      float *value, uint32_t *age_ms);
+
+/*
+ * The wanted ranges of the n points of map on the image's slave with
+ * function fc, reading into the image. Returns the ranges set in want, at
+ * most nwant, or MB_ERR_ARG if they do not fit it or the image.
+ */
+int mb_map_wants(const struct mb_point *map, int n, uint8_t fc,
+                 struct mb_image *img, struct mb_reg_want *want, int nwant);
+
+#endif /* _MBMAP_H_ */
@@ -0,0 +1,123 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+/*
+ * Modbus poll table for several slaves on one RS485 bus. A second bus has
+ * its own master and poller, and the two poll side by side.
+ *
+ * Each entry reads its register groups from one slave every interval. The
+ * scheduler picks the next poll by due time, the most overdue first and
+ * round-robin among equals, so every slave gets its turn on the bus. A
+ * timeout or bad reply is retried up to retries times right away, then the
+ * poll fails and the entry backs off, its interval doubling with each
+ * failure in a row up to MB_POLL_BACKOFF_MAX doublings. A good reply puts
+ * it back on its interval. A dead device so costs one timeout every
+ * interval << MB_POLL_BACKOFF_MAX instead of one per interval. An entry
+ * reading into a register image marks it read or stale after each poll.
+ *
+ * An entry behind a power domain waits for it. When one comes due it
+ * starts a cycle, and every entry of the domain due within its window_ms
+ * joins the batch. They are polled once it has warmed up, and the last
+ * one done powers it down.
+ */
+
+#ifndef _MBPOLL_H_
+#define _MBPOLL_H_
+
+#include "mbimage.h"
+#include "pwrdom.h"
+
+/* Most doublings of a failing slave's interval */
+#ifndef MB_POLL_BACKOFF_MAX
+#define MB_POLL_BACKOFF_MAX     6
+#endif
+
+#define MB_POLL_NEVER           0xffffffffUL
+
+struct mb_poll;
+typedef void (*mb_poll_fn)(struct mb_poll *p);
+
+/* A poll table entry, set the first fields and leave the rest zero */
+struct mb_poll {
+    uint8_t slave;
+    uint8_t fc;                 /* 0x03 or 0x04 */
+    const struct mb_reg_want *want;
+    uint8_t n;
+    uint16_t gap;               /* as for mb_plan_reads */
+    uint32_t interval_ms;
+    uint16_t timeout_ms;        /* most reply timeout, 0 for the master's */
+    uint8_t retries;            /* tries more before a poll fails */
+    mb_poll_fn done;            /* after each poll with rc set, may be NULL */
+    void *arg;
+    struct mb_image *image;     /* want reads into it, may be NULL */
+    struct pwr_domain *power;   /* the slave's supply, may be NULL */
+
+    /* scheduler state */
+    uint32_t due_ms;
+    uint8_t tries;
+    uint8_t backoff;            /* failed polls in a row, to the max */
+    uint8_t batch;              /* holds its power domain for this cycle */
+    int rc;                     /* of the last poll */
+    uint32_t polls;
+    uint32_t failures;
+    struct mb_stats stats;      /* the slave's transactions */
+};
+
+struct mb_poller {
+    struct mb_rtu *mb;
+    struct mb_poll *tab;
+    uint8_t n;
+    uint8_t next;               /* where the round-robin scan starts */
+    struct mb_poll *cur;        /* entry on the bus, NULL if none */
+    struct mb_group grp;
+};
+
+/* Poll the n entries of tab on mb, all due now. One poller per master. */
+void mb_poll_init(struct mb_poller *pl, struct mb_rtu *mb,
+                  struct mb_poll *tab, uint8_t n);
+
+/* Start the next due poll if the last is done. Call from the main loop. */
+void mb_poll_run(struct mb_poller *pl);
+
+/*
+ * Ms until mb_poll_run has a poll to start, 0 while one is on the bus or
+ * a power domain warms up, MB_POLL_NEVER for an empty table.
+ */
+uint32_t mb_poll_wait_ms(struct mb_poller *pl);
+
+/*
+ * Bus diagnostics of each poller's master, slave set to 0, followed by
+ * those of its table entries, the pollers in the order they were set up,
+ * for GET /sys/stats?mod=modbus. i counts on across them, a slave 0 starts
+ * the next bus. Returns 0 past the last.
+ */
+uint8_t mb_poll_get_stats(uint8_t i, uint8_t *slave, struct mb_stats *st);
+
+#endif /* _MBPOLL_H_ */
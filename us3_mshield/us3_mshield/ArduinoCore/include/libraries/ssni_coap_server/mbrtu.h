@@ -0,0 +1,292 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+/*
+ * Modbus RTU master over a half duplex RS485 port.
+ *
+ * Requests are queued and run one at a time by mb_rtu_poll() from the main
+ * loop, with the UART IRQ taking the reply bytes as they come. A request
+ * is built with its CRC, and the reply is taken by its length (from the
+ * byte count where there is one) and checked for address, function and
+ * CRC. Frames are delimited by character timing: the bus is left quiet
+ * t3.5 before every request, a gap over t1.5 inside a reply breaks the
+ * frame, and t3.5 of silence ends it. The driver enable drops on the
+ * USART transmit complete interrupt, and the reply timeout runs from then.
+ *
+ * Each bus has its own master, with its port, DE pin and queue, and the
+ * masters run side by side: a poll of one never waits on the other, so a
+ * cycle over both takes as long as the slower bus.
+ *
+ * mb_read_regs() and the other plain calls queue a request and poll until
+ * it is done, for callers that can wait.
+ */
+
+#ifndef _MBRTU_H_
+#define _MBRTU_H_
+
+#include <Arduino.h>
+#include "mbword.h"
+
+/* Function codes */
+#define MB_FC_READ_HOLDING      0x03
+#define MB_FC_READ_INPUT        0x04
+#define MB_FC_WRITE_SINGLE      0x06
+#define MB_FC_WRITE_MULTIPLE    0x10
+#define MB_FC_EXCEPTION         0x80
+
+/* Frame buffer. The spec allows 256, this is enough for 29 registers */
+#ifndef MB_RTU_MAX_ADU
+#define MB_RTU_MAX_ADU          64
+#endif
+#define MB_RTU_MAX_READ         ((MB_RTU_MAX_ADU - 5) / 2)
+#define MB_RTU_MAX_WRITE        ((MB_RTU_MAX_ADU - 9) / 2)
+
+/* Most wanted ranges one group read takes */
+#define MB_PLAN_MAX             8
+
+/* Masters, each on its own port */
+#ifndef MB_RTU_MAX_BUSES
+#define MB_RTU_MAX_BUSES        2
+#endif
+
+/* DE/RE pin for a port whose SERCOM drives TE itself (Uart::setRS485) */
+#define MB_RTU_NO_PIN           0xff
+
+/* Reply timeout, from the last stop bit of the request to the first byte */
+#define MB_RTU_TIMEOUT_MS       500
+
+/*
+ * Adaptive reply timeout of a request with slave stats, as TCP's RTO: the
+ * smoothed latency plus MB_RTO_K times its mean deviation, no less than
+ * MB_RTO_MIN_MS and no more than the request's own timeout. Each timeout
+ * in a row doubles it, up to that bound, the next reply resets it. Until
+ * the slave has answered once the request's timeout holds.
+ */
+#define MB_RTO_K                4
+#define MB_RTO_MIN_MS           20
+#define MB_RTO_BACKOFF_MAX      6
+
+/*
+ * Reply timeout of a probe of mb_rtu_detect, this many t3.5 and ms past the
+ * request, and the tries of each format
+ */
+#define MB_DETECT_T35S          8
+#define MB_DETECT_TURN_MS       25
+#define MB_DETECT_TRIES         2
+
+/* Results. A positive result is the exception code the slave sent. */
+#define MB_OK                   0
+#define MB_ERR_TIMEOUT          -1  /* no reply */
+#define MB_ERR_CRC              -2  /* reply CRC mismatch */
+#define MB_ERR_FRAME            -3  /* reply short, broken by a gap, or not ours */
+#define MB_ERR_ARG              -4  /* request does not fit or is not valid */
+#define MB_ERR_BUSY             -5  /* request already queued */
+
+/* Requests and replies go to the protocol trace, see trace.h */
+
+/* Reply latency bins, bin k counts first bytes within 2^k ms, the last the rest */
+#define MB_LAT_BINS             8
+
+/* Bus diagnostics, for the bus as a whole or for one slave */
+struct mb_stats {
+    uint32_t requests;          /* transactions done, not broadcasts */
+    uint32_t timeouts;          /* no reply */
+    uint32_t crc_errors;
+    uint32_t frame_errors;      /* short, broken by a gap, or not ours */
+    uint32_t exceptions;        /* exception replies */
+    uint32_t retries;           /* requests repeated by the poller */
+    uint32_t latency[MB_LAT_BINS];  /* request sent to first reply byte */
+    uint32_t srtt_us;           /* smoothed latency, 0 before the first reply */
+    uint32_t rttvar_us;         /* its mean deviation */
+    uint8_t rto_backoff;        /* timeouts in a row, to MB_RTO_BACKOFF_MAX */
+};
+
+struct mb_req;
+typedef void (*mb_done_fn)(struct mb_req *req);
+
+/*
+ * A transaction. 0x03/0x04 read count registers into regs, 0x06 writes
+ * regs[0], 0x10 writes count registers from regs. The request and regs
+ * belong to the master until done is called with rc set.
+ */
+struct mb_req {
+    struct mb_req *next;
+    uint8_t slave;              /* 0 broadcasts a write, there is no reply */
+    uint8_t fc;
+    uint16_t addr;
+    uint16_t count;
+    uint16_t *regs;
+    mb_done_fn done;            /* from mb_rtu_poll, may be NULL */
+    void *arg;
+    int rc;
+    volatile uint8_t busy;
+    uint16_t timeout_ms;        /* reply timeout, 0 for the master's */
+    struct mb_stats *stats;     /* the slave's counts and latency, may be NULL */
+    uint8_t probe;              /* a scan probe, left out of the bus stats */
+};
+
+/* Transaction states */
+#define MB_STATE_IDLE           0   /* waiting for a request and a quiet bus */
+#define MB_STATE_TX             1   /* request on the line, DE up */
+#define MB_STATE_RX             2   /* DE down, taking the reply */
+
+struct mb_rtu {
+    Uart *port;
+    uint32_t baud;              /* the port's format */
+    uint16_t config;
+    uint8_t de_pin;             /* driver enable, high to transmit */
+    uint8_t re_pin;             /* receiver enable, low to receive */
+    uint16_t char_us;           /* one character in the port's format */
+    uint16_t t15_us;
+    uint16_t t35_us;
+    uint16_t timeout_ms;
+    struct mb_req *head;        /* queue, head is the one running */
+    struct mb_req *tail;
+
+    /* shared with the UART IRQ */
+    volatile uint8_t state;
+    volatile uint8_t rx_expect; /* reply length, 0 until known */
+    volatile uint8_t rx_gap;    /* a gap over t1.5 in the reply */
+    volatile uint8_t rx_done;   /* reply length reached */
+    volatile uint16_t rx_len;
+    volatile uint32_t idle_us;  /* micros() of the last bus activity */
+    volatile uint32_t rx_start_us;  /* micros() DE dropped */
+    volatile uint32_t rx_first_us;  /* micros() of the first reply byte */
+    uint32_t tx_us;             /* micros() the request started */
+    uint32_t rto_us;            /* reply timeout of the running request */
+    uint8_t adu[MB_RTU_MAX_ADU];
+
+    struct mb_stats stats;      /* the bus, all slaves */
+};
+
+/* One character, t1.5 and t3.5 at baud and config, as the master uses them */
+void mb_rtu_timing(uint32_t baud, uint16_t config, uint16_t *char_us,
+                   uint16_t *t15_us, uint16_t *t35_us);
+
+/*
+ * Begin port at baud and config (SERIAL_8N2 ...) and set up a master on it.
+ * The character times follow from both, t1.5/t3.5 are fixed at 750/1750us
+ * above 19200 as the spec says. Each master owns its port's receive and
+ * transmit complete callbacks; up to MB_RTU_MAX_BUSES of them, on ports of
+ * their own. de_pin and re_pin may be MB_RTU_NO_PIN.
+ */
+void mb_rtu_init(struct mb_rtu *mb, Uart *port, uint32_t baud, uint16_t config,
+                 uint8_t de_pin, uint8_t re_pin);
+
+/* Begin the port again at baud and config, with no request queued */
+void mb_rtu_format(struct mb_rtu *mb, uint32_t baud, uint16_t config);
+
+/*
+ * Find the serial format of slave for commissioning: read the register at
+ * addr with fc in each of the common formats, the port's first, until a
+ * reply checks out, an exception reply too. Each probe times out in a few
+ * t3.5, so a scan of them all takes seconds. MB_OK leaves the port in the
+ * format found, see mb->baud and mb->config; MB_ERR_TIMEOUT if none had a
+ * reply, or MB_ERR_BUSY if a request is queued, leave it as it was. The
+ * probes are not counted in the bus stats. Waits.
+ */
+int mb_rtu_detect(struct mb_rtu *mb, uint8_t slave, uint8_t fc, uint16_t addr);
+
+/* Queue a request. MB_ERR_ARG if it can not be sent, MB_ERR_BUSY if queued. */
+int mb_rtu_submit(struct mb_rtu *mb, struct mb_req *req);
+
+/* Advance the running transaction. Call from the main loop, often. */
+void mb_rtu_poll(struct mb_rtu *mb);
+
+/* Non-zero while a request is queued or running */
+uint8_t mb_rtu_busy(struct mb_rtu *mb);
+
+/* 0x03/0x04: read count registers from addr into regs, waits */
+int mb_read_regs(struct mb_rtu *mb, uint8_t slave, uint8_t fc, uint16_t addr,
+                 uint16_t count, uint16_t *regs);
+
+/* 0x06: write one register, waits. Slave 0 broadcasts. */
+int mb_write_reg(struct mb_rtu *mb, uint8_t slave, uint16_t addr, uint16_t value);
+
+/* 0x10: write count registers from regs to addr, waits. Slave 0 broadcasts. */
+int mb_write_regs(struct mb_rtu *mb, uint8_t slave, uint16_t addr,
+                  uint16_t count, const uint16_t *regs);
+
+/* A wanted register range, and where its registers go */
+struct mb_reg_want {
+    uint16_t addr;
+    uint16_t count;
+    uint16_t *regs;
+};
+
+/* One read request of a plan */
+struct mb_read_plan {
+    uint16_t addr;
+    uint16_t count;
+};
+
+/*
+ * Merge the wanted ranges into the fewest reads of at most max registers.
+ * Ranges no more than gap registers apart share a read, the registers
+ * between them are read and dropped. Returns the number of reads, or
+ * MB_ERR_ARG if a range can not fit one read or the plan not fit nplan.
+ */
+int mb_plan_reads(const struct mb_reg_want *want, int n, uint16_t gap,
+                  uint16_t max, struct mb_read_plan *plan, int nplan);
+
+struct mb_group;
+typedef void (*mb_group_fn)(struct mb_group *grp);
+
+/* A group read in flight, its reads run one after the other */
+struct mb_group {
+    struct mb_rtu *mb;
+    const struct mb_reg_want *want;
+    int n;
+    struct mb_read_plan plan[MB_PLAN_MAX];
+    int nplan;
+    int step;
+    struct mb_req req;
+    uint16_t regs[MB_RTU_MAX_READ];
+    mb_group_fn done;           /* from mb_rtu_poll, may be NULL */
+    void *arg;
+    int rc;
+    volatile uint8_t busy;
+    uint16_t timeout_ms;        /* set before the start, 0 for the master's */
+    struct mb_stats *stats;     /* set before the start, may be NULL */
+};
+
+/*
+ * Start reading the wanted ranges with 0x03/0x04, as planned by
+ * mb_plan_reads. want must stay valid until done is called with rc set.
+ */
+int mb_group_start(struct mb_rtu *mb, struct mb_group *grp, uint8_t slave,
+                   uint8_t fc, const struct mb_reg_want *want, int n,
+                   uint16_t gap, mb_group_fn done);
+
+/* The same, and wait for it */
+int mb_read_group(struct mb_rtu *mb, uint8_t slave, uint8_t fc,
+                  const struct mb_reg_want *want, int n, uint16_t gap);
+
+#endif /* _MBRTU_H_ */
@@ -0,0 +1,114 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+/*
+ * Modbus bus scan, for commissioning a site whose slave addresses are not
+ * known.
+ *
+ * Every address from first to last gets one minimal read, a register with
+ * 0x03 or 0x04, and a slave that answers is present, one with an exception
+ * too. The probes go through the master's queue one after the other, so
+ * the poll table keeps its turns. Each times out MB_SCAN_T35S t3.5 and
+ * MB_SCAN_TURN_MS past the request instead of the master's timeout, about
+ * 40 ms an address at 9600 baud, so 1 to 247 take some 10 s. The probes
+ * are not counted in the bus stats.
+ */
+
+#ifndef _MBSCAN_H_
+#define _MBSCAN_H_
+
+#include "mbrtu.h"
+#include "mbpoll.h"
+
+#define MB_SCAN_FIRST           1
+#define MB_SCAN_LAST            247
+
+/* Reply timeout of a probe, this many t3.5 and ms past the request */
+#define MB_SCAN_T35S            4
+#define MB_SCAN_TURN_MS         10
+
+/* Slaves a scan keeps, those after are counted only */
+#ifndef MB_SCAN_MAX
+#define MB_SCAN_MAX             8
+#endif
+
+/* A slave that answered its probe */
+struct mb_scan_hit {
+    uint8_t slave;
+    int rc;                     /* MB_OK, or the exception code it sent */
+    uint32_t lat_us;            /* request sent to first reply byte */
+    struct mb_reg_want want;    /* the probe's register, for mb_scan_table */
+    uint16_t reg;
+};
+
+struct mb_scan;
+typedef void (*mb_scan_fn)(struct mb_scan *s);
+
+struct mb_scan {
+    struct mb_rtu *mb;
+    uint8_t fc;
+    uint16_t addr;
+    uint8_t next;               /* address of the probe on the bus */
+    uint8_t last;
+    struct mb_scan_hit hit[MB_SCAN_MAX];
+    uint8_t n;                  /* kept in hit */
+    uint8_t found;              /* answered, kept or not */
+    uint32_t start_ms;
+    uint32_t took_ms;           /* of the last scan done */
+    struct mb_req req;
+    struct mb_stats probe;      /* the slave on the bus */
+    uint16_t reg;
+    mb_scan_fn done;            /* from mb_rtu_poll, may be NULL */
+    void *arg;
+    volatile uint8_t busy;
+};
+
+/*
+ * Probe the addresses first to last on mb, reading the register at addr
+ * with fc, and call done once the last has answered or timed out. Returns
+ * MB_ERR_BUSY while s runs, MB_ERR_ARG for a bad range or function.
+ */
+int mb_scan_start(struct mb_scan *s, struct mb_rtu *mb, uint8_t fc, uint16_t addr,
+                  uint8_t first, uint8_t last, mb_scan_fn done);
+
+/*
+ * Add the slaves of the last scan to the n entries of tab, up to max, as
+ * entries reading the probe's register every interval_ms, their stats
+ * from the probe's reply so the adaptive timeout starts at its latency.
+ * A slave tab has already is left as it is. The entries read into s,
+ * which has to stay until the next scan. Returns the entries tab has now,
+ * for mb_poll_init.
+ */
+uint8_t mb_scan_table(struct mb_scan *s, struct mb_poll *tab, uint8_t n, uint8_t max,
+                      uint32_t interval_ms);
+
+#endif /* _MBSCAN_H_ */
@@ -0,0 +1,100 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+/*
+ * Modbus RTU slave, for local panels and PLCs.
+ *
+ * Answers 0x03 and 0x04 on its own port through a read callback, which
+ * serves them from what the node already has, a register image or values
+ * worked out from it. Nothing it answers reaches the field bus. Requests
+ * are taken by the UART IRQ and end at t3.5 of silence, mb_slave_poll()
+ * checks and answers them from the main loop. Other function codes get
+ * exception 01, broadcasts and frames for other addresses no answer.
+ */
+
+#ifndef _MBSLAVE_H_
+#define _MBSLAVE_H_
+
+#include "mbrtu.h"
+
+/* Exception codes */
+#define MB_EX_ILLEGAL_FUNCTION  0x01
+#define MB_EX_ILLEGAL_ADDRESS   0x02
+#define MB_EX_ILLEGAL_VALUE     0x03
+#define MB_EX_DEVICE_FAILURE    0x04
+
+/*
+ * Fill count registers from addr for function fc, 0x03 or 0x04. Returns
+ * 0, or the exception code to answer with.
+ */
+typedef uint8_t (*mb_slave_read_fn)(uint8_t fc, uint16_t addr, uint16_t count,
+                                    uint16_t *regs);
+
+/* Slave states */
+#define MB_SLAVE_RX             0   /* taking a request */
+#define MB_SLAVE_TX             1   /* answer on the line, DE up */
+
+struct mb_slave {
+    Uart *port;
+    uint8_t addr;               /* our slave address */
+    uint8_t de_pin;             /* may be MB_RTU_NO_PIN */
+    uint8_t re_pin;
+    uint16_t char_us;
+    uint16_t t15_us;
+    uint16_t t35_us;
+    mb_slave_read_fn read;
+
+    /* shared with the UART IRQ */
+    volatile uint8_t state;
+    volatile uint8_t rx_gap;    /* a gap over t1.5 in the request */
+    volatile uint16_t rx_len;
+    volatile uint32_t idle_us;
+    uint32_t tx_us;
+    uint8_t adu[MB_RTU_MAX_ADU];
+
+    uint32_t requests;          /* answered, exceptions too */
+    uint32_t exceptions;
+    uint32_t crc_errors;
+    uint32_t frame_errors;
+};
+
+/*
+ * Begin port at baud and config and answer as slave addr on it. There is
+ * one slave, it owns the port's receive and transmit complete callbacks,
+ * so the port can not also carry the master.
+ */
+void mb_slave_init(struct mb_slave *s, Uart *port, uint32_t baud, uint16_t config,
+                   uint8_t addr, uint8_t de_pin, uint8_t re_pin,
+                   mb_slave_read_fn read);
+
+/* Answer a request taken. Call from the main loop, often. */
+void mb_slave_poll(struct mb_slave *s);
+
+#endif /* _MBSLAVE_H_ */
@@ -0,0 +1,147 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+/*
+ * Modbus multi-register values in the byte orders devices use.
+ *
+ * A 32-bit value is bytes ABCD, most significant first. Devices put them
+ * on the wire as ABCD, CDAB (words swapped), BADC (bytes swapped in each
+ * word) or DCBA. The order is the XOR that takes a value byte's index to
+ * its index on the wire, so each decoder is four loads and shifts fixed at
+ * compile time, on the reply bytes or on the registers read from them.
+ * 16-bit values take MB_AB or MB_BA.
+ */
+
+#ifndef _MBWORD_H_
+#define _MBWORD_H_
+
+#include <string.h>
+#include <stdint.h>
+
+enum mb_order {
+    MB_ABCD = 0,
+    MB_BADC = 1,
+    MB_CDAB = 2,
+    MB_DCBA = 3,
+    MB_AB = 0,
+    MB_BA = 1
+};
+
+/* From the bytes as they came on the wire */
+template <mb_order O>
+constexpr uint16_t mb_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0 ^ (O & 1)] << 8 | p[1 ^ (O & 1)]);
+}
+
+template <mb_order O>
+constexpr uint32_t mb_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0 ^ O] << 24 | (uint32_t)p[1 ^ O] << 16 |
+           (uint32_t)p[2 ^ O] << 8 | p[3 ^ O];
+}
+
+template <mb_order O>
+constexpr int16_t mb_s16(const uint8_t *p)
+{
+    return (int16_t)mb_u16<O>(p);
+}
+
+template <mb_order O>
+constexpr int32_t mb_s32(const uint8_t *p)
+{
+    return (int32_t)mb_u32<O>(p);
+}
+
+template <mb_order O>
+inline float mb_float(const uint8_t *p)
+{
+    uint32_t u = mb_u32<O>(p);
+    float f;
+
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+/* A 16-bit register scaled, as 1234 for 12.34 with scale 0.01 */
+template <mb_order O>
+constexpr float mb_s16_scaled(const uint8_t *p, float scale)
+{
+    return mb_s16<O>(p) * scale;
+}
+
+template <mb_order O>
+constexpr float mb_u16_scaled(const uint8_t *p, float scale)
+{
+    return mb_u16<O>(p) * scale;
+}
+
+/* From registers, each already taken from the wire as AB */
+constexpr uint16_t mb_swap16(uint16_t w)
+{
+    return (uint16_t)(w << 8 | w >> 8);
+}
+
+template <mb_order O>
+constexpr uint16_t mb_reg_u16(const uint16_t *r)
+{
+    return (O & 1) ? mb_swap16(r[0]) : r[0];
+}
+
+template <mb_order O>
+constexpr uint32_t mb_regs_u32(const uint16_t *r)
+{
+    return (uint32_t)mb_reg_u16<O>(&r[(O >> 1) & 1]) << 16 |
+           mb_reg_u16<O>(&r[1 ^ ((O >> 1) & 1)]);
+}
+
+template <mb_order O>
+constexpr int32_t mb_regs_s32(const uint16_t *r)
+{
+    return (int32_t)mb_regs_u32<O>(r);
+}
+
+template <mb_order O>
+inline float mb_regs_float(const uint16_t *r)
+{
+    uint32_t u = mb_regs_u32<O>(r);
+    float f;
+
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+template <mb_order O>
+constexpr float mb_reg_scaled(const uint16_t *r, float scale)
+{
+    return (int16_t)mb_reg_u16<O>(r) * scale;
+}
+
+#endif /* _MBWORD_H_ */
@@ -0,0 +1,141 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+/*
+ * NMEA 0183 from a GPS receiver, parsed as it comes in.
+ *
+ * The UART receive IRQ hands each byte to the parser, no line is kept.
+ * The XOR checksum is summed as the bytes arrive and each field of the
+ * sentences asked for is decoded as it ends, into integers, the others
+ * are only summed. What a sentence carries takes effect once its
+ * checksum matches, otherwise it is dropped whole. Any talker, GP, GN,
+ * GL..., is taken.
+ *
+ *   RMC    time, status, position, speed, course, date
+ *   GGA    time, position, fix quality, satellites, HDOP, altitude
+ *
+ * Fixed point throughout, no float:
+ *
+ *   time_ms    ms since midnight UTC
+ *   lat, lon   1e-7 degrees, south and west negative
+ *   alt_cm     above mean sea level, cm
+ *   speed      1/100 knot, course 1/100 degree
+ *   hdop       1/100
+ *
+ * Fractions past NMEA_FRAC_MAX digits are dropped. The main loop takes a
+ * copy of the fix with nmea_get.
+ */
+
+#ifndef _NMEA_H_
+#define _NMEA_H_
+
+#include <Arduino.h>
+
+/* Sentences to decode, for nmea_init */
+#define NMEA_RMC                0x01
+#define NMEA_GGA                0x02
+
+/* Longer sentences are noise, 82 by the standard */
+#define NMEA_LEN_MAX            96
+#define NMEA_FRAC_MAX           5
+
+/* Fields of the fix set since nmea_init, in have */
+#define NMEA_HAVE_TIME          0x01
+#define NMEA_HAVE_DATE          0x02
+#define NMEA_HAVE_POS           0x04
+#define NMEA_HAVE_ALT           0x08
+#define NMEA_HAVE_MOTION        0x10
+
+struct nmea_fix {
+    uint32_t time_ms;           /* of the last sentence with a time */
+    uint8_t day, month, year;   /* year 2 digits, from RMC */
+    uint8_t valid;              /* RMC status A */
+    uint8_t quality;            /* GGA fix quality, 0 none, 1 GPS, 2 DGPS ... */
+    uint8_t sats;               /* GGA satellites used */
+    uint16_t hdop;
+    int32_t lat;
+    int32_t lon;
+    int32_t alt_cm;
+    uint32_t speed;
+    uint32_t course;
+    uint8_t have;               /* NMEA_HAVE_* */
+    uint32_t rx_ms;             /* millis() the last good sentence began */
+    uint8_t sentence;           /* what it was, NMEA_RMC ... */
+    uint32_t seq;               /* good sentences decoded */
+};
+
+/* Parser states */
+#define NMEA_STATE_IDLE         0   /* waiting for $ */
+#define NMEA_STATE_BODY         1   /* summing the fields */
+#define NMEA_STATE_SUM          2   /* the checksum's two hex digits */
+
+struct nmea {
+    uint8_t want;               /* NMEA_RMC | NMEA_GGA */
+
+    /* the sentence coming in, from the IRQ only */
+    uint8_t state;
+    uint8_t type;               /* sentence, NMEA_RMC ..., 0 to skip */
+    uint8_t sum;
+    uint8_t sum_rx;
+    uint8_t len;
+    uint8_t field;              /* 0 the address, then each field */
+    char addr[5];
+    uint32_t val;               /* digits of the field, the point left out */
+    uint8_t ndig;
+    uint8_t nfrac;              /* digits after the point, 0xff before it */
+    uint8_t neg;
+    char c0;                    /* first character, for the letter fields */
+    uint8_t seen;               /* lat, lon decoded, for their hemispheres */
+    uint32_t start_ms;
+    struct nmea_fix work;       /* the fix as it will be if the sum matches */
+
+    /* last good committed fix, shared with the main loop */
+    struct nmea_fix fix;
+
+    uint32_t sentences;         /* good ones, decoded or not */
+    uint32_t bad_sum;
+    uint32_t overruns;          /* longer than NMEA_LEN_MAX */
+};
+
+/*
+ * Take the NMEA from port, begun at baud and config, decoding the
+ * sentences in want. There is one parser, it owns the port's receive
+ * callback.
+ */
+void nmea_init(struct nmea *nm, Uart *port, uint32_t baud, uint16_t config, uint8_t want);
+
+/* One byte, from the receive IRQ, or from a test */
+void nmea_byte(struct nmea *nm, uint8_t c);
+
+/* Copy the fix out, 0 if no good sentence came yet */
+uint8_t nmea_get(struct nmea *nm, struct nmea_fix *fix);
+
+#endif /* _NMEA_H_ */
@@ -0,0 +1,108 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+/*
+ * Notification pace from the back-pressure of the mNIC link.
+ *
+ * coapmsg times the ACK of each CON from queueing it, those sent once
+ * only, as the ACK of a resent one can't be told apart, and counts the
+ * resends. A sampled sensor counts the notifications it skips because
+ * its last one still waits in obs_q. The link is slow with a smoothed
+ * ACK round trip over PACE_SLOW_MS, a resend, or more than PACE_SKIP_PCT
+ * of the notifications skipped; it has recovered under PACE_FAST_MS, with
+ * no resend and under half that skipped. Either moves the pace a level,
+ * at most once per PACE_HOLD_MS.
+ *
+ * Each level doubles the report interval of every observer and the HDLC
+ * frames a notification of samples may take, up to PACE_LEVEL_MAX. The
+ * samples held back stay in the ring of their sampler, or go to the
+ * sample log when it fills, so none are lost, they go out in the larger
+ * batches. GET /sys/stats?mod=pace. Left out unless PACE is 1.
+ */
+
+#ifndef _PACE_H_
+#define _PACE_H_
+
+#include <stdint.h>
+
+#ifndef PACE
+#define PACE                    1
+#endif
+
+#define PACE_SLOW_MS            4000
+#define PACE_FAST_MS            1500
+#define PACE_SKIP_PCT           25
+#define PACE_HOLD_MS            60000
+#define PACE_LEVEL_MAX          3
+
+struct pace_stats {
+    uint32_t srtt_ms;           /* smoothed ACK round trip, 1/8 a sample */
+    uint32_t rtt_max_ms;
+    uint32_t acks;              /* ACKs timed */
+    uint32_t resends;
+    uint32_t sent;              /* notifications of samples */
+    uint32_t skipped;           /* held back, the last one still queued */
+    uint32_t changes;           /* of level */
+    uint8_t skip_pct;           /* smoothed share skipped */
+    uint8_t level;
+};
+
+#if PACE
+/* The ACK of a CON sent once came rtt_ms after it was queued */
+void pace_ack(uint32_t rtt_ms);
+
+/* A CON went unacked and is sent again */
+void pace_resend(void);
+
+/* A notification of samples was due, and skipped or not */
+void pace_notify(uint8_t skipped);
+
+/* 0 at full pace, up to PACE_LEVEL_MAX */
+uint8_t pace_level(void);
+
+const struct pace_stats *pace_get(void);
+
+/* Start the counts again, the level and round trip stay */
+void pace_clear(void);
+
+#define PACE_ACK(rtt_ms)        pace_ack(rtt_ms)
+#define PACE_RESEND()           pace_resend()
+#define PACE_NOTIFY(skipped)    pace_notify(skipped)
+#define PACE_LEVEL()            pace_level()
+#else
+#define PACE_ACK(rtt_ms)
+#define PACE_RESEND()
+#define PACE_NOTIFY(skipped)
+#define PACE_LEVEL()            0
+#endif
+
+#endif /* _PACE_H_ */
@@ -0,0 +1,94 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+/*
+ * Performance levels of the SAML21, switched by the load.
+ *
+ * The core starts at 48 MHz on the DFLL, in PL2, and most of the time it
+ * only waits on a UART or the RTC. sched_idle calls perf_slow before a
+ * wait of PERF_LOW_MIN_MS or more, which drops to the lowest level the
+ * peripherals allow:
+ *
+ *   PERF_LOW   generator 0 on OSC16M at 8 MHz, DFLL off, PL0
+ *   PERF_SLOW  generator 0 stays at 48 MHz, the CPU divided to 12 MHz
+ *   PERF_HIGH  48 MHz
+ *
+ * PERF_LOW takes generator 0 down with the CPU, so only while USB is off
+ * and no peripheral on it needs its rate: the ports of ports.h get their
+ * baud again, SPI its rate on the next transaction, the EIC and EVSYS do
+ * not care, and perf_rate_free adds others that only count. Any other
+ * channel on generator 0, or a port still sending, leaves it at
+ * PERF_SLOW, which no peripheral sees. A byte being received across the
+ * switch is lost, HDLC and Modbus take it as a bad frame.
+ *
+ * The tasks run on at the low level after the wake. Work that wants the
+ * speed, a request with its CRC, CBOR and flash reads, or compression,
+ * goes between perf_burst_begin and perf_burst_end, which raise it to
+ * PERF_HIGH. It only drops again at the next long wait.
+ */
+
+#ifndef _PERFLVL_H_
+#define _PERFLVL_H_
+
+#include <stdint.h>
+
+/* Shortest wait dropped for, a switch and back cost tens of us */
+#ifndef PERF_LOW_MIN_MS
+#define PERF_LOW_MIN_MS         5
+#endif
+
+#define PERF_RATE_FREE_MAX      4
+
+enum {
+    PERF_LOW,
+    PERF_SLOW,
+    PERF_HIGH
+};
+
+/* Hook into sched_idle, from PERF_HIGH as startup left it */
+void perf_init(void);
+
+/* The rate of generator 0 channel id does not matter, for PERF_LOW */
+int perf_rate_free(uint8_t id);
+
+/* Drop as low as the peripherals allow, from sched_idle with interrupts off */
+void perf_slow(uint32_t wait_ms);
+
+/* PERF_HIGH until the matching perf_burst_end, nested */
+void perf_burst_begin(void);
+void perf_burst_end(void);
+
+/* The level now, and the switches since boot */
+uint8_t perf_level(void);
+uint32_t perf_switches(void);
+
+#endif /* _PERFLVL_H_ */
@@ -0,0 +1,89 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+/*
+ * GPS PPS discipline of the timebase.
+ *
+ * The PPS pin interrupt takes millis() and micros() at each rising edge.
+ * The RMC sentence that follows an edge within a second names the UTC
+ * second the edge began, as the receivers do. The epoch count of
+ * arduino_time is then anchored on the edge, every PPS_ANCHOR_S edges,
+ * and the RTC is written only when it is a whole second out.
+ *
+ * The crystal is measured against the pulses too. Over PPS_CORR_S edges
+ * the micros() counted, off the same crystal, are that many seconds of
+ * the GPS plus its error, and the error sets FREQCORR outright. Edges
+ * missed or out of place, off by more than PPS_PPM_MAX, restart the
+ * measurement.
+ *
+ * SysTick stops in standby and millis() only keeps to an RTC tick there,
+ * so while the PPS is in use the core is kept out of standby. The power
+ * is small to the receiver's.
+ */
+
+#ifndef _PPS_H_
+#define _PPS_H_
+
+#include <Arduino.h>
+#include "nmea.h"
+
+/* Edges between re-anchors of the epoch count */
+#ifndef PPS_ANCHOR_S
+#define PPS_ANCHOR_S            16
+#endif
+
+/* Edges a frequency measurement spans, 256 s to 0.02 ppm at a few us */
+#ifndef PPS_CORR_S
+#define PPS_CORR_S              256
+#endif
+
+/* Seconds measured off by more than this are a missed or false edge */
+#define PPS_PPM_MAX             200
+
+/* No edge for this long and the lock is lost */
+#define PPS_LOST_MS             3000
+
+/* Take the PPS on pin, its times from the RMC sentences nm decodes */
+void pps_init(uint8_t pin, struct nmea *nm);
+
+/*
+ * From the main loop. Returns 1 when the epoch count was anchored on an
+ * edge, for whatever keeps to the second boundary to realign.
+ */
+uint8_t pps_poll(void);
+
+/* 1 while edges come and the count is anchored on them */
+uint8_t pps_locked(void);
+
+/* Edges taken, and anchors made, since pps_init */
+uint32_t pps_edges(void);
+uint32_t pps_anchors(void);
+
+#endif /* _PPS_H_ */
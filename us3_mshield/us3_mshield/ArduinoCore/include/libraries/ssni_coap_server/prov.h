@@ -0,0 +1,75 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+/*
+ * Provisioning frames of the boot menu, for a line station.
+ *
+ * A frame is PROV_SOF, the command, the payload length, the payload, then
+ * the crc_xmodem of command to payload. Values and the CRC are little
+ * endian. The response has the command with PROV_RSP set and a PROV_ST_*
+ * status as its first payload byte. The boot menu, GoHere, gathers the
+ * frame from a line that starts with PROV_SOF, anything else is read as the
+ * text menu. A frame stalled for PROV_TIMEOUT_MS is dropped.
+ */
+
+#ifndef _PROV_H_
+#define _PROV_H_
+
+#include <Arduino.h>
+
+#define PROV_SOF                0xA5
+#define PROV_RSP                0x80
+#define PROV_MAX                240         /* Longest payload */
+#define PROV_FRAME_MAX          (3 + PROV_MAX + 2)
+#define PROV_TIMEOUT_MS         500UL
+
+#define PROV_GET                0x01        /* [index]... -> [index, value]..., none for all */
+#define PROV_SET                0x02        /* index, value -> one log record */
+#define PROV_BULK               0x03        /* [index, value]... -> one image */
+#define PROV_ID                 0x04        /* -> the MCU unique ID */
+#define PROV_LOG                0x05        /* offset (4), length (1) -> sample log bytes */
+#define PROV_KEY                0x06        /* key (32) -> nothing, the firmware MAC key, never read back */
+
+#define PROV_ST_OK              0
+#define PROV_ST_BAD_FRAME       1           /* CRC or length */
+#define PROV_ST_BAD_CMD         2
+#define PROV_ST_BAD_PARAM       3
+#define PROV_ST_FLASH           4           /* Not saved or read */
+
+/* Send a response on out, its data already after the status byte of frame,
+ * which has room for a whole frame. One write. */
+void prov_reply(Print *out, uint8_t *frame, uint8_t cmd, uint8_t status, uint8_t len);
+
+/* Check a complete frame and answer it on out */
+void prov_frame(Print *out, const uint8_t *frame);
+
+#endif /* _PROV_H_ */
@@ -0,0 +1,68 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+/*
+ * Pulse counting in hardware, for the pulse output of a flow meter.
+ *
+ * The edge the EIC sees on the pin is not an interrupt but an event, and
+ * an asynchronous EVSYS channel takes it to TC0, counting events. No
+ * code runs per pulse, so none is missed while interrupts are off for a
+ * DHT read or the like, and the count goes on in standby.
+ *
+ * The count is never reset. pulse_take() reads it and returns the change
+ * since the read before, modulo 2^16, so a pulse between the read and a
+ * reset cannot be lost. It has to be called before 65536 pulses pass, a
+ * few minutes at the fastest meters.
+ *
+ * TC0 is the PWM timer of some pins, which then can not be used for
+ * analogWrite(), and the EIC line of the pin is taken from attachInterrupt().
+ */
+
+#ifndef _PULSECNT_H_
+#define _PULSECNT_H_
+
+#include <Arduino.h>
+
+#define PULSE_OK                0
+#define PULSE_ERR_ARG           -1  /* the pin has no EIC line */
+#define PULSE_ERR_EVSYS         -2  /* no free EVSYS channel from the EIC to TC0 */
+#define PULSE_ERR_CHIP          -3  /* not on this chip */
+
+/* Count the rising edges of pin, the EIC filter on if filter is set */
+int pulse_init(uint8_t pin, uint8_t filter);
+
+/* Pulses since the last pulse_take, and ms since it in *ms if not NULL */
+uint32_t pulse_take(uint32_t *ms);
+
+/* Pulses since pulse_init, not taking any */
+uint32_t pulse_total(void);
+
+#endif /* _PULSECNT_H_ */
@@ -0,0 +1,78 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+/*
+ * Sensor power domains.
+ *
+ * A domain is a switched supply, a relay or a load switch, shared by the
+ * sensors behind it. Readings acquire it and release it when done. The
+ * first acquire switches it on, it is ready warmup_ms later, and the last
+ * release switches it off. Readings that acquire it together so run as
+ * one batch in one power cycle instead of cycling it each, or keeping it
+ * on all the time.
+ */
+
+#ifndef _PWRDOM_H_
+#define _PWRDOM_H_
+
+#include <Arduino.h>
+
+/* Domain states */
+#define PWR_OFF                 0
+#define PWR_WARMING             1
+#define PWR_ON                  2
+
+typedef void (*pwr_set_fn)(uint8_t on);
+
+struct pwr_domain {
+    pwr_set_fn set;             /* switch the supply on or off */
+    uint32_t warmup_ms;         /* from on to readings valid */
+    uint32_t window_ms;         /* readings due this soon join a cycle */
+    uint8_t state;
+    uint8_t users;              /* acquired and not released */
+    uint32_t on_ms;             /* millis() it was switched on */
+    uint32_t cycles;            /* times switched on */
+    uint32_t on_total_ms;       /* time on, all finished cycles */
+};
+
+/* A domain switched by set, off until acquired */
+void pwr_domain_init(struct pwr_domain *d, pwr_set_fn set, uint32_t warmup_ms,
+                     uint32_t window_ms);
+
+/* Take the domain for a reading, switching it on if it is off */
+void pwr_domain_acquire(struct pwr_domain *d);
+
+/* Non-zero once the domain is on and warmed up */
+uint8_t pwr_domain_ready(struct pwr_domain *d);
+
+/* Done with it, the last one switches it off */
+void pwr_domain_release(struct pwr_domain *d);
+
+#endif /* _PWRDOM_H_ */
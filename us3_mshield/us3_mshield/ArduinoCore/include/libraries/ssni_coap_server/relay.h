@@ -0,0 +1,102 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+/*
+ * Relays 1 (D6/D7) and 2 (D8/D9), switched by the rules of the
+ * configuration and by the timed commands of /sys/relay.
+ *
+ * A rule, one in relay_cfg, is checked on each sample of its channel the
+ * sampler takes, see SAPI_RULE_ABOVE. The commands wait in a queue by
+ * epoch, run from a task timed by the RTC. Each switch is posted as a
+ * SAPI_DATATYPE_RELAY event.
+ */
+
+#ifndef _RELAY_H_
+#define _RELAY_H_
+
+#include <stdint.h>
+#include "sapi.h"
+
+#define RELAY_RULES             2           /* "Rule1Chan" ... "Rule2MinOff" */
+#define RELAY_Q_MAX             16
+#define RELAY_Q_CHECK_MS        60000UL     /* Clock looked at again, for one that was set */
+
+struct cbor_buf;
+
+/*
+ * A rule, as set in the configuration. chan is sensor Id * 100 +
+ * datatype, 0 -> unused. The rule holds while the value is past limit, op
+ * SAPI_RULE_ABOVE or SAPI_RULE_BELOW, and lets go once it is back by hyst,
+ * both in thousandths of the value. action is the relay it switches on
+ * while it holds, negative to switch it off instead.
+ */
+struct relay_rule_cfg {
+    int chan;                   /* "RuleNChan" */
+    int op;                     /* "RuleNOp", SAPI_RULE_* */
+    int limit;                  /* "RuleNLimit", thousandths */
+    int hyst;                   /* "RuleNHyst", thousandths */
+    int action;                 /* "RuleNAction", 1, 2, -1 or -2 */
+    int min_on;                 /* "RuleNMinOn", seconds the relay stays on */
+    int min_off;                /* "RuleNMinOff", seconds it stays off */
+};
+
+extern struct relay_rule_cfg relay_cfg[RELAY_RULES];
+
+/* Forget the state of the rules and the queue */
+void relay_init(void);
+
+/* Add the task of the queue, stopped until a command is queued */
+void relay_start(void);
+
+/* Drive a relay, one pin high and the other low */
+void relay_set(uint8_t relay, uint8_t on);
+
+/* A rule changed, it starts over from its next sample */
+void relay_rule_reset(uint8_t rule);
+
+/* Check a sample against the rules on its channel, and switch the relays
+ * of the ones that change, at now_ms */
+void relay_rule_check(uint8_t sensor_id, const sapi_sample_t *sample, uint32_t now_ms);
+
+/* Encode the queue, soonest first, a CBOR array of [<epoch>,<action>].
+ * Returns CBOR_OK, or CBOR_ERR for no room. */
+int relay_q_enc(struct cbor_buf *cbuf);
+
+/* Empty the queue */
+void relay_q_clear(void);
+
+/* Queue the commands of a CBOR array of [<epoch>,<action>], replace for
+ * in place of those queued. All are checked before the queue changes.
+ * Returns a COAP_RSP_* code, 4.13 for a batch that does not fit. */
+uint8_t relay_q_put(const uint8_t *buf, uint16_t len, uint8_t replace);
+
+#endif /* _RELAY_H_ */
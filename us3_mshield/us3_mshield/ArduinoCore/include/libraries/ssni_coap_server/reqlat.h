@@ -0,0 +1,128 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+/*
+ * Where the time of a CoAP request goes, stage by stage.
+ *
+ * coap_s_serve and coap_s_proc mark the end of each stage of a request
+ * from the mNIC, the time since the last mark goes to the stage:
+ *
+ *   REQLAT_LINK    closing flag of its last frame to hdlcs_read handing
+ *                  it up: the HDLC secondary, and the main loop getting
+ *                  round to it
+ *   REQLAT_PARSE   coap_msg_parse
+ *   REQLAT_HANDLER coap_s_uri_proc, the sensor handler, and observe
+ *   REQLAT_RSP     coap_msg_response
+ *   REQLAT_SEND    hdlcs_write_mbuf, the frames framed and on their way
+ *
+ * A stage a request skips, a handler for an ACK say, counts 0 and its
+ * time goes to the next one. Each stage keeps its min, mean and max since
+ * boot or reqlat_clear, as does the sum, REQLAT_TOTAL, and the slowest
+ * REQLAT_SLOW requests are kept with their path, for GET /sys/stats
+ * ?mod=lat and ?mod=slow. Times are from micros(). Left out unless
+ * REQLAT is 1.
+ */
+
+#ifndef _REQLAT_H_
+#define _REQLAT_H_
+
+#include <Arduino.h>
+
+#ifndef REQLAT
+#define REQLAT                  1
+#endif
+
+#define REQLAT_LINK             0
+#define REQLAT_PARSE            1
+#define REQLAT_HANDLER          2
+#define REQLAT_RSP              3
+#define REQLAT_SEND             4
+#define REQLAT_STAGES           5
+#define REQLAT_TOTAL            REQLAT_STAGES
+
+#define REQLAT_SLOW             4
+#define REQLAT_PATH_LEN         24
+
+/* A stage, or the total */
+struct reqlat_stage {
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t sum_us;
+};
+
+/* One of the slowest requests */
+struct reqlat_req {
+    char path[REQLAT_PATH_LEN];     /* Uri-Path, cut to fit */
+    uint32_t ms;                    /* millis() it came in */
+    uint32_t stage_us[REQLAT_STAGES];
+    uint32_t total_us;
+};
+
+#if REQLAT
+struct coap_msg_ctx;
+
+/* A request came up from the link, its last frame closed at rx_us */
+void reqlat_start(uint32_t rx_us);
+
+/* stage is done */
+void reqlat_mark(uint8_t stage);
+
+/* The path of the request, for the slowest */
+void reqlat_path(const struct coap_msg_ctx *ctx);
+
+/* The request is out, count its stages */
+void reqlat_end(void);
+
+/* Stage stage, or REQLAT_TOTAL, NULL past it */
+const struct reqlat_stage *reqlat_get(uint8_t stage);
+
+/* Name of stage, at most 7 characters */
+const char *reqlat_name(uint8_t stage);
+
+/* The nth slowest request, 0 the slowest, NULL past the last */
+const struct reqlat_req *reqlat_slow(uint8_t n);
+
+/* Start the counts again from zero */
+void reqlat_clear(void);
+
+#define REQLAT_START(rx_us)     reqlat_start(rx_us)
+#define REQLAT_MARK(stage)      reqlat_mark(stage)
+#define REQLAT_PATH(ctx)        reqlat_path(ctx)
+#define REQLAT_END()            reqlat_end()
+#else
+#define REQLAT_START(rx_us)
+#define REQLAT_MARK(stage)
+#define REQLAT_PATH(ctx)
+#define REQLAT_END()
+#endif
+
+#endif /* _REQLAT_H_ */
@@ -0,0 +1,123 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+/*
+ * Link and observe state kept in RAM across a reset, for a warm restart.
+ *
+ * After a reset the mNIC would send SNRM and the head-end register its
+ * observes again before any data flows. What those set up is kept here
+ * instead, in .noinit RAM the C runtime leaves alone, section by section:
+ *
+ *   RETAIN_LINK    the parameters the last SNRM negotiated, saved by
+ *                  hdlcs on SNRM and DISC
+ *   RETAIN_OBS     the observe relations of coapobserve: path, token and
+ *                  sensor id
+ *   RETAIN_REG     the observers of coapsensorobs that were registered,
+ *                  with their frequency, NON mode, format and sequence
+ *
+ * Each section has a magic, its length and a CRC32. retain_boot checks
+ * them once at boot and retain_get hands a good one out once, to the
+ * module that put it, which then carries on from it. RAM holds through a
+ * reset, the watchdog and a brown-out that doesn't take the supply below
+ * retention, not a power cycle: the CRC tells. Not in the SPI flash, the
+ * sequence is saved on every acked notification and would wear it out.
+ * Left out unless RETAIN is 1.
+ */
+
+#ifndef _RETAIN_H_
+#define _RETAIN_H_
+
+#include <stdint.h>
+#include "coapobserve.h"
+
+#ifndef RETAIN
+#define RETAIN                  1
+#endif
+
+/* A warm link with nothing from the primary this long goes back to
+ * waiting for SNRM, at the base baud, the mNIC may have restarted too */
+#ifndef RETAIN_LINK_MS
+#define RETAIN_LINK_MS          2000
+#endif
+
+#define RETAIN_LINK             0
+#define RETAIN_OBS              1
+#define RETAIN_REG              2
+#define RETAIN_SECTIONS         3
+
+/* Observe paths longer than this aren't kept */
+#define RETAIN_URI_LEN          48
+
+/* RETAIN_LINK */
+struct retain_link {
+    uint8_t up;                 /* in normal mode when saved */
+    uint8_t window_tx;
+    uint8_t window_rx;
+    uint8_t pad;
+    uint16_t seg_tx;            /* max info per I frame sent */
+};
+
+/* RETAIN_OBS, one per slot of obs[], uri "" if unused */
+struct retain_obs {
+    char uri[RETAIN_URI_LEN];
+    uint8_t tkl;
+    uint8_t token[8];
+    char sid[SID_MAX_LEN];
+};
+
+/* RETAIN_REG, one per observer id, obs_uri "" if not registered */
+struct retain_reg {
+    char obs_uri[RETAIN_URI_LEN];
+    uint32_t frequency;
+    uint32_t ack_seqno;
+    uint32_t con_every_s;
+    uint8_t con_every_n;
+    uint8_t cf;
+};
+
+#if RETAIN
+/* Check what the last run left, once at boot before coap_s_init */
+void retain_boot(void);
+
+/* Copy out section, len bytes, if the last run left a good one and it
+ * wasn't taken yet. Returns 0 if not. */
+int retain_get(uint8_t section, void *buf, uint16_t len);
+
+/* Keep len bytes for section, for the next run */
+void retain_put(uint8_t section, const void *buf, uint16_t len);
+
+#define RETAIN_PUT(section, buf, len)   retain_put(section, buf, len)
+#else
+#define RETAIN_PUT(section, buf, len)
+#endif
+
+#endif /* _RETAIN_H_ */
@@ -32,6 +32,7 @@ Networks, Inc.
 
 #include <Arduino.h>
 #include "sapi_error.h"
+#include "fixstr.h"
 
 
 //////////////////////////////////////////////////////////////////////////
@@ -40,6 +41,140 @@ Networks, Inc.
 //
 //////////////////////////////////////////////////////////////////////////
 
+/**
+ * @brief A sensor sample, reported by the samples read callback.
+ */
+typedef struct sapi_sample
+{
+	uint32_t	epoch;			// UNIX epoch of the sample
+	uint8_t		datatype;		// Data type of the sample, for example 3 for level
+	uint16_t	ms;				// Milliseconds past epoch, 0-999, see get_rtc_epoch_at
+	float		value;			// Sample value
+} sapi_sample_t;
+
+// Sample data type of a digital input, 0 or 1
+#define SAPI_DATATYPE_DI		7
+
+// Sample data type of an alarm transition, datatype * 10 + kind of the
+// alarm, negative once it clears. -31 is a high level alarm that cleared.
+#define SAPI_DATATYPE_ALARM		8
+
+// Alarm kinds, see sapi_set_alarm
+#define SAPI_ALARM_HIGH			1		// Above the limit
+#define SAPI_ALARM_LOW			2		// Below the limit
+#define SAPI_ALARM_RATE			3		// Changing faster than the limit per minute, either way
+
+// Sample data type of a relay switched by a rule of the configuration, or
+// by a timed command of /sys/relay as an event of sensor 0, the relay
+// number, negative once it is off
+#define SAPI_DATATYPE_RELAY		9
+
+// Comparisons of a relay rule, "RuleNOp". A rule of the configuration,
+// "RuleNChan" sensor Id * 100 + datatype, switches relay "RuleNAction" on
+// while the sampled value is past "RuleNLimit", and off once it is back by
+// "RuleNHyst", both in thousandths, at the sample that crosses. A negative
+// action switches the relay off instead. "RuleNMinOn" and "RuleNMinOff"
+// are the least seconds it stays each way. A rule overrides "Relay1" or
+// "Relay2" from its first sample.
+#define SAPI_RULE_ABOVE			1		// Holds above the limit
+#define SAPI_RULE_BELOW			2		// Holds below the limit
+
+// Most samples a samples read callback may return, they fit one message
+#define SAPI_MAX_SAMPLES		16
+
+// Size of the payload buffer handed to the read callbacks
+#define SAPI_MAX_PAYLOAD_LEN	256
+
+// Sensor Id returned when a sensor can't be registered
+#define SAPI_NO_SENSOR			0xFF
+
+// Configuration parameter value types
+#define SAPI_PARAM_INT			0
+#define SAPI_PARAM_FLOAT		1
+#define SAPI_PARAM_BOOL			2
+#define SAPI_PARAM_TEXT			3
+
+#define SAPI_PARAM_NAME_LEN		24
+#define SAPI_PARAM_TEXT_LEN		32
+
+/**
+ * @brief A configuration parameter, one entry of a CBOR configuration PUT.
+ */
+typedef struct sapi_param
+{
+	char		name[SAPI_PARAM_NAME_LEN];		// Parameter name, for example "SampleRate"
+	uint8_t		type;							// SAPI_PARAM_*
+	union
+	{
+		int32_t	i;								// SAPI_PARAM_INT and SAPI_PARAM_BOOL
+		float	f;								// SAPI_PARAM_FLOAT
+	} v;
+	char		text[SAPI_PARAM_TEXT_LEN];		// SAPI_PARAM_TEXT
+} sapi_param_t;
+
+/**
+ * @brief The configuration in effect, see sapi_config(). Not changed once published.
+ */
+typedef struct sapi_config
+{
+	uint32_t	gen;							// Generation, 0 until loaded, one more per change
+	int			send_interval;					// "SendInterval", samples per report
+	int			sample_rate;					// "SampleRate", seconds between samples
+	int			report_s;						// Seconds between reports, sample_rate * send_interval
+	int			digital10;						// "Digital10"
+	int			digital11;						// "Digital11"
+	int			relay1;							// "Relay1"
+	int			relay2;							// "Relay2"
+	int			analog4;						// "Analog4"
+	int			analog5;						// "Analog5"
+	uint8_t		fast_boot;						// "FastBoot" non-zero
+	uint32_t	mb_baud;						// "ModbusBaud", 0 -> the sketch's
+	uint16_t	mb_format;						// "ModbusFormat", SERIAL_8N2 ..., 0 -> the sketch's
+} sapi_config_t;
+
+// GET "sens" response formats, fmt=
+#define SAPI_FMT_DEFAULT		0				// As without a query
+#define SAPI_FMT_CSV			1				// fmt=csv
+#define SAPI_FMT_CBOR			2				// fmt=cbor
+#define SAPI_FMT_BLK			3				// fmt=blk, samples as sblk blocks, columnar for rows, see sblk.h
+
+/**
+ * @brief Query parameters of a GET "sens" request, e.g. ?sens&n=10&since=1700000000&fmt=cbor,
+ *   or ?sens&log&since=1700000000 for what the sample log still holds
+ */
+typedef struct sapi_query
+{
+	uint32_t	since;			// Only samples at or after this UNIX epoch, 0 for all
+	uint16_t	n;				// At most the n latest samples, 0 for all
+	uint8_t		fmt;			// SAPI_FMT_*
+	uint8_t		log;			// 1 -> from the sample log, the first n at or after since
+} sapi_query_t;
+
+// Breakpoints of a calibration table, see sapi_set_calibration
+#define SAPI_CAL_POINTS			8
+
+/**
+ * @brief A breakpoint of a calibration table, both values Q16.16 fixed point
+ */
+typedef struct sapi_cal_point
+{
+	int32_t		raw;			// Value as read, times 65536
+	int32_t		eng;			// In engineering units, times 65536
+} sapi_cal_point_t;
+
+// Fields of a schema and the longest unit text, see sapi_set_schema
+#define SAPI_SCHEMA_FIELDS		6
+#define SAPI_SCHEMA_UNIT_LEN	8
+
+/**
+ * @brief A field of a schema, the datatype of its values and their unit
+ */
+typedef struct sapi_field
+{
+	uint8_t		datatype;						// Data type of the values, for example 3 for level
+	char		unit[SAPI_SCHEMA_UNIT_LEN];		// Unit text, for example "mm", may be empty
+} sapi_field_t;
+
 /**
  * @brief Typedef sensor initialization function pointer.
  *
@@ -72,6 +207,20 @@ typedef sapi_error_t (*SensorReadFuncPtr)(char *payload, uint8_t *len);
  */
 typedef sapi_error_t (*SensorReadCfgFuncPtr)(char *payload, uint8_t *len);
 
+struct txt_buf;
+
+/**
+ * @brief Typedef sensor text write callback function pointer.
+ *
+ * Callback by SAPI in response to a CoAP GET "sens" or "cfg" request, when registered with
+ * sapi_register_txt. Replaces the read or read cfg callback. Write the text with the txt_append_*
+ * functions of bufutil.h, its length is the writer's. A write past the end fails the request.
+ *
+ * @param tb Text writer, bounded by the room in the response.
+ * @return SAPI Error Code.
+ */
+typedef sapi_error_t (*SensorWriteTxtFuncPtr)(struct txt_buf *tb);
+
 /**
  * @brief Typedef sensor write configuration callback function pointer.
  *
@@ -83,6 +232,101 @@ typedef sapi_error_t (*SensorReadCfgFuncPtr)(char *payload, uint8_t *len);
  */
 typedef sapi_error_t (*SensorWriteCfgFuncPtr)(char *payload, uint8_t *len);
 
+/**
+ * @brief Typedef sensor samples read callback function pointer.
+ *
+ * Callback by SAPI in response to a CoAP GET "sens" request and for observation notifications,
+ * when registered with sapi_register_samples. Replaces the read callback. SAPI encodes the
+ * samples as CBOR (epoch, datatype, value) tuples, content-format 60, about half the size of text.
+ * The samples come zeroed. With ms set, samples apart by less than a second go as ms offsets
+ * from a base epoch, {0:"<sensor type>",2:<base epoch>,1:[[<ms>,<datatype>,<value>],...]}.
+ *
+ * @param samples Pointer to the samples. Fill in up to *count samples.
+ * @param count   Pointer to the sample count. Holds SAPI_MAX_SAMPLES, set to the samples returned.
+ * @return SAPI Error Code.
+ */
+typedef sapi_error_t (*SensorReadSamplesFuncPtr)(sapi_sample_t *samples, uint8_t *count);
+
+/**
+ * @brief Typedef sensor block read callback function pointer.
+ *
+ * Callback by SAPI in response to a CoAP GET "sens" request, once per block, for payloads
+ * larger than one message (RFC 7959 Block2). Replaces the read callback when registered.
+ *
+ * @param payload Char pointer to the block. Copy the payload bytes starting at offset.
+ * @param offset  Offset of the block within the whole payload.
+ * @param len     Pointer to the block length. Holds the block size, set to the bytes copied.
+ * @param more    Pointer to the more flag. Set to 1 if the payload continues past this block.
+ * @return SAPI Error Code.
+ */
+typedef sapi_error_t (*SensorReadBlockFuncPtr)(char *payload, uint32_t offset, uint16_t *len, uint8_t *more);
+
+/**
+ * @brief Typedef sensor block write callback function pointer.
+ *
+ * Callback by SAPI in response to a CoAP PUT carrying a Block1 option (RFC 7959), once per
+ * block, in order. The blocks are the request payload, a bulk configuration for example.
+ *
+ * @param payload Char pointer to the block.
+ * @param offset  Offset of the block within the whole payload, 0 starts a new transfer.
+ * @param len     Block length.
+ * @param more    1 if more blocks follow, 0 on the last block.
+ * @return SAPI Error Code.
+ */
+typedef sapi_error_t (*SensorWriteBlockFuncPtr)(char *payload, uint32_t offset, uint16_t len, uint8_t more);
+
+/**
+ * @brief Typedef sensor parameter write callback function pointer.
+ *
+ * Callback by SAPI in response to a CoAP PUT "cfg" request with a CBOR payload (content-format
+ * 60), once per entry of the map {"<name>":<value>,...}. All entries are checked before the
+ * first callback, a malformed map changes nothing.
+ *
+ * @param param Pointer to the parameter.
+ * @return SAPI Error Code. SAPI_ERR_BAD_DATA for an unknown name or a bad value.
+ */
+typedef sapi_error_t (*SensorWriteParamFuncPtr)(const sapi_param_t *param);
+
+/**
+ * @brief Typedef sensor query read callback function pointer.
+ *
+ * Callback by SAPI in response to a CoAP GET "sens" request with n= or since= query
+ * parameters, when registered with sapi_register_query. Return only the samples asked for,
+ * as text. Sensors with a samples read callback don't need one, SAPI slices their samples.
+ *
+ * @param query   Pointer to the query parameters.
+ * @param payload Char pointer to the payload. Copy the sensor payload to be returned.
+ * @param len     Pointer to the payload length. Set the sensor payload length to be returned.
+ * @return SAPI Error Code.
+ */
+typedef sapi_error_t (*SensorReadQueryFuncPtr)(const sapi_query_t *query, char *payload, uint8_t *len);
+
+/**
+ * @brief Typedef sensor read start callback function pointer.
+ *
+ * Callback by SAPI in place of the read callback, when registered with sapi_register_read_start,
+ * for sensors too slow to read inside a request. Start the read and return, then report the
+ * reading with sapi_read_complete. Not called again until then.
+ *
+ * @return SAPI Error Code. SAPI_ERR_OK once the read is under way.
+ */
+typedef sapi_error_t (*SensorReadStartFuncPtr)(void);
+
+/**
+ * @brief Typedef sensor exchange start callback function pointer.
+ *
+ * Callback by SAPI in response to a CoAP POST, or PUT "xchg", with a CBOR payload (content-format
+ * 60), when registered with sapi_register_exchange. A request for the device behind the sensor,
+ * answered in a separate response: start it and return, then report the answer with
+ * sapi_exchange_complete. One exchange runs at a time.
+ *
+ * @param payload Pointer to the request payload, valid during the callback only.
+ * @param len     Request payload length.
+ * @return SAPI Error Code. SAPI_ERR_OK once the exchange is under way, SAPI_ERR_BAD_DATA for a
+ *         bad request, SAPI_ERR_IN_PROGRESS while the device is busy.
+ */
+typedef sapi_error_t (*SensorExchangeFuncPtr)(const uint8_t *payload, uint16_t len);
+
 
 //////////////////////////////////////////////////////////////////////////
 //
@@ -111,19 +355,106 @@ void sapi_initialize(char *url_classifier);
  *
  * Call in your sensors "idle" or "main" loop. Needed to make sure that the underlying
  * CoAP server can processor incoming messages from the milli and that notification payloads
- * are pushed up.
+ * are pushed up. Returns right away when there is nothing to do.
  */
 void sapi_run();
+
+/**
+ * @brief Program the samples held in RAM for the sample log into the SPI flash.
+ *
+ * They are otherwise written a flash page at a time, or an hour after the first of them.
+ * They are kept over a reset and in sleep, not without power. The log records not printed
+ * yet are printed too. Call before removing the power.
+ */
+void sapi_flush();
+
+/**
+ * @brief Send the older part of the sample log decimated once it is far behind.
+ *
+ * After a long outage the sample log could take hours to send in full. While more than
+ * over records wait, those older than recent_s seconds go as the min and max of each data
+ * type per bucket of bucket_s seconds, the samples they were so the peaks keep their times,
+ * the rest of the bucket is marked sent. The recent ones still go as they are. All stay in
+ * the SPI flash until their sector is reused, GET "sens" with the log query reads them.
+ *
+ * @param over     Records waiting past which it starts, about 16 a KB of log.
+ * @param bucket_s Seconds of a bucket, 0 sends the log whole, the default.
+ * @param recent_s Records at most this old go as they are.
+ * @return SAPI Error Code
+ */
+sapi_error_t sapi_set_backlog_decimation(uint16_t over, uint32_t bucket_s, uint32_t recent_s);
+
+/**
+ * @brief Battery voltage for the health heartbeat, see sapi_set_health.
+ *
+ * @return Millivolts, 0 if not known.
+ */
+typedef uint16_t (*SensorBattFuncPtr)(void);
+
+/**
+ * @brief Send a health heartbeat every period_s seconds, daily by default.
+ *
+ * Once due it is encoded from the stats, and goes with the next data notification
+ * of any sensor that has room for it, at key 3 of its top level map:
+ *   {0:<uptime s>,1:<reset cause>,2:<stack used>,3:<free min>,4:[<small mbuf peak>,
+ *    <big mbuf peak>],5:<scratch peak>,6:[<frames in>,<frames out>,<bad frames>,
+ *    <resent>,<send errors>,<CoAP retries exceeded>],7:[<Modbus requests>,<timeouts>,
+ *    <bad frames>,<exceptions>],8:[<longest task us>,<latest task ms>,<task misses>],
+ *    9:<battery mV>}
+ * the counters since boot, the battery left out if not known.
+ *
+ * @param period_s Seconds between heartbeats, 0 stops them, at most 49 days.
+ * @param batt_mv  Reads the battery, NULL if there is none.
+ * @return SAPI Error Code
+ */
+sapi_error_t sapi_set_health(uint32_t period_s, SensorBattFuncPtr batt_mv);
 bool eraseBlock();
-String readSerialStr();
-String getString(int addr);
-String getID();
+
+/* Sizes, with the NUL, of the boot menu strings; longer text is cut */
+#define SAPI_SERIAL_STR_MAX     128
+#define SAPI_BLOCK_STR_MAX      256
+#define SAPI_ID_STR_MAX         40
+
+FixedString<SAPI_SERIAL_STR_MAX> readSerialStr();
+FixedString<SAPI_BLOCK_STR_MAX> getString(int addr);
+FixedString<SAPI_ID_STR_MAX> getID();
 void GoHere();
-bool setValue(String parameter, String value);
+bool setValue(StrView parameter, StrView value);
 void loadGlobalVariables();
 int ParamSendInterval();
 int ParamSampleRate();
-float convertCDAB(char * test);
+
+/**
+ * @brief The configuration in effect.
+ *
+ * Loaded once by loadGlobalVariables, then a new snapshot is published each time the boot
+ * menu or a CBOR PUT "cfg" changes it, whole, with a higher gen. One kept by a sensor stays
+ * the same; comparing its gen with the current one tells a change.
+ *
+ * @return The current snapshot, never NULL
+ */
+const sapi_config_t *sapi_config();
+
+/**
+ * @brief The fast boot profile, the "FastBoot" configuration parameter.
+ *
+ * Known from sapi_initialize on. With it the monitor isn't waited for, logging starts once
+ * it connects, and sapi_run has no boot menu countdown, see SAPI_BOOT_MENU_PIN. A CBOR PUT
+ * "cfg" of FastBoot 0 brings the countdown back at the next boot.
+ *
+ * @return Non-zero for the fast boot profile
+ */
+uint8_t sapi_boot_fast();
+
+/**
+ * @brief Save the serial format of the Modbus port, the "ModbusBaud" and "ModbusFormat"
+ *   configuration parameters, as commissioning found it, see mb_rtu_detect.
+ *
+ * @param baud   Bits per second.
+ * @param config SERIAL_8N2 ...
+ * @return SAPI Error Code, SAPI_ERR_FAIL if the SPI flash could not be written
+ */
+sapi_error_t sapi_set_modbus_format(uint32_t baud, uint16_t config);
 //////////////////////////////////////////////////////////////////////////
 //
 // SAPI sensor functions
@@ -136,8 +467,7 @@ float convertCDAB(char * test);
  * Use this function to register sensor. Usually call this in your initialization code (after the bootstrap code).
  * Your sensor code needs to provide a number of callback functions. A sensor package can support any number of sensors.
  *
- * Note: 4 sensors max are supported by default (that is you can make 4 registration calls).
- * Note: At this time the CoAP Server will only support one sensor for observations.
+ * Note: 16 sensors max are supported by default (SAPI_MAX_DEVICES), MAX_OBSERVERS of them observed.
  *
  * @param sensor_type     Sensor device type. For example "temp". Used in client URI's and MQTT Topic Names.
  * @param sensor_init     Pointer to the sensor initialization callback function.
@@ -146,11 +476,385 @@ float convertCDAB(char * test);
  * @param sensor_writecfg Pointer to the write configuration callback function. If not supported set to NULL.
  * @param is_observer     Set to 1 if this sensor is to generate observation notifications. Set to 0 if not.
  * @param frequency       Periodic observation generation frequency (in seconds).
- * @return Sensor Id.
+ * @return Sensor Id, SAPI_NO_SENSOR if the table is full.
  */
 uint8_t sapi_register_sensor(char *sensor_type, SensorInitFuncPtr sensor_init, SensorReadFuncPtr sensor_read, SensorReadCfgFuncPtr sensor_readcfg,
 							 SensorWriteCfgFuncPtr sensor_writecfg, uint8_t is_observer, uint32_t frequency);
 
+/**
+ * @brief Register a samples read callback for a sensor, to report CBOR instead of text.
+ *
+ * Optional, call after sapi_register_sensor. The payload is a CBOR map:
+ * {0:"<sensor type>",1:[[<epoch>,<datatype>,<value>],...]}
+ *
+ * @param sensor_id          Id of the sensor (returned by sapi_register_sensor).
+ * @param sensor_readsamples Pointer to the samples read callback function.
+ * @return SAPI Error Code
+ */
+sapi_error_t sapi_register_samples(uint8_t sensor_id, SensorReadSamplesFuncPtr sensor_readsamples);
+
+/**
+ * @brief Register text write callbacks for a sensor, writing its payload in place.
+ *
+ * Optional, call after sapi_register_sensor. Either callback may be NULL, leaving the read or
+ * read cfg callback in use. The cfg text goes straight into the response, up to the room left
+ * in its buffer, so past SAPI_MAX_PAYLOAD_LEN. The sens text goes into the read cache, up to
+ * SAPI_MAX_PAYLOAD_LEN - 1, and from there into each response with no other copy.
+ *
+ * @param sensor_id     Id of the sensor (returned by sapi_register_sensor).
+ * @param sensor_read   Pointer to the sens text write callback function.
+ * @param sensor_readcfg Pointer to the cfg text write callback function.
+ * @return SAPI Error Code
+ */
+sapi_error_t sapi_register_txt(uint8_t sensor_id, SensorWriteTxtFuncPtr sensor_read,
+							   SensorWriteTxtFuncPtr sensor_readcfg);
+
+/**
+ * @brief Register block-wise transfer callbacks for a sensor.
+ *
+ * Optional, call after sapi_register_sensor. Either callback may be NULL.
+ *
+ * @param sensor_id       Id of the sensor (returned by sapi_register_sensor).
+ * @param sensor_readblk  Pointer to the block read callback function, used for GET "sens".
+ * @param sensor_writeblk Pointer to the block write callback function, used for PUT with Block1.
+ * @return SAPI Error Code
+ */
+sapi_error_t sapi_register_block(uint8_t sensor_id, SensorReadBlockFuncPtr sensor_readblk, 
+								 SensorWriteBlockFuncPtr sensor_writeblk);
+
+/**
+ * @brief Read a window of the SPI flash straight into a buffer.
+ *
+ * One fast read burst, through the DMAC where the SPI has it, without a String or the heap.
+ * A block read callback serving a history stored in the flash reads its block into the
+ * payload it is given, which is the response itself.
+ *
+ * @param addr SPI flash address of the window.
+ * @param buf  Where the bytes go.
+ * @param len  Window length.
+ * @return SAPI Error Code. SAPI_ERR_FAIL if the flash could not be read.
+ */
+sapi_error_t sapi_flash_read(uint32_t addr, void *buf, uint16_t len);
+
+/**
+ * @brief Register a parameter write callback for a sensor, for CBOR configuration PUTs.
+ *
+ * Optional, call after sapi_register_sensor. Without it the parameters of a CBOR PUT are
+ * the integer configuration parameters, "SampleRate", "SendInterval", "Relay1", ...
+ * They are applied through setValue, and the changed ones logged to the SPI flash.
+ *
+ * @param sensor_id         Id of the sensor (returned by sapi_register_sensor).
+ * @param sensor_writeparam Pointer to the parameter write callback function.
+ * @return SAPI Error Code
+ */
+sapi_error_t sapi_register_params(uint8_t sensor_id, SensorWriteParamFuncPtr sensor_writeparam);
+
+/**
+ * @brief Register a query read callback for a sensor, for GET "sens" with n= or since=.
+ *
+ * Optional, call after sapi_register_sensor. Without it, and without a samples read callback,
+ * such requests get 5.01 Not Implemented.
+ *
+ * @param sensor_id        Id of the sensor (returned by sapi_register_sensor).
+ * @param sensor_readquery Pointer to the query read callback function.
+ * @return SAPI Error Code
+ */
+sapi_error_t sapi_register_query(uint8_t sensor_id, SensorReadQueryFuncPtr sensor_readquery);
+
+/**
+ * @brief Register a read start callback for a sensor, a split-phase read.
+ *
+ * Optional, call after sapi_register_sensor. A GET "sens" that finds the cache stale starts
+ * the read and gets an empty ACK, the reading follows in a separate response once the sensor
+ * calls sapi_read_complete. Observation notifications wait for it the same way.
+ *
+ * @param sensor_id         Id of the sensor (returned by sapi_register_sensor).
+ * @param sensor_readstart  Pointer to the read start callback function.
+ * @return SAPI Error Code
+ */
+sapi_error_t sapi_register_read_start(uint8_t sensor_id, SensorReadStartFuncPtr sensor_readstart);
+
+/**
+ * @brief Register an exchange start callback for a sensor, a request passed through to its device.
+ *
+ * Optional, call after sapi_register_sensor. Without it, exchanges get 5.01 Not Implemented.
+ *
+ * @param sensor_id       Id of the sensor (returned by sapi_register_sensor).
+ * @param sensor_exchange Pointer to the exchange start callback function.
+ * @return SAPI Error Code
+ */
+sapi_error_t sapi_register_exchange(uint8_t sensor_id, SensorExchangeFuncPtr sensor_exchange);
+
+/**
+ * @brief Send a sensor's periodic observation notifications non-confirmable.
+ *
+ * Cuts ACK traffic for high rate sensors. A confirmable notification still goes out every
+ * con_every_n notifications or con_every_s seconds, whichever comes first, to check that
+ * the observer is still there. Notifications pushed with sapi_push_notification are always
+ * confirmable.
+ *
+ * @param sensor_id   Id of the sensor (returned by sapi_register_sensor). Must be an observer.
+ * @param con_every_n Confirmable every n notifications. 0 or 1 makes them all confirmable.
+ * @param con_every_s Confirmable at least every s seconds, at most once a day.
+ * @return SAPI Error Code
+ */
+sapi_error_t sapi_set_observe_non(uint8_t sensor_id, uint8_t con_every_n, uint32_t con_every_s);
+
+/**
+ * @brief Compress a sensor's observation notifications.
+ *
+ * For batches of samples and the sample log, which repeat themselves. Notifications of
+ * HSHRINK_MIN_LEN bytes or more go as heatshrink, window 8 and lookahead 4, with
+ * Content-Format COAP_CF_CSV_HSHRINK or COAP_CF_CBOR_HSHRINK, when that is shorter. Those
+ * of samples take twice the room before compression. The head-end must know the formats.
+ *
+ * @param sensor_id Id of the sensor (returned by sapi_register_sensor). Must be an observer.
+ * @param on        1 to compress, 0 to send them as they are, the default.
+ * @return SAPI Error Code
+ */
+sapi_error_t sapi_set_observe_compress(uint8_t sensor_id, uint8_t on);
+
+/**
+ * @brief Change the observation notification frequency of a sensor.
+ *
+ * The next notification is a full period from now.
+ *
+ * @param sensor_id Id of the sensor (returned by sapi_register_sensor). Must be an observer.
+ * @param frequency Seconds between notifications.
+ * @return SAPI Error Code
+ */
+sapi_error_t sapi_set_frequency(uint8_t sensor_id, uint32_t frequency);
+
+/**
+ * @brief Keep a snapshot of a sensor, read in the background.
+ *
+ * Optional, for a sensor reported by its read callback, neither sampled nor with a deadband.
+ * sapi_run reads it every refresh_s seconds, and the notifications and GET "sens" are answered
+ * from the last read, however old, never waiting on the sensor. No notification goes out until
+ * the first good read.
+ *
+ * @param sensor_id Id of the sensor (returned by sapi_register_sensor).
+ * @param refresh_s Seconds between reads, 0 to read when requested again.
+ * @return SAPI Error Code
+ */
+sapi_error_t sapi_set_snapshot(uint8_t sensor_id, uint32_t refresh_s);
+
+/**
+ * @brief Have a sensor follow the SendInterval and SampleRate configuration.
+ *
+ * When a CBOR PUT "cfg" changes either, the notification frequency is set to
+ * ParamSendInterval() and, if the sensor is sampled, the sampling to ParamSampleRate().
+ *
+ * @param sensor_id Id of the sensor (returned by sapi_register_sensor). Must be an observer.
+ * @return SAPI Error Code
+ */
+sapi_error_t sapi_follow_config(uint8_t sensor_id);
+
+/**
+ * @brief Sample a sensor on its own schedule, apart from its notifications.
+ *
+ * Optional, call after sapi_register_samples. The samples read callback is called every
+ * sample_s seconds, for the samples of the moment, kept in a ring of SAPI_SAMPLER_RING.
+ * The observation notification, at the frequency given to sapi_register_sensor, reports
+ * them as CBOR and empties the ring, no notification goes out while it is empty. Once full
+ * the oldest sample goes to the sample log in the SPI flash, as does the ring while the mNIC
+ * link is down, and the log is sent oldest first once it is up. sapi_push_notification takes
+ * a sample first.
+ * Up to SAPI_MAX_SAMPLERS sensors.
+ *
+ * @param sensor_id Id of the sensor (returned by sapi_register_sensor). Must be an observer,
+ *                  with a samples read callback.
+ * @param sample_s  Sample period in seconds, 0 stops the sampling.
+ * @return SAPI Error Code. SAPI_ERR_NO_MEM with no sampler left.
+ */
+sapi_error_t sapi_set_sampling(uint8_t sensor_id, uint32_t sample_s);
+
+/**
+ * @brief Sample a sensor faster than once a second, see sapi_set_sampling.
+ *
+ * Stamp the samples with get_rtc_epoch_at, so the notification keeps them apart.
+ *
+ * @param sensor_id Id of the sensor (returned by sapi_register_sensor)
+ * @param sample_ms Sample period in milliseconds, 0 stops the sampling.
+ * @return SAPI Error Code. SAPI_ERR_NO_MEM with no sampler left.
+ */
+sapi_error_t sapi_set_sampling_ms(uint8_t sensor_id, uint32_t sample_ms);
+
+/**
+ * @brief Put the samples back on whole multiples of their period from the epoch.
+ *
+ * sapi_set_sampling_ms starts a sampler so. Call once the time was set to a
+ * second boundary, as from a GPS PPS, and units sampling on the same time
+ * take their samples at the same moments.
+ */
+void sapi_align_sampling();
+
+/**
+ * @brief Report a sensor on change of value, instead of every notification.
+ *
+ * Optional, call after sapi_register_samples. At the frequency given to sapi_register_sensor
+ * the newest sample is checked against the last one reported. The notification goes out
+ * once it moved more than band, but no sooner than min_s seconds after the last, and
+ * anyway max_s seconds after the last. sapi_push_notification always reports. Smooth noisy
+ * samples in the callback, with FilterOnePole for example, to keep the noise in the band.
+ * Up to SAPI_MAX_COV sensors. Not for sampled sensors.
+ *
+ * @param sensor_id Id of the sensor (returned by sapi_register_sensor). Must be an observer,
+ *                  with a samples read callback.
+ * @param band      Deadband, 0 or less stops the change-of-value reporting.
+ * @param percent   1 if band is a percent of the last value reported, 0 if absolute.
+ * @param min_s     Shortest time between reports in seconds.
+ * @param max_s     Longest time between reports in seconds, 0 for no limit.
+ * @return SAPI Error Code. SAPI_ERR_NO_MEM with no deadband left.
+ */
+sapi_error_t sapi_set_deadband(uint8_t sensor_id, float band, uint8_t percent, uint32_t min_s, uint32_t max_s);
+
+/**
+ * @brief Raise an alarm when a sampled value crosses a limit.
+ *
+ * Checked on every sample of the datatype the sampler takes, so rare events are caught at
+ * the sample rate whatever the notification frequency. The alarm raises once the value is
+ * past limit and clears once it is back by hyst, for SAPI_ALARM_RATE once the change per
+ * minute is under limit - hyst. Either transition is posted as a SAPI_DATATYPE_ALARM event,
+ * reported at once ahead of periodic notifications. Setting an alarm of the same sensor,
+ * datatype and kind replaces it. Up to SAPI_MAX_ALARMS alarms.
+ *
+ * @param sensor_id Id of the sensor (returned by sapi_register_sensor). Sampled, see
+ *                  sapi_set_sampling.
+ * @param datatype  Data type of the samples checked, for example 3 for level.
+ * @param kind      SAPI_ALARM_*.
+ * @param limit     Value, or change per minute, the alarm raises past.
+ * @param hyst      Hysteresis, how far back the value must come for the alarm to clear.
+ * @return SAPI Error Code. SAPI_ERR_NO_MEM with no alarm left.
+ */
+sapi_error_t sapi_set_alarm(uint8_t sensor_id, uint8_t datatype, uint8_t kind, float limit, float hyst);
+
+/**
+ * @brief Remove an alarm set by sapi_set_alarm. A raised one goes without a clear event.
+ *
+ * @param sensor_id Id of the sensor.
+ * @param datatype  Data type of the alarm.
+ * @param kind      SAPI_ALARM_*.
+ * @return SAPI Error Code. SAPI_ERR_NO_ENTRY if there is no such alarm.
+ */
+sapi_error_t sapi_clear_alarm(uint8_t sensor_id, uint8_t datatype, uint8_t kind);
+
+/**
+ * @brief Integrate a sampled value on the device, a flow into a volume for example.
+ *
+ * Call after loadGlobalVariables. Every sample of the datatype the sampler takes adds the
+ * trapezoid since the previous one, (previous + value) / 2 * seconds * scale, to a total.
+ * Each notification of the sensor reports the total as a sample of total_datatype, so a
+ * head-end gets exact volumes however rare the reports. The total is saved to the SPI flash
+ * every TOTAL_SAVE_MS of total.h when it changed, and resumed from there after a reset. Totals are
+ * kept by the order they are set in, set them in the same order on every boot.
+ * Up to TOTAL_MAX totals.
+ *
+ * @param sensor_id      Id of the sensor (returned by sapi_register_sensor). Sampled, see
+ *                       sapi_set_sampling.
+ * @param datatype       Data type of the samples integrated, for example a flow.
+ * @param total_datatype Data type of the total in the notifications.
+ * @param scale          Factor to the total's unit, 1/60.0 for a flow per minute for example.
+ * @return SAPI Error Code. SAPI_ERR_NO_MEM with no total left.
+ */
+sapi_error_t sapi_set_total(uint8_t sensor_id, uint8_t datatype, uint8_t total_datatype, float scale);
+
+/**
+ * @brief Restart a total set by sapi_set_total from 0, saved at once.
+ *
+ * @param sensor_id      Id of the sensor.
+ * @param total_datatype Data type of the total.
+ * @return SAPI Error Code. SAPI_ERR_NO_ENTRY if there is no such total.
+ */
+sapi_error_t sapi_reset_total(uint8_t sensor_id, uint8_t total_datatype);
+
+/**
+ * @brief Report the statistics of a sampled value with each notification.
+ *
+ * Every sample of the datatype the sampler takes between two notifications goes into a
+ * window, in fixed point steps of resolution. Each notification then reports its mean,
+ * standard deviation, minimum, maximum and count as samples of summary_datatype and the
+ * four data types after it, and starts the next window. A window without samples is left
+ * out. Values must be within 2^23 steps of their mean. Up to SAPI_MAX_SUMMARIES summaries.
+ *
+ * @param sensor_id        Id of the sensor (returned by sapi_register_sensor). Sampled, see
+ *                         sapi_set_sampling.
+ * @param datatype         Data type of the samples summarised.
+ * @param summary_datatype Data type of the mean, summary_datatype + 1 to + 4 are the others.
+ * @param resolution       Step the values are counted in, 0.01 for a temperature for example.
+ * @return SAPI Error Code. SAPI_ERR_NO_MEM with no summary left.
+ */
+sapi_error_t sapi_set_summary(uint8_t sensor_id, uint8_t datatype, uint8_t summary_datatype, float resolution);
+
+/**
+ * @brief Take spurious readings, a false echo for example, out of a sampled value.
+ *
+ * Each sample of the datatype read for the sampler or a change-of-value report is first put in
+ * a window of the last window raw values, 3 or 5, and tested against their median. Past k
+ * standard deviations, estimated from the median absolute deviation, it is replaced by the
+ * median, a Hampel filter. With k 0 every sample is replaced by the median. The ring, alarms,
+ * totals, summaries and deadband then only see the filtered value. A step in the value gets
+ * through once it holds for more than half the window. Up to SAPI_MAX_PREFILTERS prefilters.
+ *
+ * @param sensor_id Id of the sensor (returned by sapi_register_sensor), with a samples read
+ *                  callback.
+ * @param datatype  Data type of the samples filtered.
+ * @param window    Samples in the window, 3 or 5.
+ * @param k         Deviations from the median a sample may be off by, 3 is usual, 0 for a
+ *                  plain median.
+ * @return SAPI Error Code. SAPI_ERR_NO_MEM with no prefilter left.
+ */
+sapi_error_t sapi_set_prefilter(uint8_t sensor_id, uint8_t datatype, uint8_t window, float k);
+
+/**
+ * @brief Calibrate the samples of a datatype with a piecewise linear table.
+ *
+ * Each sample of the datatype read for the sampler, a change-of-value report or a GET is
+ * mapped from raw to engineering units ahead of the prefilters, along the segment between the
+ * breakpoints around it, the first or last beyond them. One breakpoint is an offset. The values
+ * are Q16.16, within +-32767, and the map takes a binary search and a multiply, no float math
+ * but the conversion of the sample. The table is saved in the SPI flash and loaded at boot,
+ * PUT "cal=<datatype>" with a CBOR array of [raw, eng] pairs sets it too, GET reads it back.
+ * Only a change is saved, a sketch that sets a table at every boot replaces one PUT since.
+ * Up to CAL_MAX tables, see cal.h.
+ *
+ * @param sensor_id Id of the sensor (returned by sapi_register_sensor), with a samples read
+ *                  callback.
+ * @param datatype  Data type of the samples calibrated.
+ * @param points    Breakpoints, raw ascending.
+ * @param n         Breakpoints, up to SAPI_CAL_POINTS, 0 removes the table.
+ * @return SAPI Error Code. SAPI_ERR_BAD_DATA unless raw ascends, SAPI_ERR_NO_MEM with no
+ *         table left.
+ */
+sapi_error_t sapi_set_calibration(uint8_t sensor_id, uint8_t datatype, const sapi_cal_point_t *points, uint8_t n);
+
+/**
+ * @brief Publish the schema of a sensor's samples, so they go without a datatype each.
+ *
+ * The schema document, GET "schema", is {0:"<sensor type>",4:<Id>,1:[[<datatype>,"<unit>"],
+ * ...]}, the Id the crc_xmodem of the encoded fields, so a change of fields is a new Id. The
+ * CBOR samples, notifications and GET "sens", then go as {0:"<sensor type>",4:<Id>,1:[[<epoch>,
+ * <value>,...],...]}, the samples of one epoch, or ms past the base, a row of values in the
+ * order of the fields, undefined for one not sampled. A read with a datatype not in the
+ * schema, an alarm for example, goes in full as without. Up to SAPI_MAX_SCHEMAS sensors.
+ *
+ * @param sensor_id Id of the sensor (returned by sapi_register_sensor), with a samples read
+ *                  callback.
+ * @param fields    Fields, a datatype once each.
+ * @param n         Fields, up to SAPI_SCHEMA_FIELDS, 0 removes the schema.
+ * @param id        Set to the schema Id, may be NULL.
+ * @return SAPI Error Code. SAPI_ERR_BAD_DATA with a datatype twice, SAPI_ERR_NO_MEM with no
+ *         schema left.
+ */
+sapi_error_t sapi_set_schema(uint8_t sensor_id, const sapi_field_t *fields, uint8_t n, uint16_t *id);
+
+/**
+ * @brief Map a Q16.16 raw value, an ADC count << 16 for example, with the calibration of a datatype.
+ *
+ * @return The value in engineering units, Q16.16, raw as it is without a table.
+ */
+int32_t sapi_calibrate_q16(uint8_t sensor_id, uint8_t datatype, int32_t raw);
+
 /**
  * @brief Initialize a sensor (hardware) and sensor related code.
  *
@@ -180,5 +884,82 @@ sapi_error_t sapi_init_sensor(uint8_t sensor_id);
  */
 sapi_error_t sapi_push_notification(uint8_t sensor_id);
 
+/**
+ * @brief Post an alarm event from an interrupt handler.
+ *
+ * Safe to call from one interrupt handler, the only caller. The event is timestamped now and
+ * reported by sapi_run ahead of periodic notifications, as sapi_push_notification would.
+ * A sampled sensor gets the event as a sample of its ring, at the time it was posted, and
+ * reports the ring at once. Up to SAPI_EVENT_Q events wait, more are dropped.
+ *
+ * @param sensor_id Id of the sensor to generate an observation notification for.
+ * @param datatype  Data type of the event sample, for example 7 for a digital input.
+ * @param value     Value of the event sample.
+ * @return SAPI Error Code. SAPI_ERR_NO_MEM if the queue is full.
+ */
+sapi_error_t sapi_post_event(uint8_t sensor_id, uint8_t datatype, float value);
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// SAPI digital input functions
+//
+//////////////////////////////////////////////////////////////////////////
+
+/**
+ * @brief Register a digital input as a sensor.
+ *
+ * The pin interrupts on both edges, once, with the EIC input filter on so glitches don't
+ * count. Each transition is timestamped in the interrupt and reported at once through
+ * sapi_post_event. The notifications and GET "sens" carry the input as a CBOR sample
+ * [<epoch of the last transition>,SAPI_DATATYPE_DI,<level>]. Up to SAPI_MAX_INPUTS inputs.
+ *
+ * @param sensor_type Sensor device type, the leaf of the URI.
+ * @param pin         Arduino pin, must have an external interrupt.
+ * @param mode        INPUT or INPUT_PULLUP.
+ * @param frequency   Observation notification frequency in seconds.
+ * @return Sensor Id, SAPI_NO_SENSOR if it can't be registered.
+ */
+uint8_t sapi_register_input(char *sensor_type, uint32_t pin, uint32_t mode, uint32_t frequency);
+
+/**
+ * @brief Register the inputs of the configuration, D10 and D11 when Digital10 or Digital11 is 0.
+ *
+ * Call after loadGlobalVariables. The sensor types are "DI10" and "DI11", pulled up.
+ *
+ * @param frequency   Observation notification frequency in seconds.
+ */
+void sapi_register_config_inputs(uint32_t frequency);
+
+/**
+ * @brief Report the end of a read started by the read start callback.
+ *
+ * Call from the main loop, not an interrupt. The reading goes to the read cache and to the
+ * requests and notifications waiting for it. A read not completed within SAPI_READ_TIMEOUT_MS
+ * fails with 5.04 Gateway Timeout.
+ *
+ * @param sensor_id Id of the sensor (returned by sapi_register_sensor).
+ * @param rcode     SAPI_ERR_OK for a good read, else the error.
+ * @param payload   Char pointer to the sensor payload.
+ * @param len       Sensor payload length, below SAPI_MAX_PAYLOAD_LEN, the cache keeps a byte
+ *                  length as the read callbacks do. A longer one fails the read.
+ * @return SAPI Error Code. SAPI_ERR_NO_ENTRY if no read was started.
+ */
+sapi_error_t sapi_read_complete(uint8_t sensor_id, sapi_error_t rcode, const char *payload, uint16_t len);
+
+/**
+ * @brief Report the answer to an exchange started by the exchange start callback.
+ *
+ * Call from the main loop, not an interrupt nor the callback. The answer goes back as CBOR in a
+ * 2.04 separate response. An exchange not completed within SAPI_EXCHANGE_TIMEOUT_MS fails with
+ * 5.04 Gateway Timeout.
+ *
+ * @param rcode     SAPI_ERR_OK for an answer, else the error.
+ * @param payload   Pointer to the CBOR answer.
+ * @param len       Answer length, up to SAPI_MAX_PAYLOAD_LEN.
+ * @return SAPI Error Code. SAPI_ERR_NO_ENTRY if no exchange waits.
+ */
+sapi_error_t sapi_exchange_complete(sapi_error_t rcode, const uint8_t *payload, uint16_t len);
+
 
 #endif /* SAPI_H_ */
\ No newline at end of file
@@ -44,6 +44,7 @@ typedef enum sapi_error_e
 	SAPI_ERR_NO_ENTRY			= 2,
 	SAPI_ERR_NO_MEM				= 3,
 	SAPI_ERR_BAD_DATA			= 4,
+	SAPI_ERR_IN_PROGRESS		= 5,
     SAPI_ERR_FAIL				= 99,
 } sapi_error_t;
 
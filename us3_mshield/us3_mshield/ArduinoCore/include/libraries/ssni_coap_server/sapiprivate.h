@@ -40,6 +40,7 @@ Networks, Inc.
 #include "coapobserve.h"
 #include "coap_rbt_msg.h"
 #include "arduino_time.h"
+#include "WindowStatistics.h"
 
 
 //////////////////////////////////////////////////////////////////////////
@@ -86,6 +87,42 @@ error_t crresourcehandler(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, vo
  */
 uint8_t cbor_enc_nic_type(struct cbor_buf *cbuf, char *sensor_type);
 
+/**
+ * @brief The payload wrapper of samples sent as ms offsets, the device type
+ *   and the base epoch of the offsets at SAPI_SAMPLES_BASE_KEY.
+ *
+ * @param cbuf         Pointer to an initialized CBOR buffer.
+ * @param sensor_type  Pointer to the sensor type.
+ * @param base         Epoch the offsets count from.
+ * @return  CoAP Error Code.
+ */
+uint8_t cbor_enc_nic_type_at(struct cbor_buf *cbuf, char *sensor_type, uint32_t base);
+
+/**
+ * @brief The payload wrapper of samples with the health heartbeat waiting at
+ *   SAPI_HEALTH_KEY, see sapi_set_health.
+ *
+ * @param cbuf         Pointer to an initialized CBOR buffer.
+ * @param sensor_type  Pointer to the sensor type.
+ * @param base         Epoch ms offsets count from, NULL if sent as epochs.
+ * @return  CoAP Error Code.
+ */
+uint8_t cbor_enc_nic_type_health(struct cbor_buf *cbuf, char *sensor_type, const uint32_t *base);
+
+/**
+ * @brief The payload wrapper of samples sent as rows of a schema, the schema Id at
+ *   SAPI_SCHEMA_KEY, see sapi_set_schema.
+ *
+ * @param cbuf         Pointer to an initialized CBOR buffer.
+ * @param sensor_type  Pointer to the sensor type.
+ * @param id           Schema Id.
+ * @param base         Epoch ms offsets count from, NULL if sent as epochs.
+ * @param health       Whether the health heartbeat waiting goes too.
+ * @return  CoAP Error Code.
+ */
+uint8_t cbor_enc_nic_type_schema(struct cbor_buf *cbuf, char *sensor_type, uint16_t id, const uint32_t *base,
+								 bool health);
+
 /**
  * @brief Build the CoAP response message for a sensor. Called on these CoAP requests:
  *   Get sensor value
@@ -106,6 +143,19 @@ uint8_t cbor_enc_nic_type(struct cbor_buf *cbuf, char *sensor_type);
  */
 error_t build_rsp_msg(struct mbuf *m, uint8_t *len, char *payload, uint32_t payloadlen, uint8_t sensor_id);
 
+/**
+ * @brief Append the same CBOR wrapper to a CoAP response, with fn writing the text in place.
+ *
+ * The writer is bounded by the room left in the last buffer of m.
+ *
+ * @param m           Pointer to an initialized CoAP message buffer.
+ * @param len         Pointer to the CoAP message buffer length.
+ * @param fn          Text write callback of the sensor.
+ * @param sensor_id   Sensor Id.
+ * @return  CoAP Error Code, ERR_BAD_DATA if the callback failed.
+ */
+error_t build_rsp_txt(struct mbuf *m, uint16_t *len, SensorWriteTxtFuncPtr fn, uint8_t sensor_id);
+
 /**
  * @brief Handle generation of an observation notification. Called in two ways by the CoAP Server:
  *   Periodic generation of notifications
@@ -127,6 +177,38 @@ error_t sapi_observation_handler(struct mbuf *m, uint8_t *len, uint8_t sensor_id
  */
 error_t crarduino( struct coap_msg_ctx *req, struct coap_msg_ctx *rsp );
 
+/**
+ * @brief Refresh a stale sensor read cache entry that is in use. Called from sapi_run.
+ *
+ */
+void sapi_cache_refresh();
+
+/**
+ * @brief Fail split-phase reads not completed within SAPI_READ_TIMEOUT_MS, and the exchange
+ *   not completed within SAPI_EXCHANGE_TIMEOUT_MS. Called from sapi_run.
+ *
+ */
+void sapi_read_poll();
+
+/**
+ * @brief Take the samples that are due. Called from sapi_run.
+ *
+ */
+void sapi_sample_poll();
+
+/**
+ * @brief Report the events posted from interrupts. Called from sapi_run, ahead of the notifications.
+ *
+ */
+void sapi_event_poll();
+
+/**
+ * @brief Set D10 or D11 to its configured mode, 1 -> output high, 0 -> input pulled up.
+ *   A registered input gets its interrupt back. Called from setValue.
+ *
+ */
+void sapi_input_mode(uint32_t pin, int mode);
+
 /**
  * @brief Helper function to print a banner in the log.
  *
@@ -138,12 +220,158 @@ void sapi_log_banner();
 #define SAPI_VERSION_NUMBER "1.0.0"
 #define SAPI_VERSION_STRING "Itron SAPI: "
 
-// Payload Max Length
-#define SAPI_MAX_PAYLOAD_LEN		256
 #define SAPI_MAX_DEVICE_TYPE_LEN    20
 
-// Max devices that can be registered.
-#define SAPI_MAX_DEVICES			4
+// Max devices that can be registered, up to 32. Each costs a read cache
+// entry of about SAPI_MAX_PAYLOAD_LEN bytes.
+#ifndef SAPI_MAX_DEVICES
+#define SAPI_MAX_DEVICES			16
+#endif
+
+// Sensor type lookup, open addressed by a hash of the type
+#define SAPI_TYPE_BUCKETS			(2 * SAPI_MAX_DEVICES)
+
+// Aggregate resource, GET {classifier}/all?sens reads every sensor at once.
+// A sensor registered with this device type takes precedence.
+#define SAPI_AGGREGATE_URI			"all"
+
+// Sensors that can be sampled apart from their reports. Each costs a ring
+// of SAPI_SAMPLER_RING samples, 12 bytes each.
+#define SAPI_MAX_SAMPLERS			2
+#define SAPI_SAMPLER_RING			32
+
+// Longest encoded sample, [<epoch>,<datatype>,<value>]
+#define SAPI_SAMPLE_ENC_MAX			13
+
+// Key of the base epoch of samples sent as ms offsets, and its encoded length
+#define SAPI_SAMPLES_BASE_KEY		2
+#define SAPI_SAMPLES_BASE_LEN		6
+
+// Longest span of samples sent as ms offsets, the offsets stay 4 bytes
+#define SAPI_SAMPLES_SPAN_S			86400UL
+
+// Key of the health heartbeat in a notification of samples, see health.h
+#define SAPI_HEALTH_KEY				3
+
+// Events posted from interrupts and not yet drained, a power of 2
+#define SAPI_EVENT_Q				8
+
+// Digital inputs, each needs its own interrupt and samples callback
+#define SAPI_MAX_INPUTS				2
+
+// Sensors with change-of-value reporting
+#define SAPI_MAX_COV				4
+
+// Threshold alarms on sampled values
+#define SAPI_MAX_ALARMS				4
+
+// Summaries of sampled values, one window per notification
+#define SAPI_MAX_SUMMARIES			2
+#define SAPI_SUMMARY_VALUES			5			// mean, sigma, min, max, count
+
+// Calibration tables of sampled values, see cal.h, GET and PUT cal=<datatype>
+#define SAPI_CAL_QUERY				"cal"
+
+// Schemas of the samples of a sensor, see sapi_set_schema. With one, the
+// samples go at key 1 as rows of values in schema order, the schema Id at
+// SAPI_SCHEMA_KEY in place of a datatype per sample, its encoded length.
+// The longest encoded fields of the document, GET "schema".
+#define SAPI_MAX_SCHEMAS			2
+#define SAPI_SCHEMA_KEY				4
+#define SAPI_SCHEMA_QUERY			"schema"
+#define SAPI_SCHEMA_ID_LEN			4
+#define SAPI_SCHEMA_ENC_MAX			(1 + SAPI_SCHEMA_FIELDS * (3 + SAPI_SCHEMA_UNIT_LEN))
+
+// Median and Hampel prefilters on sampled values, a window of 3 or 5
+#define SAPI_MAX_PREFILTERS			2
+#define SAPI_PREFILTER_WINDOW		5
+#define SAPI_PREFILTER_MAD_SIGMA	1.4826f		// sigma of normal noise over its MAD
+
+// The page buffer of the sample log and the rings of the samplers are kept
+// in the low power SRAM of the SAML21, the .lpram section, which holds in
+// standby and backup sleep and over a reset, not a power cycle. A header
+// with a CRC over where they stand tells at boot whether they are good.
+// The records of the page buffer then carry on from the flash head and
+// the samples of the rings go to the sample log, the samplers start over.
+// Set to 0 for plain RAM, the page then programmed a minute after its
+// first record.
+#ifndef SAPI_KEEP
+#define SAPI_KEEP					1
+#endif
+#define SAPI_KEEP_MAGIC				0x4B53		// "SK"
+
+// Store and forward of samples. Those that would be lost, overwritten in a
+// full ring or reported while the mNIC link is down, are appended to the
+// sample log of backlog.h instead. Once the link is up the log is sent
+// oldest first, a full frame of one sensor at a time, no more often than
+// SAPI_BACKLOG_GAP_MS and only while that sensor has no notification
+// waiting. Its page buffer is programmed SAPI_BACKLOG_FLUSH_MS after the
+// first of its records, or on sapi_flush. Kept over a reset, see SAPI_KEEP,
+// the page is given much longer to fill.
+#if SAPI_KEEP
+#define SAPI_BACKLOG_FLUSH_MS		3600000UL
+#else
+#define SAPI_BACKLOG_FLUSH_MS		60000UL
+#endif
+#define SAPI_BACKLOG_GAP_MS			5000UL
+
+// Decimals of the values of fmt=blk blocks, as fmt=csv writes them
+#define SAPI_BLK_DECIMALS			2
+
+// Decimation of the sample log once it is far behind, see
+// sapi_set_backlog_decimation. The min and max of up to SAPI_DECIM_TYPES
+// data types per bucket, others in the bucket are left out.
+#define SAPI_DECIM_TYPES			4
+
+// Longest a split-phase read may take before it fails with 5.04
+#define SAPI_READ_TIMEOUT_MS		30000UL
+
+// Exchanges, POST or PUT {classifier}/<sensor>?xchg, and the longest one
+// may take before it fails with 5.04
+#define SAPI_EXCHANGE_QUERY			"xchg"
+#define SAPI_EXCHANGE_TIMEOUT_MS	10000UL
+
+// SPI flash power. It is begun on first use, woken from deep power-down
+// when it is used, and put back at the end of the sapi_run pass that did.
+#define SAPI_FLASH_OFF				0			// Not begun
+#define SAPI_FLASH_AWAKE			1
+#define SAPI_FLASH_DOWN				2
+
+// Post-mortem records of the crash log, see crash.h, at 0x13000.
+
+// With the fast boot profile there is no countdown for the boot menu. Only
+// a key sent before sapi_run first runs, or this pin held low at reset,
+// opens it. Left undefined only the key does.
+//#define SAPI_BOOT_MENU_PIN		A3
+
+// Periods of the sapi_run tasks, see sched.h. The link and event tasks also
+// run as soon as the UART IRQ has a frame or an interrupt posts an event,
+// the observe task when the next notification is due.
+#define SAPI_BOOT_MS				1000		// Countdown step
+#define SAPI_MENU_MS				10			// Boot menu input
+#define SAPI_LINK_MS				100			// HDLC link and CON timers
+#define SAPI_EVENT_MS				100
+#define SAPI_SENSOR_MS				100			// Reads, samples and the cache
+#define SAPI_LOG_MS					20			// Log drain
+#define SAPI_LOG_OFF_MS				1000		// log_poll, no monitor yet
+
+// Standby between tasks with the fast boot profile, see lpidle.h. The USB
+// console has no clock in standby, so not while it is connected. Set to 0
+// to only idle.
+#ifndef SAPI_STANDBY
+#define SAPI_STANDBY				1
+#endif
+
+// Performance levels on SAML21, see perflvl.h. The clock drops before a
+// wait and a request or notification runs at full speed. Set to 0 to stay
+// at 48 MHz.
+#ifndef SAPI_PERF
+#define SAPI_PERF					1
+#endif
+
+// Budget of each sapi_run task past its deadline, for the watchdog of
+// crash.h. A pass over it doesn't feed the watchdog.
+#define SAPI_TASK_BUDGET_MS			1000
 
 // CoAP Observe Max-Age, see Section 5.10.5 of rfc7252. Default of 90s.
 #define COAP_MSG_MAX_AGE_IN_SECS	90
@@ -160,16 +388,273 @@ typedef struct sensor_reg_info
 	SensorReadFuncPtr		read;					// Sensor Read Function
 	SensorReadCfgFuncPtr	readcfg;				// Sensor Read cfg Function
 	SensorWriteCfgFuncPtr	writecfg;				// Sensor Save cfg Function
+	SensorReadSamplesFuncPtr readsamples;			// Sensor CBOR Samples Read Function, optional
+	SensorReadBlockFuncPtr	readblk;				// Sensor Block2 Read Function, optional
+	SensorWriteBlockFuncPtr	writeblk;				// Sensor Block1 Write Function, optional
+	SensorWriteParamFuncPtr	writeparam;				// Sensor CBOR Parameter Write Function, optional
+	SensorReadQueryFuncPtr	readquery;				// Sensor Query Read Function, optional
+	SensorReadStartFuncPtr	readstart;				// Sensor Read Start Function, optional
+	SensorExchangeFuncPtr	exchange;				// Sensor Exchange Start Function, optional
+	SensorWriteTxtFuncPtr	readtxt;				// Sensor Read in place, optional, for read
+	SensorWriteTxtFuncPtr	readcfgtxt;				// Sensor Read cfg in place, optional, for readcfg
+	uint8_t					sampler;				// Sampler index + 1, 0 -> sampled by the notifications
+	uint8_t					cov;					// Deadband index + 1, 0 -> every notification reported
+	uint32_t				snap_ms;				// Snapshot period, 0 -> read when requested
+	uint32_t				snap_last_ms;			// millis() at the last snapshot
+	uint8_t					cfgtiming;				// 1 -> frequency and sampling follow SendInterval and SampleRate
+	uint32_t				blk1_next;				// Offset of the next Block1 block expected
 	uint32_t				frequency;				// Observation polling frequency (seconds)
 	uint8_t					observer;				// 1 -> observer
 	uint8_t					observer_id;			// Observer Id (valid only if observer == 1)
 } sensor_reg_info_t;
 
 
+/**
+ * @brief Read stats of a sensor since boot, for GET /sys/stats?mod=sens
+ */
+typedef struct sensor_stats
+{
+	uint32_t	reads;							// Reads completed, failed ones too
+	uint32_t	errors;							// Reads that failed
+	uint32_t	timeouts;						// Split-phase reads never completed
+	uint32_t	min_us;							// Quickest read
+	uint32_t	max_us;							// Slowest read
+	uint64_t	total_us;						// All reads, for the mean
+} sensor_stats_t;
+
+
+/**
+ * @brief Sensor read cache, the last GET "sens" payload of a sensor
+ *
+ * Answered from for COAP_MSG_MAX_AGE_IN_SECS after the read. Refreshed from
+ * sapi_run once stale, if it was served since it was read. A read goes to the
+ * back buffer, shared by all sensors, which is then swapped with the payload,
+ * so a reader never sees half a read.
+ */
+typedef struct sensor_cache
+{
+	char		*payload;						// Sensor payload, as read, SAPI_MAX_PAYLOAD_LEN
+	uint8_t		len;							// Payload length
+	uint8_t		valid;							// 1 -> payload holds a good read
+	uint8_t		hit;							// 1 -> served since the read
+	uint8_t		etag[2];						// ETag, changes with the payload
+	uint32_t	read_ms;						// millis() at the read
+} sensor_cache_t;
+
+
+/**
+ * @brief A split-phase read under way, and who waits for it
+ *
+ * A GET waiting for the read got an empty ACK, its token is kept for the
+ * separate response. One GET per sensor, others get 5.03 meanwhile.
+ */
+typedef struct sensor_read_wait
+{
+	uint32_t	start_ms;						// millis() at the read start
+	uint8_t		busy;							// 1 -> read started, not completed
+	uint8_t		obs;							// 1 -> a notification waits for it
+	uint8_t		req;							// 1 -> a GET waits for it
+	uint8_t		con;							// 1 -> that GET was a CON
+	uint8_t		tkl;							// Token length of the GET
+	uint8_t		token[8];						// Token of the GET
+} sensor_read_wait_t;
+
+
+/**
+ * @brief The exchange under way, and the request that waits for it
+ *
+ * The request got an empty ACK, its token is kept for the separate
+ * response. Others get 5.03 meanwhile.
+ */
+typedef struct sensor_exchange_wait
+{
+	uint32_t	start_ms;						// millis() at the start
+	uint8_t		busy;							// 1 -> started, not completed
+	uint8_t		sensor_id;						// Sensor it runs on
+	uint8_t		con;							// 1 -> the request was a CON
+	uint8_t		tkl;							// Token length of the request
+	uint8_t		token[8];						// Token of the request
+} sensor_exchange_wait_t;
+
+
+/**
+ * @brief Sampler of a sensor, apart from its reports
+ *
+ * Reads the samples of the sensor every period_ms into a ring, the oldest
+ * moved to the sample log once full. The observe notification, at the
+ * registered frequency, encodes the ring as CBOR and empties it.
+ */
+typedef struct sensor_sampler
+{
+	uint32_t	period_ms;						// Sample period, 0 -> unused
+	uint32_t	last_ms;						// millis() at the last sample
+	uint16_t	dropped;						// Samples lost, not even in the sample log
+	uint8_t		sensor_id;						// Sensor sampled
+	uint8_t		head;							// Oldest sample
+	uint8_t		count;							// Samples since the last report
+	uint8_t		more;							// 1 -> the last report left samples for the next
+	sapi_sample_t ring[SAPI_SAMPLER_RING];		// The samples, from head
+} sensor_sampler_t;
+
+
+/**
+ * @brief Change-of-value reporting of a sensor
+ *
+ * A notification only goes out once the newest sample moved more than band
+ * from the last one reported, no sooner than min_ms after it. One goes out
+ * max_ms after it whatever the value.
+ */
+typedef struct sensor_cov
+{
+	float		band;							// Deadband, absolute or percent of the last report
+	float		last;							// Value of the last report
+	uint32_t	min_ms;							// Shortest time between reports
+	uint32_t	max_ms;							// Longest time between reports, 0 -> no limit
+	uint32_t	last_ms;						// millis() at the last report
+	uint8_t		percent;						// 1 -> band is a percent
+	uint8_t		reported;						// 1 -> last is valid
+} sensor_cov_t;
+
+
+/**
+ * @brief Threshold alarm on the samples of a datatype
+ *
+ * Checked on each sample the sampler takes. Only a transition, raised or
+ * cleared, is posted as an event.
+ */
+typedef struct sensor_alarm
+{
+	float		limit;							// Value, or change per minute, it raises past
+	float		hyst;							// Back off from limit it clears at
+	float		last;							// Previous value, SAPI_ALARM_RATE
+	uint32_t	last_ms;						// millis() of the previous value
+	uint8_t		kind;							// SAPI_ALARM_*, 0 -> unused
+	uint8_t		sensor_id;						// Sensor sampled
+	uint8_t		datatype;						// Data type checked
+	uint8_t		raised;							// 1 -> raised, not cleared
+	uint8_t		primed;							// 1 -> last is valid
+} sensor_alarm_t;
+
+
+/**
+ * @brief Statistics of the samples of a datatype between notifications
+ *
+ * The samples are counted in steps of the resolution, into the fixed point
+ * accumulator, and the window restarts at each report.
+ */
+typedef struct sensor_summary
+{
+	WindowStatistics stats;
+	float		counts;							// Counts per unit, 1 / resolution
+	uint8_t		sensor_id;						// Sensor sampled
+	uint8_t		datatype;						// Data type summarised
+	uint8_t		out;							// Data type of the mean, 0 -> unused
+} sensor_summary_t;
+
+
+/**
+ * @brief Median window ahead of everything else on the samples of a datatype
+ *
+ * The window holds the raw values, outliers too, as a Hampel filter does.
+ * The newest is tested against the median of the window, the sample is
+ * not held back for the ones after it.
+ */
+typedef struct sensor_prefilter
+{
+	float		win[SAPI_PREFILTER_WINDOW];		// Last raw values, next overwritten first
+	float		k;								// Outlier past k sigmas of the MAD, 0 -> median
+	uint16_t	replaced;						// Samples replaced by the median
+	uint8_t		size;							// Window, 0 -> unused
+	uint8_t		n;								// Values in win
+	uint8_t		next;							// Slot of the next value
+	uint8_t		sensor_id;						// Sensor sampled
+	uint8_t		datatype;						// Data type filtered
+} sensor_prefilter_t;
+
+
+/**
+ * @brief The schema of the samples of a sensor, its Id the crc_xmodem of its document
+ */
+typedef struct sensor_schema
+{
+	sapi_field_t field[SAPI_SCHEMA_FIELDS];		// In the order of the values of a row
+	uint16_t	id;								// crc_xmodem of the encoded fields
+	uint8_t		n;								// Fields, 0 -> unused
+	uint8_t		sensor_id;						// Sensor sampled
+} sensor_schema_t;
+
+
+/**
+ * @brief Where what is kept in the low power SRAM stands, see SAPI_KEEP
+ */
+typedef struct sapi_keep
+{
+	uint16_t	magic;							// SAPI_KEEP_MAGIC
+	uint16_t	crc;							// crc_xmodem of the rest, then of the rings' places
+	uint32_t	seq;							// Sector sequence of the page buffer
+	uint32_t	page;							// Its flash page
+	uint16_t	page_from;						// Its records not programmed, from
+	uint16_t	page_to;						// up to
+} sapi_keep_t;
+
+
+/**
+ * @brief Where sending the sample log stands
+ */
+typedef struct sapi_backlog
+{
+	uint32_t	sent_ms;						// millis() of the last backlog notification
+	uint8_t		sensor;							// Sensor Id + 1 of the notification being built
+	uint8_t		taken;							// Records it takes from the tail
+} sapi_backlog_t;
+
+
+/**
+ * @brief Which records of the sample log go as a min and max per bucket
+ */
+typedef struct sapi_decim
+{
+	uint32_t	bucket_s;						// Bucket, on multiples from the epoch, 0 -> off
+	uint32_t	recent_s;						// Records as recent as this go as they are
+	uint16_t	over;							// Records pending past which it starts
+	uint16_t	left;							// Records it left out, since boot
+} sapi_decim_t;
+
+
+/**
+ * @brief Event posted by sapi_post_event, from an interrupt
+ *
+ * Single producer (the interrupt), single consumer (sapi_run). The producer
+ * only moves the tail and the consumer only the head.
+ */
+typedef struct sensor_event
+{
+	uint32_t	ms;								// millis() when posted
+	float		value;							// Sample value
+	uint8_t		sensor_id;						// Sensor to report
+	uint8_t		datatype;						// Sample data type
+} sensor_event_t;
+
+
+/**
+ * @brief Digital input registered with sapi_register_input
+ *
+ * Written by its interrupt, read by its samples callback.
+ */
+typedef struct sensor_input
+{
+	uint32_t			pin;					// Arduino pin
+	volatile uint32_t	edge_ms;				// millis() at the last transition
+	volatile uint16_t	edges;					// Transitions seen
+	volatile uint8_t	level;					// Level after the last transition
+	uint8_t				sensor_id;				// Sensor reported
+} sensor_input_t;
+
 
 #ifdef SAML21
-#define SER_MON_PTR					&SerialUSB
-#define UART_PTR        			&Serial2
+// The ports of the roles, see variants/ports.h
+#define SER_MON_PTR					&PORT_CONSOLE
+#define UART_PTR        			&PORT_MNIC_UART
 
 #else
 
@@ -222,6 +707,20 @@ typedef struct sensor_reg_info
 #define HDLC_UART_TIMEOUT_IN_MS				2000
 
 
+//////////////////////////////////////////////////////////////////////////
+//
+// The mNIC serial link. The link starts at HDLC_LINK_BAUD and moves to
+// HDLC_LINK_FAST_BAUD once the mNIC connects (SNRM), back on disconnect.
+// The mNIC must be set up for the same fast rate; 0 stays at HDLC_LINK_BAUD.
+// RTS/CTS are optional GPIO flow control pins, HDLC_LINK_NO_PIN if not wired.
+//
+//////////////////////////////////////////////////////////////////////////
+#define HDLC_LINK_BAUD						38400
+#define HDLC_LINK_FAST_BAUD					0
+#define HDLC_LINK_PIN_RTS					HDLC_LINK_NO_PIN
+#define HDLC_LINK_PIN_CTS					HDLC_LINK_NO_PIN
+
+
 //////////////////////////////////////////////////////////////////////////
 //
 // The largest HDLC payload size. Maximum payload length in the MilliShield is 255
@@ -0,0 +1,178 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+/*
+ * Blocks of samples, delta coded, for the sample history on the wire.
+ *
+ * Samples of one datatype in a row go as a block: the first one whole in
+ * its header, then for each of the others its time and value less those of
+ * the one before, zigzag varints, mostly a byte each. A CRC ends the block,
+ * so blocks stand on their own and go out as they are, back to back in a
+ * CBOR byte string, with no re-encode between where they are kept and the
+ * wire. All multi-byte fields are big endian:
+ *
+ *   len      1   Bytes in the block, its CRC too
+ *   count    1   Samples in it
+ *   datatype 1
+ *   flags    1   Decimals of the values in the low nibble, SBLK_MS
+ *   epoch    4   Of the first sample
+ *   value    4   Of the first sample, times 10^decimals, signed
+ *   ms       2   Of the first sample, only with SBLK_MS
+ *   deltas       Per sample after the first: its time, in seconds or with
+ *                SBLK_MS in ms, then its value, both zigzag LEB128
+ *   crc      2   crc_xmodem of the bytes before it
+ *
+ * A value that doesn't fit in 32 bits at its decimals, NaN or infinite,
+ * can not go in a block.
+ *
+ * Rows of several datatypes sampled together go as a columnar block,
+ * SBLK_COLS in flags: the times once, then a column per datatype, each
+ * delta coded on its own so a slow level and a busy flow don't spoil each
+ * other's deltas. The length, count and flags are where they are in the
+ * block above, so the two kinds go back to back, told apart by flags:
+ *
+ *   len      1   Bytes in the block, its CRC too
+ *   count    1   Rows in it
+ *   cols     1   Columns, up to SBLK_COLS_MAX
+ *   flags    1   As above, SBLK_COLS set
+ *   epoch    4   Of the first row
+ *   ms       2   Of the first row, only with SBLK_MS
+ *   times        Per row after the first, its time less the one before
+ *   columns      Per column: its datatype, 1, the value of the first row,
+ *                4, then per row after the first its value less the one
+ *                before
+ *   crc      2   crc_xmodem of the bytes before it
+ */
+
+#ifndef _SBLK_H_
+#define _SBLK_H_
+
+#include <stdint.h>
+
+#define SBLK_MAX_LEN        255
+#define SBLK_HDR_LEN        12      /* 2 more with SBLK_MS */
+#define SBLK_CRC_LEN        2
+#define SBLK_DECIMALS_MAX   6
+#define SBLK_COLS_HDR_LEN   8       /* 2 more with SBLK_MS */
+#define SBLK_COLS_MAX       8
+
+/* flags */
+#define SBLK_DECIMALS       0x0F
+#define SBLK_MS             0x10    /* Times carry ms */
+#define SBLK_COLS           0x20    /* Rows of columns, see above */
+
+/* A block being written */
+struct sblk {
+    uint8_t *buf;
+    uint8_t size;           /* Room for it, at most SBLK_MAX_LEN */
+    uint8_t len;            /* So far, without the CRC */
+    uint8_t count;
+    uint8_t flags;
+    uint32_t epoch;         /* The sample before */
+    uint16_t ms;
+    int32_t value;
+};
+
+/* A block being read */
+struct sblk_rd {
+    const uint8_t *next;
+    const uint8_t *end;     /* Its CRC */
+    uint8_t left;           /* Samples not read */
+    uint8_t datatype;
+    uint8_t flags;
+    uint8_t started;        /* The first sample was read */
+    uint32_t epoch;         /* The sample before */
+    uint16_t ms;
+    int32_t value;
+};
+
+/* A columnar block being read */
+struct sblk_cols_rd {
+    const uint8_t *times;   /* Time deltas not read */
+    const uint8_t *col[SBLK_COLS_MAX];  /* Value deltas of each column not read */
+    const uint8_t *end;     /* Its CRC */
+    uint8_t left;           /* Rows not read */
+    uint8_t cols;
+    uint8_t flags;
+    uint8_t started;        /* The first row was read */
+    uint8_t datatype[SBLK_COLS_MAX];
+    uint32_t epoch;         /* The row before */
+    uint16_t ms;
+    int32_t value[SBLK_COLS_MAX];
+};
+
+/*
+ * Start a block in buf, size bytes, with its first sample. ms is only
+ * kept with SBLK_MS in flags, decimals are those of flags.
+ * Returns 0, -1 if it doesn't fit or the value can't go in a block.
+ */
+int sblk_start(struct sblk *b, uint8_t *buf, uint16_t size, uint8_t datatype, uint8_t flags,
+               uint32_t epoch, uint16_t ms, float value);
+
+/*
+ * Add a sample to the block. Returns 0, -1 if it is full, the sample is too
+ * far from the one before or can't go in a block, and nothing was added.
+ */
+int sblk_add(struct sblk *b, uint32_t epoch, uint16_t ms, float value);
+
+/* End the block with its count, length and CRC. Returns its length. */
+uint8_t sblk_end(struct sblk *b);
+
+/*
+ * Start reading the block at blk, of len bytes or more.
+ * Returns its length, -1 if it is short or its CRC is wrong.
+ */
+int sblk_rd_init(struct sblk_rd *rd, const uint8_t *blk, uint16_t len);
+
+/* The next sample of the block. Returns 1, 0 past the last, -1 if bad. */
+int sblk_rd_next(struct sblk_rd *rd, uint32_t *epoch, uint16_t *ms, float *value);
+
+/*
+ * Write rows of cols values in a columnar block in buf, size bytes, the
+ * values row by row, those of row r at values[r * cols]. ms are only kept
+ * with SBLK_MS in flags, and may be NULL without. Returns its length, -1
+ * if it doesn't fit, the rows are too far apart or a value can't go in a
+ * block.
+ */
+int sblk_cols(uint8_t *buf, uint16_t size, uint8_t flags, const uint32_t *epoch, const uint16_t *ms,
+              uint8_t rows, const uint8_t *datatype, const float *values, uint8_t cols);
+
+/*
+ * Start reading the columnar block at blk, of len bytes or more.
+ * Returns its length, -1 if it is short, its CRC is wrong or it is not one.
+ */
+int sblk_cols_rd_init(struct sblk_cols_rd *rd, const uint8_t *blk, uint16_t len);
+
+/* The next row of the block, a value per column. Returns 1, 0 past the last, -1 if bad. */
+int sblk_cols_rd_next(struct sblk_cols_rd *rd, uint32_t *epoch, uint16_t *ms, float *values);
+
+#endif /* _SBLK_H_ */
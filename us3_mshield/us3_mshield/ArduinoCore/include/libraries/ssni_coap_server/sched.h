@@ -0,0 +1,142 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+/*
+ * Cooperative task scheduler of the main loop.
+ *
+ * A task is a function run from thread mode when it comes due, to the
+ * end, so one task never waits on another. Armed tasks sit in a min-heap
+ * by deadline and sched_run runs those due, earliest first, each at most
+ * once a pass. A task with a period is armed again for its next one
+ * before it runs, a task may also arm itself or another with sched_at or
+ * sched_within. An interrupt hands work to a task with sched_kick, which
+ * runs it on the next pass whatever its deadline.
+ *
+ * Deadlines are millis(), compared so they survive its wrap. Between
+ * passes sched_idle parks the core until the next interrupt unless a task
+ * is due, or hands a longer wait to a sleep hook, see sched_sleep. A
+ * slow hook, see sched_slow, may drop the clock before a long wait.
+ *
+ * A task given a budget is supervised: a run later than that past its
+ * deadline is a miss. With a watchdog hook, see sched_watchdog, a pass
+ * feeds the watchdog only when it had no miss and no supervised task is
+ * left overdue, so a task that never returns, or one that holds up the
+ * others for long, ends in a watchdog reset.
+ */
+
+#ifndef _SCHED_H_
+#define _SCHED_H_
+
+#include <Arduino.h>
+
+#ifndef SCHED_MAX_TASKS
+#define SCHED_MAX_TASKS         14
+#endif
+
+/* sched_wait_ms with no task armed or kicked */
+#define SCHED_NEVER             0xffffffffUL
+
+struct sched_task;
+typedef void (*sched_fn)(struct sched_task *t);
+typedef void (*sched_sleep_fn)(uint32_t wait_ms);
+typedef void (*sched_feed_fn)(void);
+
+/* A task, set up by sched_add and left alone after */
+struct sched_task {
+    const char *name;
+    sched_fn run;
+    uint32_t period_ms;         /* 0 to run when armed or kicked only */
+    uint32_t due_ms;
+    int8_t slot;                /* in the heap, -1 when not armed */
+    uint8_t pass;               /* of its last run */
+    volatile uint8_t kicked;
+    uint32_t runs;
+    uint32_t max_us;            /* longest run */
+    uint32_t budget_ms;         /* longest it may run past its deadline, 0 unsupervised */
+    uint32_t late_ms;           /* latest it ran past its deadline */
+    uint32_t misses;            /* runs later than budget_ms */
+};
+
+/*
+ * Add task t, at most SCHED_MAX_TASKS of them. One with a period is armed
+ * to run right away, then every period_ms. Returns -1 if the table is full.
+ */
+int sched_add(struct sched_task *t, const char *name, sched_fn run, uint32_t period_ms);
+
+/* Arm t to run in ms, moving its deadline if it already had one */
+void sched_at(struct sched_task *t, uint32_t ms);
+
+/* Arm t to run in ms at the latest, a deadline already sooner is kept */
+void sched_within(struct sched_task *t, uint32_t ms);
+
+/* Supervise t, a run more than budget_ms past its deadline is a miss */
+void sched_budget(struct sched_task *t, uint32_t budget_ms);
+
+/* Take t out of the heap, a period is not resumed until it is armed */
+void sched_stop(struct sched_task *t);
+
+/* Run t on the next pass. Safe from an interrupt. */
+void sched_kick(struct sched_task *t);
+
+/* Run the kicked tasks, then the due ones. Call from loop(). */
+void sched_run(void);
+
+/* Ms until the next task is due, 0 if one is, SCHED_NEVER if none is armed */
+uint32_t sched_wait_ms(void);
+
+/* Sleep until the next interrupt, unless a task is due or kicked */
+void sched_idle(void);
+
+/*
+ * Have sched_idle call sleep instead, with interrupts off, when no task is
+ * due within min_ms. It returns after a wake, with them still off.
+ */
+void sched_sleep(sched_sleep_fn sleep, uint32_t min_ms);
+
+/*
+ * Have sched_idle call slow first, with interrupts off, when no task is
+ * due within min_ms, to wait on a slower clock.
+ */
+void sched_slow(sched_sleep_fn slow, uint32_t min_ms);
+
+/*
+ * Have sched_run call feed after a pass with no miss and nothing overdue,
+ * and sched_idle wake at least every max_wait_ms for that.
+ */
+void sched_watchdog(sched_feed_fn feed, uint32_t max_wait_ms);
+
+/* Task i in the order added, NULL past the last, for the stats */
+const struct sched_task *sched_get(uint8_t i);
+
+/* Print the tasks, their deadlines, longest runs and misses on the console */
+void sched_dump(void);
+
+#endif /* _SCHED_H_ */
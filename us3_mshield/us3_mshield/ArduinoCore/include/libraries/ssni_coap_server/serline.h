@@ -0,0 +1,152 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+/*
+ * Line-oriented driver for RS232 instruments.
+ *
+ * An instrument is asked with a text command and answers with a line.
+ * Requests are queued and run one at a time by ser_line_poll() from the
+ * main loop, in the way of the Modbus master, with the UART IRQ taking
+ * the reply into a line buffer as it comes. The command goes out with
+ * the line's eol after it. The reply ends at any of the line's terminator
+ * characters, empty lines are skipped, or with no terminators at gap_ms
+ * of silence. A reply that does not start within the timeout fails.
+ *
+ * A raw request, one with cmd_len set, is for devices that do not talk in
+ * lines: its cmd_len bytes go out as they are, without the eol, and every
+ * byte of the reply goes straight into buf, its own term byte included.
+ * The reply ends at that byte or at gap_ms of silence, both are fine.
+ *
+ * ser_query() queues a request and polls until it is done, for callers
+ * that can wait.
+ */
+
+#ifndef _SERLINE_H_
+#define _SERLINE_H_
+
+#include <Arduino.h>
+
+/* Longest reply line, the terminator is not kept */
+#ifndef SER_LINE_MAX
+#define SER_LINE_MAX            80
+#endif
+
+/* Reply timeout, from the command sent to the first byte */
+#define SER_LINE_TIMEOUT_MS     500
+
+/* Silence that ends a reply, or breaks one without its terminator */
+#define SER_LINE_GAP_MS         50
+
+/* Results, as the Modbus master's */
+#define SER_OK                  0
+#define SER_ERR_TIMEOUT         -1  /* no reply */
+#define SER_ERR_OVERFLOW        -2  /* reply longer than the line or buf, cut */
+#define SER_ERR_FRAME           -3  /* reply broken off before its terminator */
+#define SER_ERR_ARG             -4  /* request is not valid */
+#define SER_ERR_BUSY            -5  /* request already queued */
+
+/* term of a raw request that ends at gap_ms only */
+#define SER_TERM_NONE           -1
+
+struct ser_req;
+typedef void (*ser_done_fn)(struct ser_req *req);
+
+/*
+ * A transaction, cmd out and the reply line into buf, NUL terminated, or
+ * for a raw one the reply bytes as they came, not terminated. The request
+ * and buf belong to the driver until done is called with rc set. What was
+ * taken is in buf whatever rc.
+ */
+struct ser_req {
+    struct ser_req *next;
+    const char *cmd;
+    char *buf;
+    uint16_t size;              /* of buf, the NUL included for a line */
+    uint16_t len;               /* reply length */
+    ser_done_fn done;           /* from ser_line_poll, may be NULL */
+    void *arg;
+    int rc;
+    volatile uint8_t busy;
+    uint16_t timeout_ms;        /* reply timeout, 0 for the line's */
+    uint16_t cmd_len;           /* raw: bytes of cmd, 0 for a text line */
+    int16_t term;               /* raw: byte that ends the reply, or SER_TERM_NONE */
+};
+
+/* Transaction states */
+#define SER_STATE_IDLE          0   /* waiting for a request */
+#define SER_STATE_RX            1   /* command sent, taking the reply */
+
+struct ser_line {
+    Uart *port;
+    const char *eol;            /* sent after each command, may be "" */
+    const char *term;           /* characters that end a reply, "" for gap_ms */
+    uint16_t timeout_ms;
+    uint16_t gap_ms;
+    struct ser_req *head;       /* queue, head is the one running */
+    struct ser_req *tail;
+    uint32_t tx_ms;             /* millis() the command went out */
+
+    /* shared with the UART IRQ */
+    volatile uint8_t state;
+    volatile uint8_t rx_done;   /* terminator seen */
+    volatile uint16_t rx_len;   /* bytes of the line, past the buffer too */
+    volatile uint32_t rx_ms;    /* millis() of the last reply byte */
+    volatile uint32_t rx_us;    /* micros() of the first, for the trace */
+    volatile uint8_t rx_raw;    /* the running request is raw */
+    volatile int16_t rx_term;   /* its term */
+    char line[SER_LINE_MAX];
+
+    uint32_t lines;             /* replies taken */
+    uint32_t timeouts;
+    uint32_t errors;            /* cut or broken off */
+};
+
+/*
+ * Begin port at baud and config (SERIAL_8N1 ...) and set up the line on
+ * it, eol and term as above, both kept by pointer. There is one line, it
+ * owns the port's receive callback, so the port can not also carry a
+ * Modbus master or slave.
+ */
+void ser_line_init(struct ser_line *ln, Uart *port, uint32_t baud, uint16_t config,
+                   const char *eol, const char *term);
+
+/* Queue a request. SER_ERR_ARG if it can not be sent, SER_ERR_BUSY if queued. */
+int ser_line_submit(struct ser_line *ln, struct ser_req *req);
+
+/* Advance the running transaction. Call from the main loop, often. */
+void ser_line_poll(struct ser_line *ln);
+
+/* Non-zero while a request is queued or running */
+uint8_t ser_line_busy(struct ser_line *ln);
+
+/* Send cmd and take the reply line into buf, waits */
+int ser_query(struct ser_line *ln, const char *cmd, char *buf, uint16_t size);
+
+#endif /* _SERLINE_H_ */
@@ -0,0 +1,116 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+/*
+ * ASCII field map, for the records RS232 instruments answer with.
+ *
+ * An instrument's record, "12.34,m,0.56,m3/h" for example, is described
+ * by a const table of fields, one per value, as a Modbus device is by its
+ * register map: which field of the record it is, how many decimals are
+ * kept, scale and offset, and how it is published. The line is split in
+ * place and each number parsed as fixed point, nothing is allocated and
+ * there is no String, sscanf or atof. The values go to a record that
+ * keeps when each was taken and its quality, MB_Q_* as a register image,
+ * and channels read them from there.
+ */
+
+#ifndef _SERMAP_H_
+#define _SERMAP_H_
+
+#include "mbimage.h"
+
+/* Most fields of a record, the ones past them are not looked at */
+#define SER_MAP_MAX_FIELDS      16
+
+/* Most decimals a field may keep */
+#define SER_MAX_DECIMALS        6
+
+/* A field of the line, not NUL terminated */
+struct ser_span {
+    const char *p;
+    uint8_t len;
+};
+
+struct ser_field {
+    const char *name;
+    uint8_t index;              /* field of the record, from 0 */
+    uint8_t decimals;           /* kept, the next one rounds */
+    float scale;                /* value = number * scale + offset */
+    float offset;
+    uint8_t datatype;           /* sample datatype, 0 if not published */
+    const char *unit;
+};
+
+/* The values of a map, from the last record parsed */
+struct ser_record {
+    const struct ser_field *map;
+    uint8_t n;
+    float *value;               /* n of each */
+    uint32_t *stamp_ms;
+    uint8_t *quality;
+    uint32_t max_age_ms;        /* older reads as stale, 0 for never */
+};
+
+/*
+ * Split len characters of line at sep into at most max fields, spaces
+ * around them trimmed. A space sep also takes runs of spaces and tabs as
+ * one. Returns the fields set in span.
+ */
+uint8_t ser_split(const char *line, uint16_t len, char sep,
+                  struct ser_span *span, uint8_t max);
+
+/*
+ * Parse a decimal number, [+-]digits[.digits], at the start of len
+ * characters, into *v scaled by 10^decimals. What follows it, a unit for
+ * example, is left. Returns the characters taken, 0 if there is no
+ * number or it does not fit *v.
+ */
+uint8_t ser_parse_fixed(const char *p, uint8_t len, uint8_t decimals, int32_t *v);
+
+/* A record of the n fields of map, in the arrays given, never parsed */
+void ser_record_init(struct ser_record *rec, const struct ser_field *map,
+                     uint8_t n, float *value, uint32_t *stamp_ms,
+                     uint8_t *quality, uint32_t max_age_ms);
+
+/*
+ * Parse len characters of line, fields at sep, into the record. A field
+ * that is missing or not a number goes stale and keeps its value. Returns
+ * the fields taken.
+ */
+uint8_t ser_record_parse(struct ser_record *rec, const char *line, uint16_t len, char sep);
+
+/* Mark the record stale, for a query that failed. The values are kept. */
+void ser_record_fail(struct ser_record *rec);
+
+/* A field's value from the record, returns its quality as mb_image_read */
+uint8_t ser_field_read(const struct ser_field *f, const struct ser_record *rec,
+                       float *value, uint32_t *age_ms);
+
+#endif /* _SERMAP_H_ */
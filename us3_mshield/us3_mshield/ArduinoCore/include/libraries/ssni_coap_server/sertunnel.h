@@ -0,0 +1,108 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+/*
+ * RS232 tunnel, exchanges from the head-end passed through to a device
+ * the firmware does not know.
+ *
+ * A CBOR array of exchanges, [[payload, term, timeout_ms], ...], taken
+ * apart into a tunnel and run as raw requests of the line one after the
+ * other, between its own. The payload, a byte or text string, goes out as
+ * it is. The answer is the bytes that came back up to the term byte, kept,
+ * or up to the line's gap_ms of silence when term is negative. timeout_ms
+ * is the wait for its first byte, 0 for the line's. The answers go back as
+ * one CBOR array in the same order: a byte string for each exchange that
+ * went through, its SER_ERR_ for one that did not.
+ */
+
+#ifndef _SERTUNNEL_H_
+#define _SERTUNNEL_H_
+
+#include "serline.h"
+
+/* Exchanges in a tunnel, and the bytes of all of them together each way */
+#ifndef SER_TUNNEL_MAX
+#define SER_TUNNEL_MAX          4
+#endif
+#ifndef SER_TUNNEL_TX_MAX
+#define SER_TUNNEL_TX_MAX       128
+#endif
+#ifndef SER_TUNNEL_RX_MAX
+#define SER_TUNNEL_RX_MAX       192     /* their answer fits SAPI_MAX_PAYLOAD_LEN */
+#endif
+
+/* Longest payload, written without waiting as it fits the TX ring, and the longest wait */
+#define SER_TUNNEL_CMD_MAX      64
+#define SER_TUNNEL_TIMEOUT_MAX  2000
+
+struct ser_tunnel_op {
+    uint16_t off;               /* its payload in tx */
+    uint16_t len;
+    int16_t term;
+    uint16_t timeout_ms;
+    uint16_t rx_off;            /* its answer in rx */
+    uint16_t rx_len;
+    int rc;
+};
+
+struct ser_tunnel;
+typedef void (*ser_tunnel_fn)(struct ser_tunnel *t);
+
+struct ser_tunnel {
+    struct ser_line *ln;
+    struct ser_tunnel_op op[SER_TUNNEL_MAX];
+    uint8_t n;
+    uint8_t step;
+    uint8_t tx[SER_TUNNEL_TX_MAX];
+    uint8_t rx[SER_TUNNEL_RX_MAX];
+    uint16_t rx_used;
+    struct ser_req req;
+    ser_tunnel_fn done;         /* from ser_line_poll, may be NULL */
+    void *arg;
+    volatile uint8_t busy;
+};
+
+/*
+ * Take the exchanges of the CBOR array in buf into t. Returns how many,
+ * or SER_ERR_ARG if the array is malformed, an exchange is not valid or
+ * they do not fit. SER_ERR_BUSY while t runs.
+ */
+int ser_tunnel_parse(struct ser_tunnel *t, const uint8_t *buf, int len);
+
+/*
+ * Queue the exchanges of t on ln, one at a time. done is called once the
+ * last is done, each with its rc set.
+ */
+int ser_tunnel_start(struct ser_line *ln, struct ser_tunnel *t, ser_tunnel_fn done);
+
+/* Encode the answers of t into buf. Returns the length, SER_ERR_ARG if it does not fit. */
+int ser_tunnel_encode(const struct ser_tunnel *t, uint8_t *buf, int len);
+
+#endif /* _SERTUNNEL_H_ */
@@ -0,0 +1,66 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+/*
+ * SHA-256 and HMAC-SHA256, FIPS 180-4 and RFC 2104, for the MACs of the
+ * firmware images. Fed block by block, in software, data of any length.
+ */
+
+#ifndef _SHA256_H_
+#define _SHA256_H_
+
+#include <stdint.h>
+
+#define SHA256_SIZE             32          /* Digest bytes */
+#define SHA256_BLOCK            64
+
+struct sha256 {
+    uint32_t h[8];
+    uint32_t len;               /* Bytes so far, up to 4 GB */
+    uint8_t buf[SHA256_BLOCK];  /* The block not yet full */
+};
+
+struct hmac_sha256 {
+    struct sha256 inner;
+    struct sha256 outer;        /* Already fed the key ^ opad */
+};
+
+void sha256_init(struct sha256 *s);
+void sha256_update(struct sha256 *s, const void *data, uint32_t len);
+void sha256_final(struct sha256 *s, uint8_t digest[SHA256_SIZE]);
+
+/* A key longer than a block is hashed first */
+void hmac_sha256_init(struct hmac_sha256 *h, const uint8_t *key, uint32_t len);
+void hmac_sha256_update(struct hmac_sha256 *h, const void *data, uint32_t len);
+void hmac_sha256_final(struct hmac_sha256 *h, uint8_t mac[SHA256_SIZE]);
+
+#endif /* _SHA256_H_ */
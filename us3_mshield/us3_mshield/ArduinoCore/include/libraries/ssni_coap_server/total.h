@@ -0,0 +1,91 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+/*
+ * Integrals of sampled values, see sapi_set_total.
+ *
+ * Up to TOTAL_MAX totals, each of a sensor and datatype, summed by
+ * trapezoids at each sample the sampler takes. Saved in a log sector of the
+ * SPI flash, a record at a time, when changed and no more often than
+ * TOTAL_SAVE_MS, the last of a total counts. Once the log is full it is
+ * erased and the totals written at its start. Totals are kept by the order
+ * they are set in.
+ */
+
+#ifndef _TOTAL_H_
+#define _TOTAL_H_
+
+#include <stdint.h>
+#include "sapi.h"
+
+#define TOTAL_MAX               4
+#define TOTAL_SAVE_MS           900000UL
+#define TOTAL_LOG_ADDR          0x12000UL
+#define TOTAL_LOG_SIZE          4096
+#define TOTAL_REC_MARK          0x54        /* "T" */
+
+/* A total, reported with each notification of its sensor */
+struct total {
+    double total;               /* Integral, in the reported unit */
+    float scale;                /* Factor from value * seconds */
+    float last;                 /* Previous value */
+    uint32_t last_ms;           /* millis() of the previous value */
+    uint32_t saved_ms;          /* millis() at the last save */
+    uint8_t sensor_id;          /* Sensor sampled */
+    uint8_t datatype;           /* Data type integrated */
+    uint8_t out;                /* Data type reported, 0 -> unused */
+    uint8_t primed;             /* 1 -> last is valid */
+    uint8_t dirty;              /* 1 -> changed since the last save */
+};
+
+/* The totals, by the order set. Only total.cpp changes them. */
+extern struct total totals[TOTAL_MAX];
+
+/* Forget the totals set */
+void total_init(void);
+
+/* Integrate the samples of a sensor's datatype into a total reported as
+ * out, resumed from its last save. SAPI_ERR_NO_MEM without a free total. */
+sapi_error_t total_set(uint8_t sensor_id, uint8_t datatype, uint8_t out, float scale);
+
+/* Restart the total of a sensor reported as out from 0, saved at once.
+ * SAPI_ERR_NO_ENTRY if there is none, SAPI_ERR_FAIL if it was not saved. */
+sapi_error_t total_reset(uint8_t sensor_id, uint8_t out);
+
+/* Add a sample at now_ms to the totals on its datatype, the trapezoid since
+ * the previous one */
+void total_add(uint8_t sensor_id, const sapi_sample_t *sample, uint32_t now_ms);
+
+/* Save the totals changed, TOTAL_SAVE_MS after their last save */
+void total_poll(void);
+
+#endif /* _TOTAL_H_ */
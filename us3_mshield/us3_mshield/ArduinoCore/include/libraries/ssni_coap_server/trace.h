@@ -0,0 +1,98 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+/*
+ * Protocol trace of the serial ports.
+ *
+ * Frames in and out of the mNIC HDLC link, the RS485 Modbus master and
+ * the RS232 line driver go as records into one RAM ring of TRACE_SIZE
+ * bytes, the oldest make room for new ones. A record is:
+ *
+ *   head       port, TRACE_TX for a frame sent, TRACE_ERR for one that
+ *              failed, a CRC error or a timeout
+ *   kept       bytes of the frame kept, up to TRACE_KEEP
+ *   len        length of the frame, 2 bytes
+ *   us         micros(), 4 bytes: the start of a frame sent, the first
+ *              byte of a reply, the closing flag of an HDLC frame
+ *   data       the first kept bytes of the frame
+ *
+ * Values are little endian. A timeout is a reply of length 0. Records are
+ * added from thread mode only. Left out unless TRACE is 1.
+ */
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <Arduino.h>
+
+#ifndef TRACE
+#define TRACE                   1
+#endif
+#define TRACE_SIZE              512
+#define TRACE_KEEP              32
+#define TRACE_HDR               8
+
+#define TRACE_HDLC              0
+#define TRACE_RS485             1
+#define TRACE_RS232             2
+#define TRACE_PORT_MASK         0x0f
+#define TRACE_ERR               0x40
+#define TRACE_TX                0x80
+
+#if TRACE
+/*
+ * Add a frame of len bytes, in two parts, hdr then data, either may be
+ * NULL. head is the port and flags, us when it was on the wire.
+ */
+void trace_frame(uint8_t head, uint32_t us, const uint8_t *hdr, uint16_t hdrlen,
+                 const uint8_t *data, uint16_t len);
+
+/* Records in the ring */
+int trace_count(void);
+
+/*
+ * Copy record n, 0 the oldest, into buf. Returns its size, TRACE_HDR and
+ * its kept bytes, 0 past the last one.
+ */
+int trace_get(int n, uint8_t *buf);
+
+/* Drop all the records */
+void trace_clear(void);
+
+/* Print the records on the console, oldest first, the data in hex */
+void trace_dump(void);
+
+#define TRACE_FRAME(head, us, hdr, hdrlen, data, len) \
+    trace_frame((head), (us), (hdr), (hdrlen), (data), (len))
+#else
+#define TRACE_FRAME(head, us, hdr, hdrlen, data, len)
+#endif
+
+#endif /* _TRACE_H_ */
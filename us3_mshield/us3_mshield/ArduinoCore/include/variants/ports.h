@@ -0,0 +1,246 @@
+/*
+ * Serial port roles, the one place the UARTs of this board are handed out.
+ *
+ * Each role (mNIC, RS485 and a second RS485, RS232, GPS, console) is given
+ * a SerialN, and with it that UART's SERCOM, and its baud, format, ring
+ * buffer sizes and DMA use.
+ * The drivers take their port as PORT_<role>_UART and the rings of
+ * variant.cpp are sized from here, for the traffic of the role on them.
+ * Two roles on one UART, a UART on the SERCOM of the SPI flash, or two
+ * roles on the one UART DMA channel do not build. Included by variant.h,
+ * after the SERCOMs of the UARTs and the SPI.
+ */
+
+#ifndef _VARIANT_PORTS_H_
+#define _VARIANT_PORTS_H_
+
+// A role with no UART
+#define PORT_NONE                 0
+
+// mNIC, HDLC. A frame is a header, a 255 byte payload and the FCS, TX goes
+// by DMA and RX is deframed from the IRQ once HDLC is up. The baud is the
+// link's own, HDLC_LINK_BAUD and HDLC_LINK_FAST_BAUD.
+#define PORT_MNIC_SERIAL          2
+#define PORT_MNIC_RX_SIZE         (256)
+#define PORT_MNIC_TX_SIZE         (512)
+#define PORT_MNIC_DMA             1
+
+// RS485 Modbus master. The replies are taken by the IRQ, the ring only
+// holds what arrives while the sketch sits in delay().
+#define PORT_RS485_SERIAL         3
+#define PORT_RS485_BAUD           9600
+#define PORT_RS485_CONFIG         SERIAL_8N2
+#define PORT_RS485_RX_SIZE        (256)
+#define PORT_RS485_TX_SIZE        (64)
+#define PORT_RS485_DMA            0
+
+// Second RS485 bus, polled by a master of its own beside the first. No UART
+// is left for it on this board, give it Serial1 in place of RS232 where a
+// second transceiver is fitted.
+#define PORT_RS485B_SERIAL        PORT_NONE
+#define PORT_RS485B_BAUD          PORT_RS485_BAUD
+#define PORT_RS485B_CONFIG        PORT_RS485_CONFIG
+#define PORT_RS485B_RX_SIZE       PORT_RS485_RX_SIZE
+#define PORT_RS485B_TX_SIZE       PORT_RS485_TX_SIZE
+#define PORT_RS485B_DMA           0
+
+// RS232 instrument, or the local Modbus slave with TEMP_LOCAL_SLAVE. Short
+// lines both ways, TX holds a whole tunnelled payload, SER_TUNNEL_CMD_MAX.
+// Serial1, D0 and D1 on SERCOM4, the one UART the mNIC and RS485 leave.
+#define PORT_RS232_SERIAL         1
+#define PORT_RS232_BAUD           9600
+#define PORT_RS232_CONFIG         SERIAL_8N1
+#define PORT_RS232_RX_SIZE        (64)
+#define PORT_RS232_TX_SIZE        (64)
+#define PORT_RS232_DMA            0
+
+// GPS receiver, NMEA in. Each byte is parsed by nmea.h from the IRQ, the
+// ring is not used, TX only takes the receiver's set-up commands.
+#define PORT_GPS_SERIAL           PORT_NONE
+#define PORT_GPS_BAUD             9600
+#define PORT_GPS_CONFIG           SERIAL_8N1
+#define PORT_GPS_RX_SIZE          (16)
+#define PORT_GPS_TX_SIZE          (64)
+
+// Console, the USB CDC, no SERCOM
+#define PORT_CONSOLE              SerialUSB
+
+// Rings of a UART with no role
+#define PORT_IDLE_RX_SIZE         (16)
+#define PORT_IDLE_TX_SIZE         (16)
+
+#define PORT_UART_(n)             Serial##n
+#define PORT_UART(n)              PORT_UART_(n)
+#define PORT_MNIC_UART            PORT_UART(PORT_MNIC_SERIAL)
+#define PORT_RS485_UART           PORT_UART(PORT_RS485_SERIAL)
+#define PORT_RS485B_UART          PORT_UART(PORT_RS485B_SERIAL)
+#define PORT_RS232_UART           PORT_UART(PORT_RS232_SERIAL)
+#define PORT_GPS_UART             PORT_UART(PORT_GPS_SERIAL)
+
+#define PORT_SERCOM_(n)           SERIAL##n##_SERCOM
+#define PORT_SERCOM(n)            PORT_SERCOM_(n)
+
+
+/*
+ * Conflicts
+ */
+#if (PORT_MNIC_SERIAL == PORT_NONE)
+  #error "ports.h: the mNIC needs a UART"
+#endif
+#if (PORT_MNIC_SERIAL == PORT_RS485_SERIAL) || (PORT_MNIC_SERIAL == PORT_RS485B_SERIAL) || \
+    (PORT_MNIC_SERIAL == PORT_RS232_SERIAL) || (PORT_MNIC_SERIAL == PORT_GPS_SERIAL)
+  #error "ports.h: the mNIC shares its UART with another role"
+#endif
+#if (PORT_RS485_SERIAL != PORT_NONE) && (PORT_RS485_SERIAL == PORT_RS232_SERIAL)
+  #error "ports.h: RS485 and RS232 share a UART"
+#endif
+#if (PORT_RS485B_SERIAL != PORT_NONE) && \
+    ((PORT_RS485B_SERIAL == PORT_RS485_SERIAL) || (PORT_RS485B_SERIAL == PORT_RS232_SERIAL))
+  #error "ports.h: the second RS485 bus shares its UART with another role"
+#endif
+#if (PORT_GPS_SERIAL != PORT_NONE) && \
+    ((PORT_GPS_SERIAL == PORT_RS485_SERIAL) || (PORT_GPS_SERIAL == PORT_RS485B_SERIAL) || \
+     (PORT_GPS_SERIAL == PORT_RS232_SERIAL))
+  #error "ports.h: the GPS shares its UART with another role"
+#endif
+
+#if (PORT_SERCOM(PORT_MNIC_SERIAL) == SPI_SERCOM)
+  #error "ports.h: the mNIC UART is on the SPI SERCOM"
+#endif
+#if (PORT_RS485_SERIAL != PORT_NONE) && (PORT_SERCOM(PORT_RS485_SERIAL) == SPI_SERCOM)
+  #error "ports.h: the RS485 UART is on the SPI SERCOM"
+#endif
+#if (PORT_RS485B_SERIAL != PORT_NONE) && (PORT_SERCOM(PORT_RS485B_SERIAL) == SPI_SERCOM)
+  #error "ports.h: the second RS485 UART is on the SPI SERCOM"
+#endif
+#if (PORT_RS232_SERIAL != PORT_NONE) && (PORT_SERCOM(PORT_RS232_SERIAL) == SPI_SERCOM)
+  #error "ports.h: the RS232 UART is on the SPI SERCOM"
+#endif
+#if (PORT_GPS_SERIAL != PORT_NONE) && (PORT_SERCOM(PORT_GPS_SERIAL) == SPI_SERCOM)
+  #error "ports.h: the GPS UART is on the SPI SERCOM"
+#endif
+
+// Uart has one DMA channel, UART_DMA_CHANNEL
+#if (PORT_MNIC_DMA + PORT_RS485_DMA + PORT_RS485B_DMA + PORT_RS232_DMA) > 1
+  #error "ports.h: more than one role on the UART DMA channel"
+#endif
+
+#define PORT_POW2(n)              ((n) && !((n) & ((n) - 1)))
+#if !PORT_POW2(PORT_MNIC_RX_SIZE) || !PORT_POW2(PORT_MNIC_TX_SIZE) || \
+    !PORT_POW2(PORT_RS485_RX_SIZE) || !PORT_POW2(PORT_RS485_TX_SIZE) || \
+    !PORT_POW2(PORT_RS485B_RX_SIZE) || !PORT_POW2(PORT_RS485B_TX_SIZE) || \
+    !PORT_POW2(PORT_RS232_RX_SIZE) || !PORT_POW2(PORT_RS232_TX_SIZE) || \
+    !PORT_POW2(PORT_GPS_RX_SIZE) || !PORT_POW2(PORT_GPS_TX_SIZE)
+  #error "ports.h: ring buffer sizes must be powers of two"
+#endif
+
+
+/*
+ * UART ring buffer sizes, by the role on each
+ */
+#if (PORT_MNIC_SERIAL == 1)
+  #define SERIAL1_RX_BUFFER_SIZE  PORT_MNIC_RX_SIZE
+  #define SERIAL1_TX_BUFFER_SIZE  PORT_MNIC_TX_SIZE
+#elif (PORT_RS485_SERIAL == 1)
+  #define SERIAL1_RX_BUFFER_SIZE  PORT_RS485_RX_SIZE
+  #define SERIAL1_TX_BUFFER_SIZE  PORT_RS485_TX_SIZE
+#elif (PORT_RS485B_SERIAL == 1)
+  #define SERIAL1_RX_BUFFER_SIZE  PORT_RS485B_RX_SIZE
+  #define SERIAL1_TX_BUFFER_SIZE  PORT_RS485B_TX_SIZE
+#elif (PORT_RS232_SERIAL == 1)
+  #define SERIAL1_RX_BUFFER_SIZE  PORT_RS232_RX_SIZE
+  #define SERIAL1_TX_BUFFER_SIZE  PORT_RS232_TX_SIZE
+#elif (PORT_GPS_SERIAL == 1)
+  #define SERIAL1_RX_BUFFER_SIZE  PORT_GPS_RX_SIZE
+  #define SERIAL1_TX_BUFFER_SIZE  PORT_GPS_TX_SIZE
+#else
+  #define SERIAL1_RX_BUFFER_SIZE  PORT_IDLE_RX_SIZE
+  #define SERIAL1_TX_BUFFER_SIZE  PORT_IDLE_TX_SIZE
+#endif
+
+#if (PORT_MNIC_SERIAL == 2)
+  #define SERIAL2_RX_BUFFER_SIZE  PORT_MNIC_RX_SIZE
+  #define SERIAL2_TX_BUFFER_SIZE  PORT_MNIC_TX_SIZE
+#elif (PORT_RS485_SERIAL == 2)
+  #define SERIAL2_RX_BUFFER_SIZE  PORT_RS485_RX_SIZE
+  #define SERIAL2_TX_BUFFER_SIZE  PORT_RS485_TX_SIZE
+#elif (PORT_RS485B_SERIAL == 2)
+  #define SERIAL2_RX_BUFFER_SIZE  PORT_RS485B_RX_SIZE
+  #define SERIAL2_TX_BUFFER_SIZE  PORT_RS485B_TX_SIZE
+#elif (PORT_RS232_SERIAL == 2)
+  #define SERIAL2_RX_BUFFER_SIZE  PORT_RS232_RX_SIZE
+  #define SERIAL2_TX_BUFFER_SIZE  PORT_RS232_TX_SIZE
+#elif (PORT_GPS_SERIAL == 2)
+  #define SERIAL2_RX_BUFFER_SIZE  PORT_GPS_RX_SIZE
+  #define SERIAL2_TX_BUFFER_SIZE  PORT_GPS_TX_SIZE
+#else
+  #define SERIAL2_RX_BUFFER_SIZE  PORT_IDLE_RX_SIZE
+  #define SERIAL2_TX_BUFFER_SIZE  PORT_IDLE_TX_SIZE
+#endif
+
+#if (PORT_MNIC_SERIAL == 3)
+  #define SERIAL3_RX_BUFFER_SIZE  PORT_MNIC_RX_SIZE
+  #define SERIAL3_TX_BUFFER_SIZE  PORT_MNIC_TX_SIZE
+#elif (PORT_RS485_SERIAL == 3)
+  #define SERIAL3_RX_BUFFER_SIZE  PORT_RS485_RX_SIZE
+  #define SERIAL3_TX_BUFFER_SIZE  PORT_RS485_TX_SIZE
+#elif (PORT_RS485B_SERIAL == 3)
+  #define SERIAL3_RX_BUFFER_SIZE  PORT_RS485B_RX_SIZE
+  #define SERIAL3_TX_BUFFER_SIZE  PORT_RS485B_TX_SIZE
+#elif (PORT_RS232_SERIAL == 3)
+  #define SERIAL3_RX_BUFFER_SIZE  PORT_RS232_RX_SIZE
+  #define SERIAL3_TX_BUFFER_SIZE  PORT_RS232_TX_SIZE
+#elif (PORT_GPS_SERIAL == 3)
+  #define SERIAL3_RX_BUFFER_SIZE  PORT_GPS_RX_SIZE
+  #define SERIAL3_TX_BUFFER_SIZE  PORT_GPS_TX_SIZE
+#else
+  #define SERIAL3_RX_BUFFER_SIZE  PORT_IDLE_RX_SIZE
+  #define SERIAL3_TX_BUFFER_SIZE  PORT_IDLE_TX_SIZE
+#endif
+
+
+/*
+ * Interrupt priorities, the one plan for every IRQ the firmware enables.
+ * The M0+ has four levels, 0 preempts the others. RX of the mNIC and of
+ * the RS485 buses comes first, so no byte is lost behind a long handler,
+ * DMA completion next, then the tick and the other UARTs, then GPIO, the
+ * RTC, the watchdog warning, USB, the timers and the SERCOMs with no UART
+ * role. The core sets them from here, irqprio.h checks them at run time.
+ */
+#define PORT_PRIO_RX              0
+#define PORT_PRIO_DMA             1
+#define PORT_PRIO_TICK            2
+#define PORT_PRIO_UART            2
+#define PORT_PRIO_LOW             3
+
+#define PORT_SERCOM_IRQ_(n)       SERCOM##n##_IRQn
+#define PORT_SERCOM_IRQ(n)        PORT_SERCOM_IRQ_(n)
+#define PORT_IRQ_NONE             (-100)
+#define PORT_MNIC_IRQ             PORT_SERCOM_IRQ(PORT_SERCOM(PORT_MNIC_SERIAL))
+#if (PORT_RS485_SERIAL != PORT_NONE)
+  #define PORT_RS485_IRQ          PORT_SERCOM_IRQ(PORT_SERCOM(PORT_RS485_SERIAL))
+#else
+  #define PORT_RS485_IRQ          PORT_IRQ_NONE
+#endif
+#if (PORT_RS485B_SERIAL != PORT_NONE)
+  #define PORT_RS485B_IRQ         PORT_SERCOM_IRQ(PORT_SERCOM(PORT_RS485B_SERIAL))
+#else
+  #define PORT_RS485B_IRQ         PORT_IRQ_NONE
+#endif
+#if (PORT_RS232_SERIAL != PORT_NONE)
+  #define PORT_RS232_IRQ          PORT_SERCOM_IRQ(PORT_SERCOM(PORT_RS232_SERIAL))
+#else
+  #define PORT_RS232_IRQ          PORT_IRQ_NONE
+#endif
+#if (PORT_GPS_SERIAL != PORT_NONE)
+  #define PORT_GPS_IRQ            PORT_SERCOM_IRQ(PORT_SERCOM(PORT_GPS_SERIAL))
+#else
+  #define PORT_GPS_IRQ            PORT_IRQ_NONE
+#endif
+
+// The priority of the SERCOM with IRQ irq, by the role on it
+#define PORT_SERCOM_PRIO(irq) \
+  (((irq) == PORT_MNIC_IRQ || (irq) == PORT_RS485_IRQ || (irq) == PORT_RS485B_IRQ) ? PORT_PRIO_RX : \
+   ((irq) == PORT_RS232_IRQ || (irq) == PORT_GPS_IRQ) ? PORT_PRIO_UART : PORT_PRIO_LOW)
+
+#endif // _VARIANT_PORTS_H_
@@ -317,6 +317,7 @@ static const uint8_t ATN = PIN_ATN;
 #define PAD_SERIAL1_RX       (SERCOM_RX_PAD_1)
 
 #define SERCOM_INSTANCE_SERIAL1       &sercom4
+#define SERIAL1_SERCOM                4
 
 /*
 // Serial1
@@ -345,6 +346,7 @@ static const uint8_t ATN = PIN_ATN;
 #define PAD_SERIAL2_RX       (SERCOM_RX_PAD_3)			//ryan		//PA15
 
 #define SERCOM_INSTANCE_SERIAL2       &sercom2
+#define SERIAL2_SERCOM                2
 
 // Serial3 (a third serial is not available with the D51 on this board)
 /*
@@ -370,6 +372,7 @@ static const uint8_t ATN = PIN_ATN;
 #define PAD_SERIAL3_RX       (SERCOM_RX_PAD_3)
 
 #define SERCOM_INSTANCE_SERIAL3       &sercom3
+#define SERIAL3_SERCOM                3
 /*
 #define PIN_SERIAL3_TX       (PIN_SDA)
 #define PIN_SERIAL3_RX       (PIN_SCL)
@@ -379,6 +382,8 @@ static const uint8_t ATN = PIN_ATN;
 #define SERCOM_INSTANCE_SERIAL3       &sercom3
 */
 
+// UART ring buffer sizes are set by the role on each, see ports.h
+
 /*
  * SPI Interfaces
  */
@@ -401,9 +406,13 @@ static const uint8_t SCK  = FLASH_SCK ;		//RYAN
 #define PIN_SPI_SS           SS
 
 #define PERIPH_SPI           sercom5
+#define SPI_SERCOM           5
 #define PAD_SPI_TX           SPI_PAD_2_SCK_3
 #define PAD_SPI_RX           SERCOM_RX_PAD_1
 
+// Serial port roles, and the UART ring buffer sizes
+#include "ports.h"
+
 /*
 #if (SAMD51)
 #define PIN_SPI1_MISO         (21u)
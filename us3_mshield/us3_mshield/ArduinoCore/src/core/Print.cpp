@@ -297,6 +297,10 @@ size_t Print::printFloat(double number, uint8_t digits)
   if (isnan(number)) return print("nan");
   if (isinf(number)) return print("inf");
 
+  // A reading fits a scaled integer and goes out without the digit loop
+  char fixed[FTOA_FIXED_LEN];
+  if (ftoa_fixed_exact(number, fixed, digits) >= 0) return write(fixed);
+
 #if defined(LONG_LONG_PRINT_FLOAT)
   if (number > (double)ULONG_LONG_MAX) return print ("ovf");
   if (number < -(double)ULONG_LONG_MAX) return print ("ovf");
@@ -353,6 +357,10 @@ size_t Print::printFloat(float number, uint8_t digits)
   if (isnan(number)) return print("nan");
   if (isinf(number)) return print("inf");
 
+  // Float has no more digits than the scaled integer keeps
+  char fixed[FTOA_FIXED_LEN];
+  if (digits <= 9 && ftoa_fixed(number, fixed, digits) >= 0) return write(fixed);
+
 #if defined(LONG_LONG_PRINT_FLOAT)
   if (number > (float)ULONG_LONG_MAX) return print ("ovf");
   if (number < -(float)ULONG_LONG_MAX) return print ("ovf");
@@ -17,15 +17,17 @@
 */
 
 #include "RingBuffer.h"
+#include "wiring_constants.h"
 #include <string.h>
 
-RingBuffer::RingBuffer( void )
+RingBufferBase::RingBufferBase( uint8_t *buffer, int size ) :
+  _aucBuffer( buffer ), _iMask( size - 1 )
 {
-    memset( _aucBuffer, 0, SERIAL_BUFFER_SIZE ) ;
+    memset( _aucBuffer, 0, size ) ;
     clear();
 }
 
-void RingBuffer::store_char( uint8_t c )
+RAMFUNC void RingBufferBase::store_char( uint8_t c )
 {
   int i = nextIndex(_iHead);
 
@@ -36,59 +38,117 @@ void RingBuffer::store_char( uint8_t c )
   if ( i != _iTail )
   {
     _aucBuffer[_iHead] = c ;
+    barrier();
     _iHead = i ;
   }
 }
 
-void RingBuffer::clear()
+int RingBufferBase::store( const uint8_t *data, int count )
+{
+  int head = _iHead;
+  int room = availableForStore();
+  int first;
+
+  if ( count > room )
+  {
+    count = room;
+  }
+  // Up to the end of the storage, then the rest from its start
+  first = size() - head;
+  if ( first > count )
+  {
+    first = count;
+  }
+  memcpy( &_aucBuffer[head], data, first );
+  memcpy( _aucBuffer, data + first, count - first );
+  barrier();
+  _iHead = (head + count) & _iMask;
+
+  return count;
+}
+
+void RingBufferBase::clear()
 {
 	_iHead = 0;
 	_iTail = 0;
 }
 
-int RingBuffer::read_char()
+RAMFUNC int RingBufferBase::read_char()
 {
 	if(_iTail == _iHead)
 		return -1;
 
 	uint8_t value = _aucBuffer[_iTail];
+	barrier();
 	_iTail = nextIndex(_iTail);
 
 	return value;
 }
 
-int RingBuffer::available()
+int RingBufferBase::read( uint8_t *data, int count )
 {
-	int delta = _iHead - _iTail;
+  int tail = _iTail;
+  int have = (_iHead - tail) & _iMask;
+  int first;
 
-	if(delta < 0)
-		return SERIAL_BUFFER_SIZE + delta;
-	else
-		return delta;
+  if ( count > have )
+  {
+    count = have;
+  }
+  barrier();
+  first = size() - tail;
+  if ( first > count )
+  {
+    first = count;
+  }
+  memcpy( data, &_aucBuffer[tail], first );
+  memcpy( data + first, _aucBuffer, count - first );
+  barrier();
+  _iTail = (tail + count) & _iMask;
+
+  return count;
 }
 
-int RingBuffer::availableForStore()
+int RingBufferBase::peek_contiguous( const uint8_t **data )
 {
-	if (_iHead >= _iTail)
-		return SERIAL_BUFFER_SIZE - 1 - _iHead + _iTail;
-	else
-		return _iTail - _iHead - 1;
+  int tail = _iTail;
+  int head = _iHead;
+
+  barrier();
+  *data = &_aucBuffer[tail];
+  // a head behind the tail has wrapped, the span ends with the storage
+  return head >= tail ? head - tail : size() - tail;
 }
 
-int RingBuffer::peek()
+void RingBufferBase::consume( int count )
 {
-	if(_iTail == _iHead)
-		return -1;
+  if ( count > available() )
+  {
+    count = available();
+  }
+  barrier();
+  _iTail = (_iTail + count) & _iMask;
+}
 
-	return _aucBuffer[_iTail];
+RAMFUNC int RingBufferBase::available()
+{
+	return (_iHead - _iTail) & _iMask;
 }
 
-int RingBuffer::nextIndex(int index)
+RAMFUNC int RingBufferBase::availableForStore()
 {
-	return (uint32_t)(index + 1) % SERIAL_BUFFER_SIZE;
+	return (_iTail - _iHead - 1) & _iMask;
+}
+
+int RingBufferBase::peek()
+{
+	if(_iTail == _iHead)
+		return -1;
+
+	return _aucBuffer[_iTail];
 }
 
-bool RingBuffer::isFull()
+bool RingBufferBase::isFull()
 {
 	return (nextIndex(_iHead) == _iTail);
 }
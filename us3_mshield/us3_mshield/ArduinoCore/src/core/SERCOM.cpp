@@ -18,6 +18,7 @@
 
 #include "SERCOM.h"
 #include "variant.h"
+#include "wiring_constants.h"
 
 uint32_t SercomClock = 1000000ul; // this default is changed in initClockNVIC()
 
@@ -30,6 +31,18 @@ uint32_t SercomClock = 1000000ul; // this default is changed in initClockNVIC()
 SERCOM::SERCOM(Sercom* s)
 {
   sercom = s;
+#if !(SAMD51)
+  irqn = PendSV_IRQn;
+#endif
+}
+
+uint32_t SERCOM::getNvicPriority( void )
+{
+#if (SAMD51)
+  return SERCOM_NVIC_PRIORITY;
+#else
+  return NVIC_GetPriority(irqn);
+#endif
 }
 
 #if 0
@@ -104,16 +117,50 @@ void SERCOM::initUART(SercomUartMode mode, SercomUartSampleRate sampleRate, uint
     uint64_t baudValue = (65536 * scale) >> 32;
     sercom->USART.BAUD.reg = baudValue;
 #endif
-    // Asynchronous fractional mode (Table 24-2 in datasheet)
-    //   BAUD = fref / (sampleRateValue * fbaud)
-    // (multiply by 8, to calculate fractional piece)
-    uint32_t baudTimes8 = (SercomClock * 8) / (sampleRateValue * baudrate);
+    setBaudFracUART(sampleRateValue, baudrate);
+  }
+}
+
+void SERCOM::setBaudFracUART(uint16_t sampleRateValue, uint32_t baudrate)
+{
+  // Asynchronous fractional mode (Table 24-2 in datasheet)
+  //   BAUD = fref / (sampleRateValue * fbaud)
+  // (multiply by 8, to calculate fractional piece)
+  uint32_t baudTimes8 = (SercomClock * 8) / (sampleRateValue * baudrate);
+
+  sercom->USART.BAUD.FRAC.FP   = (baudTimes8 % 8);
+  sercom->USART.BAUD.FRAC.BAUD = (baudTimes8 / 8);
+}
+
+// The same baud on the SERCOM clock now, after clockChanged(). BAUD is
+// enable-protected, so the USART is off for the write, which cuts a
+// character still being sent or received.
+void SERCOM::setBaudUART(uint32_t baudrate)
+{
+  uint16_t sampleRateValue = (sercom->USART.CTRLA.bit.SAMPR == SAMPLE_RATE_x16) ? 16 : 8;
+  bool on = sercom->USART.CTRLA.bit.ENABLE;
 
-    sercom->USART.BAUD.FRAC.FP   = (baudTimes8 % 8);
-    sercom->USART.BAUD.FRAC.BAUD = (baudTimes8 / 8);
+  sercom->USART.CTRLA.bit.ENABLE = 0x0u;
+  while(sercom->USART.SYNCBUSY.bit.ENABLE);
+
+  setBaudFracUART(sampleRateValue, baudrate);
+
+  if (on) {
+    sercom->USART.CTRLA.bit.ENABLE = 0x1u;
+    while(sercom->USART.SYNCBUSY.bit.ENABLE);
   }
 }
 
+// Generator 0 feeds the SERCOMs, the CPU may run divided from it
+void SERCOM::clockChanged( void )
+{
+#if (SAML21 || SAMC21)
+  SercomClock = SystemCoreClock * MCLK->CPUDIV.reg;
+#elif (SAMD21 || SAMD11)
+  SercomClock = SystemCoreClock * (1ul << PM->CPUSEL.reg);
+#endif
+}
+
 void SERCOM::initFrame(SercomUartCharSize charSize, SercomDataOrder dataOrder, SercomParityMode parityMode, SercomNumberStopBit nbStopBits)
 {
   //Setting the CTRLA register
@@ -156,6 +203,19 @@ void SERCOM::enableUART()
   while(sercom->USART.SYNCBUSY.bit.ENABLE);
 }
 
+// Keep the USART clocked in standby, its interrupts wake the core. RUNSTDBY
+// is enable-protected, so the USART is off for the write.
+void SERCOM::setRunStandbyUART(bool on)
+{
+  sercom->USART.CTRLA.bit.ENABLE = 0x0u;
+  while(sercom->USART.SYNCBUSY.bit.ENABLE);
+
+  sercom->USART.CTRLA.bit.RUNSTDBY = on ? 0x1u : 0x0u;
+
+  sercom->USART.CTRLA.bit.ENABLE = 0x1u;
+  while(sercom->USART.SYNCBUSY.bit.ENABLE);
+}
+
 void SERCOM::flushUART()
 {
   // Skip checking transmission completion if data register is empty
@@ -166,24 +226,24 @@ void SERCOM::flushUART()
   while(!sercom->USART.INTFLAG.bit.TXC);
 }
 
-void SERCOM::clearStatusUART()
+RAMFUNC void SERCOM::clearStatusUART()
 {
   //Reset (with 0) the STATUS register
   sercom->USART.STATUS.reg = SERCOM_USART_STATUS_RESETVALUE;
 }
 
-bool SERCOM::availableDataUART()
+RAMFUNC bool SERCOM::availableDataUART()
 {
   //RXC : Receive Complete
   return sercom->USART.INTFLAG.bit.RXC;
 }
 
-bool SERCOM::isUARTError()
+RAMFUNC bool SERCOM::isUARTError()
 {
   return sercom->USART.INTFLAG.bit.ERROR;
 }
 
-void SERCOM::acknowledgeUARTError()
+RAMFUNC void SERCOM::acknowledgeUARTError()
 {
   sercom->USART.INTFLAG.bit.ERROR = 1;
 }
@@ -206,18 +266,18 @@ bool SERCOM::isParityErrorUART()
   return sercom->USART.STATUS.bit.PERR;
 }
 
-bool SERCOM::isDataRegisterEmptyUART()
+RAMFUNC bool SERCOM::isDataRegisterEmptyUART()
 {
   //DRE : Data Register Empty
   return sercom->USART.INTFLAG.bit.DRE;
 }
 
-uint8_t SERCOM::readDataUART()
+RAMFUNC uint8_t SERCOM::readDataUART()
 {
   return sercom->USART.DATA.bit.DATA;
 }
 
-int SERCOM::writeDataUART(uint8_t data)
+RAMFUNC int SERCOM::writeDataUART(uint8_t data)
 {
   // Wait for data register to be empty
   while(!isDataRegisterEmptyUART());
@@ -227,16 +287,93 @@ int SERCOM::writeDataUART(uint8_t data)
   return 1;
 }
 
+volatile void *SERCOM::getDataRegisterUART()
+{
+  return &sercom->USART.DATA.reg;
+}
+
+// DMAC trigger source for "DATA register empty", 0 if this SERCOM has none
+uint8_t SERCOM::getDmacTriggerTx()
+{
+#if (SAML21 || SAMD21)
+  if(sercom == SERCOM0)
+    return SERCOM0_DMAC_ID_TX;
+  if(sercom == SERCOM1)
+    return SERCOM1_DMAC_ID_TX;
+  if(sercom == SERCOM2)
+    return SERCOM2_DMAC_ID_TX;
+  if(sercom == SERCOM3)
+    return SERCOM3_DMAC_ID_TX;
+#if !(SAMD21E)
+  if(sercom == SERCOM4)
+    return SERCOM4_DMAC_ID_TX;
+#endif
+#endif
+  return 0;
+}
+
+// DMAC trigger source for "receive complete", 0 if this SERCOM has none
+uint8_t SERCOM::getDmacTriggerRx()
+{
+#if (SAML21 || SAMD21)
+  if(sercom == SERCOM0)
+    return SERCOM0_DMAC_ID_RX;
+  if(sercom == SERCOM1)
+    return SERCOM1_DMAC_ID_RX;
+  if(sercom == SERCOM2)
+    return SERCOM2_DMAC_ID_RX;
+  if(sercom == SERCOM3)
+    return SERCOM3_DMAC_ID_RX;
+#if !(SAMD21E)
+  if(sercom == SERCOM4)
+    return SERCOM4_DMAC_ID_RX;
+#endif
+#endif
+  return 0;
+}
+
+#if defined(SERCOM_DMAC_CHANNELS)
+// Descriptor of a channel, in the table of wiring_dmac.c
+DmacDescriptor *SERCOM::getDmacDescriptor(uint8_t channel)
+{
+  return dmacDescriptor(channel);
+}
+#endif
+
 void SERCOM::enableDataRegisterEmptyInterruptUART()
 {
   sercom->USART.INTENSET.reg = SERCOM_USART_INTENSET_DRE;
 }
 
-void SERCOM::disableDataRegisterEmptyInterruptUART()
+RAMFUNC void SERCOM::disableDataRegisterEmptyInterruptUART()
 {
   sercom->USART.INTENCLR.reg = SERCOM_USART_INTENCLR_DRE;
 }
 
+#if (SAMD51 || SAMC21)
+// Bits TE stays up after the last stop bit in RS485 mode, set while disabled
+void SERCOM::setGuardTimeUART(uint8_t bits)
+{
+  sercom->USART.CTRLC.bit.GTIME = bits & 0x7;
+}
+#endif
+
+// TXC stays set while the line is idle, so it only counts while enabled
+RAMFUNC bool SERCOM::isTransmitCompleteInterruptUART()
+{
+  return sercom->USART.INTENSET.bit.TXC && sercom->USART.INTFLAG.bit.TXC;
+}
+
+void SERCOM::enableTransmitCompleteInterruptUART()
+{
+  sercom->USART.INTENSET.reg = SERCOM_USART_INTENSET_TXC;
+}
+
+RAMFUNC void SERCOM::disableTransmitCompleteInterruptUART()
+{
+  sercom->USART.INTENCLR.reg = SERCOM_USART_INTENCLR_TXC;
+}
+
 /*	=========================
  *	===== Sercom SPI
  *	=========================
@@ -376,6 +513,106 @@ uint8_t SERCOM::transferDataSPI(uint8_t data)
   return sercom->SPI.DATA.bit.DATA;  // Reading data
 }
 
+// Bulk transfer, 0xFF out without txData, dropped in without rxData. The
+// next byte waits in DATA while one shifts, so there is no gap between
+// bytes. rxData may be txData, a byte is received only after it is sent.
+void SERCOM::transferDataSPI(const uint8_t *txData, uint8_t *rxData, size_t count)
+{
+  size_t sent = 0;
+  size_t received = 0;
+  uint8_t data;
+
+  while (received < count) {
+    // No more than the two bytes the receiver holds in flight
+    if (sent < count && sent - received < 2 && sercom->SPI.INTFLAG.bit.DRE) {
+      sercom->SPI.DATA.reg = txData ? txData[sent] : 0xFF;
+      sent++;
+    }
+    if (sercom->SPI.INTFLAG.bit.RXC) {
+      data = sercom->SPI.DATA.reg;
+      if (rxData) {
+        rxData[received] = data;
+      }
+      received++;
+    }
+  }
+}
+
+#if defined(SERCOM_DMAC_CHANNELS)
+// The two channels of a transfer set up and enabled, the receive one raising
+// the DMAC IRQ at its end if interrupt. False, nothing sent, if this SERCOM
+// has no DMAC triggers.
+bool SERCOM::armDmaSPI(const uint8_t *txData, uint8_t *rxData, size_t count, bool interrupt)
+{
+  static uint8_t fill = 0xFF;
+  static uint8_t sink;
+  uint8_t triggerTx = getDmacTriggerTx();
+  uint8_t triggerRx = getDmacTriggerRx();
+  DmacDescriptor *d;
+
+  if (triggerTx == 0 || triggerRx == 0 || count == 0 || count > 0xFFFF) {
+    return false;
+  }
+
+  // Addresses are the end of the block when incrementing
+  d = getDmacDescriptor(SERCOM_DMAC_SPI_RX);
+  d->BTCTRL.reg = DMAC_BTCTRL_VALID | DMAC_BTCTRL_BEATSIZE_BYTE | (rxData ? DMAC_BTCTRL_DSTINC : 0);
+  d->BTCNT.reg = count;
+  d->SRCADDR.reg = (uint32_t)&sercom->SPI.DATA.reg;
+  d->DSTADDR.reg = rxData ? (uint32_t)(rxData + count) : (uint32_t)&sink;
+  d->DESCADDR.reg = 0;
+
+  d = getDmacDescriptor(SERCOM_DMAC_SPI_TX);
+  d->BTCTRL.reg = DMAC_BTCTRL_VALID | DMAC_BTCTRL_BEATSIZE_BYTE | (txData ? DMAC_BTCTRL_SRCINC : 0);
+  d->BTCNT.reg = count;
+  d->SRCADDR.reg = txData ? (uint32_t)(txData + count) : (uint32_t)&fill;
+  d->DSTADDR.reg = (uint32_t)&sercom->SPI.DATA.reg;
+  d->DESCADDR.reg = 0;
+
+  // Receive first, so it is armed before the first byte shifts in
+  dmacStart(SERCOM_DMAC_SPI_RX, DMAC_CHCTRLB_LVL(0) | DMAC_CHCTRLB_TRIGSRC(triggerRx) | DMAC_CHCTRLB_TRIGACT_BEAT,
+            interrupt ? DMAC_CHINTENSET_TCMPL | DMAC_CHINTENSET_TERR : 0, false);
+  dmacStart(SERCOM_DMAC_SPI_TX, DMAC_CHCTRLB_LVL(0) | DMAC_CHCTRLB_TRIGSRC(triggerTx) | DMAC_CHCTRLB_TRIGACT_BEAT,
+            0, false);
+
+  return true;
+}
+
+// A transfer through the DMAC, waiting for the receive channel to end.
+// Returns false, nothing sent, if this SERCOM has no DMAC triggers.
+bool SERCOM::transferDmaSPI(const uint8_t *txData, uint8_t *rxData, size_t count)
+{
+  uint8_t flags;
+
+  if (!armDmaSPI(txData, rxData, count, false)) {
+    return false;
+  }
+
+  // Polled, no channel interrupt. The DMAC IRQ restores CHID.
+  do {
+    DMAC->CHID.reg = DMAC_CHID_ID(SERCOM_DMAC_SPI_RX);
+    flags = DMAC->CHINTFLAG.reg;
+  } while (!(flags & (DMAC_CHINTFLAG_TCMPL | DMAC_CHINTFLAG_TERR)));
+  DMAC->CHINTFLAG.reg = flags;
+
+  endDmaSPI();
+  return true;
+}
+
+// The same without waiting; the callback attached to SERCOM_DMAC_SPI_RX is
+// called at the end, from the DMAC IRQ, and endDmaSPI() then frees the channels.
+bool SERCOM::startDmaSPI(const uint8_t *txData, uint8_t *rxData, size_t count)
+{
+  return armDmaSPI(txData, rxData, count, true);
+}
+
+void SERCOM::endDmaSPI( void )
+{
+  dmacStop(SERCOM_DMAC_SPI_RX);
+  dmacStop(SERCOM_DMAC_SPI_TX);
+}
+#endif
+
 bool SERCOM::isBufferOverflowErrorSPI()
 {
   return sercom->SPI.STATUS.bit.BUFOVF;
@@ -401,6 +638,10 @@ bool SERCOM::isDataRegisterEmptySPI()
 
 uint32_t SERCOM::calculateBaudrateSynchronous(uint32_t baudrate)
 {
+  // the clock may be below twice the rate asked for with the core slowed down
+  if (2 * baudrate > SercomClock) {
+    return 0;
+  }
   return ((SercomClock / (2 * baudrate)) - 1);
 }
 
@@ -693,6 +934,52 @@ uint8_t SERCOM::readDataWIRE( void )
   }
 }
 
+// The address out and a start, or a repeated start as bus owner, without waiting.
+// MB follows for a write or a NACK, SB with the first byte of a read.
+void SERCOM::startAddressWIRE(uint8_t address, SercomWireReadWriteFlag flag)
+{
+  sercom->I2CM.ADDR.bit.ADDR = (address << 0x1ul) | flag;
+}
+
+// A byte out, MB when it has been acknowledged or not
+void SERCOM::writeDataMasterWIRE(uint8_t data)
+{
+  sercom->I2CM.DATA.bit.DATA = data;
+}
+
+// The byte SB has flagged, the command bits after it ask for the next or stop
+uint8_t SERCOM::readDataMasterWIRE( void )
+{
+  return sercom->I2CM.DATA.bit.DATA;
+}
+
+uint8_t SERCOM::getInterruptFlagsWIRE( void )
+{
+  return sercom->I2CM.INTFLAG.reg;
+}
+
+// A bus error or lost arbitration, which set MB or SB as well
+bool SERCOM::isMasterErrorWIRE( void )
+{
+  return sercom->I2CM.STATUS.reg & (SERCOM_I2CM_STATUS_BUSERR | SERCOM_I2CM_STATUS_ARBLOST);
+}
+
+void SERCOM::clearMasterErrorWIRE( void )
+{
+  sercom->I2CM.STATUS.reg = SERCOM_I2CM_STATUS_BUSERR | SERCOM_I2CM_STATUS_ARBLOST;
+  sercom->I2CM.INTFLAG.reg = SERCOM_I2CM_INTFLAG_ERROR;
+}
+
+void SERCOM::enableMasterInterruptsWIRE( void )
+{
+  sercom->I2CM.INTENSET.reg = SERCOM_I2CM_INTENSET_MB | SERCOM_I2CM_INTENSET_SB | SERCOM_I2CM_INTENSET_ERROR;
+}
+
+void SERCOM::disableMasterInterruptsWIRE( void )
+{
+  sercom->I2CM.INTENCLR.reg = SERCOM_I2CM_INTENCLR_MB | SERCOM_I2CM_INTENCLR_SB | SERCOM_I2CM_INTENCLR_ERROR;
+}
+
 
 void SERCOM::initClockNVIC( void )
 {
@@ -825,7 +1112,8 @@ void SERCOM::initClockNVIC( void )
   NVIC_SetPriority (IdNvic3, (1<<__NVIC_PRIO_BITS) - 1);  /* set Priority */
 #else
   NVIC_EnableIRQ(IdNvic);
-  NVIC_SetPriority (IdNvic, SERCOM_NVIC_PRIORITY);  /* set Priority */
+  NVIC_SetPriority (IdNvic, PORT_SERCOM_PRIO(IdNvic));  /* by the role on it, see ports.h */
+  irqn = IdNvic;
 #endif
 
   //Setting clock
@@ -835,7 +1123,7 @@ void SERCOM::initClockNVIC( void )
   while ( GCLK->STATUS.reg & GCLK_STATUS_SYNCBUSY );
 #elif (SAML21 || SAMC21)
   GCLK->PCHCTRL[clockId].reg = ( GCLK_PCHCTRL_CHEN | GCLK_PCHCTRL_GEN_GCLK0 );
-  SercomClock = SystemCoreClock;
+  clockChanged();
   while ( (GCLK->PCHCTRL[clockId].reg & GCLK_PCHCTRL_CHEN) != GCLK_PCHCTRL_CHEN );      // wait for sync
 #elif (SAMD51)
   GCLK->PCHCTRL[clockId].reg = ( GCLK_PCHCTRL_CHEN | GCLK_PCHCTRL_GEN_GCLK10 );  // use 96MHz clock (100MHz max for SERCOM) from GCLK10, which was setup in startup.c
@@ -100,7 +100,7 @@ void tone (uint32_t outputPin, uint32_t frequency, uint32_t duration)
   {
     firstTimeRunning = true;
 
-    NVIC_SetPriority(TONE_TC_IRQn, 0);
+    NVIC_SetPriority(TONE_TC_IRQn, PORT_PRIO_LOW);
 
     // Enable GCLK for timer used
 #if (SAMD11)
@@ -402,7 +402,7 @@ void USBDeviceClass::init()
         NVIC_SetPriority((IRQn_Type) USB_3_IRQn, 0UL);
         NVIC_EnableIRQ((IRQn_Type) USB_3_IRQn);
 #else
-	NVIC_SetPriority((IRQn_Type) USB_IRQn, 0UL);
+	NVIC_SetPriority((IRQn_Type) USB_IRQn, PORT_PRIO_LOW);
 	NVIC_EnableIRQ((IRQn_Type) USB_IRQn);
 #endif
 
@@ -20,8 +20,6 @@
 #include "Arduino.h"
 #include "wiring_private.h"
 
-#define NO_RTS_PIN 255
-#define NO_CTS_PIN 255
 #define RTS_RX_THRESHOLD 10
 #if (SAMD51)
   #define EXCEPTION_NUMBER_MASK 0x1FF
@@ -29,20 +27,32 @@
   #define EXCEPTION_NUMBER_MASK 0x3F
 #endif
 
-Uart::Uart(SERCOM *_s, uint8_t _pinRX, uint8_t _pinTX, SercomRXPad _padRX, SercomUartTXPad _padTX) :
-  Uart(_s, _pinRX, _pinTX, _padRX, _padTX, NO_RTS_PIN, NO_CTS_PIN)
+Uart::Uart(SERCOM *_s, uint8_t _pinRX, uint8_t _pinTX, SercomRXPad _padRX, SercomUartTXPad _padTX, RingBufferBase &_rx, RingBufferBase &_tx) :
+  Uart(_s, _pinRX, _pinTX, _padRX, _padTX, NO_RTS_PIN, NO_CTS_PIN, _rx, _tx)
 {
 }
 
-Uart::Uart(SERCOM *_s, uint8_t _pinRX, uint8_t _pinTX, SercomRXPad _padRX, SercomUartTXPad _padTX, uint8_t _pinRTS, uint8_t _pinCTS)
+Uart::Uart(SERCOM *_s, uint8_t _pinRX, uint8_t _pinTX, SercomRXPad _padRX, SercomUartTXPad _padTX, uint8_t _pinRTS, uint8_t _pinCTS, RingBufferBase &_rx, RingBufferBase &_tx) :
+  rxBuffer(_rx), txBuffer(_tx)
 {
   sercom = _s;
+  ul_baudrate = 0;
   uc_pinRX = _pinRX;
   uc_pinTX = _pinTX;
   uc_padRX = _padRX ;
   uc_padTX = _padTX;
   uc_pinRTS = _pinRTS;
   uc_pinCTS = _pinCTS;
+  rxCallback = NULL;
+  txDoneCallback = NULL;
+#if (SAMD51 || SAMC21)
+  uc_pinTE = NO_RTS_PIN;
+  uc_guardTime = 0;
+#endif
+#if defined(UART_DMA_TX)
+  dmaBusy = false;
+  dmaDone = NULL;
+#endif
 }
 
 void Uart::begin(unsigned long baudrate)
@@ -59,7 +69,16 @@ void Uart::begin(unsigned long baudrate, uint16_t config)
     if (uc_pinCTS != NO_CTS_PIN) {
       pinPeripheral(uc_pinCTS, PIO_SERCOM);
     }
+  } else if (uc_pinCTS != NO_CTS_PIN) {
+    // no CTS pad, polled through ctsReady()
+    pinMode(uc_pinCTS, INPUT);
+  }
+
+#if (SAMD51 || SAMC21)
+  if (uc_padTX == UART_TX_RS485_PAD_0_2 && uc_pinTE != NO_RTS_PIN) {
+    pinPeripheral(uc_pinTE, PIO_SERCOM);
   }
+#endif
 
   if (uc_pinRTS != NO_RTS_PIN) {
     pinMode(uc_pinRTS, OUTPUT);
@@ -72,15 +91,22 @@ void Uart::begin(unsigned long baudrate, uint16_t config)
     *pul_outclrRTS = ul_pinMaskRTS;
   }
 
+  ul_baudrate = baudrate;
   sercom->initUART(UART_INT_CLOCK, SAMPLE_RATE_x16, baudrate);
   sercom->initFrame(extractCharSize(config), LSB_FIRST, extractParity(config), extractNbStopBit(config));
   sercom->initPads(uc_padTX, uc_padRX);
+#if (SAMD51 || SAMC21)
+  if (uc_padTX == UART_TX_RS485_PAD_0_2) {
+    sercom->setGuardTimeUART(uc_guardTime);
+  }
+#endif
 
   sercom->enableUART();
 }
 
 void Uart::end()
 {
+  ul_baudrate = 0;
   sercom->resetUART();
   rxBuffer.clear();
   txBuffer.clear();
@@ -96,7 +122,13 @@ void Uart::flush()
 #if (SAMD51)
 void Uart::availableDataHandler()
 {
-  rxBuffer.store_char(sercom->readDataUART());
+  uint8_t data = sercom->readDataUART();
+
+  if (rxCallback) {
+    rxCallback(data);
+  } else {
+    rxBuffer.store_char(data);
+  }
 }
 
 void Uart::dataRegisterEmptyHandler()
@@ -119,16 +151,32 @@ void Uart::errorHandler()
   sercom->clearStatusUART();
 }
 
+void Uart::transmitCompleteHandler()
+{
+  sercom->disableTransmitCompleteInterruptUART();
+  if (txDoneCallback) {
+    txDoneCallback();
+  }
+}
+
 #else
-void Uart::IrqHandler()
+RAMFUNC void Uart::IrqHandler()
 {
   if (sercom->availableDataUART()) {
-    rxBuffer.store_char(sercom->readDataUART());
+    uint8_t data = sercom->readDataUART();
 
-    if (uc_pinRTS != NO_RTS_PIN) {
-      // RX buffer space is below the threshold, de-assert RTS
-      if (rxBuffer.availableForStore() < RTS_RX_THRESHOLD) {
-        *pul_outsetRTS = ul_pinMaskRTS;
+    if (rxCallback) {
+      // byte consumed by the registered receiver, nothing is buffered,
+      // it drives RTS through rxReady()
+      rxCallback(data);
+    } else {
+      rxBuffer.store_char(data);
+
+      if (uc_pinRTS != NO_RTS_PIN) {
+        // RX buffer space is below the threshold, de-assert RTS
+        if (rxBuffer.availableForStore() < RTS_RX_THRESHOLD) {
+          *pul_outsetRTS = ul_pinMaskRTS;
+        }
       }
     }
   }
@@ -143,6 +191,14 @@ void Uart::IrqHandler()
     }
   }
 
+  if (sercom->isTransmitCompleteInterruptUART()) {
+    // once per burst of writes, write() enables it again
+    sercom->disableTransmitCompleteInterruptUART();
+    if (txDoneCallback) {
+      txDoneCallback();
+    }
+  }
+
   if (sercom->isUARTError()) {
     sercom->acknowledgeUARTError();
     // TODO: if (sercom->isBufferOverflowErrorUART()) ....
@@ -153,6 +209,73 @@ void Uart::IrqHandler()
 }
 #endif
 
+void Uart::onReceive(void (*callback)(uint8_t))
+{
+  rxCallback = callback;
+}
+
+void Uart::onTransmitComplete(void (*callback)(void))
+{
+  txDoneCallback = callback;
+}
+
+void Uart::setFlowControl(uint8_t _pinRTS, uint8_t _pinCTS)
+{
+  uc_pinRTS = _pinRTS;
+  uc_pinCTS = _pinCTS;
+}
+
+void Uart::runInStandby(bool on)
+{
+  sercom->setRunStandbyUART(on);
+}
+
+void Uart::clockChanged()
+{
+  if (ul_baudrate) {
+    sercom->setBaudUART(ul_baudrate);
+  }
+}
+
+// The last character may still be in the shifter, DRE is set as it goes in
+bool Uart::isSending()
+{
+#if defined(UART_DMA_TX)
+  if (dmaBusy) {
+    return true;
+  }
+#endif
+  return ul_baudrate && (txBuffer.available() || !sercom->isDataRegisterEmptyUART());
+}
+
+#if (SAMD51 || SAMC21)
+void Uart::setRS485(uint8_t _pinTE, uint8_t guardBits)
+{
+  uc_pinTE = _pinTE;
+  uc_guardTime = guardBits;
+}
+#endif
+
+void Uart::rxReady(bool ready)
+{
+  if (uc_pinRTS != NO_RTS_PIN) {
+    if (ready) {
+      *pul_outclrRTS = ul_pinMaskRTS;
+    } else {
+      *pul_outsetRTS = ul_pinMaskRTS;
+    }
+  }
+}
+
+bool Uart::ctsReady()
+{
+  if (uc_pinCTS == NO_CTS_PIN || uc_padTX == UART_TX_RTS_CTS_PAD_0_2_3) {
+    // nothing to check, or the SERCOM holds off TX by itself
+    return true;
+  }
+  return digitalRead(uc_pinCTS) == LOW;
+}
+
 int Uart::available()
 {
   return rxBuffer.available();
@@ -182,8 +305,26 @@ int Uart::read()
   return c;
 }
 
+size_t Uart::read(uint8_t *buffer, size_t size)
+{
+  size_t n = rxBuffer.read(buffer, size);
+
+  if (uc_pinRTS != NO_RTS_PIN) {
+    if (rxBuffer.availableForStore() > RTS_RX_THRESHOLD) {
+      *pul_outclrRTS = ul_pinMaskRTS;
+    }
+  }
+
+  return n;
+}
+
 size_t Uart::write(const uint8_t data)
 {
+#if defined(UART_DMA_TX)
+  // keep byte order with a DMA transfer still in flight
+  while (dmaBusy);
+#endif
+
   if (sercom->isDataRegisterEmptyUART() && txBuffer.available() == 0) {
     sercom->writeDataUART(data);
   } else {
@@ -196,7 +337,7 @@ size_t Uart::write(const uint8_t data)
         uint32_t exceptionNumber =  (__get_IPSR() & EXCEPTION_NUMBER_MASK);
 
         if (exceptionNumber == 0 ||
-              NVIC_GetPriority((IRQn_Type)(exceptionNumber - 16)) > SERCOM_NVIC_PRIORITY) {
+              NVIC_GetPriority((IRQn_Type)(exceptionNumber - 16)) > sercom->getNvicPriority()) {
           // no exception or called from an ISR with lower priority,
           // wait for free buffer spot via IRQ
           continue;
@@ -219,9 +360,119 @@ size_t Uart::write(const uint8_t data)
     sercom->enableDataRegisterEmptyInterruptUART();
   }
 
+  // writing DATA cleared TXC, it sets again after the last character
+  if (txDoneCallback) {
+    sercom->enableTransmitCompleteInterruptUART();
+  }
+
   return 1;
 }
 
+size_t Uart::write(const uint8_t *buffer, size_t size)
+{
+  size_t n = 0;
+  int k;
+
+#if defined(UART_DMA_TX)
+  while (dmaBusy);
+#endif
+
+  while (n < size) {
+    k = txBuffer.store(buffer + n, size - n);
+    if (k == 0) {
+      // full, the single byte write waits for room however it can
+      n += write(buffer[n]);
+      continue;
+    }
+    n += k;
+    // the DRE interrupt takes the first byte at once if DATA is empty
+    sercom->enableDataRegisterEmptyInterruptUART();
+    if (txDoneCallback) {
+      sercom->enableTransmitCompleteInterruptUART();
+    }
+  }
+
+  return n;
+}
+
+#if defined(UART_DMA_TX)
+// One channel is shared by all UARTs, so only one transfer can be in flight.
+static DmacDescriptor dmaChain[UART_DMA_MAX_SEGMENTS - 1] DMAC_DESCRIPTOR_ALIGN;
+static Uart *dmaOwner = NULL;
+
+// TCMPL: last beat is in the DATA register, TERR: bus error, give up
+static void uartDmaCallback(uint8_t flags, void *context)
+{
+  Uart *owner = dmaOwner;
+
+  if (owner) {
+    dmaOwner = NULL;
+    owner->dmaHandler();
+  }
+}
+
+bool Uart::writeDMA(const uint8_t * const *buf, const uint16_t *len, uint8_t count, void (*done)(void))
+{
+  DmacDescriptor *d;
+  uint8_t trigger = sercom->getDmacTriggerTx();
+  uint8_t n = 0;
+
+  if (trigger == 0 || count > UART_DMA_MAX_SEGMENTS || dmaOwner != NULL || txBuffer.available()) {
+    return false;
+  }
+
+  d = SERCOM::getDmacDescriptor(UART_DMA_CHANNEL);
+
+  // Build the descriptor chain, skipping empty segments
+  for (uint8_t i = 0; i < count; i++) {
+    if (len[i] == 0) {
+      continue;
+    }
+    if (n > 0) {
+      dmacLink(d, &dmaChain[n - 1]);
+      d = &dmaChain[n - 1];
+    }
+    d->BTCTRL.reg = DMAC_BTCTRL_VALID | DMAC_BTCTRL_BEATSIZE_BYTE | DMAC_BTCTRL_SRCINC;
+    d->BTCNT.reg = len[i];
+    // source address is the end of the block when incrementing
+    d->SRCADDR.reg = (uint32_t)(buf[i] + len[i]);
+    d->DSTADDR.reg = (uint32_t)sercom->getDataRegisterUART();
+    dmacLink(d, NULL);
+    n++;
+  }
+
+  if (n == 0) {
+    if (done) {
+      done();
+    }
+    return true;
+  }
+  d->BTCTRL.reg |= DMAC_BTCTRL_BLOCKACT_INT;
+
+  dmaOwner = this;
+  dmaDone = done;
+  dmaBusy = true;
+
+  dmacAttach(UART_DMA_CHANNEL, uartDmaCallback, NULL);
+  dmacStart(UART_DMA_CHANNEL, DMAC_CHCTRLB_LVL(0) | DMAC_CHCTRLB_TRIGSRC(trigger) | DMAC_CHCTRLB_TRIGACT_BEAT,
+            DMAC_CHINTENSET_TCMPL | DMAC_CHINTENSET_TERR, false);
+
+  return true;
+}
+
+void Uart::dmaHandler()
+{
+  void (*done)(void) = dmaDone;
+
+  dmaDone = NULL;
+  dmaBusy = false;
+
+  if (done) {
+    done();
+  }
+}
+#endif
+
 SercomNumberStopBit Uart::extractNbStopBit(uint16_t config)
 {
   switch(config & HARDSER_STOP_BIT_MASK)
@@ -50,7 +50,7 @@ static void __initialize()
 
   NVIC_DisableIRQ(EIC_IRQn);
   NVIC_ClearPendingIRQ(EIC_IRQn);
-  NVIC_SetPriority(EIC_IRQn, 0);
+  NVIC_SetPriority(EIC_IRQn, PORT_PRIO_LOW);
   NVIC_EnableIRQ(EIC_IRQn);
 #endif
 
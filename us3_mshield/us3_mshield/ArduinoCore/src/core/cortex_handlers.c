@@ -629,7 +629,8 @@ void USB_SetHandler(void (*new_usb_isr)(void))
 #endif
 #endif
 
-void HardFault_Handler(void)
+/* Weak, an application may keep a post-mortem record instead */
+__attribute__ ((weak)) void HardFault_Handler(void)
 {
   __BKPT(13);
   while (1);
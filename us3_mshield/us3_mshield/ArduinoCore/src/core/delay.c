@@ -30,6 +30,13 @@ static volatile uint32_t _ulTickCount=0 ;
 static volatile uint32_t _ulTickCountHighWord=0 ;
 #endif
 
+/** SysTick counts to us in micros() as (ticks * scale) >> 20, for the core clock now */
+static uint32_t _ulMicrosScale = 1048576/(VARIANT_MCK/1000000) ;
+/** Part of a ms the SysTick counted before the last tickRescale(), in 1/1024 ms */
+static uint32_t _ulTickFrac = 0 ;
+
+uint32_t _ulDelayLoopsPerUs = (VARIANT_MCK / 1000000) / 3 ;
+
 unsigned long millis( void )
 {
 // todo: ensure no interrupts
@@ -60,8 +67,8 @@ unsigned long micros( void )
     count2  = _ulTickCount ;
   } while ((pend != pend2) || (count != count2) || (ticks < ticks2));
 
-  return ((count+pend) * 1000) + (((SysTick->LOAD  - ticks)*(1048576/(VARIANT_MCK/1000000)))>>20) ;
-  // this is an optimization to turn a runtime division into two compile-time divisions and
+  return ((count+pend) * 1000) + (((SysTick->LOAD  - ticks)*_ulMicrosScale)>>20) ;
+  // this is an optimization to turn a runtime division into a division at each clock switch and
   // a runtime multiplication and shift, saving a few cycles
 }
 
@@ -102,6 +109,40 @@ void delay( unsigned long ms )
   }
 }
 
+// Count the ms SysTick missed with the core in standby, interrupts off
+void tickAdvance( uint32_t ms )
+{
+  uint32_t count = _ulTickCount + ms ;
+
+#if !defined(NO_DELAY_HIGH_WORD)
+  if ( count < _ulTickCount )
+  {
+    _ulTickCountHighWord++;
+  }
+#endif
+  _ulTickCount = count ;
+}
+
+// Reload SysTick for 1 ms at the core clock now, interrupts off. Writing VAL
+// starts a full ms, so the part of the ms already counted is carried on.
+void tickRescale( void )
+{
+  uint32_t load = SysTick->LOAD + 1 ;
+  uint32_t frac = _ulTickFrac + (((uint64_t)(load - 1 - SysTick->VAL) << 10) / load) ;
+
+  SysTick->LOAD = SystemCoreClock / 1000 - 1 ;
+  SysTick->VAL = 0 ;
+  if ( frac >= 1024 )
+  {
+    tickAdvance( 1 ) ;
+    frac -= 1024 ;
+  }
+  _ulTickFrac = frac ;
+
+  _ulMicrosScale = 1048576/(SystemCoreClock/1000000) ;
+  _ulDelayLoopsPerUs = (SystemCoreClock / 1000000) / 3 ;
+}
+
 #include "Reset.h" // for tickReset()
 
 void SysTick_DefaultHandler(void)
@@ -122,6 +122,147 @@ extern char* itoa(int value, char*string, int radix)
             return string;
         }
 
+static const uint32_t ftoa_pow10[10] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+// m * 2^e scaled by 10^decimals and rounded half to even, as printf does,
+// in integers only; m * 10^decimals must fit 64 bits
+static int ftoa_scaled(uint64_t m, int e, int neg, char*string, uint8_t decimals)
+{
+    char tmp[10];
+    uint64_t p = m * ftoa_pow10[decimals];
+    uint64_t half, rem;
+    uint32_t u, ip, fp;
+    int n = 0;
+    int k = 0;
+
+    if (e >= 0)
+    {
+        if (e > 31 || (p >> (32 - e)) != 0)
+        {
+            return -1;
+        }
+        p <<= e;
+    }
+    else if (e < -63)
+    {
+        p = 0;
+    }
+    else
+    {
+        half = 1ull << (-e - 1);
+        rem = p & ((half << 1) - 1);
+        p >>= -e;
+        if (rem > half || (rem == half && (p & 1)))
+        {
+            p++;
+        }
+    }
+    if (p > 0xffffffffull)
+    {
+        return -1;
+    }
+    u = (uint32_t)p;
+    ip = u / ftoa_pow10[decimals];
+    fp = u % ftoa_pow10[decimals];
+
+    if (neg && u)
+    {
+        string[n++] = '-';
+    }
+    do
+    {
+        tmp[k++] = '0' + ip % 10;
+        ip /= 10;
+    } while (ip);
+    while (k)
+    {
+        string[n++] = tmp[--k];
+    }
+    if (decimals)
+    {
+        string[n++] = '.';
+        for (k = decimals; k--; )
+        {
+            string[n + k] = '0' + fp % 10;
+            fp /= 10;
+        }
+        n += decimals;
+    }
+    string[n] = 0;
+
+    return n;
+}
+
+extern int ftoa_fixed(float value, char*string, uint8_t decimals)
+{
+    union { float f; uint32_t u; } v;
+    uint32_t m;
+    int e;
+
+    v.f = value;
+    e = (v.u >> 23) & 0xff;
+    m = v.u & 0x7fffff;
+    if (e == 0xff)
+    {
+        return -1;
+    }
+    if (e)
+    {
+        m |= 0x800000;
+    }
+    else
+    {
+        e = 1;
+    }
+    if (decimals > 9)
+    {
+        decimals = 9;
+    }
+    // 24 bits of mantissa by 30 of 10^9 at most
+    return ftoa_scaled(m, e - 150, v.u >> 31, string, decimals);
+}
+
+extern int ftoa_fixed_exact(double value, char*string, uint8_t decimals)
+{
+    union { double d; uint64_t u; } v;
+    uint64_t m;
+    float f;
+    int e;
+
+    if (decimals > 9)
+    {
+        return -1;
+    }
+    // 53 bits of mantissa by 10 of 10^3 fit, more decimals go through float
+    if (decimals <= 3)
+    {
+        v.d = value;
+        e = (v.u >> 52) & 0x7ff;
+        m = v.u & 0xfffffffffffffull;
+        if (e == 0x7ff)
+        {
+            return -1;
+        }
+        if (e)
+        {
+            m |= 1ull << 52;
+        }
+        else
+        {
+            e = 1;
+        }
+        return ftoa_scaled(m, e - 1075, v.u >> 63, string, decimals);
+    }
+    f = (float)value;
+    if (!((f < 0 ? -f : f) * ftoa_pow10[decimals] < 16777216.0f))
+    {
+        return -1;
+    }
+    return ftoa_fixed(f, string, decimals);
+}
+
 # ifdef __cplusplus
     } // extern "C"
 #endif
\ No newline at end of file
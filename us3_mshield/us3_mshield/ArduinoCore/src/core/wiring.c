@@ -50,7 +50,7 @@ void init( void )
     // Capture error
     while ( 1 ) ;
   }
-  NVIC_SetPriority (SysTick_IRQn,  (1 << __NVIC_PRIO_BITS) - 2);  /* set Priority for Systick Interrupt (2nd lowest) */
+  NVIC_SetPriority (SysTick_IRQn,  PORT_PRIO_TICK);  /* set Priority for Systick Interrupt, see ports.h */
 
   // Clock SERCOM for Serial, TC/TCC for Pulse and Analog, and ADC/DAC for Analog
 #if (SAMD21 || SAMD11)
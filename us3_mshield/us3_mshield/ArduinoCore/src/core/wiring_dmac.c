@@ -0,0 +1,186 @@
+/*
+  Copyright (c) 2015 Arduino LLC.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+
+#include "Arduino.h"
+#include "wiring_private.h"
+#include "wiring_dmac.h"
+
+#if (SAML21 || SAMD21)
+
+#if (DMAC_CHANNELS_MAX > DMAC_CH_NUM) || (DMAC_CHANNELS_MAX < SERCOM_DMAC_CHANNELS)
+#error "DMAC_CHANNELS_MAX out of range"
+#endif
+
+static DmacDescriptor dmacDescriptors[DMAC_CHANNELS_MAX] DMAC_DESCRIPTOR_ALIGN;
+static DmacDescriptor dmacWriteback[DMAC_CHANNELS_MAX] DMAC_DESCRIPTOR_ALIGN;
+
+static struct {
+  dmacCallback callback;
+  void *context;
+} dmacOwners[DMAC_CHANNELS_MAX];
+
+// The SERCOM channels are the core's own from the start
+static uint16_t dmacUsed = (1u << SERCOM_DMAC_CHANNELS) - 1;
+
+static void dmacInit( void )
+{
+  static bool initialized = false;
+
+  if (initialized) {
+    return;
+  }
+
+#if (SAML21)
+  MCLK->AHBMASK.reg |= MCLK_AHBMASK_DMAC;
+#else
+  PM->AHBMASK.reg |= PM_AHBMASK_DMAC;
+  PM->APBBMASK.reg |= PM_APBBMASK_DMAC;
+#endif
+
+  DMAC->CTRL.reg &= ~DMAC_CTRL_DMAENABLE;
+  DMAC->CTRL.reg = DMAC_CTRL_SWRST;
+  while (DMAC->CTRL.reg & DMAC_CTRL_SWRST);
+
+  DMAC->BASEADDR.reg = (uint32_t)dmacDescriptors;
+  DMAC->WRBADDR.reg = (uint32_t)dmacWriteback;
+  DMAC->CTRL.reg = DMAC_CTRL_DMAENABLE | DMAC_CTRL_LVLEN(0xf);
+
+  NVIC_EnableIRQ(DMAC_IRQn);
+  // below UART RX, see ports.h
+  NVIC_SetPriority(DMAC_IRQn, PORT_PRIO_DMA);
+
+  initialized = true;
+}
+
+uint8_t dmacAlloc( void )
+{
+  uint32_t primask = __get_PRIMASK();
+  uint8_t channel;
+
+  __disable_irq();
+  for (channel = 0; channel < DMAC_CHANNELS_MAX; channel++) {
+    if (!(dmacUsed & (1u << channel))) {
+      dmacUsed |= 1u << channel;
+      break;
+    }
+  }
+  if (!primask) {
+    __enable_irq();
+  }
+
+  if (channel == DMAC_CHANNELS_MAX) {
+    return DMAC_NO_CHANNEL;
+  }
+  dmacInit();
+  return channel;
+}
+
+void dmacFree( uint8_t channel )
+{
+  uint32_t primask;
+
+  if (channel < SERCOM_DMAC_CHANNELS || channel >= DMAC_CHANNELS_MAX) {
+    return;
+  }
+
+  dmacStop(channel);
+  primask = __get_PRIMASK();
+  __disable_irq();
+  dmacOwners[channel].callback = NULL;
+  dmacUsed &= ~(1u << channel);
+  if (!primask) {
+    __enable_irq();
+  }
+}
+
+DmacDescriptor *dmacDescriptor( uint8_t channel )
+{
+  dmacInit();
+  return &dmacDescriptors[channel];
+}
+
+void dmacAttach( uint8_t channel, dmacCallback callback, void *context )
+{
+  uint32_t primask = __get_PRIMASK();
+
+  __disable_irq();
+  dmacOwners[channel].callback = callback;
+  dmacOwners[channel].context = context;
+  if (!primask) {
+    __enable_irq();
+  }
+}
+
+void dmacStart( uint8_t channel, uint32_t chctrlb, uint8_t interrupts, bool runStandby )
+{
+  uint8_t chid = DMAC->CHID.reg;
+
+  dmacInit();
+  DMAC->CHID.reg = DMAC_CHID_ID(channel);
+  DMAC->CHCTRLA.reg &= ~DMAC_CHCTRLA_ENABLE;
+  DMAC->CHCTRLA.reg = DMAC_CHCTRLA_SWRST;
+  while (DMAC->CHCTRLA.reg & DMAC_CHCTRLA_SWRST);
+  DMAC->CHCTRLB.reg = chctrlb;
+  if (interrupts) {
+    DMAC->CHINTENSET.reg = interrupts;
+  }
+  DMAC->CHCTRLA.reg = DMAC_CHCTRLA_ENABLE | (runStandby ? DMAC_CHCTRLA_RUNSTDBY : 0);
+  DMAC->CHID.reg = chid;
+}
+
+void dmacStop( uint8_t channel )
+{
+  uint8_t chid = DMAC->CHID.reg;
+
+  DMAC->CHID.reg = DMAC_CHID_ID(channel);
+  DMAC->CHINTENCLR.reg = DMAC_CHINTENCLR_MASK;
+  DMAC->CHCTRLA.reg &= ~DMAC_CHCTRLA_ENABLE;
+  while (DMAC->CHCTRLA.reg & DMAC_CHCTRLA_ENABLE);
+  DMAC->CHINTFLAG.reg = DMAC_CHINTFLAG_MASK;
+  DMAC->CHID.reg = chid;
+}
+
+// Each channel with a callback and an enabled flag pending. Flags that are
+// not enabled are left alone, for a transfer polling its own channel.
+void DMAC_Handler( void )
+{
+  uint8_t chid = DMAC->CHID.reg;
+  uint32_t pending = DMAC->INTSTATUS.reg;
+  uint8_t channel;
+
+  for (channel = 0; channel < DMAC_CHANNELS_MAX; channel++) {
+    dmacCallback callback = dmacOwners[channel].callback;
+    uint8_t flags;
+
+    if (!(pending & (1u << channel)) || !callback) {
+      continue;
+    }
+    // the loop may be between selecting its channel and using it
+    DMAC->CHID.reg = DMAC_CHID_ID(channel);
+    flags = DMAC->CHINTFLAG.reg & DMAC->CHINTENSET.reg;
+    DMAC->CHINTFLAG.reg = flags;
+    DMAC->CHID.reg = chid;
+    if (flags) {
+      callback(flags, dmacOwners[channel].context);
+      DMAC->CHID.reg = chid;
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,155 @@
+/*
+  Copyright (c) 2015 Arduino LLC.  All right reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation; either
+  version 2.1 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+  See the GNU Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, write to the Free Software
+  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+*/
+
+#include "Arduino.h"
+#include "wiring_private.h"
+#include "wiring_evsys.h"
+
+#if (SAML21)
+
+// One bit per channel in use, taken and given back with interrupts off as
+// drivers may set up from an IRQ (a sensor started by the scheduler)
+static uint16_t evsysUsed = 0;
+
+static bool evsysOwned( uint8_t channel )
+{
+  return channel < EVSYS_CHANNELS && (evsysUsed & (1u << channel));
+}
+
+uint8_t evsysAlloc( void )
+{
+  uint32_t primask = __get_PRIMASK();
+  uint8_t channel;
+
+  __disable_irq();
+  for (channel = 0; channel < EVSYS_CHANNELS; channel++) {
+    if (!(evsysUsed & (1u << channel))) {
+      evsysUsed |= 1u << channel;
+      break;
+    }
+  }
+  if (!primask) {
+    __enable_irq();
+  }
+
+  if (channel == EVSYS_CHANNELS) {
+    return EVSYS_NO_CHANNEL;
+  }
+  MCLK->APBDMASK.reg |= MCLK_APBDMASK_EVSYS;
+  return channel;
+}
+
+void evsysFree( uint8_t channel )
+{
+  uint32_t primask;
+  uint8_t user;
+
+  if (!evsysOwned(channel)) {
+    return;
+  }
+
+  // USER holds the channel number plus one, 0 is none
+  for (user = 0; user < EVSYS_USERS; user++) {
+    if ((EVSYS->USER[user].reg & EVSYS_USER_CHANNEL_Msk) == (uint32_t)channel + 1) {
+      EVSYS->USER[user].reg = 0;
+    }
+  }
+  EVSYS->CHANNEL[channel].reg = 0;
+  GCLK->PCHCTRL[GCM_EVSYS_CHANNEL_0 + channel].reg = 0;
+
+  primask = __get_PRIMASK();
+  __disable_irq();
+  evsysUsed &= ~(1u << channel);
+  if (!primask) {
+    __enable_irq();
+  }
+}
+
+int evsysRoute( uint8_t channel, uint8_t generator, uint32_t config )
+{
+  if (!evsysOwned(channel) || generator >= EVSYS_GENERATORS) {
+    return -1;
+  }
+
+  // the synchronous and resynchronized paths run on a channel clock
+  if ((config & EVSYS_CHANNEL_PATH_Msk) != EVSYS_CHANNEL_PATH_ASYNCHRONOUS) {
+    GCLK->PCHCTRL[GCM_EVSYS_CHANNEL_0 + channel].reg = GCLK_PCHCTRL_CHEN | GCLK_PCHCTRL_GEN_GCLK0;
+    while ((GCLK->PCHCTRL[GCM_EVSYS_CHANNEL_0 + channel].reg & GCLK_PCHCTRL_CHEN) != GCLK_PCHCTRL_CHEN);
+  }
+  EVSYS->CHANNEL[channel].reg = EVSYS_CHANNEL_EVGEN(generator) | (config & ~EVSYS_CHANNEL_EVGEN_Msk);
+  return RET_STATUS_OK;
+}
+
+int evsysConnect( uint8_t channel, uint8_t user )
+{
+  if (!evsysOwned(channel) || user >= EVSYS_USERS) {
+    return -1;
+  }
+
+  EVSYS->USER[user].reg = EVSYS_USER_CHANNEL(channel + 1);
+  return RET_STATUS_OK;
+}
+
+void evsysDisconnect( uint8_t user )
+{
+  if (user < EVSYS_USERS) {
+    EVSYS->USER[user].reg = 0;
+  }
+}
+
+#else
+
+uint8_t evsysAlloc( void )
+{
+  return EVSYS_NO_CHANNEL;
+}
+
+void evsysFree( uint8_t channel )
+{
+}
+
+int evsysRoute( uint8_t channel, uint8_t generator, uint32_t config )
+{
+  return -1;
+}
+
+int evsysConnect( uint8_t channel, uint8_t user )
+{
+  return -1;
+}
+
+void evsysDisconnect( uint8_t user )
+{
+}
+
+#endif
+
+uint8_t evsysChain( uint8_t generator, uint8_t user, uint32_t config )
+{
+  uint8_t channel = evsysAlloc();
+
+  if (channel == EVSYS_NO_CHANNEL) {
+    return EVSYS_NO_CHANNEL;
+  }
+  if (evsysRoute(channel, generator, config) != RET_STATUS_OK ||
+      evsysConnect(channel, user) != RET_STATUS_OK) {
+    evsysFree(channel);
+    return EVSYS_NO_CHANNEL;
+  }
+  return channel;
+}
@@ -0,0 +1,220 @@
+#include "FilterFixed.h"
+
+// exp(-i/64), Q31
+static const uint32_t ExpFrac[65] = {
+  0x7fffffff, 0x7e03fab0, 0x7c0fd5aa, 0x7a2371ac, 0x783eafef, 0x76617227, 0x748b9a80, 0x72bd0b9d,
+  0x70f5a894, 0x6f3554ee, 0x6d7bf4a8, 0x6bc96c2a, 0x6a1da04b, 0x6878764f, 0x66d9d3e4, 0x65419f1e,
+  0x63afbe7b, 0x622418dc, 0x609e9586, 0x5f1f1c22, 0x5da594b8, 0x5c31e7af, 0x5ac3fdcb, 0x595bc030,
+  0x57f91858, 0x569bf018, 0x5544319f, 0x53f1c770, 0x52a49c65, 0x515c9baa, 0x5019b0c0, 0x4edbc777,
+  0x4da2cbf2, 0x4c6eaa9f, 0x4b3f503e, 0x4a14a9d8, 0x48eea4c3, 0x47cd2e9e, 0x46b03552, 0x4597a710,
+  0x4483724d, 0x437385c8, 0x4267d080, 0x416041bb, 0x405cc8ff, 0x3f5d5616, 0x3e61d907, 0x3d6a421b,
+  0x3c7681d8, 0x3b868902, 0x3a9a489a, 0x39b1b1db, 0x38ccb63c, 0x37eb476d, 0x370d5758, 0x3632d81c,
+  0x355bbc13, 0x3487f5c9, 0x33b77804, 0x32ea35ba, 0x32202218, 0x3159307c, 0x30955477, 0x2fd481cc,
+  0x2f16ac6c
+};
+
+// exp(-n), Q31, past the last it rounds to 0
+#define EXP_INT_MAX 22
+static const uint32_t ExpInt[EXP_INT_MAX] = {
+  0x7fffffff, 0x2f16ac6c, 0x1152aaa4, 0x065f6c33, 0x02582ab7, 0x00dcc9ff, 0x00513948, 0x001de16c,
+  0x000afe11, 0x00040b3d, 0x00017cd8, 0x00008c1b, 0x0000338b, 0x000012f6, 0x000006fa, 0x00000291,
+  0x000000f2, 0x00000059, 0x00000021, 0x0000000c, 0x00000004, 0x00000002
+};
+
+uint32_t expNegQ16( uint32_t r ) {
+  uint32_t n = r >> 16;
+  uint32_t i = (r >> 10) & 0x3f;
+  uint32_t w = r & 0x3ff;
+  uint32_t t;
+
+  if( n >= EXP_INT_MAX )
+    return 0;
+
+  // 1/64 apart the steps are under 2^25, so the product fits
+  t = ExpFrac[i] - ((((ExpFrac[i] - ExpFrac[i+1]) >> 5) * w) >> 5);
+  return (uint32_t)(((uint64_t)ExpInt[n] * t) >> 31);
+}
+
+// 1 - exp(-dt/tau) for a corner frequency, as a fraction of one
+static float onePoleK( float fc, float sampleS ) {
+  float tau = 1.0/(TWO_PI*fc);    // τ=1/ω
+
+  return 1.0 - expf( -sampleS / tau );
+}
+
+
+FilterOnePoleQ15::FilterOnePoleQ15( FILTER_TYPE ft, float fc, float sampleS, int16_t initialValue ) {
+  setFilter( ft, fc, sampleS, initialValue );
+}
+
+void FilterOnePoleQ15::setFilter( FILTER_TYPE ft, float fc, float sampleS, int16_t initialValue ) {
+  FT = ft;
+  K = constrain( lroundf( onePoleK( fc, sampleS ) * 32768.0 ), 1, 32767 );
+  setToNewValue( initialValue );
+}
+
+int16_t FilterOnePoleQ15::input( int16_t inVal ) {
+  X = inVal;
+  // the difference is within 17 bits and K 15, the product fits
+  Y += (int32_t(inVal) - (Y >> 15)) * K;
+  return output();
+}
+
+int16_t FilterOnePoleQ15::output() {
+  int16_t lp = (Y + (1 << 14)) >> 15;
+
+  switch (FT) {
+    case LOWPASS:
+      return lp;
+    case HIGHPASS:
+      return constrain( int32_t(X) - lp, -32768, 32767 );
+    default:
+      return 0;
+  }
+}
+
+void FilterOnePoleQ15::setToNewValue( int16_t newVal ) {
+  X = newVal;
+  Y = int32_t(newVal) << 15;
+}
+
+
+FilterOnePoleQ31::FilterOnePoleQ31( FILTER_TYPE ft, float fc, float sampleS, int32_t initialValue ) {
+  setFilter( ft, fc, sampleS, initialValue );
+}
+
+void FilterOnePoleQ31::setFilter( FILTER_TYPE ft, float fc, float sampleS, int32_t initialValue ) {
+  FT = ft;
+  K = constrain( llroundf( onePoleK( fc, sampleS ) * 2147483648.0 ), 1, 0x7fffffff );
+  setToNewValue( initialValue );
+}
+
+int32_t FilterOnePoleQ31::input( int32_t inVal ) {
+  X = inVal;
+  Y += (int64_t(inVal) - (Y >> 31)) * K;
+  return output();
+}
+
+int32_t FilterOnePoleQ31::output() {
+  int32_t lp = (Y + (int64_t(1) << 30)) >> 31;
+
+  switch (FT) {
+    case LOWPASS:
+      return lp;
+    case HIGHPASS:
+      return X - lp;
+    default:
+      return 0;
+  }
+}
+
+void FilterOnePoleQ31::setToNewValue( int32_t newVal ) {
+  X = newVal;
+  Y = int64_t(newVal) << 31;
+}
+
+
+FilterOnePoleQ31Var::FilterOnePoleQ31Var( FILTER_TYPE ft, float fc, int32_t initialValue ) {
+  setFilter( ft, fc, initialValue );
+}
+
+void FilterOnePoleQ31Var::setFilter( FILTER_TYPE ft, float fc, int32_t initialValue ) {
+  FT = ft;
+  // 2^32 / (1e6 / ω)
+  TauInv = constrain( TWO_PI * fc * 4294.967296, 1.0, 4294967295.0 );
+  setToNewValue( initialValue );
+
+  LastUS = micros();
+}
+
+int32_t FilterOnePoleQ31Var::input( int32_t inVal ) {
+  unsigned long time = micros();
+  uint32_t elapsed = time - LastUS;
+
+  LastUS = time;
+  return input( inVal, elapsed );
+}
+
+int32_t FilterOnePoleQ31Var::input( int32_t inVal, uint32_t elapsedUS ) {
+  // dt/tau, Q16
+  uint64_t r = (uint64_t(elapsedUS) * TauInv) >> 16;
+  int32_t k = 0x7fffffff - expNegQ16( r > 0xffffffff ? 0xffffffff : r );
+
+  X = inVal;
+  Y += (int64_t(inVal) - (Y >> 31)) * k;
+  return output();
+}
+
+int32_t FilterOnePoleQ31Var::output() {
+  int32_t lp = (Y + (int64_t(1) << 30)) >> 31;
+
+  switch (FT) {
+    case LOWPASS:
+      return lp;
+    case HIGHPASS:
+      return X - lp;
+    default:
+      return 0;
+  }
+}
+
+void FilterOnePoleQ31Var::setToNewValue( int32_t newVal ) {
+  X = newVal;
+  Y = int64_t(newVal) << 31;
+}
+
+
+FilterTwoPoleQ31::FilterTwoPoleQ31( OSCILLATOR_TYPE ft, float frequency3db, float sampleS, int32_t initialValue ) {
+  setAsFilter( ft, frequency3db, sampleS, initialValue );
+}
+
+void FilterTwoPoleQ31::setAsFilter( OSCILLATOR_TYPE ft, float frequency3db, float sampleS, int32_t initialValue ) {
+  float f0, q, k, norm;
+
+  // as FilterTwoPole::setAsFilter
+  if( ft == LOWPASS_BESSEL ) {
+    f0 = frequency3db * 1.28;
+    q = 0.5774;
+  }
+  else {
+    f0 = frequency3db;
+    q = 0.7071;
+  }
+
+  // prewarped, and kept below the Nyquist frequency
+  k = tanf( PI * constrain( f0 * sampleS, 1e-6, 0.45 ) );
+  norm = 1.0 / (1.0 + k/q + k*k);
+
+  Num0 = lroundf( k*k * norm * 536870912.0 );
+  Den1 = lroundf( 2.0 * (k*k - 1.0) * norm * 536870912.0 );
+  // from the others, so the gain at DC is 1 exactly after the rounding
+  Den2 = 4 * Num0 - (int32_t(1) << 29) - Den1;
+
+  setToNewValue( initialValue );
+}
+
+int32_t FilterTwoPoleQ31::input( int32_t drive ) {
+  int64_t acc;
+  int32_t y;
+
+  acc = int64_t(Num0) * (int64_t(drive) + 2 * int64_t(X1) + X2)
+        - int64_t(Den1) * Y1 - int64_t(Den2) * Y2 + Err;
+  y = acc >> 29;
+  Err = acc - (int64_t(y) << 29);
+
+  X2 = X1;
+  X1 = drive;
+  Y2 = Y1;
+  Y1 = y;
+  return y;
+}
+
+int32_t FilterTwoPoleQ31::output() {
+  return Y1;
+}
+
+void FilterTwoPoleQ31::setToNewValue( int32_t newVal ) {
+  X1 = X2 = newVal;
+  Y1 = Y2 = newVal;
+  Err = 0;
+}
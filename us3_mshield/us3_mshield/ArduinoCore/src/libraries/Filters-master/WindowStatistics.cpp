@@ -0,0 +1,61 @@
+#include "WindowStatistics.h"
+
+WindowStatistics::WindowStatistics() {
+  reset();
+}
+
+void WindowStatistics::reset() {
+  N = 0;
+  Min = Max = 0;
+  MeanQ = 0;
+  M2Q = 0;
+}
+
+void WindowStatistics::input( int32_t inVal ) {
+  int64_t x = int64_t(inVal) << 16;
+  int64_t d, d2;
+
+  if( N++ == 0 ) {
+    Min = Max = inVal;
+    MeanQ = x;
+    return;
+  }
+  if( inVal < Min ) Min = inVal;
+  if( inVal > Max ) Max = inVal;
+
+  // a 32 bit division when the step fits, as it does for all but outliers
+  d = x - MeanQ;
+  if( d >= -0x7fffffff && d <= 0x7fffffff && N <= 0x7fffffff )
+    MeanQ += int32_t(d) / int32_t(N);
+  else
+    MeanQ += d / int64_t(N);
+  d2 = x - MeanQ;
+
+  // Q8 * Q8, both under 2^31 for samples within 2^23 of the mean
+  M2Q += uint64_t((d >> 8) * (d2 >> 8));
+}
+
+uint32_t WindowStatistics::count() {
+  return N;
+}
+
+float WindowStatistics::mean() {
+  return MeanQ * (1.0f / 65536.0f);
+}
+
+float WindowStatistics::variance() {
+  if( N < 2 ) return 0;
+  return M2Q * (1.0f / 65536.0f) / (N - 1);
+}
+
+float WindowStatistics::sigma() {
+  return sqrtf( variance() );
+}
+
+int32_t WindowStatistics::minimum() {
+  return Min;
+}
+
+int32_t WindowStatistics::maximum() {
+  return Max;
+}
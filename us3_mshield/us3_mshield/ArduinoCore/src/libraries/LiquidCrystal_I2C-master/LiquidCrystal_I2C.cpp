@@ -270,6 +270,27 @@ void LiquidCrystal_I2C::expanderWrite(uint8_t _data){
 	Wire.endTransmission();   
 }
 
+// Characters at the cursor, up to LCD_RUN_MAX of them to one I2C transaction.
+// At 100 kHz a byte is 90us, more than the 37us a character needs to settle.
+void LiquidCrystal_I2C::writeRun(const uint8_t *s, uint8_t n){
+	while (n) {
+		uint8_t k = n < LCD_RUN_MAX ? n : LCD_RUN_MAX;
+		Wire.beginTransmission(_Addr);
+		for (uint8_t i = 0; i < k; i++) {
+			uint8_t nib[2] = { (uint8_t)((s[i] & 0xf0) | Rs | _backlightval),
+			                   (uint8_t)(((s[i] << 4) & 0xf0) | Rs | _backlightval) };
+			for (uint8_t j = 0; j < 2; j++) {
+				if (!j) printIIC(nib[j]);
+				printIIC(nib[j] | En);
+				printIIC(nib[j]);
+			}
+		}
+		Wire.endTransmission();
+		s += k;
+		n -= k;
+	}
+}
+
 void LiquidCrystal_I2C::pulseEnable(uint8_t _data){
 	expanderWrite(_data | En);	// En high
 	delayMicroseconds(1);		// enable pulse must be >450ns
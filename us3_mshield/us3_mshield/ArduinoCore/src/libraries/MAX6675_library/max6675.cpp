@@ -14,6 +14,8 @@ MAX6675::MAX6675(int8_t SCLK, int8_t CS, int8_t MISO) {
   sclk = SCLK;
   cs = CS;
   miso = MISO;
+  _spi = NULL;
+  _read = false;
 
   //define pin modes
   pinMode(cs, OUTPUT);
@@ -21,19 +23,70 @@ MAX6675::MAX6675(int8_t SCLK, int8_t CS, int8_t MISO) {
   pinMode(miso, INPUT);
 
   digitalWrite(cs, HIGH);
+  _start = millis();
+}
+
+MAX6675::MAX6675(int8_t CS, SPIClass &spi) {
+  sclk = -1;
+  cs = CS;
+  miso = -1;
+  _spi = &spi;
+  _read = false;
+  _start = 0;
+}
+
+void MAX6675::begin(void) {
+  if (!_spi) {
+    return;
+  }
+  pinMode(cs, OUTPUT);
+  digitalWrite(cs, HIGH);
+  _spi->begin();
+  _start = millis();
 }
-double MAX6675::readCelsius(void) {
 
+bool MAX6675::ready(void) {
+  return (uint32_t)(millis() - _start) >= MAX6675_CONV_MS;
+}
+
+uint16_t MAX6675::read16(void) {
   uint16_t v;
 
-  digitalWrite(cs, LOW);
-  delay(1);
+  if (_spi) {
+    _spi->beginTransaction(SPISettings(MAX6675_SPI_HZ, MSBFIRST, SPI_MODE0));
+    digitalWrite(cs, LOW);
+    v = _spi->transfer16(0);
+    digitalWrite(cs, HIGH);
+    _spi->endTransaction();
+  } else {
+    digitalWrite(cs, LOW);
+    delayMicroseconds(1);
+
+    v = spiread();
+    v <<= 8;
+    v |= spiread();
+
+    digitalWrite(cs, HIGH);
+  }
+  // CS high starts the next conversion
+  _start = millis();
+  return v;
+}
 
-  v = spiread();
-  v <<= 8;
-  v |= spiread();
+double MAX6675::readCelsius(void) {
 
-  digitalWrite(cs, HIGH);
+  uint16_t v;
+
+  // Reading now would stop the conversion, and give the last one again.
+  // The first one is waited for.
+  while (!_read && !ready()) {
+    yield();
+  }
+  if (ready()) {
+    _raw = read16();
+    _read = true;
+  }
+  v = _raw;
 
   if (v & 0x4) {
     // uh oh, no thermocouple attached!
@@ -57,14 +110,14 @@ byte MAX6675::spiread(void) {
   for (i=7; i>=0; i--)
   {
     digitalWrite(sclk, LOW);
-    delay(1);
+    delayMicroseconds(1);
     if (digitalRead(miso)) {
       //set the bit to 0 no matter what
       d |= (1 << i);
     }
 
     digitalWrite(sclk, HIGH);
-    delay(1);
+    delayMicroseconds(1);
   }
 
   return d;
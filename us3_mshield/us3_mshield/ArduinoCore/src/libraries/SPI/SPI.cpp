@@ -31,6 +31,7 @@ const SPISettings DEFAULT_SPI_SETTINGS = SPISettings();
 SPIClass::SPIClass(SERCOM *p_sercom, uint8_t uc_pinMISO, uint8_t uc_pinSCK, uint8_t uc_pinMOSI, SercomSpiTXPad PadTx, SercomRXPad PadRx)
 {
   initialized = false;
+  _dmaBusy = false;
   assert(p_sercom != NULL);
   _p_sercom = p_sercom;
 
@@ -228,10 +229,81 @@ uint16_t SPIClass::transfer16(uint16_t data) {
 
 void SPIClass::transfer(void *buf, size_t count)
 {
-  uint8_t *buffer = reinterpret_cast<uint8_t *>(buf);
-  for (size_t i=0; i<count; i++) {
-    *buffer = transfer(*buffer);
-    buffer++;
+  transfer(buf, buf, count);
+}
+
+#if defined(SERCOM_DMAC_CHANNELS)
+// One SPI has the DMAC channels at a time, for a transfer without waiting
+static SPIClass *spiDmaOwner = NULL;
+#endif
+
+// Either buffer may be NULL, 0xFF is sent without txbuf. Long transfers go
+// through the DMAC where the SERCOM has triggers for it.
+void SPIClass::transfer(const void *txbuf, void *rxbuf, size_t count)
+{
+  const uint8_t *tx = reinterpret_cast<const uint8_t *>(txbuf);
+  uint8_t *rx = reinterpret_cast<uint8_t *>(rxbuf);
+
+  while (_dmaBusy);
+#if defined(SERCOM_DMAC_CHANNELS)
+  if (count >= SPI_DMA_MIN && spiDmaOwner == NULL && _p_sercom->transferDmaSPI(tx, rx, count)) {
+    return;
+  }
+#endif
+  _p_sercom->transferDataSPI(tx, rx, count);
+}
+
+#if defined(SERCOM_DMAC_CHANNELS)
+// From the DMAC IRQ, TCMPL or TERR of the receive channel
+static void spiDmaCallback(uint8_t flags, void *context)
+{
+  SPIClass *owner = spiDmaOwner;
+
+  if (owner) {
+    spiDmaOwner = NULL;
+    owner->dmaHandler();
+  }
+}
+#endif
+
+bool SPIClass::transfer(const void *txbuf, void *rxbuf, size_t count, void (*onComplete)(void *), void *context)
+{
+  const uint8_t *tx = reinterpret_cast<const uint8_t *>(txbuf);
+  uint8_t *rx = reinterpret_cast<uint8_t *>(rxbuf);
+
+  if (_dmaBusy) {
+    return false;
+  }
+  _dmaComplete = onComplete;
+  _dmaContext = context;
+
+#if defined(SERCOM_DMAC_CHANNELS)
+  if (count >= SPI_DMA_MIN && spiDmaOwner == NULL) {
+    _dmaBusy = true;
+    spiDmaOwner = this;
+    dmacAttach(SERCOM_DMAC_SPI_RX, spiDmaCallback, NULL);
+    if (_p_sercom->startDmaSPI(tx, rx, count)) {
+      return true;
+    }
+    spiDmaOwner = NULL;
+    _dmaBusy = false;
+  }
+#endif
+  _p_sercom->transferDataSPI(tx, rx, count);
+  if (onComplete) {
+    onComplete(context);
+  }
+  return true;
+}
+
+void SPIClass::dmaHandler(void)
+{
+#if defined(SERCOM_DMAC_CHANNELS)
+  _p_sercom->endDmaSPI();
+#endif
+  _dmaBusy = false;
+  if (_dmaComplete) {
+    _dmaComplete(_dmaContext);
   }
 }
 
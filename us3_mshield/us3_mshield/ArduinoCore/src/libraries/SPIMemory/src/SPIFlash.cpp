@@ -133,6 +133,17 @@ bool SPIFlash::begin(uint32_t flashChipSize) {
 #endif
   bool retVal = _chipID(flashChipSize);
   _endSPI();
+#ifdef SPI_HAS_TRANSACTION
+  // FASTREAD's dummy byte only pays off above the clock READDATA is rated for. Dual and quad reads need
+  // more data lines than an SPI port has.
+  uint32_t _clock = _clockSpeed;
+  #ifdef SPI_MAX_FREQUENCY
+  if (_clock > SPI_MAX_FREQUENCY) {
+    _clock = SPI_MAX_FREQUENCY;
+  }
+  #endif
+  _fastRead = (_clock > READDATA_MAX_CLK) ? FASTREAD : READDATA;
+#endif
   chipPoweredDown = false;
   _disableGlobalBlockProtect();
   return retVal;
@@ -144,6 +155,7 @@ bool SPIFlash::begin(uint32_t flashChipSize) {
 void SPIFlash::setClock(uint32_t clockSpeed) {
   _settings = SPISettings(clockSpeed, MSBFIRST, SPI_MODE0);
   _SPISettingsSet = true;
+  _clockSpeed = clockSpeed;
 }
 #else
 void SPIFlash::setClock(uint8_t clockdiv) {
@@ -171,6 +183,28 @@ uint32_t SPIFlash::getMaxPage(void) {
 	return (_chip.capacity / _pageSize);
 }
 
+//Returns the size of a program page, from SFDP if the chip has it
+uint16_t SPIFlash::getPageSize(void) {
+	return _pageSize;
+}
+
+//Returns the smallest size the chip erases, 0 if it erases only whole
+uint32_t SPIFlash::getEraseSize(void) {
+  if (kb4Erase.supported) {
+    return KB(4);
+  }
+  if (kb32Erase.supported) {
+    return KB(32);
+  }
+  if (kb64Erase.supported) {
+    return KB(64);
+  }
+  if (kb256Erase.supported) {
+    return KB(256);
+  }
+  return 0;
+}
+
 //Returns the time taken to run a function. Must be called immediately after a function is run as the variable returned is overwritten each time a function from this library is called. Primarily used in the diagnostics sketch included in the library to track function time.
 //This function can only be called if #define RUNDIAGNOSTIC is uncommented in SPIFlash.h
 float SPIFlash::functionRunTime(void) {
@@ -310,7 +344,7 @@ bool  SPIFlash::readByteArray(uint32_t _addr, uint8_t *data_buffer, size_t buffe
     return false;
   }
   if(fastRead) {
-    _beginSPI(FASTREAD);
+    _beginSPI(_fastRead);
   }
   else {
     _beginSPI(READDATA);
@@ -337,7 +371,7 @@ bool  SPIFlash::readCharArray(uint32_t _addr, char *data_buffer, size_t bufferSi
     return false;
 	}
   if(fastRead) {
-    _beginSPI(FASTREAD);
+    _beginSPI(_fastRead);
   }
   else {
     _beginSPI(READDATA);
@@ -418,7 +452,7 @@ bool SPIFlash::readStr(uint32_t _addr, String &data, bool fastRead) {
   }
   else {
     if (fastRead) {
-      _beginSPI(FASTREAD);
+      _beginSPI(_fastRead);
     }
     else {
       _beginSPI(READDATA);
@@ -435,7 +469,7 @@ bool SPIFlash::readStr(uint32_t _addr, String &data, bool fastRead) {
     return false;
 	}
   if(fastRead) {
-    _beginSPI(FASTREAD);
+    _beginSPI(_fastRead);
   }
   else {
     _beginSPI(READDATA);
@@ -572,16 +606,19 @@ bool SPIFlash::writeByteArray(uint32_t _addr, uint8_t *data_buffer, size_t buffe
   if (!_prep(PAGEPROG, _addr, bufferSize)) {
     return false;
   }
-  uint16_t maxBytes = SPI_PAGESIZE-(_addr % SPI_PAGESIZE);  // Force the first set of bytes to stay within the first page
+  uint16_t maxBytes = _pageSize-(_addr % _pageSize);  // Force the first set of bytes to stay within the first page
 
   if (bufferSize <= maxBytes) {
     CHIP_SELECT
     _nextByte(WRITE, PAGEPROG);
     _transferAddress();
-    //_nextBuf(PAGEPROG, &data_buffer[0], bufferSize);
-    for (uint16_t i = 0; i < bufferSize; ++i) {
-      _nextByte(WRITE, data_buffer[i]);
-    }
+    #if defined (ARDUINO_ARCH_SAMD)
+      _nextBuf(PAGEPROG, &data_buffer[0], bufferSize);
+    #else
+      for (uint16_t i = 0; i < bufferSize; ++i) {
+        _nextByte(WRITE, data_buffer[i]);
+      }
+    #endif
     CHIP_DESELECT
   }
   else {
@@ -595,16 +632,19 @@ bool SPIFlash::writeByteArray(uint32_t _addr, uint8_t *data_buffer, size_t buffe
       CHIP_SELECT
       _nextByte(WRITE, PAGEPROG);
       _transferAddress();
-      //_nextBuf(PAGEPROG, &data_buffer[data_offset], writeBufSz);
-      for (uint16_t i = 0; i < writeBufSz; ++i) {
-        _nextByte(WRITE, data_buffer[data_offset + i]);
-      }
+      #if defined (ARDUINO_ARCH_SAMD)
+        _nextBuf(PAGEPROG, &data_buffer[data_offset], writeBufSz);
+      #else
+        for (uint16_t i = 0; i < writeBufSz; ++i) {
+          _nextByte(WRITE, data_buffer[data_offset + i]);
+        }
+      #endif
       CHIP_DESELECT
 
       _currentAddress += writeBufSz;
       data_offset += writeBufSz;
       length -= writeBufSz;
-      maxBytes = 256;   // Now we can do up to 256 bytes per loop
+      maxBytes = _pageSize;   // Now we can do up to a page per loop
 
       if(!_notBusy() || !_writeEnable()){
         return false;
@@ -656,7 +696,7 @@ bool SPIFlash::writeCharArray(uint32_t _addr, char *data_buffer, size_t bufferSi
   if (!_prep(PAGEPROG, _addr, bufferSize)) {
     return false;
   }
-  uint16_t maxBytes = SPI_PAGESIZE-(_addr % SPI_PAGESIZE);  // Force the first set of bytes to stay within the first page
+  uint16_t maxBytes = _pageSize-(_addr % _pageSize);  // Force the first set of bytes to stay within the first page
 
   if (bufferSize <= maxBytes) {
     CHIP_SELECT
@@ -687,7 +727,7 @@ bool SPIFlash::writeCharArray(uint32_t _addr, char *data_buffer, size_t bufferSi
       _currentAddress += writeBufSz;
       data_offset += writeBufSz;
       length -= writeBufSz;
-      maxBytes = 256;   // Now we can do up to 256 bytes per loop
+      maxBytes = _pageSize;   // Now we can do up to a page per loop
 
       if(!_notBusy() || !_writeEnable()){
         return false;
@@ -1052,7 +1092,7 @@ bool SPIFlash::writeStr(uint32_t _addr, String &data, bool errorCheck) {
   if(!_addressCheck(_addr+sizeof(_sz), _sz) || !_notBusy() || !_writeEnable()) {
     return false;
   }
-  uint16_t maxBytes = SPI_PAGESIZE-(_addr % SPI_PAGESIZE);  // Force the first set of bytes to stay within the first page
+  uint16_t maxBytes = _pageSize-(_addr % _pageSize);  // Force the first set of bytes to stay within the first page
 
   if (_sz <= maxBytes) {
     CHIP_SELECT
@@ -1083,7 +1123,7 @@ bool SPIFlash::writeStr(uint32_t _addr, String &data, bool errorCheck) {
       _currentAddress += writeBufSz;
       data_offset += writeBufSz;
       length -= writeBufSz;
-      maxBytes = 256;   // Now we can do up to 256 bytes per loop
+      maxBytes = _pageSize;   // Now we can do up to a page per loop
 
       if(!_notBusy() || !_writeEnable()){
         return false;
@@ -1132,92 +1172,45 @@ bool SPIFlash::writeStr(uint32_t _addr, String &data, bool errorCheck) {
 
 
 // Erases a number of sectors or blocks as needed by the data being input.
-//  Takes an address and the size of the data being input as the arguments and erases the block/s of memory containing the address.
+//  Takes an address and the size of the data being input as the arguments and erases the sectors/blocks of memory
+//  containing them. Each erase is the largest one the chip supports that is aligned there and ends within them.
 bool SPIFlash::eraseSection(uint32_t _addr, uint32_t _sz) {
   #ifdef RUNDIAGNOSTIC
     _spifuncruntime = micros();
   #endif
+  eraseParam *_erase[4] = {&kb256Erase, &kb64Erase, &kb32Erase, &kb4Erase};
+  const uint32_t _eraseSz[4] = {KB(256), KB(64), KB(32), KB(4)};
+  uint32_t _unit = getEraseSize();
+  uint32_t _end;
+  uint8_t i;
 
-  if (!_prep(ERASEFUNC, _addr, _sz)) {
+  if (!_unit) {
+    _troubleshoot(UNSUPPORTEDFUNC);
     return false;
   }
-
-    // If size of data is > 4KB more than one sector needs to be erased. So the number of erase sessions is determined by the quotient of _sz/KB(4). If the _sz is not perfectly divisible by KB(4), then an additional sector has to be erased.
-  uint32_t noOfEraseRunsB4Boundary = 0;
-  uint32_t noOf4KBEraseRuns, KB64Blocks, KB32Blocks, KB4Blocks, totalBlocks;
-
-  if (_sz/KB(4)) {
-    noOf4KBEraseRuns = _sz/KB(4);
-  }
-  else {
-    noOf4KBEraseRuns = 1;
-  }
-  KB64Blocks = noOf4KBEraseRuns/16;
-  KB32Blocks = (noOf4KBEraseRuns % 16) / 8;
-  KB4Blocks = (noOf4KBEraseRuns % 8);
-  totalBlocks = KB64Blocks + KB32Blocks + KB4Blocks;
-  //Serial.print(F("noOf4KBEraseRuns: "));
-  //Serial.println(noOf4KBEraseRuns);
-  //Serial.print(F("totalBlocks: "));
-  //Serial.println(totalBlocks);
-
-  uint16_t _eraseFuncOrder[totalBlocks];
-
-  if (KB64Blocks) {
-    for (uint32_t i = 0; i < KB64Blocks; i++) {
-      _eraseFuncOrder[i] = kb64Erase.opcode;
-    }
+  if (!_sz) {
+    _sz = 1;
   }
-  if (KB32Blocks) {
-    for (uint32_t i = KB64Blocks; i < (KB64Blocks + KB32Blocks); i++) {
-      _eraseFuncOrder[i] = kb32Erase.opcode;
-    }
-  }
-  if (KB4Blocks) {
-    for (uint32_t i = (KB64Blocks + KB32Blocks); i < totalBlocks; i++) {
-      _eraseFuncOrder[i] = kb4Erase.opcode;
-    }
-  }
-
-// Now that the number of blocks to be erased have been calculated and the information saved, the erase function is carried out.
-  if (_addressOverflow) {
-    noOfEraseRunsB4Boundary = (_sz - _addressOverflow)/16;
-    noOfEraseRunsB4Boundary += ((_sz - _addressOverflow) % 16) / 8;
-    noOfEraseRunsB4Boundary += ((_sz - _addressOverflow) % 8);
-    //Serial.print(F("noOfEraseRunsB4Boundary: "));
-    //Serial.println(noOfEraseRunsB4Boundary);
-  }
-  if (!_addressOverflow) {
-    for (uint32_t j = 0; j < totalBlocks; j++) {
-      _beginSPI(_eraseFuncOrder[j]);   //The address is transferred as a part of this function
-      _endSPI();
-
-
-      //Serial.printF("_eraseFuncOrder: 0x"));
-      //Serial.println(_eraseFuncOrder[j], HEX);
+  _end = _addr + _sz;
+  _end += (_unit - (_end % _unit)) % _unit;
+  _addr -= _addr % _unit;
 
-      uint16_t _timeFactor = 0;
-      if (_eraseFuncOrder[j] == kb64Erase.opcode) {
-        _timeFactor = kb64Erase.time;
-      }
-      if (_eraseFuncOrder[j] == kb32Erase.opcode) {
-        _timeFactor = kb32Erase.time;
-      }
-      if (_eraseFuncOrder[j] == kb4Erase.opcode) {
-        _timeFactor = kb4Erase.time;
-      }
-      if(!_notBusy(_timeFactor * 1000L)) {
-        return false;
-      }
-      if (j == noOfEraseRunsB4Boundary) {
-        if (!_prep(ERASEFUNC, (_addr + (_sz - _addressOverflow)), _sz)) {
-          return false;
-        }
-        //Serial.print(F("Overflow triggered"));
+  while (_addr < _end) {
+    for (i = 0; i < 4; i++) {
+      if (_erase[i]->supported && !(_addr % _eraseSz[i]) && _eraseSz[i] <= _end - _addr) {
+        break;
       }
     }
+    if (!_prep(ERASEFUNC, _addr, _eraseSz[i])) {
+      return false;
+    }
+    _beginSPI(_erase[i]->opcode);   //The address is transferred as a part of this function
+    _endSPI();
+    if(!_notBusy(_erase[i]->time)) {
+      return false;
+    }
+    _addr += _eraseSz[i];
   }
-  //_writeDisable();
   #ifdef RUNDIAGNOSTIC
     _spifuncruntime = micros() - _spifuncruntime;
   #endif
@@ -223,6 +223,11 @@
 
      default:
      _nextByte(WRITE, opcode);
+     // Erase opcodes read from SFDP take an address as the standard ones do
+     if ((kb4Erase.supported && opcode == kb4Erase.opcode) || (kb32Erase.supported && opcode == kb32Erase.opcode) ||
+         (kb64Erase.supported && opcode == kb64Erase.opcode) || (kb256Erase.supported && opcode == kb256Erase.opcode)) {
+       _transferAddress();
+     }
      break;
    }
    return true;
@@ -271,7 +276,7 @@
        #ifdef ENABLEZERODMA
          spi_read(&(*data_buffer), size);
        #else
-         _spi->transfer(&data_buffer[0], size);
+         _spi->transfer(NULL, &data_buffer[0], size);
        #endif
      #elif defined (ARDUINO_ARCH_AVR)
        SPI.transfer(&(*data_buffer), size);
@@ -290,7 +295,7 @@
        #ifdef ENABLEZERODMA
          spi_write(&(*data_buffer), size);
        #else
-         _spi->transfer(&data_buffer[0], size);
+         _spi->transfer(&data_buffer[0], NULL, size);  // data_buffer is kept for errorCheck
        #endif
      #elif defined (ARDUINO_ARCH_AVR)
        SPI.transfer(&(*data_buffer), size);
@@ -531,6 +536,7 @@
    kb32Erase.time = kb4Erase.time * 8;
    kb64Erase.time = kb32Erase.time * 4;
    kb256Erase.supported = false;
+   kb256Erase.time = BUSY_TIMEOUT;
    chipErase.opcode = CHIPERASE;
    chipErase.time = kb64Erase.time * 100L;
    _pageSize = SPI_PAGESIZE;
@@ -142,171 +142,105 @@ uint32_t SPIFlash::_calcSFDPEraseTimeUnits(uint8_t _unitBits) {
   return false;
 }
 
+// Gets the erase types from SFDP tables - if available. Types 1 to 4 are in DWORDs 8 and 9, a size as a power
+// of 2 and its opcode. Their times are in DWORD 10, in the same order (Refer to JESD216B Page 20). Sizes the
+// part does not list are marked unsupported, so eraseSection() only uses what the part has.
 void SPIFlash::_getSFDPEraseParam(void) {
-  // Get sector erase details if available on SFDP Tables
-  if (_noOfBasicParamDwords >= SFDP_ERASE1_INSTRUCTION_DWORD) {
-    uint32_t _eraseInfoAddress;
-    uint8_t _eraseInfo[8];
-    uint8_t _eraseExists = 0;
-    uint8_t _count;
-    uint32_t _units;
-    union {
-      uint32_t dword;
-      uint8_t byte[4];
-    } _eraseTime;
-    _eraseInfoAddress = ADDRESSOFSFDPDWORD(_BasicParamTableAddr, SFDP_ERASE1_INSTRUCTION_DWORD);
-    _getSFDPData(_eraseInfoAddress, &(*_eraseInfo), 8);
-
-    for (uint8_t i = 0; i < 8; i++) {
-      _eraseExists += _eraseInfo[i];
-      if (!_eraseExists) { // If faulty SFDP read, then revert to defaults
-          kb4Erase.supported = kb32Erase.supported = kb64Erase.supported = chipErase.supported = true;
-          kb4Erase.opcode = SECTORERASE;
-          kb32Erase.opcode = BLOCK32ERASE;
-          kb64Erase.opcode = BLOCK64ERASE;
-          kb4Erase.time = BUSY_TIMEOUT;
-          kb32Erase.time = kb4Erase.time * 8;
-          kb64Erase.time = kb32Erase.time * 4;
-          kb256Erase.supported = false;
-          chipErase.opcode = CHIPERASE;
-          chipErase.time = kb64Erase.time * 100L;
-        _troubleshoot(NOSFDPERASEPARAM);
-      }
-    }
-    for (uint8_t i = 0; i < 8; i++) {
-      if ((i % 2) == 0) {
-        switch ((_eraseInfo[i])) {
-          case KB4ERASE_TYPE:
-          kb4Erase.supported = true;
-          kb4Erase.opcode = _eraseInfo[i+1];
-          break;
-
-          case KB32ERASE_TYPE:
-          kb32Erase.supported = true;
-          kb32Erase.opcode = _eraseInfo[i+1];
-          break;
-
-          case KB64ERASE_TYPE:
-          kb64Erase.supported = true;
-          kb64Erase.opcode = _eraseInfo[i+1];
-          break;
-
-          case KB256ERASE_TYPE:
-          kb256Erase.supported = true;
-          kb256Erase.opcode = _eraseInfo[i+1];
-          break;
-        }
-      }
-    }
-    // Some flash memory chips have information about sector erase times in DWORD 10 of SFDP Basic param table.
-    if (_noOfBasicParamDwords >= SFDP_SECTOR_ERASE_TIME_DWORD) {
-      _eraseTime.dword = _getSFDPdword(_BasicParamTableAddr, SFDP_SECTOR_ERASE_TIME_DWORD);
-      _eraseTimeMultiplier = _eraseTime.byte[0];
-      setUpperNibble(_eraseTimeMultiplier, 0b0000);
-      _eraseTimeMultiplier = 2 * (_eraseTimeMultiplier + 1);  // Refer JESD216B Page 21
-
-      for (uint8_t i = 0; i < 8; i++) {
-        if ((i % 2) == 0) {
-          switch ((_eraseInfo[i])) {
-            case KB4ERASE_TYPE:
-            _count = ( ( ( (_eraseTime.byte[1] & _createMask(0, 0)) << 5) | ( (_eraseTime.byte[0] & _createMask(4, 7)) ) >> 4) + 1);
-            _units = _calcSFDPEraseTimeUnits((_eraseTime.byte[1] & _createMask(1, 2)) >> 1);
-            kb4Erase.time = (_count * _units * _eraseTimeMultiplier);
-            break;
-
-            case KB32ERASE_TYPE:
-            _count = (((_eraseTime.byte[1] & _createMask(3, 7)) >> 3) + 1);
-            _units = _calcSFDPEraseTimeUnits(_eraseTime.byte[2] & _createMask(0, 1));
-            kb32Erase.time = (_count * _units * _eraseTimeMultiplier);
-            break;
-
-            case KB64ERASE_TYPE:
-            _count = (((_eraseTime.byte[2] & _createMask(2, 6)) >> 2) + 1);
-            _units = _calcSFDPEraseTimeUnits(((_eraseTime.byte[2] & _createMask(7, 7)) >> 7) | (_eraseTime.byte[3] & _createMask(0,0)) << 1);
-            kb64Erase.time = (_count * _units * _eraseTimeMultiplier);
-            break;
-
-            case KB256ERASE_TYPE:
-            _count = (((_eraseTime.byte[3] & _createMask(1, 5)) >> 1) + 1);
-            _units = _calcSFDPEraseTimeUnits((_eraseTime.byte[3] & _createMask(6, 7)) >> 6);
-            kb64Erase.time = (_count * _units) * _eraseTimeMultiplier;
-            break;
-          }
-        }
-      }
-
-      // Some flash memory chips have information about chip erase times in DWORD 11 of SFDP Basic param table.
-      if (_noOfBasicParamDwords >= SFDP_CHIP_ERASE_TIME_DWORD) {
-        // Get chip erase details
-        _eraseInfoAddress = ADDRESSOFSFDPDWORD(_BasicParamTableAddr, DWORD(11));
-        _getSFDPData(_eraseInfoAddress, &(*_eraseInfo), 8);
-        chipErase.supported = true; // chipErase.opcode is set in _chipID().
-        _count = (((_eraseTime.byte[3] & _createMask(0, 4))) + 1);
-        _units = _calcSFDPEraseTimeUnits((_eraseTime.byte[3] & _createMask(5, 6)) >> 5);
-        chipErase.time = (_count * _units) * _eraseTimeMultiplier;
-      }
+  if (_noOfBasicParamDwords < SFDP_ERASE2_INSTRUCTION_DWORD) {
+    _troubleshoot(NOSFDPERASEPARAM);
+    return;
+  }
+  uint8_t _eraseInfo[8];
+  uint32_t _eraseTime = 0;
+  uint32_t _units;
+  uint64_t _chipTime;
+  uint8_t _count;
+  eraseParam *_type;
+
+  _getSFDPData(ADDRESSOFSFDPDWORD(_BasicParamTableAddr, SFDP_ERASE1_INSTRUCTION_DWORD), &(*_eraseInfo), 8);
+  if (!(_eraseInfo[0] | _eraseInfo[2] | _eraseInfo[4] | _eraseInfo[6])) {
+    _troubleshoot(NOSFDPERASEPARAM); // If faulty SFDP read, then keep the defaults set by _chipID()
+    return;
+  }
+  if (_noOfBasicParamDwords >= SFDP_SECTOR_ERASE_TIME_DWORD) {
+    _eraseTime = _getSFDPdword(_BasicParamTableAddr, SFDP_SECTOR_ERASE_TIME_DWORD);
+    _eraseTimeMultiplier = 2 * ((_eraseTime & 0x0F) + 1);  // Typical to maximum time
+  }
+  else { //If flash memory does not have any sfdp information about sector erase times
+    _troubleshoot(NOSFDPERASETIME);
+  }
 
+  kb4Erase.supported = kb32Erase.supported = kb64Erase.supported = kb256Erase.supported = false;
+  for (uint8_t i = 0; i < 4; i++) {
+    switch (_eraseInfo[2 * i]) {
+      case KB4ERASE_TYPE:
+      _type = &kb4Erase;
+      break;
+
+      case KB32ERASE_TYPE:
+      _type = &kb32Erase;
+      break;
+
+      case KB64ERASE_TYPE:
+      _type = &kb64Erase;
+      break;
+
+      case KB256ERASE_TYPE:
+      _type = &kb256Erase;
+      break;
+
+      default:
+      continue;
     }
-    else { //If flash memory does not have any sfdp information about sector erase times
-      _troubleshoot(NOSFDPERASETIME);
-      kb4Erase.time = BUSY_TIMEOUT;
-      kb32Erase.time = kb4Erase.time * 8;
-      kb64Erase.time = kb32Erase.time * 4;
-      kb256Erase.supported = false;
-      chipErase.opcode = CHIPERASE;
-      chipErase.time = kb64Erase.time * 100L;
+    _type->supported = true;
+    _type->opcode = _eraseInfo[(2 * i) + 1];
+    if (_eraseTime) {
+      // Erase type i + 1 has a 5 bit count from bit 4 + 7i, then 2 bits of units
+      _count = ((_eraseTime >> (4 + (7 * i))) & 0x1F) + 1;
+      _units = _calcSFDPEraseTimeUnits((_eraseTime >> (9 + (7 * i))) & 0x03);
+      _type->time = _count * _units * _eraseTimeMultiplier;
     }
-
   }
-  else {
-    _troubleshoot(NOSFDPERASEPARAM);
+
+  // Some flash memory chips have information about chip erase times in DWORD 11 of SFDP Basic param table.
+  if (_eraseTime && _noOfBasicParamDwords >= SFDP_CHIP_ERASE_TIME_DWORD) {
+    uint32_t _dword = _getSFDPdword(_BasicParamTableAddr, SFDP_CHIP_ERASE_TIME_DWORD);
+    const uint32_t _chipUnits[4] = {16000L, 256000L, 4000000L, 64000000L};  // 16ms, 256ms, 4s and 64s
+    chipErase.supported = true; // chipErase.opcode is set in _chipID().
+    _chipTime = (uint64_t)(((_dword >> 24) & 0x1F) + 1) * _chipUnits[(_dword >> 29) & 0x03] * _eraseTimeMultiplier;
+    chipErase.time = (_chipTime > BUSY_TIMEOUT) ? BUSY_TIMEOUT : (uint32_t)_chipTime;
   }
 }
 
-// Gets IO timing information from SFDP tables - if available.
+// Gets page size and program timing information from DWORD 11 of the SFDP tables - if available (Refer to JESD216B Page 22).
 void SPIFlash::_getSFDPProgramTimeParam(void) {
   if (_noOfBasicParamDwords >= SFDP_PROGRAM_TIME_DWORD) {
-    union {
-      uint32_t dword;
-      uint8_t byte[4];
-    } _sfdp;
+    uint32_t _sfdp;
     uint8_t _count;
     uint32_t _units;
 
-    _sfdp.dword= _getSFDPdword(_BasicParamTableAddr, SFDP_PROGRAM_TIME_DWORD);
+    _sfdp = _getSFDPdword(_BasicParamTableAddr, SFDP_PROGRAM_TIME_DWORD);
 
     //Calculate Program time multiplier
-    _prgmTimeMultiplier = (2 * ((_sfdp.byte[1] >> 4) + 1));
-    //Serial.print("_prgmTimeMultiplier: ");
-    //Serial.println(_prgmTimeMultiplier);
+    _prgmTimeMultiplier = 2 * ((_sfdp & 0x0F) + 1);
 
-    // Get pageSize
-    //setUpperNibble(_eraseTimeMultiplier, 0b0000);
-    _pageSize = setUpperNibble(_sfdp.byte[1], 0b0000);
-    _pageSize *= 2;
-    //Serial.print("_pageSize: ");
-    //Serial.println(_pageSize);
+    // Get pageSize, 2^N bytes
+    _pageSize = ((_sfdp >> 4) & 0x0F) ? (1 << ((_sfdp >> 4) & 0x0F)) : SPI_PAGESIZE;
 
     //Calculate Page Program time
-    _count = (((_sfdp.byte[1] & _createMask(0, 4))) + 1);
-    ((_sfdp.byte[1] & _createMask(7, 7)) >> 7) ? (_units = 64) : (_units = 8);
+    _count = ((_sfdp >> 8) & 0x1F) + 1;
+    _units = (_sfdp & (1UL << 13)) ? 64 : 8;
     _pagePrgmTime = (_count * _units) * _prgmTimeMultiplier;
-    //Serial.print("_pagePrgmTime: ");
-    //Serial.println(_pagePrgmTime);
 
     //Calculate First Byte Program time
-    _count = ( (((_sfdp.byte[1] & _createMask(6, 7)) >> 4) | (((_sfdp.byte[2] & _createMask(6, 7))) >> 6)) + 1);
-    ((_sfdp.byte[2] & _createMask(5, 5)) >> 5) ? (_units = 8) : (_units = 1);
+    _count = ((_sfdp >> 14) & 0x0F) + 1;
+    _units = (_sfdp & (1UL << 18)) ? 8 : 1;
     _byteFirstPrgmTime = (_count * _units) * _prgmTimeMultiplier;
-    //Serial.print("_byteFirstPrgmTime :");
-    //Serial.println(_byteFirstPrgmTime);
 
     //Calculate Additional Byte Program time
-    _count = ( ((_sfdp.byte[2] & _createMask(4, 1)) >> 1) + 1);
-    (_sfdp.byte[2] & _createMask(0, 0)) ? (_units = 8) : (_units = 1);
+    _count = ((_sfdp >> 19) & 0x0F) + 1;
+    _units = (_sfdp & (1UL << 23)) ? 8 : 1;
     _byteAddnlPrgmTime = (_count * _units) * _prgmTimeMultiplier;
-    //Serial.print("_byteAddnlPrgmTime :");
-    //Serial.println(_byteAddnlPrgmTime);
   }
   else {
     _pageSize = SPI_PAGESIZE;
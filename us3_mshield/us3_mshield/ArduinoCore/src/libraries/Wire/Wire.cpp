@@ -32,6 +32,7 @@ TwoWire::TwoWire(SERCOM * s, uint8_t pinSDA, uint8_t pinSCL)
   this->_uc_pinSDA=pinSDA;
   this->_uc_pinSCL=pinSCL;
   transmissionBegun = false;
+  asyncHead = asyncTail = NULL;
 }
 
 void TwoWire::begin(void) {
@@ -71,6 +72,9 @@ uint8_t TwoWire::requestFrom(uint8_t address, size_t quantity, bool stopBit)
 
   size_t byteRead = 0;
 
+  // Not in the middle of a queued transaction
+  while (asyncHead);
+
   rxBuffer.clear();
 
   if(sercom->startTransmissionWIRE(address, WIRE_READ_FLAG))
@@ -120,6 +124,9 @@ uint8_t TwoWire::endTransmission(bool stopBit)
 {
   transmissionBegun = false ;
 
+  // Not in the middle of a queued transaction
+  while (asyncHead);
+
   // Start I2C transmission
   if ( !sercom->startTransmissionWIRE( txAddress, WIRE_WRITE_FLAG ) )
   {
@@ -209,10 +216,137 @@ void TwoWire::onRequest(void(*function)(void))
   onRequestCallback = function;
 }
 
+bool TwoWire::submit(WireTransaction *t)
+{
+  if (t->status == WIRE_PENDING || (!t->txLength && !t->rxLength))
+  {
+    return false;
+  }
+  t->status = WIRE_PENDING;
+  t->next = NULL;
+
+  noInterrupts();
+  if (asyncHead)
+  {
+    asyncTail->next = t;
+    asyncTail = t;
+    interrupts();
+    return true;
+  }
+  asyncHead = asyncTail = t;
+  interrupts();
+
+  asyncStart();
+  return true;
+}
+
+// The address of the head, its write first; the rest follows from onMasterService
+void TwoWire::asyncStart(void)
+{
+  WireTransaction *t = asyncHead;
+
+  asyncPos = 0;
+  asyncReading = t->txLength == 0;
+  sercom->enableMasterInterruptsWIRE();
+  sercom->startAddressWIRE(t->address, asyncReading ? WIRE_READ_FLAG : WIRE_WRITE_FLAG);
+}
+
+// The head done, with the stop sent, and the next started
+void TwoWire::asyncFinish(uint8_t status)
+{
+  WireTransaction *t = asyncHead;
+  WireTransaction *next = t->next;
+
+  sercom->disableMasterInterruptsWIRE();
+  asyncHead = next;
+  if (!next)
+  {
+    asyncTail = NULL;
+  }
+  t->next = NULL;
+  t->status = status;
+  // A submit from onComplete to an empty queue starts itself
+  if (t->onComplete)
+  {
+    t->onComplete(t);
+  }
+  if (next)
+  {
+    asyncStart();
+  }
+}
+
+// MB for each address or byte written, SB for each byte read, errors with either
+void TwoWire::onMasterService(void)
+{
+  WireTransaction *t = asyncHead;
+  uint8_t flags = sercom->getInterruptFlagsWIRE();
+
+  if (!t)
+  {
+    sercom->disableMasterInterruptsWIRE();
+    return;
+  }
+  if ((flags & SERCOM_I2CM_INTFLAG_ERROR) || sercom->isMasterErrorWIRE())
+  {
+    sercom->clearMasterErrorWIRE();
+    sercom->prepareCommandBitsWire(WIRE_MASTER_ACT_STOP);
+    asyncFinish(4);
+    return;
+  }
+
+  if (flags & SERCOM_I2CM_INTFLAG_SB)
+  {
+    t->rxData[asyncPos++] = sercom->readDataMasterWIRE();
+    if (asyncPos < t->rxLength)
+    {
+      sercom->prepareAckBitWIRE();
+      sercom->prepareCommandBitsWire(WIRE_MASTER_ACT_READ);
+    }
+    else
+    {
+      sercom->prepareNackBitWIRE();
+      sercom->prepareCommandBitsWire(WIRE_MASTER_ACT_STOP);
+      asyncFinish(0);
+    }
+    return;
+  }
+
+  if (flags & SERCOM_I2CM_INTFLAG_MB)
+  {
+    if (asyncReading || sercom->isRXNackReceivedWIRE())
+    {
+      // A NACK of the address, MB rather than SB for a read, or of data
+      sercom->prepareCommandBitsWire(WIRE_MASTER_ACT_STOP);
+      asyncFinish(asyncReading || asyncPos == 0 ? 2 : 3);
+      return;
+    }
+    if (asyncPos < t->txLength)
+    {
+      sercom->writeDataMasterWIRE(t->txData[asyncPos++]);
+    }
+    else if (t->rxLength)
+    {
+      asyncPos = 0;
+      asyncReading = true;
+      sercom->startAddressWIRE(t->address, WIRE_READ_FLAG);
+    }
+    else
+    {
+      sercom->prepareCommandBitsWire(WIRE_MASTER_ACT_STOP);
+      asyncFinish(0);
+    }
+  }
+}
+
 #if (SAMD51)
 void TwoWire::onStopDetected(void)
 {
-  if ( sercom->isSlaveWIRE() )
+  if ( sercom->isMasterWIRE() )
+  {
+    onMasterService();
+  }
+  else if ( sercom->isSlaveWIRE() )
   {
     sercom->prepareAckBitWIRE();
     sercom->prepareCommandBitsWire(0x03);
@@ -229,7 +363,11 @@ void TwoWire::onStopDetected(void)
 
 void TwoWire::onAddressMatch(void)
 {
-  if ( sercom->isSlaveWIRE() )
+  if ( sercom->isMasterWIRE() )
+  {
+    onMasterService();
+  }
+  else if ( sercom->isSlaveWIRE() )
   {
     sercom->prepareAckBitWIRE();
     sercom->prepareCommandBitsWire(0x03);
@@ -291,7 +429,11 @@ void TwoWire::onDataReady(void)
 #else
 void TwoWire::onService(void)
 {
-  if ( sercom->isSlaveWIRE() )
+  if ( sercom->isMasterWIRE() )
+  {
+    onMasterService();
+  }
+  else if ( sercom->isSlaveWIRE() )
   {
     if(sercom->isStopDetectedWIRE() || 
         (sercom->isAddressMatch() && sercom->isRestartDetectedWIRE() && !sercom->isMasterReadOperationWIRE())) //Stop or Restart detected
@@ -8,17 +8,31 @@ written by Adafruit Industries
 
 #define MIN_INTERVAL 2000
 
+// Host start signal, the DHT11 wants the line low for 18 ms at least.
+#define START_MS 20
+// The response and the 40 bits take 5 ms at most.
+#define FRAME_MS 8
+// Falling edge to falling edge of a bit: 50 us low then ~28 us high for a
+// 0, ~70 us high for a 1.
+#define BIT_US 100
+#define BIT_MIN_US 50
+#define BIT_MAX_US 200
+
+// Where a background read is
+#define STATE_IDLE 0
+#define STATE_START 1
+#define STATE_FRAME 2
+
+DHT *DHT::_active;
+
 DHT::DHT(uint8_t pin, uint8_t type, uint8_t count) {
   _pin = pin;
   _type = type;
-  #ifdef __AVR
-    _bit = digitalPinToBitMask(pin);
-    _port = digitalPinToPort(pin);
-  #endif
-  _maxcycles = microsecondsToClockCycles(1000);  // 1 millisecond timeout for
-                                                 // reading pulses from DHT sensor.
-  // Note that count is now ignored as the DHT reading algorithm adjusts itself
-  // basd on the speed of the processor.
+  _state = STATE_IDLE;
+  _lastresult = false;
+  _nedges = 0;
+  // Note that count is now ignored as the bits are timed by the pin
+  // interrupt, not by the speed of the processor.
 }
 
 void DHT::begin(void) {
@@ -28,14 +42,18 @@ void DHT::begin(void) {
   // >= MIN_INTERVAL right away. Note that this assignment wraps around,
   // but so will the subtraction.
   _lastreadtime = -MIN_INTERVAL;
-  DEBUG_PRINT("Max clock cycles: "); DEBUG_PRINTLN(_maxcycles, DEC);
 }
 
 //boolean S == Scale.  True == Fahrenheit; False == Celcius
 float DHT::readTemperature(bool S, bool force) {
+  read(force);
+  return temperature(S);
+}
+
+float DHT::temperature(bool S) {
   float f = NAN;
 
-  if (read(force)) {
+  if (_lastresult) {
     switch (_type) {
     case DHT11:
       f = data[2];
@@ -70,8 +88,13 @@ float DHT::convertFtoC(float f) {
 }
 
 float DHT::readHumidity(bool force) {
+  read(force);
+  return humidity();
+}
+
+float DHT::humidity(void) {
   float f = NAN;
-  if (read()) {
+  if (_lastresult) {
     switch (_type) {
     case DHT11:
       f = data[0];
@@ -121,90 +144,113 @@ float DHT::computeHeatIndex(float temperature, float percentHumidity, bool isFah
 }
 
 boolean DHT::read(bool force) {
+  int8_t rc;
+
   // Check if sensor was read less than two seconds ago and return early
   // to use last reading.
-  uint32_t currenttime = millis();
-  if (!force && ((currenttime - _lastreadtime) < 2000)) {
-    return _lastresult; // return last correct measurement
+  if (_state == STATE_IDLE) {
+    if (!force && ((millis() - _lastreadtime) < MIN_INTERVAL)) {
+      return _lastresult; // return last correct measurement
+    }
+    start();
   }
-  _lastreadtime = currenttime;
 
-  // Reset 40 bits of received data to zero.
-  data[0] = data[1] = data[2] = data[3] = data[4] = 0;
+  // The UARTs keep their interrupts while this waits
+  while ((rc = poll()) == DHT_BUSY) {
+    yield();
+  }
+  return rc == DHT_OK;
+}
+
+bool DHT::start(void) {
+  if (_state != STATE_IDLE) {
+    return false;
+  }
+  _lastreadtime = millis();
 
   // Send start signal.  See DHT datasheet for full signal diagram:
   //   http://www.adafruit.com/datasheets/Digital%20humidity%20and%20temperature%20sensor%20AM2302.pdf
-
-  // Go into high impedence state to let pull-up raise data line level and
-  // start the reading process.
-  digitalWrite(_pin, HIGH);
-  delay(250);
-
-  // First set data line low for 20 milliseconds.
+  // The pull-up has held the line high since the last read, so it only
+  // has to be set low, for START_MS.
   pinMode(_pin, OUTPUT);
   digitalWrite(_pin, LOW);
-  delay(20);
+  _statetime = millis();
+  _state = STATE_START;
+  return true;
+}
 
-  uint32_t cycles[80];
-  {
-    // Turn off interrupts temporarily because the next sections are timing critical
-    // and we don't want any interruptions.
-    InterruptLock lock;
+bool DHT::busy(void) {
+  return _state != STATE_IDLE;
+}
 
-    // End the start signal by setting data line high for 40 microseconds.
-    digitalWrite(_pin, HIGH);
-    delayMicroseconds(40);
+int8_t DHT::poll(void) {
+  uint32_t now = millis();
 
-    // Now start reading the data line to get the value from the DHT sensor.
-    pinMode(_pin, INPUT_PULLUP);
-    delayMicroseconds(10);  // Delay a bit to let sensor pull data line low.
-
-    // First expect a low signal for ~80 microseconds followed by a high signal
-    // for ~80 microseconds again.
-    if (expectPulse(LOW) == 0) {
-      DEBUG_PRINTLN(F("Timeout waiting for start signal low pulse."));
-      _lastresult = false;
-      return _lastresult;
+  switch (_state) {
+  case STATE_START:
+    if ((now - _statetime) < START_MS) {
+      return DHT_BUSY;
     }
-    if (expectPulse(HIGH) == 0) {
-      DEBUG_PRINTLN(F("Timeout waiting for start signal high pulse."));
-      _lastresult = false;
-      return _lastresult;
+    // End the start signal, let the pull-up raise the line and time each
+    // falling edge the sensor then makes.
+    _nedges = 0;
+    _active = this;
+    pinMode(_pin, INPUT_PULLUP);
+    attachInterrupt(digitalPinToInterrupt(_pin), edge, FALLING);
+    _statetime = now;
+    _state = STATE_FRAME;
+    return DHT_BUSY;
+
+  case STATE_FRAME:
+    if ((now - _statetime) <= FRAME_MS) {
+      return DHT_BUSY;
     }
+    detachInterrupt(digitalPinToInterrupt(_pin));
+    _active = NULL;
+    pinMode(_pin, INPUT_PULLUP);
+    _state = STATE_IDLE;
+    _lastresult = decode();
+    break;
+  }
+  return _lastresult ? DHT_OK : DHT_ERR;
+}
 
-    // Now read the 40 bits sent by the sensor.  Each bit is sent as a 50
-    // microsecond low pulse followed by a variable length high pulse.  If the
-    // high pulse is ~28 microseconds then it's a 0 and if it's ~70 microseconds
-    // then it's a 1.  We measure the cycle count of the initial 50us low pulse
-    // and use that to compare to the cycle count of the high pulse to determine
-    // if the bit is a 0 (high state cycle count < low state cycle count), or a
-    // 1 (high state cycle count > low state cycle count). Note that for speed all
-    // the pulses are read into a array and then examined in a later step.
-    for (int i=0; i<80; i+=2) {
-      cycles[i]   = expectPulse(LOW);
-      cycles[i+1] = expectPulse(HIGH);
-    }
-  } // Timing critical code is now complete.
+// A falling edge on the line, from the pin interrupt. Only the time is
+// taken, the bits are worked out once the frame is in.
+void DHT::edge(void) {
+  DHT *d = _active;
+
+  if (d && d->_nedges < DHT_EDGES) {
+    d->_edges[d->_nedges++] = (uint16_t)micros();
+  }
+}
+
+// Each bit runs from the falling edge that starts its low pulse to the
+// next one: ~78 us apart for a 0, ~120 us for a 1. The last 41 edges are
+// those of the 40 bits and the closing pulse, the response or a glitch
+// as the line was let go may come before them.
+bool DHT::decode(void) {
+  uint8_t n = _nedges;
+  uint16_t us;
+
+  // Reset 40 bits of received data to zero.
+  data[0] = data[1] = data[2] = data[3] = data[4] = 0;
 
-  // Inspect pulses and determine which ones are 0 (high state cycle count < low
-  // state cycle count), or 1 (high state cycle count > low state cycle count).
+  if (n < 41) {
+    DEBUG_PRINT(F("Timeout waiting for pulse, edges ")); DEBUG_PRINTLN(n, DEC);
+    return false;
+  }
+  n -= 41;
   for (int i=0; i<40; ++i) {
-    uint32_t lowCycles  = cycles[2*i];
-    uint32_t highCycles = cycles[2*i+1];
-    if ((lowCycles == 0) || (highCycles == 0)) {
-      DEBUG_PRINTLN(F("Timeout waiting for pulse."));
-      _lastresult = false;
-      return _lastresult;
+    us = _edges[n + i + 1] - _edges[n + i];
+    if ((us < BIT_MIN_US) || (us > BIT_MAX_US)) {
+      DEBUG_PRINTLN(F("Bad pulse."));
+      return false;
     }
     data[i/8] <<= 1;
-    // Now compare the low and high cycle times to see if the bit is a 0 or 1.
-    if (highCycles > lowCycles) {
-      // High cycles are greater than 50us low cycle count, must be a 1.
+    if (us > BIT_US) {
       data[i/8] |= 1;
     }
-    // Else high cycles are less than (or equal to, a weird case) the 50us low
-    // cycle count so this must be a zero.  Nothing needs to be changed in the
-    // stored data.
   }
 
   DEBUG_PRINTLN(F("Received:"));
@@ -217,43 +263,8 @@ boolean DHT::read(bool force) {
 
   // Check we read 40 bits and that the checksum matches.
   if (data[4] == ((data[0] + data[1] + data[2] + data[3]) & 0xFF)) {
-    _lastresult = true;
-    return _lastresult;
-  }
-  else {
-    DEBUG_PRINTLN(F("Checksum failure!"));
-    _lastresult = false;
-    return _lastresult;
+    return true;
   }
-}
-
-// Expect the signal line to be at the specified level for a period of time and
-// return a count of loop cycles spent at that level (this cycle count can be
-// used to compare the relative time of two pulses).  If more than a millisecond
-// ellapses without the level changing then the call fails with a 0 response.
-// This is adapted from Arduino's pulseInLong function (which is only available
-// in the very latest IDE versions):
-//   https://github.com/arduino/Arduino/blob/master/hardware/arduino/avr/cores/arduino/wiring_pulse.c
-uint32_t DHT::expectPulse(bool level) {
-  uint32_t count = 0;
-  // On AVR platforms use direct GPIO port access as it's much faster and better
-  // for catching pulses that are 10's of microseconds in length:
-  #ifdef __AVR
-    uint8_t portState = level ? _bit : 0;
-    while ((*portInputRegister(_port) & _bit) == portState) {
-      if (count++ >= _maxcycles) {
-        return 0; // Exceeded timeout, fail.
-      }
-    }
-  // Otherwise fall back to using digitalRead (this seems to be necessary on ESP8266
-  // right now, perhaps bugs in direct port access functions?).
-  #else
-    while (digitalRead(_pin) == level) {
-      if (count++ >= _maxcycles) {
-        return 0; // Exceeded timeout, fail.
-      }
-    }
-  #endif
-
-  return count;
+  DEBUG_PRINTLN(F("Checksum failure!"));
+  return false;
 }
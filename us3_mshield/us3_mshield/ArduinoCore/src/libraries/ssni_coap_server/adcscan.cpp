@@ -0,0 +1,391 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+#include "adcscan.h"
+#include "wiring_private.h"
+#include "wiring_evsys.h"
+#include "log.h"
+
+
+#if (SAML21) && defined(DMAC_CHANNELS_MAX)
+
+extern "C" uint8_t ADCinitialized;
+
+/* MUXNEG of a single ended conversion, not named by the headers */
+#define ADC_SCAN_MUXNEG_GND     0x18
+
+/* Shift of each TC prescaler setting, DIV1 to DIV1024 */
+static const uint8_t adc_scan_tc_shift[] = { 0, 1, 2, 3, 4, 6, 8, 10 };
+
+static uint16_t adc_scan_buf[2][ADC_SCAN_BLOCK * ADC_SCAN_MAX];
+static DmacDescriptor adc_scan_link DMAC_DESCRIPTOR_ALIGN;
+
+static struct adc_scan_cfg adc_scan_cur;
+static uint8_t adc_scan_n;                  /* inputs, 0 when stopped */
+static uint8_t adc_scan_ain[ADC_SCAN_MAX];  /* their AIN, in scan order */
+static uint8_t adc_scan_avg;
+static uint8_t adc_scan_evsys = EVSYS_NO_CHANNEL;   /* TC4 to the ADC */
+static uint8_t adc_scan_dma = DMAC_NO_CHANNEL;      /* RESULT to the buffer */
+static adc_scan_block_fn adc_scan_block_cb;
+static volatile uint8_t adc_scan_err;
+static volatile uint32_t adc_scan_nblocks;
+
+/* The ADC as analogRead() had it, for adc_scan_stop */
+static uint8_t adc_scan_ctrlb;
+static uint16_t adc_scan_ctrlc;
+static uint8_t adc_scan_avgctrl;
+static uint8_t adc_scan_sampctrl;
+static uint16_t adc_scan_inputctrl;
+
+
+static void
+adc_scan_sync(void)
+{
+    while (ADC->SYNCBUSY.reg);
+}
+
+
+/* From DMAC_Handler, with the flags of the ADC channel taken and cleared */
+static void
+adc_scan_dma_done(uint8_t flags, void *context)
+{
+    adc_scan_block_fn fn = adc_scan_block_cb;
+
+    if (flags & DMAC_CHINTFLAG_TCMPL) {
+        adc_scan_nblocks++;
+        if (fn) {
+            fn(adc_scan_buf[(adc_scan_nblocks - 1) & 1], adc_scan_n * ADC_SCAN_BLOCK);
+        }
+    }
+    if (flags & DMAC_CHINTFLAG_TERR) {
+        adc_scan_err = 1;
+    }
+}
+
+
+/* TC4 overflowing rate_hz times a second, its event out */
+static void
+adc_scan_tc_start(uint32_t rate_hz)
+{
+    uint32_t count;
+    uint8_t presc;
+
+    /* The finest prescaler the period fits 16 bits with */
+    for (presc = 0; ; presc++) {
+        count = ((F_CPU >> adc_scan_tc_shift[presc]) + rate_hz / 2) / rate_hz;
+        if (count <= 0x10000 || presc == sizeof(adc_scan_tc_shift) - 1) {
+            break;
+        }
+    }
+    count = constrain(count, 2, 0x10000);
+
+    MCLK->APBDMASK.reg |= MCLK_APBDMASK_TC4;
+    GCLK->PCHCTRL[GCM_TC4].reg = GCLK_PCHCTRL_CHEN | GCLK_PCHCTRL_GEN_GCLK0;
+    while ((GCLK->PCHCTRL[GCM_TC4].reg & GCLK_PCHCTRL_CHEN) != GCLK_PCHCTRL_CHEN);
+
+    TC4->COUNT16.CTRLA.reg = TC_CTRLA_SWRST;
+    while (TC4->COUNT16.SYNCBUSY.reg & TC_SYNCBUSY_SWRST);
+    TC4->COUNT16.CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_PRESCALER(presc) | TC_CTRLA_RUNSTDBY;
+    TC4->COUNT16.WAVE.reg = TC_WAVE_WAVEGEN_MFRQ;
+    TC4->COUNT16.CC[0].reg = count - 1;
+    while (TC4->COUNT16.SYNCBUSY.reg & TC_SYNCBUSY_CC0);
+    TC4->COUNT16.EVCTRL.reg = TC_EVCTRL_OVFEO;
+    TC4->COUNT16.CTRLA.reg |= TC_CTRLA_ENABLE;
+    while (TC4->COUNT16.SYNCBUSY.reg & TC_SYNCBUSY_ENABLE);
+}
+
+
+/* The two halves, each descriptor linked to the other, on RESRDY */
+static void
+adc_scan_dma_start(void)
+{
+    uint16_t total = adc_scan_n * ADC_SCAN_BLOCK;
+    DmacDescriptor *d = dmacDescriptor(adc_scan_dma);
+    DmacDescriptor *half[2] = { d, &adc_scan_link };
+    uint8_t i;
+
+    for (i = 0; i < 2; i++) {
+        half[i]->BTCTRL.reg = DMAC_BTCTRL_VALID | DMAC_BTCTRL_BEATSIZE_HWORD | DMAC_BTCTRL_DSTINC |
+                              DMAC_BTCTRL_BLOCKACT_INT;
+        half[i]->BTCNT.reg = total;
+        half[i]->SRCADDR.reg = (uint32_t)&ADC->RESULT.reg;
+        /* the end of the block, as it counts up */
+        half[i]->DSTADDR.reg = (uint32_t)&adc_scan_buf[i][total];
+        dmacLink(half[i], half[i ^ 1]);
+    }
+
+    dmacAttach(adc_scan_dma, adc_scan_dma_done, NULL);
+    dmacStart(adc_scan_dma, DMAC_CHCTRLB_LVL(0) | DMAC_CHCTRLB_TRIGSRC(ADC_DMAC_ID_RESRDY) |
+              DMAC_CHCTRLB_TRIGACT_BEAT, DMAC_CHINTENSET_TCMPL | DMAC_CHINTENSET_TERR, true);
+}
+
+
+int
+adc_scan_start(const uint8_t *pins, uint8_t n, uint32_t rate_hz, uint8_t avg_log2)
+{
+    uint32_t seq = 0;
+    uint8_t adjres;
+    uint8_t i;
+
+    if (!n || n > ADC_SCAN_MAX || avg_log2 > ADC_SCAN_AVG_MAX) {
+        return ADC_SCAN_ERR_ARG;
+    }
+    for (i = 0; i < n; i++) {
+        if (!(g_APinDescription[pins[i]].ulPinAttribute & PIN_ATTR_ADC) ||
+            (seq & (1ul << GetADC(pins[i])))) {
+            return ADC_SCAN_ERR_ARG;
+        }
+        seq |= 1ul << GetADC(pins[i]);
+    }
+    if (!rate_hz || rate_hz > ADC_SCAN_CONV_HZ ||
+        ((rate_hz * n) << avg_log2) > ADC_SCAN_CONV_HZ) {
+        return ADC_SCAN_ERR_RATE;
+    }
+
+    adc_scan_stop();
+    adc_scan_dma = dmacAlloc();
+    if (adc_scan_dma == DMAC_NO_CHANNEL) {
+        return ADC_SCAN_ERR_DMAC;
+    }
+    adc_scan_evsys = evsysAlloc();
+    if (adc_scan_evsys == EVSYS_NO_CHANNEL) {
+        dmacFree(adc_scan_dma);
+        adc_scan_dma = DMAC_NO_CHANNEL;
+        return ADC_SCAN_ERR_EVSYS;
+    }
+    if (!ADCinitialized) {
+        initADC();
+    }
+    for (i = 0; i < n; i++) {
+        pinPeripheral(pins[i], PIO_ANALOG_ADC);
+    }
+    for (i = 0; i < 32; i++) {
+        if (seq & (1ul << i)) {
+            adc_scan_ain[adc_scan_n++] = i;
+        }
+    }
+    memcpy(adc_scan_cur.pins, pins, n);
+    adc_scan_cur.n = n;
+    adc_scan_cur.rate_hz = rate_hz;
+    adc_scan_cur.avg_log2 = avg_log2;
+    adc_scan_avg = avg_log2;
+    adc_scan_err = 0;
+    adc_scan_nblocks = 0;
+
+    /*
+     * The sum of 2^avg samples, shifted right by avg - avg / 2. Sums past
+     * 16 bits are shifted by the ADC itself first, ADJRES does the rest.
+     */
+    adjres = (avg_log2 - avg_log2 / 2) - (avg_log2 > 4 ? avg_log2 - 4 : 0);
+
+    adc_scan_sync();
+    ADC->CTRLA.reg &= ~ADC_CTRLA_ENABLE;
+    adc_scan_sync();
+    adc_scan_ctrlb = ADC->CTRLB.reg;
+    adc_scan_ctrlc = ADC->CTRLC.reg;
+    adc_scan_avgctrl = ADC->AVGCTRL.reg;
+    adc_scan_sampctrl = ADC->SAMPCTRL.reg;
+    adc_scan_inputctrl = ADC->INPUTCTRL.reg;
+
+    ADC->CTRLB.reg = ADC_SCAN_PRESCALER;
+    ADC->CTRLC.reg = avg_log2 ? ADC_CTRLC_RESSEL_16BIT : ADC_CTRLC_RESSEL_12BIT;
+    ADC->AVGCTRL.reg = ADC_AVGCTRL_SAMPLENUM(avg_log2) | ADC_AVGCTRL_ADJRES(adjres);
+    ADC->SAMPCTRL.reg = ADC_SAMPCTRL_SAMPLEN(ADC_SCAN_SAMPLEN);
+    ADC->INPUTCTRL.reg = ADC_INPUTCTRL_MUXPOS(adc_scan_ain[0]) | ADC_INPUTCTRL_MUXNEG(ADC_SCAN_MUXNEG_GND);
+    ADC->SEQCTRL.reg = ADC_SEQCTRL_SEQEN(seq);
+    ADC->EVCTRL.reg = ADC_EVCTRL_STARTEI;
+    adc_scan_sync();
+
+    adc_scan_dma_start();
+
+    ADC->CTRLA.reg = ADC_CTRLA_RUNSTDBY | ADC_CTRLA_ENABLE;
+    adc_scan_sync();
+
+    evsysRoute(adc_scan_evsys, EVSYS_ID_GEN_TC4_OVF, EVSYS_ROUTE_ASYNC);
+    evsysConnect(adc_scan_evsys, EVSYS_ID_USER_ADC_START);
+
+    adc_scan_tc_start(rate_hz);
+
+    DLOG_DEBUG("ADC scan %d inputs at %lu Hz, %d bits", n, rate_hz, adc_scan_bits());
+    return ADC_SCAN_OK;
+}
+
+
+void
+adc_scan_stop(void)
+{
+    if (!adc_scan_n) {
+        return;
+    }
+
+    TC4->COUNT16.CTRLA.reg &= ~TC_CTRLA_ENABLE;
+    while (TC4->COUNT16.SYNCBUSY.reg & TC_SYNCBUSY_ENABLE);
+    evsysFree(adc_scan_evsys);
+    adc_scan_evsys = EVSYS_NO_CHANNEL;
+
+    dmacFree(adc_scan_dma);
+    adc_scan_dma = DMAC_NO_CHANNEL;
+
+    adc_scan_sync();
+    ADC->CTRLA.reg &= ~ADC_CTRLA_ENABLE;
+    adc_scan_sync();
+    ADC->EVCTRL.reg = 0;
+    ADC->SEQCTRL.reg = 0;
+    ADC->CTRLB.reg = adc_scan_ctrlb;
+    ADC->CTRLC.reg = adc_scan_ctrlc;
+    ADC->AVGCTRL.reg = adc_scan_avgctrl;
+    ADC->SAMPCTRL.reg = adc_scan_sampctrl;
+    ADC->INPUTCTRL.reg = adc_scan_inputctrl;
+    adc_scan_sync();
+
+    adc_scan_n = 0;
+    adc_scan_cur.n = 0;
+}
+
+
+uint8_t
+adc_scan_running(void)
+{
+    return adc_scan_n && !adc_scan_err;
+}
+
+
+void
+adc_scan_get(struct adc_scan_cfg *cfg)
+{
+    *cfg = adc_scan_cur;
+}
+
+
+void
+adc_scan_on_block(adc_scan_block_fn fn)
+{
+    adc_scan_block_cb = fn;
+}
+
+
+uint8_t
+adc_scan_bits(void)
+{
+    return 12 + adc_scan_avg / 2;
+}
+
+
+uint32_t
+adc_scan_blocks(void)
+{
+    return adc_scan_nblocks;
+}
+
+
+int32_t
+adc_scan_value(uint8_t pin)
+{
+    uint32_t blocks = adc_scan_nblocks;
+    const uint16_t *b;
+    uint32_t sum = 0;
+    uint16_t i;
+    uint8_t slot;
+
+    for (slot = 0; slot < adc_scan_n; slot++) {
+        if (adc_scan_ain[slot] == GetADC(pin)) {
+            break;
+        }
+    }
+    if (slot == adc_scan_n || !blocks) {
+        return -1;
+    }
+
+    /* The half after it is being filled, this one stays for a whole block */
+    b = adc_scan_buf[(blocks - 1) & 1];
+    for (i = slot; i < adc_scan_n * ADC_SCAN_BLOCK; i += adc_scan_n) {
+        sum += b[i];
+    }
+    return (sum + ADC_SCAN_BLOCK / 2) / ADC_SCAN_BLOCK;
+}
+
+#else
+
+int
+adc_scan_start(const uint8_t *pins, uint8_t n, uint32_t rate_hz, uint8_t avg_log2)
+{
+    return ADC_SCAN_ERR_CHIP;
+}
+
+
+void
+adc_scan_stop(void)
+{
+}
+
+
+uint8_t
+adc_scan_running(void)
+{
+    return 0;
+}
+
+
+void
+adc_scan_get(struct adc_scan_cfg *cfg)
+{
+    memset(cfg, 0, sizeof(*cfg));
+}
+
+
+void
+adc_scan_on_block(adc_scan_block_fn fn)
+{
+}
+
+
+uint8_t
+adc_scan_bits(void)
+{
+    return 12;
+}
+
+
+uint32_t
+adc_scan_blocks(void)
+{
+    return 0;
+}
+
+
+int32_t
+adc_scan_value(uint8_t pin)
+{
+    return -1;
+}
+
+#endif
@@ -46,6 +46,32 @@ RTCDue rtc(XTAL);
 // Time relative UTC
 static int32_t seconds_relative_utc = 0;
 
+// The epoch counted off millis(), reading the calendar takes a register sync and a mktime()
+static volatile time_t rtc_epoch_now;
+static volatile uint32_t rtc_epoch_ms;		// millis() at the start of the rtc_epoch_now second
+static volatile uint32_t rtc_epoch_sync_ms;	// millis() at the last check against the RTC
+
+// Drift of the 32 kHz crystal, measured between network time sets
+static time_t rtc_ref_epoch;		// network time the drift is measured from, 0 before the first set
+static int32_t rtc_ref_err;			// seconds the RTC gained on the network since then
+static int16_t rtc_corr;			// FREQCORR in use, 1/1048576 steps, > 0 slows the RTC
+
+
+/*
+ * @brief Start counting from the epoch the RTC holds now
+ *
+ */
+static void rtc_epoch_anchor(void)
+{
+	time_t epoch = rtc.getEpoch();
+
+	noInterrupts();
+	rtc_epoch_now = epoch;
+	rtc_epoch_ms = millis();
+	rtc_epoch_sync_ms = rtc_epoch_ms;
+	interrupts();
+}
+
 
 /**
  * @brief Set time zone
@@ -78,6 +104,7 @@ error_t rtc_time_init(int32_t zone)
 	time.second = 0;
 	
 	rtc.rtc_set_time(&time);
+	rtc_epoch_anchor();
 	
 	// Set the timezone
 	set_time_zone(zone);
@@ -87,18 +114,197 @@ error_t rtc_time_init(int32_t zone)
 /*
  * @brief Get the RTC time in local time
  *
- * 
+ * One load within the second, a division once it is over. Every
+ * RTC_EPOCH_SYNC_MS the count is checked against the calendar, and
+ * restarted from it when they are more than a second apart.
  */
 time_t get_rtc_epoch()
 {
-	// Convert to UTC
-	time_t epoch;
-	epoch = rtc.getEpoch();
-	return epoch;
+	uint32_t now;
+	uint32_t secs;
+
+	if ((uint32_t)(millis() - rtc_epoch_ms) >= 1000)
+	{
+		noInterrupts();
+		now = millis();
+		secs = (now - rtc_epoch_ms) / 1000;
+		rtc_epoch_now += secs;
+		rtc_epoch_ms += secs * 1000;
+		interrupts();
+
+		if ((uint32_t)(now - rtc_epoch_sync_ms) >= RTC_EPOCH_SYNC_MS)
+		{
+			time_t epoch = rtc.getEpoch();
+			int32_t off = (int32_t)(epoch - rtc_epoch_now);
+
+			rtc_epoch_sync_ms = now;
+			// The count lags the calendar by part of a second, more is drift
+			if (off > 1 || off < 0)
+			{
+				rtc_epoch_anchor();
+			}
+		}
+	}
+	return rtc_epoch_now;
 
 } // get_rtc_time()
 
 
+/*
+ * @brief The epoch at a millis() time, and the ms past it
+ *
+ * The count runs off millis(), so a time taken in an interrupt or a
+ * while ago gets its epoch to the ms. Within 24 days either way.
+ */
+time_t get_rtc_epoch_at(uint32_t at_ms, uint16_t *ms)
+{
+	time_t epoch;
+	int32_t d;
+	int32_t secs;
+
+	(void)get_rtc_epoch();
+	noInterrupts();
+	epoch = rtc_epoch_now;
+	d = (int32_t)(at_ms - rtc_epoch_ms);
+	interrupts();
+
+	secs = d >= 0 ? d / 1000 : -((999 - d) / 1000);
+	if (ms)
+	{
+		*ms = (uint16_t)(d - secs * 1000);
+	}
+	return epoch + secs;
+
+} // get_rtc_epoch_at()
+
+
+/*
+ * @brief Program the RTC frequency correction, 1/1048576 steps
+ *
+ */
+static void rtc_set_corr(int32_t corr)
+{
+	corr = constrain(corr, -RTC_CORR_MAX, RTC_CORR_MAX);
+	if (corr == rtc_corr)
+	{
+		return;
+	}
+	rtc_corr = corr;
+
+#if defined(SAML21)
+	RTC->MODE2.FREQCORR.reg = corr >= 0 ? RTC_FREQCORR_SIGN | RTC_FREQCORR_VALUE(corr) :
+										  RTC_FREQCORR_VALUE(-corr);
+	while (RTC->MODE2.SYNCBUSY.reg & RTC_MODE2_SYNCBUSY_FREQCORR)
+		;
+#endif
+	DLOG_INFO("RTC correction %d/1048576", corr);
+}
+
+
+/*
+ * @brief Work the drift out of how far the RTC is off at a network time set
+ *
+ * The error is summed over the sets between, and turned into a correction
+ * once RTC_DRIFT_MIN_SECS have passed, so the 1 s resolution of the set
+ * stays a small part of it. An error too large for a drift is a clock
+ * that was wrong, and restarts the measurement.
+ */
+static void rtc_drift_track(time_t epoch)
+{
+	int32_t span = (int32_t)(epoch - rtc_ref_epoch);
+	int32_t step;
+
+	rtc_ref_err += (int32_t)(rtc.getEpoch() - epoch);
+	if (!rtc_ref_epoch || span <= 0)
+	{
+		rtc_ref_epoch = epoch;
+		rtc_ref_err = 0;
+		return;
+	}
+	if (span < RTC_DRIFT_MIN_SECS)
+	{
+		return;
+	}
+
+	step = (int32_t)(((int64_t)rtc_ref_err << 20) / span);
+	DLOG_INFO("RTC gained %ld s in %ld s", (long)rtc_ref_err, (long)span);
+	rtc_ref_epoch = epoch;
+	rtc_ref_err = 0;
+	if (step > RTC_CORR_MAX || step < -RTC_CORR_MAX)
+	{
+		return;
+	}
+	rtc_set_corr(rtc_corr + step);
+}
+
+
+/*
+ * @brief Set the RTC, UTC seconds
+ *
+ */
+void set_rtc_epoch(time_t epoch)
+{
+	rtc_drift_track(epoch);
+	rtc.setEpoch(epoch);
+	rtc_epoch_anchor();
+
+} // set_rtc_epoch()
+
+
+/*
+ * @brief Set the epoch of the second that began at millis() at_ms, a PPS edge
+ *
+ * The count is anchored on the edge rather than on the RTC second. The RTC
+ * is only written when it is off by more than the part of a second it may
+ * be ahead of the edge, a write does not move its second boundary, and an
+ * RTC within that is left for the re-anchor check to accept.
+ */
+void set_rtc_epoch_at(time_t epoch, uint32_t at_ms)
+{
+	uint32_t secs = (millis() - at_ms) / 1000;
+	int32_t off;
+
+	epoch += secs;
+	at_ms += secs * 1000;
+	off = (int32_t)(rtc.getEpoch() - epoch);
+	if (off > 1 || off < 0)
+	{
+		rtc.setEpoch(epoch);
+	}
+
+	noInterrupts();
+	rtc_epoch_now = epoch;
+	rtc_epoch_ms = at_ms;
+	rtc_epoch_sync_ms = millis();
+	interrupts();
+
+} // set_rtc_epoch_at()
+
+
+/*
+ * @brief Set the RTC frequency correction from a measurement of its own
+ *
+ * The drift measured between network time sets restarts from here.
+ */
+void set_rtc_corr(int16_t corr)
+{
+	rtc_ref_epoch = 0;
+	rtc_set_corr(corr);
+
+} // set_rtc_corr()
+
+
+/*
+ * @brief The RTC frequency correction in use
+ *
+ */
+int16_t get_rtc_corr(void)
+{
+	return rtc_corr;
+
+} // get_rtc_corr()
+
+
 /**
 * @brief
 * Prints the current time
@@ -108,7 +314,7 @@ time_t get_rtc_epoch()
 void print_current_time(void)
 {
 	uint32_t a,b,c;
-	char buffer[PRINTF_LEN];
+	char buffer[64];
 
 	// Print time
 	a = rtc.getSeconds();
@@ -129,7 +335,7 @@ void print_current_time(void)
 void print_log_time(void)
 {
 	uint32_t a,b,c;
-	char buffer[PRINTF_LEN];
+	char buffer[64];
 
 	// Print time
 	a = rtc.getSeconds();
@@ -150,7 +356,7 @@ void print_log_time(void)
 void print_current_date(void)
 {
 	uint32_t a,b,c;
-	char buffer[PRINTF_LEN];
+	char buffer[64];
 
 	// Print time
 	a = rtc.getYear();
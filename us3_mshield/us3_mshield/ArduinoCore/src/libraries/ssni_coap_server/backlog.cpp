@@ -0,0 +1,556 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+
+#include <SPIMemory.h>
+#include "backlog.h"
+#include "crc_xmodem.h"
+#include "hbuf.h"
+#include "log.h"
+
+
+/* Header of a sector, its first record slot */
+struct backlog_hdr {
+    uint16_t magic;             /* BACKLOG_MAGIC */
+    uint16_t crc;               /* crc_xmodem of seq */
+    uint32_t seq;               /* Sectors in the order written, from 1 */
+    uint32_t lo;                /* Its earliest epoch, 0xFF.. until it is done */
+    uint32_t hi;                /* Latest epoch up to its end, of it or before */
+};
+
+/* The RAM index of a sector by epoch. hi only grows from the oldest sector
+ * on, so the sector a since query starts in is found by a binary search. */
+struct backlog_idx {
+    uint32_t lo;                /* Earliest epoch in it */
+    uint32_t hi;                /* Latest epoch up to its end, of it or before */
+    uint16_t count;             /* Records in it, 0 -> empty or no header */
+};
+
+// SPI flash of SAPI, out of deep power-down before each access
+extern SPIFlash flash;
+void sapi_flash_wake();
+
+struct backlog backlog;
+static uint8_t *backlog_buf;
+static struct backlog_idx backlog_idx[BACKLOG_SECTORS];
+
+
+/* CRC of a record, over the sensor and the sample */
+static uint16_t
+backlog_rec_crc(const struct backlog_rec *rec)
+{
+    uint16_t crc = crc_xmodem(crc_xmodem_init(), &rec->sensor_id, sizeof(rec->sensor_id));
+
+    crc = crc_xmodem(crc, &rec->epoch, sizeof(rec->epoch));
+    crc = crc_xmodem(crc, &rec->value, sizeof(rec->value));
+    return crc_xmodem(crc, &rec->datatype, sizeof(rec->datatype));
+}
+
+
+bool
+backlog_rec_good(const struct backlog_rec *rec)
+{
+    return rec->mark == BACKLOG_REC_MARK && rec->crc == backlog_rec_crc(rec);
+}
+
+
+bool
+backlog_rec_live(const struct backlog_rec *rec)
+{
+    return rec->sent == 0xFF && backlog_rec_good(rec);
+}
+
+
+void
+backlog_sample(const struct backlog_rec *rec, sapi_sample_t *sample)
+{
+    sample->epoch = rec->epoch;
+    sample->datatype = rec->datatype;
+    sample->ms = rec->ms < 1000 ? rec->ms : 0;
+    sample->value = rec->value;
+}
+
+
+static uint32_t
+backlog_sector_addr(uint8_t indx)
+{
+    return BACKLOG_ADDR + (uint32_t)indx * BACKLOG_SECTOR;
+}
+
+
+/* Header of sector indx and its sequence number, 0 if it is not good */
+static uint32_t
+backlog_sector_hdr(uint8_t indx, struct backlog_hdr *hdr)
+{
+    sapi_flash_wake();
+    flash.readByteArray(backlog_sector_addr(indx), (uint8_t *)hdr, sizeof(*hdr));
+    if (hdr->magic != BACKLOG_MAGIC || hdr->crc != crc_xmodem(crc_xmodem_init(), &hdr->seq, sizeof(hdr->seq))) {
+        return 0;
+    }
+    return hdr->seq;
+}
+
+
+/* Add a record's epoch to the index of its sector */
+static void
+backlog_idx_add(struct backlog_idx *x, uint32_t epoch)
+{
+    if (!x->count || epoch < x->lo) {
+        x->lo = epoch;
+    }
+    if (epoch > x->hi) {
+        x->hi = epoch;
+    }
+    x->count++;
+}
+
+
+/* Index sector indx from its records, for the head sector and those done
+ * before their epochs were kept. Returns where its records end. */
+static uint32_t
+backlog_idx_scan(uint8_t indx)
+{
+    struct backlog_idx *x = &backlog_idx[indx];
+    struct backlog_rec rec;
+    uint32_t end = backlog_sector_addr(indx + 1);
+    uint32_t addr;
+    uint16_t bad = 0;
+
+    memset(x, 0, sizeof(*x));
+    for (addr = backlog_sector_addr(indx) + sizeof(struct backlog_hdr); addr < end; addr += sizeof(rec)) {
+        flash.readByteArray(addr, (uint8_t *)&rec, sizeof(rec));
+        if (rec.mark == 0xFF) {
+            break;
+        }
+        if (backlog_rec_good(&rec)) {
+            backlog_idx_add(x, rec.epoch);
+        } else {
+            bad++;
+        }
+    }
+    x->count += bad;
+    return addr;
+}
+
+
+/* Rebuild the index, oldest sector first, from the epochs in their
+ * headers. A sector without them is read once and they are programmed in,
+ * the head sector is read for the head anyway. */
+static void
+backlog_idx_load(uint8_t first)
+{
+    struct backlog_hdr hdr;
+    struct backlog_idx *x;
+    uint32_t span[2], prev = 0;
+    uint8_t indx;
+
+    memset(backlog_idx, 0, sizeof(backlog_idx));
+    for (indx = first; ; indx = (indx + 1) % BACKLOG_SECTORS) {
+        x = &backlog_idx[indx];
+        if (!backlog_sector_hdr(indx, &hdr)) {
+            ;
+        } else if (indx == backlog.sector) {
+            backlog.head = backlog_idx_scan(indx);
+        } else if (hdr.hi != 0xFFFFFFFFUL && hdr.lo <= hdr.hi) {
+            x->lo = hdr.lo;
+            x->hi = hdr.hi;
+            x->count = (BACKLOG_SECTOR - sizeof(hdr)) / sizeof(struct backlog_rec);
+        } else {
+            /* Done before the epochs were kept, or they were cut short */
+            (void)backlog_idx_scan(indx);
+            if (x->hi < prev) {
+                x->hi = prev;
+            }
+            if (hdr.lo == 0xFFFFFFFFUL) {
+                span[0] = x->lo;
+                span[1] = x->hi;
+                (void)flash.writeByteArray(backlog_sector_addr(indx) + offsetof(struct backlog_hdr, lo),
+                                           (uint8_t *)span, sizeof(span));
+            }
+        }
+        if (x->hi < prev) {
+            x->hi = prev;
+        }
+        prev = x->hi;
+        if (indx == backlog.sector) {
+            break;
+        }
+    }
+}
+
+
+uint32_t
+backlog_next(uint32_t addr)
+{
+    addr += sizeof(struct backlog_rec);
+    if (addr != backlog.head && (addr - BACKLOG_ADDR) % BACKLOG_SECTOR == 0) {
+        if (addr == backlog_sector_addr(BACKLOG_SECTORS)) {
+            addr = BACKLOG_ADDR;
+        }
+        addr += sizeof(struct backlog_hdr);
+    }
+    return addr;
+}
+
+
+uint32_t
+backlog_waiting(void)
+{
+    uint32_t span = backlog.head - backlog.tail;
+
+    if (backlog.head < backlog.tail) {
+        span += BACKLOG_SECTORS * BACKLOG_SECTOR;
+    }
+    return span / sizeof(struct backlog_rec);
+}
+
+
+void
+backlog_read(uint32_t addr, struct backlog_rec *rec)
+{
+    if (backlog.page && addr >= backlog.page + backlog.page_from &&
+        addr < backlog.page + backlog.page_to) {
+        memcpy(rec, &backlog_buf[addr - backlog.page], sizeof(*rec));
+    } else {
+        sapi_flash_wake();
+        flash.readByteArray(addr, (uint8_t *)rec, sizeof(*rec));
+    }
+}
+
+
+/* Those still in the page buffer are taken from it */
+uint8_t
+backlog_read_run(uint32_t addr, struct backlog_rec *recs, uint8_t n)
+{
+    uint32_t end = addr - (addr - BACKLOG_ADDR) % BACKLOG_SECTOR + BACKLOG_SECTOR;
+    uint32_t lim, from;
+    uint8_t i;
+
+    if (backlog.head > addr && backlog.head < end) {
+        end = backlog.head;
+    }
+    if (n > (end - addr) / sizeof(*recs)) {
+        n = (end - addr) / sizeof(*recs);
+    }
+
+    /* The page buffer ends at the head, flash before it */
+    lim = addr + n * sizeof(*recs);
+    from = backlog.page + backlog.page_from;
+    if (backlog.page_to != backlog.page_from && from < lim && backlog.page + backlog.page_to > addr) {
+        lim = (from > addr) ? from : addr;
+    }
+    if (lim > addr && sapi_flash_read(addr, recs, lim - addr) != SAPI_ERR_OK) {
+        return 0;
+    }
+    for (i = (lim - addr) / sizeof(*recs); i < n; i++) {
+        memcpy(&recs[i], &backlog_buf[addr + i * sizeof(*recs) - backlog.page], sizeof(*recs));
+    }
+    return n;
+}
+
+
+/* Not read back, a bad one fails its CRC where it is read */
+void
+backlog_flush(void)
+{
+    uint16_t from = backlog.page_from;
+    uint16_t len = backlog.page_to - from;
+
+    if (!len) {
+        return;
+    }
+    sapi_flash_wake();
+    if (!flash.writeByteArray(backlog.page + from, &backlog_buf[from], len, false)) {
+        backlog.dropped += len / sizeof(struct backlog_rec);
+        DLOG_ERR("Sample log page %lx not written", backlog.page);
+    }
+    backlog.page_from = backlog.page_to;
+}
+
+
+/* The newest sector has the head, at its first free record. The tail is
+ * the first record not sent, from the oldest sector on. A sector is
+ * passed over whole when its last record was sent. */
+void
+backlog_load(uint8_t *buf)
+{
+    struct backlog_hdr hdr;
+    struct backlog_rec rec;
+    uint32_t seq, newest = 0, oldest = 0;
+    uint32_t end, addr;
+    uint8_t indx, first = 0;
+
+    memset(&backlog, 0, sizeof(backlog));
+    memset(backlog_idx, 0, sizeof(backlog_idx));
+    backlog_buf = buf;
+    for (indx = 0; indx < BACKLOG_SECTORS; indx++) {
+        seq = backlog_sector_hdr(indx, &hdr);
+        if (seq && seq > newest) {
+            newest = seq;
+            backlog.sector = indx;
+        }
+        if (seq && (!oldest || seq < oldest)) {
+            oldest = seq;
+            first = indx;
+        }
+    }
+    if (!newest) {
+        DLOG_DEBUG("Sample log empty");
+        return;
+    }
+    backlog.seq = newest;
+    backlog_idx_load(first);
+
+    backlog.tail = backlog.head;
+    for (indx = first; ; indx = (indx + 1) % BACKLOG_SECTORS) {
+        end = (indx == backlog.sector) ? backlog.head : backlog_sector_addr(indx + 1);
+        addr = backlog_sector_addr(indx) + sizeof(struct backlog_hdr);
+        if (end > addr) {
+            flash.readByteArray(end - sizeof(rec), (uint8_t *)&rec, sizeof(rec));
+        }
+        if (end <= addr || !backlog_idx[indx].count || (rec.mark == BACKLOG_REC_MARK && !rec.sent)) {
+            /* Empty, not started, or all of it went */
+            addr = end;
+        }
+        for (; addr < end; addr += sizeof(rec)) {
+            flash.readByteArray(addr, (uint8_t *)&rec, sizeof(rec));
+            if (backlog_rec_live(&rec)) {
+                break;
+            }
+        }
+        if (addr < end) {
+            backlog.tail = addr;
+            break;
+        }
+        if (indx == backlog.sector) {
+            break;
+        }
+    }
+    DLOG_DEBUG("Sample log: head %lx, tail %lx", backlog.head, backlog.tail);
+}
+
+
+uint16_t
+backlog_resume(uint32_t seq, uint32_t page, uint16_t from, uint16_t to)
+{
+    const struct backlog_rec *rec;
+    uint8_t empty = (backlog.tail == backlog.head);
+    uint16_t off;
+    uint16_t n = 0;
+
+    if (!seq || seq != backlog.seq || from >= to || to > BACKLOG_PAGE || page + from != backlog.head) {
+        return 0;
+    }
+    backlog.page = page;
+    backlog.page_from = backlog.page_to = from;
+    backlog.page_ms = millis();
+    for (off = from; off + sizeof(*rec) <= to; off += sizeof(*rec)) {
+        rec = (const struct backlog_rec *)&backlog_buf[off];
+        if (!backlog_rec_good(rec)) {
+            break;
+        }
+        backlog_idx_add(&backlog_idx[backlog.sector], rec->epoch);
+        backlog.page_to += sizeof(*rec);
+        backlog.head += sizeof(*rec);
+        /* The tail stays at the first not sent */
+        if (empty && backlog_rec_live(rec)) {
+            empty = 0;
+        } else if (empty) {
+            backlog.tail = backlog.head;
+        }
+        n++;
+    }
+    return n;
+}
+
+
+/* Start the next sector. When that is where the tail is, the log is full
+ * and its oldest sector goes. The sector done gets its epochs in its
+ * header first. */
+static bool
+backlog_sector_start(void)
+{
+    struct backlog_hdr hdr;
+    uint8_t indx = backlog.seq ? (backlog.sector + 1) % BACKLOG_SECTORS : 0;
+    uint32_t addr = backlog_sector_addr(indx);
+    uint8_t empty = (backlog.tail == backlog.head);
+    uint32_t span[2], prev = 0;
+
+    if (backlog.seq) {
+        /* A failed write is put right at the next boot, from its records */
+        span[0] = backlog_idx[backlog.sector].lo;
+        span[1] = prev = backlog_idx[backlog.sector].hi;
+        sapi_flash_wake();
+        (void)flash.writeByteArray(backlog_sector_addr(backlog.sector) + offsetof(struct backlog_hdr, lo),
+                                   (uint8_t *)span, sizeof(span));
+    }
+
+    if (!empty && backlog.tail >= addr && backlog.tail < addr + BACKLOG_SECTOR) {
+        backlog.dropped += (addr + BACKLOG_SECTOR - backlog.tail) / sizeof(struct backlog_rec);
+        backlog.tail = backlog_sector_addr((indx + 1) % BACKLOG_SECTORS) + sizeof(struct backlog_hdr);
+        DLOG_ERR("Sample log full, oldest sector dropped");
+    }
+
+    memset(&hdr, 0xFF, sizeof(hdr));
+    hdr.magic = BACKLOG_MAGIC;
+    hdr.seq = backlog.seq + 1;
+    hdr.crc = crc_xmodem(crc_xmodem_init(), &hdr.seq, sizeof(hdr.seq));
+    backlog_idx[indx].count = 0;
+    backlog_idx[indx].lo = 0;
+    backlog_idx[indx].hi = prev;
+    sapi_flash_wake();
+    if (!flash.eraseSector(addr) || !flash.writeByteArray(addr, (uint8_t *)&hdr, sizeof(hdr))) {
+        return false;
+    }
+
+    backlog.seq = hdr.seq;
+    backlog.sector = indx;
+    backlog.head = addr + sizeof(hdr);
+    if (empty) {
+        backlog.tail = backlog.head;
+    }
+    return true;
+}
+
+
+bool
+backlog_put(uint8_t sensor_id, const sapi_sample_t *sample)
+{
+    struct backlog_rec rec;
+    uint8_t empty = (backlog.tail == backlog.head);
+    uint32_t page;
+
+    if (!backlog.seq || (backlog.head - BACKLOG_ADDR) % BACKLOG_SECTOR == 0) {
+        backlog_flush();
+        if (!backlog_sector_start()) {
+            backlog.dropped++;
+            return false;
+        }
+    }
+
+    page = backlog.head - (backlog.head - BACKLOG_ADDR) % BACKLOG_PAGE;
+    if (page != backlog.page) {
+        backlog_flush();
+        backlog.page = page;
+        backlog.page_from = backlog.page_to = backlog.head - page;
+    }
+    if (backlog.page_from == backlog.page_to) {
+        backlog.page_ms = millis();
+    }
+
+    memset(&rec, 0xFF, sizeof(rec));
+    rec.mark = BACKLOG_REC_MARK;
+    rec.sensor_id = sensor_id;
+    rec.epoch = sample->epoch;
+    rec.value = sample->value;
+    rec.datatype = sample->datatype;
+    rec.ms = sample->ms;
+    rec.crc = backlog_rec_crc(&rec);
+    memcpy(&backlog_buf[backlog.page_to], &rec, sizeof(rec));
+    backlog.page_to += sizeof(rec);
+    backlog_idx_add(&backlog_idx[backlog.sector], rec.epoch);
+    if (empty) {
+        backlog.tail = backlog.head;
+    }
+    backlog.head += sizeof(rec);
+
+    if (backlog.page_to == BACKLOG_PAGE) {
+        backlog_flush();
+    }
+    return true;
+}
+
+
+void
+backlog_commit(uint8_t n)
+{
+    uint32_t addr;
+
+    for (; n && backlog.tail != backlog.head; n--) {
+        addr = backlog.tail + offsetof(struct backlog_rec, sent);
+        if (backlog.page && addr >= backlog.page + backlog.page_from &&
+            addr < backlog.page + backlog.page_to) {
+            backlog_buf[addr - backlog.page] = 0;
+        } else {
+            /* Fails harmlessly on a record already marked */
+            sapi_flash_wake();
+            (void)flash.writeByte(addr, 0);
+        }
+        backlog.tail = backlog_next(backlog.tail);
+    }
+}
+
+
+/* The index finds the first sector with any at or after since, the ones
+ * before are not read */
+int
+backlog_find(uint8_t sensor_id, uint32_t since, sapi_sample_t *samples, uint8_t want)
+{
+    int mark = scratch_mark();
+    struct backlog_rec *recs = (struct backlog_rec *) scratch_alloc(BACKLOG_PAGE);
+    uint8_t count = 0, indx, got, i, k, lo, hi;
+    uint32_t addr, end;
+
+    if (!recs) {
+        scratch_release(mark);
+        return -1;
+    }
+    /* hi only grows from the oldest sector, the one after the head, on */
+    for (lo = 1, hi = BACKLOG_SECTORS + 1; lo < hi; ) {
+        k = (lo + hi) / 2;
+        if (backlog_idx[(backlog.sector + k) % BACKLOG_SECTORS].hi < since) {
+            lo = k + 1;
+        } else {
+            hi = k;
+        }
+    }
+    for (k = lo; backlog.seq && k <= BACKLOG_SECTORS && count < want; k++) {
+        indx = (backlog.sector + k) % BACKLOG_SECTORS;
+        if (!backlog_idx[indx].count) {
+            continue;
+        }
+        end = (indx == backlog.sector) ? backlog.head : backlog_sector_addr(indx + 1);
+        for (addr = backlog_sector_addr(indx) + sizeof(struct backlog_hdr); addr < end && count < want;
+             addr += got * sizeof(*recs)) {
+            if (!(got = backlog_read_run(addr, recs, BACKLOG_PAGE / sizeof(*recs)))) {
+                break;
+            }
+            for (i = 0; i < got && count < want; i++) {
+                if (backlog_rec_good(&recs[i]) && recs[i].sensor_id == sensor_id && recs[i].epoch >= since) {
+                    backlog_sample(&recs[i], &samples[count++]);
+                }
+            }
+        }
+    }
+    scratch_release(mark);
+    return count;
+}
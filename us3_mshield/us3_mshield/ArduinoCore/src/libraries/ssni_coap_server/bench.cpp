@@ -0,0 +1,319 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+#include "bench.h"
+
+#if BENCH
+#include "hbuf.h"
+#include "crc_xmodem.h"
+#include "coapmsg.h"
+#include "coappdu.h"
+#include "cbor.h"
+#include "mbword.h"
+#include "arduino_time.h"
+#include "log.h"
+
+#define BENCH_INFO_LEN          (256)
+#define BENCH_PAYLOAD_LEN       (32)
+#define BENCH_LINE_LEN          (64)
+
+/* CON GET /sensor/arduino/temp, token abcd */
+static const uint8_t bench_get[] = {
+    0x42, 0x01, 0x12, 0x34, 0xab, 0xcd,
+    0xb6, 's', 'e', 'n', 's', 'o', 'r',
+    0x07, 'a', 'r', 'd', 'u', 'i', 'n', 'o',
+    0x04, 't', 'e', 'm', 'p',
+};
+
+/* 21.5 as a CDAB float, as the level of the Modbus sensor comes */
+static const uint8_t bench_cdab[4] = { 0x00, 0x00, 0x41, 0xac };
+
+static const float bench_vals[8] = { 21.5f, 21.25f, 21.0f, 20.75f, 20.5f, 20.5f, 20.25f, 20.0f };
+
+static uint8_t bench_info[BENCH_INFO_LEN];
+static struct coap_msg_ctx bench_req;
+static volatile uint32_t bench_sink;    /* results, so none is optimised away */
+
+
+/*
+ * Core cycles since boot, modulo 2^32: the milliseconds SysTick has
+ * counted times its reload, plus how far it is down the current one. Read
+ * as micros() reads it, again until the count and the pending flag hold
+ * still across a SysTick reading that has not wrapped.
+ */
+static uint32_t
+bench_cycles(void)
+{
+    uint32_t ticks, ticks2;
+    uint32_t pend, pend2;
+    uint32_t count, count2;
+
+    ticks2 = SysTick->VAL;
+    pend2 = !!(SCB->ICSR & SCB_ICSR_PENDSTSET_Msk);
+    count2 = millis();
+    do {
+        ticks = ticks2;
+        pend = pend2;
+        count = count2;
+        ticks2 = SysTick->VAL;
+        pend2 = !!(SCB->ICSR & SCB_ICSR_PENDSTSET_Msk);
+        count2 = millis();
+    } while (pend != pend2 || count != count2 || ticks < ticks2);
+
+    return (count + pend) * (SysTick->LOAD + 1) + (SysTick->LOAD - ticks);
+}
+
+/* Cycles of stmt into bench_dt, reading the counter included */
+#define BENCH_TIME(stmt) \
+    do { uint32_t t0 = bench_cycles(); stmt; bench_dt = bench_cycles() - t0; } while (0)
+
+static uint32_t bench_dt;
+
+
+static void
+bench_null(void)
+{
+    BENCH_TIME((void)0);
+}
+
+
+static void
+bench_crc16(void)
+{
+    BENCH_TIME(bench_sink += crc16(CRC16_FINAL, bench_info, sizeof(bench_info)));
+}
+
+
+static struct mbuf *
+bench_request(void)
+{
+    struct mbuf *m = m_get();
+
+    if (m) {
+        memcpy(m_append(m, sizeof(bench_get)), bench_get, sizeof(bench_get));
+    }
+    return m;
+}
+
+
+static void
+bench_coap_parse(void)
+{
+    struct coap_msg_ctx cc;
+    struct mbuf *m = bench_request();
+    uint8_t code;
+
+    memset(&cc, 0, sizeof(cc));
+    copt_init((sl_co *)&cc.oh);
+    BENCH_TIME(bench_sink += coap_msg_parse(&cc, m, &code));
+    m_free(m);
+}
+
+
+static void
+bench_coap_response(void)
+{
+    struct coap_msg_ctx rsp;
+    struct mbuf *r = m_get();
+
+    m_reserve(r, COAP_RSP_HEADROOM);
+    memset(m_append(r, BENCH_PAYLOAD_LEN), 0x55, BENCH_PAYLOAD_LEN);
+    coap_init_rsp(&bench_req, &rsp, r);
+    rsp.code = COAP_RSP_205_CONTENT;
+    rsp.plen = BENCH_PAYLOAD_LEN;
+    BENCH_TIME(bench_sink += coap_msg_response(&rsp));
+    m_free(rsp.msg);
+}
+
+
+static void
+bench_cbor_uint(void)
+{
+    uint8_t buf[8];
+    struct cbor_buf cb;
+
+    cbor_enc_init(&cb, buf, sizeof(buf));
+    BENCH_TIME(bench_sink += cbor_enc_uint(&cb, 1700000000));
+}
+
+
+static void
+bench_cbor_float32(void)
+{
+    uint8_t buf[64];
+    struct cbor_buf cb;
+
+    cbor_enc_init(&cb, buf, sizeof(buf));
+    BENCH_TIME(bench_sink += cbor_enc_typed_float32(&cb, bench_vals, 8));
+}
+
+
+/* A notification's worth: time, id and a series */
+static void
+bench_cbor_map(void)
+{
+    uint8_t buf[128];
+    struct cbor_buf cb;
+
+    BENCH_TIME(
+        cbor_enc_init(&cb, buf, sizeof(buf));
+        cbor_enc_map(&cb, 3);
+        cbor_enc_text(&cb, "t", 1);
+        cbor_enc_uint(&cb, 1700000000);
+        cbor_enc_text(&cb, "id", 2);
+        cbor_enc_text(&cb, "temp", 4);
+        cbor_enc_text(&cb, "v", 1);
+        cbor_enc_typed_float32(&cb, bench_vals, 8);
+        bench_sink += cbor_buf_get_len(&cb));
+}
+
+
+static void
+bench_mbuf(void)
+{
+    BENCH_TIME(m_free(m_get()));
+}
+
+
+static void
+bench_float_cdab(void)
+{
+    const uint8_t *volatile p = bench_cdab;
+    float f;
+
+    BENCH_TIME(f = mb_float<MB_CDAB>(p));
+    bench_sink += (uint32_t)f;
+}
+
+
+/* Into the ring only, log_drain prints it afterwards */
+static void
+bench_dlog(void)
+{
+    BENCH_TIME(dlog(LOG_DEBUG, "bench %d %s", (int)bench_sink, "dlog"));
+}
+
+
+static void
+bench_epoch(void)
+{
+    BENCH_TIME(bench_sink += get_rtc_epoch());
+}
+
+
+struct bench {
+    const char *name;
+    void (*fn)(void);
+};
+
+static const struct bench benches[] = {
+    { "crc16 256B",             bench_crc16 },
+    { "coap_msg_parse GET",     bench_coap_parse },
+    { "coap_msg_response 32B",  bench_coap_response },
+    { "cbor_enc_uint",          bench_cbor_uint },
+    { "cbor_enc_typed_float32", bench_cbor_float32 },
+    { "cbor notification",      bench_cbor_map },
+    { "m_get+m_free",           bench_mbuf },
+    { "mb_float CDAB",          bench_float_cdab },
+    { "dlog 2 args",            bench_dlog },
+    { "get_rtc_epoch",          bench_epoch },
+};
+
+
+/* Least cycles of reading the counter twice, taken off each run */
+static uint32_t
+bench_overhead(void)
+{
+    uint32_t least = UINT32_MAX;
+    int i;
+
+    for (i = 0; i < BENCH_RUNS; i++) {
+        bench_null();
+        least = min(least, bench_dt);
+    }
+    return least;
+}
+
+
+void
+bench_run(Print *out)
+{
+    char line[BENCH_LINE_LEN];
+    uint32_t overhead;
+    uint32_t lo, hi, dt;
+    uint64_t sum;
+    struct mbuf *m;
+    uint8_t code;
+    size_t b;
+    int i;
+
+    for (i = 0; i < BENCH_INFO_LEN; i++) {
+        bench_info[i] = (uint8_t)(i * 7 + 1);
+    }
+    memset(&bench_req, 0, sizeof(bench_req));
+    copt_init((sl_co *)&bench_req.oh);
+    m = bench_request();
+    if (!m || coap_msg_parse(&bench_req, m, &code) != ERR_OK) {
+        out->println("bench: no request to answer");
+        m_free(m);
+        return;
+    }
+    m_free(m);
+    bench_req.msg = NULL;
+
+    overhead = bench_overhead();
+    snprintf(line, sizeof(line), "%-24s %4s %7s %7s %7s %8s", "case", "runs", "min", "avg", "max", "us");
+    out->println(line);
+
+    for (b = 0; b < sizeof(benches) / sizeof(benches[0]); b++) {
+        lo = UINT32_MAX;
+        hi = 0;
+        sum = 0;
+        for (i = 0; i < BENCH_RUNS; i++) {
+            benches[b].fn();
+            dt = bench_dt > overhead ? bench_dt - overhead : 0;
+            lo = min(lo, dt);
+            hi = max(hi, dt);
+            sum += dt;
+        }
+        dt = (uint32_t)(sum / BENCH_RUNS);
+        snprintf(line, sizeof(line), "%-24s %4d %7lu %7lu %7lu %6lu.%01lu", benches[b].name, BENCH_RUNS,
+                 (unsigned long)lo, (unsigned long)dt, (unsigned long)hi,
+                 (unsigned long)(dt / (F_CPU / 1000000)),
+                 (unsigned long)(dt * 10 / (F_CPU / 1000000) % 10));
+        out->println(line);
+    }
+    snprintf(line, sizeof(line), "%lu cycles/us, %lu to read the counter taken off",
+             (unsigned long)(F_CPU / 1000000), (unsigned long)overhead);
+    out->println(line);
+}
+
+#endif /* BENCH */
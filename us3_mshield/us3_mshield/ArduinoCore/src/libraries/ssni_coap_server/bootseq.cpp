@@ -0,0 +1,156 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+
+#include "bootseq.h"
+#include "sched.h"
+#include "log.h"
+
+
+static struct sched_task boot_task;
+static const struct boot_step *boot_tab;
+static uint8_t boot_n;
+static uint16_t boot_done_mask;
+static uint32_t boot_due_ms[BOOT_MAX_STEPS];
+static uint32_t boot_at_ms[BOOT_MAX_STEPS];     /* millis() it was done */
+
+
+/* Step i is not done and the steps before it are */
+static uint8_t
+boot_step_ready(uint8_t i)
+{
+    return !(boot_done_mask & BOOT_AFTER(i)) &&
+           !(boot_tab[i].after & ~boot_done_mask);
+}
+
+
+static void
+boot_seq_run(struct sched_task *t)
+{
+    uint32_t now = millis();
+    uint32_t wait = SCHED_NEVER;
+    uint32_t w;
+    int32_t d;
+    uint8_t i;
+
+    for (i = 0; i < boot_n; i++) {
+        if (!boot_step_ready(i)) {
+            continue;
+        }
+        d = (int32_t)(boot_due_ms[i] - now);
+        if (d > 0) {
+            if ((uint32_t)d < wait) {
+                wait = d;
+            }
+            continue;
+        }
+        w = boot_tab[i].run();
+        now = millis();
+        if (w == BOOT_STEP_DONE) {
+            boot_done_mask |= BOOT_AFTER(i);
+            boot_at_ms[i] = now;
+            DLOG_DEBUG("Boot step %s done at %lu ms", boot_tab[i].name, (unsigned long)now);
+        } else {
+            boot_due_ms[i] = now + w;
+        }
+        /* one a pass, the next on the next one */
+        sched_at(t, 0);
+        return;
+    }
+
+    if (boot_seq_done()) {
+        DLOG_INFO("Boot steps done at %lu ms", (unsigned long)now);
+        sched_stop(t);
+        return;
+    }
+    if (wait == SCHED_NEVER) {
+        /* the rest wait on each other */
+        DLOG_ERR("Boot steps 0x%x left waiting", (unsigned)(~boot_done_mask & (BOOT_AFTER(boot_n) - 1)));
+        sched_stop(t);
+        return;
+    }
+    sched_at(t, wait);
+}
+
+
+int
+boot_seq_start(const struct boot_step *tab, uint8_t n)
+{
+    uint32_t now = millis();
+    uint8_t i;
+
+    if (n > BOOT_MAX_STEPS) {
+        n = BOOT_MAX_STEPS;
+    }
+    boot_tab = tab;
+    boot_n = n;
+    boot_done_mask = 0;
+    for (i = 0; i < n; i++) {
+        boot_due_ms[i] = now;
+        boot_at_ms[i] = 0;
+    }
+    if (sched_add(&boot_task, "init", boot_seq_run, 0) < 0) {
+        return -1;
+    }
+    sched_at(&boot_task, 0);
+    return 0;
+}
+
+
+uint8_t
+boot_seq_done(void)
+{
+    return boot_done_mask == (uint16_t)(BOOT_AFTER(boot_n) - 1);
+}
+
+
+void
+boot_seq_dump(void)
+{
+    char line[64];
+    uint32_t now = millis();
+    uint8_t i;
+
+    for (i = 0; i < boot_n; i++) {
+        if (boot_done_mask & BOOT_AFTER(i)) {
+            snprintf(line, sizeof(line), "%-8s done at %8lu ms", boot_tab[i].name,
+                     (unsigned long)boot_at_ms[i]);
+        } else if (boot_step_ready(i)) {
+            snprintf(line, sizeof(line), "%-8s due in  %8ld ms", boot_tab[i].name,
+                     (long)(int32_t)(boot_due_ms[i] - now));
+        } else {
+            snprintf(line, sizeof(line), "%-8s after 0x%x", boot_tab[i].name,
+                     (unsigned)(boot_tab[i].after & ~boot_done_mask));
+        }
+        println(line);
+    }
+}
@@ -28,6 +28,7 @@ Networks, Inc.
 */
 
 #include "bufutil.h"
+#include <itoa.h>
 
 uint16_t
 buf_be16(const void *buf, int idx)
@@ -69,3 +70,102 @@ buf_wbe32(void *buf, int idx, uint32_t val)
     *p++ = (val >> 8) & 0xFF;
     *p = val & 0xFF;
 }
+
+
+/*
+ * Text writer.
+ */
+void
+txt_init(struct txt_buf *tb, char *buf, int len)
+{
+    tb->head = buf;
+    tb->next = buf;
+    tb->tail = buf + (len > 0 ? len - 1 : 0);
+    tb->err = (len <= 0);
+    if (len > 0) {
+        *buf = '\0';
+    }
+}
+
+int
+txt_len(const struct txt_buf *tb)
+{
+    return tb->next - tb->head;
+}
+
+static int
+txt_put(struct txt_buf *tb, const char *s, int len)
+{
+    if (tb->err || len > tb->tail - tb->next) {
+        tb->err = 1;
+        return -1;
+    }
+    memcpy(tb->next, s, len);
+    tb->next += len;
+    *tb->next = '\0';
+    return 0;
+}
+
+int
+txt_append_str(struct txt_buf *tb, const char *s)
+{
+    return txt_put(tb, s, strlen(s));
+}
+
+int
+txt_append_char(struct txt_buf *tb, char c)
+{
+    return txt_put(tb, &c, 1);
+}
+
+/* Digits of val, at least min of them, right aligned in d[10] */
+static int
+txt_digits(char *d, uint32_t val, int min)
+{
+    int n = 0;
+
+    do {
+        d[9 - n++] = '0' + val % 10;
+        val /= 10;
+    } while (val || n < min);
+    return n;
+}
+
+int
+txt_append_u32(struct txt_buf *tb, uint32_t val)
+{
+    char d[10];
+    int n = txt_digits(d, val, 1);
+
+    return txt_put(tb, d + 10 - n, n);
+}
+
+int
+txt_append_i32(struct txt_buf *tb, int32_t val)
+{
+    char d[11];
+    uint32_t mag = val < 0 ? -(uint32_t)val : val;
+    int n = txt_digits(d + 1, mag, 1);
+
+    if (val < 0) {
+        d[10 - n++] = '-';
+    }
+    return txt_put(tb, d + 11 - n, n);
+}
+
+/*
+ * val rounded to decimals places, at most 9, by the core's ftoa_fixed.
+ * Out of the 32 bit range, or not a number, is an error.
+ */
+int
+txt_append_fixed(struct txt_buf *tb, float val, uint8_t decimals)
+{
+    char d[FTOA_FIXED_LEN];
+    int n = ftoa_fixed(val, d, decimals);
+
+    if (n < 0) {
+        tb->err = 1;
+        return -1;
+    }
+    return txt_put(tb, d, n);
+}
@@ -0,0 +1,217 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+#include "burst.h"
+#include "adcscan.h"
+#include "WindowStatistics.h"
+#include "log.h"
+
+
+#define BURST_IDLE              0
+#define BURST_RUN               1
+#define BURST_DONE              2
+
+static uint16_t burst_buf[BURST_MAX_SAMPLES];
+static volatile uint16_t burst_len;     /* samples in, from the DMAC IRQ */
+static volatile uint8_t burst_full;
+static uint16_t burst_want;
+static uint16_t burst_level;
+static uint8_t burst_state;
+static uint32_t burst_start_ms;
+static uint32_t burst_limit_ms;
+static struct adc_scan_cfg burst_prev;  /* the scan to go back to */
+static struct burst_summary burst_sum;
+
+
+/* A filled half of the scan buffer, from the DMAC IRQ */
+static void
+burst_take(const uint16_t *block, uint16_t len)
+{
+    uint16_t n = burst_len;
+    uint16_t k = min(len, (uint16_t)(burst_want - n));
+
+    memcpy(&burst_buf[n], block, k * sizeof(burst_buf[0]));
+    burst_len = n + k;
+    if (burst_len == burst_want) {
+        adc_scan_on_block(NULL);
+        burst_full = 1;
+    }
+}
+
+
+int
+burst_start(uint8_t pin, uint32_t rate_hz, uint16_t samples, uint8_t avg_log2, uint16_t level)
+{
+    struct adc_scan_cfg prev;
+    int rc;
+
+    if (burst_state == BURST_RUN) {
+        return BURST_ERR_BUSY;
+    }
+    if (!samples || samples > BURST_MAX_SAMPLES) {
+        return BURST_ERR_ARG;
+    }
+
+    adc_scan_get(&prev);
+    burst_len = 0;
+    burst_full = 0;
+    burst_want = samples;
+    /* a bad pin or rate fails before the scan running is stopped */
+    rc = adc_scan_start(&pin, 1, rate_hz, avg_log2);
+    if (rc != ADC_SCAN_OK) {
+        return rc;
+    }
+    /* well before the first half of the new scan is full */
+    adc_scan_on_block(burst_take);
+
+    burst_prev = prev;
+    burst_level = level;
+    burst_state = BURST_RUN;
+    burst_start_ms = millis();
+    burst_limit_ms = (uint32_t)samples * 1000 / rate_hz + BURST_SLACK_MS;
+    memset(&burst_sum, 0, sizeof(burst_sum));
+    burst_sum.rate_hz = rate_hz;
+    burst_sum.bits = adc_scan_bits();
+    return BURST_OK;
+}
+
+
+/* Back to the scan before the burst */
+static void
+burst_end(void)
+{
+    adc_scan_on_block(NULL);
+    adc_scan_stop();
+    if (burst_prev.n) {
+        (void)adc_scan_start(burst_prev.pins, burst_prev.n, burst_prev.rate_hz, burst_prev.avg_log2);
+    }
+}
+
+
+static void
+burst_summarize(void)
+{
+    struct burst_summary *s = &burst_sum;
+    WindowStatistics st;
+    uint16_t level;
+    uint16_t hyst;
+    uint16_t i;
+    uint8_t above = 0;
+    float var;
+
+    for (i = 0; i < burst_len; i++) {
+        st.input(burst_buf[i]);
+    }
+    s->n = burst_len;
+    s->min = st.minimum();
+    s->max = st.maximum();
+    s->mean = st.mean();
+    s->sigma = st.sigma();
+    /* mean square is the mean squared and the variance over n */
+    var = st.variance() * (s->n - 1) / s->n;
+    s->rms = sqrtf(s->mean * s->mean + var);
+
+    level = burst_level ? burst_level : (uint16_t)((s->mean + s->max) / 2);
+    hyst = level > s->mean ? (uint16_t)((level - s->mean) / 4) : 0;
+    s->level = level;
+    s->peaks = 0;
+    for (i = 0; i < burst_len; i++) {
+        if (!above && burst_buf[i] >= level) {
+            s->peaks++;
+            above = 1;
+        } else if (above && burst_buf[i] + hyst < level) {
+            above = 0;
+        }
+    }
+}
+
+
+uint8_t
+burst_poll(void)
+{
+    if (burst_state != BURST_RUN) {
+        return 0;
+    }
+    if (!burst_full) {
+        if (adc_scan_running() && (uint32_t)(millis() - burst_start_ms) < burst_limit_ms) {
+            return 0;
+        }
+        DLOG_ERR("Burst failed, %d of %d samples", burst_len, burst_want);
+        burst_end();
+        burst_len = 0;
+        burst_state = BURST_IDLE;
+        return 1;
+    }
+
+    burst_end();
+    burst_summarize();
+    burst_state = BURST_DONE;
+    DLOG_DEBUG("Burst %d samples, %d..%d, %d peaks", burst_sum.n, burst_sum.min, burst_sum.max,
+               burst_sum.peaks);
+    return 1;
+}
+
+
+uint8_t
+burst_busy(void)
+{
+    return burst_state == BURST_RUN;
+}
+
+
+uint16_t
+burst_summary_get(struct burst_summary *s)
+{
+    *s = burst_sum;
+    return s->n;
+}
+
+
+uint16_t
+burst_csv(char *buf, uint32_t offset, uint16_t size, uint8_t *more)
+{
+    static const uint16_t pow10[5] = { 10000, 1000, 100, 10, 1 };
+    uint32_t total = burst_state == BURST_DONE ? (uint32_t)burst_len * BURST_CSV_WIDTH : 0;
+    uint16_t k;
+    uint8_t c;
+
+    for (k = 0; k < size && offset < total; k++, offset++) {
+        c = offset % BURST_CSV_WIDTH;
+        if (c == BURST_CSV_WIDTH - 1) {
+            buf[k] = '\n';
+        } else {
+            buf[k] = '0' + burst_buf[offset / BURST_CSV_WIDTH] / pow10[c] % 10;
+        }
+    }
+    *more = offset < total;
+    return k;
+}
@@ -0,0 +1,271 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+
+#include <SPIMemory.h>
+#include "cal.h"
+#include "crc_xmodem.h"
+
+
+/* A saved table, a record of the log sector, n 0 when removed */
+struct cal_rec {
+    uint8_t mark;               /* CAL_REC_MARK, 0xFF -> end of the log */
+    uint8_t sensor_id;
+    uint8_t datatype;
+    uint8_t n;
+    uint16_t crc;               /* crc_xmodem of sensor_id, datatype, n and pt */
+    uint8_t pad[2];
+    sapi_cal_point_t pt[SAPI_CAL_POINTS];
+};
+
+// SPI flash of SAPI, out of deep power-down before each access
+extern SPIFlash flash;
+void sapi_flash_wake();
+
+static struct cal cals[CAL_MAX];
+static uint32_t cal_log_next;
+
+
+/* CRC of a record, from the sensor to the breakpoints */
+static uint16_t
+cal_rec_crc(const struct cal_rec *rec)
+{
+    uint16_t crc = crc_xmodem(crc_xmodem_init(), &rec->sensor_id, 3);
+
+    return crc_xmodem(crc, rec->pt, sizeof(rec->pt));
+}
+
+
+/* Table of a sensor's datatype, CAL_MAX if none */
+static uint8_t
+cal_indx(uint8_t sensor_id, uint8_t datatype)
+{
+    uint8_t indx;
+
+    for (indx = 0; indx < CAL_MAX; indx++) {
+        if (cals[indx].n && cals[indx].sensor_id == sensor_id && cals[indx].datatype == datatype) {
+            break;
+        }
+    }
+    return indx;
+}
+
+
+/* Table of a sensor's datatype, else a free one, CAL_MAX if none */
+static uint8_t
+cal_slot(uint8_t sensor_id, uint8_t datatype)
+{
+    uint8_t indx = cal_indx(sensor_id, datatype);
+
+    if (indx == CAL_MAX) {
+        for (indx = 0; indx < CAL_MAX && cals[indx].n; indx++)
+            ;
+    }
+    return indx;
+}
+
+
+/* Take n breakpoints into a table, with the slopes of the segments
+ * between them. False unless raw ascends and n fits. */
+static bool
+cal_fit(struct cal *c, const sapi_cal_point_t *pt, uint8_t n)
+{
+    int64_t slope;
+
+    if (!n || n > SAPI_CAL_POINTS) {
+        return false;
+    }
+    for (uint8_t i = 0; i + 1 < n; i++) {
+        if (pt[i + 1].raw <= pt[i].raw) {
+            return false;
+        }
+        slope = ((int64_t)pt[i + 1].eng - pt[i].eng) * 65536 / ((int64_t)pt[i + 1].raw - pt[i].raw);
+        c->slope[i] = slope > INT32_MAX ? INT32_MAX : slope < INT32_MIN ? INT32_MIN : (int32_t)slope;
+    }
+    memcpy(c->pt, pt, n * sizeof(*pt));
+    c->n = n;
+    return true;
+}
+
+
+int32_t
+cal_eval(const struct cal *c, int32_t raw)
+{
+    uint8_t lo = 0, hi = c->n - 1, mid;
+    int64_t eng;
+
+    if (c->n == 1) {
+        eng = (int64_t)c->pt[0].eng + raw - c->pt[0].raw;
+    } else {
+        /* The segment from pt[lo], the first or last one beyond the table */
+        hi--;
+        while (lo < hi) {
+            mid = (lo + hi + 1) / 2;
+            if (c->pt[mid].raw <= raw) {
+                lo = mid;
+            } else {
+                hi = mid - 1;
+            }
+        }
+        eng = (int64_t)c->pt[lo].eng + ((((int64_t)raw - c->pt[lo].raw) * c->slope[lo]) >> 16);
+    }
+    return eng > INT32_MAX ? INT32_MAX : eng < INT32_MIN ? INT32_MIN : (int32_t)eng;
+}
+
+
+/* Save a table, one record, n 0 for one removed. Once the log is full it
+ * is erased and the tables in use written at its start instead. */
+static bool
+cal_save(uint8_t sensor_id, uint8_t datatype, const sapi_cal_point_t *pt, uint8_t n)
+{
+    struct cal_rec rec;
+
+    sapi_flash_wake();
+    if (cal_log_next + sizeof(rec) > CAL_LOG_ADDR + CAL_LOG_SIZE) {
+        if (!flash.eraseSector(CAL_LOG_ADDR)) {
+            return false;
+        }
+        cal_log_next = CAL_LOG_ADDR;
+        for (uint8_t i = 0; i < CAL_MAX; i++) {
+            if (cals[i].n && !cal_save(cals[i].sensor_id, cals[i].datatype, cals[i].pt, cals[i].n)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    memset(&rec, 0, sizeof(rec));
+    rec.mark = CAL_REC_MARK;
+    rec.sensor_id = sensor_id;
+    rec.datatype = datatype;
+    rec.n = n;
+    memcpy(rec.pt, pt, n * sizeof(*pt));
+    rec.crc = cal_rec_crc(&rec);
+    if (!flash.writeByteArray(cal_log_next, (uint8_t *)&rec, sizeof(rec))) {
+        return false;
+    }
+    cal_log_next += sizeof(rec);
+    return true;
+}
+
+
+/* The last record of each sensor and datatype counts */
+void
+cal_load(void)
+{
+    struct cal_rec rec;
+    uint32_t addr;
+    uint8_t indx;
+
+    memset(cals, 0, sizeof(cals));
+    sapi_flash_wake();
+    for (addr = CAL_LOG_ADDR; addr + sizeof(rec) <= CAL_LOG_ADDR + CAL_LOG_SIZE; addr += sizeof(rec)) {
+        flash.readByteArray(addr, (uint8_t *)&rec, sizeof(rec));
+        if (rec.mark == 0xFF) {
+            break;
+        }
+        if (rec.mark != CAL_REC_MARK || rec.crc != cal_rec_crc(&rec)) {
+            continue;
+        }
+        indx = cal_slot(rec.sensor_id, rec.datatype);
+        if (indx == CAL_MAX) {
+            continue;
+        }
+        cals[indx].n = 0;
+        if (cal_fit(&cals[indx], rec.pt, rec.n)) {
+            cals[indx].sensor_id = rec.sensor_id;
+            cals[indx].datatype = rec.datatype;
+        }
+    }
+    cal_log_next = addr;
+}
+
+
+const struct cal *
+cal_find(uint8_t sensor_id, uint8_t datatype)
+{
+    uint8_t indx = cal_indx(sensor_id, datatype);
+
+    return indx < CAL_MAX ? &cals[indx] : NULL;
+}
+
+
+sapi_error_t
+cal_set(uint8_t sensor_id, uint8_t datatype, const sapi_cal_point_t *pt, uint8_t n)
+{
+    struct cal c;
+    uint8_t indx;
+
+    if (n > SAPI_CAL_POINTS) {
+        return SAPI_ERR_BAD_DATA;
+    }
+    indx = n ? cal_slot(sensor_id, datatype) : cal_indx(sensor_id, datatype);
+    if (indx == CAL_MAX) {
+        return n ? SAPI_ERR_NO_MEM : SAPI_ERR_OK;
+    }
+    memset(&c, 0, sizeof(c));
+    if (n && !cal_fit(&c, pt, n)) {
+        return SAPI_ERR_BAD_DATA;
+    }
+    if (cals[indx].n == n && !memcmp(cals[indx].pt, pt, n * sizeof(*pt))) {
+        return SAPI_ERR_OK;
+    }
+
+    c.sensor_id = sensor_id;
+    c.datatype = datatype;
+    cals[indx] = c;
+    return cal_save(sensor_id, datatype, pt, n) ? SAPI_ERR_OK : SAPI_ERR_FAIL;
+}
+
+
+/* Ahead of the prefilters and everything else */
+void
+cal_apply(uint8_t sensor_id, sapi_sample_t *samples, uint8_t count)
+{
+    const struct cal *c;
+    float v;
+
+    for (uint8_t indx = 0; indx < CAL_MAX; indx++) {
+        c = &cals[indx];
+        if (!c->n || c->sensor_id != sensor_id) {
+            continue;
+        }
+        for (uint8_t i = 0; i < count; i++) {
+            if (samples[i].datatype != c->datatype) {
+                continue;
+            }
+            v = samples[i].value * 65536.0f;
+            v = v > (float)INT32_MAX ? (float)INT32_MAX : v < (float)INT32_MIN ? (float)INT32_MIN : v;
+            samples[i].value = cal_eval(c, (int32_t)v) / 65536.0f;
+        }
+    }
+}
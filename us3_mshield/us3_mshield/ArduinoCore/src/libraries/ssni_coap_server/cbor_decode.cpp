@@ -0,0 +1,451 @@
+/*
+ * Copyright SilverSpring Networks 2017.
+ * All rights reserved.
+ *
+ * Bounded CBOR decoder. Works in place on the buffer given to
+ * cbor_dec_init: text and byte strings are returned as pointers into it, and
+ * nothing is allocated. Nesting is limited to CBOR_DEC_DEPTH_MAX.
+ */
+#include <arduino.h>
+#include <includes.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "cbor.h"
+
+#if CBOR_64_BIT
+#error "64-bit integer support is not available"
+#endif
+
+/*
+ * function: cbor_dec_init
+ * description: initialize a CBOR-specific struct used to decode data.
+ * input: cbuf -> ptr to cbor buf to be used during the decode session
+ *        buf -> buffer holding the encoded data.
+ *        len -> length of the encoded data.
+ */
+void
+cbor_dec_init(struct cbor_buf *cbuf, void *buf, int len)
+{
+    memset(cbuf, 0, sizeof(struct cbor_buf));
+    cbuf->head = (uint8_t*)buf;
+    cbuf->next = (uint8_t*)buf;
+    cbuf->tail = cbuf->head + len;
+}
+
+/*
+ * function: cbor_dec_head
+ * description: decode the initial byte and argument of the next data item.
+ * input: cbuf -> ptr to CBOR stream buffer.
+ *        major_type -> ptr to save the major type.
+ *        val -> ptr to save the argument.
+ * output: status of decode operation. Indefinite length and arguments that
+ *         don't fit 32 bits fail with CBOR_INV_ADDNL_INFO.
+ */
+static int
+cbor_dec_head(struct cbor_buf *cbuf, uint8_t *major_type, uint32_t *val)
+{
+    uint8_t *p = cbuf->next;
+    uint8_t ai;
+    int n;
+
+    if (p >= cbuf->tail) {
+        cbuf->err = CBOR_OUT_OF_DATA;
+        return CBOR_ERR;
+    }
+    *major_type = *p & CBOR_TYPE_PRIMITIVE;
+    ai = *p++ & CBOR_INDEF_LEN;
+
+    if (ai <= CBOR_MJR0_THRESHOLD) {
+        *val = ai;
+        cbuf->next = p;
+        return CBOR_OK;
+    }
+    switch (ai) {
+    case CBOR_ADDL_BYTE_UINT8:  n = 1; break;
+    case CBOR_ADDL_BYTE_UINT16: n = 2; break;
+    case CBOR_ADDL_BYTE_UINT32: n = 4; break;
+    case CBOR_ADDL_BYTE_UINT64: n = 8; break;
+    case CBOR_INDEF_LEN:
+        cbuf->err = CBOR_INV_ADDNL_INFO;
+        return CBOR_ERR;
+    default:
+        cbuf->err = CBOR_NOT_WELL_FRMD;
+        return CBOR_ERR;
+    }
+    if (cbuf->tail - p < n) {
+        cbuf->err = CBOR_OUT_OF_DATA;
+        return CBOR_ERR;
+    }
+
+    /* big endian, bytewise as it may not be aligned */
+    if (n == 8) {
+        if (p[0] | p[1] | p[2] | p[3]) {
+            cbuf->err = CBOR_INV_ADDNL_INFO;
+            return CBOR_ERR;
+        }
+        p += 4;
+        n = 4;
+    }
+    *val = 0;
+    while (n--) {
+        *val = (*val << 8) | *p++;
+    }
+    cbuf->next = p;
+    return CBOR_OK;
+}
+
+/*
+ * function: cbor_dec_major_type
+ * description: major type of the next data item, not consumed.
+ * output: CBOR_TYPE_*, or CBOR_INDEF_TERM at a break or the end of data.
+ */
+uint8_t
+cbor_dec_major_type(struct cbor_buf *cbuf)
+{
+    if (cbuf->next >= cbuf->tail) {
+        cbuf->err = CBOR_OUT_OF_DATA;
+        return CBOR_INDEF_TERM;
+    }
+    if (*cbuf->next == CBOR_INDEF_TERM) {
+        return CBOR_INDEF_TERM;
+    }
+    return *cbuf->next & CBOR_TYPE_PRIMITIVE;
+}
+
+/* Decode the head of an item of major_type, restoring next on error */
+static int
+cbor_dec_length(uint8_t major_type, struct cbor_buf *cbuf, uint32_t *val)
+{
+    uint8_t *save = cbuf->next;
+    uint8_t mt;
+
+    if (cbor_dec_head(cbuf, &mt, val)) {
+        cbuf->next = save;
+        return CBOR_ERR;
+    }
+    if (mt != major_type) {
+        cbuf->next = save;
+        cbuf->err = CBOR_INVALID_TYPE;
+        return CBOR_ERR;
+    }
+    return CBOR_OK;
+}
+
+/*
+ * function: cbor_dec_uint
+ * description: decode an unsigned integer.
+ * output: status of decode operation.
+ */
+int
+cbor_dec_uint(struct cbor_buf *cbuf, uint32_t *val)
+{
+    return cbor_dec_length(CBOR_TYPE_UINT, cbuf, val);
+}
+
+/*
+ * function: cbor_dec_int
+ * description: decode a signed integer, UINT or NINT, that fits an int.
+ * output: status of decode operation.
+ */
+int
+cbor_dec_int(struct cbor_buf *cbuf, int *val)
+{
+    uint8_t *save = cbuf->next;
+    uint8_t mt;
+    uint32_t v;
+
+    if (cbor_dec_head(cbuf, &mt, &v)) {
+        cbuf->next = save;
+        return CBOR_ERR;
+    }
+    if (mt != CBOR_TYPE_UINT && mt != CBOR_TYPE_NINT) {
+        cbuf->next = save;
+        cbuf->err = CBOR_INVALID_TYPE;
+        return CBOR_ERR;
+    }
+    if (v > INT32_MAX) {
+        cbuf->next = save;
+        cbuf->err = CBOR_INV_ADDNL_INFO;
+        return CBOR_ERR;
+    }
+    *val = (mt == CBOR_TYPE_NINT) ? -1 - (int)v : (int)v;
+    return CBOR_OK;
+}
+
+/* Definite length string of major type mt, returned in place */
+static const uint8_t *
+cbor_dec_string(uint8_t major_type, struct cbor_buf *cbuf, int *len)
+{
+    uint8_t *save = cbuf->next;
+    const uint8_t *s;
+    uint32_t v;
+
+    if (cbor_dec_length(major_type, cbuf, &v)) {
+        return NULL;
+    }
+    if (v > (uint32_t)(cbuf->tail - cbuf->next)) {
+        cbuf->next = save;
+        cbuf->err = CBOR_OUT_OF_DATA;
+        return NULL;
+    }
+    s = cbuf->next;
+    cbuf->next += v;
+    *len = v;
+    return s;
+}
+
+/*
+ * function: cbor_dec_text
+ * description: decode a definite length text string.
+ * input: str_len -> ptr to save the string length.
+ * output: ptr to the string in the buffer, not NUL terminated; NULL on error.
+ */
+const char *
+cbor_dec_text(struct cbor_buf *cbuf, int *str_len)
+{
+    return (const char *)cbor_dec_string(CBOR_TYPE_TEXT, cbuf, str_len);
+}
+
+/*
+ * function: cbor_dec_bytes
+ * description: decode a definite length byte string.
+ * input: byte_len -> ptr to save the string length.
+ * output: ptr to the bytes in the buffer; NULL on error.
+ */
+const uint8_t *
+cbor_dec_bytes(struct cbor_buf *cbuf, int *byte_len)
+{
+    return cbor_dec_string(CBOR_TYPE_BYTES, cbuf, byte_len);
+}
+
+/* Array or map head, CBOR_DEC_INDEF for indefinite length */
+static int
+cbor_dec_container(uint8_t major_type, struct cbor_buf *cbuf)
+{
+    uint32_t v;
+
+    if (cbuf->next < cbuf->tail &&
+        *cbuf->next == (major_type | CBOR_INDEF_LEN)) {
+        cbuf->next++;
+        return CBOR_DEC_INDEF;
+    }
+    if (cbor_dec_length(major_type, cbuf, &v)) {
+        return CBOR_ERR;
+    }
+    if (v > INT16_MAX) {
+        cbuf->err = CBOR_INV_ADDNL_INFO;
+        return CBOR_ERR;
+    }
+    return v;
+}
+
+/*
+ * function: cbor_dec_array
+ * description: decode an array head.
+ * output: number of elements; CBOR_DEC_INDEF for an indefinite array,
+ *         ended by cbor_dec_indef_break; CBOR_ERR on error.
+ */
+int
+cbor_dec_array(struct cbor_buf *cbuf)
+{
+    return cbor_dec_container(CBOR_TYPE_ARRAY, cbuf);
+}
+
+/*
+ * function: cbor_dec_map
+ * description: decode a map head.
+ * output: number of key/value pairs; CBOR_DEC_INDEF for an indefinite map,
+ *         ended by cbor_dec_indef_break; CBOR_ERR on error.
+ */
+int
+cbor_dec_map(struct cbor_buf *cbuf)
+{
+    return cbor_dec_container(CBOR_TYPE_MAP, cbuf);
+}
+
+/*
+ * function: cbor_dec_indef_break
+ * description: consume the break ending an indefinite array or map.
+ * output: true if the next byte was a break.
+ */
+bool
+cbor_dec_indef_break(struct cbor_buf *cbuf)
+{
+    if (cbuf->next < cbuf->tail && *cbuf->next == CBOR_INDEF_TERM) {
+        cbuf->next++;
+        return true;
+    }
+    return false;
+}
+
+/*
+ * function: cbor_dec_primitive
+ * description: decode a simple value, e.g. CBOR_PRIM_BOOL_TRUE.
+ * output: the simple value, CBOR_ERR on error or for a float.
+ */
+int
+cbor_dec_primitive(struct cbor_buf *cbuf)
+{
+    uint8_t ai;
+
+    if (cbuf->next >= cbuf->tail) {
+        cbuf->err = CBOR_OUT_OF_DATA;
+        return CBOR_ERR;
+    }
+    if ((*cbuf->next & CBOR_TYPE_PRIMITIVE) != CBOR_TYPE_PRIMITIVE) {
+        cbuf->err = CBOR_INVALID_TYPE;
+        return CBOR_ERR;
+    }
+    ai = *cbuf->next & CBOR_INDEF_LEN;
+    if (ai > CBOR_MJR0_THRESHOLD) {
+        cbuf->err = CBOR_INVALID_TYPE;
+        return CBOR_ERR;
+    }
+    cbuf->next++;
+    return ai;
+}
+
+/*
+ * function: cbor_dec_prim_float32
+ * description: decode a single precision float.
+ * output: status of decode operation.
+ */
+int
+cbor_dec_prim_float32(struct cbor_buf *cbuf, float *val)
+{
+    union {
+        uint32_t u32;
+        float    f;
+    } temp;
+    uint8_t *p = cbuf->next;
+
+    if (cbuf->tail - p < 1 + (int)sizeof(float)) {
+        cbuf->err = CBOR_OUT_OF_DATA;
+        return CBOR_ERR;
+    }
+    if (*p++ != (CBOR_TYPE_PRIMITIVE | CBOR_PRIM_FLOAT32)) {
+        cbuf->err = CBOR_INVALID_TYPE;
+        return CBOR_ERR;
+    }
+    temp.u32 = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+               ((uint32_t)p[2] << 8) | p[3];
+    *val = temp.f;
+    cbuf->next = p + sizeof(float);
+    return CBOR_OK;
+}
+
+/*
+ * function: cbor_dec_skip
+ * description: skip the next data item, with everything nested in it.
+ * output: status of decode operation.
+ */
+int
+cbor_dec_skip(struct cbor_buf *cbuf)
+{
+    /* items left at each level, -1 for indefinite, up to a break */
+    int32_t left[CBOR_DEC_DEPTH_MAX];
+    int depth = 0;
+    uint8_t mt;
+    uint32_t v;
+
+    left[0] = 1;
+    while (depth >= 0) {
+        if (left[depth] == 0) {
+            depth--;
+            continue;
+        }
+        if (cbuf->next >= cbuf->tail) {
+            cbuf->err = CBOR_OUT_OF_DATA;
+            return CBOR_ERR;
+        }
+        if (*cbuf->next == CBOR_INDEF_TERM) {
+            if (left[depth] > 0) {
+                cbuf->err = CBOR_NOT_WELL_FRMD;
+                return CBOR_ERR;
+            }
+            cbuf->next++;
+            depth--;
+            continue;
+        }
+        if (left[depth] > 0) {
+            left[depth]--;
+        }
+
+        mt = *cbuf->next & CBOR_TYPE_PRIMITIVE;
+        if ((*cbuf->next & CBOR_INDEF_LEN) == CBOR_INDEF_LEN) {
+            /* indefinite string, array or map */
+            if (mt == CBOR_TYPE_UINT || mt == CBOR_TYPE_NINT ||
+                mt == CBOR_TYPE_TAG || mt == CBOR_TYPE_PRIMITIVE) {
+                cbuf->err = CBOR_NOT_WELL_FRMD;
+                return CBOR_ERR;
+            }
+            cbuf->next++;
+            if (++depth >= CBOR_DEC_DEPTH_MAX) {
+                cbuf->err = CBOR_NO_MEM;
+                return CBOR_ERR;
+            }
+            left[depth] = -1;
+            continue;
+        }
+
+        if (cbor_dec_head(cbuf, &mt, &v)) {
+            return CBOR_ERR;
+        }
+        switch (mt) {
+        case CBOR_TYPE_BYTES:
+        case CBOR_TYPE_TEXT:
+            if (v > (uint32_t)(cbuf->tail - cbuf->next)) {
+                cbuf->err = CBOR_OUT_OF_DATA;
+                return CBOR_ERR;
+            }
+            cbuf->next += v;
+            break;
+        case CBOR_TYPE_ARRAY:
+        case CBOR_TYPE_MAP:
+        case CBOR_TYPE_TAG:
+            if (mt == CBOR_TYPE_TAG) {
+                v = 1;      /* the tagged item */
+            } else if (v > (uint32_t)(cbuf->tail - cbuf->next)) {
+                /* each element takes at least a byte */
+                cbuf->err = CBOR_OUT_OF_DATA;
+                return CBOR_ERR;
+            } else if (mt == CBOR_TYPE_MAP) {
+                v *= 2;
+            }
+            if (v) {
+                if (++depth >= CBOR_DEC_DEPTH_MAX) {
+                    cbuf->err = CBOR_NO_MEM;
+                    return CBOR_ERR;
+                }
+                left[depth] = v;
+            }
+            break;
+        default:
+            /* integers and simple values, the head is all there is */
+            break;
+        }
+    }
+    return CBOR_OK;
+}
+
+/*
+ * function: cbor_dec_well_formed
+ * description: check the data from the current position to the end of the
+ * buffer is a sequence of well formed items. Nothing is consumed.
+ * output: status of check.
+ */
+int
+cbor_dec_well_formed(struct cbor_buf *cbuf)
+{
+    struct cbor_buf c = *cbuf;
+
+    while (c.next < c.tail) {
+        if (cbor_dec_skip(&c)) {
+            cbuf->err = c.err;
+            return CBOR_ERR;
+        }
+    }
+    return CBOR_OK;
+}
@@ -338,6 +338,7 @@ void
 cbor_enc_prim_undef(struct cbor_buf *cbuf) {
     if ((cbuf->tail - cbuf->next) < 1) {
         cbuf->err = CBOR_NO_MEM;
+        return;
     }
     *cbuf->next++ = CBOR_TYPE_PRIMITIVE | CBOR_PRIM_UNDEF;
 }
@@ -355,7 +356,7 @@ cbor_enc_prim_float32(struct cbor_buf *cbuf, float val)
     temp.u32 = htonl(temp.u32);
 
 
-    if ((cbuf->tail - cbuf->next) < sizeof(float)) {
+    if ((cbuf->tail - cbuf->next) < 1 + sizeof(float)) {
         cbuf->err = CBOR_NO_MEM;
         return CBOR_ERR;
     }
@@ -364,3 +365,242 @@ cbor_enc_prim_float32(struct cbor_buf *cbuf, float val)
     cbuf->next += sizeof(float);
     return CBOR_OK;
 }
+
+/*
+ * Single to half precision, round to nearest even. Out of range values
+ * become infinity, tiny ones half subnormals or zero.
+ */
+static uint16_t
+cbor_float_to_half(float val)
+{
+    union {
+        uint32_t u32;
+        float    f;
+    } temp;
+    uint32_t mant, rem, half;
+    uint16_t sign, h;
+    int32_t exp;
+    int shift;
+
+    temp.f = val;
+    sign = (temp.u32 >> 16) & 0x8000;
+    exp = (temp.u32 >> 23) & 0xFF;
+    mant = temp.u32 & 0x7FFFFF;
+
+    if (exp == 0xFF) {
+        /* infinity, or a quiet NaN */
+        return sign | 0x7C00 | (mant ? 0x200 : 0);
+    }
+    exp -= 127 - 15;
+    if (exp >= 0x1F) {
+        return sign | 0x7C00;
+    }
+    if (exp <= 0) {
+        if (exp < -10) {
+            return sign;
+        }
+        mant |= 0x800000;
+        shift = 14 - exp;
+        h = mant >> shift;
+    } else {
+        shift = 13;
+        h = (exp << 10) | (mant >> shift);
+    }
+    rem = mant & ((1UL << shift) - 1);
+    half = 1UL << (shift - 1);
+    if (rem > half || (rem == half && (h & 1))) {
+        /* may carry into the exponent, up to infinity, which is right */
+        h++;
+    }
+    return sign | h;
+}
+
+/*
+ * function: cbor_enc_prim_float16
+ * description: CBOR encode a half precision float, 3 bytes instead of 5.
+ * 11 significant bits, about 3 decimal digits, and up to 65504.
+ * input: cbuf -> ptr to CBOR stream buffer.
+ *        val -> value, rounded to half precision.
+ * output: status of encode operation.
+ */
+int
+cbor_enc_prim_float16(struct cbor_buf *cbuf, float val)
+{
+    uint16_t h = cbor_float_to_half(val);
+
+    if ((cbuf->tail - cbuf->next) < 1 + (int)sizeof(uint16_t)) {
+        cbuf->err = CBOR_NO_MEM;
+        return CBOR_ERR;
+    }
+    *cbuf->next++ = CBOR_TYPE_PRIMITIVE | CBOR_PRIM_FLOAT16;
+    *cbuf->next++ = h >> 8;
+    *cbuf->next++ = h & 0xFF;
+    return CBOR_OK;
+}
+
+/*
+ * function: cbor_enc_tag
+ * description: CBOR encode a tag, the next item is the tagged item.
+ * output: status of encode operation.
+ */
+int
+cbor_enc_tag(struct cbor_buf *cbuf, uint32_t tag)
+{
+    return (cbor_enc_length(CBOR_TYPE_TAG, cbuf, tag));
+}
+
+/* Tag and byte string head of an RFC 8746 typed array of len bytes */
+static int
+cbor_enc_typed_head(struct cbor_buf *cbuf, uint32_t tag, int len)
+{
+    if (cbor_enc_tag(cbuf, tag) || cbor_enc_length(CBOR_TYPE_BYTES, cbuf, len)) {
+        return CBOR_ERR;
+    }
+    if (len > (cbuf->tail - cbuf->next)) {
+        cbuf->err = CBOR_NO_MEM;
+        return CBOR_ERR;
+    }
+    return CBOR_OK;
+}
+
+/*
+ * function: cbor_enc_typed_float16
+ * description: CBOR encode floats as an RFC 8746 typed array of big endian
+ * half precision floats, 2 bytes per value.
+ * input: cbuf -> ptr to CBOR stream buffer.
+ *        vals -> values to be encoded.
+ *        num_elements -> number of values.
+ * output: status of encode operation.
+ */
+int
+cbor_enc_typed_float16(struct cbor_buf *cbuf, const float *vals, int num_elements)
+{
+    uint16_t h;
+    int i;
+
+    if (cbor_enc_typed_head(cbuf, CBOR_TAG_TA_FLOAT16_BE,
+                            num_elements * sizeof(uint16_t))) {
+        return CBOR_ERR;
+    }
+    for (i = 0; i < num_elements; i++) {
+        h = cbor_float_to_half(vals[i]);
+        *cbuf->next++ = h >> 8;
+        *cbuf->next++ = h & 0xFF;
+    }
+    return CBOR_OK;
+}
+
+/*
+ * function: cbor_enc_typed_float32
+ * description: CBOR encode floats as an RFC 8746 typed array of big endian
+ * single precision floats, 4 bytes per value instead of 5.
+ * output: status of encode operation.
+ */
+int
+cbor_enc_typed_float32(struct cbor_buf *cbuf, const float *vals, int num_elements)
+{
+    union {
+        uint32_t u32;
+        float    f;
+    } temp;
+    int i;
+
+    if (cbor_enc_typed_head(cbuf, CBOR_TAG_TA_FLOAT32_BE,
+                            num_elements * sizeof(float))) {
+        return CBOR_ERR;
+    }
+    for (i = 0; i < num_elements; i++) {
+        temp.f = vals[i];
+        temp.u32 = htonl(temp.u32);
+        memcpy(cbuf->next, &temp.u32, sizeof(float));
+        cbuf->next += sizeof(float);
+    }
+    return CBOR_OK;
+}
+
+/*
+ * function: cbor_enc_typed_sint16
+ * description: CBOR encode integers as an RFC 8746 typed array of big
+ * endian signed 16 bit integers, scaled readings for example.
+ * output: status of encode operation.
+ */
+int
+cbor_enc_typed_sint16(struct cbor_buf *cbuf, const int16_t *vals, int num_elements)
+{
+    int i;
+
+    if (cbor_enc_typed_head(cbuf, CBOR_TAG_TA_SINT16_BE,
+                            num_elements * sizeof(int16_t))) {
+        return CBOR_ERR;
+    }
+    for (i = 0; i < num_elements; i++) {
+        *cbuf->next++ = (uint16_t)vals[i] >> 8;
+        *cbuf->next++ = (uint16_t)vals[i] & 0xFF;
+    }
+    return CBOR_OK;
+}
+
+/* Zigzag maps small deltas of either sign to small unsigned values */
+static uint32_t
+cbor_zigzag(int32_t delta)
+{
+    return ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+}
+
+/* Bytes of the LEB128 varint of val, written to p unless NULL */
+static int
+cbor_varint(uint8_t *p, uint32_t val)
+{
+    int n = 0;
+
+    do {
+        if (p) {
+            p[n] = (val & 0x7F) | (val > 0x7F ? 0x80 : 0);
+        }
+        n++;
+        val >>= 7;
+    } while (val);
+    return n;
+}
+
+/*
+ * function: cbor_enc_series
+ * description: CBOR encode a regularly sampled series as
+ * [<epoch>, <step>, h'<deltas>'], the first sample taken at epoch and one
+ * every step seconds after. The deltas are vals[i] - vals[i-1], vals[-1]
+ * being 0, as zigzag LEB128 varints: one byte for each slowly changing
+ * sample. Scale readings to integers first, e.g. level in mm.
+ * input: cbuf -> ptr to CBOR stream buffer.
+ *        epoch -> UNIX epoch of the first sample.
+ *        step -> seconds between samples.
+ *        vals -> samples to be encoded.
+ *        num_elements -> number of samples.
+ * output: status of encode operation.
+ */
+int
+cbor_enc_series(struct cbor_buf *cbuf, uint32_t epoch, uint32_t step,
+                const int32_t *vals, int num_elements)
+{
+    int32_t prev = 0;
+    int len = 0;
+    int i;
+
+    for (i = 0; i < num_elements; i++) {
+        len += cbor_varint(NULL, cbor_zigzag(vals[i] - prev));
+        prev = vals[i];
+    }
+    if (cbor_enc_array(cbuf, 3) || cbor_enc_uint(cbuf, epoch) ||
+        cbor_enc_uint(cbuf, step) || cbor_enc_length(CBOR_TYPE_BYTES, cbuf, len)) {
+        return CBOR_ERR;
+    }
+    if (len > (cbuf->tail - cbuf->next)) {
+        cbuf->err = CBOR_NO_MEM;
+        return CBOR_ERR;
+    }
+    prev = 0;
+    for (i = 0; i < num_elements; i++) {
+        cbuf->next += cbor_varint(cbuf->next, cbor_zigzag(vals[i] - prev));
+        prev = vals[i];
+    }
+    return CBOR_OK;
+}
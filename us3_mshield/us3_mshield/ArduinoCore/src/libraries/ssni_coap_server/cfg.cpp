@@ -0,0 +1,462 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SPIMemory.h>
+#include "cfg.h"
+#include "relay.h"
+#include "crc_xmodem.h"
+
+
+/* Header of a sector of the store */
+struct cfg_hdr {
+    uint16_t magic;             /* CFG_HDR_MAGIC */
+    uint16_t crc;               /* crc_xmodem of seq */
+    uint32_t seq;               /* Sectors in the order compacted, from 1 */
+};
+
+/* Image of the values, after the header */
+struct cfg_image {
+    uint16_t magic;             /* CFG_MAGIC */
+    uint8_t version;            /* CFG_VERSION */
+    uint8_t count;              /* Values in the image, the crc follows the last */
+    int32_t value[CFG_COUNT];   /* Values, by CFG_* index */
+    uint16_t crc;               /* crc_xmodem of the bytes before it */
+};
+
+/* Parameter changed since the image was written, a log record */
+struct cfg_rec {
+    uint8_t mark;               /* CFG_REC_MARK, 0xFF -> end of the log */
+    uint8_t index;              /* CFG_* index */
+    uint16_t crc;               /* crc_xmodem of index and value */
+    int32_t value;              /* New value */
+};
+
+/* Where the records of a sector start, after its image */
+#define CFG_REC_OFF             (sizeof(struct cfg_hdr) + sizeof(struct cfg_image))
+
+// SPI flash of SAPI, out of deep power-down before each access
+extern SPIFlash flash;
+void sapi_flash_wake();
+
+// The pins that follow a parameter, and its echo on the console
+void sapi_cfg_applied(uint8_t index, int value);
+
+int sendInterval = 0;
+int sampleRate = 0;
+int Digital10 = 0;
+int Digital11 = 0;
+int Relay1 = 0;
+int Relay2 = 0;
+int Analog4 = 0;
+int Analog5 = 0;
+int FastBoot = 0;
+int ModbusBaud = 0;
+int ModbusFormat = 0;
+
+const struct cfg_param cfg_params[CFG_COUNT] = {
+    { "SendInterval",   &sendInterval,          1 },
+    { "SampleRate",     &sampleRate,            1 },
+    { "Digital10",      &Digital10,             0 },
+    { "Digital11",      &Digital11,             0 },
+    { "Relay1",         &Relay1,                0 },
+    { "Relay2",         &Relay2,                0 },
+    { "Analog4",        &Analog4,               0 },
+    { "Analog5",        &Analog5,               0 },
+    { "FastBoot",       &FastBoot,              0 },
+    { "ModbusBaud",     &ModbusBaud,            0 },
+    { "ModbusFormat",   &ModbusFormat,          0 },
+    { "Rule1Chan",      &relay_cfg[0].chan,     0 },
+    { "Rule1Op",        &relay_cfg[0].op,       0 },
+    { "Rule1Limit",     &relay_cfg[0].limit,    0 },
+    { "Rule1Hyst",      &relay_cfg[0].hyst,     0 },
+    { "Rule1Action",    &relay_cfg[0].action,   0 },
+    { "Rule1MinOn",     &relay_cfg[0].min_on,   0 },
+    { "Rule1MinOff",    &relay_cfg[0].min_off,  0 },
+    { "Rule2Chan",      &relay_cfg[1].chan,     0 },
+    { "Rule2Op",        &relay_cfg[1].op,       0 },
+    { "Rule2Limit",     &relay_cfg[1].limit,    0 },
+    { "Rule2Hyst",      &relay_cfg[1].hyst,     0 },
+    { "Rule2Action",    &relay_cfg[1].action,   0 },
+    { "Rule2MinOn",     &relay_cfg[1].min_on,   0 },
+    { "Rule2MinOff",    &relay_cfg[1].min_off,  0 },
+};
+
+/* The snapshot published and the one built next, and whether a parameter
+ * changed since the last */
+static sapi_config_t cfg_snap[2];
+static const sapi_config_t * volatile cfg_cur = &cfg_snap[0];
+static uint8_t cfg_dirty;
+
+/* Sector of the store in use, 0 until found, its sequence and its next
+ * free record */
+static uint32_t cfg_base;
+static uint32_t cfg_seq;
+static uint32_t cfg_log_next;
+
+
+uint8_t
+cfg_find(const char *name, int len)
+{
+    uint8_t i;
+
+    for (i = 0; i < CFG_COUNT; i++) {
+        if (!strncmp(name, cfg_params[i].name, len) && cfg_params[i].name[len] == '\0') {
+            break;
+        }
+    }
+    return i;
+}
+
+
+void
+cfg_apply(uint8_t index, int value)
+{
+    if (*cfg_params[index].value != value) {
+        cfg_dirty = 1;
+    }
+    *cfg_params[index].value = value;
+    sapi_cfg_applied(index, value);
+}
+
+
+void
+cfg_publish(void)
+{
+    const sapi_config_t *cur = cfg_cur;
+    sapi_config_t *next = (cur == &cfg_snap[0]) ? &cfg_snap[1] : &cfg_snap[0];
+
+    if (!cfg_dirty && cur->gen) {
+        return;
+    }
+    cfg_dirty = 0;
+
+    next->gen = cur->gen + 1;
+    next->send_interval = sendInterval;
+    next->sample_rate = sampleRate;
+    next->report_s = sampleRate * sendInterval;
+    next->digital10 = Digital10;
+    next->digital11 = Digital11;
+    next->relay1 = Relay1;
+    next->relay2 = Relay2;
+    next->analog4 = Analog4;
+    next->analog5 = Analog5;
+    next->fast_boot = (FastBoot != 0);
+    next->mb_baud = ModbusBaud > 0 ? ModbusBaud : 0;
+    next->mb_format = ModbusFormat > 0 ? ModbusFormat : 0;
+    cfg_cur = next;
+}
+
+
+const sapi_config_t *
+cfg_config(void)
+{
+    return cfg_cur;
+}
+
+
+int
+cfg_import(const char *text)
+{
+    const char *p = text;
+    const char *sep;
+    char *end;
+    uint8_t index;
+    long value;
+    int n = 0;
+
+    while (*p && *p != '.') {
+        if (!(sep = strchr(p, ':'))) {
+            break;
+        }
+        index = cfg_find(p, sep - p);
+        value = strtol(sep + 1, &end, 10);
+        if (index < CFG_COUNT && end != sep + 1) {
+            cfg_apply(index, value);
+            n++;
+        }
+        if (!(p = strchr(end, ','))) {
+            break;
+        }
+        p++;
+    }
+    return n;
+}
+
+
+void
+cfg_export(Print *out)
+{
+    uint8_t i;
+
+    for (i = 0; i < CFG_COUNT; i++) {
+        out->print(cfg_params[i].name);
+        out->print(":");
+        out->print(*cfg_params[i].value);
+        out->print(",");
+    }
+    out->println(".");
+}
+
+
+/* CRC of a record, over the index and the value */
+static uint16_t
+cfg_rec_crc(const struct cfg_rec *rec)
+{
+    uint16_t crc = crc_xmodem(crc_xmodem_init(), &rec->index, sizeof(rec->index));
+
+    return crc_xmodem(crc, &rec->value, sizeof(rec->value));
+}
+
+
+/* Find the sector in use, the good header of the highest sequence. False
+ * if there is none. */
+static bool
+cfg_sector_find(void)
+{
+    struct cfg_hdr hdr;
+    uint32_t addr;
+    uint8_t i;
+
+    cfg_base = 0;
+    cfg_seq = 0;
+    sapi_flash_wake();
+    for (i = 0; i < CFG_SECTORS; i++) {
+        addr = CFG_ADDR + (uint32_t)i * CFG_SECTOR;
+        flash.readByteArray(addr, (uint8_t *)&hdr, sizeof(hdr));
+        if (hdr.magic == CFG_HDR_MAGIC && hdr.crc == crc_xmodem(crc_xmodem_init(), &hdr.seq, sizeof(hdr.seq)) &&
+            hdr.seq > cfg_seq) {
+            cfg_base = addr;
+            cfg_seq = hdr.seq;
+        }
+    }
+    return cfg_base != 0;
+}
+
+
+/*
+ * The image goes into the next sector, which then takes the records. The
+ * header goes last, until it is written the sector in use stays the one
+ * before.
+ */
+bool
+cfg_save(void)
+{
+    struct cfg_hdr hdr;
+    struct cfg_image img;
+    uint32_t addr;
+    uint8_t i;
+
+    if (!cfg_base) {
+        (void)cfg_sector_find();
+    }
+    addr = cfg_base + CFG_SECTOR;
+    if (!cfg_base || addr >= CFG_ADDR + CFG_SECTORS * CFG_SECTOR) {
+        addr = CFG_ADDR;
+    }
+
+    memset(&img, 0xFF, sizeof(img));
+    img.magic = CFG_MAGIC;
+    img.version = CFG_VERSION;
+    img.count = CFG_COUNT;
+    for (i = 0; i < CFG_COUNT; i++) {
+        img.value[i] = *cfg_params[i].value;
+    }
+    img.crc = crc_xmodem(crc_xmodem_init(), &img, offsetof(struct cfg_image, crc));
+
+    hdr.magic = CFG_HDR_MAGIC;
+    hdr.seq = cfg_seq + 1;
+    hdr.crc = crc_xmodem(crc_xmodem_init(), &hdr.seq, sizeof(hdr.seq));
+    sapi_flash_wake();
+    if (!flash.eraseSector(addr) ||
+            !flash.writeByteArray(addr + sizeof(hdr), (uint8_t *)&img, sizeof(img)) ||
+            !flash.writeByteArray(addr, (uint8_t *)&hdr, sizeof(hdr))) {
+        return false;
+    }
+
+    cfg_base = addr;
+    cfg_seq = hdr.seq;
+    cfg_log_next = addr + CFG_REC_OFF;
+    return true;
+}
+
+
+/* Read the image at addr, one read. Returns the number of values in it, 0
+ * if there is none or it is bad. The values past them keep their defaults. */
+static uint8_t
+cfg_read(uint32_t addr, struct cfg_image *img)
+{
+    uint16_t crc;
+    uint8_t count;
+
+    sapi_flash_wake();
+    if (!flash.readByteArray(addr, (uint8_t *)img, sizeof(*img))) {
+        return 0;
+    }
+    if (img->magic != CFG_MAGIC || img->version == 0 || img->version > CFG_VERSION) {
+        return 0;
+    }
+    count = (img->version == 1) ? CFG_V1_COUNT : img->count;
+    if (count == 0 || count > CFG_COUNT) {
+        return 0;
+    }
+
+    memcpy(&crc, &img->value[count], sizeof(crc));
+    if (crc != crc_xmodem(crc_xmodem_init(), img, offsetof(struct cfg_image, value) + count * sizeof(img->value[0]))) {
+        return 0;
+    }
+    return count;
+}
+
+
+/*
+ * Go over the image at img_addr, then the records from rec_addr to end, and
+ * set every value, or with index below CFG_COUNT only read that one into
+ * *value. A bad record is skipped, it is never written over. Returns where
+ * the records end, 0 if there is no image.
+ */
+static uint32_t
+cfg_walk(uint32_t img_addr, uint32_t rec_addr, uint32_t end, uint8_t index, int *value)
+{
+    struct cfg_image img;
+    struct cfg_rec rec;
+    uint8_t count = cfg_read(img_addr, &img);
+    uint32_t addr;
+    uint8_t i;
+
+    if (!count) {
+        return 0;
+    }
+    for (i = 0; i < count; i++) {
+        if (index == CFG_COUNT) {
+            cfg_apply(i, img.value[i]);
+        } else if (i == index) {
+            *value = img.value[i];
+        }
+    }
+    for (addr = rec_addr; addr + sizeof(rec) <= end; addr += sizeof(rec)) {
+        flash.readByteArray(addr, (uint8_t *)&rec, sizeof(rec));
+        if (rec.mark == 0xFF) {
+            break;
+        }
+        if (rec.mark != CFG_REC_MARK || rec.index >= CFG_COUNT || rec.crc != cfg_rec_crc(&rec)) {
+            continue;
+        }
+        if (index == CFG_COUNT) {
+            cfg_apply(rec.index, rec.value);
+        } else if (rec.index == index) {
+            *value = rec.value;
+        }
+    }
+    return addr;
+}
+
+
+bool
+cfg_load(void)
+{
+    if (cfg_sector_find()) {
+        cfg_log_next = cfg_walk(cfg_base + sizeof(struct cfg_hdr), cfg_base + CFG_REC_OFF,
+                cfg_base + CFG_SECTOR, CFG_COUNT, NULL);
+        if (cfg_log_next) {
+            return true;
+        }
+    }
+    if (!cfg_walk(CFG_V2_IMG_ADDR, CFG_ADDR, CFG_ADDR + CFG_SECTOR, CFG_COUNT, NULL)) {
+        return false;
+    }
+
+    /* Into the first sector, the image before stays until that is done */
+    cfg_base = 0;
+    cfg_seq = 0;
+    (void)cfg_save();
+    return true;
+}
+
+
+int
+cfg_peek(uint8_t index)
+{
+    int value = 0;
+
+    if (!cfg_sector_find() ||
+            !cfg_walk(cfg_base + sizeof(struct cfg_hdr), cfg_base + CFG_REC_OFF,
+                cfg_base + CFG_SECTOR, index, &value)) {
+        (void)cfg_walk(CFG_V2_IMG_ADDR, CFG_ADDR, CFG_ADDR + CFG_SECTOR, index, &value);
+    }
+    return value;
+}
+
+
+/* Once the sector is full the values are compacted into the next one
+ * instead, the value is already set */
+bool
+cfg_log(uint8_t index, int value)
+{
+    struct cfg_rec rec;
+
+    if (!cfg_base || cfg_log_next + sizeof(rec) > cfg_base + CFG_SECTOR) {
+        return cfg_save();
+    }
+
+    rec.mark = CFG_REC_MARK;
+    rec.index = index;
+    rec.value = value;
+    rec.crc = cfg_rec_crc(&rec);
+    sapi_flash_wake();
+    if (!flash.writeByteArray(cfg_log_next, (uint8_t *)&rec, sizeof(rec))) {
+        return false;
+    }
+    cfg_log_next += sizeof(rec);
+    return true;
+}
+
+
+bool
+cfg_erase(void)
+{
+    bool ok;
+    uint8_t i;
+
+    sapi_flash_wake();
+    ok = flash.eraseSector(CFG_TEXT_ADDR);
+    for (i = 0; i < CFG_SECTORS; i++) {
+        ok = flash.eraseSector(CFG_ADDR + (uint32_t)i * CFG_SECTOR) && ok;
+    }
+    cfg_base = 0;
+    cfg_seq = 0;
+    return ok;
+}
@@ -0,0 +1,130 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+#include "chan.h"
+#include "arduino_time.h"
+
+
+void
+chan_init(const struct chan *tab, uint8_t n)
+{
+    uint8_t i;
+
+    for (i = 0; i < n; i++) {
+        if (tab[i].source == CHAN_GPIO) {
+            pinMode(tab[i].pin, (tab[i].flags & CHAN_F_PULLUP) ? INPUT_PULLUP : INPUT);
+        }
+    }
+}
+
+
+uint8_t
+chan_read(const struct chan *c, float *value, uint32_t *age_ms)
+{
+    *age_ms = 0;
+    switch (c->source) {
+    case CHAN_MODBUS:
+        return mb_point_read(c->point, c->image, value, age_ms);
+    case CHAN_GPIO:
+        *value = (digitalRead(c->pin) == HIGH) ^ !!(c->flags & CHAN_F_INVERT);
+        return MB_Q_GOOD;
+    case CHAN_ADC:
+        *value = analogRead(c->pin) * c->scale + c->offset;
+        return MB_Q_GOOD;
+    case CHAN_COMPUTED:
+        return c->fn(c, value, age_ms);
+    case CHAN_SERIAL:
+        return ser_field_read(c->field, c->record, value, age_ms);
+    }
+    return MB_Q_NONE;
+}
+
+
+sapi_error_t
+chan_samples(const struct chan *tab, uint8_t n, sapi_sample_t *samples, uint8_t *count)
+{
+    uint32_t now = millis();
+    uint32_t age_ms;
+    uint8_t i, k = 0;
+
+    for (i = 0; i < n && k < *count; i++) {
+        if (!tab[i].datatype) {
+            continue;
+        }
+        if (chan_read(&tab[i], &samples[k].value, &age_ms) == MB_Q_NONE) {
+            return SAPI_ERR_FAIL;
+        }
+        samples[k].epoch = get_rtc_epoch_at(now - age_ms, &samples[k].ms);
+        samples[k].datatype = tab[i].datatype;
+        k++;
+    }
+    *count = k;
+    return SAPI_ERR_OK;
+}
+
+
+sapi_error_t
+chan_payload(const struct chan *tab, uint8_t n, uint32_t epoch,
+             struct txt_buf *tb, uint8_t units)
+{
+    float values[CHAN_MAX];
+    uint32_t age_ms, oldest = 0;
+    uint8_t i;
+
+    if (n > CHAN_MAX) {
+        n = CHAN_MAX;
+    }
+    if (!units) {
+        /* stamped with the oldest of the values */
+        for (i = 0; i < n; i++) {
+            if (!tab[i].datatype) {
+                continue;
+            }
+            if (chan_read(&tab[i], &values[i], &age_ms) == MB_Q_NONE) {
+                return SAPI_ERR_FAIL;
+            }
+            oldest = max(oldest, age_ms);
+        }
+        txt_append_u32(tb, epoch - oldest / 1000);
+        txt_append_char(tb, ',');
+    }
+    for (i = 0; i < n; i++) {
+        if (!tab[i].datatype) {
+            continue;
+        }
+        if (units) {
+            txt_append_str(tb, tab[i].unit);
+        } else {
+            txt_append_fixed(tb, values[i], 2);
+        }
+        txt_append_char(tb, ',');
+    }
+    return tb->err ? SAPI_ERR_NO_MEM : SAPI_ERR_OK;
+}
@@ -33,6 +33,8 @@ Networks, Inc.
 #include "exp_coap.h"
 #include "arduino_pins.h"
 #include "coap_rbt_msg.h"
+#include "coapsensorobs.h"
+#include "crash.h"
 
 
 static const uint8_t rbtput[] = {
@@ -43,13 +45,9 @@ static const uint8_t rbtput[] = {
 };
 
 
-// Buffers pointed to are sent to the mnic CoAP proxy by HDLC
-extern struct mbuf *pending_rsp;
-
 // CoAP Stats for this IC CoAP server
 extern struct coap_stats coap_stats;
 
-
 /**
  * Send a PUT system reboot event request to the mnic. This is called
  * when the IC reboots, and the intent is that the mnic may have some 
@@ -62,6 +60,7 @@ error_t coap_put_ic_reboot_event(void)
 {
 	struct mbuf *req;
 	uint8_t     *ptr;
+	int         len;
 
 	/* Allocate request buffer */
 	MGETHDR(req);
@@ -75,19 +74,24 @@ error_t coap_put_ic_reboot_event(void)
 	ptr = (uint8_t *)m_append(req, sizeof(rbtput));
 	memcpy(ptr, rbtput, sizeof(rbtput));
 
-	/* Send the request to the mnic */
-	/* If pending buffer free it - no memory leaks */
-	if (pending_rsp)
+	/* A fault that caused the reboot goes along, after the payload marker */
+	len = crash_payload(ptr + sizeof(rbtput) + 1, M_TRAILINGSPACE(req) - 1);
+	if (len > 0)
+	{
+		ptr = (uint8_t *)m_append(req, len + 1);
+		*ptr = 0xFF;
+	}
+
+	/* Send the request to the mnic, ahead of periodic notifications */
+	if (obs_q_add(req, OBS_Q_NO_OBSERVER, 1) != ERR_OK)
 	{
-		m_free(pending_rsp);
+		m_free(req);
+		return ERR_NO_MEM;
 	}
-	pending_rsp = req;
-	dlog(LOG_DEBUG, "Sending reset event to mnic");
+	DLOG_DEBUG("Sending reset event to mnic");
 
-	/* Notify mnic of request, wait for 1ms, then high again */
-	digitalWrite(MNIC_WAKEUP_PIN, LOW);
-	delay(1);
-	digitalWrite(MNIC_WAKEUP_PIN, HIGH);
+	/* Notify mnic of request, at once */
+	obs_q_wake(1);
 
 	return ERR_OK;
 }
\ No newline at end of file
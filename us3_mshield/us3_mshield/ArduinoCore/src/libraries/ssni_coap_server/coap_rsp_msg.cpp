@@ -53,8 +53,13 @@ error_t rsp_msg( struct mbuf * m, uint8_t *len, uint32_t count, float * reading,
 		// Get each value
 		for( ix = 0; ix < count; ix++ )
 		{
-			// Create string containing reading
-			sprintf( reading_buf, ",%.2f", *reading++ );
+			// Create string containing reading, without printf's float code
+			reading_buf[0] = ',';
+			if (ftoa_fixed( *reading, reading_buf + 1, 2 ) < 0)
+			{
+				sprintf( reading_buf, ",%.2f", *reading );
+			}
+			reading++;
 
 			// Concatenate the reading
 			strcat( rsp_buf, reading_buf );
@@ -70,7 +75,7 @@ error_t rsp_msg( struct mbuf * m, uint8_t *len, uint32_t count, float * reading,
 	}
 
 	// Print message
-	dlog( LOG_INFO, rsp_buf );
+	DLOG_INFO("%s", rsp_buf );
 	
 	// Get length
 	l = strlen(rsp_buf);
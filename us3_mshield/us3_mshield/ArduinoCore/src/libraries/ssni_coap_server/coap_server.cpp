@@ -40,6 +40,9 @@ Networks, Inc.
 #include "coapobserve.h"
 #include "exp_coap.h"
 #include "coap_server.h"
+#include "hdlc.h"
+#include "reqlat.h"
+#include "perflvl.h"
 
 
 /* 
@@ -53,12 +56,12 @@ Networks, Inc.
 
 
 // CoAP Server initialization
-void coap_s_init(HardwareSerial *pSerial, uint32_t max_age, uint32_t uart_timeout_ms, uint32_t max_hdlc_payload_size, const char *uri_rsrc_name, ObsFuncPtr pObsFuncPtr)
+void coap_s_init(HardwareSerial *pSerial, const struct hdlc_link_cfg *link, uint32_t max_age, uint32_t uart_timeout_ms, uint32_t max_hdlc_payload_size, const char *uri_rsrc_name, ObsFuncPtr pObsFuncPtr)
 {
 	int res;
 	
-	// Initialize CoAP Server registry
-	coap_registry_init();
+	// Paint the free RAM, for the stack high-water mark in the memory stats
+	mem_paint();
 
 	// Set Max-Age: CoAP Server Response Option 14
 	coap_set_max_age(max_age);
@@ -66,22 +69,118 @@ void coap_s_init(HardwareSerial *pSerial, uint32_t max_age, uint32_t uart_timeou
 	// Set the URI used for obtaining token etc in CoAP Observe response msg
 	set_observer(uri_rsrc_name, pObsFuncPtr);
 
+	// The observe relations from before a reset, before any request
+	(void)obs_restore();
+
 	// Open the HDLC connection
-	res = hdlcs_open(pSerial, uart_timeout_ms, max_hdlc_payload_size);
+	res = hdlcs_open(pSerial, link, uart_timeout_ms, max_hdlc_payload_size);
 	if (res) 
 	{
-		dlog(LOG_ERR, "HDLC initialization failed!");
+		DLOG_ERR("HDLC initialization failed!");
 	}
 	
 	// That's all folks!
 } // coap_s_init()
 
 
+/*
+ * Responses to recent CON requests, by MID. A request the mNIC repeats
+ * because our ACK was late is answered again from here, without running the
+ * handler (and the sensor read) a second time. rsp NULL if nothing was sent.
+ */
+#define COAP_DEDUP_MAX      (4)
+
+struct coap_dedup_ent {
+    struct mbuf *rsp;
+    uint32_t ms;        /* millis() when answered */
+    uint16_t mid;
+    uint8_t used;
+};
+static struct coap_dedup_ent coap_dedup[COAP_DEDUP_MAX];
+
+
+// Forget answers older than EXCHANGE_LIFETIME, the MID can't repeat anymore
+static void coap_dedup_expire()
+{
+    uint8_t i;
+
+    for (i = 0; i < COAP_DEDUP_MAX; i++)
+    {
+        if (coap_dedup[i].used && 
+            (uint32_t)(millis() - coap_dedup[i].ms) >= COAP_EXCHANGE_LIFETIME_MS)
+        {
+            if (coap_dedup[i].rsp)
+            {
+                m_free(coap_dedup[i].rsp);
+            }
+            coap_dedup[i].rsp = NULL;
+            coap_dedup[i].used = 0;
+        }
+    }
+}
+
+
+static struct coap_dedup_ent *coap_dedup_find(uint16_t mid)
+{
+    uint8_t i;
+
+    for (i = 0; i < COAP_DEDUP_MAX; i++)
+    {
+        if (coap_dedup[i].used && coap_dedup[i].mid == mid)
+        {
+            return &coap_dedup[i];
+        }
+    }
+    return NULL;
+}
+
+
+// Remember the answer to mid, over the oldest entry when full
+static void coap_dedup_add(uint16_t mid, struct mbuf *rsp)
+{
+    struct coap_dedup_ent *e = &coap_dedup[0];
+    uint8_t i;
+
+    for (i = 0; i < COAP_DEDUP_MAX; i++)
+    {
+        if (!coap_dedup[i].used)
+        {
+            e = &coap_dedup[i];
+            break;
+        }
+        if ((int32_t)(coap_dedup[i].ms - e->ms) < 0)
+        {
+            e = &coap_dedup[i];
+        }
+    }
+    if (e->rsp)
+    {
+        m_free(e->rsp);
+    }
+    e->rsp = rsp ? m_ref(rsp) : NULL;
+    e->ms = millis();
+    e->mid = mid;
+    e->used = 1;
+}
+
+
 /*** limited to static data and time ***/
 
 #define xstr(s)   str(s)
 #define str(s)    #s
 
+/* A response buffer, room to write the CoAP header in front of the payload */
+static struct mbuf *coap_rsp_get()
+{
+    struct mbuf *r = m_get();
+
+    if (r)
+    {
+        m_reserve(r, COAP_RSP_HEADROOM);
+    }
+    return r;
+}
+
 /*
  * Primary CoAP process function.
  * Set up REQ and RSP contexts.
@@ -97,45 +196,62 @@ mbuf_ptr_t coap_s_proc( mbuf_ptr_t m )
     struct optlv *op;
     error_t rc;
     uint8_t code;
-    char *pstr;
-    
-    /* Allocate response buffer */
     struct mbuf *r = NULL;
-    r = m_get();
-    if (r == NULL)
-    {
-	    goto done;
-    }
 
-    /* Parse incoming message */
+    /*
+     * Parse incoming message. A zeroed option list is empty, rcc is set up
+     * by coap_init_rsp, and the response buffer is only taken once the
+     * message is one that is answered.
+     */
     memset(&cc, 0, sizeof(cc));
-    copt_init((sl_co*)&(cc.oh));
-    memset(&rcc, 0, sizeof(rcc));
-    copt_init((sl_co*)&(rcc.oh));
     rc = coap_msg_parse(&cc, m, &code);
+    REQLAT_MARK(REQLAT_PARSE);
 
     if (rc == ERR_OK)
 	{
-        if (cc.type == COAP_T_ACK_VAL)
+        REQLAT_PATH(&cc);
+        if (cc.kind == COAP_MSG_ACK)
 		{
             /*
              * TODO: Assuming it's not a piggy-backed ACK for now.
              */
             rc = coap_ack_rx(cc.mid, NULL);
-            dlog(LOG_INFO, "ACK for mid: 0x%x received, lookup returned %d", cc.mid, rc);
+            DLOG_INFO("ACK for mid: 0x%x received, lookup returned %d", cc.mid, rc);
             rc = ERR_NORSP;
             goto done;
         }
+        if (cc.kind == COAP_MSG_IGNORE)
+        {
+            DLOG_DEBUG("Type %d code 0x%x mid: 0x%x ignored", cc.type, cc.code, cc.mid);
+            rc = ERR_NORSP;
+            goto done;
+        }
+
+        /* A repeated CON, send the same answer again */
+        if (cc.type == COAP_T_CONF_VAL && cc.kind == COAP_MSG_REQUEST)
+        {
+            struct coap_dedup_ent *e = coap_dedup_find(cc.mid);
+
+            if (e)
+            {
+                DLOG_INFO("Duplicate mid: 0x%x, answered from cache", cc.mid);
+                r = e->rsp ? m_ref(e->rsp) : NULL;
+                goto done;
+            }
+        }
+
+        /* Allocate response buffer */
+        if ((r = coap_rsp_get()) == NULL)
+        {
+            goto done;
+        }
         coap_init_rsp(&cc, &rcc, r);
 
         /* Currently the proxy is catching all empty msgs anyway... */
-        if (cc.code == COAP_EMPTY_MESSAGE)
+        if (cc.kind == COAP_MSG_PING)
 		{
             rcc.plen = 0;
-            if (cc.type == COAP_T_CONF_VAL)
-			{
-                rcc.type = COAP_T_RESET_VAL;
-            }
+            rcc.type = COAP_T_RESET_VAL;
         }
 		else
 		{
@@ -156,19 +272,18 @@ mbuf_ptr_t coap_s_proc( mbuf_ptr_t m )
          * final will have been set if there was an error processing the URL or
          * the return code is not 2.*.
          */
-        pstr = coap_pathstr(&cc);
         if (!rcc.final && copt_get_next_opt_type((sl_co*)&(rcc.oh), COAP_OPTION_OBSERVE, NULL))
 		{
-            (void)disable_obs(pstr, &cc, &clt, 1);
-            if (enable_obs(pstr, &cc, &clt) != ERR_OK)
+            (void)disable_obs(&cc, &clt, 1);
+            if (enable_obs(&cc, &clt) != ERR_OK)
 			{
                 (void)copt_del_opt_type((sl_co*)&(rcc.oh), COAP_OPTION_OBSERVE);
                 rcc.final = 1;
-                dlog(LOG_ERR, "Failed to enabled observe for URI: %s", pstr);
+                DLOG_ERR("Failed to enabled observe for URI: %s", coap_pathstr(&cc));
             }
 			else
 			{
-                dlog(LOG_DEBUG, "Enabled observe for URI: %s", pstr);
+                DLOG_DEBUG("Enabled observe");
             }
         } else if ((op = copt_get_next_opt_type((sl_co*)&(cc.oh), COAP_OPTION_OBSERVE, NULL)) && 
 				   (co_uint32_n2h(op) == COAP_OBS_DEREG))
@@ -178,17 +293,20 @@ mbuf_ptr_t coap_s_proc( mbuf_ptr_t m )
              * DEREG request. No need to call client_done as coap_proc is a
              * synchronous call, so the caller can handle it.
              */
-            if (disable_obs(pstr, &cc, &clt, 0) == ERR_OK)
+            if (disable_obs(&cc, &clt, 0) == ERR_OK)
 			{
-                dlog(LOG_DEBUG, "Disabled observe for URI %s", pstr);
+                DLOG_DEBUG("Disabled observe");
             }
         }
+        REQLAT_MARK(REQLAT_HANDLER);
 
-        if (coap_msg_response(&rcc) != ERR_OK)
+        rc = coap_msg_response(&rcc);
+        REQLAT_MARK(REQLAT_RSP);
+        if (rc != ERR_OK)
 		{
 			if (r)
 			{
-				dlog(LOG_DEBUG, "Error msg rsp: freeing mbuf");
+				DLOG_DEBUG("Error msg rsp: freeing mbuf");
 				m_free(r);
 				r = NULL;
 			}
@@ -196,27 +314,27 @@ mbuf_ptr_t coap_s_proc( mbuf_ptr_t m )
         }
 
 		/* No response */
-        if(r->m_pktlen == 0)
+        if(m_pktlen(r) == 0)
 		{
-	        dlog(LOG_DEBUG, "No rsp: freeing mbuf");
+	        DLOG_DEBUG("No rsp: freeing mbuf");
             m_free(r);
             r = NULL;
         }
 
+        if (cc.type == COAP_T_CONF_VAL && cc.kind == COAP_MSG_REQUEST)
+        {
+            coap_dedup_add(cc.mid, r);
+        }
+
         /* hand back reply */
         /* START */    
     }
-	else if (rc == ERR_VER_NOT_SUPP)
+	else if (rc == ERR_VER_NOT_SUPP || code == COAP_RSP_101_SILENT_IGN)
 	{
         /*
          * Silently ignore.
          */
-         if (r)
-         {
-			dlog(LOG_DEBUG, "Parse error: freeing mbuf");
-			m_free(r);
-			r = NULL;
-         }
+        DLOG_DEBUG("Parse error %d: ignored", rc);
         rc = ERR_OK;
         goto done;
     }
@@ -226,7 +344,7 @@ mbuf_ptr_t coap_s_proc( mbuf_ptr_t m )
          * There was some sort of issue with the request, build a response
          * that indicates the issue.
          */
-        dlog(LOG_ERR, "Error: rc/h->len: %d/%d, cc.code: %d", rc, m->m_pktlen, cc.code);
+        DLOG_ERR("Error: rc/h->len: %d/%d, cc.code: %d", rc, m_pktlen(m), cc.code);
         
         /*
          * Leave token length and token as-is.
@@ -236,6 +354,10 @@ mbuf_ptr_t coap_s_proc( mbuf_ptr_t m )
          * Don't care about URI.
          * No observe.
          */
+        if ((r = coap_rsp_get()) == NULL)
+        {
+            goto done;
+        }
         coap_init_rsp(&cc, &rcc, r);
 		
         if (cc.type == COAP_T_CONF_VAL)
@@ -248,11 +370,13 @@ mbuf_ptr_t coap_s_proc( mbuf_ptr_t m )
         }
         rcc.code = code;
         
-        if (coap_msg_response(&rcc) != ERR_OK)
+        rc = coap_msg_response(&rcc);
+        REQLAT_MARK(REQLAT_RSP);
+        if (rc != ERR_OK)
 		{
 			if (r)
 			{
-				dlog(LOG_DEBUG, "Error msg rsp: freeing mbuf");
+				DLOG_DEBUG("Error msg rsp: freeing mbuf");
 				m_free(r);
 				r = NULL;
 			}
@@ -263,46 +387,90 @@ mbuf_ptr_t coap_s_proc( mbuf_ptr_t m )
 done:
     if (cc.msg)
 	{
-		dlog(LOG_DEBUG, "coap_s_proc: Free cc mbuf");
+		DLOG_DEBUG("coap_s_proc: Free cc mbuf");
         m_free(cc.msg);
         cc.msg = NULL;
     }
     copt_del_all((sl_co*)&(cc.oh));
     copt_del_all((sl_co*)&(rcc.oh));
+    /* the request's temporaries go with it */
+    scratch_reset();
     return r;
 	
 }
 
 
-// Run HDLCS and the CoAP Server 
-void coap_s_run()
+// Serve the requests HDLCS has reassembled, oldest first, if any
+static void coap_s_serve()
 {
 	struct mbuf *appd;
 	struct mbuf *arsp;
 	
-	/* Run the secondary-station HDLC state machine */
-	hdlcs_run();
+	coap_dedup_expire();
 	
-	/* Serve incoming request, if any */
-	appd = hdlcs_read();
-	if (appd) 
+	/* Serve incoming requests, in the order they came */
+	while ((appd = hdlcs_read()))
 	{
+		REQLAT_START(hdlcs_read_us());
+
+		// CRC, CBOR, flash reads and compression at full speed
+		perf_burst_begin();
+
 		/* Run the CoAP server */
 		arsp = coap_s_proc(appd);
 		if (arsp) 
 		{
-			// Direct send of CoAP response
-			hdlcs_write(arsp->data, arsp->len);
-			
-			// Free response mbuf
-			dlog(LOG_DEBUG, "coap_s_run: freeing arsp mbuf");
-			m_free(arsp);
+			// Direct send of CoAP response, HDLC frees the mbuf once it's out
+			hdlcs_write_mbuf(arsp);
 		}
+		else
+		{
+			// Nothing to say, answer the poll with RR
+			hdlcs_rr();
+		}
+		perf_burst_end();
+		REQLAT_MARK(REQLAT_SEND);
+		REQLAT_END();
+
 		// Free request mbuf
-		dlog(LOG_DEBUG, "coap_s_run: freeing appd mbuf");
+		DLOG_DEBUG("coap_s_run: freeing appd mbuf");
 		m_free(appd);
 		
 		int freeram = free_ram();
-		dlog(LOG_DEBUG, "coap_s_run: free Ram: %d", freeram);
+		DLOG_DEBUG("coap_s_run: free Ram: %d", freeram);
 	}
 } 
+
+
+// Run HDLCS and the CoAP Server 
+void coap_s_run()
+{
+	/* Run the secondary-station HDLC state machine */
+	hdlcs_run();
+	
+	coap_s_serve();
+	
+	/* Resend CONs that went unacked */
+	coap_con_poll();
+
+	/* Wake the mNIC for all that was queued meanwhile */
+	obs_q_wake_poll();
+}
+
+
+// Run HDLCS and the CoAP Server on whatever has arrived, without waiting.
+// The frames already deframed go in first, a window's worth of requests
+// is taken together and served oldest first.
+void coap_s_poll()
+{
+	for (uint8_t i = 0; i < HDLCS_RXQ_MAX && hdlcs_poll(); i++)
+		;
+	
+	coap_s_serve();
+	
+	/* Resend CONs that went unacked */
+	coap_con_poll();
+
+	/* Wake the mNIC for all that was queued meanwhile */
+	obs_q_wake_poll();
+}
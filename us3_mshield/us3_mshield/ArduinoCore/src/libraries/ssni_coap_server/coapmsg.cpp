@@ -34,6 +34,9 @@ Networks, Inc.
 #include "coapobserve.h"
 #include "coaputil.h"
 #include "arduino_time.h"
+#include "coapsensorobs.h"
+#include "exp_coap.h"
+#include "pace.h"
 
 /* 
  * intrct_cb_q initialization. FIFO of mid:cb mappings. For now that's all it
@@ -44,6 +47,12 @@ Networks, Inc.
 struct intrct_cb_t {
     uint16_t mid;       /* CoAP message ID */
     coap_ack_cb_info_t cbinfo;  /*app cb fn, and param. */
+    struct mbuf *m;     /* reference to retransmit, NULL when not retransmitting */
+    uint32_t due_ms;    /* millis() of the next retransmit */
+    uint32_t tmo_ms;    /* current ACK timeout, doubled each retransmit */
+    uint32_t sent_ms;   /* millis() it was queued, for the ACK round trip */
+    uint8_t nretx;      /* retransmits so far */
+    uint8_t qid;        /* obs_q id to requeue with */
 };
 
 #define MID_CB_Q_SZ     4
@@ -54,6 +63,16 @@ uint8_t intrct_cb_q_ind;   /* index to add next entry */
 /* Max-Age in seconds */
 uint32_t coap_max_age_in_seconds = 0;
 
+/* stop retransmitting entry e */
+static void
+coap_con_stop(struct intrct_cb_t *e)
+{
+    if (e->m) {
+        m_free(e->m);
+        e->m = NULL;
+    }
+}
+
 /*
  * Add entry to the queue at the next (oldest slot). Not thread safe, so
  * assuming synchronization via caller.
@@ -61,21 +80,80 @@ uint32_t coap_max_age_in_seconds = 0;
  * @param mid: Message ID of CON, and thus ACK.
  * @param cb: callback function to call when ACK arrives.
  * @param cbctx: callback context, param to cb.
+ * @param m: the CON, copied for retransmission; NULL to not retransmit.
+ * @param qid: obs_q id of m. A newer CON for the same id supersedes it.
  *
  * @return error_t.
  */
 error_t
-coap_con_add(uint16_t mid, coap_ack_cb_info_t *cbi)
+coap_con_add(uint16_t mid, coap_ack_cb_info_t *cbi, struct mbuf *m, 
+             uint8_t qid)
 {
-    dlog(LOG_DEBUG, "Adding callback for MID: 0x%x\n", mid);
-    intrct_cb_q[intrct_cb_q_ind].mid = mid;
-    intrct_cb_q[intrct_cb_q_ind].cbinfo = *cbi;
+    struct intrct_cb_t *e = &intrct_cb_q[intrct_cb_q_ind];
+    uint8_t i;
+
+    DLOG_DEBUG("Adding callback for MID: 0x%x\n", mid);
+    for (i = 0; qid != OBS_Q_NO_OBSERVER && i < MID_CB_Q_SZ; i++) {
+        if (intrct_cb_q[i].m && intrct_cb_q[i].qid == qid) {
+            coap_con_stop(&intrct_cb_q[i]);
+        }
+    }
+    coap_con_stop(e);
+    e->mid = mid;
+    e->cbinfo = *cbi;
+    e->qid = qid;
+    e->nretx = 0;
+    e->m = m ? m_ref(m) : NULL;
+    /* ACK_TIMEOUT up to ACK_TIMEOUT * ACK_RANDOM_FACTOR */
+    e->tmo_ms = COAP_ACK_TIMEOUT_MS + 
+        random(COAP_ACK_TIMEOUT_MS * (COAP_ACK_RANDOM_FACTOR_PCT - 100) / 100 + 1);
+    e->sent_ms = millis();
+    e->due_ms = e->sent_ms + e->tmo_ms;
     intrct_cb_q_ind = (intrct_cb_q_ind + 1) % MID_CB_Q_SZ;
 
     return ERR_OK;
 }
 
 
+/*
+ * Requeue CONs not ACKed within their timeout, doubling it each time, and
+ * give up after COAP_MAX_RETRANSMIT. A CON still queued for the mNIC, or
+ * superseded by a newer one there, just waits another timeout.
+ */
+void
+coap_con_poll(void)
+{
+    uint32_t now = millis();
+    struct intrct_cb_t *e;
+    struct mbuf *n;
+    uint8_t i;
+
+    for (i = 0; i < MID_CB_Q_SZ; i++) {
+        e = &intrct_cb_q[i];
+        if (!e->m || (int32_t)(now - e->due_ms) < 0) {
+            continue;
+        }
+        if (e->nretx >= COAP_MAX_RETRANSMIT) {
+            DLOG_INFO("No ACK for MID: 0x%x, giving up", e->mid);
+            coap_stats.nretries_exceeded++;
+            coap_con_stop(e);
+            continue;
+        }
+        if (e->qid == OBS_Q_NO_OBSERVER || !obs_q_has(e->qid)) {
+            DLOG_DEBUG("Retransmit MID: 0x%x, try %d", e->mid, e->nretx + 1);
+            n = m_ref(e->m);
+            if (obs_q_add(n, e->qid, 0) != ERR_OK) {
+                m_free(n);
+            }
+            PACE_RESEND();
+        }
+        e->nretx++;
+        e->tmo_ms <<= 1;
+        e->due_ms = now + e->tmo_ms;
+    }
+}
+
+
 /*
  * Find the entry matching mid in the queue, or return ERR_NO_ENTRY.
  * Not thread safe, requirements as above.
@@ -89,10 +167,20 @@ coap_ack_rx(uint16_t mid, struct mbuf *m)
 {
     uint8_t i;
 
-    dlog(LOG_DEBUG, "Looking up callback for MID: 0x%x\n", mid);
+    DLOG_DEBUG("Looking up callback for MID: 0x%x\n", mid);
     for (i = 0; i < MID_CB_Q_SZ; i++) {
-        if (intrct_cb_q[i].mid == mid) {
-            return (intrct_cb_q[i].cbinfo.cb(intrct_cb_q[i].cbinfo.cbctx, m));
+        if (intrct_cb_q[i].mid == mid && intrct_cb_q[i].cbinfo.cb) {
+            coap_ack_cb_info_t cbi = intrct_cb_q[i].cbinfo;
+
+            /* the round trip of one sent once, it can't be told which a resent one acks */
+            if (!intrct_cb_q[i].nretx) {
+                PACE_ACK(millis() - intrct_cb_q[i].sent_ms);
+            }
+
+            /* acked - no more retransmits, and a duplicate ACK is ignored */
+            coap_con_stop(&intrct_cb_q[i]);
+            intrct_cb_q[i].cbinfo.cb = NULL;
+            return (cbi.cb(cbi.cbctx, m));
         }
     }
 
@@ -121,83 +209,135 @@ coap_opt_strcmp(const struct optlv *opt, const char *str)
     }
 }
 
-/* construct Uri-Path string from options */ 
-/* expects a valid parsed context */
-char *
-coap_pathstr(const struct coap_msg_ctx *ctx)
+/* match the Uri-Path options, segment by segment, against a "/a/b" path */
+/* 0 on a match; nothing is copied out of the message */
+int
+coap_path_cmp(const struct coap_msg_ctx *ctx, const char *path)
+{
+    struct optlv *opt;
+    void *it = NULL;
+
+    while ((opt = copt_get_next_opt_type((const sl_co*)&(ctx->oh), COAP_OPTION_URI_PATH, &it)) != NULL)
+	{
+        if (*path++ != '/' || strnlen(path, opt->ol) != opt->ol || 
+            memcmp(path, opt->ov, opt->ol))
+		{
+            return 1;
+        }
+        path += opt->ol;
+    }
+
+    return *path != '\0';
+}
+
+/* construct Uri-Path string from options into buf, NUL terminated */
+/* returns the length, -1 if it doesn't fit; buf NULL only measures */
+int
+coap_path_copy(const struct coap_msg_ctx *ctx, char *buf, int size)
 {
     struct optlv *opt;
     int ul = 0;
     void *it = NULL;
-    /* 
-     * This function only called from netmgr thread at present, so naturally
-     * synchronous. No need for locking due to this static, yet.
-     */
-    static char uristr[MAX_URI_LEN];
 
-    uristr[0] = 0;
     /*
      * Iterate through all Uri-Path options.
      */
     while ((opt = copt_get_next_opt_type((const sl_co*)&(ctx->oh), COAP_OPTION_URI_PATH, &it)) != NULL)
 	{
-        if (ul + opt->ol + 1 > (int)sizeof(uristr))
+        if (ul + opt->ol + 1 >= size && buf)
 		{
             /* limit size - error */
-            return NULL;
+            return -1;
+        }
+
+        if (buf)
+		{
+            buf[ul] = '/';
+            memcpy(buf + ul + 1, opt->ov, opt->ol);
         }
+        ul += opt->ol + 1;
+    }
+    if (buf)
+	{
+        buf[ul] = 0;
+    }
+
+    return ul;
+}
+
+/* construct Uri-Path string from options */ 
+/* expects a valid parsed context */
+char *
+coap_pathstr(const struct coap_msg_ctx *ctx)
+{
+    /* 
+     * This function only called from netmgr thread at present, so naturally
+     * synchronous. No need for locking due to this static, yet.
+     */
+    static char uristr[MAX_URI_LEN];
 
-        uristr[ul++] = '/';
-        memcpy(uristr + ul, opt->ov, opt->ol);
-        uristr[ul + opt->ol] = 0;
-        ul += opt->ol;
+    if (coap_path_copy(ctx, uristr, sizeof(uristr)) < 0)
+	{
+        return NULL;
     }
 
     return uristr;
 }
 
 
-/* option tlv */
-   
+/*
+ * One option tlv at b, of the len bytes left. Returns its size, or -1 for
+ * the payload marker or an option that is malformed or runs past len.
+ */
 int
 coap_opt_parse(struct optlv *o, const uint8_t *b, int len)
 {
     uint16_t od, ol;
     int i = 1;
 
+    if (len < 1 || b[0] == 0xFF) {
+        goto err;
+    }
     od = b[0] >> 4;
     ol = b[0] & 0xf;
 
-    if (od < 13) {
-        i = 1;
-    }
-    else if (od == 13) {
-        od += b[1];
-        i = 2;
+    if (od == 13) {
+        if (len < i + 1) {
+            goto err;
+        }
+        od = b[i] + 13;
+        i++;
     }
     else if (od == 14) {
-        od = (b[1] << 8) + b[2] + 269;
-        i = 3;
+        if (len < i + 2) {
+            goto err;
+        }
+        od = (b[i] << 8) + b[i+1] + 269;
+        i += 2;
     }
-    else {
+    else if (od == 15) {
         goto err;
     }
 
-    if (ol < 13) {
-        ;   /* nop */
-    }
-    else if (ol == 13) {
-        ol += b[i];
+    if (ol == 13) {
+        if (len < i + 1) {
+            goto err;
+        }
+        ol = b[i] + 13;
         i++;
     }
-    else if (od == 14) {
+    else if (ol == 14) {
+        if (len < i + 2) {
+            goto err;
+        }
         ol = (b[i] << 8) + b[i+1] + 269;
+        i += 2;
     }
-    else {
+    else if (ol == 15) {
         goto err;
     }
     
-    if (len < i || len < i + ol) {
+    if (len < i + ol) {
         goto err;
     }
 
@@ -252,7 +392,7 @@ coap_opt_add(const struct optlv *o, uint8_t *b, int len)
     ohl = op - oh;
 
     if (ohl + o->ol > len) {
-        dlog(LOG_ERR, "Insufficient buffer space to add option\n");
+        DLOG_ERR("Insufficient buffer space to add option\n");
         return 0;
     }
 
@@ -350,20 +490,26 @@ coap_msg_log(const struct coap_msg_ctx *ctx)
     struct optlv *op;
     char uriqp[MAX_URI_LEN];
 
+    /* don't build the strings if they won't be printed */
+    if (!dlog_on(LOG_DEBUG))
+	{
+        return;
+    }
+
     uriqp[0] = '\0';
-    dlog(LOG_DEBUG, "REQ/RSP Type: %s", 
+    DLOG_DEBUG("REQ/RSP Type: %s", 
             ctx->type == COAP_T_CONF_VAL ? "CON" : 
             ctx->type == COAP_T_NCONF_VAL ? "NON" :
             ctx->type == COAP_T_ACK_VAL ? "ACK" : "RST");
     if ((ctx->code & COAP_CODE_C_MASK) == COAP_CODE_REQUEST) {
-        dlog(LOG_DEBUG, "REQ/ACK Code: %s",
+        DLOG_DEBUG("REQ/ACK Code: %s",
                 (ctx->code & COAP_CODE_DD_MASK) == COAP_CODE_GET ? "GET" :
                 (ctx->code & COAP_CODE_DD_MASK) == COAP_CODE_POST ? "POST" :
                 (ctx->code & COAP_CODE_DD_MASK) == COAP_CODE_PUT ? "PUT" : 
                 (ctx->code & COAP_CODE_DD_MASK) == COAP_CODE_DELETE ? 
                 "DELETE" : "EMPTY");
     } else {
-        dlog(LOG_DEBUG, "RSP Code: %s",
+        DLOG_DEBUG("RSP Code: %s",
                 (ctx->code & COAP_CODE_C_MASK) == COAP_CODE_SUCCESS ? 
                     "Success" :
                 (ctx->code & COAP_CODE_C_MASK) == COAP_CODE_CLIENT_ERR ? 
@@ -379,7 +525,7 @@ coap_msg_log(const struct coap_msg_ctx *ctx)
         strncat(uriqp, (char *)op->ov, op->ol);
     }
     if (uriqp[0] != '\0') {
-        dlog(LOG_INFO, "Uri-Path-Query: %s", uriqp);
+        DLOG_INFO("Uri-Path-Query: %s", uriqp);
     }
 }
 
@@ -397,12 +543,16 @@ coap_msg_log(const struct coap_msg_ctx *ctx)
 static error_t
 coap_hdr_parse(struct coap_msg_ctx *ctx, struct mbuf *m)
 {
-    uint8_t *b = m->m_data;
+    uint8_t *b = mtod(m, uint8_t *);
     error_t rc;
 
     ctx->msg = m;   /* save mbuf in context - free later */
 
     /* parse header */
+    if (m->len < 4) {
+        rc = ERR_BAD_DATA;
+        goto err;
+    }
     if ((b[0] & 0xC0) != 0x40) {  /* confirm version 1 */
         rc = ERR_VER_NOT_SUPP;
         goto err;
@@ -415,12 +565,12 @@ coap_hdr_parse(struct coap_msg_ctx *ctx, struct mbuf *m)
     ctx->mid  = (b[2] << 8) + b[3];
     ctx->plen = 0;  /* Initialise */
 
-    rc = ERR_OK;     /* TBD */
-
-    /* sanity checks 
-        token length <= 8
-        message length > header + token
-    */
+    /* a token longer than 8 or than the message is a format error */
+    if (ctx->tkl > 8 || 4 + ctx->tkl > m->len) {
+        rc = ERR_BAD_DATA;
+        goto err;
+    }
+    rc = ERR_OK;
 
     memcpy(ctx->token, b + 4, ctx->tkl);
 
@@ -430,21 +580,26 @@ err:
 
 
 /*
- * Parse data into the CoAP message context ctx.
+ * Parse data into the CoAP message context ctx, in one pass over the mbuf.
  * We DON'T modify ctx for some anticipated response, we leave that to the
  * caller. ctx reflects the state of the incoming message.
  *
+ * The header classifies the message first, ctx->kind. Only a request goes
+ * on to its options, each checked as it is taken, so a message that is
+ * not answered, or one that is in error, costs the caller nothing more.
+ *
  * @param ctx: Output, loaded with context info goodness from the packet in
  * data.
  * @param m: The mbuf with the PDU.
- * @param code: CoAP return code.
+ * @param code: CoAP return code, COAP_RSP_101_SILENT_IGN for a message
+ * to drop without an answer.
  * @return: 0 on success, nonzero error/special handling code. 
  */
 error_t coap_msg_parse(struct coap_msg_ctx *ctx, struct mbuf *m, uint8_t *code)
 {
     int i, osize, mdatalen;
-    uint8_t *b = m->m_data; /* assuming single buffer */
-    int len = m->m_pktlen;
+    uint8_t *b = mtod(m, uint8_t *); /* assuming single buffer */
+    int len = m->len;
     struct optlv opt;
     uint16_t ot;
     error_t rc;
@@ -453,9 +608,11 @@ error_t coap_msg_parse(struct coap_msg_ctx *ctx, struct mbuf *m, uint8_t *code)
     /* Default code, indicating everything okay, so far. */
     *code = COAP_RSP_205_CONTENT;
 
-    ddump(LOG_DEBUG, "CoAP REQ decode", b, len);
+    DDUMP_DEBUG("CoAP REQ decode", b, len);
     
     if ((rc = coap_hdr_parse(ctx, m)) != ERR_OK) {
+        /* a format error in the header, nothing to answer it with */
+        *code = COAP_RSP_101_SILENT_IGN;
         goto err;
     }
 
@@ -464,10 +621,20 @@ error_t coap_msg_parse(struct coap_msg_ctx *ctx, struct mbuf *m, uint8_t *code)
     ctx->final = 1; /* default value, not ongoing observe */
     ctx->oidx = i;  /* where options will start, or maybe payload marker */
 
+    /* the header tells all but a request, ignore everything else */
+    if (ctx->type == COAP_T_ACK_VAL) {
+        ctx->kind = COAP_MSG_ACK;
+        return ERR_OK;
+    }
+    if (ctx->type == COAP_T_RESET_VAL || COAP_CLASS(ctx->code) != 0) {
+        ctx->kind = COAP_MSG_IGNORE;
+        return ERR_OK;
+    }
     if (ctx->code == COAP_EMPTY_MESSAGE) {
-        /* ignore everything else */
+        ctx->kind = ctx->type == COAP_T_CONF_VAL ? COAP_MSG_PING : COAP_MSG_IGNORE;
         return ERR_OK;
     }
+    ctx->kind = COAP_MSG_REQUEST;
 
     // Make sure the packet length is not greater than what is allocated by m_get()
 	mdatalen = get_mbuf_data_size()-16;
@@ -496,11 +663,18 @@ error_t coap_msg_parse(struct coap_msg_ctx *ctx, struct mbuf *m, uint8_t *code)
      * ZK - this should be an option (build option?)
      */
     ot = 0;
-    while ((osize = coap_opt_parse(&opt, b + i, len - i)) > 0) {
+    while (i < len && b[i] != 0xFF) {
+        if ((osize = coap_opt_parse(&opt, b + i, len - i)) <= 0 ||
+            (uint32_t)ot + opt.ot > 0xffff) {
+            DLOG_ERR("malformed option after %u", ot);
+            rc = ERR_BAD_DATA;
+            *code = COAP_RSP_400_BAD_REQUEST;
+            goto err;
+        }
         /* Add, because it's an option delta. */
         ot += opt.ot;
-        dlog(LOG_DEBUG, "option type: %u len: %u", ot, opt.ol);
-        ddump(LOG_DEBUG, "option", opt.ov, opt.ol);
+        DLOG_DEBUG("option type: %u len: %u", ot, opt.ol);
+        DDUMP_DEBUG("option", opt.ov, opt.ol);
 
         /*
          * Add each option to the message context structure to ease
@@ -510,7 +684,7 @@ error_t coap_msg_parse(struct coap_msg_ctx *ctx, struct mbuf *m, uint8_t *code)
          */
         opt.ot = ot;
         if ((rc = copt_add_opt((sl_co*)&(ctx->oh), &opt)) != ERR_OK) {
-            dlog(LOG_ALERT, "Couldn't save option data");
+            DLOG_ALERT("Couldn't save option data");
             *code = COAP_RSP_500_INTERNAL_ERROR;
             goto err;
         }
@@ -528,7 +702,8 @@ error_t coap_msg_parse(struct coap_msg_ctx *ctx, struct mbuf *m, uint8_t *code)
              */
             break;
         case COAP_OPTION_BLOCK2:            /* Block2    */
-                /*FIXME willfully ignoring this option   */
+        case COAP_OPTION_BLOCK1:            /* Block1    */
+            /* Handled by the resource, see coap_block_get() */
 			break;
         case COAP_OPTION_URI_PATH:          /* Uri-Path  */
         case COAP_OPTION_URI_QUERY:         /* Uri-Query */
@@ -559,7 +734,7 @@ error_t coap_msg_parse(struct coap_msg_ctx *ctx, struct mbuf *m, uint8_t *code)
             /* unhandled critical option */
             if (COAP_OPTION_CRITICAL(ot)) {
                 /* this is an error */
-                dlog(LOG_ERR, "unhandled critical option %d\n", ot);
+                DLOG_ERR("unhandled critical option %d\n", ot);
                 rc = ERR_OP_NOT_SUPP;
                 *code = COAP_RSP_402_BAD_OPTION;
                 goto err;
@@ -569,21 +744,21 @@ error_t coap_msg_parse(struct coap_msg_ctx *ctx, struct mbuf *m, uint8_t *code)
         }
     }
 
-    if (ot && i != len) {
-        /* must be separating FF next */
-        if (b[i] != 0xFF) {
-            dlog(LOG_ERR, "missing option separator FF");
+    if (i != len) {
+        /* the separating FF, a payload must follow it */
+        i++;
+        if (i == len) {
+            DLOG_ERR("payload marker FF with no payload");
             rc = ERR_BAD_DATA;
-            *code = COAP_RSP_415_UNSUPPORTED_CFORMAT;
+            *code = COAP_RSP_400_BAD_REQUEST;
             goto err;
         }
-        i++;
     }
 
     /* after options - set the payload pointer */
     ctx->hdrlen = i;
     ctx->plen = len - i;
-    m->m_pktlen = len;
+    m->len = len;
 
     coap_msg_log(ctx);
 err:
@@ -605,13 +780,13 @@ error_t
 coap_rsp_parse(struct coap_msg_ctx *ctx, struct mbuf *m)
 {
     int i, osize;
-    uint8_t *b = m->m_data; /* assuming single buffer */
-    int len = m->m_pktlen;
+    uint8_t *b = mtod(m, uint8_t *); /* assuming single buffer */
+    int len = m->len;
     struct optlv opt;
     uint16_t ot;
     error_t rc;
 
-    ddump(LOG_DEBUG, "CoAP RSP decode", b, len);
+    DDUMP_DEBUG("CoAP RSP decode", b, len);
     
     if ((rc = coap_hdr_parse(ctx, m)) != ERR_OK) {
         goto err;
@@ -629,8 +804,8 @@ coap_rsp_parse(struct coap_msg_ctx *ctx, struct mbuf *m)
     while ((osize = coap_opt_parse(&opt, b + i, len - i)) > 0) {
         /* Add, because it's an option delta. */
         ot += opt.ot;
-        dlog(LOG_DEBUG, "option type: %u len: %u", ot, opt.ol);
-        ddump(LOG_DEBUG, "option", opt.ov, opt.ol);
+        DLOG_DEBUG("option type: %u len: %u", ot, opt.ol);
+        DDUMP_DEBUG("option", opt.ov, opt.ol);
         
         /*
          * Add each option to the message context structure to ease
@@ -640,7 +815,7 @@ coap_rsp_parse(struct coap_msg_ctx *ctx, struct mbuf *m)
          */
         opt.ot = ot;
         if ((rc = copt_add_opt((sl_co*)&(ctx->oh), &opt)) != ERR_OK) {
-            dlog(LOG_ALERT, "Couldn't save option data");
+            DLOG_ALERT("Couldn't save option data");
             goto err;
         }
         
@@ -663,7 +838,7 @@ coap_rsp_parse(struct coap_msg_ctx *ctx, struct mbuf *m)
     if (ot && i != len) {
         /* must be separating FF next */
         if (b[i] != 0xFF) {
-            dlog(LOG_ERR, "missing option separator FF");
+            DLOG_ERR("missing option separator FF");
             rc = ERR_BAD_DATA;
             goto err;
         }
@@ -679,6 +854,164 @@ err:
     return rc;
 }
 
+/*
+ * Get the Block1 or Block2 option of ctx, ot COAP_OPTION_BLOCK1/2.
+ *
+ * @return: 0 if absent, 1 if blk is loaded, -1 if the option is malformed.
+ */
+int
+coap_block_get(const struct coap_msg_ctx *ctx, uint16_t ot, 
+               struct coap_block *blk)
+{
+    struct optlv *op;
+    const uint8_t *d;
+    uint32_t v = 0;
+    int i;
+
+    if ((op = copt_get_next_opt_type((const sl_co*)&(ctx->oh), ot, NULL)) == NULL) {
+        return 0;
+    }
+    if (op->ol > 3) {
+        return -1;
+    }
+    /* bytewise, the value may not be aligned in the mbuf */
+    d = (const uint8_t *)op->ov;
+    for (i = 0; i < op->ol; i++) {
+        v = (v << 8) | d[i];
+    }
+    if ((v & 0x7) > COAP_BLOCK_SZX_MAX) {
+        return -1;
+    }
+    blk->num = v >> 4;
+    blk->m = (v >> 3) & 1;
+    blk->szx = v & 0x7;
+    return 1;
+}
+
+/*
+ * Set the Block1 or Block2 option of the response rsp. The value is kept in
+ * rsp->blkv and added to the PDU by coap_msg_response().
+ */
+error_t
+coap_block_set(struct coap_msg_ctx *rsp, uint16_t ot, 
+               const struct coap_block *blk)
+{
+    struct optlv opt;
+    uint8_t *d = rsp->blkv[ot == COAP_OPTION_BLOCK1];
+    uint32_t v = (blk->num << 4) | (blk->m ? 0x8 : 0) | blk->szx;
+    int i;
+
+    if (blk->num >= (1UL << 20)) {
+        return ERR_INVAL;
+    }
+    opt.ot = ot;
+    opt.ol = v > 0xFFFF ? 3 : v > 0xFF ? 2 : v ? 1 : 0;
+    opt.ov = d;
+    for (i = opt.ol; i > 0; i--) {
+        d[i - 1] = v & 0xFF;
+        v >>= 8;
+    }
+
+    (void)copt_del_opt_type((sl_co*)&(rsp->oh), ot);
+    return copt_add_opt((sl_co*)&(rsp->oh), &opt);
+}
+
+/* split the next Uri-Query option at the first '=', nothing is copied */
+/* returns 1 with q filled in, 0 when there are no more */
+int
+coap_query_next(const struct coap_msg_ctx *ctx, void **it, struct coap_query *q)
+{
+    struct optlv *opt;
+    const char *eq;
+
+    opt = copt_get_next_opt_type((const sl_co*)&(ctx->oh), COAP_OPTION_URI_QUERY, it);
+    if (!opt) {
+        return 0;
+    }
+    q->key = (const char *)opt->ov;
+    eq = (const char *)memchr(q->key, '=', opt->ol);
+    if (eq) {
+        q->klen = eq - q->key;
+        q->val = eq + 1;
+        q->vlen = opt->ol - q->klen - 1;
+    } else {
+        q->klen = opt->ol;
+        q->val = NULL;
+        q->vlen = 0;
+    }
+    return 1;
+}
+
+/* 0 if the query key is key */
+int
+coap_query_key(const struct coap_query *q, const char *key)
+{
+    return strlen(key) != q->klen || memcmp(q->key, key, q->klen);
+}
+
+/* 0 if the query has value val */
+int
+coap_query_val(const struct coap_query *q, const char *val)
+{
+    return !q->val || strlen(val) != q->vlen || memcmp(q->val, val, q->vlen);
+}
+
+/* decimal query value, 0 on success, -1 if empty, not a number or > 2^32-1 */
+int
+coap_query_uint(const struct coap_query *q, uint32_t *v)
+{
+    uint32_t d;
+    uint8_t i;
+
+    if (!q->val || !q->vlen) {
+        return -1;
+    }
+    *v = 0;
+    for (i = 0; i < q->vlen; i++) {
+        d = q->val[i] - '0';
+        if (d > 9 || *v > (UINT32_MAX - d) / 10) {
+            return -1;
+        }
+        *v = *v * 10 + d;
+    }
+    return 0;
+}
+
+/* hex query value of exactly len bytes into buf, 0 on success, -1 if not */
+int
+coap_query_hex(const struct coap_query *q, uint8_t *buf, uint8_t len)
+{
+    uint8_t d;
+    uint8_t i;
+    char c;
+
+    if (!q->val || q->vlen != 2 * len) {
+        return -1;
+    }
+    for (i = 0; i < q->vlen; i++) {
+        c = q->val[i];
+        if (c >= '0' && c <= '9') {
+            d = c - '0';
+        } else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f') {
+            d = (c | 0x20) - 'a' + 10;
+        } else {
+            return -1;
+        }
+        buf[i / 2] = (i & 1) ? (buf[i / 2] << 4) | d : d;
+    }
+    return 0;
+}
+
+/* Largest block size exponent up to szx whose block fits a response mbuf */
+uint8_t
+coap_block_szx(uint8_t szx)
+{
+    while (szx && COAP_BLOCK_SIZE(szx) + COAP_RSP_HEADROOM > get_mbuf_data_size()) {
+        szx--;
+    }
+    return szx;
+}
+
 /* initialize response message context based on request + mbuf */
 void       
 coap_init_rsp(const struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, 
@@ -721,7 +1054,7 @@ coap_init_rsp(const struct coap_msg_ctx *req, struct coap_msg_ctx *rsp,
             nop.ot = COAP_OPTION_OBSERVE;
             nop.ol = 3;
             if (copt_add_opt((sl_co*)&(rsp->oh), &nop) != ERR_OK) {
-                dlog(LOG_ERR, "Couldn't add observe option");
+                DLOG_ERR("Couldn't add observe option");
             }
         }
     }
@@ -745,7 +1078,7 @@ coap_opt_rpl(struct coap_msg_ctx *ctx)
     int sz;
     void *it = NULL;
     struct mbuf *m = ctx->msg;
-    uint8_t *b = m->m_data;
+    uint8_t *b = mtod(m, uint8_t *);
     int len;
     int osize;
     int i;
@@ -753,15 +1086,15 @@ coap_opt_rpl(struct coap_msg_ctx *ctx)
     struct optlv dopt;    /* op with type delta */
 
     i = ctx->oidx;
-    dlog(LOG_DEBUG, "oidx: %d, hdrlen: %d, m_pktlen: %d", ctx->oidx, 
-            ctx->hdrlen, m->m_pktlen);
+    DLOG_DEBUG("oidx: %d, hdrlen: %d, m_pktlen: %d", ctx->oidx, 
+            ctx->hdrlen, m->len);
     while ((opt = copt_get_next_opt((const sl_co*)&(ctx->oh), &it)) != NULL) {
         /* Deltas go into the PDU. */
         dopt = *opt;
         dopt.ot -= ot;
         ot = opt->ot;
         if ((sz = coap_opt_add(&dopt, &(b[i]), ctx->hdrlen - i)) == 0) {
-            dlog(LOG_ERR, "Couldn't add %d option to msg", ot);
+            DLOG_ERR("Couldn't add %d option to msg", ot);
             goto err;
         }
         i += sz;
@@ -776,18 +1109,18 @@ coap_opt_rpl(struct coap_msg_ctx *ctx)
         memmove(&(b[i]), &(b[ctx->hdrlen]), ctx->plen);
         /* m_copyinto? */
 //#ifdef TOOLS_COAP
-        m->m_pktlen -= (ctx->hdrlen - i);
+        m->len -= (ctx->hdrlen - i);
 //#else
         // FIXME - add this to hbuf m_adj(m, i - ctx->hdrlen);
 //#endif
         ctx->hdrlen = i;
-        dlog(LOG_DEBUG, "hdrlen: %d, m_pktlen: %d", ctx->hdrlen, 
-                m->m_pktlen);
+        DLOG_DEBUG("hdrlen: %d, m_pktlen: %d", ctx->hdrlen, 
+                m->len);
 
         /* Rebuilt option list so ov is correct. */
         ot = 0;
         i = 4 + ctx->tkl;
-        len = m->m_pktlen;
+        len = m->len;
         copt_del_all((sl_co*)&(ctx->oh));
         while ((osize = coap_opt_parse(&dopt, b + i, len - i)) > 0) {
             /* Add, because it's an option delta. */
@@ -796,16 +1129,16 @@ coap_opt_rpl(struct coap_msg_ctx *ctx)
             /* Make opt->ot absolute. Deltas aren't used outside the PDU. */
             dopt.ot = ot;
             if (copt_add_opt((sl_co*)&(ctx->oh), &dopt) != ERR_OK) {
-                dlog(LOG_ALERT, "Couldn't save option data");
+                DLOG_ALERT("Couldn't save option data");
                 goto err;
             }
             i += osize;
         }
     } else if (i == ctx->hdrlen) {
-        dlog(LOG_WARNING, "%s No adjustment necessary when one expected", 
+        DLOG_WARNING("%s No adjustment necessary when one expected", 
                 __FUNCTION__);
     } else {
-        dlog(LOG_ERR, "%s replaced options don't fit", __FUNCTION__);
+        DLOG_ERR("%s replaced options don't fit", __FUNCTION__);
         goto err;
     }
 
@@ -833,7 +1166,7 @@ coap_msg_response(struct coap_msg_ctx *ctx)
      * 4 + 8 (max token) + 2 (option and option length, + option) + 1 (option
      * terminator) + 4 observe option. Can be added to later, as required.
      */
-    uint8_t b[COAP_OBS_HDR_SZ];  /* as above, +1 */
+    uint8_t b[COAP_RSP_HDR_SZ];  /* as above, + block options */
     error_t rc = ERR_OK;
 
     int idx = 4;
@@ -875,6 +1208,23 @@ coap_msg_response(struct coap_msg_ctx *ctx)
             idx += ctx->tkl;
         }
 
+        /*
+         * ETag (Option 4), if the resource set one. The value is owned by the
+         * resource and must outlive the response.
+         */
+        if ((op = copt_get_next_opt_type((const sl_co*)&(ctx->oh), COAP_OPTION_ETAG, NULL))
+               != NULL) {
+            dopt = *op;
+            dopt.ot = COAP_OPTION_ETAG - onum;
+            onum = COAP_OPTION_ETAG;
+            if ((sz = coap_opt_add(&dopt, &(b[idx]), COAP_RSP_HDR_SZ - idx)) == 0) {
+                DLOG_ERR("Couldn't add ETag option to msg");
+                rc = ERR_NO_MEM;
+                goto done;
+            }
+            idx += sz;
+        }
+
         /*
          * Add the observe option if it's present in the context structure.
          * op doesn't contain a value yet, we add that now, so it's really just
@@ -888,8 +1238,8 @@ coap_msg_response(struct coap_msg_ctx *ctx)
             opt_val = co_uint32_h2n(&dopt);
             dopt.ot = COAP_OPTION_OBSERVE - onum;
             onum = COAP_OPTION_OBSERVE;
-            if ((sz = coap_opt_add(&dopt, &(b[idx]), COAP_OBS_HDR_SZ - idx)) == 0) {
-                dlog(LOG_ERR, "Couldn't add Observe option to msg");
+            if ((sz = coap_opt_add(&dopt, &(b[idx]), COAP_RSP_HDR_SZ - idx)) == 0) {
+                DLOG_ERR("Couldn't add Observe option to msg");
                 rc = ERR_NO_MEM;
                 goto done;
             }
@@ -908,8 +1258,8 @@ coap_msg_response(struct coap_msg_ctx *ctx)
                 dopt.ol = 0;
                 dopt.ov = &opt_val;
                 opt_val = 0;  /* 0 length anyway */
-                if ((sz = coap_opt_add(&dopt, &(b[idx]), COAP_OBS_HDR_SZ - idx)) == 0) {
-                    dlog(LOG_ERR, "Couldn't add content format option to msg");
+                if ((sz = coap_opt_add(&dopt, &(b[idx]), COAP_RSP_HDR_SZ - idx)) == 0) {
+                    DLOG_ERR("Couldn't add content format option to msg");
                     rc = ERR_NO_MEM;
                     goto done;
                 }
@@ -918,8 +1268,8 @@ coap_msg_response(struct coap_msg_ctx *ctx)
             } else {
                 dopt.ol = 1;
                 dopt.ov = &(ctx->cf);
-                if ((sz = coap_opt_add(&dopt, &(b[idx]), COAP_OBS_HDR_SZ - idx)) == 0) {
-                    dlog(LOG_ERR, "Couldn't add content format option to msg");
+                if ((sz = coap_opt_add(&dopt, &(b[idx]), COAP_RSP_HDR_SZ - idx)) == 0) {
+                    DLOG_ERR("Couldn't add content format option to msg");
                     rc = ERR_NO_MEM;
                     goto done;
                 }
@@ -942,8 +1292,8 @@ coap_msg_response(struct coap_msg_ctx *ctx)
 				opt_val = co_uint32_h2n(&dopt);
                 dopt.ot = COAP_OPTION_MAXAGE - onum;
                 onum = COAP_OPTION_MAXAGE;
-                if ((sz = coap_opt_add(&dopt, &(b[idx]), COAP_OBS_HDR_SZ - idx)) <= 0) {
-                    dlog(LOG_ERR, "Couldn't add Max-Age option to msg");
+                if ((sz = coap_opt_add(&dopt, &(b[idx]), COAP_RSP_HDR_SZ - idx)) <= 0) {
+                    DLOG_ERR("Couldn't add Max-Age option to msg");
                     rc = ERR_NO_MEM;
                     goto done;
                 }
@@ -952,23 +1302,52 @@ coap_msg_response(struct coap_msg_ctx *ctx)
 
         } // plen
 
+        /*
+         * Block2 and Block1 (Options 23 and 27), already encoded by
+         * coap_block_set(). A 2.31 Continue carries Block1 with no payload.
+         */
+        if ((op = copt_get_next_opt_type((const sl_co*)&(ctx->oh), COAP_OPTION_BLOCK2, 
+                        NULL)) != NULL) {
+            dopt = *op;
+            dopt.ot = COAP_OPTION_BLOCK2 - onum;
+            onum = COAP_OPTION_BLOCK2;
+            if ((sz = coap_opt_add(&dopt, &(b[idx]), COAP_RSP_HDR_SZ - idx)) == 0) {
+                DLOG_ERR("Couldn't add Block2 option to msg");
+                rc = ERR_NO_MEM;
+                goto done;
+            }
+            idx += sz;
+        }
+        if ((op = copt_get_next_opt_type((const sl_co*)&(ctx->oh), COAP_OPTION_BLOCK1, 
+                        NULL)) != NULL) {
+            dopt = *op;
+            dopt.ot = COAP_OPTION_BLOCK1 - onum;
+            onum = COAP_OPTION_BLOCK1;
+            if ((sz = coap_opt_add(&dopt, &(b[idx]), COAP_RSP_HDR_SZ - idx)) == 0) {
+                DLOG_ERR("Couldn't add Block1 option to msg");
+                rc = ERR_NO_MEM;
+                goto done;
+            }
+            idx += sz;
+        }
+
 		/* End of options */	   
         if (onum && ctx->plen) {
             b[idx++] = 0xFF;    /* end of options */
         }
     }
-    assert(idx <= COAP_OBS_HDR_SZ);
+    assert(idx <= COAP_RSP_HDR_SZ);
 
-    /* prepend header to response */
+    /* prepend header to response, into the headroom if reserved */
     n = m_prepend(ctx->msg, idx);
     if (!n) {
         rc = ERR_NO_MEM;
         goto done;
     }
     ctx->msg = n;   /* A new mbuf may be required */
-    memcpy(n->m_data, b, idx);
+    memcpy(mtod(n, uint8_t *), b, idx);
 
-    ddump(LOG_DEBUG, "Response", n->m_data, n->m_pktlen);
+    DDUMP_DEBUG("Response", mtod(n, uint8_t *), n->len);
 
 done:
     return rc;
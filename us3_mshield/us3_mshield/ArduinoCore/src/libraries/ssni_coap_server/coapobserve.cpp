@@ -34,6 +34,8 @@ Networks, Inc.
 #include "coaputil.h"
 #include "coapsensoruri.h"
 #include "coapobserve.h"
+#include "coapmsg.h"
+#include "retain.h"
 
 /*
  * The main issue is with the client field, since that represents something
@@ -64,9 +66,112 @@ struct obs_t {
  */
 static struct obs_t obs[MAX_OBSERVERS] = { };
 
+/*
+ * Indexes over obs[], so that notifications and token lookups don't scan it.
+ * obs_id_slot maps an observer id (coapsensorobs) to its slot + 1, bound on
+ * the first lookup by URI. obs_tok_idx is an open addressed table of slot + 1
+ * by token hash. 0 is empty in both. Rebuilt when an entry comes or goes.
+ */
+#define OBS_TOK_BUCKETS     (2 * MAX_OBSERVERS)
+
+static uint8_t obs_id_slot[MAX_OBSERVERS];
+static uint8_t obs_tok_idx[OBS_TOK_BUCKETS];
+
+
+/* FNV-1a over the token, folded to a bucket */
+static uint8_t
+obs_tok_hash(uint8_t tkl, const uint8_t *token)
+{
+    uint32_t h = 2166136261UL;
+    uint8_t i;
+
+    for (i = 0; i < tkl; i++) {
+        h = (h ^ token[i]) * 16777619UL;
+    }
+    return (h ^ (h >> 16)) % OBS_TOK_BUCKETS;
+}
+
+
+/* Reindex after obs[] changes, observer ids are bound again on use */
+static void
+obs_reindex(void)
+{
+    uint8_t i, b;
+
+    memset(obs_id_slot, 0, sizeof(obs_id_slot));
+    memset(obs_tok_idx, 0, sizeof(obs_tok_idx));
+    for (i = 0; i < MAX_OBSERVERS; i++) {
+        if (obs[i].uri[0] == '\0') {
+            continue;
+        }
+        b = obs_tok_hash(obs[i].tkl, obs[i].token);
+        while (obs_tok_idx[b]) {
+            b = (b + 1) % OBS_TOK_BUCKETS;
+        }
+        obs_tok_idx[b] = i + 1;
+    }
+}
+
+/* The relations, for a warm restart. Those with a path too long aren't kept. */
+static void
+obs_retain(void)
+{
+#if RETAIN
+    struct retain_obs ro[MAX_OBSERVERS];
+    uint8_t i;
+
+    memset(ro, 0, sizeof(ro));
+    for (i = 0; i < MAX_OBSERVERS; i++) {
+        if (strlen(obs[i].uri) < sizeof(ro[i].uri)) {
+            strcpy(ro[i].uri, obs[i].uri);
+            ro[i].tkl = obs[i].tkl;
+            memcpy(ro[i].token, obs[i].token, sizeof(ro[i].token));
+            strcpy(ro[i].sid, obs[i].sid);
+        }
+    }
+    retain_put(RETAIN_OBS, ro, sizeof(ro));
+#endif
+}
+
+/*
+ * Take back the relations the last run had, from before a reset. The
+ * client handles are gone with it, on the sensor they are always NULL.
+ * Returns the number restored.
+ */
+uint8_t
+obs_restore(void)
+{
+    uint8_t n = 0;
+#if RETAIN
+    struct retain_obs ro[MAX_OBSERVERS];
+    uint8_t i;
+
+    if (!retain_get(RETAIN_OBS, ro, sizeof(ro))) {
+        return 0;
+    }
+    for (i = 0; i < MAX_OBSERVERS; i++) {
+        if (ro[i].uri[0] == '\0' || obs[i].uri[0] != '\0') {
+            continue;
+        }
+        strcpy(obs[i].uri, ro[i].uri);
+        obs[i].tkl = min(ro[i].tkl, (uint8_t)sizeof(obs[i].token));
+        memcpy(obs[i].token, ro[i].token, sizeof(obs[i].token));
+        obs[i].client = NULL;
+        ro[i].sid[sizeof(ro[i].sid) - 1] = '\0';
+        strcpy(obs[i].sid, ro[i].sid);
+        n++;
+    }
+    obs_reindex();
+    obs_retain();
+    DLOG_INFO("Restored %d observe relations", n);
+#endif
+    return n;
+}
+
 /*
  * Find the observe entry in the array specified by the token and the sensor
- * identifier. For now it just finds the matching entries in obs[], but in
+ * identifier, through the token hash. For now it just finds the matching
+ * entries in obs[], but in
  * future we'll need a more sophisticated mapping if multiple clients and/or
  * sensors will be upported concurrently, as tokens are only unique to a given
  * endpoint. The issue is that we don't know what resource is responding unless
@@ -80,8 +185,8 @@ static struct obs_t obs[MAX_OBSERVERS] = { };
  * @param token: The token to use as the key.
  * @param client: To return the opaque client handle that was provided when the
  * observe was set up.
- * @param nxt: index after the one where the entry was found. Start with 0 on
- * the first call.
+ * @param nxt: position in the hash chain after the entry found. Start with 0
+ * on the first call.
  *
  * Returns 0 on success, -1 if not found.
  */
@@ -89,26 +194,28 @@ error_t
 get_obs_by_sid_tok(const char *sid, uint8_t tkl, const uint8_t *token, 
                   void **client, uint8_t *nxt)
 {
+    uint8_t b;
     uint8_t i;
 
-    if ((tkl == 0) || (token == NULL) || (*nxt >= MAX_OBSERVERS) || 
+    if ((tkl == 0) || (token == NULL) || (*nxt >= OBS_TOK_BUCKETS) || 
             (sid == NULL)) {
         return ERR_INVAL;
     }
 
-    for (i = *nxt; i < MAX_OBSERVERS; i++) {
-        if (!memcmp(token, obs[i].token, tkl) && !strcmp(sid, obs[i].sid)) {
-            break;
+    b = (obs_tok_hash(tkl, token) + *nxt) % OBS_TOK_BUCKETS;
+    for (; *nxt < OBS_TOK_BUCKETS && obs_tok_idx[b]; (*nxt)++) {
+        i = obs_tok_idx[b] - 1;
+        b = (b + 1) % OBS_TOK_BUCKETS;
+        if (obs[i].tkl == tkl && !memcmp(token, obs[i].token, tkl) &&
+                !strcmp(sid, obs[i].sid)) {
+            *client = obs[i].client;
+            (*nxt)++;
+            return ERR_OK;
         }
     }
-    if (i == MAX_OBSERVERS) {
-        return ERR_NO_ENTRY;
-    }
+    *nxt = OBS_TOK_BUCKETS;
 
-    *client = obs[i].client;
-    *nxt = i + 1;
-
-    return ERR_OK;
+    return ERR_NO_ENTRY;
 }
 
 
@@ -155,6 +262,42 @@ get_obs_by_uri(const char *uri, uint8_t *tkl, uint8_t *token, void **client, uin
 }
 
 
+/*
+ * As get_obs_by_uri for the one observer of a resource, by the observer id
+ * coapsensorobs assigned it. Only the first lookup after an observe is
+ * enabled or disabled matches the uri, later ones go straight to the slot.
+ *
+ * @param oid: Observer id, < MAX_OBSERVERS.
+ * @param uri: The URI of the resource, to bind oid to a slot.
+ *
+ * Returns 0 on success, -1 if not found.
+ */
+error_t
+get_obs_by_id(uint8_t oid, const char *uri, uint8_t *tkl, uint8_t *token, void **client)
+{
+    uint8_t i;
+    uint8_t nxt = 0;
+
+    if (oid >= MAX_OBSERVERS) {
+        return ERR_INVAL;
+    }
+    if (!obs_id_slot[oid]) {
+        if (get_obs_by_uri(uri, tkl, token, client, &nxt)) {
+            return ERR_NO_ENTRY;
+        }
+        obs_id_slot[oid] = nxt;
+        return ERR_OK;
+    }
+
+    i = obs_id_slot[oid] - 1;
+    *tkl = obs[i].tkl;
+    memcpy(token, obs[i].token, *tkl);
+    *client = obs[i].client;
+
+    return ERR_OK;
+}
+
+
 
 /*
  *  Get the next observe option value. Values 0 and 1 are reserved for the
@@ -185,11 +328,12 @@ get_obs_val(void)
  * This can only be called by the main (on the NIC, net_mgr) task.
  */
 static void
-add_obs(int slot, const char *urip, struct coap_msg_ctx *req, void *client)
+add_obs(int slot, struct coap_msg_ctx *req, void *client)
 {
     obs[slot].tkl = req->tkl;
     memcpy(obs[slot].token, req->token, req->tkl);
-    strcpy(obs[slot].uri, urip);
+    /* the one copy of the path, it outlives the request */
+    (void)coap_path_copy(req, obs[slot].uri, sizeof(obs[slot].uri));
     obs[slot].client = client;
     strcpy(obs[slot].sid, req->sid);
 }
@@ -210,21 +354,16 @@ add_obs(int slot, const char *urip, struct coap_msg_ctx *req, void *client)
  * locking.
  */
 error_t 
-enable_obs(const char *urip, struct coap_msg_ctx *req, void *client)
+enable_obs(struct coap_msg_ctx *req, void *client)
 {
     int i;
     int empty_slot = MAX_OBSERVERS;
 
-    if (urip == NULL)
-	{
-		goto error;
-    }
-
     /*
      * Find the uri in the array, if present.
      * Add it to the array, with the token.
      */
-    if (strlen(urip) >= MAX_OBS_URI_LEN)
+    if (coap_path_copy(req, NULL, 0) >= MAX_OBS_URI_LEN)
 	{
         goto error;
     }
@@ -243,7 +382,7 @@ enable_obs(const char *urip, struct coap_msg_ctx *req, void *client)
             if (!strncmp(req->sid, obs[i].uri, strlen(req->sid)) && 
                 !memcmp(req->token, obs[i].token, MAX(req->tkl, obs[i].tkl)))
 			{
-                dlog(LOG_INFO, "Not adding obs entry for %s, sid:token not unique", urip);
+                DLOG_INFO("Not adding obs entry for %s, sid:token not unique", obs[i].uri);
                 return ERR_EXISTS;
             }
         }
@@ -253,9 +392,9 @@ enable_obs(const char *urip, struct coap_msg_ctx *req, void *client)
      * Now match on URI, which is all we're supposed to do based on the RFC.
      */
     for (i = 0; i < MAX_OBSERVERS; i++) {
-        if (!strcmp(urip, obs[i].uri))
+        if (!coap_path_cmp(req, obs[i].uri))
 		{
-            dlog(LOG_INFO, "Not adding obs entry for %s, duplicate.", urip);
+            DLOG_INFO("Not adding obs entry for %s, duplicate.", obs[i].uri);
             return ERR_EXISTS;
         }
 		else if ((obs[i].uri[0] == '\0') && (empty_slot == MAX_OBSERVERS))
@@ -265,7 +404,9 @@ enable_obs(const char *urip, struct coap_msg_ctx *req, void *client)
     }
     if (empty_slot < MAX_OBSERVERS)
 	{
-        add_obs(empty_slot, urip, req, client);
+        add_obs(empty_slot, req, client);
+        obs_reindex();
+        obs_retain();
         return ERR_OK;
     }
 
@@ -287,28 +428,25 @@ error:
  * locking. However, as per enable_obs and client pointer.
  */
 error_t 
-disable_obs(const char *urip, struct coap_msg_ctx *req, void **client, uint8_t force)
+disable_obs(struct coap_msg_ctx *req, void **client, uint8_t force)
 {
     int i;
 
-    if (urip == NULL)
-	{
-        return ERR_INVAL;
-    }
-
     /*
      * Find the uri in the array, and if present, zero the entry.
      */
     for (i = 0; i < MAX_OBSERVERS; i++)
 	{
-        if (!strcmp(urip, obs[i].uri) && (!memcmp(req->token, obs[i].token, MAX(req->tkl, obs[i].tkl)) || force))
+        if (!coap_path_cmp(req, obs[i].uri) && (!memcmp(req->token, obs[i].token, MAX(req->tkl, obs[i].tkl)) || force))
 		{
+            DLOG_INFO("disable_obs: De-registered URI: %s", obs[i].uri);
             obs[i].uri[0] = '\0';
             *client = obs[i].client;
             obs[i].client = NULL;
             memset(obs[i].token, 0, sizeof(obs[i].token));
             obs[i].sid[0] = '\0';
-            dlog(LOG_INFO, "disable_obs: De-registered URI: %s", urip);
+            obs_reindex();
+            obs_retain();
             return ERR_OK;
         }
     }
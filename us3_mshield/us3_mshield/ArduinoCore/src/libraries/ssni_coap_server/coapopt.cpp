@@ -39,83 +39,67 @@ Networks, Inc.
 #include "coapmsg.h"
 #include "coappdu.h"
 
-class sl_co
-{
-  public:
-
-  coap_opt * slh_first;
-};
+/*
+ * Options live in a small array in the message context, sorted by type.
+ * first[] indexes the first option of each type below COAP_OPT_IDX_MAX,
+ * larger types are found by binary search.  An iterator points at the
+ * option last returned.
+ */
 
-#define TOOLS_COAP
+/* Rebuild the first of type index after the array changed */
+static void
+copt_reindex(struct sl_co *hd)
+{
+    int i;
 
-#ifndef TOOLS_COAP
-/******************************************************************************
- * Memory pool code, NIC only.
- *****************************************************************************/
-#define CO_MAX  16  /* Maximum number of options concurrently processed */
+    memset(hd->first, 0, sizeof(hd->first));
+    for (i = hd->n - 1; i >= 0; i--) {
+        if (hd->o[i].ot < COAP_OPT_IDX_MAX) {
+            hd->first[hd->o[i].ot] = i + 1;
+        }
+    }
+}
 
-static OS_MEM *copt_pool;
 
-void
-copt_pool_init(void)
+/* Index of the first option with type > ot, or >= ot if !after */
+static int
+copt_bound(const struct sl_co *hd, uint16_t ot, int after)
 {
-    void *copt_mem;
-    uint8_t err;
-
-    copt_mem = malloc(OS_MEM_SIZE(CO_MAX, sizeof(coap_opt)));
-    copt_pool = OSMemCreate(copt_mem, CO_MAX, sizeof(coap_opt), "coap_opts", &err);
-    assert(err == 0);
+    int lo = 0, hi = hd->n, mid;
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (hd->o[mid].ot < ot || (after && hd->o[mid].ot == ot)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
 }
-#endif  /* TOOLS_COAP */
 
 
-/*
- * Allocate and initialise a coap_opt. Will be used by the client, and
- * internally to add options
- *
- * @param: None.
- *
- * @return: A pointer to the new object. This is to be passed to all accessor
- * and deallocation functions.
- */
-static coap_opt *
-copt_alloc(void)
+/* Index of the first option of type ot, or -1 */
+static int
+copt_first(const struct sl_co *hd, uint16_t ot)
 {
-    coap_opt *co;
-
-#ifdef TOOLS_COAP
-    if ((co = (coap_opt *)malloc(sizeof(coap_opt))) != NULL) {
-#else
-    if ((co = OSMemGet(copt_pool)) != NULL) {
-#endif
-        memset(co, 0, sizeof(coap_opt));
-    }
+    int i;
 
-    return co;
+    if (ot < COAP_OPT_IDX_MAX) {
+        return hd->first[ot] - 1;
+    }
+    i = copt_bound(hd, ot, 0);
+    return (i < hd->n && hd->o[i].ot == ot) ? i : -1;
 }
 
 
-/*
- * Dellocate a coap_opt.
- *
- * @param: co, the object to free.
- *
- * @return: None.
- */
+/* Remove n options starting at index i */
 static void
-copt_dealloc(coap_opt *co)
+copt_remove(struct sl_co *hd, int i, int n)
 {
-    /*
-     * TODO Return to a pool. Isolate code for Linux/ucos so it looks the
-     * same to the caller.
-     */
-    if (co) {
-#ifdef TOOLS_COAP
-        free(co);
-#else
-        OSMemPut(copt_pool, co);
-#endif
-    }
+    memmove(&hd->o[i], &hd->o[i + n], (hd->n - i - n) * sizeof(hd->o[0]));
+    hd->n -= n;
+    copt_reindex(hd);
 }
 
 
@@ -127,38 +111,42 @@ copt_init(struct sl_co *hd)
 {
     assert(hd);
 
-    SLIST_INIT(hd);
+    hd->n = 0;
+    memset(hd->first, 0, sizeof(hd->first));
 }
 
 
 /*
- * Dellocate all attached coap_opt objects and NULLify the head.
+ * Drop all options.
  *
- * @param: co, the root object.
+ * @param: hd, the options.
  *
  * @return: None.
  */
 void
 copt_del_all(struct sl_co *hd)
 {
-    coap_opt *curr, *tmp;
-
     assert(hd);
-    SLIST_FOREACH_SAFE(curr, hd, nxt, tmp) {
-        SLIST_REMOVE(hd, curr, coap_opt, nxt);
-        copt_dealloc(curr);
-    }
+    copt_init(hd);
+}
+
+
+/* Most options any list has held, against COAP_OPT_MAX */
+static uint8_t copt_peak_n;
 
-    return;
+int
+copt_peak(void)
+{
+    return copt_peak_n;
 }
 
 
 /*
- * Add the supplied option to the specified coap_opt head. Assume the supplied
- * head and option isn't NULL. The contents of opt is copied into the newly
- * allocated object, which is inserted into the list.
+ * Add the supplied option after any others of its type. Assume the supplied
+ * head and option isn't NULL. The option tlv is copied, not the value it
+ * points to.
  *
- * @param: hd, the head anchor
+ * @param: hd, the options
  * @param: opt, the option tlv to add.
  *
  * @return: 0 on sucess.
@@ -166,51 +154,34 @@ copt_del_all(struct sl_co *hd)
 error_t
 copt_add_opt(struct sl_co *hd, struct optlv *opt)
 {
-    assert(hd);
-    coap_opt *nco;       /* New coap option */
-    coap_opt *o, *po;    /* option iterator, previous option. */
-    error_t rc = ERR_OK;
+    int i;
 
     assert(hd);
     assert(opt);
 
-    /*
-     * Find the node with the correct option value.
-     * If present, allocate and append a new object, set object values.
-     */
-    if ((nco = copt_alloc()) == NULL) {
-        rc = ERR_NO_MEM;
-        goto done;
+    if (hd->n >= COAP_OPT_MAX) {
+        coap_stats.no_mem++;
+        DLOG_ERR("No room for option %d, %d in use", opt->ot, hd->n);
+        return ERR_NO_MEM;
     }
-    nco->o = *opt;
 
-    if (SLIST_EMPTY(hd) || (SLIST_FIRST(hd)->o.ot > opt->ot)) {
-        SLIST_INSERT_HEAD(hd, nco, nxt);
-        goto done;
+    i = copt_bound(hd, opt->ot, 1);
+    memmove(&hd->o[i + 1], &hd->o[i], (hd->n - i) * sizeof(hd->o[0]));
+    hd->o[i] = *opt;
+    hd->n++;
+    if (hd->n > copt_peak_n) {
+        copt_peak_n = hd->n;
     }
-    SLIST_FOREACH(o, hd, nxt) {
-        if (SLIST_NEXT(o, nxt) && (SLIST_NEXT(o, nxt)->o.ot > opt->ot)) {
-            SLIST_INSERT_AFTER(o, nco, nxt);
-            goto done;
-        }
-        po = o;
-    }
-    /*
-     * Got to the end and didn't find the right location, so it must be
-     * appended to the list.
-     */
-    SLIST_INSERT_AFTER(po, nco, nxt);
-    
-done:
-    return rc;
+    copt_reindex(hd);
+
+    return ERR_OK;
 }
 
 
 /*
- * Remove the option specified by type and value from the list, and deallocate
- * its storage.
+ * Remove the option specified by type and value.
  *
- * @param: hd: The head of the list.
+ * @param: hd: The options.
  * @param: opt: A pointer to an option whose content will be sought in the
  * list, and if found, that option deleted from the list.
  *
@@ -219,107 +190,92 @@ done:
 error_t
 copt_del_opt(struct sl_co *hd, struct optlv *opt)
 {
-    error_t rc = ERR_OK;
+    int i;
+
     assert(hd);
-    coap_opt *o, *tmp; /* option list iterator, and tmp ptr. */
     assert(opt);
     assert(opt->ov);
 
-    SLIST_FOREACH_SAFE(o, hd, nxt, tmp) {
-        if ((o->o.ot == opt->ot) && (o->o.ol == opt->ol) && 
-            !memcmp(o->o.ov, opt->ov, opt->ol)) {
+    for (i = copt_first(hd, opt->ot); i >= 0 && i < hd->n && 
+                                      hd->o[i].ot == opt->ot; i++) {
+        if ((hd->o[i].ol == opt->ol) && !memcmp(hd->o[i].ov, opt->ov, opt->ol)) {
             /* Found the value */
-            SLIST_REMOVE(hd, o, coap_opt, nxt);
-            copt_dealloc(o);
-            goto done;
+            copt_remove(hd, i, 1);
+            return ERR_OK;
         }
     }
-    dlog(LOG_DEBUG, "Didn't find option %d to delete.", opt->ot);
-    rc = ERR_NO_ENTRY;
-done:
-    return rc;
+    DLOG_DEBUG("Didn't find option %d to delete.", opt->ot);
+    return ERR_NO_ENTRY;
 }
 
 
 /*
- * Get the next option in the list of the specified type. If the iterator (*it)
+ * Get the next option of the specified type. If the iterator (*it)
  * is NULL, start at the beginning of that type. If "it" is NULL, just return
- * the first of that type.
+ * the first of that type.  Once there are no more *it is NULL again.
  *
- * @param: hd: The head of the list.
+ * @param: hd: The options.
  * @param: ot: The option type to match. Nothing else used for matching.
  * @param: it: Iterator used for subsequent calls to get next.
  *
- * @return: The next option (as optlv) in the list, or NULL if no more.
+ * @return: The next option (as optlv), or NULL if no more.
  */
 struct optlv *
 copt_get_next_opt_type(const struct sl_co *hd, uint16_t ot, void **it)
 {
-    struct optlv *opt;
-    coap_opt **ppco = (coap_opt **)it;
-    coap_opt *pco;
+    const struct optlv *cur;
+    int i;
 
     assert(hd);
-    pco = SLIST_FIRST(hd);
-    if (!ppco) {    /* Allow passing in NULL to find any instances */
-        ppco = &pco;
-    } else if (!*ppco) {
-        *ppco = SLIST_FIRST(hd);
-    } else {
-        *ppco = SLIST_NEXT(*ppco, nxt);
-    }
-    while (*ppco) {
-        if ((*ppco)->o.ot == ot) {
-            break;
+    i = copt_first(hd, ot);
+    if (it && *it) {
+        /* continue past the last one returned, which may be of another type */
+        cur = (const struct optlv *)*it;
+        if (i <= cur - hd->o) {
+            i = cur - hd->o + 1;
+            if (i >= hd->n || hd->o[i].ot != ot) {
+                i = -1;
+            }
         }
-        *ppco = SLIST_NEXT(*ppco, nxt);
     }
-    if (*ppco) {
-        opt = &((*ppco)->o);
-    } else {
-        opt = NULL;
+
+    cur = (i >= 0) ? &hd->o[i] : NULL;
+    if (it) {
+        *it = (void *)cur;
     }
-    return opt;
+    return (struct optlv *)cur;
 }
 
 
 /*
- * Get the next option in the list. Actually returns the option currently
- * indicated by *ppco (it), unless it's NULL in which case it's initialised to
- * co, then it returns the option. Subsequent calls get the next option, until
- * there are no more.
+ * Get the next option. Starts at the first option if *it is NULL.
+ * Subsequent calls get the next option, until there are no more.
  *
- * @param: hd: The head of the list.
+ * @param: hd: The options.
  * @param: it: Iterator used for subsequent calls to get next.
  *
- * @return: The next option (as optlv) in the list, or NULL if no more.
+ * @return: The next option (as optlv), or NULL if no more.
  */
 struct optlv *
 copt_get_next_opt(const struct sl_co *hd, void **it)
 {
-    struct optlv *opt;
-    coap_opt **ppco = (coap_opt **)it;
-    assert(ppco);
+    const struct optlv *cur;
+    int i;
+
+    assert(it);
     assert(hd);
 
-    if (!*ppco) {
-        *ppco = SLIST_FIRST(hd);
-    } else {
-        *ppco = SLIST_NEXT(*ppco, nxt);
-    }
-    if (*ppco) {
-        opt = &((*ppco)->o);
-    } else {
-        opt = NULL;
-    }
-    return opt;
+    i = *it ? ((const struct optlv *)*it - hd->o) + 1 : 0;
+    cur = (i < hd->n) ? &hd->o[i] : NULL;
+    *it = (void *)cur;
+    return (struct optlv *)cur;
 }
 
 
 /*
- * Remove and deallocate all instances of options of the specified type.
+ * Remove all options of the specified type.
  *
- * @param: hd: The head of the list.
+ * @param: hd: The options.
  * @param: ot: The type of option to delete.
  *
  * @return: 0 if anything deleted.
@@ -327,42 +283,39 @@ copt_get_next_opt(const struct sl_co *hd, void **it)
 error_t
 copt_del_opt_type(struct sl_co *hd, uint16_t ot)
 {
-    error_t rc = ERR_NO_ENTRY;
-    assert(hd);
-    coap_opt *o, *tmp;
+    int i, n;
 
-    SLIST_FOREACH_SAFE(o, hd, nxt, tmp) {
-        if (o->o.ot == ot) {
-            rc = ERR_OK;
-            SLIST_REMOVE(hd, o, coap_opt, nxt);
-            copt_dealloc(o);
-        }
+    assert(hd);
+    i = copt_first(hd, ot);
+    if (i < 0) {
+        DLOG_DEBUG("Didn't find option %d to delete.", ot);
+        return ERR_NO_ENTRY;
     }
 
-    if (rc) {
-        dlog(LOG_DEBUG, "Didn't find option %d to delete.", ot);
+    for (n = 1; i + n < hd->n && hd->o[i + n].ot == ot; n++) {
     }
+    copt_remove(hd, i, n);
 
-    return rc;
+    return ERR_OK;
 }
 
 
 /*
- * Dump the contents of the coap_opt object using dlog.
+ * Dump the options using dlog.
  *
  * @return: None.
  */
 void
 copt_dump(struct sl_co *hd)
 {
-    coap_opt *co;
+    int i;
 
     assert(hd);
-    dlog(LOG_DEBUG, "Dumping options:");
+    DLOG_DEBUG("Dumping options:");
 
-    SLIST_FOREACH(co, hd, nxt) {
-        dlog(LOG_DEBUG, "option type: %d, len: %d, Val: 0x%x", co->o.ot, 
-                co->o.ol, (uint32_t)co->o.ov);
+    for (i = 0; i < hd->n; i++) {
+        DLOG_DEBUG("option type: %d, len: %d, Val: 0x%x", hd->o[i].ot, 
+                hd->o[i].ol, (unsigned int)(uintptr_t)hd->o[i].ov);
     }
 }
 
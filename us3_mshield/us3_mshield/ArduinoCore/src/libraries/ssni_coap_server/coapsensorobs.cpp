@@ -36,6 +36,10 @@ Networks, Inc.
 #include "coapsensorobs.h"
 #include "arduino_pins.h"
 #include "arduino_time.h"
+#include "retain.h"
+#include "hdlc.h"
+#include "pace.h"
+#include "hshrink.h"
 
 
 // Used to tell CoAP Server to use the SAPI dispatcher and handler
@@ -48,16 +52,54 @@ observe_reg_info_t observe_info[MAX_OBSERVERS];
 // Next empty slot in the observe info table
 static uint8_t observe_info_index = 0;
 
+// millis() at which do_observe next has something to do
+static uint32_t obs_due_ms = 0;
+
+// Registered observers, soonest notification first
+static uint8_t obs_due[MAX_OBSERVERS];
+static uint8_t obs_due_n = 0;
+
+// Link pace the order was made with, see pace.h
+static uint8_t obs_due_pace = 0;
+
+// Registrations are kept for a warm restart from coap_obs_restore on, so the
+// set up at boot doesn't overwrite those of the last run
+static uint8_t obs_retain_on = 0;
+
+
+/*
+ * obs_q holds the next payloads to send to the proxy, observe responses or
+ * the reboot event awaiting a data link layer connection, alarms first. The
+ * next RR poll moves them to the HDLC transmit queue, which holds them for
+ * resend until the proxy/primary acks them.
+ */
+struct obs_q_ent {
+	struct mbuf *	m;
+	uint8_t			observer_id;		// OBS_Q_NO_OBSERVER if not a notification
+	uint8_t			alarm;				// 1 -> sent ahead of the others
+};
+
+static struct obs_q_ent obs_q[OBS_Q_MAX];
+static uint8_t obs_q_n = 0;
+
+// A wake-up of the mNIC held for more to queue, see obs_q_wake
+static uint8_t obs_wake_held = 0;
+static uint32_t obs_wake_ms = 0;
 
 /*
- * pending_rsp is the next payload to send to the proxy. It may be an observe
- * response that is awaiting a data link layer connection, or it could be the
- * last frame that was sent by us. In the latter case, we hold onto it to
- * resend in the event that the proxy/primary didn't receive it.
- *
- * This assumes we only have a data link window size of 1.
+ * The CoAP header and options of each observer's notifications, as the last
+ * full build laid them out. Only the type, MID and Observe value change from
+ * one to the next, so while the token, Content-Format and Max-Age hold, the
+ * next one is the template with those patched in. len 0 until one is built.
  */
-struct mbuf *pending_rsp;
+struct obs_tpl {
+	uint8_t			hdr[COAP_RSP_HDR_SZ];
+	uint8_t			len;
+	uint8_t			cf;
+	uint32_t		max_age;
+};
+
+static struct obs_tpl obs_tpl[MAX_OBSERVERS];
 
 
 
@@ -79,9 +121,243 @@ struct mbuf *pending_rsp;
 
 
 
+// Drop entry i of the queue, not freeing it
+static void obs_q_del(uint8_t i)
+{
+	obs_q_n--;
+	memmove(&obs_q[i], &obs_q[i + 1], (obs_q_n - i) * sizeof(obs_q[0]));
+}
+
+
+// The deadline epoch sets an observer's next one from, see OBS_ALIGN
+static time_t obs_align(time_t epoch, uint32_t frequency)
+{
+#if OBS_ALIGN
+	if (frequency)
+	{
+		return epoch - (uint32_t)epoch % frequency;
+	}
+#endif
+	return epoch;
+}
+
+
+// Seconds between an observer's notifications, stretched by the link pace
+static uint32_t obs_period(uint8_t observer_id)
+{
+	return observe_info[observer_id].frequency << PACE_LEVEL();
+}
+
+
+// Epoch of an observer's next notification
+static time_t obs_due_epoch(uint8_t observer_id)
+{
+	return observe_info[observer_id].base_epoch + obs_period(observer_id);
+}
+
+
+// Take an observer out of the deadline order
+static void obs_due_del(uint8_t observer_id)
+{
+	uint8_t i;
+
+	for (i = 0; i < obs_due_n && obs_due[i] != observer_id; i++)
+		;
+	if (i < obs_due_n)
+	{
+		obs_due_n--;
+		memmove(&obs_due[i], &obs_due[i + 1], (obs_due_n - i) * sizeof(obs_due[0]));
+	}
+}
+
+
+// (Re)place an observer by its next notification, after those due at the same time
+static void obs_due_add(uint8_t observer_id)
+{
+	time_t due = obs_due_epoch(observer_id);
+	uint8_t i;
+
+	obs_due_del(observer_id);
+	for (i = 0; i < obs_due_n && (int32_t)(obs_due_epoch(obs_due[i]) - due) <= 0; i++)
+		;
+	memmove(&obs_due[i + 1], &obs_due[i], (obs_due_n - i) * sizeof(obs_due[0]));
+	obs_due[i] = observer_id;
+	obs_due_n++;
+	obs_due_ms = millis();
+}
+
+
+// The registered observers, for a warm restart
+static void obs_reg_retain()
+{
+#if RETAIN
+	struct retain_reg rr[MAX_OBSERVERS];
+	uint8_t i;
+
+	if (!obs_retain_on)
+	{
+		return;
+	}
+	memset(rr, 0, sizeof(rr));
+	for (i = 0; i < observe_info_index; i++)
+	{
+		if (observe_info[i].obs_flag)
+		{
+			strcpy(rr[i].obs_uri, observe_info[i].obs_uri);
+			rr[i].frequency = observe_info[i].frequency;
+			rr[i].ack_seqno = observe_info[i].ack_seqno;
+			rr[i].con_every_s = observe_info[i].con_every_s;
+			rr[i].con_every_n = observe_info[i].con_every_n;
+			rr[i].cf = observe_info[i].cf;
+		}
+	}
+	retain_put(RETAIN_REG, rr, sizeof(rr));
+#endif
+}
+
+
+error_t obs_q_add(struct mbuf *m, uint8_t observer_id, uint8_t alarm)
+{
+	uint8_t i;
+
+	// A newer notification replaces an unsent one for the same URI
+	for (i = 0; observer_id != OBS_Q_NO_OBSERVER && i < obs_q_n; i++)
+	{
+		if (obs_q[i].observer_id == observer_id)
+		{
+			DLOG_DEBUG("obs_q_add: replacing unsent notification: %d", observer_id);
+			alarm |= obs_q[i].alarm;
+			m_free(obs_q[i].m);
+			obs_q_del(i);
+			break;
+		}
+	}
+
+	// Full, drop the oldest that isn't an alarm
+	if (obs_q_n == OBS_Q_MAX)
+	{
+		for (i = 0; i < obs_q_n && obs_q[i].alarm; i++)
+			;
+		if (i == obs_q_n)
+		{
+			DLOG_ERR("obs_q_add: queue full of alarms");
+			return ERR_NO_MEM;
+		}
+		DLOG_INFO("obs_q_add: queue full, dropping: %d", obs_q[i].observer_id);
+		m_free(obs_q[i].m);
+		obs_q_del(i);
+	}
+
+	// Alarms go after the queued alarms, others at the tail
+	i = obs_q_n;
+	if (alarm)
+	{
+		for (i = 0; i < obs_q_n && obs_q[i].alarm; i++)
+			;
+	}
+	memmove(&obs_q[i + 1], &obs_q[i], (obs_q_n - i) * sizeof(obs_q[0]));
+	obs_q[i].m = m;
+	obs_q[i].observer_id = observer_id;
+	obs_q[i].alarm = alarm ? 1 : 0;
+	obs_q_n++;
+
+	return ERR_OK;
+}
+
+
+boolean obs_q_has(uint8_t observer_id)
+{
+	for (uint8_t i = 0; i < obs_q_n; i++)
+	{
+		if (obs_q[i].observer_id == observer_id)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+
+struct mbuf *obs_q_head()
+{
+	return obs_q_n ? obs_q[0].m : NULL;
+}
+
+
+void obs_q_pop()
+{
+	if (obs_q_n)
+	{
+		obs_q_del(0);
+	}
+}
+
+
+void obs_q_flush()
+{
+	while (obs_q_n)
+	{
+		m_free(obs_q[--obs_q_n].m);
+	}
+	DLOG_DEBUG("%s:%d Cleared obs_q", __FUNCTION__, __LINE__);
+}
+
+
 // This function assembles an URI and sets the function used to read a sensor
+// Toggle the wake-up pin 1 -> 0 -> 1, unless the mNIC is polling anyway
+static void obs_wake_pulse()
+{
+	obs_wake_held = 0;
+	if ((uint32_t)(micros() - hdlc_rx_us()) < MNIC_AWAKE_MS * 1000UL)
+	{
+		return;
+	}
+	digitalWrite(MNIC_WAKEUP_PIN, LOW);
+	delay(1);
+	digitalWrite(MNIC_WAKEUP_PIN, HIGH);
+}
+
+
+void obs_q_wake(uint8_t alarm)
+{
+	if (alarm || obs_q_n >= OBS_Q_MAX)
+	{
+		obs_wake_pulse();
+	}
+	else if (!obs_wake_held)
+	{
+		obs_wake_held = 1;
+		obs_wake_ms = millis() + MNIC_WAKE_HOLD_MS;
+	}
+}
+
+
+void obs_q_wake_poll()
+{
+	if (!obs_wake_held)
+	{
+		return;
+	}
+	if (!obs_q_n)
+	{
+		// drained by a poll of its own
+		obs_wake_held = 0;
+	}
+	else if ((int32_t)(millis() - obs_wake_ms) >= 0)
+	{
+		obs_wake_pulse();
+	}
+}
+
+
 uint8_t set_observer_sapi(const char *sensor_type, ObsFuncPtr p, uint32_t frequency, uint8_t sensor_id)
 {
+	if (observe_info_index >= MAX_OBSERVERS)
+	{
+		DLOG_ERR("No observer slot for: %s", sensor_type);
+		return OBS_Q_NO_OBSERVER;
+	}
+
 	// Assemble the full resource URI; e.g. "/arduino/temp". Link to master observe table.
 	sprintf(observe_info[observe_info_index].obs_uri, "/us3/%s", sensor_type);
 	
@@ -91,6 +367,10 @@ uint8_t set_observer_sapi(const char *sensor_type, ObsFuncPtr p, uint32_t freque
 	observe_info[observe_info_index].obs_flag = 0;
 	observe_info[observe_info_index].ack_seqno = 0;
 	observe_info[observe_info_index].base_epoch = get_rtc_epoch();
+	observe_info[observe_info_index].con_every_n = 0;
+	observe_info[observe_info_index].con_every_s = OBS_NON_CON_MAX_SECS;
+	observe_info[observe_info_index].cf = COAP_CF_CSV;
+	observe_info[observe_info_index].compress = 0;
 	
 	return observe_info_index++;
 }
@@ -109,6 +389,10 @@ void set_observer( const char *uri_rsrc_name, ObsFuncPtr p )
 	observe_info[observe_info_index].obs_flag = 0;
 	observe_info[observe_info_index].ack_seqno = 0;
 	observe_info[observe_info_index].base_epoch = get_rtc_epoch();
+	observe_info[observe_info_index].con_every_n = 0;
+	observe_info[observe_info_index].con_every_s = OBS_NON_CON_MAX_SECS;
+	observe_info[observe_info_index].cf = COAP_CF_CSV;
+	observe_info[observe_info_index].compress = 0;
 	
 	
 	// Assemble the resource URI, e.g. "/arduino/temp"
@@ -120,84 +404,182 @@ void set_observer( const char *uri_rsrc_name, ObsFuncPtr p )
 	//base_epoch = get_rtc_epoch();
 }
 
-// Check each registered sensor. Determine if it we should generate an observation notification.
-// Based on the periodic frequency defined for the sensor at registration time.
+// Send the notifications that are due, soonest first. Each goes back in
+// the order a full period from now, so all observers due take their turn.
+// Aligned, those due within OBS_ALIGN_WINDOW_S go too, their next one is
+// the next multiple of the period after the window.
 boolean do_observe()
 {
-	boolean atleastone = true;
 	time_t  epoch      = get_rtc_epoch();
-	
-	// Check all registered observers
-	for (uint8_t indx=0 ; indx < observe_info_index ; indx++)
+	uint32_t wait_s    = OBS_RECHECK_SECS;
+	uint8_t indx;
+#if OBS_ALIGN
+	time_t  until      = epoch + OBS_ALIGN_WINDOW_S;
+#else
+	time_t  until      = epoch;
+#endif
+	uint8_t order[MAX_OBSERVERS];
+	uint8_t i, n;
+
+	// Periods stretched or shrunk with the link pace, order by the new deadlines
+	if (obs_due_pace != PACE_LEVEL())
 	{
-		if (observe_info[indx].obs_flag)
+		obs_due_pace = PACE_LEVEL();
+		n = obs_due_n;
+		memcpy(order, obs_due, n);
+		for (i = 0; i < n; i++)
 		{
-			if (observe_info[indx].base_epoch == 0)
-			{
-				observe_info[indx].base_epoch = epoch;
-			}
-		
-			// Check if the current minute is different from the previous minute
-			if (epoch >= (observe_info[indx].base_epoch+observe_info[indx].frequency))
-			{
-				// Record the current minute
-				dlog(LOG_DEBUG, "do_observe: epoch %x uri %s", observe_info[indx].base_epoch, observe_info[indx].obs_uri);
-				observe_info[indx].base_epoch = epoch;
-
-				// Generate and send response notification
-				coap_observe_rsp(indx);
-				atleastone = true;
-			
-				int freeram = free_ram();
-				dlog(LOG_DEBUG, "do_observe: Free Ram: %d", freeram);
-				break;
-			}
+			obs_due_add(order[i]);
 		}
 	}
-	/*
-	// Check if we are doing Observe
-	if (obs_flag)
+	
+	while (obs_due_n && (int32_t)(until - obs_due_epoch(obs_due[0])) >= 0)
 	{
-		time_t epoch = get_rtc_epoch();
-		if (base_epoch == 0)
-		{
-			base_epoch = epoch;
-		}
-		
-		// Check if the current minute is different from the previous minute
-		if ( epoch >= (base_epoch+obs_frequency) )
-		{
-			// Record the current minute
-			dlog(LOG_DEBUG, "Observe notification at epoch: %d", base_epoch);
-			base_epoch = epoch;
+		indx = obs_due[0];
+
+		// Record the current minute
+		DLOG_DEBUG("do_observe: epoch %x uri %s", observe_info[indx].base_epoch, observe_info[indx].obs_uri);
+		observe_info[indx].base_epoch = obs_align(until, obs_period(indx));
+		obs_due_add(indx);
 
-			// Send response
-			coap_observe_rsp();
+		// Generate and send response notification
+		coap_observe_rsp(indx);
 			
-			int freeram = free_ram();
-			dlog(LOG_DEBUG, "Free Ram: %d", freeram);
-		}
+		int freeram = free_ram();
+		DLOG_DEBUG("do_observe: Free Ram: %d", freeram);
+	}
+	if (obs_due_n && (uint32_t)(obs_due_epoch(obs_due[0]) - epoch) < wait_s)
+	{
+		wait_s = obs_due_epoch(obs_due[0]) - epoch;
 	}
-	*/
+	obs_due_ms = millis() + wait_s * 1000;
 	
-	// Return the delay for reading time flag
-	return atleastone;
+	// Tell whether any observer is registered
+	return obs_due_n != 0;
 	
 } // do_observe
 
 
+// Check if do_observe has anything to do yet, without reading the RTC
+boolean observe_due()
+{
+	return (int32_t)(millis() - obs_due_ms) >= 0;
+}
+
+
+// Ms until do_observe has anything to do, for the observe task's deadline
+uint32_t observe_wait_ms()
+{
+	int32_t wait = (int32_t)(obs_due_ms - millis());
+
+	return wait > 0 ? (uint32_t)wait : 0;
+}
+
+
+// NON notifications with a periodic CON keepalive
+error_t coap_obs_set_non(uint8_t observer_id, uint8_t con_every_n, uint32_t con_every_s)
+{
+	if (observer_id >= observe_info_index)
+	{
+		return ERR_NO_ENTRY;
+	}
+	
+	observe_info[observer_id].con_every_n = con_every_n;
+	observe_info[observer_id].con_every_s = min(con_every_s, (uint32_t)OBS_NON_CON_MAX_SECS);
+	observe_info[observer_id].non_cnt = 0;
+	obs_reg_retain();
+	return ERR_OK;
+}
+
+
+// Content-Format of the notifications
+error_t coap_obs_set_cf(uint8_t observer_id, uint8_t cf)
+{
+	if (observer_id >= observe_info_index)
+	{
+		return ERR_NO_ENTRY;
+	}
+	
+	observe_info[observer_id].cf = cf;
+	obs_reg_retain();
+	return ERR_OK;
+}
+
+
+// Compressed notifications, see hshrink.h
+error_t coap_obs_set_compress(uint8_t observer_id, uint8_t on)
+{
+	if (observer_id >= observe_info_index)
+	{
+		return ERR_NO_ENTRY;
+	}
+	
+	observe_info[observer_id].compress = HSHRINK && on;
+	return ERR_OK;
+}
+
+
+uint8_t coap_obs_compress(uint8_t observer_id)
+{
+	return observer_id < observe_info_index && observe_info[observer_id].compress;
+}
+
+
+// Notification frequency, re-armed from now
+error_t coap_obs_set_freq(uint8_t observer_id, uint32_t frequency)
+{
+	if (observer_id >= observe_info_index)
+	{
+		return ERR_NO_ENTRY;
+	}
+	
+	observe_info[observer_id].frequency = frequency;
+	observe_info[observer_id].base_epoch = obs_align(get_rtc_epoch(), obs_period(observer_id));
+	if (observe_info[observer_id].obs_flag)
+	{
+		obs_due_add(observer_id);
+	}
+	obs_reg_retain();
+	return ERR_OK;
+}
+
+
+// Is it time for a CON notification, to check the observer is still there
+static uint8_t obs_con_due(uint8_t observer_id, uint8_t alarm)
+{
+	observe_reg_info_t *o = &observe_info[observer_id];
+	time_t epoch = get_rtc_epoch();
+	
+	if (!alarm && o->con_every_n > 1 && o->non_cnt + 1 < o->con_every_n &&
+		(uint32_t)(epoch - o->con_epoch) < o->con_every_s)
+	{
+		o->non_cnt++;
+		return 0;
+	}
+	o->non_cnt = 0;
+	o->con_epoch = epoch;
+	return 1;
+}
+
+
 // Register for Observe used by SAPI handlers.
 error_t coap_obs_reg_sapi(uint8_t observer_id)
 {
 	// Record the minute that we turn on Observe
 	// Make sure we don't send Observe response more than once per minute
-	observe_info[observer_id].base_epoch = get_rtc_epoch();
+	observe_info[observer_id].base_epoch = obs_align(get_rtc_epoch(), obs_period(observer_id));
 	
 	// Flag that we are doing Observe
 	observe_info[observer_id].obs_flag = 1;
+	obs_due_add(observer_id);
+	
+	// First notification is a CON
+	observe_info[observer_id].non_cnt = 0;
+	observe_info[observer_id].con_epoch = 0;
 	
 	// Set start sequence number (must be non-zero)
 	observe_info[observer_id].ack_seqno = 10;
+	obs_reg_retain();
 
 	// Set mNIC wake-up pin to HIGH, so that we can toggle it 0 -> 1
 	//pinMode(MNIC_WAKEUP_PIN,OUTPUT);
@@ -216,9 +598,13 @@ error_t coap_obs_reg()
 	
 	// Flag that we are doing Observe
 	observe_info[0].obs_flag = 1;
+	obs_due_add(0);
+	observe_info[0].non_cnt = 0;
+	observe_info[0].con_epoch = 0;
 	
 	// Set start sequence number (must be non-zero)
 	observe_info[0].ack_seqno = 10;
+	obs_reg_retain();
 
 	// Set mNIC wake-up pin to HIGH, so that we can toggle it 0 -> 1
 	pinMode(MNIC_WAKEUP_PIN,OUTPUT);
@@ -233,10 +619,12 @@ error_t coap_obs_dereg_sapi(uint8_t observer_id)
 {
 	// Flag that we are not doing Observe
 	observe_info[observer_id].obs_flag = 0;
+	obs_due_del(observer_id);
 	observe_info[observer_id].base_epoch = 0;
 	observe_info[observer_id].ack_seqno = 0;
+	obs_reg_retain();
 
-	dlog(LOG_DEBUG, "De-register Observe: %d", observer_id);
+	DLOG_DEBUG("De-register Observe: %d", observer_id);
 	return ERR_OK;
 
 }
@@ -247,15 +635,62 @@ error_t coap_obs_dereg()
 {
 	// Flag that we are not doing Observe
 	observe_info[0].obs_flag = 0;
+	obs_due_del(0);
+	obs_reg_retain();
 	
 	// Set mNIC wake-up pin to LOW
 	digitalWrite(MNIC_WAKEUP_PIN,LOW);
 
-	dlog(LOG_DEBUG, "De-register Observe: 0");
+	DLOG_DEBUG("De-register Observe: 0");
 	return ERR_OK;
 }
 
 
+// Take back the observers registered before a reset, see retain.h
+uint8_t coap_obs_restore()
+{
+	uint8_t n = 0;
+#if RETAIN
+	struct retain_reg rr[MAX_OBSERVERS];
+	observe_reg_info_t *o;
+	uint8_t i, j;
+
+	obs_retain_on = 1;
+	if (retain_get(RETAIN_REG, rr, sizeof(rr)))
+	{
+		for (i = 0; i < MAX_OBSERVERS; i++)
+		{
+			rr[i].obs_uri[sizeof(rr[i].obs_uri) - 1] = '\0';
+			for (j = 0; j < observe_info_index && rr[i].obs_uri[0]; j++)
+			{
+				o = &observe_info[j];
+				if (o->obs_flag || strcmp(o->obs_uri, rr[i].obs_uri))
+				{
+					continue;
+				}
+				o->frequency = rr[i].frequency;
+				o->con_every_n = rr[i].con_every_n;
+				o->con_every_s = rr[i].con_every_s;
+				o->cf = rr[i].cf;
+				(void)coap_obs_reg_sapi(j);
+				
+				// The RTC started over, what's left of the period is lost: one
+				// now, a CON, then every period. The sequence goes on.
+				o->base_epoch = get_rtc_epoch() - obs_period(j);
+				o->ack_seqno = rr[i].ack_seqno;
+				obs_due_add(j);
+				n++;
+				break;
+			}
+		}
+		DLOG_INFO("Restored %d observers", n);
+	}
+	obs_reg_retain();
+#endif
+	return n;
+}
+
+
 /*
  * Handle CoAP ACK received.
  */
@@ -265,11 +700,93 @@ error_t observe_rx_ack(void *cbctx, struct mbuf *m)
 	uint32_t seq_number = *((uint32_t *)cbctx);
 	seq_number++;
 	*((uint32_t *)cbctx) = seq_number;
+	obs_reg_retain();
+	
+	/* More queued, the milli nic that acked is awake for the next poll */
+	if (obs_q_head())
+	{
+		obs_q_wake(0);
+	}
 	
 	return ERR_OK;
 }
 
 
+#if HSHRINK
+// The Content-Format of a compressed payload of this one, 0 if it has none
+static uint8_t obs_compress_cf(uint8_t cf)
+{
+	switch (cf)
+	{
+	case COAP_CF_CSV:
+		return COAP_CF_CSV_HSHRINK;
+	case COAP_CF_APPLICATION_CBOR:
+		return COAP_CF_CBOR_HSHRINK;
+	}
+	return 0;
+}
+#endif
+
+
+// Observe option of a notification: delta 6 from the token, 3 byte value
+#define OBS_TPL_OBSERVE		((COAP_OPTION_OBSERVE << 4) | 3)
+
+
+// Keep the header of a notification just built as the observer's template
+static void obs_tpl_take(uint8_t observer_id, const struct coap_msg_ctx *rsp)
+{
+	struct obs_tpl *t = &obs_tpl[observer_id];
+	uint16_t len = m_pktlen(rsp->msg) - rsp->plen;
+
+	t->len = 0;
+	if (len > sizeof(t->hdr) || len > rsp->msg->len ||
+		len < 4 + rsp->tkl + 4 || mtod(rsp->msg, uint8_t *)[4 + rsp->tkl] != OBS_TPL_OBSERVE)
+	{
+		return;
+	}
+	memcpy(t->hdr, mtod(rsp->msg, uint8_t *), len);
+	t->cf = rsp->cf;
+	t->max_age = coap_max_age_in_seconds;
+	t->len = len;
+}
+
+
+/*
+ * The notification's header from the observer's template, in front of the
+ * payload, if it has one that still fits. 1 if so.
+ */
+static uint8_t obs_tpl_put(uint8_t observer_id, struct coap_msg_ctx *rsp)
+{
+	struct obs_tpl *t = &obs_tpl[observer_id];
+	uint32_t seq;
+	struct mbuf *n;
+	uint8_t *h;
+
+	if (!t->len || !rsp->plen || t->cf != rsp->cf || t->max_age != coap_max_age_in_seconds ||
+		(t->hdr[0] & 0x0F) != rsp->tkl || memcmp(t->hdr + 4, rsp->token, rsp->tkl))
+	{
+		return 0;
+	}
+	n = m_prepend(rsp->msg, t->len);
+	if (!n)
+	{
+		return 0;
+	}
+	rsp->msg = n;
+	h = mtod(n, uint8_t *);
+	memcpy(h, t->hdr, t->len);
+	h[0] = COAP_VER | COAP_T_VAL2PDU(rsp->type) | rsp->tkl;
+	h[2] = rsp->mid >> 8;
+	h[3] = rsp->mid & 0xFF;
+	seq = get_obs_val();
+	h += 4 + rsp->tkl + 1;
+	h[0] = seq >> 16;
+	h[1] = seq >> 8;
+	h[2] = seq;
+	return 1;
+}
+
+
 // Generate Observe response message
 /*
  * Find the correct entry in the obs array. If not present, just return.
@@ -277,35 +794,28 @@ error_t observe_rx_ack(void *cbctx, struct mbuf *m)
  * Initialize the context.
  * Set the RSP type to CON.
  * Set the code and plen, if required.
- * coap_msg_response() to build a response.
+ * The header from the observer's template, or coap_msg_response() to
+ * build it and keep it as the template.
  * Register for callback when ACK received.
- * Set pending_rsp, freeing any existing one first.
+ * Queue it for the proxy, alarms ahead.
  */
-error_t coap_observe_rsp(uint8_t observer_id)
+static error_t coap_observe_send(uint8_t observer_id, uint8_t alarm)
 {
 	struct coap_msg_ctx rsp;
     coap_ack_cb_info_t 	cbi;			// Callback info
     uint8_t 			len = 0;		// Message length
-    uint8_t 			nxt = 0;		// The next observer
     struct mbuf *		m = NULL;		// Observe response message
     struct optlv 		opt;
     error_t 			rc = ERR_OK;
 
-	// Safety check. If a message is already in progress do nothing.
-    if (pending_rsp) 
-	{
-		dlog(LOG_DEBUG, "coap_observe_rsp: Pending response in progress - skipping new notification");
-		return ERR_INPROGRESS;
-    }
-	
 	// Clear CoAP response message
 	memset(&rsp, 0, sizeof(rsp));
 	
 	// Get token from observers (obs) table
-	rc = get_obs_by_uri(observe_info[observer_id].obs_uri, &(rsp.tkl), rsp.token, &(rsp.client), &nxt);
+	rc = get_obs_by_id(observer_id, observe_info[observer_id].obs_uri, &(rsp.tkl), rsp.token, &(rsp.client));
     if (rc)
     {
-        dlog(LOG_ERR, "get_obs_by_uri failed: %s", observe_info[observer_id].obs_uri);
+        DLOG_ERR("get_obs_by_id failed: %s", observe_info[observer_id].obs_uri);
         return ERR_NO_ENTRY;
     }
     
@@ -321,7 +831,7 @@ error_t coap_observe_rsp(uint8_t observer_id)
     }
 	
     /* Allow room for CoAP header */
-    m_prepend(m, COAP_OBS_HDR_SZ);
+    m_reserve(m, COAP_RSP_HEADROOM);
 
     // Ask sensor code for a reading (that is read the sensor and return a CoAP response.
 	if (is_sapi == 1)
@@ -339,84 +849,106 @@ error_t coap_observe_rsp(uint8_t observer_id)
         goto error;
     }
 
-    /* Move payload up to start of buffer, enough space to pre-pend l8r. */
-    m_adj( m, COAP_OBS_HDR_SZ );
     rsp.msg = m;
 	
 	// Add Message ID
     rsp.mid = get_mid_val();
 
-	// Add Observe option
-	opt.ot = COAP_OPTION_OBSERVE;
-	opt.ol = 3;
-	if (copt_add_opt((sl_co*)&(rsp.oh), &opt) != ERR_OK) 
-	{
-		dlog(LOG_ERR, "Couldn't add Observe option");
-		rc = ERR_NO_MEM;
-		goto error;
-	}
-
-	// Add Max-Age option
-	opt.ot = COAP_OPTION_MAXAGE;
-	opt.ol = 4;
-	if (copt_add_opt((sl_co*)&(rsp.oh), &opt) != ERR_OK) 
-	{
-		dlog(LOG_ERR, "Couldn't add Max-Age option");
-		rc = ERR_NO_MEM;
-		goto error;
-	}
-
     /*
      * Now get the content. Does the m_append to the mbuf.
      */
-	rsp.plen = m->m_pktlen; /* payload includes type and length */
+	rsp.cf = observe_info[observer_id].cf;
+#if HSHRINK
+	if (observe_info[observer_id].compress && obs_compress_cf(rsp.cf) && hshrink_mbuf(m))
+	{
+		rsp.cf = obs_compress_cf(rsp.cf);
+	}
+#endif
+	rsp.plen = m_pktlen(m); /* payload includes type and length */
     rsp.code = COAP_RSP_205_CONTENT;
-	rsp.cf = COAP_CF_CSV;
-    rsp.type = COAP_T_NCONF_VAL; // TODO: CON or NON?
+    rsp.type = obs_con_due(observer_id, alarm) ? COAP_T_CONF_VAL : COAP_T_NCONF_VAL;
 
     /*
      * Build actual CoAP response message. Will be sent over HDLC link later.
+     * The header is the template's when it still fits, else built in full
+     * and kept as the template for the next.
      */
-    if (coap_msg_response(&rsp) != ERR_OK) 
+    if (!obs_tpl_put(observer_id, &rsp))
 	{
-        dlog(LOG_ERR, "coap_observe_rsp: Error creating response");
-        //m_free(m);
-        goto error;
-    }
+		// Add Observe option
+		opt.ot = COAP_OPTION_OBSERVE;
+		opt.ol = 3;
+		if (copt_add_opt((sl_co*)&(rsp.oh), &opt) != ERR_OK) 
+		{
+			DLOG_ERR("Couldn't add Observe option");
+			rc = ERR_NO_MEM;
+			goto error;
+		}
+
+		// Add Max-Age option
+		opt.ot = COAP_OPTION_MAXAGE;
+		opt.ol = 4;
+		if (copt_add_opt((sl_co*)&(rsp.oh), &opt) != ERR_OK) 
+		{
+			DLOG_ERR("Couldn't add Max-Age option");
+			rc = ERR_NO_MEM;
+			goto error;
+		}
+
+		if (coap_msg_response(&rsp) != ERR_OK) 
+		{
+			DLOG_ERR("coap_observe_rsp: Error creating response");
+			//m_free(m);
+			goto error;
+		}
+		obs_tpl_take(observer_id, &rsp);
+	}
 
     /*
      * Record the next sequence number we'll use for notification.
 	 * When acked, we'll ack this number, indicating that's what next.
+	 * Only a CON gets an ACK.
      */
-    cbi.cbctx = (void *) &observe_info[observer_id].ack_seqno;
-    
-    /*
-     * Set callback and register for notification of ACK.
-     */
-    cbi.cb = observe_rx_ack;
-    coap_con_add(rsp.mid, &cbi);
+    if (rsp.type == COAP_T_CONF_VAL)
+	{
+	    cbi.cbctx = (void *) &observe_info[observer_id].ack_seqno;
+	    
+	    /*
+	     * Set callback and register for notification of ACK.
+	     */
+	    cbi.cb = observe_rx_ack;
+	    coap_con_add(rsp.mid, &cbi, rsp.msg, observer_id);
+	}
 
     /*
-     * If shared transfer buffer has prior response than free it and post the new response.
+     * Queue for the next poll, replacing an unsent one for this observer.
      */
-    if (pending_rsp) 
+    m = rsp.msg;
+    if ((rc = obs_q_add(m, observer_id, alarm)) != ERR_OK) 
 	{
-        m_free(pending_rsp);
-		dlog(LOG_DEBUG, "%s:%d Cleared pending_rsp", __FUNCTION__, __LINE__);
+        goto error;
     }
-    pending_rsp = rsp.msg;
     copt_del_all((sl_co*)&(rsp.oh));
 
-	/* Notify milli nic of observe request, wait for 1ms, then high again */
-	digitalWrite(MNIC_WAKEUP_PIN,LOW);
-	delay(1);
-	digitalWrite(MNIC_WAKEUP_PIN,HIGH);
+	/* Notify milli nic of observe request, with the others queued */
+	obs_q_wake(alarm);
     return ERR_OK;
 
 error:
     copt_del_all((sl_co*)&(rsp.oh));
-    dlog(LOG_DEBUG, "coap_observe_rsp: free response mbuf on error");
+    DLOG_DEBUG("coap_observe_rsp: free response mbuf on error");
     m_free(m);
     return rc;
 }
 
+
+error_t coap_observe_rsp(uint8_t observer_id)
+{
+	return coap_observe_send(observer_id, 0);
+}
+
+
+error_t coap_observe_alarm(uint8_t observer_id)
+{
+	return coap_observe_send(observer_id, 1);
+}
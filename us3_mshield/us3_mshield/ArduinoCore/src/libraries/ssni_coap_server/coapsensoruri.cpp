@@ -36,6 +36,15 @@ Networks, Inc.
 #include "coapobserve.h"
 #include "coapsensorobs.h"
 #include "arduino_time.h"
+#include "mbpoll.h"
+#include "sched.h"
+#include "duty.h"
+#include "trace.h"
+#include "reqlat.h"
+#include "pace.h"
+#include "cpuload.h"
+#include "crash.h"
+#include "fw.h"
 
 
 /*! @brief
@@ -50,11 +59,19 @@ struct coap_stats coap_stats;
 
 
 // System handler forwards
-static error_t crtitle(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp);
+static error_t crtitle(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, void *it);
 
-static error_t crwellknown(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp);
+static error_t crwellknown(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, void *it);
 
-static error_t crsystem(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp);
+static error_t crsystem(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, void *it);
+
+static error_t crsystem_time(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, void *it);
+
+static error_t crsystem_stats(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, void *it);
+
+static error_t crsystem_trace(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, void *it);
+
+static error_t crclassifier(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, void *it);
 
 // Dispatcher implemented in the "Sketch"
 error_t crarduino( struct coap_msg_ctx *req, struct coap_msg_ctx *rsp );
@@ -65,6 +82,12 @@ error_t crsapi( struct coap_msg_ctx *req, struct coap_msg_ctx *rsp );
 // Sensor API flag. Is 1 id using SAPI.
 extern uint8_t is_sapi;
 
+// Read stats of a SAPI sensor, 0 past the last one
+uint8_t sapi_read_stats(uint8_t sensor_id, struct coap_sens_stats *ss);
+
+// Timed relay commands of SAPI, "/sys/relay"
+error_t sapi_relay_rsp(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, void *it);
+
 
 /* CoRE Link Attributes - RFC 6690 
  * Resource Type 'rt' Attribute - 
@@ -84,32 +107,29 @@ extern uint8_t is_sapi;
 #define S_URI_SYSTEM			"sys"
 #define S_TIME_URI				"time"
 #define S_STAT_URI              "stats"
+#define S_FW_URI                "fw"
+#define S_CRASH_URI             "crash"
+#define S_RELAY_URI             "relay"
+#define S_TRACE_URI             "trace"
+#define S_TRACE_URI_Q_FROM      "n="
 
 #define S_STAT_URI_Q_MODULE     "mod"
 #define S_STAT_URI_Q_MOD_COAP   S_STAT_URI_Q_MODULE "=coap"
 #define S_STAT_URI_Q_MOD_PWR    S_STAT_URI_Q_MODULE "=pwr"
 #define S_STAT_URI_Q_MOD_HDLC   S_STAT_URI_Q_MODULE "=hdlc"
+#define S_STAT_URI_Q_MOD_MEM    S_STAT_URI_Q_MODULE "=mem"
+#define S_STAT_URI_Q_MOD_SENS   S_STAT_URI_Q_MODULE "=sens"
+#define S_STAT_URI_Q_MOD_MODBUS S_STAT_URI_Q_MODULE "=modbus"
+#define S_STAT_URI_Q_MOD_TASK   S_STAT_URI_Q_MODULE "=task"
+#define S_STAT_URI_Q_MOD_LAT    S_STAT_URI_Q_MODULE "=lat"
+#define S_STAT_URI_Q_MOD_SLOW   S_STAT_URI_Q_MODULE "=slow"
+#define S_STAT_URI_Q_MOD_PACE   S_STAT_URI_Q_MODULE "=pace"
+#define S_STAT_URI_Q_MOD_LOAD   S_STAT_URI_Q_MODULE "=load"
 
 #define CLA_SYSTEM  "if=" "\"" S_URI_SYSTEM "\"" ";title=\"System\";ct=42;rev=1;"
 #define CLA_ARDUINO   "if=" "\"" DEFAULT_CLASSIFIER "\"" ";title=\"Arduino Sensors\";ct=42;"
 
 
-// Table for the CoAP handler registry. Specific to this CoAP Server and Device.
-// Note: We need only one sensor call back slot as we use a two level dispatching scheme.
-//       First level is a <classifier> (e.g. "arduino")
-//       Second level is a sensor resource (e.g. "temp")
-//       If you add handlers for additional classifiers than you will need to add space table slots.
-#define COAP_N_BASE_CBR		(2)
-#define COAP_N_SYS_CBR		(1)
-#define COAP_N_SENSOR_CBR	(1)
-
-#define COAP_MAX_CBR        (COAP_N_BASE_CBR + COAP_N_SYS_CBR + COAP_N_SENSOR_CBR)
-
-
-struct coap_cb_reg coap_registry[COAP_MAX_CBR];
-static int		coap_reg_size = 0;
-
-
 // URL Classifier
 char			classifier[CLASSIFIER_MAX_LEN] = DEFAULT_CLASSIFIER;
 
@@ -117,91 +137,97 @@ char			classifier[CLASSIFIER_MAX_LEN] = DEFAULT_CLASSIFIER;
 extern RTCZero	rtc;
 
 
-error_t coap_uri_register(const char *path, coap_cb cbfunc, const char *corelink)
-{
-    int idx;
+#define COAP_URI_NSUB(t)    (sizeof(t) / sizeof((t)[0]))
 
-    if (coap_reg_size < COAP_MAX_CBR)
-	{
-        idx = coap_reg_size++;    
-    }
-	else
-	{
-        return ERR_NO_MEM;
-    }
-    
-    coap_registry[idx].path = path;
-    coap_registry[idx].cb = cbfunc;
-    coap_registry[idx].link = corelink;
-    
-    return ERR_OK;
-}
+// Resource tree, fixed at compile time. The classifier segment is matched
+// against the runtime classifier string.
+static const struct coap_uri_node coap_uri_sys[] = {
+    { S_TIME_URI, crsystem_time, NULL, NULL, 0, 0 },
+    { S_STAT_URI, crsystem_stats, NULL, NULL, 0, 0 },
+    { S_FW_URI, fw_rsp, NULL, NULL, 0, 0 },
+    { S_CRASH_URI, crash_rsp, NULL, NULL, 0, 0 },
+    { S_RELAY_URI, sapi_relay_rsp, NULL, NULL, 0, 0 },
+    { S_TRACE_URI, crsystem_trace, NULL, NULL, 0, 0 },
+};
 
+static const struct coap_uri_node coap_uri_wellknown[] = {
+    { "core", crwellknown, NULL, NULL, 0, 0 },
+};
 
-// Initialize the CoAP registry
-void coap_registry_init()
-{
-	/* Clear the registry */
-	coap_reg_size = 0;
-
+static const struct coap_uri_node coap_uri_top[] = {
     /* mandatory elements */
-    (void)coap_uri_register("", crtitle, "title=\"Info\";ct=0");
-    (void)coap_uri_register(".well-known", crwellknown, NULL);
+    { "", crtitle, NULL, NULL, 0, 0 },
+    { ".well-known", NULL, NULL, coap_uri_wellknown, COAP_URI_NSUB(coap_uri_wellknown), 0 },
 
     /* basic resources from the NIC */
-    (void)coap_uri_register(S_URI_SYSTEM, crsystem, CLA_SYSTEM);
-	
-	/*
-	* Since coap_s_uri_proc only matches on the first path option, and it's
-	* against the whole path, registering L_URI_LOGISTICS guarantees a match
-	* or that URI, and its children. Putting it first means it's found faster.
-	* We will never match the subsequent L_URI_LOGISTICS paths due to the
-	* separation of the options but the concatenation of the path.
-	* TODO Optimize this so that only one URI is required to be registered
-	* while satisfying .well-known/core discovery.
-	*/
-	if (is_sapi == 1)
-	{
-		(void)coap_uri_register(classifier, crsapi, CLA_ARDUINO);
-	}
-	else
-	{
-		(void)coap_uri_register(classifier, crarduino, CLA_ARDUINO);
-	}
+    { S_URI_SYSTEM, crsystem, CLA_SYSTEM, coap_uri_sys, COAP_URI_NSUB(coap_uri_sys), 1 },
+
+    /* sensors, second level dispatch is up to crsapi/crarduino */
+    { classifier, crclassifier, CLA_ARDUINO, NULL, 0, 0 },
+};
+
+static const struct coap_uri_node coap_uri_root = {
+    NULL, crtitle, NULL, coap_uri_top, COAP_URI_NSUB(coap_uri_top), 0
+};
+
+
+// Find the child of n matching Uri-Path option op, length first
+static const struct coap_uri_node *
+coap_uri_child(const struct coap_uri_node *n, const struct optlv *op)
+{
+    const struct coap_uri_node *c;
+    uint8_t i;
+
+    for (i = 0; i < n->nsub; i++)
+    {
+        c = &n->sub[i];
+        if (strlen(c->seg) == op->ol && !memcmp(c->seg, op->ov, op->ol))
+        {
+            return c;
+        }
+    }
+    return NULL;
 }
 
 
-// CoAP Dispatcher. Dispatch request to registered handler
+// CoAP Dispatcher. Dispatch request to the handler of the deepest node
+// its Uri-Path matches, in one pass over the path options.
 error_t coap_s_uri_proc(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp)
 {
-    int i;
-    int rs = sizeof(coap_registry) / sizeof (coap_registry[0]);
+    const struct coap_uri_node *n = &coap_uri_root;
+    const struct coap_uri_node *c;
+    uint8_t noobs = 0;
+    void *it = NULL;
+    void *next;
     error_t rc;
     struct optlv *op;
 
-    if ((op = copt_get_next_opt_type((const sl_co*)&(req->oh), COAP_OPTION_URI_PATH, NULL)) == NULL) 
-	{
-        i = 0;
-    } 
-	else 
-	{
-        for (i = 0; i < rs; i++) 
-		{
-            if (!coap_opt_strcmp(op, coap_registry[i].path)) 
-			{
-                break;
-            }
+    for (;;)
+    {
+        next = it;
+        op = copt_get_next_opt_type((const sl_co*)&(req->oh), COAP_OPTION_URI_PATH, &next);
+        if (!op || !(c = coap_uri_child(n, op)))
+        {
+            break;
         }
+        n = c;
+        it = next;
+        noobs |= n->noobs;
     }
-    
-    if (i == rs) 
+
+    if (!n->cb) 
 	{
         /* no match found */
         rsp->code = COAP_RSP_404_NOT_FOUND;
         goto done;
     }
 
-    rc = coap_registry[i].cb(req, rsp);
+    if (noobs)
+    {
+        copt_del_opt_type((sl_co*)&(rsp->oh), COAP_OPTION_OBSERVE);
+    }
+
+    rc = n->cb(req, rsp, it);
 
     if (rc != ERR_OK) 
 	{
@@ -235,7 +261,7 @@ done:
 
 
 // crtitle. Handles "/{prefix}". For example "/snsr".
-static error_t crtitle(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp)
+static error_t crtitle(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, void *it)
 {
     if (req->code == COAP_REQUEST_GET)
 	{
@@ -267,61 +293,140 @@ static error_t crtitle(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp)
 }
 
 
-static error_t crwellknown(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp)
+// .well-known/core document, rendered from the resource tree by
+// coap_uri_links_update. -1 while it needs rendering.
+static char coap_links[COAP_LINKS_MAX_LEN];
+static int16_t coap_links_len = -1;
+
+
+// Render "</path>;link," for n and every node below it that has a link, at
+// buf[*k]. path holds the nodes above n.
+static error_t coap_uri_links(char *buf, int *k, const struct coap_uri_node **path, 
+                              uint8_t depth, const struct coap_uri_node *n)
 {
-    int i;
-    int rs = coap_reg_size; //sizeof(coap_registry) / sizeof (coap_registry[0]);
-    char *ls;
-    struct optlv *op;
-    int n, m, len;
-    struct coap_cb_reg *cr;
-    void *it = NULL;
+    uint8_t i;
+    int len;
+    error_t rc;
+
+    path[depth++] = n;
+    if (n->link) {
+        len = 3 + strlen(n->link) + 1;      /* adding < > ; , */
+        for (i = 0; i < depth; i++) {
+            len += 1 + strlen(path[i]->seg); /* / */
+        }
+        if (*k + len > COAP_LINKS_MAX_LEN) {
+            return ERR_NO_MEM;
+        }
+
+        buf[(*k)++] = '<';
+        for (i = 0; i < depth; i++) {
+            buf[(*k)++] = '/';
+            memcpy(&(buf[*k]), path[i]->seg, strlen(path[i]->seg));
+            *k += strlen(path[i]->seg);
+        }
+        buf[(*k)++] = '>';
+        buf[(*k)++] = ';';
+        memcpy(&(buf[*k]), n->link, strlen(n->link));
+        *k += strlen(n->link);
+        buf[(*k)++] = ',';
+        /* no NUL terminator here */
+    }
+
+    if (depth < COAP_URI_DEPTH_MAX) {
+        for (i = 0; i < n->nsub; i++) {
+            if ((rc = coap_uri_links(buf, k, path, depth, &n->sub[i]))) {
+                return rc;
+            }
+        }
+    }
+    return ERR_OK;
+}
+
+
+// Render the .well-known/core document. The tree is fixed but the classifier
+// segment isn't, so call again after it changes.
+error_t coap_uri_links_update(void)
+{
+    const struct coap_uri_node *path[COAP_URI_DEPTH_MAX];
+    uint8_t i;
+    int k = 0;
+
+    coap_links_len = -1;
+    for (i = 0; i < coap_uri_root.nsub; i++) {
+        if (coap_uri_links(coap_links, &k, path, 0, &coap_uri_root.sub[i])) {
+            DLOG_ERR("Link format over %d bytes", COAP_LINKS_MAX_LEN);
+            return ERR_NO_MEM;
+        }
+    }
+    coap_links_len = k;
+    return ERR_OK;
+}
+
+
+// crwellknown. Handles "/.well-known/core", a copy of the rendered document,
+// block-wise (Block2) if it doesn't fit one message.
+static error_t crwellknown(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, void *it)
+{
+    struct coap_block blk = { 0, 0, COAP_BLOCK_SZX_MAX };
+    uint32_t off;
+    uint16_t size;
+    uint8_t szx;
+    int blkopt;
+    int len;
+    char *d;
 
     rsp->code = 0;  /* unknown yet - fill in below */
     if (req->code == COAP_REQUEST_GET) {
-        /* confirm we have two Uri-Path elements, not less, not more */
-        /* the first one is .well-known, second one must be 'core'   */
-        if (!copt_get_next_opt_type((const sl_co*)&(req->oh), COAP_OPTION_URI_PATH, &it)    || 
-            !(op = 
-                copt_get_next_opt_type((const sl_co*)&(req->oh), COAP_OPTION_URI_PATH, &it)) ||
-            coap_opt_strcmp(op, "core")                                      ||
-            copt_get_next_opt_type((const sl_co*)&(req->oh), COAP_OPTION_URI_PATH, &it)) {
-        
+        /* nothing may follow .well-known/core */
+        if (copt_get_next_opt_type((const sl_co*)&(req->oh), COAP_OPTION_URI_PATH, &it)) {
             rsp->code = COAP_RSP_404_NOT_FOUND;
             return ERR_FAIL;
         }
+        if (coap_links_len < 0 && coap_uri_links_update()) {
+            rsp->code = COAP_RSP_500_INTERNAL_ERROR;
+            return ERR_FAIL;
+        }
+        if ((blkopt = coap_block_get(req, COAP_OPTION_BLOCK2, &blk)) < 0) {
+            rsp->code = COAP_RSP_400_BAD_REQUEST;
+            return ERR_OK;
+        }
 
-        for (i = 2; i < rs; i++) {  /* skipping default and well-known */
-            cr = coap_registry + i;
-            len = strlen(cr->path) + 4;         /* adding </ > , */
-            if (cr->link) {
-                len += strlen(cr->link) + 1;    /* ; */
+        /* smaller blocks than asked for if they don't fit a message */
+        szx = coap_block_szx(blk.szx);
+        size = COAP_BLOCK_SIZE(szx);
+        if (blkopt || coap_links_len > size) {
+            blk.num <<= blk.szx - szx;
+            blk.szx = szx;
+            off = blk.num * size;
+            if (off >= (uint32_t)coap_links_len && blk.num) {
+                rsp->code = COAP_RSP_402_BAD_OPTION;
+                return ERR_OK;
+            }
+            len = coap_links_len - off;
+            blk.m = len > size;
+            if (blk.m) {
+                len = size;
             }
-            
-            ls = (char*) m_append(rsp->msg, len);
-            if (!ls) {
-                coap_stats.no_mbufs++;
+            if (coap_block_set(rsp, COAP_OPTION_BLOCK2, &blk) != ERR_OK) {
                 rsp->code = COAP_RSP_500_INTERNAL_ERROR;
                 return ERR_FAIL;
             }
+        } else {
+            off = 0;
+            len = coap_links_len;
+        }
 
-            n = 2;
-            memcpy(ls, "</", n);
-            m = strlen(cr->path);
-            memcpy(&(ls[n]), cr->path, m);
-            n += m;
-            ls[n++] = '>';
-            if (cr->link) {
-                ls[n++] = ';';
-                memcpy(&(ls[n]), cr->link, strlen(cr->link));
-            }
-            ls[len-1] = ',';
-            /* no NUL terminator here */
-            rsp->code = COAP_RSP_205_CONTENT;
+        d = (char*) m_append(rsp->msg, len);
+        if (!d) {
+            coap_stats.no_mbufs++;
+            rsp->code = COAP_RSP_500_INTERNAL_ERROR;
+            return ERR_FAIL;
         }
+        memcpy(d, &coap_links[off], len);
+        rsp->code = COAP_RSP_205_CONTENT;
 
         rsp->cf = COAP_CF_APPLICATION_LINK_FORMAT; /* application/link-format */
-        rsp->plen = rsp->msg->m_pktlen;
+        rsp->plen = len;
     }
     else {
         rsp->code = COAP_RSP_501_NOT_IMPLEMENTED;
@@ -351,7 +456,7 @@ static error_t crsystem_time(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp,
         int len;
 		
 		now = get_rtc_epoch();
-		dlog(LOG_DEBUG, "Epoch for GET of sys time: %08x", now);
+		DLOG_DEBUG("Epoch for GET of sys time: %08x", now);
         now = htonl(now);
         len = sizeof(now);
         d = m_append(rsp->msg, len);
@@ -369,10 +474,10 @@ static error_t crsystem_time(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp,
 	{
         m_adj(req->msg, req->hdrlen);
         coap_sys_time_data_t *td = mtod(req->msg, coap_sys_time_data_t *);
-        //ddump(LOG_DEBUG, "PUT /sys/time Payload", (void *)td, sizeof(coap_sys_time_data_t));
+        //DDUMP_DEBUG("PUT /sys/time Payload", (void *)td, sizeof(coap_sys_time_data_t));
 
         /* Ensure type and length correct */
-        if ((req->msg->m_pktlen == 0) || ((td->tl.u.rdt != crdt_time_abs) && (td->tl.u.rdt != crdt_time_delta)) || 
+        if ((m_pktlen(req->msg) == 0) || ((td->tl.u.rdt != crdt_time_abs) && (td->tl.u.rdt != crdt_time_delta)) || 
             (td->tl.l != (sizeof(coap_sys_time_data_t) - sizeof(coap_sens_tl_t))))
 		{
             rsp->code = COAP_RSP_406_NOT_ACCEPTABLE;
@@ -382,15 +487,15 @@ static error_t crsystem_time(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp,
 			uint32_t epoch;
 			
 			// Expect UTC time
-			ddump(LOG_DEBUG, "PUT /sys/time Payload", (void *)td, sizeof(coap_sys_time_data_t));
+			DDUMP_DEBUG("PUT /sys/time Payload", (void *)td, sizeof(coap_sys_time_data_t));
 			//#ifdef _ATMEL_BIGENDIAN_
 			epoch = (uint32_t) ntohl(td->sec);
 			//#else
 			//epoch = bswap32(td->sec);
 			//#endif 
-			dlog(LOG_DEBUG, "Setting RTC to epoch: %08x", epoch);
+			DLOG_DEBUG("Setting RTC to epoch: %08x", epoch);
 			
-			rtc.setEpoch(epoch);
+			set_rtc_epoch(epoch);
 			
 			print_current_date();
 			print_current_time();
@@ -435,6 +540,344 @@ static error_t coap_get_coap_stats(struct mbuf *m, uint8_t *len)
 }
 
 
+/*
+ * Get the HDLC link stats, with TLV.
+ */
+static error_t coap_get_hdlc_stats(struct mbuf *m, uint8_t *len)
+{
+    uint32_t *w;
+    uint8_t i;
+
+    coap_sys_hdlc_stats_t *d = (coap_sys_hdlc_stats_t *) m_append(m, sizeof(coap_sys_hdlc_stats_t));
+    if (!d) {
+        coap_stats.no_mbufs++;
+        return ERR_NO_MEM;
+    }
+    d->tl.u.rdt = crdt_stat_hdlc;
+    d->tl.l = sizeof(d->hs);
+    hdlc_get_stats(&d->hs);
+
+    /* all 32 bit counters */
+    w = (uint32_t *) &d->hs;
+    for (i = 0; i < sizeof(d->hs) / sizeof(uint32_t); i++) {
+        w[i] = htonl(w[i]);
+    }
+    *len = sizeof(*d);
+
+    return ERR_OK;
+}
+
+
+/*
+ * Get the memory high-water marks, with TLV.
+ */
+static error_t coap_get_mem_stats(struct mbuf *m, uint8_t *len)
+{
+    coap_sys_mem_stats_t *d = (coap_sys_mem_stats_t *) m_append(m, sizeof(coap_sys_mem_stats_t));
+    if (!d) {
+        coap_stats.no_mbufs++;
+        return ERR_NO_MEM;
+    }
+    d->tl.u.rdt = crdt_stat_mem;
+    d->tl.l = sizeof(d->ms);
+    d->ms.stack_used = htonl(mem_stack_used());
+    d->ms.free_min = htonl(mem_free_min());
+    d->ms.mbuf_big_cnt = htonl(MBUF_POOL_BIG_CNT);
+    d->ms.mbuf_big_peak = htonl(m_pool_peak(1));
+    d->ms.mbuf_small_cnt = htonl(MBUF_POOL_SMALL_CNT);
+    d->ms.mbuf_small_peak = htonl(m_pool_peak(0));
+    d->ms.mbuf_empty = htonl(pool_empty_cnt);
+    d->ms.opt_max = htonl(COAP_OPT_MAX);
+    d->ms.opt_peak = htonl(copt_peak());
+    d->ms.scratch_size = htonl(SCRATCH_SIZE);
+    d->ms.scratch_peak = htonl(scratch_peak());
+    *len = sizeof(*d);
+
+    return ERR_OK;
+}
+
+
+/*
+ * Get the read stats of the SAPI sensors, a TLV each. As many as fit
+ * the response, by sensor id.
+ */
+static error_t coap_get_sens_stats(struct mbuf *m, uint8_t *len)
+{
+    struct coap_sens_stats ss;
+    coap_sys_sens_stats_t *d;
+    uint32_t *w;
+    uint8_t id, i;
+
+    *len = 0;
+    for (id = 0; *len + sizeof(*d) <= 0xFF && sapi_read_stats(id, &ss); id++) {
+        d = (coap_sys_sens_stats_t *) m_append(m, sizeof(coap_sys_sens_stats_t));
+        if (!d) {
+            coap_stats.no_mbufs++;
+            return ERR_NO_MEM;
+        }
+        d->tl.u.rdt = crdt_stat_sens;
+        d->tl.l = sizeof(d->ss);
+
+        /* all 32 bit counters */
+        w = (uint32_t *) &ss;
+        for (i = 0; i < sizeof(ss) / sizeof(uint32_t); i++) {
+            w[i] = htonl(w[i]);
+        }
+        memcpy(&d->ss, &ss, sizeof(ss));
+        *len += sizeof(*d);
+    }
+
+    return ERR_OK;
+}
+
+
+/*
+ * Get the Modbus bus diagnostics, a TLV for the bus and one per polled
+ * slave. As many as fit the response.
+ */
+static error_t coap_get_modbus_stats(struct mbuf *m, uint8_t *len)
+{
+    static_assert(COAP_MODBUS_LAT_BINS == MB_LAT_BINS, "latency bins");
+    coap_sys_modbus_stats_t *d;
+    struct mb_stats st;
+    uint8_t slave;
+    uint8_t i, k;
+
+    *len = 0;
+    for (i = 0; *len + sizeof(*d) <= 0xFF && mb_poll_get_stats(i, &slave, &st); i++) {
+        d = (coap_sys_modbus_stats_t *) m_append(m, sizeof(coap_sys_modbus_stats_t));
+        if (!d) {
+            coap_stats.no_mbufs++;
+            return ERR_NO_MEM;
+        }
+        d->tl.u.rdt = crdt_stat_modbus;
+        d->tl.l = sizeof(d->mb);
+        d->mb.slave = htonl(slave);
+        d->mb.requests = htonl(st.requests);
+        d->mb.timeouts = htonl(st.timeouts);
+        d->mb.crc_errors = htonl(st.crc_errors);
+        d->mb.frame_errors = htonl(st.frame_errors);
+        d->mb.exceptions = htonl(st.exceptions);
+        d->mb.retries = htonl(st.retries);
+        for (k = 0; k < MB_LAT_BINS; k++) {
+            d->mb.latency[k] = htonl(st.latency[k]);
+        }
+        *len += sizeof(*d);
+    }
+
+    return ERR_OK;
+}
+
+
+/*
+ * Get the main loop task stats, a TLV per task, as many as fit the
+ * response. The longest runs and misses point at what holds up the loop.
+ */
+static error_t coap_get_task_stats(struct mbuf *m, uint8_t *len)
+{
+    const struct sched_task *t;
+    coap_sys_task_stats_t *d;
+    uint8_t i;
+
+    *len = 0;
+    for (i = 0; *len + sizeof(*d) <= 0xFF && (t = sched_get(i)); i++) {
+        d = (coap_sys_task_stats_t *) m_append(m, sizeof(coap_sys_task_stats_t));
+        if (!d) {
+            coap_stats.no_mbufs++;
+            return ERR_NO_MEM;
+        }
+        d->tl.u.rdt = crdt_stat_task;
+        d->tl.l = sizeof(d->ts);
+        memset(d->ts.name, 0, sizeof(d->ts.name));
+        strncpy(d->ts.name, t->name, sizeof(d->ts.name));
+        d->ts.runs = htonl(t->runs);
+        d->ts.max_us = htonl(t->max_us);
+        d->ts.late_ms = htonl(t->late_ms);
+        d->ts.misses = htonl(t->misses);
+        d->ts.budget_ms = htonl(t->budget_ms);
+        *len += sizeof(*d);
+    }
+
+    return ERR_OK;
+}
+
+
+#if DUTY
+/*
+ * Get the time in each run state, a TLV per state. The states add up to
+ * the time since boot or the last clear, idle and standby are the share
+ * the battery gets to rest.
+ */
+static error_t coap_get_pwr_stats(struct mbuf *m, uint8_t *len)
+{
+    coap_sys_duty_stats_t *d;
+    uint64_t ms;
+    uint8_t i;
+
+    *len = 0;
+    for (i = 0; i < DUTY_STATES; i++) {
+        d = (coap_sys_duty_stats_t *) m_append(m, sizeof(coap_sys_duty_stats_t));
+        if (!d) {
+            coap_stats.no_mbufs++;
+            return ERR_NO_MEM;
+        }
+        ms = duty_us(i) / 1000;
+        d->tl.u.rdt = crdt_stat_duty;
+        d->tl.l = sizeof(d->ds);
+        memset(d->ds.name, 0, sizeof(d->ds.name));
+        strncpy(d->ds.name, duty_name(i), sizeof(d->ds.name));
+        d->ds.time.s = htonl((uint32_t)(ms / 1000));
+        d->ds.time.ms = htonl((uint32_t)(ms % 1000));
+        d->ds.entries = htonl(duty_entries(i));
+        *len += sizeof(*d);
+    }
+
+    return ERR_OK;
+}
+#endif
+
+
+#if REQLAT
+STATIC_ASSERT(COAP_SLOW_STAGES == REQLAT_STAGES);
+
+/*
+ * Get the request latency of each stage and the total, a TLV each. A
+ * slow link stage is the HDLC side or the main loop, a slow handler the
+ * sensor.
+ */
+static error_t coap_get_lat_stats(struct mbuf *m, uint8_t *len)
+{
+    const struct reqlat_stage *st;
+    coap_sys_lat_stats_t *d;
+    uint8_t i;
+
+    *len = 0;
+    for (i = 0; (st = reqlat_get(i)); i++) {
+        d = (coap_sys_lat_stats_t *) m_append(m, sizeof(coap_sys_lat_stats_t));
+        if (!d) {
+            coap_stats.no_mbufs++;
+            return ERR_NO_MEM;
+        }
+        d->tl.u.rdt = crdt_stat_lat;
+        d->tl.l = sizeof(d->ls);
+        memset(d->ls.name, 0, sizeof(d->ls.name));
+        strncpy(d->ls.name, reqlat_name(i), sizeof(d->ls.name));
+        d->ls.count = htonl(st->count);
+        d->ls.min_us = htonl(st->min_us);
+        d->ls.avg_us = htonl(st->count ? (uint32_t)(st->sum_us / st->count) : 0);
+        d->ls.max_us = htonl(st->max_us);
+        *len += sizeof(*d);
+    }
+
+    return ERR_OK;
+}
+
+
+/*
+ * Get the slowest requests since boot or the last clear, slowest first,
+ * a TLV each with its path and stages.
+ */
+static error_t coap_get_slow_reqs(struct mbuf *m, uint8_t *len)
+{
+    const struct reqlat_req *r;
+    coap_sys_slow_req_t *d;
+    uint8_t i, k;
+
+    *len = 0;
+    for (i = 0; *len + sizeof(*d) <= 0xFF && (r = reqlat_slow(i)); i++) {
+        d = (coap_sys_slow_req_t *) m_append(m, sizeof(coap_sys_slow_req_t));
+        if (!d) {
+            coap_stats.no_mbufs++;
+            return ERR_NO_MEM;
+        }
+        d->tl.u.rdt = crdt_stat_slow;
+        d->tl.l = sizeof(d->sr);
+        memset(d->sr.path, 0, sizeof(d->sr.path));
+        strncpy(d->sr.path, r->path, sizeof(d->sr.path));
+        d->sr.age_s = htonl((millis() - r->ms) / 1000);
+        d->sr.total_us = htonl(r->total_us);
+        for (k = 0; k < COAP_SLOW_STAGES; k++) {
+            d->sr.stage_us[k] = htonl(r->stage_us[k]);
+        }
+        *len += sizeof(*d);
+    }
+
+    return ERR_OK;
+}
+#endif
+
+
+#if PACE
+/*
+ * Get the link pace, with the ACK round trip and the notifications held
+ * back that set it.
+ */
+static error_t coap_get_pace_stats(struct mbuf *m, uint8_t *len)
+{
+    const struct pace_stats *ps = pace_get();
+    coap_sys_pace_stats_t *d;
+
+    d = (coap_sys_pace_stats_t *) m_append(m, sizeof(coap_sys_pace_stats_t));
+    if (!d) {
+        coap_stats.no_mbufs++;
+        return ERR_NO_MEM;
+    }
+    memset(d, 0, sizeof(*d));
+    d->tl.u.rdt = crdt_stat_pace;
+    d->tl.l = sizeof(d->ps);
+    d->ps.level = ps->level;
+    d->ps.skip_pct = ps->skip_pct;
+    d->ps.srtt_ms = htonl(ps->srtt_ms);
+    d->ps.rtt_max_ms = htonl(ps->rtt_max_ms);
+    d->ps.acks = htonl(ps->acks);
+    d->ps.resends = htonl(ps->resends);
+    d->ps.sent = htonl(ps->sent);
+    d->ps.skipped = htonl(ps->skipped);
+    d->ps.changes = htonl(ps->changes);
+    *len = sizeof(*d);
+
+    return ERR_OK;
+}
+#endif
+
+
+#if CPULOAD
+/*
+ * Get the CPU load of the main loop, and its iteration times.
+ */
+static error_t coap_get_load_stats(struct mbuf *m, uint8_t *len)
+{
+    static_assert(COAP_LOAD_BINS == CPULOAD_BINS, "load bins");
+    struct cpuload_stats cs;
+    coap_sys_load_stats_t *d;
+    uint8_t k;
+
+    d = (coap_sys_load_stats_t *) m_append(m, sizeof(coap_sys_load_stats_t));
+    if (!d) {
+        coap_stats.no_mbufs++;
+        return ERR_NO_MEM;
+    }
+    cpuload_get(&cs);
+    memset(d, 0, sizeof(*d));
+    d->tl.u.rdt = crdt_stat_load;
+    d->tl.l = sizeof(d->ls);
+    d->ls.load_1s = htons(cs.load_1s);
+    d->ls.load_1m = htons(cs.load_1m);
+    d->ls.load_15m = htons(cs.load_15m);
+    d->ls.idle_ms = htonl(cs.idle_ms);
+    d->ls.busy_ms = htonl(cs.busy_ms);
+    d->ls.iters = htonl(cs.iters);
+    d->ls.iter_max_us = htonl(cs.iter_max_us);
+    for (k = 0; k < CPULOAD_BINS; k++) {
+        d->ls.hist[k] = htonl(cs.hist[k]);
+    }
+    *len = sizeof(*d);
+
+    return ERR_OK;
+}
+#endif
+
+
 /*
  * Return or set, the specified system stats.
  */
@@ -455,17 +898,62 @@ static error_t crsystem_stats(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp
         if (!coap_opt_strcmp(o, S_STAT_URI_Q_MOD_COAP)) {
             /* get CoAP stats */
             rc = coap_get_coap_stats(rsp->msg, &len);
+        } else if (!coap_opt_strcmp(o, S_STAT_URI_Q_MOD_HDLC)) {
+            /* get HDLC link stats */
+            rc = coap_get_hdlc_stats(rsp->msg, &len);
+        } else if (!coap_opt_strcmp(o, S_STAT_URI_Q_MOD_MEM)) {
+            /* get memory high-water marks */
+            rc = coap_get_mem_stats(rsp->msg, &len);
+        } else if (!coap_opt_strcmp(o, S_STAT_URI_Q_MOD_SENS)) {
+            /* get sensor read stats */
+            rc = coap_get_sens_stats(rsp->msg, &len);
+        } else if (!coap_opt_strcmp(o, S_STAT_URI_Q_MOD_MODBUS)) {
+            /* get Modbus bus diagnostics */
+            rc = coap_get_modbus_stats(rsp->msg, &len);
+        } else if (!coap_opt_strcmp(o, S_STAT_URI_Q_MOD_TASK)) {
+            /* get main loop task stats */
+            rc = coap_get_task_stats(rsp->msg, &len);
         } else if (!coap_opt_strcmp(o, S_STAT_URI_Q_MOD_PWR)) {
-            /* get power stats */
-            // TODO: Do we need this?
-            //rc = coap_get_pwr_stats(rsp->msg, &len);
+            /* get the time in each run state */
+#if DUTY
+            rc = coap_get_pwr_stats(rsp->msg, &len);
+#else
+            rc = ERR_INVAL;
+#endif
+        } else if (!coap_opt_strcmp(o, S_STAT_URI_Q_MOD_LAT)) {
+            /* get the request latency by stage */
+#if REQLAT
+            rc = coap_get_lat_stats(rsp->msg, &len);
+#else
             rc = ERR_INVAL;
+#endif
+        } else if (!coap_opt_strcmp(o, S_STAT_URI_Q_MOD_SLOW)) {
+            /* get the slowest requests */
+#if REQLAT
+            rc = coap_get_slow_reqs(rsp->msg, &len);
+#else
+            rc = ERR_INVAL;
+#endif
+        } else if (!coap_opt_strcmp(o, S_STAT_URI_Q_MOD_PACE)) {
+            /* get the link pace */
+#if PACE
+            rc = coap_get_pace_stats(rsp->msg, &len);
+#else
+            rc = ERR_INVAL;
+#endif
+        } else if (!coap_opt_strcmp(o, S_STAT_URI_Q_MOD_LOAD)) {
+            /* get the CPU load */
+#if CPULOAD
+            rc = coap_get_load_stats(rsp->msg, &len);
+#else
+            rc = ERR_INVAL;
+#endif
         } else {
             /* Don't support other queries. */
             rsp->code = COAP_RSP_501_NOT_IMPLEMENTED;
             goto err;
         }
-        dlog(LOG_DEBUG, "GET (status %d) read %d bytes.", rc, len);
+        DLOG_DEBUG("GET (status %d) read %d bytes.", rc, len);
         if (!rc) {
             rsp->plen = len;
             rsp->cf = COAP_CF_APPLICATION_OCTET_STREAM;
@@ -488,16 +976,44 @@ static error_t crsystem_stats(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp
             rsp->code = COAP_RSP_501_NOT_IMPLEMENTED;
             goto err;
         } else if (!coap_opt_strcmp(o, S_STAT_URI_Q_MOD_PWR)) {
-            /* Set power stats */
-            // TODO: Do we need this?
-            //rc = coap_set_pwr_stats();
+            /* clear the run state times */
+#if DUTY
+            duty_clear();
+            rc = ERR_OK;
+#else
+            rc = ERR_INVAL;
+#endif
+        } else if (!coap_opt_strcmp(o, S_STAT_URI_Q_MOD_LAT) ||
+                   !coap_opt_strcmp(o, S_STAT_URI_Q_MOD_SLOW)) {
+            /* clear the request latency and the slowest */
+#if REQLAT
+            reqlat_clear();
+            rc = ERR_OK;
+#else
+            rc = ERR_INVAL;
+#endif
+        } else if (!coap_opt_strcmp(o, S_STAT_URI_Q_MOD_PACE)) {
+            /* clear the link pace counts */
+#if PACE
+            pace_clear();
+            rc = ERR_OK;
+#else
             rc = ERR_INVAL;
+#endif
+        } else if (!coap_opt_strcmp(o, S_STAT_URI_Q_MOD_LOAD)) {
+            /* clear the loop iteration counts */
+#if CPULOAD
+            cpuload_clear();
+            rc = ERR_OK;
+#else
+            rc = ERR_INVAL;
+#endif
         } else {
             /* Don't support other queries. */
             rsp->code = COAP_RSP_501_NOT_IMPLEMENTED;
             goto err;
         }
-        dlog(LOG_DEBUG, "SET (status %d).", rc);
+        DLOG_DEBUG("SET (status %d).", rc);
         if (!rc) {
             rsp->plen = 0;
             rsp->code = COAP_RSP_204_CHANGED;
@@ -526,45 +1042,102 @@ err:
 }
 
 
-// The "sys" dispatcher.
-static error_t crsystem(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp)
+
+/*
+ * The protocol trace, see trace.h. GET gives the records from the n-th
+ * oldest, /sys/trace?n=<k>, as many whole ones as fit, after a header of
+ * the record count, the index of the first record sent and micros() now,
+ * 2, 2 and 4 bytes little endian. DELETE drops the records.
+ */
+static error_t crsystem_trace(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, void *it)
 {
+#if TRACE
     struct optlv *o;
-    void *it = NULL;
-	
-    /* No observes on system */
-    if ((o = copt_get_next_opt_type((const sl_co*)&(req->oh), COAP_OPTION_OBSERVE, NULL)))
-	{
-        copt_del_opt_type((sl_co*)&(rsp->oh), COAP_OPTION_OBSERVE);
-    }
-    /* 
-     * No URI path beyond /system, except /time and /stats is supported, so
-     * reject if present. 
-     */
-    copt_get_next_opt_type((const sl_co*)&(req->oh), COAP_OPTION_URI_PATH, &it);
-	
-    if ((o = copt_get_next_opt_type((const sl_co*) &(req->oh), COAP_OPTION_URI_PATH, &it)))
-	{
-        if (!coap_opt_strcmp(o, S_TIME_URI))
-		{
-            return crsystem_time(req, rsp, it);
-        }
-		else if (!coap_opt_strcmp(o, S_STAT_URI))
-		{
-            /* placeholder for stats */
-            return crsystem_stats(req, rsp, it);
-        }
-		else
-		{
-            rsp->code = COAP_RSP_404_NOT_FOUND;
+    uint8_t *p;
+    uint32_t now;
+    uint16_t len;
+    char num[6];
+    int room;
+    int from = 0;
+    int count;
+    int n;
+
+    o = copt_get_next_opt_type((const sl_co*)&(req->oh), COAP_OPTION_URI_QUERY, NULL);
+    if (o) {
+        if (coap_opt_strncmp(o, S_TRACE_URI_Q_FROM, strlen(S_TRACE_URI_Q_FROM)) ||
+            o->ol <= strlen(S_TRACE_URI_Q_FROM) || o->ol - strlen(S_TRACE_URI_Q_FROM) >= sizeof(num)) {
+            rsp->code = COAP_RSP_400_BAD_REQUEST;
+            goto err;
         }
+        memset(num, 0, sizeof(num));
+        memcpy(num, (const char *)o->ov + strlen(S_TRACE_URI_Q_FROM), o->ol - strlen(S_TRACE_URI_Q_FROM));
+        from = atoi(num);
     }
-	else
-	{
-        rsp->code = COAP_RSP_404_NOT_FOUND;
+
+    if (req->code == COAP_REQUEST_DELETE) {
+        trace_clear();
+        rsp->code = COAP_RSP_202_DELETED;
+        goto err;
+    }
+    if (req->code != COAP_REQUEST_GET) {
+        rsp->code = COAP_RSP_405_METHOD_NOT_ALLOWED;
+        goto err;
+    }
+
+    count = trace_count();
+    room = M_TRAILINGSPACE(rsp->msg);
+    p = mtod(rsp->msg, uint8_t *) + rsp->msg->len;
+    if (room < 8 + TRACE_HDR + TRACE_KEEP) {
+        rsp->code = COAP_RSP_500_INTERNAL_ERROR;
+        goto err;
+    }
+    now = micros();
+    p[0] = count;
+    p[1] = count >> 8;
+    p[2] = from;
+    p[3] = from >> 8;
+    p[4] = now;
+    p[5] = now >> 8;
+    p[6] = now >> 16;
+    p[7] = now >> 24;
+    len = 8;
+    for (n = from; n < count && len + TRACE_HDR + TRACE_KEEP <= room; n++) {
+        len += trace_get(n, p + len);
     }
 
+    (void)m_append(rsp->msg, len);
+    rsp->plen = len;
+    rsp->cf = COAP_CF_APPLICATION_OCTET_STREAM;
+    rsp->code = COAP_RSP_205_CONTENT;
+    return ERR_OK;
+#else
+    rsp->code = COAP_RSP_404_NOT_FOUND;
+    goto err;
+#endif
+
+err:
+    rsp->plen = 0;
+    return ERR_OK;
+}
+
+// crsystem. Handles "/sys" itself, or a "/sys/..." path that isn't in the
+// resource tree. Observe is already removed by the dispatcher.
+static error_t crsystem(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, void *it)
+{
+    /* No URI path beyond /system, except /time, /stats and /fw is supported */
+    rsp->code = COAP_RSP_404_NOT_FOUND;
     rsp->plen = 0;
 
     return ERR_OK;
 }
+
+
+// Sensors under the classifier, dispatched by SAPI or the sketch
+static error_t crclassifier(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, void *it)
+{
+	if (is_sapi == 1)
+	{
+		return crsapi(req, rsp);
+	}
+	return crarduino(req, rsp);
+}
@@ -0,0 +1,169 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+
+#include <Arduino.h>
+#include "cpuload.h"
+
+
+#if CPULOAD
+/* Decay a window of the 1 and 15 minute loads, exp(-1/60) and exp(-1/900), Q16 */
+#define CPULOAD_DECAY_1M        64453
+#define CPULOAD_DECAY_15M       65463
+
+static struct cpuload_stats cpuload;
+static uint64_t cpuload_idle_us;    /* totals for idle_ms and busy_ms */
+static uint64_t cpuload_busy_us;
+static uint32_t cpuload_iter_us;    /* micros() the iteration started */
+static uint32_t cpuload_win_ms;     /* millis() the window started */
+static uint32_t cpuload_win_idle;   /* us parked in it */
+static uint32_t cpuload_avg_q8[2];  /* 1 and 15 minute loads * 256 */
+static uint8_t cpuload_started;
+static uint8_t cpuload_windowed;    /* the averages have a first window */
+
+
+/* decay ^ n, Q16, by squaring so a window stretched over hours costs little */
+static uint32_t
+cpuload_pow(uint32_t decay, uint32_t n)
+{
+    uint32_t r = 65536;
+
+    while (n) {
+        if (n & 1) {
+            r = (uint64_t)r * decay >> 16;
+        }
+        decay = (uint64_t)decay * decay >> 16;
+        n >>= 1;
+    }
+    return r;
+}
+
+
+static uint32_t
+cpuload_smooth(uint32_t avg_q8, uint32_t load, uint32_t decay)
+{
+    return ((uint64_t)avg_q8 * decay + ((uint64_t)load << 8) * (65536 - decay)) >> 16;
+}
+
+
+/* Close the window of span_ms, as many as it stretched over */
+static void
+cpuload_window(uint32_t span_ms)
+{
+    uint64_t idle = (uint64_t)cpuload_win_idle * 10 / span_ms;
+    uint32_t load = idle < 10000 ? 10000 - (uint32_t)idle : 0;
+    uint32_t n = span_ms / CPULOAD_WIN_MS;
+
+    cpuload_idle_us += cpuload_win_idle;
+    if ((uint64_t)span_ms * 1000 > cpuload_win_idle) {
+        cpuload_busy_us += (uint64_t)span_ms * 1000 - cpuload_win_idle;
+    }
+    cpuload.load_1s = load;
+    if (!cpuload_windowed) {
+        cpuload_windowed = 1;
+        cpuload_avg_q8[0] = cpuload_avg_q8[1] = load << 8;
+        return;
+    }
+    cpuload_avg_q8[0] = cpuload_smooth(cpuload_avg_q8[0], load, cpuload_pow(CPULOAD_DECAY_1M, n));
+    cpuload_avg_q8[1] = cpuload_smooth(cpuload_avg_q8[1], load, cpuload_pow(CPULOAD_DECAY_15M, n));
+}
+
+
+uint32_t
+cpuload_enter(void)
+{
+    uint32_t now = micros();
+    uint32_t us = now - cpuload_iter_us;
+    uint8_t b;
+
+    /* not the first, that is setup() too */
+    if (cpuload_started) {
+        b = 0;
+        while (b < CPULOAD_BINS - 1 && us >= ((uint32_t)CPULOAD_BIN0_US << 2 * b)) {
+            b++;
+        }
+        cpuload.hist[b]++;
+        cpuload.iters++;
+        if (us > cpuload.iter_max_us) {
+            cpuload.iter_max_us = us;
+        }
+    }
+    return now;
+}
+
+
+void
+cpuload_exit(uint32_t idle_us, uint8_t parked)
+{
+    uint32_t now = micros();
+    uint32_t span;
+
+    cpuload_iter_us = now;
+    if (!cpuload_started) {
+        cpuload_started = 1;
+        cpuload_win_ms = millis();
+        return;
+    }
+    if (parked) {
+        cpuload_win_idle += now - idle_us;
+    }
+
+    span = millis() - cpuload_win_ms;
+    if (span >= CPULOAD_WIN_MS) {
+        cpuload_window(span);
+        cpuload_win_ms += span;
+        cpuload_win_idle = 0;
+    }
+}
+
+
+void
+cpuload_get(struct cpuload_stats *s)
+{
+    *s = cpuload;
+    s->load_1m = cpuload_avg_q8[0] >> 8;
+    s->load_15m = cpuload_avg_q8[1] >> 8;
+    s->idle_ms = cpuload_idle_us / 1000;
+    s->busy_ms = cpuload_busy_us / 1000;
+}
+
+
+void
+cpuload_clear(void)
+{
+    cpuload_idle_us = 0;
+    cpuload_busy_us = 0;
+    cpuload.iters = 0;
+    cpuload.iter_max_us = 0;
+    memset(cpuload.hist, 0, sizeof(cpuload.hist));
+}
+#endif
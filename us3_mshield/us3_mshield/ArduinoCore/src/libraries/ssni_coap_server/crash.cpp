@@ -0,0 +1,345 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+
+#include <Arduino.h>
+#include <SPIMemory.h>
+#include "crash.h"
+#include "cbor.h"
+#include "hbuf.h"
+#include "coappdu.h"
+#include "coapmsg.h"
+#include "crc_xmodem.h"
+#include "sched.h"
+#include "sapi.h"
+
+
+/* Fault record in RAM, across the reset */
+struct crash_ram {
+    struct crash_regs regs;
+    struct log_rec log[CRASH_LOG_RECS];
+    uint32_t nlog;                      /* Records in log */
+    uint32_t crc;                       /* crc32 of the above */
+};
+
+// SPI flash of SAPI
+extern SPIFlash flash;
+
+/* Left as the fault had it by the C runtime, and what the one found at
+ * boot left for the reboot event */
+static struct crash_ram crash_ram __attribute__ ((section (".noinit")));
+static struct crash_regs crash_boot_regs;
+
+
+/* CRC of a fault record, over len bytes from its start */
+static uint32_t
+crash_crc(const void *rec, uint32_t len)
+{
+    return crc32_final(crc32(crc32_init(), rec, len));
+}
+
+
+static const char *
+crash_cause(uint8_t cause)
+{
+    return (cause == CRASH_CAUSE_HARDFAULT) ? "hardfault" :
+        (cause == CRASH_CAUSE_WDT) ? "wdt" : "none";
+}
+
+
+/* Save a fault record and reset, entered from HardFault_Handler or
+ * WDT_Handler with the exception frame. Only the frame is trusted to be
+ * in RAM, what is above it is copied up to the end of RAM. */
+extern "C" void
+crash_save(const uint32_t *frame, uint32_t cause)
+{
+    const uint32_t top = HSRAM_ADDR + HSRAM_SIZE;
+    uint32_t sp = (uint32_t)(uintptr_t)frame;
+    uint32_t i;
+
+    memset(&crash_ram, 0, sizeof(crash_ram));
+    crash_ram.regs.magic = CRASH_MAGIC;
+    crash_ram.regs.cause = cause;
+    crash_ram.regs.ms = millis();
+    crash_ram.regs.sp = sp;
+    if (!(sp & 3) && sp >= HSRAM_ADDR && sp + sizeof(crash_ram.regs.frame) <= top) {
+        memcpy(crash_ram.regs.frame, frame, sizeof(crash_ram.regs.frame));
+        for (i = 0; i < CRASH_STACK_WORDS && sp + sizeof(crash_ram.regs.frame) + 4 * i < top; i++) {
+            crash_ram.regs.stack[i] = frame[8 + i];
+        }
+    }
+    crash_ram.nlog = log_last(crash_ram.log, CRASH_LOG_RECS);
+    crash_ram.crc = crash_crc(&crash_ram, offsetof(struct crash_ram, crc));
+
+    NVIC_SystemReset();
+    while (true)
+        ;
+}
+
+
+/* Enter crash_save with the stack the exception frame is on, bit 2 of
+ * EXC_RETURN, and the cause */
+#define CRASH_ENTRY(cause)                          \
+    __asm volatile (                                \
+        "   .syntax unified         \n"             \
+        "   movs    r0, #4          \n"             \
+        "   mov     r1, lr          \n"             \
+        "   tst     r0, r1          \n"             \
+        "   bne     1f              \n"             \
+        "   mrs     r0, msp         \n"             \
+        "   b       2f              \n"             \
+        "1: mrs     r0, psp         \n"             \
+        "2: movs    r1, %[c]        \n"             \
+        "   ldr     r2, =crash_save \n"             \
+        "   bx      r2              \n"             \
+        "   .ltorg                  \n"             \
+        : : [c] "i" (cause))
+
+extern "C" __attribute__ ((naked)) void
+HardFault_Handler(void)
+{
+    CRASH_ENTRY(CRASH_CAUSE_HARDFAULT);
+}
+
+/* The watchdog early warning, once the watchdog runs with it enabled */
+extern "C" __attribute__ ((naked)) void
+WDT_Handler(void)
+{
+    CRASH_ENTRY(CRASH_CAUSE_WDT);
+}
+
+
+#if CRASH_WDT && defined(SAML21)
+/* Fed by the scheduler, a clear still syncing counts for this one too */
+static void
+crash_wdt_feed(void)
+{
+    if (!(WDT->SYNCBUSY.reg & WDT_SYNCBUSY_CLEAR)) {
+        WDT->CLEAR.reg = WDT_CLEAR_CLEAR_KEY;
+    }
+}
+
+
+void
+crash_wdt_init(void)
+{
+    WDT->CTRLA.reg = 0;
+    while (WDT->SYNCBUSY.reg & WDT_SYNCBUSY_ENABLE)
+        ;
+    WDT->CONFIG.reg = CRASH_WDT_PER;
+    WDT->EWCTRL.reg = CRASH_WDT_EW;
+    WDT->INTFLAG.reg = WDT_INTFLAG_EW;
+    WDT->INTENSET.reg = WDT_INTENSET_EW;
+    NVIC_ClearPendingIRQ(WDT_IRQn);
+    NVIC_SetPriority(WDT_IRQn, PORT_PRIO_LOW);
+    NVIC_EnableIRQ(WDT_IRQn);
+    WDT->CTRLA.reg = WDT_CTRLA_ENABLE;
+    while (WDT->SYNCBUSY.reg & WDT_SYNCBUSY_ENABLE)
+        ;
+    sched_watchdog(crash_wdt_feed, CRASH_WDT_FEED_MS);
+}
+#endif
+
+
+/* Where the next record of the log goes */
+static uint32_t
+crash_log_end(void)
+{
+    uint16_t magic;
+    uint32_t addr;
+
+    for (addr = CRASH_LOG_ADDR; addr + sizeof(struct crash_rec) <= CRASH_LOG_ADDR + CRASH_LOG_SIZE;
+         addr += sizeof(struct crash_rec)) {
+        if (sapi_flash_read(addr, &magic, sizeof(magic)) != SAPI_ERR_OK || magic == 0xFFFF) {
+            break;
+        }
+    }
+    return addr;
+}
+
+
+/* Append a record to the log, erased first once it is full */
+static bool
+crash_log_put(struct crash_rec *rec)
+{
+    uint32_t addr = crash_log_end();
+
+    if (addr + sizeof(*rec) > CRASH_LOG_ADDR + CRASH_LOG_SIZE) {
+        if (!flash.eraseSector(CRASH_LOG_ADDR)) {
+            return false;
+        }
+        addr = CRASH_LOG_ADDR;
+    }
+    rec->crc = crash_crc(rec, offsetof(struct crash_rec, crc));
+    return flash.writeByteArray(addr, (uint8_t *)rec, sizeof(*rec));
+}
+
+
+void
+crash_boot(void)
+{
+    uint8_t rcause = RSTC->RCAUSE.reg;
+    struct crash_rec rec;
+    uint32_t i;
+
+    memset(&rec, 0, sizeof(rec));
+    if (crash_ram.regs.magic == CRASH_MAGIC && crash_ram.nlog <= CRASH_LOG_RECS &&
+        crash_ram.crc == crash_crc(&crash_ram, offsetof(struct crash_ram, crc))) {
+        rec.regs = crash_ram.regs;
+        for (i = 0; i < crash_ram.nlog; i++) {
+            log_rec_text(&crash_ram.log[i], rec.log[i], CRASH_LINE);
+        }
+    } else if (rcause & RSTC_RCAUSE_WDT) {
+        rec.regs.magic = CRASH_MAGIC;
+        rec.regs.cause = CRASH_CAUSE_WDT;
+    }
+    crash_ram.regs.magic = 0;
+    if (rec.regs.magic != CRASH_MAGIC) {
+        return;
+    }
+    rec.regs.rcause = rcause;
+    crash_boot_regs = rec.regs;
+
+    DLOG_CRIT("Reset by %s at pc %08lx lr %08lx sp %08lx, %lu ms after boot", crash_cause(rec.regs.cause),
+        rec.regs.frame[6], rec.regs.frame[5], rec.regs.sp, rec.regs.ms);
+    for (i = 0; i < CRASH_LOG_RECS && rec.log[i][0]; i++) {
+        DLOG_CRIT("  %s", rec.log[i]);
+    }
+    if (!crash_log_put(&rec)) {
+        DLOG_ERR("Crash record not saved");
+    }
+}
+
+
+int
+crash_payload(uint8_t *buf, int size)
+{
+    const struct crash_regs *regs = &crash_boot_regs;
+    const char *cause = crash_cause(regs->cause);
+    struct cbor_buf cbuf;
+
+    if (regs->magic != CRASH_MAGIC) {
+        return 0;
+    }
+    cbor_enc_init(&cbuf, buf, size);
+    if (cbor_enc_map(&cbuf, 5) ||
+        cbor_enc_text(&cbuf, "cause", 5) || cbor_enc_text(&cbuf, cause, strlen(cause)) ||
+        cbor_enc_text(&cbuf, "rc", 2) || cbor_enc_uint(&cbuf, regs->rcause) ||
+        cbor_enc_text(&cbuf, "pc", 2) || cbor_enc_uint(&cbuf, regs->frame[6]) ||
+        cbor_enc_text(&cbuf, "lr", 2) || cbor_enc_uint(&cbuf, regs->frame[5]) ||
+        cbor_enc_text(&cbuf, "ms", 2) || cbor_enc_uint(&cbuf, regs->ms)) {
+        return -1;
+    }
+    return cbor_buf_get_len(&cbuf);
+}
+
+
+/* A CBOR map of the record count, the causes, the stacked registers and
+ * stack, and the log lines. The newest record without a query. */
+error_t
+crash_rsp(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, void *it)
+{
+    struct cbor_buf cbuf;
+    struct crash_rec rec;
+    struct optlv *o;
+    uint32_t count;
+    uint32_t n = 0;
+    char num[8];
+    int lines;
+    int rc;
+    int i;
+
+    if (req->code != COAP_REQUEST_GET) {
+        rsp->code = COAP_RSP_405_METHOD_NOT_ALLOWED;
+        goto err;
+    }
+    o = copt_get_next_opt_type((const sl_co*)&(req->oh), COAP_OPTION_URI_QUERY, NULL);
+    if (o) {
+        if (coap_opt_strncmp(o, CRASH_QUERY, strlen(CRASH_QUERY)) ||
+            o->ol <= strlen(CRASH_QUERY) || o->ol - strlen(CRASH_QUERY) >= sizeof(num)) {
+            rsp->code = COAP_RSP_400_BAD_REQUEST;
+            goto err;
+        }
+        memset(num, 0, sizeof(num));
+        memcpy(num, (const char *)o->ov + strlen(CRASH_QUERY), o->ol - strlen(CRASH_QUERY));
+        n = strtoul(num, NULL, 10);
+    }
+
+    count = (crash_log_end() - CRASH_LOG_ADDR) / sizeof(rec);
+    if (n >= count) {
+        rsp->code = COAP_RSP_404_NOT_FOUND;
+        goto err;
+    }
+    if (sapi_flash_read(CRASH_LOG_ADDR + (count - 1 - n) * sizeof(rec), &rec, sizeof(rec)) != SAPI_ERR_OK ||
+        rec.crc != crash_crc(&rec, offsetof(struct crash_rec, crc))) {
+        rsp->code = COAP_RSP_500_INTERNAL_ERROR;
+        goto err;
+    }
+
+    cbor_enc_init(&cbuf, mtod(rsp->msg, uint8_t *) + rsp->msg->len, M_TRAILINGSPACE(rsp->msg));
+    rc = cbor_enc_map(&cbuf, 8) ||
+        cbor_enc_text(&cbuf, "n", 1) || cbor_enc_uint(&cbuf, count) ||
+        cbor_enc_text(&cbuf, "cause", 5) ||
+        cbor_enc_text(&cbuf, crash_cause(rec.regs.cause), strlen(crash_cause(rec.regs.cause))) ||
+        cbor_enc_text(&cbuf, "rc", 2) || cbor_enc_uint(&cbuf, rec.regs.rcause) ||
+        cbor_enc_text(&cbuf, "ms", 2) || cbor_enc_uint(&cbuf, rec.regs.ms) ||
+        cbor_enc_text(&cbuf, "sp", 2) || cbor_enc_uint(&cbuf, rec.regs.sp) ||
+        cbor_enc_text(&cbuf, "r", 1) || cbor_enc_array(&cbuf, 8);
+    for (i = 0; !rc && i < 8; i++) {
+        rc = cbor_enc_uint(&cbuf, rec.regs.frame[i]);
+    }
+    rc = rc || cbor_enc_text(&cbuf, "stk", 3) || cbor_enc_array(&cbuf, CRASH_STACK_WORDS);
+    for (i = 0; !rc && i < CRASH_STACK_WORDS; i++) {
+        rc = cbor_enc_uint(&cbuf, rec.regs.stack[i]);
+    }
+    for (lines = 0; lines < CRASH_LOG_RECS && rec.log[lines][0]; lines++)
+        ;
+    rc = rc || cbor_enc_text(&cbuf, "log", 3) || cbor_enc_array(&cbuf, lines);
+    for (i = 0; !rc && i < lines; i++) {
+        rec.log[i][CRASH_LINE - 1] = 0;
+        rc = cbor_enc_text(&cbuf, rec.log[i], strlen(rec.log[i]));
+    }
+    if (rc) {
+        rsp->code = COAP_RSP_500_INTERNAL_ERROR;
+        goto err;
+    }
+
+    rsp->plen = cbor_buf_get_len(&cbuf);
+    (void)m_append(rsp->msg, rsp->plen);
+    rsp->cf = COAP_CF_APPLICATION_CBOR;
+    rsp->code = COAP_RSP_205_CONTENT;
+    return ERR_OK;
+
+err:
+    rsp->plen = 0;
+    return ERR_OK;
+}
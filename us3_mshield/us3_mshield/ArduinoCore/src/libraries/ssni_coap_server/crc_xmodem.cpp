@@ -36,6 +36,13 @@ Networks, Inc.
 
 #include "crc_xmodem.h"
 
+#ifdef CRC_BENCH
+#include "log.h"
+#endif
+
+/* The byte tables are also the first slice of CRC_KERNEL_SLICE4 */
+#if (CRC_KERNEL != CRC_KERNEL_NIBBLE) || defined(CRC_BENCH)
+
 /*
  * CRC LOOKUP TABLE
  * ================
@@ -134,6 +141,320 @@ static const uint16_t dnp_crctable[256] = {
         0x6e26,0x5878,0x29a,0x34c4,0xb75e,0x8100,0xdbe2,0xedbc,
         0x91af,0xa7f1,0xfd13,0xcb4d,0x48d7,0x7e89,0x246b,0x1235
 };
+
+/*
+ * CRC LOOKUP TABLE
+ * ================
+ *    Width   : 2 bytes.
+ *    Poly    : 0xA001
+ *    Reverse : TRUE.
+ *
+ *    The Modbus RTU CRC, dnp3_crc_table() above with 0xa001.
+ */
+static const uint16_t modbus_crctable[256] = {
+        0x0000,0xc0c1,0xc181,0x0140,0xc301,0x03c0,0x0280,0xc241,
+        0xc601,0x06c0,0x0780,0xc741,0x0500,0xc5c1,0xc481,0x0440,
+        0xcc01,0x0cc0,0x0d80,0xcd41,0x0f00,0xcfc1,0xce81,0x0e40,
+        0x0a00,0xcac1,0xcb81,0x0b40,0xc901,0x09c0,0x0880,0xc841,
+        0xd801,0x18c0,0x1980,0xd941,0x1b00,0xdbc1,0xda81,0x1a40,
+        0x1e00,0xdec1,0xdf81,0x1f40,0xdd01,0x1dc0,0x1c80,0xdc41,
+        0x1400,0xd4c1,0xd581,0x1540,0xd701,0x17c0,0x1680,0xd641,
+        0xd201,0x12c0,0x1380,0xd341,0x1100,0xd1c1,0xd081,0x1040,
+        0xf001,0x30c0,0x3180,0xf141,0x3300,0xf3c1,0xf281,0x3240,
+        0x3600,0xf6c1,0xf781,0x3740,0xf501,0x35c0,0x3480,0xf441,
+        0x3c00,0xfcc1,0xfd81,0x3d40,0xff01,0x3fc0,0x3e80,0xfe41,
+        0xfa01,0x3ac0,0x3b80,0xfb41,0x3900,0xf9c1,0xf881,0x3840,
+        0x2800,0xe8c1,0xe981,0x2940,0xeb01,0x2bc0,0x2a80,0xea41,
+        0xee01,0x2ec0,0x2f80,0xef41,0x2d00,0xedc1,0xec81,0x2c40,
+        0xe401,0x24c0,0x2580,0xe541,0x2700,0xe7c1,0xe681,0x2640,
+        0x2200,0xe2c1,0xe381,0x2340,0xe101,0x21c0,0x2080,0xe041,
+        0xa001,0x60c0,0x6180,0xa141,0x6300,0xa3c1,0xa281,0x6240,
+        0x6600,0xa6c1,0xa781,0x6740,0xa501,0x65c0,0x6480,0xa441,
+        0x6c00,0xacc1,0xad81,0x6d40,0xaf01,0x6fc0,0x6e80,0xae41,
+        0xaa01,0x6ac0,0x6b80,0xab41,0x6900,0xa9c1,0xa881,0x6840,
+        0x7800,0xb8c1,0xb981,0x7940,0xbb01,0x7bc0,0x7a80,0xba41,
+        0xbe01,0x7ec0,0x7f80,0xbf41,0x7d00,0xbdc1,0xbc81,0x7c40,
+        0xb401,0x74c0,0x7580,0xb541,0x7700,0xb7c1,0xb681,0x7640,
+        0x7200,0xb2c1,0xb381,0x7340,0xb101,0x71c0,0x7080,0xb041,
+        0x5000,0x90c1,0x9181,0x5140,0x9301,0x53c0,0x5280,0x9241,
+        0x9601,0x56c0,0x5780,0x9741,0x5500,0x95c1,0x9481,0x5440,
+        0x9c01,0x5cc0,0x5d80,0x9d41,0x5f00,0x9fc1,0x9e81,0x5e40,
+        0x5a00,0x9ac1,0x9b81,0x5b40,0x9901,0x59c0,0x5880,0x9841,
+        0x8801,0x48c0,0x4980,0x8941,0x4b00,0x8bc1,0x8a81,0x4a40,
+        0x4e00,0x8ec1,0x8f81,0x4f40,0x8d01,0x4dc0,0x4c80,0x8c41,
+        0x4400,0x84c1,0x8581,0x4540,0x8701,0x47c0,0x4680,0x8641,
+        0x8201,0x42c0,0x4380,0x8341,0x4100,0x81c1,0x8081,0x4040
+};
+#endif /* CRC_KERNEL != CRC_KERNEL_NIBBLE */
+
+#if (CRC_KERNEL == CRC_KERNEL_SLICE4)
+/*
+ * Slice-by-4 tables. [k][i] is the byte table applied k+1 more times:
+ * the CRC register value after i is shifted through k+2 byte steps.
+ * With these four bytes are folded in per round instead of one.
+ */
+static const uint16_t xmodem_crctable4[3][256] = {
+  {
+    0x0000, 0x19d8, 0x33b0, 0x2a68, 0x6760, 0x7eb8, 0x54d0, 0x4d08,
+    0xcec0, 0xd718, 0xfd70, 0xe4a8, 0xa9a0, 0xb078, 0x9a10, 0x83c8,
+    0x9591, 0x8c49, 0xa621, 0xbff9, 0xf2f1, 0xeb29, 0xc141, 0xd899,
+    0x5b51, 0x4289, 0x68e1, 0x7139, 0x3c31, 0x25e9, 0x0f81, 0x1659,
+    0x2333, 0x3aeb, 0x1083, 0x095b, 0x4453, 0x5d8b, 0x77e3, 0x6e3b,
+    0xedf3, 0xf42b, 0xde43, 0xc79b, 0x8a93, 0x934b, 0xb923, 0xa0fb,
+    0xb6a2, 0xaf7a, 0x8512, 0x9cca, 0xd1c2, 0xc81a, 0xe272, 0xfbaa,
+    0x7862, 0x61ba, 0x4bd2, 0x520a, 0x1f02, 0x06da, 0x2cb2, 0x356a,
+    0x4666, 0x5fbe, 0x75d6, 0x6c0e, 0x2106, 0x38de, 0x12b6, 0x0b6e,
+    0x88a6, 0x917e, 0xbb16, 0xa2ce, 0xefc6, 0xf61e, 0xdc76, 0xc5ae,
+    0xd3f7, 0xca2f, 0xe047, 0xf99f, 0xb497, 0xad4f, 0x8727, 0x9eff,
+    0x1d37, 0x04ef, 0x2e87, 0x375f, 0x7a57, 0x638f, 0x49e7, 0x503f,
+    0x6555, 0x7c8d, 0x56e5, 0x4f3d, 0x0235, 0x1bed, 0x3185, 0x285d,
+    0xab95, 0xb24d, 0x9825, 0x81fd, 0xccf5, 0xd52d, 0xff45, 0xe69d,
+    0xf0c4, 0xe91c, 0xc374, 0xdaac, 0x97a4, 0x8e7c, 0xa414, 0xbdcc,
+    0x3e04, 0x27dc, 0x0db4, 0x146c, 0x5964, 0x40bc, 0x6ad4, 0x730c,
+    0x8ccc, 0x9514, 0xbf7c, 0xa6a4, 0xebac, 0xf274, 0xd81c, 0xc1c4,
+    0x420c, 0x5bd4, 0x71bc, 0x6864, 0x256c, 0x3cb4, 0x16dc, 0x0f04,
+    0x195d, 0x0085, 0x2aed, 0x3335, 0x7e3d, 0x67e5, 0x4d8d, 0x5455,
+    0xd79d, 0xce45, 0xe42d, 0xfdf5, 0xb0fd, 0xa925, 0x834d, 0x9a95,
+    0xafff, 0xb627, 0x9c4f, 0x8597, 0xc89f, 0xd147, 0xfb2f, 0xe2f7,
+    0x613f, 0x78e7, 0x528f, 0x4b57, 0x065f, 0x1f87, 0x35ef, 0x2c37,
+    0x3a6e, 0x23b6, 0x09de, 0x1006, 0x5d0e, 0x44d6, 0x6ebe, 0x7766,
+    0xf4ae, 0xed76, 0xc71e, 0xdec6, 0x93ce, 0x8a16, 0xa07e, 0xb9a6,
+    0xcaaa, 0xd372, 0xf91a, 0xe0c2, 0xadca, 0xb412, 0x9e7a, 0x87a2,
+    0x046a, 0x1db2, 0x37da, 0x2e02, 0x630a, 0x7ad2, 0x50ba, 0x4962,
+    0x5f3b, 0x46e3, 0x6c8b, 0x7553, 0x385b, 0x2183, 0x0beb, 0x1233,
+    0x91fb, 0x8823, 0xa24b, 0xbb93, 0xf69b, 0xef43, 0xc52b, 0xdcf3,
+    0xe999, 0xf041, 0xda29, 0xc3f1, 0x8ef9, 0x9721, 0xbd49, 0xa491,
+    0x2759, 0x3e81, 0x14e9, 0x0d31, 0x4039, 0x59e1, 0x7389, 0x6a51,
+    0x7c08, 0x65d0, 0x4fb8, 0x5660, 0x1b68, 0x02b0, 0x28d8, 0x3100,
+    0xb2c8, 0xab10, 0x8178, 0x98a0, 0xd5a8, 0xcc70, 0xe618, 0xffc0
+  },
+  {
+    0x0000, 0x5adc, 0xb5b8, 0xef64, 0x6361, 0x39bd, 0xd6d9, 0x8c05,
+    0xc6c2, 0x9c1e, 0x737a, 0x29a6, 0xa5a3, 0xff7f, 0x101b, 0x4ac7,
+    0x8595, 0xdf49, 0x302d, 0x6af1, 0xe6f4, 0xbc28, 0x534c, 0x0990,
+    0x4357, 0x198b, 0xf6ef, 0xac33, 0x2036, 0x7aea, 0x958e, 0xcf52,
+    0x033b, 0x59e7, 0xb683, 0xec5f, 0x605a, 0x3a86, 0xd5e2, 0x8f3e,
+    0xc5f9, 0x9f25, 0x7041, 0x2a9d, 0xa698, 0xfc44, 0x1320, 0x49fc,
+    0x86ae, 0xdc72, 0x3316, 0x69ca, 0xe5cf, 0xbf13, 0x5077, 0x0aab,
+    0x406c, 0x1ab0, 0xf5d4, 0xaf08, 0x230d, 0x79d1, 0x96b5, 0xcc69,
+    0x0676, 0x5caa, 0xb3ce, 0xe912, 0x6517, 0x3fcb, 0xd0af, 0x8a73,
+    0xc0b4, 0x9a68, 0x750c, 0x2fd0, 0xa3d5, 0xf909, 0x166d, 0x4cb1,
+    0x83e3, 0xd93f, 0x365b, 0x6c87, 0xe082, 0xba5e, 0x553a, 0x0fe6,
+    0x4521, 0x1ffd, 0xf099, 0xaa45, 0x2640, 0x7c9c, 0x93f8, 0xc924,
+    0x054d, 0x5f91, 0xb0f5, 0xea29, 0x662c, 0x3cf0, 0xd394, 0x8948,
+    0xc38f, 0x9953, 0x7637, 0x2ceb, 0xa0ee, 0xfa32, 0x1556, 0x4f8a,
+    0x80d8, 0xda04, 0x3560, 0x6fbc, 0xe3b9, 0xb965, 0x5601, 0x0cdd,
+    0x461a, 0x1cc6, 0xf3a2, 0xa97e, 0x257b, 0x7fa7, 0x90c3, 0xca1f,
+    0x0cec, 0x5630, 0xb954, 0xe388, 0x6f8d, 0x3551, 0xda35, 0x80e9,
+    0xca2e, 0x90f2, 0x7f96, 0x254a, 0xa94f, 0xf393, 0x1cf7, 0x462b,
+    0x8979, 0xd3a5, 0x3cc1, 0x661d, 0xea18, 0xb0c4, 0x5fa0, 0x057c,
+    0x4fbb, 0x1567, 0xfa03, 0xa0df, 0x2cda, 0x7606, 0x9962, 0xc3be,
+    0x0fd7, 0x550b, 0xba6f, 0xe0b3, 0x6cb6, 0x366a, 0xd90e, 0x83d2,
+    0xc915, 0x93c9, 0x7cad, 0x2671, 0xaa74, 0xf0a8, 0x1fcc, 0x4510,
+    0x8a42, 0xd09e, 0x3ffa, 0x6526, 0xe923, 0xb3ff, 0x5c9b, 0x0647,
+    0x4c80, 0x165c, 0xf938, 0xa3e4, 0x2fe1, 0x753d, 0x9a59, 0xc085,
+    0x0a9a, 0x5046, 0xbf22, 0xe5fe, 0x69fb, 0x3327, 0xdc43, 0x869f,
+    0xcc58, 0x9684, 0x79e0, 0x233c, 0xaf39, 0xf5e5, 0x1a81, 0x405d,
+    0x8f0f, 0xd5d3, 0x3ab7, 0x606b, 0xec6e, 0xb6b2, 0x59d6, 0x030a,
+    0x49cd, 0x1311, 0xfc75, 0xa6a9, 0x2aac, 0x7070, 0x9f14, 0xc5c8,
+    0x09a1, 0x537d, 0xbc19, 0xe6c5, 0x6ac0, 0x301c, 0xdf78, 0x85a4,
+    0xcf63, 0x95bf, 0x7adb, 0x2007, 0xac02, 0xf6de, 0x19ba, 0x4366,
+    0x8c34, 0xd6e8, 0x398c, 0x6350, 0xef55, 0xb589, 0x5aed, 0x0031,
+    0x4af6, 0x102a, 0xff4e, 0xa592, 0x2997, 0x734b, 0x9c2f, 0xc6f3
+  },
+  {
+    0x0000, 0x1cbb, 0x3976, 0x25cd, 0x72ec, 0x6e57, 0x4b9a, 0x5721,
+    0xe5d8, 0xf963, 0xdcae, 0xc015, 0x9734, 0x8b8f, 0xae42, 0xb2f9,
+    0xc3a1, 0xdf1a, 0xfad7, 0xe66c, 0xb14d, 0xadf6, 0x883b, 0x9480,
+    0x2679, 0x3ac2, 0x1f0f, 0x03b4, 0x5495, 0x482e, 0x6de3, 0x7158,
+    0x8f53, 0x93e8, 0xb625, 0xaa9e, 0xfdbf, 0xe104, 0xc4c9, 0xd872,
+    0x6a8b, 0x7630, 0x53fd, 0x4f46, 0x1867, 0x04dc, 0x2111, 0x3daa,
+    0x4cf2, 0x5049, 0x7584, 0x693f, 0x3e1e, 0x22a5, 0x0768, 0x1bd3,
+    0xa92a, 0xb591, 0x905c, 0x8ce7, 0xdbc6, 0xc77d, 0xe2b0, 0xfe0b,
+    0x16b7, 0x0a0c, 0x2fc1, 0x337a, 0x645b, 0x78e0, 0x5d2d, 0x4196,
+    0xf36f, 0xefd4, 0xca19, 0xd6a2, 0x8183, 0x9d38, 0xb8f5, 0xa44e,
+    0xd516, 0xc9ad, 0xec60, 0xf0db, 0xa7fa, 0xbb41, 0x9e8c, 0x8237,
+    0x30ce, 0x2c75, 0x09b8, 0x1503, 0x4222, 0x5e99, 0x7b54, 0x67ef,
+    0x99e4, 0x855f, 0xa092, 0xbc29, 0xeb08, 0xf7b3, 0xd27e, 0xcec5,
+    0x7c3c, 0x6087, 0x454a, 0x59f1, 0x0ed0, 0x126b, 0x37a6, 0x2b1d,
+    0x5a45, 0x46fe, 0x6333, 0x7f88, 0x28a9, 0x3412, 0x11df, 0x0d64,
+    0xbf9d, 0xa326, 0x86eb, 0x9a50, 0xcd71, 0xd1ca, 0xf407, 0xe8bc,
+    0x2d6e, 0x31d5, 0x1418, 0x08a3, 0x5f82, 0x4339, 0x66f4, 0x7a4f,
+    0xc8b6, 0xd40d, 0xf1c0, 0xed7b, 0xba5a, 0xa6e1, 0x832c, 0x9f97,
+    0xeecf, 0xf274, 0xd7b9, 0xcb02, 0x9c23, 0x8098, 0xa555, 0xb9ee,
+    0x0b17, 0x17ac, 0x3261, 0x2eda, 0x79fb, 0x6540, 0x408d, 0x5c36,
+    0xa23d, 0xbe86, 0x9b4b, 0x87f0, 0xd0d1, 0xcc6a, 0xe9a7, 0xf51c,
+    0x47e5, 0x5b5e, 0x7e93, 0x6228, 0x3509, 0x29b2, 0x0c7f, 0x10c4,
+    0x619c, 0x7d27, 0x58ea, 0x4451, 0x1370, 0x0fcb, 0x2a06, 0x36bd,
+    0x8444, 0x98ff, 0xbd32, 0xa189, 0xf6a8, 0xea13, 0xcfde, 0xd365,
+    0x3bd9, 0x2762, 0x02af, 0x1e14, 0x4935, 0x558e, 0x7043, 0x6cf8,
+    0xde01, 0xc2ba, 0xe777, 0xfbcc, 0xaced, 0xb056, 0x959b, 0x8920,
+    0xf878, 0xe4c3, 0xc10e, 0xddb5, 0x8a94, 0x962f, 0xb3e2, 0xaf59,
+    0x1da0, 0x011b, 0x24d6, 0x386d, 0x6f4c, 0x73f7, 0x563a, 0x4a81,
+    0xb48a, 0xa831, 0x8dfc, 0x9147, 0xc666, 0xdadd, 0xff10, 0xe3ab,
+    0x5152, 0x4de9, 0x6824, 0x749f, 0x23be, 0x3f05, 0x1ac8, 0x0673,
+    0x772b, 0x6b90, 0x4e5d, 0x52e6, 0x05c7, 0x197c, 0x3cb1, 0x200a,
+    0x92f3, 0x8e48, 0xab85, 0xb73e, 0xe01f, 0xfca4, 0xd969, 0xc5d2
+  }
+};
+
+static const uint16_t dnp_crctable4[3][256] = {
+  {
+    0x0000, 0xab4e, 0x1be5, 0xb0ab, 0x37ca, 0x9c84, 0x2c2f, 0x8761,
+    0x6f94, 0xc4da, 0x7471, 0xdf3f, 0x585e, 0xf310, 0x43bb, 0xe8f5,
+    0xdf28, 0x7466, 0xc4cd, 0x6f83, 0xe8e2, 0x43ac, 0xf307, 0x5849,
+    0xb0bc, 0x1bf2, 0xab59, 0x0017, 0x8776, 0x2c38, 0x9c93, 0x37dd,
+    0xf329, 0x5867, 0xe8cc, 0x4382, 0xc4e3, 0x6fad, 0xdf06, 0x7448,
+    0x9cbd, 0x37f3, 0x8758, 0x2c16, 0xab77, 0x0039, 0xb092, 0x1bdc,
+    0x2c01, 0x874f, 0x37e4, 0x9caa, 0x1bcb, 0xb085, 0x002e, 0xab60,
+    0x4395, 0xe8db, 0x5870, 0xf33e, 0x745f, 0xdf11, 0x6fba, 0xc4f4,
+    0xab2b, 0x0065, 0xb0ce, 0x1b80, 0x9ce1, 0x37af, 0x8704, 0x2c4a,
+    0xc4bf, 0x6ff1, 0xdf5a, 0x7414, 0xf375, 0x583b, 0xe890, 0x43de,
+    0x7403, 0xdf4d, 0x6fe6, 0xc4a8, 0x43c9, 0xe887, 0x582c, 0xf362,
+    0x1b97, 0xb0d9, 0x0072, 0xab3c, 0x2c5d, 0x8713, 0x37b8, 0x9cf6,
+    0x5802, 0xf34c, 0x43e7, 0xe8a9, 0x6fc8, 0xc486, 0x742d, 0xdf63,
+    0x3796, 0x9cd8, 0x2c73, 0x873d, 0x005c, 0xab12, 0x1bb9, 0xb0f7,
+    0x872a, 0x2c64, 0x9ccf, 0x3781, 0xb0e0, 0x1bae, 0xab05, 0x004b,
+    0xe8be, 0x43f0, 0xf35b, 0x5815, 0xdf74, 0x743a, 0xc491, 0x6fdf,
+    0x1b2f, 0xb061, 0x00ca, 0xab84, 0x2ce5, 0x87ab, 0x3700, 0x9c4e,
+    0x74bb, 0xdff5, 0x6f5e, 0xc410, 0x4371, 0xe83f, 0x5894, 0xf3da,
+    0xc407, 0x6f49, 0xdfe2, 0x74ac, 0xf3cd, 0x5883, 0xe828, 0x4366,
+    0xab93, 0x00dd, 0xb076, 0x1b38, 0x9c59, 0x3717, 0x87bc, 0x2cf2,
+    0xe806, 0x4348, 0xf3e3, 0x58ad, 0xdfcc, 0x7482, 0xc429, 0x6f67,
+    0x8792, 0x2cdc, 0x9c77, 0x3739, 0xb058, 0x1b16, 0xabbd, 0x00f3,
+    0x372e, 0x9c60, 0x2ccb, 0x8785, 0x00e4, 0xabaa, 0x1b01, 0xb04f,
+    0x58ba, 0xf3f4, 0x435f, 0xe811, 0x6f70, 0xc43e, 0x7495, 0xdfdb,
+    0xb004, 0x1b4a, 0xabe1, 0x00af, 0x87ce, 0x2c80, 0x9c2b, 0x3765,
+    0xdf90, 0x74de, 0xc475, 0x6f3b, 0xe85a, 0x4314, 0xf3bf, 0x58f1,
+    0x6f2c, 0xc462, 0x74c9, 0xdf87, 0x58e6, 0xf3a8, 0x4303, 0xe84d,
+    0x00b8, 0xabf6, 0x1b5d, 0xb013, 0x3772, 0x9c3c, 0x2c97, 0x87d9,
+    0x432d, 0xe863, 0x58c8, 0xf386, 0x74e7, 0xdfa9, 0x6f02, 0xc44c,
+    0x2cb9, 0x87f7, 0x375c, 0x9c12, 0x1b73, 0xb03d, 0x0096, 0xabd8,
+    0x9c05, 0x374b, 0x87e0, 0x2cae, 0xabcf, 0x0081, 0xb02a, 0x1b64,
+    0xf391, 0x58df, 0xe874, 0x433a, 0xc45b, 0x6f15, 0xdfbe, 0x74f0
+  },
+  {
+    0x0000, 0x19b8, 0x3370, 0x2ac8, 0x66e0, 0x7f58, 0x5590, 0x4c28,
+    0xcdc0, 0xd478, 0xfeb0, 0xe708, 0xab20, 0xb298, 0x9850, 0x81e8,
+    0xd6f9, 0xcf41, 0xe589, 0xfc31, 0xb019, 0xa9a1, 0x8369, 0x9ad1,
+    0x1b39, 0x0281, 0x2849, 0x31f1, 0x7dd9, 0x6461, 0x4ea9, 0x5711,
+    0xe08b, 0xf933, 0xd3fb, 0xca43, 0x866b, 0x9fd3, 0xb51b, 0xaca3,
+    0x2d4b, 0x34f3, 0x1e3b, 0x0783, 0x4bab, 0x5213, 0x78db, 0x6163,
+    0x3672, 0x2fca, 0x0502, 0x1cba, 0x5092, 0x492a, 0x63e2, 0x7a5a,
+    0xfbb2, 0xe20a, 0xc8c2, 0xd17a, 0x9d52, 0x84ea, 0xae22, 0xb79a,
+    0x8c6f, 0x95d7, 0xbf1f, 0xa6a7, 0xea8f, 0xf337, 0xd9ff, 0xc047,
+    0x41af, 0x5817, 0x72df, 0x6b67, 0x274f, 0x3ef7, 0x143f, 0x0d87,
+    0x5a96, 0x432e, 0x69e6, 0x705e, 0x3c76, 0x25ce, 0x0f06, 0x16be,
+    0x9756, 0x8eee, 0xa426, 0xbd9e, 0xf1b6, 0xe80e, 0xc2c6, 0xdb7e,
+    0x6ce4, 0x755c, 0x5f94, 0x462c, 0x0a04, 0x13bc, 0x3974, 0x20cc,
+    0xa124, 0xb89c, 0x9254, 0x8bec, 0xc7c4, 0xde7c, 0xf4b4, 0xed0c,
+    0xba1d, 0xa3a5, 0x896d, 0x90d5, 0xdcfd, 0xc545, 0xef8d, 0xf635,
+    0x77dd, 0x6e65, 0x44ad, 0x5d15, 0x113d, 0x0885, 0x224d, 0x3bf5,
+    0x55a7, 0x4c1f, 0x66d7, 0x7f6f, 0x3347, 0x2aff, 0x0037, 0x198f,
+    0x9867, 0x81df, 0xab17, 0xb2af, 0xfe87, 0xe73f, 0xcdf7, 0xd44f,
+    0x835e, 0x9ae6, 0xb02e, 0xa996, 0xe5be, 0xfc06, 0xd6ce, 0xcf76,
+    0x4e9e, 0x5726, 0x7dee, 0x6456, 0x287e, 0x31c6, 0x1b0e, 0x02b6,
+    0xb52c, 0xac94, 0x865c, 0x9fe4, 0xd3cc, 0xca74, 0xe0bc, 0xf904,
+    0x78ec, 0x6154, 0x4b9c, 0x5224, 0x1e0c, 0x07b4, 0x2d7c, 0x34c4,
+    0x63d5, 0x7a6d, 0x50a5, 0x491d, 0x0535, 0x1c8d, 0x3645, 0x2ffd,
+    0xae15, 0xb7ad, 0x9d65, 0x84dd, 0xc8f5, 0xd14d, 0xfb85, 0xe23d,
+    0xd9c8, 0xc070, 0xeab8, 0xf300, 0xbf28, 0xa690, 0x8c58, 0x95e0,
+    0x1408, 0x0db0, 0x2778, 0x3ec0, 0x72e8, 0x6b50, 0x4198, 0x5820,
+    0x0f31, 0x1689, 0x3c41, 0x25f9, 0x69d1, 0x7069, 0x5aa1, 0x4319,
+    0xc2f1, 0xdb49, 0xf181, 0xe839, 0xa411, 0xbda9, 0x9761, 0x8ed9,
+    0x3943, 0x20fb, 0x0a33, 0x138b, 0x5fa3, 0x461b, 0x6cd3, 0x756b,
+    0xf483, 0xed3b, 0xc7f3, 0xde4b, 0x9263, 0x8bdb, 0xa113, 0xb8ab,
+    0xefba, 0xf602, 0xdcca, 0xc572, 0x895a, 0x90e2, 0xba2a, 0xa392,
+    0x227a, 0x3bc2, 0x110a, 0x08b2, 0x449a, 0x5d22, 0x77ea, 0x6e52
+  },
+  {
+    0x0000, 0xc2e8, 0xc8a9, 0x0a41, 0xdc2b, 0x1ec3, 0x1482, 0xd66a,
+    0xf52f, 0x37c7, 0x3d86, 0xff6e, 0x2904, 0xebec, 0xe1ad, 0x2345,
+    0xa727, 0x65cf, 0x6f8e, 0xad66, 0x7b0c, 0xb9e4, 0xb3a5, 0x714d,
+    0x5208, 0x90e0, 0x9aa1, 0x5849, 0x8e23, 0x4ccb, 0x468a, 0x8462,
+    0x0337, 0xc1df, 0xcb9e, 0x0976, 0xdf1c, 0x1df4, 0x17b5, 0xd55d,
+    0xf618, 0x34f0, 0x3eb1, 0xfc59, 0x2a33, 0xe8db, 0xe29a, 0x2072,
+    0xa410, 0x66f8, 0x6cb9, 0xae51, 0x783b, 0xbad3, 0xb092, 0x727a,
+    0x513f, 0x93d7, 0x9996, 0x5b7e, 0x8d14, 0x4ffc, 0x45bd, 0x8755,
+    0x066e, 0xc486, 0xcec7, 0x0c2f, 0xda45, 0x18ad, 0x12ec, 0xd004,
+    0xf341, 0x31a9, 0x3be8, 0xf900, 0x2f6a, 0xed82, 0xe7c3, 0x252b,
+    0xa149, 0x63a1, 0x69e0, 0xab08, 0x7d62, 0xbf8a, 0xb5cb, 0x7723,
+    0x5466, 0x968e, 0x9ccf, 0x5e27, 0x884d, 0x4aa5, 0x40e4, 0x820c,
+    0x0559, 0xc7b1, 0xcdf0, 0x0f18, 0xd972, 0x1b9a, 0x11db, 0xd333,
+    0xf076, 0x329e, 0x38df, 0xfa37, 0x2c5d, 0xeeb5, 0xe4f4, 0x261c,
+    0xa27e, 0x6096, 0x6ad7, 0xa83f, 0x7e55, 0xbcbd, 0xb6fc, 0x7414,
+    0x5751, 0x95b9, 0x9ff8, 0x5d10, 0x8b7a, 0x4992, 0x43d3, 0x813b,
+    0x0cdc, 0xce34, 0xc475, 0x069d, 0xd0f7, 0x121f, 0x185e, 0xdab6,
+    0xf9f3, 0x3b1b, 0x315a, 0xf3b2, 0x25d8, 0xe730, 0xed71, 0x2f99,
+    0xabfb, 0x6913, 0x6352, 0xa1ba, 0x77d0, 0xb538, 0xbf79, 0x7d91,
+    0x5ed4, 0x9c3c, 0x967d, 0x5495, 0x82ff, 0x4017, 0x4a56, 0x88be,
+    0x0feb, 0xcd03, 0xc742, 0x05aa, 0xd3c0, 0x1128, 0x1b69, 0xd981,
+    0xfac4, 0x382c, 0x326d, 0xf085, 0x26ef, 0xe407, 0xee46, 0x2cae,
+    0xa8cc, 0x6a24, 0x6065, 0xa28d, 0x74e7, 0xb60f, 0xbc4e, 0x7ea6,
+    0x5de3, 0x9f0b, 0x954a, 0x57a2, 0x81c8, 0x4320, 0x4961, 0x8b89,
+    0x0ab2, 0xc85a, 0xc21b, 0x00f3, 0xd699, 0x1471, 0x1e30, 0xdcd8,
+    0xff9d, 0x3d75, 0x3734, 0xf5dc, 0x23b6, 0xe15e, 0xeb1f, 0x29f7,
+    0xad95, 0x6f7d, 0x653c, 0xa7d4, 0x71be, 0xb356, 0xb917, 0x7bff,
+    0x58ba, 0x9a52, 0x9013, 0x52fb, 0x8491, 0x4679, 0x4c38, 0x8ed0,
+    0x0985, 0xcb6d, 0xc12c, 0x03c4, 0xd5ae, 0x1746, 0x1d07, 0xdfef,
+    0xfcaa, 0x3e42, 0x3403, 0xf6eb, 0x2081, 0xe269, 0xe828, 0x2ac0,
+    0xaea2, 0x6c4a, 0x660b, 0xa4e3, 0x7289, 0xb061, 0xba20, 0x78c8,
+    0x5b8d, 0x9965, 0x9324, 0x51cc, 0x87a6, 0x454e, 0x4f0f, 0x8de7
+  }
+};
+
+#define XMODEM_T(i)     xmodem_crctable[(i) & 0xff]
+#define DNP_T(i)        dnp_crctable[(i) & 0xff]
+#define MODBUS_T(i)     modbus_crctable[(i) & 0xff]
+
+#elif (CRC_KERNEL == CRC_KERNEL_NIBBLE)
+/*
+ * Nibble tables, 64 bytes each instead of 512. The byte tables are
+ * linear, so table[i] == [0][i & 0x0f] ^ [1][i >> 4].
+ */
+static const uint16_t xmodem_crcnib[2][16] = {
+  {
+    0x0000, 0x1189, 0x2312, 0x329b, 0x4624, 0x57ad, 0x6536, 0x74bf,
+    0x8c48, 0x9dc1, 0xaf5a, 0xbed3, 0xca6c, 0xdbe5, 0xe97e, 0xf8f7
+  },
+  {
+    0x0000, 0x1081, 0x2102, 0x3183, 0x4204, 0x5285, 0x6306, 0x7387,
+    0x8408, 0x9489, 0xa50a, 0xb58b, 0xc60c, 0xd68d, 0xe70e, 0xf78f
+  }
+};
+
+static const uint16_t dnp_crcnib[2][16] = {
+  {
+    0x0000, 0x365e, 0x6cbc, 0x5ae2, 0xd978, 0xef26, 0xb5c4, 0x839a,
+    0xff89, 0xc9d7, 0x9335, 0xa56b, 0x26f1, 0x10af, 0x4a4d, 0x7c13
+  },
+  {
+    0x0000, 0xb26b, 0x29af, 0x9bc4, 0x535e, 0xe135, 0x7af1, 0xc89a,
+    0xa6bc, 0x14d7, 0x8f13, 0x3d78, 0xf5e2, 0x4789, 0xdc4d, 0x6e26
+  }
+};
+
+#define XMODEM_T(i)     (xmodem_crcnib[0][(i) & 0x0f] ^ xmodem_crcnib[1][((i) >> 4) & 0x0f])
+static const uint16_t modbus_crcnib[2][16] = {
+  {
+    0x0000, 0xc0c1, 0xc181, 0x0140, 0xc301, 0x03c0, 0x0280, 0xc241,
+    0xc601, 0x06c0, 0x0780, 0xc741, 0x0500, 0xc5c1, 0xc481, 0x0440
+  },
+  {
+    0x0000, 0xcc01, 0xd801, 0x1400, 0xf001, 0x3c00, 0x2800, 0xe401,
+    0xa001, 0x6c00, 0x7800, 0xb401, 0x5000, 0x9c01, 0x8801, 0x4400
+  }
+};
+
+#define DNP_T(i)        (dnp_crcnib[0][(i) & 0x0f] ^ dnp_crcnib[1][((i) >> 4) & 0x0f])
+#define MODBUS_T(i)     (modbus_crcnib[0][(i) & 0x0f] ^ modbus_crcnib[1][((i) >> 4) & 0x0f])
+
+#else
+#define XMODEM_T(i)     xmodem_crctable[(i) & 0xff]
+#define DNP_T(i)        dnp_crctable[(i) & 0xff]
+#define MODBUS_T(i)     modbus_crctable[(i) & 0xff]
+#endif
+
 /*
  * Initialize CRC value.
  */
@@ -146,15 +467,25 @@ crc_xmodem_init(void)
 /*
  * Append data block to CRC.
  */
-uint16_t
+RAMFUNC uint16_t
 crc_xmodem(uint16_t crc, const void *addr_v, unsigned int len)
 {
     const uint8_t *addr = (const uint8_t *)addr_v;
     uint8_t ch;
 
+#if (CRC_KERNEL == CRC_KERNEL_SLICE4)
+    /* data enters at the top here, the last two bytes skip the tables */
+    while (len >= 4) {
+        crc = xmodem_crctable4[2][crc & 0xff] ^ xmodem_crctable4[1][crc >> 8] ^
+              xmodem_crctable4[0][addr[0]] ^ xmodem_crctable[addr[1]] ^
+              (addr[2] | (addr[3] << 8));
+        addr += 4;
+        len -= 4;
+    }
+#endif
     while (len--) {
         ch = *addr++;
-        crc = xmodem_crctable[crc & 0xff] ^ (crc >> 8) ^ (ch << 8);
+        crc = XMODEM_T(crc) ^ (crc >> 8) ^ (ch << 8);
     }
     return (crc);
 }
@@ -172,20 +503,36 @@ crc16_init(void)
     return CRC16_INITIAL;
 }
 
-uint16_t
+RAMFUNC uint16_t
 crc16(uint16_t crc, const  void *addr_v, unsigned int len)
 {
     const uint8_t *addr = (const uint8_t *)addr_v;
     uint8_t ch;
 
+#if (CRC_KERNEL == CRC_KERNEL_SLICE4)
+    while (len >= 4) {
+        crc ^= addr[0] | (addr[1] << 8);
+        crc = xmodem_crctable4[2][crc & 0xff] ^ xmodem_crctable4[1][crc >> 8] ^
+              xmodem_crctable4[0][addr[2]] ^ xmodem_crctable[addr[3]];
+        addr += 4;
+        len -= 4;
+    }
+#endif
     while (len--) {
         ch = *addr++;
-        crc = (crc >> 8) ^ xmodem_crctable[(crc ^ ch) & 0xFF]; 
+        crc = (crc >> 8) ^ XMODEM_T(crc ^ ch); 
 
     }
     return crc;
 }    
 
+/* Single byte step of crc16(), for callers that see bytes one at a time */
+RAMFUNC uint16_t
+crc16_byte(uint16_t crc, uint8_t ch)
+{
+    return (crc >> 8) ^ XMODEM_T(crc ^ ch);
+}
+
 
 /* len includes the 2 bytes of CRC at the end of the buffer 
  * return 0 for OK, nonzero for error
@@ -201,14 +548,176 @@ uint16_t
 crc_dnp(const uint8_t *data, int len)
 {
     uint16_t crc;
-    int i;
+    int i = 0;
 
     crc = 0;
+#if (CRC_KERNEL == CRC_KERNEL_SLICE4)
+    for (; i + 4 <= len; i += 4) {
+        crc ^= data[i] | (data[i + 1] << 8);
+        crc = dnp_crctable4[2][crc & 0xff] ^ dnp_crctable4[1][crc >> 8] ^
+              dnp_crctable4[0][data[i + 2]] ^ dnp_crctable[data[i + 3]];
+    }
+#endif
+    for (; i < len; ++i) {
+        crc = crc >> 8 ^ DNP_T(crc ^ data[i]);
+    }
+
+    return ~crc;
+}
+
+
+/* Modbus RTU frames are short, the byte loop is enough here */
+uint16_t
+crc_modbus(const uint8_t *data, int len)
+{
+    uint16_t crc = 0xffff;
+    int i;
+
     for (i = 0; i < len; ++i) {
-        crc = crc >> 8 ^ dnp_crctable[(crc ^ data[i])&0xFF];
+        crc = crc >> 8 ^ MODBUS_T(crc ^ data[i]);
     }
 
+    return crc;
+}
+
+
+/* Only images are checked with CRC-32, the nibble table is enough and
+ * takes 64 bytes in any CRC_KERNEL */
+static const uint32_t crc32_crcnib[16] = {
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+    0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+    0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+    0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+};
+
+uint32_t
+crc32_init(void)
+{
+    return (0xffffffff);
+}
+
+uint32_t
+crc32(uint32_t crc, const void *addr_v, unsigned int len)
+{
+    const uint8_t *addr = (const uint8_t *)addr_v;
+
+    while (len--) {
+        crc ^= *addr++;
+        crc = (crc >> 4) ^ crc32_crcnib[crc & 0x0f];
+        crc = (crc >> 4) ^ crc32_crcnib[crc & 0x0f];
+    }
+    return (crc);
+}
+
+uint32_t
+crc32_final(uint32_t crc)
+{
+    return (~crc);
+}
+
+
+#ifdef CRC_BENCH
+
+#if (CRC_KERNEL == CRC_KERNEL_SLICE4)
+#define CRC_KERNEL_NAME "slice4"
+#elif (CRC_KERNEL == CRC_KERNEL_NIBBLE)
+#define CRC_KERNEL_NAME "nibble"
+#else
+#define CRC_KERNEL_NAME "table"
+#endif
+
+/* The byte table loops the kernels are measured against */
+static uint16_t bench_crc16_ref(const uint8_t *data, int len)
+{
+    uint16_t crc = CRC16_INITIAL;
+
+    while (len--) {
+        crc = (crc >> 8) ^ xmodem_crctable[(crc ^ *data++) & 0xFF];
+    }
+    return crc;
+}
+
+static uint16_t bench_crc16(const uint8_t *data, int len)
+{
+    return crc16(CRC16_INITIAL, data, len);
+}
+
+static uint16_t bench_xmodem_ref(const uint8_t *data, int len)
+{
+    uint16_t crc = crc_xmodem_init();
+
+    while (len--) {
+        crc = xmodem_crctable[crc & 0xff] ^ (crc >> 8) ^ (*data++ << 8);
+    }
+    return crc;
+}
+
+static uint16_t bench_xmodem(const uint8_t *data, int len)
+{
+    return crc_xmodem(crc_xmodem_init(), data, len);
+}
+
+static uint16_t bench_dnp_ref(const uint8_t *data, int len)
+{
+    uint16_t crc = 0;
+
+    while (len--) {
+        crc = crc >> 8 ^ dnp_crctable[(crc ^ *data++) & 0xFF];
+    }
     return ~crc;
 }
 
+static const struct {
+    const char *name;
+    uint16_t (*ref)(const uint8_t *, int);
+    uint16_t (*fn)(const uint8_t *, int);
+} crc_bench_fns[] = {
+    { "crc16", bench_crc16_ref, bench_crc16 },
+    { "xmodem", bench_xmodem_ref, bench_xmodem },
+    { "dnp", bench_dnp_ref, crc_dnp },
+};
+
+/* S frame, Modbus request, typical CoAP and full HDLC info */
+static const int crc_bench_len[] = { 7, 8, 64, 128, 255 };
+
+/* SysTick counts core clocks down from LOAD and reloads every ms.  Runs
+ * here are well under a ms and made with interrupts off, so there is at
+ * most one reload to account for.
+ */
+static uint32_t crc_bench_run(uint16_t (*fn)(const uint8_t *, int),
+                              const uint8_t *data, int len, uint16_t *crc)
+{
+    uint32_t start, end;
+
+    noInterrupts();
+    start = SysTick->VAL;
+    *crc = fn(data, len);
+    end = SysTick->VAL;
+    interrupts();
+
+    return (start >= end) ? start - end : start + SysTick->LOAD + 1 - end;
+}
+
+void crc_bench(void)
+{
+    static uint8_t data[255];
+    uint32_t ref_cycles, cycles;
+    uint16_t ref_crc, crc;
+    unsigned int f, l;
+
+    for (l = 0; l < sizeof(data); l++) {
+        data[l] = (uint8_t)(l * 7 + 3);
+    }
+
+    for (f = 0; f < sizeof(crc_bench_fns) / sizeof(crc_bench_fns[0]); f++) {
+        for (l = 0; l < sizeof(crc_bench_len) / sizeof(crc_bench_len[0]); l++) {
+            ref_cycles = crc_bench_run(crc_bench_fns[f].ref, data, crc_bench_len[l], &ref_crc);
+            cycles = crc_bench_run(crc_bench_fns[f].fn, data, crc_bench_len[l], &crc);
+            DLOG_INFO("%s %3d bytes: table %5lu " CRC_KERNEL_NAME " %5lu cycles%s",
+                 crc_bench_fns[f].name, crc_bench_len[l], ref_cycles, cycles,
+                 (crc == ref_crc) ? "" : " MISMATCH");
+        }
+    }
+}
 
+#endif /* CRC_BENCH */
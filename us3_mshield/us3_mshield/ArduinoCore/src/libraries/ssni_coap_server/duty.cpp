@@ -0,0 +1,142 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+#include "duty.h"
+
+
+#if DUTY
+static uint64_t duty_time_us[DUTY_STATES];
+static uint32_t duty_count[DUTY_STATES];
+static uint32_t duty_since_us;      /* micros() the current state was entered */
+static uint8_t duty_state = DUTY_RUN;
+
+static const char *duty_names[DUTY_STATES] = { "run", "idle", "standby", "link", "sensor", "log" };
+
+#ifdef DUTY_PINS
+static const int8_t duty_pin[DUTY_STATES] = { DUTY_PINS };
+#endif
+
+
+/* Give the time since the last switch to the current state, then go to state */
+static void
+duty_switch(uint8_t state)
+{
+    uint32_t now = micros();
+
+    duty_time_us[duty_state] += now - duty_since_us;
+    duty_since_us = now;
+#ifdef DUTY_PINS
+    if (duty_pin[duty_state] >= 0) {
+        digitalWrite(duty_pin[duty_state], LOW);
+    }
+    if (duty_pin[state] >= 0) {
+        digitalWrite(duty_pin[state], HIGH);
+    }
+#endif
+    duty_state = state;
+}
+
+
+void
+duty_init(void)
+{
+#ifdef DUTY_PINS
+    uint8_t i;
+
+    for (i = 0; i < DUTY_STATES; i++) {
+        if (duty_pin[i] >= 0) {
+            pinMode(duty_pin[i], OUTPUT);
+            digitalWrite(duty_pin[i], i == duty_state ? HIGH : LOW);
+        }
+    }
+#endif
+}
+
+
+uint8_t
+duty_enter(uint8_t state)
+{
+    uint8_t prev = duty_state;
+
+    if (state >= DUTY_STATES || state == prev) {
+        return prev;
+    }
+    duty_switch(state);
+    duty_count[state]++;
+    return prev;
+}
+
+
+void
+duty_exit(uint8_t prev)
+{
+    if (prev != duty_state) {
+        duty_switch(prev);
+    }
+}
+
+
+uint64_t
+duty_us(uint8_t state)
+{
+    if (state >= DUTY_STATES) {
+        return 0;
+    }
+    if (state == duty_state) {
+        return duty_time_us[state] + (uint32_t)(micros() - duty_since_us);
+    }
+    return duty_time_us[state];
+}
+
+
+uint32_t
+duty_entries(uint8_t state)
+{
+    return state < DUTY_STATES ? duty_count[state] : 0;
+}
+
+
+const char *
+duty_name(uint8_t state)
+{
+    return state < DUTY_STATES ? duty_names[state] : "";
+}
+
+
+void
+duty_clear(void)
+{
+    memset(duty_time_us, 0, sizeof(duty_time_us));
+    memset(duty_count, 0, sizeof(duty_count));
+    duty_since_us = micros();
+}
+#endif
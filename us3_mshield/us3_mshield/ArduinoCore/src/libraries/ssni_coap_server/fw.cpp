@@ -0,0 +1,718 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+
+
+#include <Arduino.h>
+#include <SPIMemory.h>
+#include <stddef.h>
+#include <string.h>
+#include "fw.h"
+#include "sapi.h"
+#include "hbuf.h"
+#include "cbor.h"
+#include "coapmsg.h"
+#include "coappdu.h"
+#include "crc_xmodem.h"
+#include "log.h"
+#include "sched.h"
+#include "sha256.h"
+
+
+/* The transfer going on, in image offsets */
+struct fw {
+    uint32_t next;              /* Next block, 0 -> no transfer */
+    uint32_t last;              /* The block before, answered again when repeated */
+    uint32_t erased;            /* Sectors erased up to here */
+    uint32_t max;               /* Longest image, the SPI flash and the MCU flash */
+    uint32_t crc;               /* crc32 so far */
+    uint32_t expect;            /* CRC-32 given with the first block */
+    uint32_t vec[2];            /* Stack and reset vector of the image */
+    uint8_t mac[SHA256_SIZE];   /* MAC given with the first block */
+    struct hmac_sha256 hmac;    /* MAC so far */
+};
+
+/* Code of the install stub, in its rows ahead of the application. It calls
+ * nothing outside them and reads no constant data. */
+#define FW_STUB                 __attribute__ ((section (".fwstub"), noinline, noclone))
+#define FW_ROW                  (FLASH_PAGE_SIZE * NVMCTRL_ROW_PAGES)
+
+// SPI flash of SAPI, out of deep power-down before each access
+extern SPIFlash flash;
+void sapi_flash_wake();
+
+// Of the linker script
+extern uint32_t __StackTop;
+extern const uint32_t __app_start__[];
+
+static struct fw fw;
+static struct sched_task fw_task;
+
+FW_STUB static void fw_stub_reset(void);
+
+/* Where the bootloader jumps, ahead of the stub */
+__attribute__ ((section (".fwstub.vectors"), used))
+static void *const fw_stub_vectors[2] = {
+    (void *)&__StackTop,
+    (void *)fw_stub_reset,
+};
+
+
+/* Longest image, what the SPI flash has after FW_IMG_ADDR and the MCU flash
+ * from the application on. 0 -> no room. */
+static uint32_t
+fw_max(void)
+{
+    uint32_t cap = flash.getCapacity();
+    uint32_t app = FLASH_SIZE - SCB->VTOR;
+
+    if (cap <= FW_IMG_ADDR) {
+        return 0;
+    }
+    return (cap - FW_IMG_ADDR < app) ? cap - FW_IMG_ADDR : app;
+}
+
+
+/* The MAC key, false if none is set */
+static bool
+fw_key(uint8_t *key)
+{
+    uint8_t i;
+
+    memcpy(key, (const void *)FW_KEY_ADDR, FW_KEY_SIZE);
+    for (i = 0; i < FW_KEY_SIZE; i++) {
+        if (key[i] != 0xFF) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/* The MAC ends with the len and crc of the header, little endian */
+static void
+fw_mac_final(struct hmac_sha256 *h, uint32_t len, uint32_t crc, uint8_t *mac)
+{
+    uint8_t tail[8];
+    uint8_t i;
+
+    for (i = 0; i < 4; i++) {
+        tail[i] = len >> (8 * i);
+        tail[4 + i] = crc >> (8 * i);
+    }
+    hmac_sha256_update(h, tail, sizeof(tail));
+    hmac_sha256_final(h, mac);
+}
+
+
+/* 0 if the MACs match, in the same time wherever they differ */
+static uint8_t
+fw_mac_cmp(const uint8_t *a, const uint8_t *b)
+{
+    uint8_t d = 0;
+    uint8_t i;
+
+    for (i = 0; i < SHA256_SIZE; i++) {
+        d |= a[i] ^ b[i];
+    }
+    return d;
+}
+
+
+/* The staged image against the CRC and MAC of its header, read back a page
+ * at a time */
+static sapi_error_t
+fw_check(const struct fw_hdr *hdr)
+{
+    uint8_t buf[FLASH_PAGE_SIZE];
+    uint8_t key[FW_KEY_SIZE];
+    uint8_t mac[SHA256_SIZE];
+    struct hmac_sha256 h;
+    uint32_t crc;
+    uint32_t off;
+    uint16_t n;
+
+    if (!fw_key(key)) {
+        return SAPI_ERR_FAIL;
+    }
+    hmac_sha256_init(&h, key, sizeof(key));
+    memset(key, 0, sizeof(key));
+    crc = crc32_init();
+    for (off = 0; off < hdr->len; off += n) {
+        n = (hdr->len - off < sizeof(buf)) ? hdr->len - off : sizeof(buf);
+        if (sapi_flash_read(FW_IMG_ADDR + off, buf, n) != SAPI_ERR_OK) {
+            return SAPI_ERR_FAIL;
+        }
+        crc = crc32(crc, buf, n);
+        hmac_sha256_update(&h, buf, n);
+    }
+    fw_mac_final(&h, hdr->len, hdr->crc, mac);
+    if (crc32_final(crc) != hdr->crc || fw_mac_cmp(mac, hdr->mac)) {
+        return SAPI_ERR_FAIL;
+    }
+    return SAPI_ERR_OK;
+}
+
+
+/* One byte each way on the SPI flash SERCOM */
+FW_STUB static uint8_t
+fw_spi(uint8_t out)
+{
+    volatile SercomSpi *spi = &SERCOM5->SPI;
+
+    while (!spi->INTFLAG.bit.DRE) {
+        ;
+    }
+    spi->DATA.reg = out;
+    while (!spi->INTFLAG.bit.RXC) {
+        ;
+    }
+    return spi->DATA.reg;
+}
+
+
+/* Select the SPI flash and send cmd, with a 24 bit address unless none */
+FW_STUB static void
+fw_spi_cmd(uint8_t cmd, bool has_addr, uint32_t addr)
+{
+    PORT->Group[FW_SPI_CS >> 5].OUTCLR.reg = 1UL << (FW_SPI_CS & 31);
+    (void)fw_spi(cmd);
+    if (has_addr) {
+        (void)fw_spi((uint8_t)(addr >> 16));
+        (void)fw_spi((uint8_t)(addr >> 8));
+        (void)fw_spi((uint8_t)addr);
+    }
+}
+
+
+FW_STUB static void
+fw_spi_end(void)
+{
+    PORT->Group[FW_SPI_CS >> 5].OUTSET.reg = 1UL << (FW_SPI_CS & 31);
+}
+
+
+/* A pin to its peripheral, pinmux a PINMUX_ of the device header */
+__attribute__ ((always_inline))
+static inline void
+fw_spi_pmux(uint32_t pinmux)
+{
+    volatile PortGroup *port = &PORT->Group[pinmux >> 21];
+    const uint32_t pin = (pinmux >> 16) & 31;
+    const uint8_t mux = pinmux & 0xF;
+
+    if (pin & 1) {
+        port->PMUX[pin >> 1].reg = (port->PMUX[pin >> 1].reg & PORT_PMUX_PMUXE_Msk) | PORT_PMUX_PMUXO(mux);
+    } else {
+        port->PMUX[pin >> 1].reg = (port->PMUX[pin >> 1].reg & PORT_PMUX_PMUXO_Msk) | PORT_PMUX_PMUXE(mux);
+    }
+    port->PINCFG[pin].reg |= PORT_PINCFG_PMUXEN;
+}
+
+
+/* The SPI flash SERCOM from reset, as the variant has it, and the flash
+ * out of deep power-down */
+FW_STUB static void
+fw_spi_init(void)
+{
+    volatile SercomSpi *spi = &SERCOM5->SPI;
+    volatile uint32_t n;
+
+    MCLK->APBDMASK.reg |= MCLK_APBDMASK_SERCOM5;
+    GCLK->PCHCTRL[SERCOM5_GCLK_ID_CORE].reg = GCLK_PCHCTRL_GEN_GCLK0 | GCLK_PCHCTRL_CHEN;
+    while (!(GCLK->PCHCTRL[SERCOM5_GCLK_ID_CORE].reg & GCLK_PCHCTRL_CHEN)) {
+        ;
+    }
+    fw_spi_pmux(FW_SPI_MISO);
+    fw_spi_pmux(FW_SPI_MOSI);
+    fw_spi_pmux(FW_SPI_SCK);
+    fw_spi_end();
+    PORT->Group[FW_SPI_CS >> 5].DIRSET.reg = 1UL << (FW_SPI_CS & 31);
+
+    spi->CTRLA.reg = SERCOM_SPI_CTRLA_SWRST;
+    while (spi->SYNCBUSY.reg & SERCOM_SPI_SYNCBUSY_SWRST) {
+        ;
+    }
+    spi->CTRLA.reg = SERCOM_SPI_CTRLA_MODE(SPI_MASTER_OPERATION) |
+            SERCOM_SPI_CTRLA_DOPO(PAD_SPI_TX) | SERCOM_SPI_CTRLA_DIPO(PAD_SPI_RX);
+    spi->CTRLB.reg = SERCOM_SPI_CTRLB_RXEN;
+    while (spi->SYNCBUSY.reg & SERCOM_SPI_SYNCBUSY_CTRLB) {
+        ;
+    }
+    spi->BAUD.reg = FW_SPI_BAUD;
+    spi->CTRLA.reg |= SERCOM_SPI_CTRLA_ENABLE;
+    while (spi->SYNCBUSY.reg & SERCOM_SPI_SYNCBUSY_ENABLE) {
+        ;
+    }
+
+    fw_spi_cmd(RELEASE, false, 0);
+    fw_spi_end();
+    for (n = 0; n < FW_SPI_RES_LOOPS; n++) {
+        ;
+    }
+}
+
+
+/* Whether row r of the image is marked copied */
+FW_STUB static bool
+fw_stub_copied(uint32_t r)
+{
+    uint8_t mark;
+
+    fw_spi_cmd(READDATA, true, FW_MARKS + r);
+    mark = fw_spi(0xFF);
+    fw_spi_end();
+    return mark == 0;
+}
+
+
+/* Mark row r copied, once the SPI flash is done with it */
+FW_STUB static void
+fw_stub_mark(uint32_t r)
+{
+    fw_spi_cmd(WRITEENABLE, false, 0);
+    fw_spi_end();
+    fw_spi_cmd(PAGEPROG, true, FW_MARKS + r);
+    (void)fw_spi(0);
+    fw_spi_end();
+
+    fw_spi_cmd(READSTAT1, false, 0);
+    while (fw_spi(0xFF) & 1) {
+        ;
+    }
+    fw_spi_end();
+}
+
+
+/* An NVM command on the row or page of addr, when it is done */
+FW_STUB static void
+fw_stub_nvm(uint32_t addr, uint32_t cmd)
+{
+    NVMCTRL->STATUS.reg = NVMCTRL_STATUS_MASK;
+    NVMCTRL->ADDR.reg = addr / 2;
+    NVMCTRL->CTRLA.reg = cmd | NVMCTRL_CTRLA_CMDEX_KEY;
+    while (!(NVMCTRL->INTFLAG.reg & NVMCTRL_INTFLAG_READY)) {
+        ;
+    }
+}
+
+
+/* Erase row r of the application and write it from the image, little
+ * endian words into the page buffer. Its first page goes last. The image
+ * sectors are erased past its end, the rest of a row comes out erased. */
+FW_STUB static void
+fw_stub_row(uint32_t app, uint32_t r)
+{
+    const uint32_t row = app + r * FW_ROW;
+    uint32_t page;
+    uint32_t word;
+    uint32_t i;
+    uint32_t p;
+    uint8_t b;
+
+    fw_stub_nvm(row, NVMCTRL_CTRLA_CMD_ER);
+    for (p = 1; p <= NVMCTRL_ROW_PAGES; p++) {
+        page = row + (p % NVMCTRL_ROW_PAGES) * FLASH_PAGE_SIZE;
+        fw_spi_cmd(READDATA, true, FW_IMG_ADDR + (page - app));
+        for (i = 0; i < FLASH_PAGE_SIZE; i += 4) {
+            word = 0;
+            for (b = 0; b < 32; b += 8) {
+                word |= (uint32_t)fw_spi(0xFF) << b;
+            }
+            *(volatile uint32_t *)(page + i) = word;
+        }
+        fw_spi_end();
+        fw_stub_nvm(page, NVMCTRL_CTRLA_CMD_WP);
+    }
+}
+
+
+/*
+ * Copy the staged image of len bytes over the application, the rows not
+ * marked, then reset. With interrupts off, run from the MCU flash, which
+ * stalls the core while a row is erased or a page written. Row 0 is erased
+ * first and written last, a reset in between leaves the vectors erased.
+ */
+FW_STUB static void
+fw_stub_install(uint32_t len)
+{
+    const uint32_t app = (uint32_t)(uintptr_t)__app_start__;
+    const uint32_t rows = (len + FW_ROW - 1) / FW_ROW;
+    uint32_t row;
+    uint32_t r;
+
+    fw_spi_init();
+    NVMCTRL->CTRLB.reg |= NVMCTRL_CTRLB_MANW;
+    fw_stub_nvm(app, NVMCTRL_CTRLA_CMD_PBC);
+
+    if (!fw_stub_copied(0)) {
+        fw_stub_nvm(app, NVMCTRL_CTRLA_CMD_ER);
+        for (r = 1; r <= rows; r++) {
+            row = (r < rows) ? r : 0;
+            if (!fw_stub_copied(row)) {
+                fw_stub_row(app, row);
+                fw_stub_mark(row);
+            }
+        }
+    }
+
+    SCB->AIRCR = (0x5FAUL << SCB_AIRCR_VECTKEY_Pos) | SCB_AIRCR_SYSRESETREQ_Msk;
+    while (true) {
+        ;
+    }
+}
+
+
+/*
+ * Reset, from the bootloader. Into the application, unless its vectors are
+ * erased. A copy was cut short then, the header still installing, and the
+ * stub copies the rest. Nothing runs otherwise.
+ */
+FW_STUB static void
+fw_stub_reset(void)
+{
+    const uint32_t *app = __app_start__;
+    uint32_t len = 0;
+    uint16_t magic;
+    uint8_t state;
+    uint8_t b;
+
+    if (app[1] == 0xFFFFFFFFUL) {
+        /* struct fw_hdr a byte at a time */
+        fw_spi_init();
+        fw_spi_cmd(READDATA, true, FW_ADDR);
+        magic = fw_spi(0xFF);
+        magic |= (uint16_t)fw_spi(0xFF) << 8;
+        state = fw_spi(0xFF);
+        (void)fw_spi(0xFF);
+        for (b = 0; b < 32; b += 8) {
+            len |= (uint32_t)fw_spi(0xFF) << b;
+        }
+        fw_spi_end();
+
+        if (magic == FW_MAGIC && state == FW_INSTALLING && len && len <= FLASH_SIZE - (uint32_t)(uintptr_t)app) {
+            fw_stub_install(len);
+        }
+        while (true) {
+            ;
+        }
+    }
+
+    SCB->VTOR = (uint32_t)(uintptr_t)app;
+    __asm volatile ("msr msp, %0\n\tbx %1" : : "r" (app[0]), "r" (app[1]));
+}
+
+
+/* The first row of the RWW EEPROM erased and its first page written, read
+ * back */
+bool
+fw_key_set(const uint8_t *key)
+{
+    volatile uint32_t *dst = (volatile uint32_t *)FW_KEY_ADDR;
+    uint32_t word;
+    uint8_t i;
+
+    fw_stub_nvm(FW_KEY_ADDR, NVMCTRL_CTRLA_CMD_RWWEEER);
+    fw_stub_nvm(FW_KEY_ADDR, NVMCTRL_CTRLA_CMD_PBC);
+    for (i = 0; i < FW_KEY_SIZE; i += sizeof(word)) {
+        memcpy(&word, &key[i], sizeof(word));
+        dst[i / sizeof(word)] = word;
+    }
+    fw_stub_nvm(FW_KEY_ADDR, NVMCTRL_CTRLA_CMD_RWWEEWP);
+    return !memcmp((const void *)FW_KEY_ADDR, key, FW_KEY_SIZE);
+}
+
+
+/* The image is checked in the SPI flash once more, the MCU flash after the
+ * copy */
+void
+fw_boot(void)
+{
+    const uint32_t state = FW_ADDR + offsetof(struct fw_hdr, state);
+    struct fw_hdr hdr;
+    uint8_t mark;
+
+    if (sapi_flash_read(FW_ADDR, &hdr, sizeof(hdr)) != SAPI_ERR_OK || hdr.magic != FW_MAGIC) {
+        return;
+    }
+    if (hdr.state == FW_INSTALLING &&
+            crc32_final(crc32(crc32_init(), (const void *)SCB->VTOR, hdr.len)) == hdr.crc) {
+        (void)flash.writeByte(state, FW_DONE);
+        DLOG_INFO("Firmware of %lu bytes installed", hdr.len);
+        return;
+    }
+    if (hdr.state == FW_INSTALLING &&
+            sapi_flash_read(FW_MARKS, &mark, sizeof(mark)) == SAPI_ERR_OK && mark == 0) {
+        /* Every row marked copied, another copy would change nothing */
+        DLOG_ERR("Installed firmware fails its CRC");
+        (void)flash.writeByte(state, FW_DONE);
+        return;
+    }
+    if (hdr.state != FW_PENDING && hdr.state != FW_INSTALLING) {
+        return;
+    }
+
+    if (hdr.len > fw_max() || fw_check(&hdr) != SAPI_ERR_OK) {
+        DLOG_ERR("Staged firmware fails its CRC or MAC, dropped");
+        (void)flash.writeByte(state, FW_DONE);
+        return;
+    }
+    if (hdr.state == FW_PENDING && !flash.writeByte(state, FW_INSTALLING)) {
+        return;
+    }
+
+    /* The log drains before interrupts go off */
+    DLOG_INFO("Installing firmware of %lu bytes", hdr.len);
+    (void)log_drain();
+    delay(100);
+    __disable_irq();
+    fw_stub_install(hdr.len);
+}
+
+
+/* POST /sys/fw, once the response is out */
+static void
+fw_reset_run(struct sched_task *t)
+{
+    (void)t;
+    NVIC_SystemReset();
+}
+
+
+void
+fw_start(void)
+{
+    (void)sched_add(&fw_task, "fw", fw_reset_run, 0);
+}
+
+
+/* The staged firmware for GET, a CBOR map of its state, length and CRC, and
+ * the bytes of a transfer going on */
+static error_t
+fw_status(struct coap_msg_ctx *rsp)
+{
+    struct cbor_buf cbuf;
+    struct fw_hdr hdr;
+    const char *state;
+    int rc;
+
+    if (sapi_flash_read(FW_ADDR, &hdr, sizeof(hdr)) != SAPI_ERR_OK) {
+        rsp->code = COAP_RSP_500_INTERNAL_ERROR;
+        rsp->plen = 0;
+        return ERR_OK;
+    }
+    if (hdr.magic != FW_MAGIC) {
+        state = "none";
+        hdr.len = 0;
+        hdr.crc = 0;
+    } else {
+        state = (hdr.state == FW_PENDING) ? "pending" :
+                (hdr.state == FW_INSTALLING) ? "installing" :
+                (hdr.state == FW_DONE) ? "done" : "none";
+    }
+
+    cbor_enc_init(&cbuf, mtod(rsp->msg, uint8_t *) + rsp->msg->len, M_TRAILINGSPACE(rsp->msg));
+    rc = cbor_enc_map(&cbuf, 4) ||
+            cbor_enc_text(&cbuf, "state", 5) || cbor_enc_text(&cbuf, state, strlen(state)) ||
+            cbor_enc_text(&cbuf, "len", 3) || cbor_enc_uint(&cbuf, hdr.len) ||
+            cbor_enc_text(&cbuf, "crc", 3) || cbor_enc_uint(&cbuf, hdr.crc) ||
+            cbor_enc_text(&cbuf, "rcvd", 4) || cbor_enc_uint(&cbuf, fw.next);
+    if (rc) {
+        rsp->code = COAP_RSP_500_INTERNAL_ERROR;
+        rsp->plen = 0;
+        return ERR_OK;
+    }
+
+    rsp->plen = cbor_buf_get_len(&cbuf);
+    (void)m_append(rsp->msg, rsp->plen);
+    rsp->cf = COAP_CF_APPLICATION_CBOR;
+    rsp->code = COAP_RSP_205_CONTENT;
+    return ERR_OK;
+}
+
+
+/*
+ * GET gives the status, a Block1 PUT takes the image a block at a time and
+ * POST reboots into a pending one. With blocks sent ahead over the HDLC
+ * window they still come in order, each is programmed as it arrives. A
+ * repeat of the last one is answered again without programming it.
+ */
+error_t
+fw_rsp(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, void *it)
+{
+    uint8_t *payload = mtod(req->msg, uint8_t *) + req->hdrlen;
+    uint8_t key[FW_KEY_SIZE];
+    uint8_t crc[4];
+    struct coap_query q;
+    struct coap_block blk;
+    struct fw_hdr hdr;
+    void *qit = NULL;
+    uint32_t off;
+    uint8_t has = 0;
+
+    if (copt_get_next_opt_type((const sl_co*)&(req->oh), COAP_OPTION_URI_PATH, &it)) {
+        rsp->code = COAP_RSP_404_NOT_FOUND;
+        goto err;
+    }
+    copt_del_opt_type((sl_co*)&(rsp->oh), COAP_OPTION_OBSERVE);
+
+    if (req->code == COAP_REQUEST_GET) {
+        return fw_status(rsp);
+    }
+    if (req->code == COAP_REQUEST_POST) {
+        if (sapi_flash_read(FW_ADDR, &hdr, sizeof(hdr)) != SAPI_ERR_OK ||
+                hdr.magic != FW_MAGIC || hdr.state != FW_PENDING) {
+            rsp->code = COAP_RSP_412_PRE_FAILED;
+            goto err;
+        }
+        sapi_flush();
+        sched_at(&fw_task, FW_RESET_MS);
+        rsp->code = COAP_RSP_204_CHANGED;
+        goto err;
+    }
+    if (req->code != COAP_REQUEST_PUT) {
+        rsp->code = COAP_RSP_405_METHOD_NOT_ALLOWED;
+        goto err;
+    }
+
+    /* Only taken block-wise */
+    if (coap_block_get(req, COAP_OPTION_BLOCK1, &blk) != 1 ||
+            (blk.m && req->plen != COAP_BLOCK_SIZE(blk.szx))) {
+        rsp->code = COAP_RSP_400_BAD_REQUEST;
+        goto err;
+    }
+    off = blk.num * COAP_BLOCK_SIZE(blk.szx);
+
+    sapi_flash_wake();
+    if (blk.num == 0) {
+        /* A new image, any staged one goes. The CRC and MAC come with it,
+         * none is taken without a key to check it. */
+        fw.next = 0;
+        while (coap_query_next(req, &qit, &q)) {
+            if (!coap_query_key(&q, FW_QUERY_CRC) && !coap_query_hex(&q, crc, sizeof(crc))) {
+                has |= 1;
+            } else if (!coap_query_key(&q, FW_QUERY_MAC) &&
+                    !coap_query_hex(&q, fw.mac, sizeof(fw.mac))) {
+                has |= 2;
+            }
+        }
+        if (has != 3 || req->plen < (int)sizeof(fw.vec)) {
+            rsp->code = COAP_RSP_400_BAD_REQUEST;
+            goto err;
+        }
+        if (!fw_key(key)) {
+            rsp->code = COAP_RSP_403_FORBIDDEN;
+            goto err;
+        }
+        hmac_sha256_init(&fw.hmac, key, sizeof(key));
+        memset(key, 0, sizeof(key));
+        fw.expect = ((uint32_t)crc[0] << 24) | ((uint32_t)crc[1] << 16) |
+                ((uint32_t)crc[2] << 8) | crc[3];
+        memcpy(fw.vec, payload, sizeof(fw.vec));
+        fw.max = fw_max();
+        fw.crc = crc32_init();
+        fw.erased = 0;
+        if (!flash.eraseSector(FW_ADDR)) {
+            rsp->code = COAP_RSP_500_INTERNAL_ERROR;
+            goto err;
+        }
+    } else if (fw.next && off == fw.last && off + req->plen == fw.next) {
+        goto ack;
+    } else if (!fw.next || off != fw.next) {
+        rsp->code = COAP_RSP_408_REQ_INCOMPLETE;
+        goto err;
+    }
+
+    if (off + req->plen > fw.max) {
+        fw.next = 0;
+        rsp->code = COAP_RSP_413_REQ_TOO_LARGE;
+        goto err;
+    }
+    while (fw.erased < off + req->plen) {
+        if (!flash.eraseSector(FW_IMG_ADDR + fw.erased)) {
+            fw.next = 0;
+            rsp->code = COAP_RSP_500_INTERNAL_ERROR;
+            goto err;
+        }
+        fw.erased += FW_SECTOR;
+    }
+    if (req->plen && !flash.writeByteArray(FW_IMG_ADDR + off, payload, req->plen, false)) {
+        fw.next = 0;
+        rsp->code = COAP_RSP_500_INTERNAL_ERROR;
+        goto err;
+    }
+    fw.crc = crc32(fw.crc, payload, req->plen);
+    hmac_sha256_update(&fw.hmac, payload, req->plen);
+    fw.last = off;
+    fw.next = off + req->plen;
+
+    if (!blk.m) {
+        /* The last block, stage the image if it checks out. The stack must
+         * be in RAM and the reset vector in the image. */
+        fw.next = 0;
+        hdr.magic = FW_MAGIC;
+        hdr.state = FW_PENDING;
+        hdr.pad = 0xFF;
+        hdr.len = off + req->plen;
+        hdr.crc = crc32_final(fw.crc);
+        fw_mac_final(&fw.hmac, hdr.len, hdr.crc, hdr.mac);
+        if (fw_mac_cmp(hdr.mac, fw.mac)) {
+            DLOG_ERR("Firmware image rejected, MAC mismatch");
+            rsp->code = COAP_RSP_403_FORBIDDEN;
+            goto err;
+        }
+        if (hdr.crc != fw.expect ||
+                fw.vec[0] < HSRAM_ADDR || fw.vec[0] > HSRAM_ADDR + HSRAM_SIZE ||
+                fw.vec[1] < SCB->VTOR || fw.vec[1] >= SCB->VTOR + hdr.len) {
+            DLOG_ERR("Firmware image rejected, CRC %08lx for %08lx", hdr.crc, fw.expect);
+            rsp->code = COAP_RSP_406_NOT_ACCEPTABLE;
+            goto err;
+        }
+        if (!flash.writeByteArray(FW_ADDR, (uint8_t *)&hdr, sizeof(hdr))) {
+            rsp->code = COAP_RSP_500_INTERNAL_ERROR;
+            goto err;
+        }
+        DLOG_INFO("Firmware of %lu bytes staged", hdr.len);
+    }
+
+ack:
+    /* Echo the block, 2.31 Continue asks for the next one */
+    if (coap_block_set(rsp, COAP_OPTION_BLOCK1, &blk) != ERR_OK) {
+        rsp->code = COAP_RSP_500_INTERNAL_ERROR;
+        goto err;
+    }
+    rsp->code = blk.m ? COAP_RSP_231_CONTINUE : COAP_RSP_204_CHANGED;
+
+err:
+    rsp->plen = 0;
+    return ERR_OK;
+}
@@ -45,13 +45,51 @@ Networks, Inc.
 
 int malloc_cnt;
 int free_cnt;
+int pool_empty_cnt;
+
+/*
+ * mbufs come from two static pools, so the frame path never touches the heap.
+ * Big ones hold a whole reassembled message (get_mbuf_data_size()), small
+ * ones an HDLC frame or a short CoAP response. Free ones are singly linked
+ * through their first data word.
+ */
+struct mbuf_pool {
+    uint8_t *base;
+    uint16_t stride;
+    uint16_t size;
+    uint8_t cnt;
+    uint8_t nfree;
+    uint8_t nfree_min;  /* low-water mark, for the peak in use */
+    struct mbuf *head;
+};
+
+#define MBUF_POOL_STRIDE(sz)    ((sizeof(struct mbuf) + (sz) + 3) & ~3)
+
+static uint32_t mbuf_big_mem[MBUF_POOL_BIG_CNT *
+                             MBUF_POOL_STRIDE(MBUF_POOL_BIG_SIZE) / 4];
+static uint32_t mbuf_small_mem[MBUF_POOL_SMALL_CNT *
+                               MBUF_POOL_STRIDE(MBUF_POOL_SMALL_SIZE) / 4];
+
+static struct mbuf_pool mbuf_big = {
+    (uint8_t *)mbuf_big_mem, MBUF_POOL_STRIDE(MBUF_POOL_BIG_SIZE),
+    MBUF_POOL_BIG_SIZE, MBUF_POOL_BIG_CNT, 0, 0, NULL
+};
+static struct mbuf_pool mbuf_small = {
+    (uint8_t *)mbuf_small_mem, MBUF_POOL_STRIDE(MBUF_POOL_SMALL_SIZE),
+    MBUF_POOL_SMALL_SIZE, MBUF_POOL_SMALL_CNT, 0, 0, NULL
+};
+static uint8_t mbuf_pool_ready;
+
+#define MBUF_NEXT(m)    (*(struct mbuf **)(m)->data)
+#define MBUF_POOL_HAS(p, m) ((uint8_t *)(m) >= (p)->base && \
+                             (uint8_t *)(m) < (p)->base + (p)->cnt * (p)->stride)
 
 // Set the size of the mbuf data buffer
-static int mbuf_data_buf_size = 0;
+static int mbuf_data_buf_size = MBUF_POOL_BIG_SIZE;
 void set_mbuf_data_size( int buf_size )
 {
-	// Get the size of the mbuf data buffer
-	mbuf_data_buf_size = buf_size;
+	// Get the size of the mbuf data buffer, no bigger than the big pool's
+	mbuf_data_buf_size = min(buf_size, MBUF_POOL_BIG_SIZE);
 	
 } // set_mbuf_size
 
@@ -65,39 +103,153 @@ int get_mbuf_data_size()
 } // get_mbuf_size
 
 
-struct mbuf * m_get()
+static void
+mbuf_pool_init(struct mbuf_pool *p)
+{
+    struct mbuf *m;
+    int i;
+
+    p->head = NULL;
+    for (i = p->cnt - 1; i >= 0; i--) {
+        m = (struct mbuf *)(p->base + i * p->stride);
+        MBUF_NEXT(m) = p->head;
+        p->head = m;
+    }
+    p->nfree = p->cnt;
+    p->nfree_min = p->cnt;
+}
+
+
+static struct mbuf *
+mbuf_pool_get(struct mbuf_pool *p, int size)
 {
     struct mbuf *m;
-	int mbuf_size = sizeof(*m) + mbuf_data_buf_size;
-	dlog(LOG_DEBUG, "Allocate mbuf with size: %d", mbuf_size);
-    m = (struct mbuf *) malloc(mbuf_size);
-    assert(m);
+
+    if (!mbuf_pool_ready) {
+        mbuf_pool_init(&mbuf_big);
+        mbuf_pool_init(&mbuf_small);
+        mbuf_pool_ready = 1;
+    }
+    m = p->head;
+    if (!m) {
+        return NULL;
+    }
+    p->head = MBUF_NEXT(m);
+    p->nfree--;
+    if (p->nfree < p->nfree_min) {
+        p->nfree_min = p->nfree;
+    }
     m->len = 0;
-    m->size = mbuf_data_buf_size;
+    m->size = size;
+    m->off = 0;
+    m->ref = 1;
+    m->next = NULL;
     malloc_cnt++;
     return m;
 }
 
+
+struct mbuf * m_get()
+{
+    struct mbuf *m;
+
+    m = mbuf_pool_get(&mbuf_big, mbuf_data_buf_size);
+    if (!m) {
+        pool_empty_cnt++;
+        DLOG_ERR("mbuf pool empty");
+    }
+    return m;
+}
+
+
+struct mbuf *
+m_get_len(int len)
+{
+    struct mbuf *m = NULL;
+
+    if (len <= MBUF_POOL_SMALL_SIZE) {
+        m = mbuf_pool_get(&mbuf_small, MBUF_POOL_SMALL_SIZE);
+    }
+    if (!m && len <= mbuf_data_buf_size) {
+        return m_get();
+    }
+    return m;
+}
+
+
 void
 m_free(struct mbuf *m)
 {
-    free(m);
-    free_cnt++;
+    struct mbuf_pool *p;
+    struct mbuf *n;
+
+    /* the chain goes with the last reference to its head */
+    if (!m || --m->ref) {
+        return;
+    }
+    for (; m; m = n) {
+        n = m->next;
+        p = MBUF_POOL_HAS(&mbuf_small, m) ? &mbuf_small : &mbuf_big;
+        assert(MBUF_POOL_HAS(p, m));
+        MBUF_NEXT(m) = p->head;
+        p->head = m;
+        p->nfree++;
+        free_cnt++;
+    }
+}
+
+
+int
+m_length(struct mbuf *m)
+{
+    int len = 0;
+
+    for (; m; m = m->next) {
+        len += m->len;
+    }
+    return len;
+}
+
+
+int
+m_pool_peak(int big)
+{
+    struct mbuf_pool *p = big ? &mbuf_big : &mbuf_small;
+
+    return mbuf_pool_ready ? p->cnt - p->nfree_min : 0;
 }
 
 
 struct mbuf *
-m_dup(struct mbuf *m)
+m_ref(struct mbuf *m)
 {
+    m->ref++;
+    return m;
+}
 
-    struct mbuf *n = m_get();
 
-    if (n) {
-        memcpy(n, m, sizeof(*m) + mbuf_data_buf_size);
+struct mbuf *
+m_dup(struct mbuf *m)
+{
+
+    struct mbuf *h = NULL;
+    struct mbuf **t = &h;
+    struct mbuf *n;
+
+    for (; m; m = m->next) {
+        n = m_get_len(m->off + m->len);
+        if (!n) {
+            m_free(h);
+            return NULL;
+        }
+        memcpy(n->data, m->data, m->off + m->len);
+        n->off = m->off;
         n->len = m->len;
+        *t = n;
+        t = &n->next;
     }
 
-    return n;
+    return h;
 
 }
 
@@ -106,27 +258,54 @@ struct mbuf *
 m_prepend(struct mbuf *m, int len)
 {
 
-    if (m->len + len > mbuf_data_buf_size) {
+    if (len <= m->off) {
+        /* from the headroom */
+        m->off -= len;
+        m->len += len;
+        return m;
+    }
+    if (m->len + len > m->size) {
         return NULL;
     }
 
     /* make space at the top of the buffer */
-    memmove(m->data + len, m->data, m->len);
+    memmove(m->data + len, m->data + m->off, m->len);
+    m->off = 0;
     m->len += len;
 
     return m;
 }
 
 
+int
+m_reserve(struct mbuf *m, int len)
+{
+    len = (len + 3) & ~3;
+    if (m->len || len > m->size) {
+        return -1;
+    }
+    m->off = len;
+    return 0;
+}
+
+
 void *
 m_append(struct mbuf *m, int16_t len)
 {
     void *d;
-    if (m->len + len > mbuf_data_buf_size) {
-        return NULL;
+
+    while (m->next) {
+        m = m->next;
+    }
+    if (m->off + m->len + len > m->size) {
+        /* no room in the last buffer, chain another one */
+        if (!(m->next = m_get_len(len))) {
+            return NULL;
+        }
+        m = m->next;
     }
 
-    d = m->data + m->len;
+    d = m->data + m->off + m->len;
     m->len += len;
     
     return d;
@@ -143,10 +322,16 @@ m_copydata(struct mbuf *m, uint32_t off, uint32_t len, void *vp)
     if (!m) {
         return -1;
     }
-    if ((off < m->len) && (len > 0)) {
+    for (; m && len > 0; m = m->next) {
+        if (off >= m->len) {
+            off -= m->len;
+            continue;
+        }
         count = min(m->len - off, len);
-        memcpy(cp, m->data + off, count);
+        memcpy(cp, mtod(m, uint8_t *) + off, count);
+        cp += count;
         len -= count;
+        off = 0;
     }
 
     return (len > 0 ? -1 : 0);
@@ -154,22 +339,85 @@ m_copydata(struct mbuf *m, uint32_t off, uint32_t len, void *vp)
 
 
 
+static uint32_t scratch_mem[SCRATCH_SIZE / 4];
+static int scratch_top;
+static int scratch_high;
+
+void *
+scratch_alloc(int len)
+{
+    void *p;
+
+    len = (len + 3) & ~3;
+    if (len > SCRATCH_SIZE - scratch_top) {
+        /* no dlog, it allocates from here too */
+        return NULL;
+    }
+    p = (uint8_t *)scratch_mem + scratch_top;
+    scratch_top += len;
+    if (scratch_top > scratch_high) {
+        scratch_high = scratch_top;
+    }
+    return p;
+}
+
+
+int
+scratch_mark(void)
+{
+    return scratch_top;
+}
+
+
+void
+scratch_release(int mark)
+{
+    if (mark < scratch_top) {
+        scratch_top = mark;
+    }
+}
+
+
+void
+scratch_reset(void)
+{
+    scratch_top = 0;
+}
+
+
+int
+scratch_peak(void)
+{
+    return scratch_high;
+}
+
+
 void
 m_adj(struct mbuf *mp, int req_len)
 {
+    struct mbuf *m;
+    int len;
+
     if (mp == NULL) {
         return;
     }
-    if ((req_len > mp->len) || (-1*(req_len) > mp->len)) {
-        req_len = mp->len;
-    }
 
     if (req_len >= 0) {
-        /* Trim from head. */
-        mp->len -= req_len;
-        memmove(mp->data, &(mp->data[req_len]), mp->len);
+        /* Trim from head, the bytes become headroom. */
+        for (m = mp; m && req_len > 0; m = m->next) {
+            len = min(m->len, req_len);
+            m->len -= len;
+            m->off += len;
+            req_len -= len;
+        }
     } else {
-        /* Trim from tail. */
-        mp->len += req_len;
+        /* Trim from tail, releasing the buffers left empty past the head. */
+        len = max(m_length(mp) + req_len, 0);
+        for (m = mp; m->next && len > m->len; m = m->next) {
+            len -= m->len;
+        }
+        m->len = len;
+        m_free(m->next);
+        m->next = NULL;
     }
 }
@@ -47,36 +47,108 @@ Networks, Inc.
 #include <arduino.h>
 
 #include "hdlc.h"
+#include "hbuf.h"
 #include "bufutil.h"
 #include "crc_xmodem.h"
 #include "log.h"
+#include "trace.h"
+#include "duty.h"
 #include "coapsensorobs.h"
 
 #define HDLC_SINGLE_BYTE_ADDR_ONLY
 
-// This number is fixed for the Milli Arduino Shield
+// Default rate of the Milli Arduino Shield link
 #define UART_BAUD_RATE 38400
 
 // The max payload size
 static uint32_t max_payload_size = 0;
 
-// Pointer to Serial console and UART
-static HardwareSerial * pU;
-#define uart (*pU)
-void hdlc_init( HardwareSerial * pUART, uint32_t max_info_len )
+// Told from the UART IRQ when the deframer has a frame ready
+static void (*hdlc_rx_notify_fn)( void );
+
+static void hdlc_rx_reset( void );
+static void hdlc_rx_flow( bool ready );
+static int hdlc_tx_clear( void );
+static void hdlc_tx_count( void );
+
+// The mNIC UART. On SAMD it is always a Uart, so its calls are bound to
+// Uart at compile time, not made through the Stream and Print vtables.
+#if defined(ARDUINO_ARCH_SAMD)
+typedef Uart hdlc_port_t;
+#define HDLC_PORT(fn)		pU->Uart::fn
+#else
+typedef HardwareSerial hdlc_port_t;
+#define HDLC_PORT(fn)		pU->fn
+#endif
+static hdlc_port_t * pU;
+
+// Link settings and the baud the UART is running at
+static struct hdlc_link_cfg hlink;
+static uint32_t hlink_baud;
+
+void hdlc_init( HardwareSerial * pUART, const struct hdlc_link_cfg *link, 
+                uint32_t max_info_len )
 {
 	// Set pointer to UART object
-	pU = pUART;
+	pU = static_cast<hdlc_port_t *>(pUART);
+
+	if (link)
+	{
+		hlink = *link;
+	}
+	else
+	{
+		hlink.baud = UART_BAUD_RATE;
+		hlink.fast_baud = 0;
+		hlink.pin_rts = HDLC_LINK_NO_PIN;
+		hlink.pin_cts = HDLC_LINK_NO_PIN;
+	}
 
-	// Set baud rate for the mShield UART
-	// NOTE: This baud rate is fixed and cannot be changed
-	uart.begin(UART_BAUD_RATE);
+#if defined(ARDUINO_ARCH_SAMD)
+	// Flow control pins have to be known before begin()
+	pU->setFlowControl(hlink.pin_rts, hlink.pin_cts);
+#endif
+
+	// Set baud rate for the mShield UART, the fast rate comes with SNRM
+	HDLC_PORT(begin)(hlink.baud);
+	hlink_baud = hlink.baud;
 	
 	// Set the max payload size
 	max_payload_size = max_info_len;
 
+	// Start the deframer hunting for a flag
+	hdlc_rx_reset();
+
+#if defined(ARDUINO_ARCH_SAMD)
+	// Deframe straight from the UART IRQ, the UART is always a Uart on SAMD
+	pU->onReceive(hdlc_rx_byte);
+#endif
+
 } // hdlc_set_serial
 
+
+void hdlc_link_up( int up )
+{
+	uint32_t baud = (up && hlink.fast_baud) ? hlink.fast_baud : hlink.baud;
+
+	if (baud == hlink_baud)
+	{
+		return;
+	}
+
+	// Last frame (the UA) must be on the wire at the old rate
+	hdlc_tx_wait();
+	HDLC_PORT(flush)();
+
+	DLOG_DEBUG("mNIC link %lu -> %lu baud", hlink_baud, baud );
+	HDLC_PORT(begin)(baud);
+	hlink_baud = baud;
+
+	// Anything half received was at the wrong rate
+	hdlc_rx_reset();
+
+} // hdlc_link_up
+
 struct hdlcstat hdlc_stats;
 
 /* HDLC Frame Control field encoders/decoders 
@@ -170,7 +242,7 @@ hdlc_parse_control(uint8_t ctrl, struct hdlc_ctrl *hc)
                 rc = 1;     /* Unknown frame - error */
         }
     }
-    dlog(LOG_DEBUG, "frame type: 0x%x", hc->type);
+    DLOG_DEBUG("frame type: 0x%x", hc->type);
 
     return rc;
 }
@@ -252,35 +324,92 @@ err:
     return 1;
 }
 
-/* Generate updated frame header and 2 byte FCS ready to append 
- * at the tail of info
+/* Encode the parts of a connection's headers that don't change */
+void
+hdlc_hdr_tmpl_init(struct hdlc_hdr_tmpl *t, uint8_t dst, uint8_t src)
+{
+    buf_wbe16(t->h, 0, 0xA000 | HDLC_HDR_SIZE);
+    t->h[2] = dst;
+    t->h[3] = src;
+    t->crc = crc16(crc16_init(), t->h, sizeof(t->h));
+}
+
+/* Build a header from a connection template for a frame carrying infolen
+ * bytes of info.  A bare header only runs the CRC over the control byte.
  */
 int
-hdlc_frm_add_info(const uint8_t *hdr, uint8_t *fhdr, 
-    const uint8_t *info, int infolen, uint8_t *fmfcs)
+hdlc_hdr_tmpl_fill(const struct hdlc_hdr_tmpl *t, int segment, 
+    int16_t fcontrol, int infolen, uint8_t *buf)
 {
-    int fmt, hdrlen;
-    uint16_t hcs, fcs;
+    uint16_t hcs;
+
+    if (fcontrol == HDLC_FC_INVALID) {
+        return 1;
+    }
+
+    memcpy(buf, t->h, sizeof(t->h));
+    buf[4] = fcontrol;
+    if (!segment && infolen <= 0) {
+        hcs = crc16_byte(t->crc, fcontrol);
+    }
+    else {
+        buf_wbe16(buf, 0, 0xA000 | (segment ? 0x0800 : 0) | 
+                  (HDLC_HDR_SIZE + (infolen > 0 ? infolen + HDLC_CRC_SIZE : 0)));
+        hcs = crc16(crc16_init(), buf, HDLC_HDR_SIZE - HDLC_CRC_SIZE);
+    }
+    buf_wle16(buf, HDLC_HDR_SIZE - HDLC_CRC_SIZE, ~hcs);
+
+    return 0;
+}
+
+/* Generate updated frame header for an info field of infolen bytes */
+static int
+hdlc_frm_set_len(const uint8_t *hdr, uint8_t *fhdr, int infolen)
+{
+    int fmt, hdrlen, frmlen;
+    uint16_t hcs;
     
     fmt = buf_be16(hdr, 0);
-    hdrlen = fmt & 0x07FF;
+    frmlen = fmt & 0x07FF;
     fmt = fmt & 0xF800;
+    hdrlen = HDLC_HDR_SIZE;
+
+    memcpy(fhdr, hdr, hdrlen);
 
-    if (hdrlen > HDLC_HDR_MAX) {
+    /* headers from a template already carry the frame length and HCS */
+    if (infolen > 0 && frmlen == hdrlen + infolen + HDLC_CRC_SIZE) {
+        return 0;
+    }
+    if (frmlen > HDLC_HDR_MAX) {
         return 1;
     }
 
-    memcpy(fhdr, hdr, hdrlen);
-
     /* Modify length value (adding infolen + 2(for FCS) and HCS */
     if (infolen > 0) {           
         buf_wbe16(fhdr, 0, fmt | (hdrlen + infolen + 2));
         hcs = crc16(crc16_init(), fhdr, hdrlen - 2);
         buf_wle16(fhdr, hdrlen - 2, ~hcs);
+    }
+    return 0;
+}
 
-        /* Calculate separate FCS */
-        fcs = crc16(crc16_init(), fhdr, hdrlen);
-        fcs = crc16(fcs, info, infolen);
+/* Generate updated frame header and 2 byte FCS ready to append 
+ * at the tail of info
+ */
+int
+hdlc_frm_add_info(const uint8_t *hdr, uint8_t *fhdr, 
+    const uint8_t *info, int infolen, uint8_t *fmfcs)
+{
+    uint16_t fcs;
+
+    if (hdlc_frm_set_len(hdr, fhdr, infolen)) {
+        return 1;
+    }
+
+    if (infolen > 0) {           
+        /* Calculate separate FCS - over a header with a good HCS the
+         * CRC is always CRC16_FINAL, so start from there */
+        fcs = crc16(CRC16_FINAL, info, infolen);
         /* final byte order - ready to be appended to frame */
         buf_wle16(fmfcs, 0, ~fcs);
     }
@@ -446,77 +575,230 @@ hdlc_parse_snrm_param(const uint8_t *buf, uint32_t buflen, struct hdlc_snrm_para
     return 0;
 }
 
+#if defined(ARDUINO_ARCH_SAMD) && defined(UART_DMA_TX)
+#define HDLC_TX_DMA
+#endif
 
-/*
- *****************************************************************************
- *****************************************************************************
- 
-    UART Interface --- driver function implemented using POSIX file ops.
-
- *****************************************************************************
- *****************************************************************************
+/* Frame being transmitted.  The DMAC reads the flags, header and FCS from
+ * here after hdlc_send_frame_async() has returned, so they can't live on
+ * the caller's stack.
  */
+static struct hdlc_tx {
+    uint8_t head[1 + HDLC_HDR_MAX];     /* opening flag and header */
+    uint8_t tail[HDLC_CRC_SIZE + 1];    /* FCS and closing flag */
+    uint8_t taillen;
+    volatile uint8_t busy;
+    volatile uint8_t body_sent;         /* head and info are out */
+    volatile uint8_t fcs_ready;         /* tail is filled in */
+    hdlc_tx_done done;
+    void *arg;
+} htx;
+
+static void hdlc_tx_complete( void )
+{
+    hdlc_tx_done done = htx.done;
 
-int hdlc_send_frame( const uint8_t *hdr, const uint8_t *info, int infolen )
+    htx.busy = 0;
+    if (done) {
+        done(htx.arg);
+    }
+}
+
+int hdlc_tx_busy( void )
+{
+    return htx.busy;
+}
+
+void hdlc_tx_wait( void )
+{
+    DUTY_ENTER(DUTY_LINK);
+
+    while (htx.busy);
+    DUTY_EXIT();
+}
+
+static void hdlc_tx_log( const uint8_t *info, int infolen )
+{
+    log_msg("HDLC send frame", &htx.head[1], HDLC_HDR_SIZE, 0);
+    if (info) {
+        log_msg(NULL, info, infolen, 0);    
+        log_msg(NULL, htx.tail, HDLC_CRC_SIZE, 0);            
+    }
+    log_msg(NULL, NULL, 0, 1);  /* EOL */
+}
+
+#ifdef HDLC_TX_DMA
+/* Send the FCS and closing flag, from the DMAC IRQ or with IRQs off */
+static void hdlc_tx_tail( void )
+{
+    const uint8_t *seg[1] = { htx.tail };
+    uint16_t seglen[1] = { htx.taillen };
+
+    if (!pU->writeDMA(seg, seglen, 1, hdlc_tx_complete)) {
+        HDLC_PORT(write)(htx.tail, htx.taillen);
+        hdlc_tx_complete();
+    }
+}
+
+/* Head and info are out, follow with the tail once the FCS is known */
+static void hdlc_tx_body_done( void )
+{
+    if (htx.fcs_ready) {
+        hdlc_tx_tail();
+    }
+    else {
+        htx.body_sent = 1;
+    }
+}
+#endif
+
+/* Wait for the mNIC to raise CTS, if wired. 0 if it never did. */
+static int hdlc_tx_clear( void )
+{
+#if defined(ARDUINO_ARCH_SAMD)
+    uint32_t start = millis();
+    DUTY_ENTER(DUTY_LINK);
+
+    while (!pU->ctsReady()) {
+        if ((millis() - start) > HDLC_CTS_TIMEOUT) {
+            DUTY_EXIT();
+            return 0;
+        }
+    }
+    DUTY_EXIT();
+#endif
+    return 1;
+}
+
+/* The FCS is worked out while the header and info go out: behind the DMAC,
+ * or byte by byte as they are written to the UART, so there's no separate
+ * pass over the info before sending.
+ */
+int hdlc_send_frame_async( const uint8_t *hdr, const uint8_t *info, int infolen,
+                           hdlc_tx_done done, void *arg )
 {
-    uint8_t fhdr[HDLC_HDR_MAX];
-    uint8_t fs = HDLC_FLAG;
-    uint8_t fcs[2];    
+    uint16_t fcs;
     int rc;
-    int i;
+
+    /* one frame in flight at a time */
+    hdlc_tx_wait();
+
+    /* frames are not split on CTS, the mNIC takes a whole one once ready */
+    if (!hdlc_tx_clear()) {
+        DLOG_DEBUG("Error: hdlc_send_frame() CTS timeout");
+        hdlc_stats.frame_send_err++;
+        return -1;
+    }
 
     /* attach info if present */
     if (info && infolen > 0) {
-        if ((rc = hdlc_frm_add_info(hdr, fhdr, info, infolen, fcs))) {
+        if ((rc = hdlc_frm_set_len(hdr, &htx.head[1], infolen))) {
+            hdlc_stats.frame_send_err++;
             return -1;
         }
-        hdr = fhdr;
+        htx.taillen = HDLC_CRC_SIZE + 1;
     }
+    else {
+        memcpy(&htx.head[1], hdr, HDLC_HDR_SIZE);
+        info = NULL;
+        infolen = 0;
+        htx.taillen = 1;
+    }
+    htx.head[0] = HDLC_FLAG;
+    htx.tail[htx.taillen - 1] = HDLC_FLAG;
+
+    hdlc_tx_count();
+    TRACE_FRAME(TRACE_HDLC | TRACE_TX, micros(), &htx.head[1], HDLC_HDR_SIZE, info, infolen);
+
+#ifdef HDLC_TX_DMA
+    {
+        const uint8_t *seg[2] = { htx.head, info };
+        uint16_t seglen[2] = { sizeof(htx.head), (uint16_t)infolen };
+
+        htx.done = done;
+        htx.arg = arg;
+        htx.busy = 1;
+        htx.body_sent = 0;
+        htx.fcs_ready = 0;
+        if (!info) {
+            /* nothing to wait for, send it all in one go */
+            seg[1] = htx.tail;
+            seglen[1] = htx.taillen;
+            if (pU->writeDMA(seg, seglen, 2, hdlc_tx_complete)) {
+                hdlc_tx_log(NULL, 0);
+                return 0;
+            }
+        }
+        else if (pU->writeDMA(seg, seglen, 2, hdlc_tx_body_done)) {
+            fcs = crc16(CRC16_FINAL, info, infolen);
+            buf_wle16(htx.tail, 0, ~fcs);
+
+            /* whoever is last sends the tail */
+            noInterrupts();
+            if (htx.body_sent) {
+                hdlc_tx_tail();
+            }
+            else {
+                htx.fcs_ready = 1;
+            }
+            interrupts();
 
-	// Log
-    log_msg("HDLC send frame", hdr, HDLC_HDR_SIZE, 0);
-
-	// Send frame delimiter
-    uart.write(fs);
+            hdlc_tx_log(info, infolen);
+            return 0;
+        }
+        /* DMAC channel taken by someone else - send it the slow way */
+        htx.busy = 0;
+    }
+#endif
 
-	// Send header
+	// Send frame delimiter and header
     /* TODO: Is this a problem on Arduino? */
 	/* Need to know why the first char is dropped on uart */
-	rc = uart.write( hdr, HDLC_HDR_SIZE );
-    if (rc != HDLC_HDR_SIZE) 
+	rc = HDLC_PORT(write)( htx.head, sizeof(htx.head) );
+    if (rc != sizeof(htx.head)) 
 	{
-		dlog(LOG_DEBUG, "Error: hdlc_send_frame() did not send %d bytes as required\n", HDLC_HDR_SIZE );
+		DLOG_DEBUG("Error: hdlc_send_frame() did not send %d bytes as required\n", HDLC_HDR_SIZE );
 		return -1;
     }
    
-    if (info && infolen > 0) 
+    if (info) 
 	{
-		// Write payload info
-        rc = uart.write(info, infolen);
-		if (rc != infolen) 
+		// Write payload info in one go, then run the FCS over it while the
+		// ring drains
+		if (HDLC_PORT(write)(info, infolen) != (size_t)infolen)
 		{
-			dlog(LOG_DEBUG, "Error: hdlc_send_frame() did not send %d bytes as required\n", infolen );
+			DLOG_DEBUG("Error: hdlc_send_frame() did not send %d bytes as required\n", infolen );
 			return -1;
 		}
+		fcs = crc16(CRC16_FINAL, info, infolen);
+		buf_wle16(htx.tail, 0, ~fcs);
+    }
 
-		// Write CRC-16
-        rc = uart.write(fcs, HDLC_CRC_SIZE);
-		if (rc != HDLC_CRC_SIZE) 
-		{
-			dlog(LOG_DEBUG, "Error: hdlc_send_frame() did not send %d bytes as required\n", HDLC_CRC_SIZE );
-			return -1;
-		}
+	// Write CRC-16, if any, and the closing FS
+    rc = HDLC_PORT(write)(htx.tail, htx.taillen);
+	if (rc != htx.taillen) 
+	{
+		DLOG_DEBUG("Error: hdlc_send_frame() did not send %d bytes as required\n", htx.taillen );
+		return -1;
+	}
 
-        log_msg(NULL, info, infolen, 0);    
-        log_msg(NULL, fcs, HDLC_CRC_SIZE, 0);            
+    hdlc_tx_log(info, infolen);
 
+    if (done) {
+        done(arg);
     }
+    return 0;
+}
 
-    /* closing with FS.  Not shown in log */
-    uart.write(fs);
-    log_msg(NULL, NULL, 0, 1);  /* EOL */
+int hdlc_send_frame( const uint8_t *hdr, const uint8_t *info, int infolen )
+{
+    int rc;
 
-    return 0;
+    /* info may be on the caller's stack - wait until it's on the wire */
+    rc = hdlc_send_frame_async(hdr, info, infolen, NULL, NULL);
+    hdlc_tx_wait();
+
+    return rc;
 }
 
 #define FRAME_FLAG          (1)
@@ -529,10 +811,14 @@ int hdlc_send_frame( const uint8_t *hdr, const uint8_t *info, int infolen )
 
 
 struct hdlcux {
-    /* store full frame, header (incl. HCS), info and FCS */
-    uint8_t h_frame[HDLC_HDR_MAX + HDLC_INFO_MAX + 2];
+    /* header (incl. HCS) */
+    uint8_t h_frame[HDLC_HDR_MAX];
+    uint16_t h_crc;     /* CRC over the whole frame, as received */
+    /* info and FCS are stored straight into the mbuf handed up by hdlc_rx */
+    struct mbuf *h_m;
     uint8_t h_infoidx; /* fixed header format, this is constant */
     uint16_t h_infolen;
+    uint32_t h_us;      /* micros() at the closing flag */
 };
 
 /* Parse header, return OK/Error and the number of bytes still needed to 
@@ -598,14 +884,10 @@ static int hu_hdlc_parse_hdr(const uint8_t *hdr, int datalen, int *need)
 
 #endif
 
-    /* did we get HCS (which may turn out to be FCS) */
+    /* did we get HCS (which may turn out to be FCS)
+     * the deframer checks it with the CRC it keeps as bytes arrive */
     hdrlen = 2 + dstlen + srclen + 1 + 2;
-    if (datalen >= hdrlen) {
-        if (crc16_validate(hdr, hdrlen)) {
-            //++hustats.hs_hcs_err;
-            goto err;
-        }
-    } else {
+    if (datalen < hdrlen) {
         *need = 1;
         goto done;
     }
@@ -675,225 +957,453 @@ struct hdlcu_stats {
     uint32_t hs_nomem;
     uint32_t hs_frm_start;
     uint32_t hs_discard;
+    uint32_t hs_hdr_err;
+    uint32_t hs_len_err;
+    uint32_t hs_overrun;
+    uint32_t hs_idle;
+    uint32_t hs_lat[HDLC_LAT_BUCKETS];
 };
 
 struct hdlcu_stats hustats;
 
 
+/* Completed frames the deframer can hold until hdlc_rx picks them up */
+#define HDLC_RX_FRAMES  (2)
+
 struct hdlcu_ctx {
-    uint8_t     hu_state;       /* frame processing state */
+    volatile uint8_t hu_state;  /* frame processing state */
     int         hu_pend;        /* number of bytes needed to progress */
     int         hu_frmlen;      /* expected length of incoming frame */
     int         hu_hdrlen;      /* accumulated so far */
-
-    struct hdlcux   hux;        /* current frame being processed */
+    volatile int hu_len;        /* bytes of the frame stored so far */
+    volatile uint32_t hu_last;  /* millis() when the last byte arrived */
+    uint16_t    hu_crc;         /* running HCS/FCS over the frame so far */
+
+    /* Filled by the UART IRQ, drained by hdlc_rx */
+    uint8_t         hu_fill;
+    uint8_t         hu_next;
+    volatile uint8_t hu_ready[HDLC_RX_FRAMES];
+    struct hdlcux   hux[HDLC_RX_FRAMES];   /* frames being processed */
 };
 struct hdlcu_ctx hctx;
 
 void print_hctx_state()
 {
-	char buffer[256];
-	sprintf( buffer, "hctx.hu_state: %d", hctx.hu_state );
-    dlog( LOG_INFO, buffer );
+    DLOG_INFO("hctx.hu_state: %d", hctx.hu_state );
 }
 
 void print_hctx_pend()
 {
-	char buffer[256];
-	sprintf( buffer, "hctx.hu_pend: %d", hctx.hu_pend );
-    dlog( LOG_INFO, buffer );
+    DLOG_INFO("hctx.hu_pend: %d", hctx.hu_pend );
 }
 
-#define HDLC_FRAME_BASE         (0)
-#define HDLC_FRAME_HDR          (1)
-#define HDLC_FRAME_INFO         (2)
-#define HDLC_FRAME_CLOSE_FLAG   (3)
-#define HDLC_FRAME_ERR_FLUSH    (4)
-#define HDLC_FRAME_END			(5)
 
-// UART receive buffer
-uint8_t UART_Buf[UART_MAX_BUF_LEN];
+/* Incremental deframer, fed one byte at a time from the UART IRQ.
+ *
+ * Frame format type 3 has no byte stuffing, so the flag value may also
+ * show up inside the info field.  The frame length from the header is
+ * used to find the closing flag; the HCS guards against resyncing on a
+ * flag byte inside a discarded frame.  A closing flag may also serve as
+ * the opening flag of the next frame.  In SRAM with crc16_byte, the per
+ * byte cost doesn't depend on the flash wait states.
+ */
+RAMFUNC void hdlc_rx_byte( uint8_t c )
+{
+    struct hdlcux *pHUX = &hctx.hux[hctx.hu_fill];
+
+    hctx.hu_last = millis();
+
+    switch (hctx.hu_state) {
+    case FRAME_HDR:
+        if (hctx.hu_len == 0) {
+            if (c == HDLC_FLAG) {
+                /* repeated flags between frames */
+                break;
+            }
+            if (hctx.hu_ready[hctx.hu_fill]) {
+                /* hdlc_rx hasn't picked up the oldest frame yet */
+                ++hustats.hs_overrun;
+                ++hustats.hs_discard;
+                hctx.hu_state = FRAME_ERR_FLUSH;
+                break;
+            }
+            if (!pHUX->h_m) {
+                /* no buffer to receive into */
+                ++hustats.hs_nomem;
+                hctx.hu_state = FRAME_ERR_FLUSH;
+                break;
+            }
+            ++hustats.hs_frm_start;
+            hctx.hu_crc = crc16_init();
+        }
+
+        pHUX->h_frame[hctx.hu_len++] = c;
+        hctx.hu_crc = crc16_byte(hctx.hu_crc, c);
+        if (hctx.hu_len < HDLC_HDR_SIZE) {
+            break;
+        }
+
+        /* CRC over a header ending in a good HCS leaves the residue */
+        if (hctx.hu_crc != CRC16_FINAL) {
+            ++hustats.hs_hcs_err;
+            ++hustats.hs_discard;
+            hctx.hu_state = FRAME_ERR_FLUSH;
+            break;
+        }
+
+        if (hu_hdlc_parse_hdr( pHUX->h_frame, hctx.hu_len, &hctx.hu_pend ) ||
+            hu_hdlc_parse_infolen( pHUX->h_frame, HDLC_HDR_SIZE, &pHUX->h_infolen ) ||
+            (pHUX->h_infolen > HDLC_INFO_MAX + HDLC_CRC_SIZE) ||
+            (pHUX->h_infolen > pHUX->h_m->size)) {
+            /* header parsing error - need to flush */
+            ++hustats.hs_hdr_err;
+            ++hustats.hs_discard;
+            hctx.hu_state = FRAME_ERR_FLUSH;
+            break;
+        }
+
+        /* Header complete - always, working with fixed hdr size */
+        hctx.hu_hdrlen = HDLC_HDR_SIZE;
+        pHUX->h_infoidx = HDLC_HDR_SIZE;
+        hctx.hu_frmlen = pHUX->h_infoidx + pHUX->h_infolen;
+        hctx.hu_state = pHUX->h_infolen ? FRAME_INFO : FRAME_CLOSE_FLAG;
+        break;
+
+    case FRAME_INFO:
+        mtod(pHUX->h_m, uint8_t *)[hctx.hu_len++ - pHUX->h_infoidx] = c;
+        hctx.hu_crc = crc16_byte(hctx.hu_crc, c);
+        if (hctx.hu_len == hctx.hu_frmlen) {
+            hctx.hu_state = FRAME_CLOSE_FLAG;
+        }
+        break;
+
+    case FRAME_CLOSE_FLAG:
+        if (c != HDLC_FLAG) {
+            /* length field didn't match what was on the wire */
+            ++hustats.hs_len_err;
+            ++hustats.hs_discard;
+            hctx.hu_state = FRAME_ERR_FLUSH;
+            break;
+        }
+
+        /* Hand the frame over to hdlc_rx, FCS already known good or not */
+        pHUX->h_crc = hctx.hu_crc;
+        pHUX->h_us = micros();
+        ++hustats.hs_ipkts;
+        hctx.hu_ready[hctx.hu_fill] = 1;
+        hctx.hu_fill = (hctx.hu_fill + 1) % HDLC_RX_FRAMES;
+
+        /* hold off the mNIC until hdlc_rx frees a slot */
+        if (hctx.hu_ready[hctx.hu_fill]) {
+            hdlc_rx_flow(false);
+        }
+        if (hdlc_rx_notify_fn) {
+            hdlc_rx_notify_fn();
+        }
+
+        /* this flag may also open the next frame */
+        hctx.hu_len = 0;
+        hctx.hu_state = FRAME_HDR;
+        break;
+
+    case FRAME_FLAG:
+    case FRAME_ERR_FLUSH:
+    default:
+        /* hunt for a flag to start over */
+        if (c == HDLC_FLAG) {
+            hctx.hu_len = 0;
+            hctx.hu_state = FRAME_HDR;
+        }
+        break;
+    }
+
+} // hdlc_rx_byte()
+
+
+/* Drop a partially received frame if the UART went quiet in the middle of
+ * it.  Otherwise a lost byte would make the deframer swallow the start of
+ * the next frame as the tail of this one.
+ */
+static void hdlc_rx_idle_check( void )
+{
+    noInterrupts();
+    if (((hctx.hu_state == FRAME_HDR && hctx.hu_len) ||
+         (hctx.hu_state == FRAME_INFO) || (hctx.hu_state == FRAME_CLOSE_FLAG)) &&
+        ((millis() - hctx.hu_last) > READ_BUF_TIMEOUT)) {
+        ++hustats.hs_idle;
+        ++hustats.hs_discard;
+        hctx.hu_len = 0;
+        hctx.hu_state = FRAME_FLAG;
+    }
+    interrupts();
+}
+
+
+/* Discard any frames in progress or waiting, and hunt for a flag */
+static void hdlc_rx_reset( void )
+{
+    int i;
+
+    /* give every slot a buffer to receive into */
+    for (i = 0; i < HDLC_RX_FRAMES; i++) {
+        if (!hctx.hux[i].h_m) {
+            hctx.hux[i].h_m = m_get_len(HDLC_INFO_MAX + HDLC_CRC_SIZE);
+        }
+    }
+
+    noInterrupts();
+    hctx.hu_state = FRAME_FLAG;
+    hctx.hu_len = 0;
+    hctx.hu_fill = 0;
+    hctx.hu_next = 0;
+    memset( (void *)hctx.hu_ready, 0, sizeof(hctx.hu_ready) );
+    interrupts();
+
+    hdlc_rx_flow(true);
+}
+
+
+/* RTS to the mNIC, if wired: asserted while the deframer has a free slot */
+static void hdlc_rx_flow( bool ready )
+{
+#if defined(ARDUINO_ARCH_SAMD)
+    pU->rxReady(ready);
+#endif
+}
+
 
 // Count the number of received frames
 static int hframerecv;
 
+// Arrival of the last frame handed up, until a frame goes out in reply
+static uint32_t hlat_us;
+static uint8_t hlat_pend;
+
+// Count a frame going out, the first after a received one closes its
+// RX to TX latency in the histogram
+static void hdlc_tx_count( void )
+{
+	uint32_t ms;
+	int b = 0;
+
+	++hustats.hs_opkts;
+	if (!hlat_pend)
+	{
+		return;
+	}
+	hlat_pend = 0;
+
+	ms = (micros() - hlat_us) / 1000;
+	while (ms && b < HDLC_LAT_BUCKETS - 1)
+	{
+		ms >>= 1;
+		b++;
+	}
+	++hustats.hs_lat[b];
+}
+
+
+uint32_t hdlc_rx_us( void )
+{
+	return hlat_us;
+}
+
+
+// Snapshot the link counters
+void hdlc_get_stats( struct hdlc_link_stats *s )
+{
+	s->rx_frames = hustats.hs_ipkts;
+	s->rx_good = hframerecv;
+	s->tx_frames = hustats.hs_opkts;
+	s->hcs_err = hustats.hs_hcs_err;
+	s->fcs_err = hustats.hs_fcs_err;
+	s->hdr_err = hustats.hs_hdr_err;
+	s->len_err = hustats.hs_len_err;
+	s->oversize = hdlc_stats.recv_large_frame_dropped;
+	s->overrun = hustats.hs_overrun;
+	s->nomem = hustats.hs_nomem;
+	s->idle_discard = hustats.hs_idle;
+	s->seqnum_err = hdlc_stats.seqnum_err;
+	s->rexmit = hdlc_stats.send_i_rexmit;
+	s->send_err = hdlc_stats.frame_send_err;
+	s->snrm = hdlc_stats.recv_snrm;
+	s->disc = hdlc_stats.recv_disc;
+	memcpy(s->lat_hist, hustats.hs_lat, sizeof(s->lat_hist));
+}
+
 // Sleep for 1 ms while waiting for a frame to arrive on UART
 #define MS_SLEEP				(1)
 
-// Receive an HDLC frame
-int hdlc_rx( uint8_t *hdr, uint8_t *info, int framesz, int hdlc_frame_timeout )
+// Park the core until the next interrupt: the UART RX IRQ feeding the
+// deframer, or SysTick for the next millisecond
+static void hdlc_rx_sleep( void )
 {
-	char buffer[256];
-    uint32_t cnt;
-	int rc;
-	boolean obs_flag;
-    float elapsed;
-	float timeout;
-	uint8_t * pHdr;
-	uint8_t * pPayload;
-	uint16_t rx_len = 0;
-	uint16_t frame_len = 0;
-	struct hdlcux * pHUX = &hctx.hux;
+#if defined(ARDUINO_ARCH_SAMD)
+	// WFI still wakes on an interrupt pended while they are off, so a frame
+	// completing between the check and the WFI is not slept through
+	noInterrupts();
+	if (!hctx.hu_ready[hctx.hu_next])
+	{
+		DUTY_ENTER(DUTY_LINK);
+		__WFI();
+		DUTY_EXIT();
+	}
+	interrupts();
+#else
+	delay(MS_SLEEP);
+#endif
+}
 
-    memset( pHUX, 0x0, sizeof(hctx.hux) );
+// Validate a frame handed over by the deframer, pass its info mbuf up
+static int hdlc_rx_frame( struct hdlcux * pHUX, uint8_t *hdr, struct mbuf **info )
+{
+	uint8_t * pHdr = pHUX->h_frame;
+	struct mbuf * m = pHUX->h_m;
+	uint16_t rx_len;
 
-	// Read UART for maximum 200 ms
-	uart.setTimeout(READ_BUF_TIMEOUT);	 
+	*info = NULL;
 
-	// Wait for incoming HDLC frame
-	elapsed = 0.0;
-	timeout = (float) hdlc_frame_timeout;
-	while( elapsed < timeout ) 
+	// Raw frame with its FCS, timed at the closing flag
+	TRACE_FRAME(TRACE_HDLC | (pHUX->h_crc != CRC16_FINAL ? TRACE_ERR : 0), pHUX->h_us,
+				pHdr, pHUX->h_infoidx, m ? mtod(m, uint8_t *) : NULL, pHUX->h_infolen);
+
+	// CRC check, the deframer ran it over header and info as they came in
+	if ( pHUX->h_crc != CRC16_FINAL ) 
 	{
-		// Check if there is nothing at the UART
-		if (!uart.available())
-		{
-			// Check if it is time to send Observe response message
-			// The function call returns a flag that determines if Observe is turned on
-			obs_flag = do_observe();
-			
-#if defined(ARDUINO_ARCH_SAMD)
-			if (obs_flag)
-			{
-				// The reading of the time on SAMD takes about 5.5 ms
-				// Adjust the variable accordingly
-				elapsed += 5.5;
-				continue;
-			}
-#endif
-			// Sleep for 1 ms
-			delay(MS_SLEEP);
-			elapsed++;
-			continue;
-			
-		} // if
-		
-		// Read the HDLC frame until time-out
-		cnt = uart.readBytes( UART_Buf, UART_MAX_BUF_LEN );
-		sprintf( buffer, "readBytes() count: %d", cnt );
-		dlog( LOG_INFO, buffer );
-		capture_dump( UART_Buf, cnt );
-		
-		// Check if we received more bytes than there is space for in the receive buffer
-		if ( cnt > UART_MAX_BUF_LEN )
-		{
-			// This should never happen as the readBytes method above already sets the limit
-			dlog( LOG_DEBUG, "The UART receive buffer has overflown!" );
-			sprintf( buffer, "We read %d bytes and the max is %d bytes.", cnt, UART_MAX_BUF_LEN );
-			dlog( LOG_DEBUG, buffer );
-			
-		} // if
+		++hustats.hs_fcs_err;
+		DLOG_DEBUG("Discard frame - CRC error" );
+		return 0;
+	}
+	
+	/* Return header */
+	memcpy( hdr, pHdr, HDLC_HDR_SIZE );
 
-		// Check for HDLC frame delimiters
-		hctx.hu_state = HDLC_FRAME_BASE;
-		if (( UART_Buf[0] != HDLC_FLAG ) || ( UART_Buf[cnt-1] != HDLC_FLAG ))
-		{
-            ++hustats.hs_discard;  
-			dlog( LOG_DEBUG, "Missing HDLC flag(s)" );
-			return 0;
-			
-		} // if
-		
-		/* Number of bytes received excluding the two frame delimiters */
-		rx_len = cnt - 2;
-		
-		// Parse the header
-		pHdr = &UART_Buf[1];
-		rc = hu_hdlc_parse_hdr( pHdr, HDLC_HDR_SIZE, &hctx.hu_pend );
-		if (rc) 
+	// Check for payload
+	if (pHUX->h_infolen) 
+	{
+		/* If the payload is present, it can't be zero bytes */
+		if ( pHUX->h_infolen <= HDLC_CRC_SIZE ) 
 		{
-			/* header parsing error - need to flush */
-			hctx.hu_state = HDLC_FRAME_ERR_FLUSH;
-			dlog( LOG_DEBUG, "Bad hdr - flush" );
+			/* Invalid payload size */
+			++hustats.hs_len_err;
+			DLOG_DEBUG("Discard frame - bad info len" );
 			return 0;
 			
 		} // if
 
-		/* TODO: How should this be handled? */
-		if ( hctx.hu_pend == 2 ) 
+		/* Check if payload is greater than the maximum allowed */
+		rx_len = pHUX->h_infolen - HDLC_CRC_SIZE;
+		if ( rx_len > max_payload_size )
 		{
-			dlog( LOG_DEBUG, "hctx.hu_pend == 2" );
+			hdlc_stats.recv_large_frame_dropped++;
+			DLOG_DEBUG("The HDLC payload is too large!" );
+			DLOG_DEBUG("We got %d bytes and the max is %d bytes.", rx_len, max_payload_size );
 			return 0;
 			
 		} // if
 
-		/* Header complete - always, working with fixed hdr size */
-		/* Payload, if any, starts after the header */
-		hctx.hu_state = HDLC_FRAME_HDR;
-		pHUX->h_infoidx = HDLC_HDR_SIZE;
-
-		// Get payload size
-		rc = hu_hdlc_parse_infolen( pHdr, HDLC_HDR_SIZE, &pHUX->h_infolen );
-		if (rc)
-		{
-			hctx.hu_state = HDLC_FRAME_ERR_FLUSH;
-			dlog( LOG_DEBUG, "bad infolen - flush" );
-		
-		} // if
+		// Return payload, the caller now owns the mbuf
+		m->len = rx_len;
+		*info = m;
+		pHUX->h_m = NULL;
+	}
+	else 
+	{
+		DLOG_DEBUG("Zero infolen" );
 		
-		// Check if the frame length equals the number of received bytes
-		frame_len = pHUX->h_infoidx + pHUX->h_infolen;
-		if ( frame_len != rx_len )
+	} // if-else
+
+	// Increment the receive frame counter
+	hframerecv++;
+	log_msg( "HDLC recv frame", pHdr, pHUX->h_infoidx, !*info );
+	if (*info)
+	{
+		log_msg( NULL, mtod(m, uint8_t *), pHUX->h_infolen, 1 );
+	}
+	return 1;
+
+} // hdlc_rx_frame()
+
+
+// Take a frame from the deframer if it has one complete, don't wait
+int hdlc_rx_poll( uint8_t *hdr, struct mbuf **info )
+{
+	int rc;
+
+	*info = NULL;
+
+#if !defined(ARDUINO_ARCH_SAMD)
+	// No receive hook on this core, feed the deframer from the RX buffer
+	while (HDLC_PORT(available)())
+	{
+		hdlc_rx_byte( HDLC_PORT(read)() );
+	}
+#endif
+	hdlc_rx_idle_check();
+
+	// Check if the deframer has a complete frame for us
+	if (!hctx.hu_ready[hctx.hu_next])
+	{
+		return -1;
+	}
+
+	// Process the frame and release its slot back to the deframer,
+	// with a fresh buffer if its mbuf was handed up
+	rc = hdlc_rx_frame( &hctx.hux[hctx.hu_next], hdr, info );
+	if (!hctx.hux[hctx.hu_next].h_m)
+	{
+		hctx.hux[hctx.hu_next].h_m = m_get_len(HDLC_INFO_MAX + HDLC_CRC_SIZE);
+	}
+	if (rc > 0)
+	{
+		hlat_us = hctx.hux[hctx.hu_next].h_us;
+		hlat_pend = 1;
+	}
+	hctx.hu_ready[hctx.hu_next] = 0;
+	hctx.hu_next = (hctx.hu_next + 1) % HDLC_RX_FRAMES;
+	hdlc_rx_flow(true);
+	return rc;
+
+} // hdlc_rx_poll()
+
+
+void hdlc_rx_notify( void (*fn)( void ) )
+{
+	hdlc_rx_notify_fn = fn;
+}
+
+
+// Receive an HDLC frame
+int hdlc_rx( uint8_t *hdr, struct mbuf **info, int hdlc_frame_timeout )
+{
+	int rc;
+	uint32_t start = millis();
+
+	// Wait for incoming HDLC frame
+	for (;;)
+	{
+		rc = hdlc_rx_poll( hdr, info );
+		if (rc >= 0)
 		{
-			dlog( LOG_DEBUG, "The frame length doesn't match the number of received bytes" );
-			print("frame_len: ");	printnum(frame_len);	println("");
-			print("rx_len:    ");	printnum(rx_len);		println("");
-			return 0;
-			
-		} // if
+			return rc;
+		}
 
-		// CRC check
-		if ( crc16_validate( pHdr, frame_len )) 
+		if ((millis() - start) >= (uint32_t) hdlc_frame_timeout)
 		{
-			dlog( LOG_DEBUG, "Discard frame - CRC error" );
+			// Time-out
 			return 0;
 		}
-		
-		/* Return header */
-		memcpy( hdr, pHdr, HDLC_HDR_SIZE );
 
-		// Check for payload
-		if (pHUX->h_infolen) 
+		// Check if it is time to send Observe response message
+		if (observe_due())
 		{
-			/* If the payload is present, it can't be zero bytes */
-			if ( pHUX->h_infolen <= HDLC_CRC_SIZE ) 
-			{
-				/* Invalid payload size */
-				dlog( LOG_DEBUG, "Discard frame - bad info len" );
-				return 0;
-				
-			} // if
-
-			/* Check if payload is greater than the maximum allowed */
-			rx_len = pHUX->h_infolen - HDLC_CRC_SIZE;
-			if ( rx_len > max_payload_size )
-			{
-				dlog( LOG_DEBUG, "The HDLC payload is too large!" );
-				sprintf( buffer, "We got %d bytes and the max is %d bytes.", rx_len, max_payload_size );
-				dlog( LOG_DEBUG, buffer );
-				return 0;
-				
-			} // if
-
-			// Return payload
-			pPayload = pHdr + HDLC_HDR_SIZE;
-			memcpy( info, pPayload, rx_len );
-			hctx.hu_state = HDLC_FRAME_INFO;
+			do_observe();
+			continue;
 		}
-		else 
-		{
-			dlog( LOG_DEBUG, "Zero infolen" );
-			
-		} // if-else
 
-		// Increment the receive frame counter
-		hframerecv++;
-		log_msg( "HDLC recv frame", pHdr, frame_len, 1 );
-		return 1;
+		// Nothing to do until the next interrupt
+		hdlc_rx_sleep();
 
-    } // while
-
-	// Time-out
-	return 0;
+    } // for
 	
 } // hdlc_rx()
@@ -36,14 +36,20 @@ Networks, Inc.
 #include "bufutil.h"
 #include "crc_xmodem.h"
 #include "log.h"
+#include "coapsensorobs.h"
+#include "retain.h"
 
 
 extern int verbose;
+extern struct hdlcstat hdlc_stats;
 
 
 struct hdlcs_cfg {
     uint32_t max_info_tx;
     uint32_t max_info_rx;
+    uint32_t window_tx;
+    uint32_t window_rx;
+    uint32_t seg_tx;    /* negotiated max info per transmitted I frame */
 };
 
 
@@ -54,6 +60,27 @@ enum hdlcss {
 };
 
 #define INCM8(i)    ((i + 1) & 0x07)
+#define SUBM8(a, b) (((a) - (b)) & 0x07)
+#define ADDM8(a, b) (((a) + (b)) & 0x07)
+
+/* A warm link, see RETAIN_LINK: counters still to take from the primary */
+#define HSS_WARM_NR 0x01    /* N(R) of its first frame becomes V(S) */
+#define HSS_WARM_NS 0x02    /* N(S) of its first I frame becomes V(R) */
+
+/* A reassembled request waiting for hdlcs_read */
+struct hdlcs_req {
+    struct mbuf *m;
+    uint32_t rx_us;     /* hdlc_rx_us() at its last frame */
+};
+
+/* One I frame worth of an outgoing message; the final segment owns m */
+struct hdlcs_seg {
+    struct mbuf *m;     /* the message, freed with its last segment */
+    struct mbuf *p;     /* the buffer of the chain holding this segment */
+    uint16_t off;
+    uint16_t len;
+    uint8_t last;
+};
 
 struct hdlcs_state
 {
@@ -65,15 +92,31 @@ struct hdlcs_state
 
     uint8_t esrc;
     uint8_t edst;
+    struct hdlc_hdr_tmpl htmpl; /* our headers to the primary */
 
-    uint8_t vs;
+    uint8_t vs;         /* N(S) of the next frame to go out */
     uint8_t vr;
-    uint8_t vs_ack;
+    uint8_t vs_ack;     /* oldest frame not acked by the primary */
     uint8_t vr_ack;
+    uint8_t vq;         /* N(S) the next queued frame will get */
+    int polled;         /* P bit seen, we owe the primary a final frame */
+    uint32_t rx_last;   /* millis() of the last frame from the primary */
+    uint8_t warm;       /* HSS_WARM_*, normal mode restored at boot */
+    uint32_t warm_ms;   /* millis() it was restored */
 
     hdlcs_data_handler icb; /* not supported */
     struct mbuf *recv;  /* accumulating incoming data */
-    int r_complete;
+    int r_discard;      /* overran recv, drop segments up to the last */
+
+    /* reassembled requests, oldest at rxq_head, served in order */
+    struct hdlcs_req rxq[HDLCS_RXQ_MAX];
+    uint8_t rxq_head;
+    uint8_t rxq_n;
+    uint32_t read_us;   /* rx_us of the request last read */
+
+    /* outgoing I frames indexed by N(S), held until acked:
+     * vs_ack..vs sent and unacked, vs..vq waiting for the window */
+    struct hdlcs_seg txq[8];
 };
 
 // Declare hss
@@ -81,31 +124,29 @@ struct hdlcs_state hss;
 
 
 /* secondary station handlers for known frame types */
-static int hdlcs_snrm(void);
+static int hdlcs_snrm(const uint8_t *info, int infolen);
 static int hdlcs_disc(void);
-static int hdlcs_i(struct mbuf *d);
+static int hdlcs_i(struct mbuf *d, int segment);
+static void hdlcs_ack(const struct hdlc_ctrl *hc);
+static int hdlcs_txq_add(struct mbuf *m);
+static int hdlcs_frame(uint8_t *hdr, struct mbuf *info);
+static int hdlcs_send_window(void);
+static void hdlcs_txq_flush(void);
+static void hdlcs_txq_rebase(uint8_t base);
+static void hdlcs_retain(void);
+static void hdlcs_warm_check(void);
+static void hdlcs_rxq_flush(void);
 /* error response frames */
 static int hdlcs_dm(void);
 static int hdlcs_frmr(void);
 
 
-// Allocate an mbuf
-static void hdlcs_get_buf(int size)
-{
-	// Set the size of the mbuf data buffer
-	set_mbuf_data_size(size);
-	
-	// Allocate mbuf
-    hss.recv = m_get();
-    assert(hss.recv);
-}
-
-
 // Time-out period in ms of the UART
 static uint32_t uart_timeout_ms		= 0;
 
 /* Open HDLCS connection */
-error_t hdlcs_open( HardwareSerial * pUART, uint32_t timeout_ms, uint32_t max_info_len )
+error_t hdlcs_open( HardwareSerial * pUART, const struct hdlc_link_cfg *link, 
+                    uint32_t timeout_ms, uint32_t max_info_len )
 {
 	// Check that we are not already open
     if (hss.open) 
@@ -117,13 +158,17 @@ error_t hdlcs_open( HardwareSerial * pUART, uint32_t timeout_ms, uint32_t max_in
 	// Check that the specified max payload size is not larger than the corresponding size on the mNIC
 	if ( max_info_len > MNIC_MAX_PAYLOAD_SIZE )
 	{
-		dlog( LOG_DEBUG, "The max payload size specified is too large: %d bytes. The maximum allowed is %d bytes ", max_info_len, MNIC_MAX_PAYLOAD_SIZE );
+		DLOG_DEBUG("The max payload size specified is too large: %d bytes. The maximum allowed is %d bytes ", max_info_len, MNIC_MAX_PAYLOAD_SIZE );
 		return ERR_FAIL;
 		
 	} // if
 	
+	// Size mbufs for a whole reassembled message, before the deframer
+	// takes its receive buffers
+	set_mbuf_data_size(HDLCS_MSG_MAX);
+
 	// Init HDLC UART
-	hdlc_init( pUART, max_info_len );
+	hdlc_init( pUART, link, max_info_len );
 
 	// Set the time-out period of the UART
 	uart_timeout_ms = timeout_ms;
@@ -137,22 +182,111 @@ error_t hdlcs_open( HardwareSerial * pUART, uint32_t timeout_ms, uint32_t max_in
     /* initialize config to defaults */
     hss.cfg.max_info_tx = max_info_len;
     hss.cfg.max_info_rx = max_info_len;
+    hss.cfg.window_tx = 1;
+    hss.cfg.window_rx = 1;
+    hss.cfg.seg_tx = max_info_len;
 
     /* start in disconnected state */
     hss.state = HSS_DISC;
-
-	/* Allocate the mbuf */
-    hdlcs_get_buf(max_info_len);
    
     /* my address */
     hss.esrc = hdlc_addr_encode(1);
     /* update this when the connection is made.  fixed now */
     hss.edst = hdlc_addr_encode(1);
+    hdlc_hdr_tmpl_init(&hss.htmpl, hss.esrc, hss.edst);
+
+    hss.rx_last = millis();
+
+#if RETAIN
+    /* carry on with the link the last run had, if it was up */
+    struct retain_link rl;
+    if (retain_get(RETAIN_LINK, &rl, sizeof(rl)) && rl.up && rl.seg_tx)
+    {
+        hss.cfg.window_tx = constrain(rl.window_tx, 1, HDLCS_WINDOW_MAX);
+        hss.cfg.window_rx = constrain(rl.window_rx, 1, HDLCS_WINDOW_MAX);
+        hss.cfg.seg_tx = min((uint32_t)rl.seg_tx, max_info_len);
+        hss.state = HSS_NORM;
+        hss.warm = HSS_WARM_NR | HSS_WARM_NS;
+        hss.warm_ms = millis();
+        hdlc_link_up(1);
+        DLOG_INFO("Warm HDLC link, window tx %d rx %d", hss.cfg.window_tx, hss.cfg.window_rx);
+    }
+#endif
 
     return ERR_OK;
 }
 
 
+/* Drop everything in the transmit queue */
+static void hdlcs_txq_flush(void)
+{
+    int i;
+
+    /* the frame going out may still be read by DMA */
+    hdlc_tx_wait();
+
+    for (i = 0; i < 8; i++) {
+        if (hss.txq[i].m && hss.txq[i].last) {
+            m_free(hss.txq[i].m);
+        }
+        hss.txq[i].m = NULL;
+    }
+    hss.vs_ack = hss.vs = hss.vq = 0;
+}
+
+/* Renumber unacked frames from N(S) base, 0 for a new connection, so
+ * nothing queued is lost to an SNRM */
+static void hdlcs_txq_rebase(uint8_t base)
+{
+    struct hdlcs_seg q[8];
+    uint8_t n = 0;
+    uint8_t i;
+
+    hdlc_tx_wait();
+
+    while (hss.vs_ack != hss.vq) {
+        q[n++] = hss.txq[hss.vs_ack];
+        hss.txq[hss.vs_ack].m = NULL;
+        hss.vs_ack = INCM8(hss.vs_ack);
+    }
+    for (i = 0; i < n; i++) {
+        hss.txq[ADDM8(base, i)] = q[i];
+    }
+    hss.vs_ack = hss.vs = base;
+    hss.vq = ADDM8(base, n);
+}
+
+
+/* The negotiated link, for a warm restart */
+static void hdlcs_retain(void)
+{
+#if RETAIN
+    struct retain_link rl;
+
+    memset(&rl, 0, sizeof(rl));
+    rl.up = (hss.state == HSS_NORM);
+    rl.window_tx = hss.cfg.window_tx;
+    rl.window_rx = hss.cfg.window_rx;
+    rl.seg_tx = hss.cfg.seg_tx;
+    retain_put(RETAIN_LINK, &rl, sizeof(rl));
+#endif
+}
+
+
+/* A warm link the primary never spoke on goes back to waiting for SNRM */
+static void hdlcs_warm_check(void)
+{
+    if ((hss.warm & HSS_WARM_NR) && (millis() - hss.warm_ms) >= RETAIN_LINK_MS)
+    {
+        DLOG_WARNING("Warm HDLC link not polled in %d ms, waiting for SNRM", RETAIN_LINK_MS);
+        hss.warm = 0;
+        hss.state = HSS_DISC;
+        hdlc_link_up(0);
+        hdlcs_retain();
+    }
+}
+
+
 int
 hdlcs_close(void)
 {
@@ -160,6 +294,9 @@ hdlcs_close(void)
         m_free(hss.recv);
     }
 
+    hdlcs_rxq_flush();
+    hdlcs_txq_flush();
+
     memset(&hss, 0, sizeof(hss));
 
 
@@ -167,30 +304,83 @@ hdlcs_close(void)
 }
 
 
-// This pointer will be assigned when an Observe message is ready to be sent
-extern struct mbuf *pending_rsp;
-
-/* The main HDLC Secondary station state machine */
+/* The main HDLC Secondary station state machine, waits up to the
+ * UART time-out for a frame */
 int hdlcs_run(void)
 {
     uint8_t hdr[HDLC_HDR_SIZE];
-    struct hdlc_hdr_fields hh;
-    struct hdlc_ctrl hc;
+    struct mbuf *info;
     int rc;
 
+    hdlcs_warm_check();
+
     /* Check for HDLC frame */
-    rc = hdlc_rx( hdr, hss.recv->data, hss.recv->size, uart_timeout_ms );  
+    rc = hdlc_rx( hdr, &info, uart_timeout_ms );  
 	if ( rc <= 0 )
 	{
         return 0;
     }
+    hss.rx_last = millis();
+
+    return hdlcs_frame(hdr, info);
+
+} // hdlcs_run()
+
+
+/* As hdlcs_run, but only handles a frame the deframer already has and
+ * returns right away, 1 if there was one.  The UART time-out becomes a
+ * link deadline: a poll left unanswered that long is stale, the primary
+ * has given up on it. */
+int hdlcs_poll(void)
+{
+    uint8_t hdr[HDLC_HDR_SIZE];
+    struct mbuf *info;
+    int rc;
+
+    hdlcs_warm_check();
+
+    rc = hdlc_rx_poll( hdr, &info );
+    if (rc < 0)
+    {
+        /* nothing from the primary, the observers have a task of their own */
+        if (hss.state == HSS_NORM && 
+            (millis() - hss.rx_last) >= uart_timeout_ms)
+        {
+            hdlc_stats.recv_frame_timeout++;
+            DLOG_DEBUG("No frame from primary in %lu ms", uart_timeout_ms);
+            hss.polled = 0;
+            hss.rx_last = millis();
+        }
+        return 0;
+    }
+    hss.rx_last = millis();
+    if (rc == 0)
+    {
+        /* bad frame, dropped by hdlc_rx_poll */
+        return 1;
+    }
+
+    (void)hdlcs_frame(hdr, info);
+    return 1;
+
+} // hdlcs_poll()
+
+
+/* Run the state machine on one received frame, info is freed here
+ * unless handed on */
+static int hdlcs_frame(uint8_t *hdr, struct mbuf *info)
+{
+    struct hdlc_hdr_fields hh;
+    struct hdlc_ctrl hc;
+    int ret = 0;
+    int rc;
 
     /* Parse header */
 	rc = hdlc_parse_hdr( &hh, hdr, HDLC_HDR_SIZE );
 	if (rc) 
 	{
         /* error parsing packet header -- drop */
-        return 0;
+        goto done;
     }
 
 	/* Parse control */
@@ -198,18 +388,34 @@ int hdlcs_run(void)
     if (rc) 
 	{
         /* error decoding control info -- drop - or - frame reject response */
-        return 0;
+        goto done;
     }
 
-    hss.recv->len = hh.infolen;
     
-    dlog(LOG_DEBUG, "Process incoming ctrl %02x in state %d", hh.control, hss.state);
+    DLOG_DEBUG("Process incoming ctrl %02x in state %d", hh.control, hss.state);
 
-    /* Free last packet if it's acked */
-    if (hc.nr == INCM8(hss.vs)) 
+    /* Warm link: the primary's counters went on while we were down */
+    if (hss.warm && hss.state == HSS_NORM)
 	{
-        dlog(LOG_DEBUG, "response rxed at primary");
-        hss.vs = INCM8(hss.vs);
+        if ((hss.warm & HSS_WARM_NR) && 
+            (hc.type == HDLC_I || hc.type == HDLC_RR || hc.type == HDLC_RNR))
+		{
+            hdlcs_txq_rebase(hc.nr);
+            hss.warm &= ~HSS_WARM_NR;
+        }
+        if ((hss.warm & HSS_WARM_NS) && hc.type == HDLC_I)
+		{
+            hss.vr = hc.ns;
+            hss.warm &= ~HSS_WARM_NS;
+        }
+    }
+
+    /* Free packets the primary has acked */
+    if (hss.state == HSS_NORM && 
+        (hc.type == HDLC_I || hc.type == HDLC_RR || hc.type == HDLC_RNR))
+	{
+        hdlcs_ack(&hc);
+        hss.polled = hc.pf;
     }
 
     switch (hss.state) 
@@ -218,7 +424,7 @@ int hdlcs_run(void)
         /* reject all frames except SNRM */
         /* send DM response */
         if (hc.type == HDLC_SNRM) {
-            rc = hdlcs_snrm();
+            rc = hdlcs_snrm(info ? mtod(info, uint8_t *) : NULL, info ? info->len : 0);
         }
         else {
             /* reject all with DM response */
@@ -228,33 +434,51 @@ int hdlcs_run(void)
     case HSS_NORM:
         /* normal mode processing */
         if (hc.type == HDLC_SNRM) {
-            dlog( LOG_DEBUG, "HDLC_SNRM" );
-            rc = hdlcs_snrm();
+            DLOG_DEBUG("HDLC_SNRM" );
+            rc = hdlcs_snrm(info ? mtod(info, uint8_t *) : NULL, info ? info->len : 0);
         }
         else if (hc.type == HDLC_I) {
-            dlog( LOG_DEBUG, "HDLC_I" );
+            DLOG_DEBUG("HDLC_I" );
             /* update seqnums */
             if (hc.ns != hss.vr) {
-                dlog(LOG_ERR, "Unexpected seqnum N(S) = %d  V(R) = %d", 
+                /* out of sequence - drop it, our N(R) asks for a resend */
+                DLOG_ERR("Unexpected seqnum N(S) = %d  V(R) = %d", 
                             hc.ns, hss.vr);
+                hdlc_stats.seqnum_err++;
+                rc = hss.polled ? hdlcs_rr() : 0;
+            }
+            else if (!hss.recv && !hss.r_discard && hss.rxq_n == HDLCS_RXQ_MAX) {
+                /* no room for another request - not acked, the primary
+                 * sends it again once we have caught up */
+                hdlc_stats.recv_busy++;
+                rc = hss.polled ? hdlcs_rr() : 0;
             }
             else {
                 hss.vr = INCM8(hss.vr);
+                hdlc_stats.recv_i++;
+                rc = hdlcs_i(info, hh.segment);
+                info = NULL;
             }
-            rc = hdlcs_i(hss.recv);
         }
         else if (hc.type == HDLC_RR) {
-            dlog( LOG_DEBUG, "HDLC_RR" );
+            DLOG_DEBUG("HDLC_RR" );
             /* process seqnum - retransmit if necessary */
-            dlog(LOG_DEBUG, "hc.nr: %d, hss.vs: %d", hc.nr, hss.vs);
-            rc = hdlcs_rr();
+            DLOG_DEBUG("hc.nr: %d, hss.vs: %d", hc.nr, hss.vs);
+            hdlc_stats.recv_rr++;
+            rc = hss.polled ? hdlcs_rr() : 0;
+        }
+        else if (hc.type == HDLC_RNR) {
+            DLOG_DEBUG("HDLC_RNR" );
+            /* primary is busy - hold the window until it polls again */
+            hdlc_stats.recv_rnr++;
+            rc = 0;
         }
 
         else if (hc.type == HDLC_DISC) {
-            dlog( LOG_DEBUG, "HDLC_DISC" );
-            m_free(pending_rsp);
-            pending_rsp = NULL;
-            dlog(LOG_DEBUG, "%s:%d Cleared pending_rsp", __FUNCTION__, __LINE__);
+            DLOG_DEBUG("HDLC_DISC" );
+            obs_q_flush();
+            hdlcs_rxq_flush();
+            hdlcs_txq_flush();
             rc = hdlcs_disc();
         }
         else {
@@ -264,15 +488,21 @@ int hdlcs_run(void)
         break;
     default:
         /* unknown state - error */
-		dlog( LOG_DEBUG, "Error - unknown state: %d", hss.state );
-        return 1;
+		DLOG_DEBUG("Error - unknown state: %d", hss.state );
+        ret = 1;
+        goto done;
     }
 
 	// Log
-    dlog( LOG_DEBUG, "hdlcs_run() - %d", rc );
-    return 0;
+    DLOG_DEBUG("hdlcs_frame() - %d", rc );
 
-} // hdlcs_run()
+done:
+    if (info) {
+        m_free(info);
+    }
+    return ret;
+
+} // hdlcs_frame()
 
 
 /*
@@ -292,19 +522,27 @@ boolean hdlcs_is_connected()
 } // hdlcs_is_connected
 
 
+uint16_t hdlcs_max_info_tx(void)
+{
+    return hss.cfg.seg_tx;
+}
+
+
 struct mbuf * hdlcs_read(void)
 {
+    struct hdlcs_req *q;
     struct mbuf *r;
     
-    if (hss.r_complete) {
-        /* using a duplicate here */
-        r = m_dup(hss.recv);
-        assert(r);
-        hss.recv->len = 0;
-        hss.r_complete = 0;
-        memset(hss.recv->data, 0, hss.recv->size);
-
-		dlog( LOG_DEBUG, "hdlcs_read() - %x", r );
+    if (hss.rxq_n) {
+        /* caller takes the oldest, the buffer the deframer filled */
+        q = &hss.rxq[hss.rxq_head];
+        r = q->m;
+        hss.read_us = q->rx_us;
+        q->m = NULL;
+        hss.rxq_head = (hss.rxq_head + 1) % HDLCS_RXQ_MAX;
+        hss.rxq_n--;
+
+		DLOG_DEBUG("hdlcs_read() - %x", r );
         return r;
     }
     
@@ -312,24 +550,182 @@ struct mbuf * hdlcs_read(void)
 
 } // hdlcs_read()
 
+
+uint32_t hdlcs_read_us(void)
+{
+    return hss.read_us;
+}
+
+
+/* Drop the requests not read yet */
+static void
+hdlcs_rxq_flush(void)
+{
+    while (hss.rxq_n) {
+        m_free(hdlcs_read());
+    }
+    hss.rxq_head = 0;
+}
+
 int
 hdlcs_write(const void *data, uint16_t len)
 {
-    uint8_t hdr[HDLC_HDR_SIZE];
-    int hdrlen;
+    struct mbuf *m;
+
+    /* the queue holds frames until acked, so it needs its own copy */
+    m = m_get_len(len);
+    if (!m || len > m->size) {
+        if (m) {
+            m_free(m);
+        }
+        hdlc_stats.send_mbuf_err++;
+        return HDLC_ERROR_SEND_FRAME;
+    }
+    memcpy(m_append(m, len), data, len);
+
+    return hdlcs_write_mbuf(m);
+}
+
+int
+hdlcs_write_mbuf(struct mbuf *m)
+{
     int rc;
 
-    /* no segmentation support at this time  - write sends I frm directly */
-    (void)hdlc_hdr(0, hdlc_control_i(hss.vr, hss.vs, 1),
-                          hss.esrc, hss.edst, hdr, &hdrlen);
-    
-    rc = hdlc_send_frame(hdr, (const uint8_t *)data, len);
-    
+    rc = hdlcs_txq_add(m);
+    if (rc) {
+        DLOG_WARNING("HDLC transmit queue full");
+        m_free(m);
+        return rc;
+    }
+
+    /* I frames only go out while the primary has us polled */
+    return hdlcs_send_window();
+}
+
+
+/*
+ * Split m into segments of at most seg_tx bytes at the end of the queue.
+ * Segments don't span the buffers of a chain, each is sent in place.
+ */
+static int
+hdlcs_txq_add(struct mbuf *m)
+{
+    struct mbuf *p;
+    struct hdlcs_seg *sg;
+    uint16_t off = 0;
+    uint16_t len;
+    int nseg = 0;
+
+    for (p = m; p; p = p->next) {
+        nseg += (p->len + hss.cfg.seg_tx - 1) / hss.cfg.seg_tx;
+    }
+    if (!nseg) {
+        nseg = 1;
+    }
+    if (SUBM8(hss.vq, hss.vs_ack) + nseg > HDLCS_TXQ_MAX) {
+        return HDLC_ERROR_BUSY;
+    }
+
+    p = m;
+    do {
+        /* on to the next buffer with data, an empty message is one segment */
+        while (off >= p->len && p->next) {
+            p = p->next;
+            off = 0;
+        }
+        len = min(p->len - off, hss.cfg.seg_tx);
+        sg = &hss.txq[hss.vq];
+        sg->m = m;
+        sg->p = p;
+        sg->off = off;
+        sg->len = len;
+        sg->last = (nseg == 1);
+        off += len;
+        hss.vq = INCM8(hss.vq);
+    } while (--nseg);
+
+    return 0;
+}
+
+
+/* Send queued frames the window allows, the last one carries F */
+static int
+hdlcs_send_window(void)
+{
+    uint8_t hdr[HDLC_HDR_SIZE];
+    int final;
+    int rc = 0;
+    struct hdlcs_seg *sg;
+
+    if (!hss.polled) {
+        return 0;
+    }
+
+    while (hss.vs != hss.vq && SUBM8(hss.vs, hss.vs_ack) < hss.cfg.window_tx) {
+        sg = &hss.txq[hss.vs];
+        final = (INCM8(hss.vs) == hss.vq || 
+                 SUBM8(INCM8(hss.vs), hss.vs_ack) >= hss.cfg.window_tx);
+
+        (void)hdlc_hdr_tmpl_fill(&hss.htmpl, !sg->last, 
+                                 hdlc_control_i(hss.vr, hss.vs, final),
+                                 sg->len, hdr);
+
+        /* the mbuf stays queued, so it outlives the DMA transfer */
+        rc = hdlc_send_frame_async(hdr, mtod(sg->p, uint8_t *) + sg->off, sg->len, 
+                                   NULL, NULL);
+        if (rc) {
+            hdlc_stats.send_i_err++;
+            break;
+        }
+        hdlc_stats.send_i++;
+        hss.vs = INCM8(hss.vs);
+        if (final) {
+            hss.polled = 0;
+        }
+    }
+
     return rc;
 }
 
 
-static int hdlcs_snrm(void)
+/* Process N(R) from the primary: free acked frames, rewind on a poll */
+static void
+hdlcs_ack(const struct hdlc_ctrl *hc)
+{
+    /* N(R) must lie within vs_ack..vs */
+    if (SUBM8(hc->nr, hss.vs_ack) > SUBM8(hss.vs, hss.vs_ack)) {
+        DLOG_ERR("Invalid N(R) = %d  V(S) = %d", hc->nr, hss.vs);
+        hdlc_stats.seqnum_err++;
+        return;
+    }
+
+    if (hss.vs_ack != hc->nr) {
+        /* the frame going out may still be read by DMA */
+        hdlc_tx_wait();
+        DLOG_DEBUG("response rxed at primary");
+    }
+    while (hss.vs_ack != hc->nr) {
+        if (hss.txq[hss.vs_ack].last) {
+            m_free(hss.txq[hss.vs_ack].m);
+        }
+        hss.txq[hss.vs_ack].m = NULL;
+        hss.vs_ack = INCM8(hss.vs_ack);
+    }
+
+    /*
+     * We only ever stop sending on a final frame, so a poll that doesn't
+     * ack everything means the rest was lost - go back N and resend.
+     */
+    if (hc->pf && hss.vs != hc->nr) {
+        DLOG_DEBUG("Resending from N(S) = %d", hc->nr);
+        hdlc_stats.send_i_recovery++;
+        hdlc_stats.send_i_rexmit += SUBM8(hss.vs, hc->nr);
+        hss.vs = hc->nr;
+    }
+}
+
+
+static int hdlcs_snrm(const uint8_t *info, int infolen)
 {
     uint8_t hdr[HDLC_HDR_SIZE];
     uint8_t param_info[26];
@@ -338,33 +734,68 @@ static int hdlcs_snrm(void)
 
     struct hdlc_snrm_params hsp;
 
-    int hdrlen;
 
 
-    hss.state = HSS_NORM;
-            
-     /* reinit state */
-    dlog(LOG_DEBUG, "enter normal mode");
-            
-    /* respond with UA */
-    hdlc_hdr(0, hdlc_control(HDLC_UA, 1), hss.esrc, hss.edst, hdr, &hdrlen);
+    hdlc_stats.recv_snrm++;
 
-    /* should use negotiated values - min() of primary/secondary */    
-    hsp.max_info_tx = hss.cfg.max_info_tx;  
+    /* defaults IEC 62056-46 6.4.4.4.3.2, unless the primary says otherwise */
+    hsp.max_info_tx = hss.cfg.max_info_tx;
     hsp.max_info_rx = hss.cfg.max_info_rx;
     hsp.window_tx = 1;
     hsp.window_rx = 1;
+    if ((infolen && hdlc_parse_snrm_param(info, infolen, &hsp)) ||
+        !hsp.max_info_tx || !hsp.max_info_rx) {
+        DLOG_WARNING("bad SNRM params - using defaults");
+        hsp.max_info_tx = hss.cfg.max_info_tx;
+        hsp.max_info_rx = hss.cfg.max_info_rx;
+        hsp.window_tx = 1;
+        hsp.window_rx = 1;
+    }
+
+    /* negotiated values - min() of primary/secondary */
+    hsp.max_info_tx = min(hsp.max_info_tx, hss.cfg.max_info_tx);
+    hsp.max_info_rx = min(hsp.max_info_rx, hss.cfg.max_info_rx);
+    hsp.window_tx = constrain(hsp.window_tx, 1, HDLCS_WINDOW_MAX);
+    hsp.window_rx = constrain(hsp.window_rx, 1, HDLCS_WINDOW_MAX);
+    hss.cfg.window_tx = hsp.window_tx;
+    hss.cfg.window_rx = hsp.window_rx;
+    hss.cfg.seg_tx = hsp.max_info_tx;
 
+    hss.state = HSS_NORM;
+            
+     /* reinit state */
+    DLOG_DEBUG("enter normal mode");
+            
+    /* addresses are fixed for the connection from here */
+    hdlc_hdr_tmpl_init(&hss.htmpl, hss.esrc, hss.edst);
+
+    /* respond with UA */
     hdlc_fill_snrm_param(param_info, sizeof(param_info), &rsplen, &hsp);
+    hdlc_hdr_tmpl_fill(&hss.htmpl, 0, hdlc_control(HDLC_UA, 1), rsplen, hdr);
     rc = hdlc_send_frame(hdr, param_info, rsplen);
 
-    dlog(LOG_DEBUG, "SNRM-UA response rc %d", rc);
+    DLOG_DEBUG("SNRM-UA response rc %d, window tx %d rx %d", rc, 
+                    hsp.window_tx, hsp.window_rx);
+
+    /* both ends move to the fast baud, if any, once the UA is out */
+    hdlc_link_up(1);
 
     /* Send / Receive sequence numbers are reset to 0 */
     hss.vr = 0;
-    hss.vs = 0;
     hss.vr_ack = 0;
-    hss.vs_ack = 0;
+    hdlcs_txq_rebase(0);
+    hss.polled = 0;
+    hss.warm = 0;
+    hdlcs_retain();
+
+    /* a partly reassembled message won't be completed, nor the requests
+     * of the old link answered */
+    if (hss.recv) {
+        m_free(hss.recv);
+        hss.recv = NULL;
+    }
+    hss.r_discard = 0;
+    hdlcs_rxq_flush();
 
     return 0;
  
@@ -375,47 +806,93 @@ static int
 hdlcs_disc(void)
 {
     uint8_t hdr[HDLC_HDR_SIZE];
-    int hdrlen;
     int rc;    
 
+    hdlc_stats.recv_disc++;
     hss.state = HSS_DISC;
             
-    dlog(LOG_DEBUG, "disconnecting");
+    DLOG_DEBUG("disconnecting");
 
     /* respond with UA */
-    hdlc_hdr(0, hdlc_control(HDLC_UA, 1), hss.esrc, hss.edst, hdr, &hdrlen);
+    hdlc_hdr_tmpl_fill(&hss.htmpl, 0, hdlc_control(HDLC_UA, 1), 0, hdr);
     rc = hdlc_send_frame(hdr, NULL, 0);
+
+    /* the next SNRM comes at the base baud */
+    hdlc_link_up(0);
+    hss.warm = 0;
+    hdlcs_retain();
     return 0;
 }
 
+/* Takes ownership of d, the info of an in-sequence I frame (may be NULL) */
 static int
-hdlcs_i(struct mbuf *d)
+hdlcs_i(struct mbuf *d, int segment)
 {
-    uint8_t hdr[HDLC_HDR_SIZE];
-    int hdrlen;
-    int rc;   
-
-    ddump(LOG_DEBUG, "Recv I frame", d->data, d->len);
+    if (d) {
+        DDUMP_DEBUG("Recv I frame", mtod(d, uint8_t *), d->len);
+    }
    
-    if (hss.icb) {
-        /* hand incoming data to registered callback */
-        dlog(LOG_ERR, "data CB not supported");
+    if (hss.r_discard) {
+        /* rest of a message we had no room for */
+        hss.r_discard = segment;
+        m_free(d);
+        return segment && hss.polled ? hdlcs_rr() : 0;
     }
-    else if (1) {
-        /* make data available ro hdlcs_read() */
 
-        /* segmentation not supported - this is the first and final element */
-        hss.recv = d;
-        hss.r_complete = 1;
+    if (!hss.recv && (!segment || (d && d->size >= get_mbuf_data_size()))) {
+        /* whole message - keep the deframer's buffer */
+        hss.recv = d ? d : m_get_len(0);
+        if (!hss.recv) {
+            hdlc_stats.recv_mbuf_err++;
+            return 0;
+        }
     }
-    else {
-        /* if there was segmentation, we'd send back an RR to ack */
-        hdlc_hdr(0, hdlc_control_rr(hss.vr, 1), hss.esrc, hss.edst, 
-                                                hdr, &hdrlen);
-        rc = hdlc_send_frame(hdr, NULL, 0);
-        if (rc) {
-            dlog(LOG_ERR, "I ack RR rc %d", rc);
+    else if (!hss.recv) {
+        /* first of several segments - needs a big buffer to reassemble into */
+        hss.recv = m_get();
+        if (!hss.recv) {
+            hdlc_stats.recv_mbuf_err++;
+            hss.r_discard = segment;
+            m_free(d);
+            return hss.polled ? hdlcs_rr() : 0;
+        }
+        if (d) {
+            memcpy(m_append(hss.recv, d->len), mtod(d, uint8_t *), d->len);
+            m_free(d);
+        }
+    }
+    else if (d) {
+        /* later segment - append to what we have */
+        if (d->len > M_TRAILINGSPACE(hss.recv)) {
+            DLOG_ERR("Reassembly overrun at %d bytes", hss.recv->len);
+            hdlc_stats.data_buf_overrun++;
+            m_free(hss.recv);
+            hss.recv = NULL;
+            hss.r_discard = segment;
+            m_free(d);
+            return segment && hss.polled ? hdlcs_rr() : 0;
         }
+        memcpy(m_append(hss.recv, d->len), mtod(d, uint8_t *), d->len);
+        m_free(d);
+    }
+
+    if (hss.icb) {
+        /* hand incoming data to registered callback */
+        DLOG_ERR("data CB not supported");
+    }
+    else if (!segment) {
+        /* this is the final element - queue it for hdlcs_read(), the
+         * frame check let it in only with room */
+        struct hdlcs_req *q = &hss.rxq[(hss.rxq_head + hss.rxq_n) % HDLCS_RXQ_MAX];
+
+        q->m = hss.recv;
+        q->rx_us = hdlc_rx_us();
+        hss.rxq_n++;
+        hss.recv = NULL;
+    }
+    else if (hss.polled) {
+        /* more to come - send back an RR to ack */
+        return hdlcs_rr();
     }
 
     return 0;
@@ -427,22 +904,29 @@ int
 hdlcs_rr(void)
 {
     uint8_t hdr[HDLC_HDR_SIZE];
-    int hdrlen;
-
-    if (!pending_rsp) {
-        dlog(LOG_DEBUG, "respond to RR with RR");
-        hdlc_hdr(0, hdlc_control_rr(hss.vr, 1), hss.esrc, hss.edst, hdr, &hdrlen);
-        hdlc_send_frame(hdr, NULL, 0);
-    }
-    else {
+    struct mbuf *m;
 
-        dlog(LOG_DEBUG, "Resending frame");
-        hdlcs_write(pending_rsp->m_data, pending_rsp->m_pktlen);
+    while ((m = obs_q_head()) && !hdlcs_txq_add(m)) {
+        /* txq owns it now, resent from there until acked */
+        DLOG_DEBUG("Queueing pending frame");
+        obs_q_pop();
 
         /* CoAP will also send app confirm */
         /* if not (and there is no data), proxy should send RR to confirm */
     }
 
+    if (hss.vs != hss.vq && SUBM8(hss.vs, hss.vs_ack) < hss.cfg.window_tx) {
+        return hdlcs_send_window();
+    }
+
+    if (hss.polled) {
+        DLOG_DEBUG("respond to RR with RR");
+        hdlc_hdr_tmpl_fill(&hss.htmpl, 0, hdlc_control_rr(hss.vr, 1), 0, hdr);
+        hdlc_send_frame(hdr, NULL, 0);
+        hdlc_stats.send_rr++;
+        hss.polled = 0;
+    }
+
     return 0;
 }
 
@@ -451,12 +935,11 @@ static int
 hdlcs_dm(void)
 {    
     uint8_t hdr[HDLC_HDR_SIZE];
-    int hdrlen;
 
     /* Disconnected Mode response */
-    dlog(LOG_WARNING, "request recv'd in disconnected mode");
+    DLOG_WARNING("request recv'd in disconnected mode");
     
-    hdlc_hdr(0, hdlc_control(HDLC_DM, 1), hss.esrc, hss.edst, hdr, &hdrlen);
+    hdlc_hdr_tmpl_fill(&hss.htmpl, 0, hdlc_control(HDLC_DM, 1), 0, hdr);
     hdlc_send_frame(hdr, NULL, 0);
 
     return 0;
@@ -468,12 +951,11 @@ static int
 hdlcs_frmr(void)
 {
     uint8_t hdr[HDLC_HDR_SIZE];
-    int hdrlen;
     
     /* Frame Reject response */
-    dlog(LOG_WARNING, "error - frame rejected");
+    DLOG_WARNING("error - frame rejected");
 
-    hdlc_hdr(0, hdlc_control(HDLC_FRMR, 1), hss.esrc, hss.edst, hdr, &hdrlen);
+    hdlc_hdr_tmpl_fill(&hss.htmpl, 0, hdlc_control(HDLC_FRMR, 1), 0, hdr);
     hdlc_send_frame(hdr, NULL, 0);
 
     return 0;
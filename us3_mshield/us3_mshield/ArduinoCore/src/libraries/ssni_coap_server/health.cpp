@@ -0,0 +1,167 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+
+
+#include <Arduino.h>
+#include <string.h>
+#include "health.h"
+#include "cbor.h"
+#include "log.h"
+#include "hbuf.h"
+#include "hdlc.h"
+#include "mbpoll.h"
+#include "sched.h"
+#include "exp_coap.h"
+
+
+static struct {
+    uint32_t period_s;          /* Between heartbeats, 0 -> off */
+    uint32_t last_ms;           /* millis() it was last encoded */
+    uint64_t up_ms;             /* Uptime then */
+    SensorBattFuncPtr batt_mv;  /* Battery reading, NULL -> none */
+    uint8_t once;               /* Encoded since boot */
+    uint8_t len;                /* Encoded length, 0 -> none waiting */
+    uint8_t enc[HEALTH_ENC_MAX];
+} health = { HEALTH_PERIOD_S };
+
+
+sapi_error_t
+health_set(uint32_t period_s, SensorBattFuncPtr batt_mv)
+{
+    if (period_s > HEALTH_MAX_S) {
+        return SAPI_ERR_BAD_DATA;
+    }
+    health.period_s = period_s;
+    health.batt_mv = batt_mv;
+    if (!period_s) {
+        health.len = 0;
+    }
+    return SAPI_ERR_OK;
+}
+
+
+/*
+ * Encode the heartbeat from the stats. The counters are summed over the
+ * Modbus slaves, the task times are the worst of the tasks.
+ */
+static void
+health_snap(void)
+{
+    struct hdlc_link_stats hs;
+    struct mb_stats st;
+    const struct sched_task *t;
+    struct cbor_buf cbuf;
+    uint32_t mb[4] = { 0, 0, 0, 0 };
+    uint32_t max_us = 0, late_ms = 0, misses = 0;
+    uint32_t now = millis();
+    uint16_t batt = health.batt_mv ? (*health.batt_mv)() : 0;
+    uint8_t slave, i;
+
+    health.up_ms += now - health.last_ms;
+    health.last_ms = now;
+    health.once = 1;
+
+    hdlc_get_stats(&hs);
+    for (i = 0; mb_poll_get_stats(i, &slave, &st); i++) {
+        mb[0] += st.requests;
+        mb[1] += st.timeouts;
+        mb[2] += st.crc_errors + st.frame_errors;
+        mb[3] += st.exceptions;
+    }
+    for (i = 0; (t = sched_get(i)); i++) {
+        max_us = max(max_us, t->max_us);
+        late_ms = max(late_ms, t->late_ms);
+        misses += t->misses;
+    }
+
+    cbor_enc_init(&cbuf, health.enc, sizeof(health.enc));
+    if (cbor_enc_map(&cbuf, batt ? 10 : 9) ||
+        cbor_enc_uint(&cbuf, 0) || cbor_enc_uint(&cbuf, (uint32_t)(health.up_ms / 1000)) ||
+        cbor_enc_uint(&cbuf, 1) || cbor_enc_uint(&cbuf, RSTC->RCAUSE.reg) ||
+        cbor_enc_uint(&cbuf, 2) || cbor_enc_uint(&cbuf, mem_stack_used()) ||
+        cbor_enc_uint(&cbuf, 3) || cbor_enc_uint(&cbuf, mem_free_min()) ||
+        cbor_enc_uint(&cbuf, 4) || cbor_enc_array(&cbuf, 2) ||
+        cbor_enc_uint(&cbuf, m_pool_peak(0)) || cbor_enc_uint(&cbuf, m_pool_peak(1)) ||
+        cbor_enc_uint(&cbuf, 5) || cbor_enc_uint(&cbuf, scratch_peak()) ||
+        cbor_enc_uint(&cbuf, 6) || cbor_enc_array(&cbuf, 6) ||
+        cbor_enc_uint(&cbuf, hs.rx_good) || cbor_enc_uint(&cbuf, hs.tx_frames) ||
+        cbor_enc_uint(&cbuf, hs.hcs_err + hs.fcs_err + hs.hdr_err + hs.len_err) ||
+        cbor_enc_uint(&cbuf, hs.rexmit) || cbor_enc_uint(&cbuf, hs.send_err) ||
+        cbor_enc_uint(&cbuf, coap_stats.nretries_exceeded) ||
+        cbor_enc_uint(&cbuf, 7) || cbor_enc_array(&cbuf, 4) ||
+        cbor_enc_uint(&cbuf, mb[0]) || cbor_enc_uint(&cbuf, mb[1]) ||
+        cbor_enc_uint(&cbuf, mb[2]) || cbor_enc_uint(&cbuf, mb[3]) ||
+        cbor_enc_uint(&cbuf, 8) || cbor_enc_array(&cbuf, 3) ||
+        cbor_enc_uint(&cbuf, max_us) || cbor_enc_uint(&cbuf, late_ms) || cbor_enc_uint(&cbuf, misses) ||
+        (batt && (cbor_enc_uint(&cbuf, 9) || cbor_enc_uint(&cbuf, batt)))) {
+        health.len = 0;
+        return;
+    }
+    health.len = cbor_buf_get_len(&cbuf);
+}
+
+
+void
+health_poll(void)
+{
+    if (health.period_s &&
+        (!health.once || millis() - health.last_ms >= health.period_s * 1000)) {
+        health_snap();
+    }
+}
+
+
+uint8_t
+health_len(void)
+{
+    return health.len;
+}
+
+
+void
+health_taken(void)
+{
+    health.len = 0;
+}
+
+
+uint8_t
+health_enc(struct cbor_buf *cbuf)
+{
+    if (cbuf->tail - cbuf->next < health.len) {
+        return CBOR_ERR;
+    }
+    memcpy(cbuf->next, health.enc, health.len);
+    cbuf->next += health.len;
+    return 0;
+}
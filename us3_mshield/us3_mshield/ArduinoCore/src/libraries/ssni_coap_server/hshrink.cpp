@@ -0,0 +1,130 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+
+#include <Arduino.h>
+#include <string.h>
+#include "hshrink.h"
+#include "log.h"
+
+
+#if HSHRINK
+#define HSHRINK_WINDOW          (1 << HSHRINK_WINDOW_SZ2)
+#define HSHRINK_LOOKAHEAD       (1 << HSHRINK_LOOKAHEAD_SZ2)
+
+struct hshrink_out {
+    uint8_t *buf;
+    uint16_t size;
+    uint16_t len;
+    uint8_t mask;           /* next bit of buf[len - 1], 0 for a new byte */
+    uint8_t over;
+};
+
+
+/* The low count bits of v, the highest first */
+static void
+hshrink_bits(struct hshrink_out *o, uint16_t v, uint8_t count)
+{
+    while (count--) {
+        if (!o->mask) {
+            if (o->len >= o->size) {
+                o->over = 1;
+                return;
+            }
+            o->buf[o->len++] = 0;
+            o->mask = 0x80;
+        }
+        if (v & (1 << count)) {
+            o->buf[o->len - 1] |= o->mask;
+        }
+        o->mask >>= 1;
+    }
+}
+
+
+uint16_t
+hshrink(const uint8_t *in, uint16_t len, uint8_t *out, uint16_t size)
+{
+    struct hshrink_out o = { out, size, 0, 0, 0 };
+    uint16_t i = 0, j, k, max, best, best_at;
+
+    while (i < len && !o.over) {
+        max = min(len - i, HSHRINK_LOOKAHEAD);
+        best = 0;
+        best_at = 0;
+        /* nearest first, a match may run on into the lookahead */
+        for (j = i; j-- > (i > HSHRINK_WINDOW ? i - HSHRINK_WINDOW : 0) && best < max; ) {
+            for (k = 0; k < max && in[j + k] == in[i + k]; k++)
+                ;
+            if (k > best) {
+                best = k;
+                best_at = j;
+            }
+        }
+        if (best >= 2) {
+            hshrink_bits(&o, 0, 1);
+            hshrink_bits(&o, i - best_at - 1, HSHRINK_WINDOW_SZ2);
+            hshrink_bits(&o, best - 1, HSHRINK_LOOKAHEAD_SZ2);
+            i += best;
+        } else {
+            hshrink_bits(&o, 0x100 | in[i], 9);
+            i++;
+        }
+    }
+    return o.over ? 0 : o.len;
+}
+
+
+uint8_t
+hshrink_mbuf(struct mbuf *m)
+{
+    uint16_t len = m->len, n = 0;
+    int mark;
+    uint8_t *out;
+
+    if (m->next || len < HSHRINK_MIN_LEN) {
+        return 0;
+    }
+    mark = scratch_mark();
+    out = (uint8_t *)scratch_alloc(len);
+    if (out) {
+        n = hshrink(mtod(m, const uint8_t *), len, out, len - 1);
+        if (n) {
+            memcpy(mtod(m, uint8_t *), out, n);
+            m->len = n;
+        }
+    }
+    scratch_release(mark);
+    DLOG_DEBUG("hshrink %d -> %d", len, n ? n : len);
+    return n != 0;
+}
+#endif
@@ -0,0 +1,96 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+
+#include <Arduino.h>
+#include "irqprio.h"
+#include "log.h"
+
+
+struct irq_prio {
+    int16_t irq;
+    uint8_t prio;
+    const char *name;
+};
+
+/* Every IRQ the firmware enables, with its place in the plan */
+static const struct irq_prio irq_prio_plan[] = {
+    { PORT_MNIC_IRQ, PORT_PRIO_RX, "mnic" },
+#if (PORT_RS485_SERIAL != PORT_NONE)
+    { PORT_RS485_IRQ, PORT_PRIO_RX, "rs485" },
+#endif
+#if (PORT_RS485B_SERIAL != PORT_NONE)
+    { PORT_RS485B_IRQ, PORT_PRIO_RX, "rs485b" },
+#endif
+#if (PORT_RS232_SERIAL != PORT_NONE)
+    { PORT_RS232_IRQ, PORT_PRIO_UART, "rs232" },
+#endif
+#if (PORT_GPS_SERIAL != PORT_NONE)
+    { PORT_GPS_IRQ, PORT_PRIO_UART, "gps" },
+#endif
+    { DMAC_IRQn, PORT_PRIO_DMA, "dmac" },
+    { SysTick_IRQn, PORT_PRIO_TICK, "systick" },
+    { EIC_IRQn, PORT_PRIO_LOW, "eic" },
+    { RTC_IRQn, PORT_PRIO_LOW, "rtc" },
+    { WDT_IRQn, PORT_PRIO_LOW, "wdt" },
+    { USB_IRQn, PORT_PRIO_LOW, "usb" },
+    { PORT_SERCOM_IRQ(SPI_SERCOM), PORT_PRIO_LOW, "spi" },
+};
+
+static uint32_t irq_prio_fixes;
+
+
+uint8_t
+irq_prio_check(void)
+{
+    uint8_t i, off = 0;
+    uint32_t p;
+
+    for (i = 0; i < sizeof(irq_prio_plan) / sizeof(irq_prio_plan[0]); i++) {
+        p = NVIC_GetPriority((IRQn_Type)irq_prio_plan[i].irq);
+        if (p != irq_prio_plan[i].prio) {
+            NVIC_SetPriority((IRQn_Type)irq_prio_plan[i].irq, irq_prio_plan[i].prio);
+            DLOG_ERR("IRQ %s at priority %lu, put back to %u", irq_prio_plan[i].name,
+                     (unsigned long)p, irq_prio_plan[i].prio);
+            off++;
+        }
+    }
+    irq_prio_fixes += off;
+    return off;
+}
+
+
+uint32_t
+irq_prio_fixed(void)
+{
+    return irq_prio_fixes;
+}
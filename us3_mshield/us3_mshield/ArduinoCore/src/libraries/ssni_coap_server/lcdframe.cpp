@@ -0,0 +1,123 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+#include <stdarg.h>
+#include "lcdframe.h"
+
+
+void
+lcd_frame_init(struct lcd_frame *f, LiquidCrystal_I2C *lcd, uint8_t cols, uint8_t rows)
+{
+    memset(f->next, ' ', sizeof(f->next));
+    memset(f->shown, ' ', sizeof(f->shown));
+    f->lcd = lcd;
+    f->cols = min(cols, LCD_FRAME_COLS_MAX);
+    f->rows = min(rows, LCD_FRAME_ROWS_MAX);
+    f->valid = 0;
+}
+
+
+void
+lcd_frame_clear(struct lcd_frame *f)
+{
+    memset(f->next, ' ', sizeof(f->next));
+}
+
+
+uint8_t
+lcd_frame_put(struct lcd_frame *f, uint8_t col, uint8_t row, const char *s)
+{
+    uint8_t n = 0;
+
+    if (row >= f->rows) {
+        return 0;
+    }
+    while (col < f->cols && s[n]) {
+        f->next[row][col++] = s[n++];
+    }
+    return n;
+}
+
+
+uint8_t
+lcd_frame_printf(struct lcd_frame *f, uint8_t col, uint8_t row, const char *fmt, ...)
+{
+    char buf[LCD_FRAME_COLS_MAX + 1];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    return lcd_frame_put(f, col, row, buf);
+}
+
+
+void
+lcd_frame_invalidate(struct lcd_frame *f)
+{
+    f->valid = 0;
+}
+
+
+uint16_t
+lcd_frame_flush(struct lcd_frame *f)
+{
+    uint16_t sent = 0;
+    uint8_t row, col, end, last;
+
+    for (row = 0; row < f->rows; row++) {
+        col = 0;
+        while (col < f->cols) {
+            if (f->valid && f->next[row][col] == f->shown[row][col]) {
+                col++;
+                continue;
+            }
+            /* A run of changes, through gaps too short for a new address */
+            end = col + 1;
+            last = col;
+            while (end < f->cols && end - last <= LCD_FRAME_GAP + 1) {
+                if (!f->valid || f->next[row][end] != f->shown[row][end]) {
+                    last = end;
+                }
+                end++;
+            }
+            end = last + 1;
+            f->lcd->setCursor(col, row);
+            f->lcd->writeRun((const uint8_t *)&f->next[row][col], end - col);
+            memcpy(&f->shown[row][col], &f->next[row][col], end - col);
+            sent += end - col;
+            col = end;
+        }
+    }
+    f->valid = 1;
+    return sent;
+}
@@ -30,7 +30,9 @@ Networks, Inc.
 #include <assert.h>
 #include <stdarg.h>
 #include "log.h"    
+#include "logfmt.h"
 #include "arduino_time.h"
+#include "hbuf.h"
 
 extern int verbose;
 
@@ -45,9 +47,32 @@ static const int numlevels = sizeof (label) / sizeof(label[0]);
 static Serial_ *pSerMon = NULL;
 #define SerMon (*pSerMon)
 static bool log_enabled = false;
+static uint32_t log_poll_ms = 0;
 
+// Ring of records. Slots are taken at the tail with interrupts masked for
+// the few instructions it takes, only log_drain moves the head.
+static struct log_rec log_ring[LOG_RING_RECS];
+static volatile uint8_t log_head = 0;
+static volatile uint8_t log_tail = 0;
+static volatile uint16_t log_dropped = 0;
 
-void log_init( Serial_ *pSerial, uint32_t baud, uint32_t log_level )
+// The console packet being gathered, see LOG_OUT_LEN
+static uint8_t log_out_buf[LOG_OUT_LEN];
+static uint8_t log_out_n = 0;
+static uint32_t log_out_ms = 0;		// millis() of its first byte
+
+class LogOut : public Print
+{
+public:
+	size_t write(uint8_t c) { return write(&c, 1); }
+	size_t write(const uint8_t *buffer, size_t size);
+	using Print::write;
+};
+
+static LogOut log_out;
+
+
+void log_init( Serial_ *pSerial, uint32_t baud, uint32_t log_level, uint8_t wait )
 {
 	// Assign pointer used for printing
 	pSerMon = pSerial;
@@ -59,7 +84,7 @@ void log_init( Serial_ *pSerial, uint32_t baud, uint32_t log_level )
 	//while(!SerMon);
 	// Give 16s to allow USB to connect to monitor.
 	log_enabled = false;
-	for (int indx=0 ; indx < 8 ; indx++) {
+	for (int indx=0 ; wait && indx < 8 ; indx++) {
 		if (!SerMon){
 			delay(2000);
 		} else {
@@ -73,6 +98,56 @@ void log_init( Serial_ *pSerial, uint32_t baud, uint32_t log_level )
 } // log_init
 
 
+size_t LogOut::write(const uint8_t *buffer, size_t size)
+{
+	size_t left = size;
+	size_t n;
+
+	while (left)
+	{
+		if (!log_out_n)
+		{
+			log_out_ms = millis();
+		}
+		n = min(left, (size_t)(LOG_OUT_LEN - log_out_n));
+		memcpy(&log_out_buf[log_out_n], buffer, n);
+		log_out_n += n;
+		buffer += n;
+		left -= n;
+		if (log_out_n == LOG_OUT_LEN)
+		{
+			log_flush();
+		}
+	}
+	return size;
+} // LogOut::write
+
+
+void log_flush()
+{
+	if (log_out_n && pSerMon)
+	{
+		SerMon.write(log_out_buf, log_out_n);
+	}
+	log_out_n = 0;
+} // log_flush
+
+
+void log_poll()
+{
+	if (log_out_n && (uint32_t)(millis() - log_out_ms) >= LOG_OUT_MS)
+	{
+		log_flush();
+	}
+
+	// The connection check costs 10ms, so not on every loop
+	if (log_enabled || !pSerMon || (uint32_t)(millis() - log_poll_ms) < 1000)
+		return;
+	log_poll_ms = millis();
+	log_enabled = (bool)SerMon;
+} // log_poll
+
+
 void dlog_level(int level)
 {
     /* force level bounds */
@@ -83,10 +158,284 @@ void dlog_level(int level)
 } // dlog_level
 
 
+int dlog_on(int level)
+{
+    return log_enabled && level <= log_level;
+} // dlog_on
+
+
+// Copy the arguments of a message into its record, in format order and
+// at the sizes of logfmt.h
+static void log_pack(struct log_rec *r, const char *format, va_list args)
+{
+	const char *p = format;
+	const char *str;
+	uint8_t type;
+	uint8_t size;
+	int n = 0;
+	union {
+		uint32_t u;
+		long long ll;
+		double d;
+	} v;
+
+	r->cut = 0;
+	while (*p)
+	{
+		if (*p++ != '%')
+		{
+			continue;
+		}
+		p = log_spec(p, &type);
+		if (!*p)
+		{
+			break;
+		}
+		p++;
+
+		size = log_arg_size(type);
+		switch (type)
+		{
+		case LOG_ARG_NONE:
+			continue;
+		case LOG_ARG_INT:		v.u = va_arg(args, int);							break;
+		case LOG_ARG_LONG:		v.u = va_arg(args, long);							break;
+		case LOG_ARG_LLONG:		v.ll = va_arg(args, long long);						break;
+		case LOG_ARG_DOUBLE:	v.d = va_arg(args, double);							break;
+		case LOG_ARG_PTR:		v.u = (uint32_t)(uintptr_t)va_arg(args, const void *);	break;
+		case LOG_ARG_STR:
+			if (!(str = va_arg(args, const char *)))
+			{
+				str = "(null)";
+			}
+			if (!log_put_str(r->args, &n, str))
+			{
+				r->cut = 1;
+				break;
+			}
+			continue;
+		default:
+			r->cut = 1;
+			break;
+		}
+		if (r->cut || n + size > LOG_ARG_BYTES)
+		{
+			r->cut = 1;
+			break;
+		}
+		memcpy(&r->args[n], &v, size);
+		n += size;
+	}
+	r->len = n;
+
+} // log_pack
+
+
+// Print the RTC time a record was logged at, as print_log_time does
+static void log_print_time(uint32_t ms)
+{
+	uint32_t t = get_rtc_epoch() - (millis() - ms) / 1000;
+	char buffer[24];
+
+	sprintf( buffer, "Time: %02d:%02d:%02d: ", (int)(t / 3600 % 24), (int)(t / 60 % 60), (int)(t % 60) );
+	log_out.print(buffer);
+
+} // log_print_time
+
+
+// Send a tokenized record as a frame, see logfmt.h
+static void log_send_token(const struct log_rec *r)
+{
+	uint8_t hdr[2 + LOG_TOK_HDR];
+	uint16_t token = (uint16_t)(uintptr_t)r->format;
+
+	hdr[0] = LOG_TOK_SOF;
+	hdr[1] = LOG_TOK_HDR + r->len;
+	hdr[2] = r->level | (r->cut ? LOG_TOK_CUT : 0);
+	hdr[3] = token & 0xff;
+	hdr[4] = token >> 8;
+	hdr[5] = r->ms & 0xff;
+	hdr[6] = (r->ms >> 8) & 0xff;
+	hdr[7] = (r->ms >> 16) & 0xff;
+	hdr[8] = r->ms >> 24;
+	log_out.write(hdr, sizeof(hdr));
+	log_out.write(r->args, r->len);
+
+} // log_send_token
+
+
+// Print up to max records, 0 for all, into the console packet
+static int log_drain_recs(int max)
+{
+	struct log_rec *r;
+	char *buffer;
+	int mark;
+	int n;
+	
+	if (!pSerMon)
+	{
+		return 0;
+	}
+	if (log_dropped)
+	{
+		log_print_time(millis());
+		log_out.print(log_dropped);
+		log_out.println(" log records dropped");
+		log_dropped = 0;
+	}
+
+	// Format in the scratch arena, just the format if it's full
+	mark = scratch_mark();
+	buffer = (char *) scratch_alloc(PRINTF_LEN);
+	for (n = 0; (!max || n < max) && log_head != log_tail; n++)
+	{
+		r = &log_ring[log_head % LOG_RING_RECS];
+		if (!r->ready)
+		{
+			break;
+		}
+		if (r->tok)
+		{
+			log_send_token(r);
+		}
+		else if (buffer)
+		{
+			log_print_time(r->ms);
+			log_format(buffer, PRINTF_LEN, r->format, r->args, r->len);
+			log_out.println(buffer);
+		}
+		else
+		{
+			log_print_time(r->ms);
+			log_out.println(r->format);
+		}
+		log_head++;
+	}
+	scratch_release(mark);
+	return (uint8_t)(log_tail - log_head);
+
+} // log_drain_recs
+
+
+int log_drain(int max)
+{
+	int left = log_drain_recs(max);
+
+	if (!max)
+	{
+		log_flush();
+	}
+	return left;
+
+} // log_drain
+
+
+int log_last(struct log_rec *dst, int max)
+{
+	const struct log_rec *r;
+	uint8_t tail = log_tail;
+	int n = 0;
+	int i;
+
+	// Slots never taken have no format, one being filled isn't ready
+	for (i = min(max, LOG_RING_RECS); i > 0; i--)
+	{
+		r = &log_ring[(uint8_t)(tail - i) % LOG_RING_RECS];
+		if (r->format && r->ready)
+		{
+			memcpy(&dst[n++], r, sizeof(*r));
+		}
+	}
+	return n;
+
+} // log_last
+
+
+void log_rec_text(const struct log_rec *r, char *buf, int size)
+{
+	int n;
+
+	n = snprintf(buf, size, "%lu %s: ", r->ms, label[r->level % numlevels]);
+	if (n < 0 || n >= size)
+	{
+		return;
+	}
+	if (r->tok)
+	{
+		snprintf(buf + n, size - n, "token %04x", (unsigned)(uintptr_t)r->format);
+	}
+	else if ((uintptr_t)r->format < FLASH_ADDR + FLASH_SIZE)
+	{
+		log_format(buf + n, size - n, r->format, r->args, r->len);
+	}
+	else
+	{
+		snprintf(buf + n, size - n, "format at %08lx", (uint32_t)(uintptr_t)r->format);
+	}
+
+} // log_rec_text
+
+
+// Take the slot at the tail, a full ring is drained first outside of an
+// interrupt. NULL when it stays full, the record is counted as dropped.
+static struct log_rec *log_take(int level, const char *format, uint8_t tok)
+{
+	struct log_rec *r;
+	uint32_t primask;
+
+	if ((uint8_t)(log_tail - log_head) == LOG_RING_RECS && !__get_IPSR())
+	{
+		(void)log_drain(1);
+	}
+	primask = __get_PRIMASK();
+	__disable_irq();
+	if ((uint8_t)(log_tail - log_head) == LOG_RING_RECS)
+	{
+		log_dropped++;
+		if (!primask)
+		{
+			__enable_irq();
+		}
+		return NULL;
+	}
+	r = &log_ring[log_tail % LOG_RING_RECS];
+	r->ready = 0;
+	log_tail++;
+	if (!primask)
+	{
+		__enable_irq();
+	}
+
+	r->ms = millis();
+	r->format = format;
+	r->level = level;
+	r->tok = tok;
+	return r;
+
+} // log_take
+
+
+int log_put_str(uint8_t *args, int *n, const char *str)
+{
+	int size;
+
+	if (*n >= LOG_ARG_BYTES)
+	{
+		return 0;
+	}
+	size = strnlen(str, LOG_ARG_BYTES - *n - 1);
+	memcpy(&args[*n], str, size);
+	args[*n + size] = 0;
+	*n += size + 1;
+	return 1;
+
+} // log_put_str
+
+
 void dlog(int level, const char *format, ...)
 {
     va_list args;
-	char buffer[PRINTF_LEN];
+	struct log_rec *r;
 	
 	// Is logging enabled?
 	if (!log_enabled)
@@ -100,22 +449,64 @@ void dlog(int level, const char *format, ...)
         return;
     }
 
-	// Print time
-	print_log_time();
-
-	// Print to serial port using the format
+	if (!(r = log_take(level, format, 0)))
+	{
+		return;
+	}
 	va_start( args, format );
-	vsprintf( buffer,format, args );
-	SerMon.println(buffer);
+	log_pack(r, format, args);
 	va_end(args);
+	r->ready = 1;
 
 } // dlog
 
 
+void dlog_tok_put(int level, const char *format, const struct log_tok_buf *t)
+{
+	struct log_rec *r;
+
+	if (!log_enabled || level > log_level || !(r = log_take(level, format, 1)))
+	{
+		return;
+	}
+	memcpy(r->args, t->b, t->n);
+	r->len = t->n;
+	r->cut = t->cut;
+	r->ready = 1;
+
+} // dlog_tok_put
+
+
+static const char log_hexdig[] = "0123456789abcdef";
+
+int log_hex(char *buf, const void *data, int len, char sep)
+{
+	const uint8_t *b = (const uint8_t *) data;
+	char *p = buf;
+	int i;
+
+	for (i = 0; i < len; i++)
+	{
+		if (sep && i)
+		{
+			*p++ = sep;
+		}
+		*p++ = log_hexdig[b[i] >> 4];
+		*p++ = log_hexdig[b[i] & 0x0f];
+	}
+	*p = 0;
+	return p - buf;
+
+} // log_hex
+
+
+// Bytes of a line of hex written at a time
+#define LOG_HEX_CHUNK	16
+
 void ddump(int level, const char *label, const void *data, int datalen)
 {
     const uint8_t *b = (const uint8_t *) data;
-	char buffer[PRINTF_LEN];
+	char buffer[LOG_HEX_CHUNK * 3 + 1];
     int i;
     
     // Is logging enabled?
@@ -128,23 +519,25 @@ void ddump(int level, const char *label, const void *data, int datalen)
 	{
         return;
     }
+	(void)log_drain_recs(0);
 
 	// Print time
 	print_log_time();
 
     if (label) 
 	{
-		sprintf( buffer, "%s:", label );
-        SerMon.print(buffer);
+        log_out.print(label);
+        log_out.print(":");
     }
 
-    for(i = 0; i < datalen; i++) 
+    for(i = 0; i < datalen; i += LOG_HEX_CHUNK) 
 	{
-		sprintf( buffer, " %02x", b[i] );
-        SerMon.print(buffer);
+		buffer[0] = ' ';
+		(void)log_hex(&buffer[1], &b[i], min(datalen - i, LOG_HEX_CHUNK), ' ');
+        log_out.print(buffer);
     }
     
-    SerMon.println("");
+    log_out.println("");
 
 } // ddump
 
@@ -205,8 +598,9 @@ void print( const char * buf )
 	{
         return;
     }
+	(void)log_drain_recs(0);
 
-	SerMon.print(buf);
+	log_out.print(buf);
 	
 } // print
 
@@ -223,8 +617,9 @@ void println( const char * buf )
 	{
         return;
     }
+	(void)log_drain_recs(0);
 
-	SerMon.println(buf);
+	log_out.println(buf);
 	
 } // println
 
@@ -241,8 +636,9 @@ void printnum( int n )
 	{
         return;
     }
+	(void)log_drain_recs(0);
 
-	SerMon.print(n);
+	log_out.print(n);
 	
 } // println
 
@@ -260,8 +656,7 @@ void capture( uint8_t ch )
 
 void capture_dump( uint8_t * p, int count )
 {
-	char str[6];
-    uint8_t ch;
+	char str[LOG_HEX_CHUNK * 3 + 1];
 	uint16_t ix;
 	
 	// Is logging enabled?
@@ -276,6 +671,7 @@ void capture_dump( uint8_t * p, int count )
         return;
     }
 	
+	(void)log_drain_recs(0);
 	if (!p)
 	{
 		p = &capture_buf[0];
@@ -287,17 +683,19 @@ void capture_dump( uint8_t * p, int count )
 		
 	}
 	
-	SerMon.println("======================================================");
-	for( ix = 0; ix < count-1; ix++ )
+	log_out.println("======================================================");
+	for( ix = 0; ix < count; ix += LOG_HEX_CHUNK )
 	{
-		ch = p[ix];
-		sprintf( str, "%02x,", ch );
-		SerMon.print(str);
+		if (ix)
+		{
+			log_out.print(",");
+		}
+		(void)log_hex(str, &p[ix], min(count - ix, LOG_HEX_CHUNK), ',');
+		log_out.print(str);
 
 	} // for
-	sprintf( str, "%02x", p[ix] );
-	SerMon.println(str);
-	SerMon.println("======================================================");
+	log_out.println("");
+	log_out.println("======================================================");
 
 	// Reset the count
 	cap_count = 0;
@@ -313,3 +711,65 @@ int free_ram()
 	return &stack_dummy - sbrk(0);
 }
 
+
+// Stack painting. The free RAM is filled with MEM_PAINT at boot, the lowest
+// byte that no longer holds it is as deep as the stack has been.
+#define MEM_PAINT			(0xC5)
+#define MEM_PAINT_MARGIN	(64)		// left for mem_paint's own frame and memset
+
+extern "C" char __StackTop;
+static char *mem_paint_lo;
+static char *mem_paint_hi;
+
+// Paint from the heap top up to just below the caller's stack frame
+void mem_paint()
+{
+	char stack_dummy = 0;
+
+	mem_paint_lo = sbrk(0);
+	mem_paint_hi = &stack_dummy - MEM_PAINT_MARGIN;
+	if (mem_paint_hi <= mem_paint_lo)
+	{
+		mem_paint_hi = mem_paint_lo;
+		return;
+	}
+	memset(mem_paint_lo, MEM_PAINT, mem_paint_hi - mem_paint_lo);
+
+} // mem_paint()
+
+
+// Lowest address the stack has reached, the heap may have grown into the paint
+static char *mem_stack_low()
+{
+	char *p = max(mem_paint_lo, sbrk(0));
+
+	while (p < mem_paint_hi && *p == (char)MEM_PAINT)
+	{
+		p++;
+	}
+	return p;
+
+} // mem_stack_low()
+
+
+uint32_t mem_stack_used()
+{
+	if (!mem_paint_lo)
+	{
+		return 0;
+	}
+	return &__StackTop - mem_stack_low();
+
+} // mem_stack_used()
+
+
+uint32_t mem_free_min()
+{
+	if (!mem_paint_lo)
+	{
+		return free_ram();
+	}
+	return mem_stack_low() - sbrk(0);
+
+} // mem_free_min()
+
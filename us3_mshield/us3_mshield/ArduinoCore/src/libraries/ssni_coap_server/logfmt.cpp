@@ -0,0 +1,202 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include "logfmt.h"
+#if defined(ARDUINO)
+#include <itoa.h>
+#endif
+
+
+const char *
+log_spec(const char *p, uint8_t *type)
+{
+    uint8_t l = 0;
+
+    while (*p && strchr("-+ #0123456789.", *p)) {
+        p++;
+    }
+    while (*p == 'h' || *p == 'l' || *p == 'j' || *p == 'z' || *p == 't') {
+        l += (*p == 'l' || *p == 'z' || *p == 't') ? 1 : (*p == 'j') ? 2 : 0;
+        p++;
+    }
+
+    switch (*p) {
+    case '%':
+        *type = LOG_ARG_NONE;
+        break;
+    case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+        *type = (l >= 2) ? LOG_ARG_LLONG : l ? LOG_ARG_LONG : LOG_ARG_INT;
+        break;
+    case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+        *type = LOG_ARG_DOUBLE;
+        break;
+    case 'p':
+        *type = LOG_ARG_PTR;
+        break;
+    case 's':
+        *type = LOG_ARG_STR;
+        break;
+    default:
+        *type = LOG_ARG_BAD;
+        break;
+    }
+    return p;
+}
+
+
+uint8_t
+log_arg_size(uint8_t type)
+{
+    switch (type) {
+    case LOG_ARG_INT:
+    case LOG_ARG_LONG:
+    case LOG_ARG_PTR:
+        return 4;
+    case LOG_ARG_LLONG:
+    case LOG_ARG_DOUBLE:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+
+#if defined(ARDUINO)
+/* Decimals of a plain %f or %.<n>f, the conversions ftoa_fixed can do; -1 for others */
+static int
+log_fixed_decimals(const char *spec)
+{
+    if (spec[1] == 'f' && !spec[2]) {
+        return 6;
+    }
+    if (spec[1] == '.' && spec[2] >= '0' && spec[2] <= '9' && spec[3] == 'f' && !spec[4]) {
+        return spec[2] - '0';
+    }
+    return -1;
+}
+#endif
+
+
+/* Little endian words of a record */
+static uint32_t
+log_get32(const uint8_t *a)
+{
+    return a[0] | (a[1] << 8) | ((uint32_t)a[2] << 16) | ((uint32_t)a[3] << 24);
+}
+
+
+void
+log_format(char *buf, int size, const char *format, const uint8_t *args, int len)
+{
+    const char *p = format;
+    const char *q;
+    const uint8_t *a = args;
+    const uint8_t *end = args + len;
+    char spec[16];
+    uint8_t type;
+    uint8_t n;
+    uint64_t ll;
+    uint32_t u;
+    double d;
+    int pos = 0;
+    int rem;
+    int w;
+
+    while (*p && pos < size - 1) {
+        if (*p != '%') {
+            buf[pos++] = *p++;
+            continue;
+        }
+        q = log_spec(p + 1, &type);
+        n = log_arg_size(type);
+        if (!*q || type == LOG_ARG_BAD || q - p >= (int)sizeof(spec) - 1 ||
+            (type == LOG_ARG_STR ? a >= end : a + n > end)) {
+            break;
+        }
+        if (type == LOG_ARG_NONE) {
+            buf[pos++] = '%';
+            p = q + 1;
+            continue;
+        }
+        memcpy(spec, p, q - p + 1);
+        spec[q - p + 1] = 0;
+
+        /* 32 bit values widened to what the host's conversion takes */
+        rem = size - pos;
+        u = (n == 4) ? log_get32(a) : 0;
+        switch (type) {
+        case LOG_ARG_INT:
+            w = snprintf(&buf[pos], rem, spec, (int)u);
+            break;
+        case LOG_ARG_LONG:
+            w = snprintf(&buf[pos], rem, spec, (*q == 'd' || *q == 'i') ? (long)(int32_t)u : (long)u);
+            break;
+        case LOG_ARG_PTR:
+            w = snprintf(&buf[pos], rem, spec, (void *)(uintptr_t)u);
+            break;
+        case LOG_ARG_LLONG:
+            ll = log_get32(a) | ((uint64_t)log_get32(a + 4) << 32);
+            w = snprintf(&buf[pos], rem, spec, (long long)ll);
+            break;
+        case LOG_ARG_DOUBLE:
+            memcpy(&d, a, sizeof(d));
+#if defined(ARDUINO)
+            {
+                /* Plain readings without newlib's soft-float printf */
+                char fixed[FTOA_FIXED_LEN];
+                int k = log_fixed_decimals(spec);
+
+                if (k >= 0 && (w = ftoa_fixed_exact(d, fixed, k)) >= 0) {
+                    memcpy(&buf[pos], fixed, (w < rem) ? w + 1 : rem - 1);
+                    buf[size - 1] = 0;
+                    break;
+                }
+            }
+#endif
+            w = snprintf(&buf[pos], rem, spec, d);
+            break;
+        default:
+            w = snprintf(&buf[pos], rem, spec, (const char *)a);
+            n = strnlen((const char *)a, end - a) + 1;
+            break;
+        }
+        a += n;
+        pos += (w < 0) ? 0 : (w >= rem) ? rem - 1 : w;
+        p = q + 1;
+    }
+
+    /* The rest as it is, its arguments are missing */
+    while (*p && pos < size - 1) {
+        buf[pos++] = *p++;
+    }
+    buf[pos] = 0;
+}
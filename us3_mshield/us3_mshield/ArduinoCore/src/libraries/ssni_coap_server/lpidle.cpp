@@ -0,0 +1,195 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+#include "lpidle.h"
+#include "sched.h"
+#include "duty.h"
+
+
+static lp_busy_fn lp_vetoes[LP_VETO_MAX];
+static uint8_t lp_nvetoes;
+static uint32_t lp_slept_ms;
+static uint8_t lp_frac;             /* 1/16 ms slept, not yet in millis() */
+
+/* A tick in 1/16 ms, 125 */
+#define LP_TICK_16              (16000 / LP_TICK_HZ)
+
+/* Longest wait counted, SCHED_NEVER would overflow the 1/16 ms */
+#define LP_WAIT_MAX_MS          3600000UL
+
+
+#if defined(SAML21)
+/* Only runs if a tick slips through, lp_standby takes them with it off */
+extern "C" void
+RTC_Handler(void)
+{
+    RTC->MODE2.INTFLAG.reg = RTC_MODE2_INTFLAG_PER0;
+}
+#endif
+
+
+void
+lp_init(void)
+{
+#if defined(SAML21)
+    /* the UARTs run on generator 0, it and its source stay up in standby */
+    switch (GCLK->GENCTRL[0].bit.SRC) {
+    case GCLK_GENCTRL_SRC_DPLL96M_Val:
+        OSCCTRL->DPLLCTRLA.bit.RUNSTDBY = 1;
+        break;
+    case GCLK_GENCTRL_SRC_DFLL48M_Val:
+        while (!OSCCTRL->STATUS.bit.DFLLRDY);
+        OSCCTRL->DFLLCTRL.bit.RUNSTDBY = 1;
+        while (!OSCCTRL->STATUS.bit.DFLLRDY);
+        break;
+    }
+    GCLK->GENCTRL[0].bit.RUNSTDBY = 1;
+    while (GCLK->SYNCBUSY.reg & GCLK_SYNCBUSY_GENCTRL(1u << 0));
+
+    /* the tick only wakes the WFI, its flag is taken with interrupts off */
+    RTC->MODE2.INTENCLR.reg = RTC_MODE2_INTENCLR_PER0;
+    RTC->MODE2.INTFLAG.reg = RTC_MODE2_INTFLAG_PER0;
+    NVIC_ClearPendingIRQ(RTC_IRQn);
+    NVIC_SetPriority(RTC_IRQn, PORT_PRIO_LOW);
+    NVIC_EnableIRQ(RTC_IRQn);
+
+    sched_sleep(lp_standby, LP_STANDBY_MIN_MS);
+#endif
+}
+
+
+void
+lp_uart(Uart *port)
+{
+    port->runInStandby(true);
+}
+
+
+int
+lp_veto(lp_busy_fn busy)
+{
+    if (lp_nvetoes >= LP_VETO_MAX) {
+        return -1;
+    }
+    lp_vetoes[lp_nvetoes++] = busy;
+    return 0;
+}
+
+
+#if defined(SAML21)
+/* Move millis() on by n 1/16 ms, the fractions carried */
+static void
+lp_count(uint16_t n)
+{
+    uint16_t sum = lp_frac + n;
+
+    tickAdvance(sum >> 4);
+    lp_slept_ms += sum >> 4;
+    lp_frac = sum & 15;
+}
+
+
+static void
+lp_sleepcfg(uint8_t mode)
+{
+    PM->SLEEPCFG.reg = mode;
+    while (PM->SLEEPCFG.reg != mode);
+}
+#endif
+
+
+void
+lp_standby(uint32_t wait_ms)
+{
+#if defined(SAML21)
+    uint32_t left;
+    uint16_t step;
+    uint8_t idle = PM->SLEEPCFG.reg;
+    uint8_t i;
+
+    for (i = 0; i < lp_nvetoes; i++) {
+        if (lp_vetoes[i]()) {
+            __WFI();
+            return;
+        }
+    }
+    /* an interrupt already pending would end it right away */
+    if (NVIC->ISPR[0] || (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk)) {
+        return;
+    }
+
+    DUTY_ENTER(DUTY_STANDBY);
+    left = min(wait_ms, LP_WAIT_MAX_MS) * 16;
+    RTC->MODE2.INTFLAG.reg = RTC_MODE2_INTFLAG_PER0;
+    RTC->MODE2.INTENSET.reg = RTC_MODE2_INTENSET_PER0;
+    lp_sleepcfg(PM_SLEEPCFG_SLEEPMODE_STANDBY);
+
+    /* the first tick comes half of one in, on average */
+    step = LP_TICK_16 / 2;
+    for (;;) {
+        __DSB();
+        __WFI();
+        if (!(RTC->MODE2.INTFLAG.reg & RTC_MODE2_INTFLAG_PER0)) {
+            /* woken by something else, it runs once interrupts are on, half
+             * a tick after the last on average */
+            if (step == LP_TICK_16) {
+                lp_count(LP_TICK_16 / 2);
+            }
+            break;
+        }
+        RTC->MODE2.INTFLAG.reg = RTC_MODE2_INTFLAG_PER0;
+        NVIC_ClearPendingIRQ(RTC_IRQn);
+        lp_count(step);
+        left = left > step ? left - step : 0;
+        step = LP_TICK_16;
+        /* SysTick takes the last part, and anything else pending */
+        if (left <= LP_TICK_16 || (NVIC->ISPR[0] & ~(1UL << RTC_IRQn))) {
+            break;
+        }
+    }
+
+    RTC->MODE2.INTENCLR.reg = RTC_MODE2_INTENCLR_PER0;
+    RTC->MODE2.INTFLAG.reg = RTC_MODE2_INTFLAG_PER0;
+    NVIC_ClearPendingIRQ(RTC_IRQn);
+    lp_sleepcfg(idle);
+    DUTY_EXIT();
+#else
+    __WFI();
+#endif
+}
+
+
+uint32_t
+lp_standby_ms(void)
+{
+    return lp_slept_ms;
+}
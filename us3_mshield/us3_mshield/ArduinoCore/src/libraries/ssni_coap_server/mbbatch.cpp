@@ -0,0 +1,173 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+#include "mbbatch.h"
+#include "cbor.h"
+
+/* Fields of a read */
+#define MB_BATCH_FIELDS         4
+
+
+int
+mb_batch_parse(struct mb_batch *b, const uint8_t *buf, int len)
+{
+    struct cbor_buf cbuf;
+    struct mb_batch_op *op;
+    uint32_t v[MB_BATCH_FIELDS];
+    uint16_t nregs = 0;
+    int n, i, k;
+
+    if (b->busy) {
+        return MB_ERR_BUSY;
+    }
+    cbor_dec_init(&cbuf, (void *)buf, len);
+    if (cbor_dec_well_formed(&cbuf) != CBOR_OK) {
+        return MB_ERR_ARG;
+    }
+    n = cbor_dec_array(&cbuf);
+    if (n == CBOR_ERR) {
+        return MB_ERR_ARG;
+    }
+    for (i = 0; ; i++) {
+        if (n == CBOR_DEC_INDEF ? cbor_dec_indef_break(&cbuf) : i >= n) {
+            break;
+        }
+        if (i >= MB_BATCH_MAX || cbor_dec_array(&cbuf) != MB_BATCH_FIELDS) {
+            return MB_ERR_ARG;
+        }
+        for (k = 0; k < MB_BATCH_FIELDS; k++) {
+            if (cbor_dec_uint(&cbuf, &v[k]) != CBOR_OK) {
+                return MB_ERR_ARG;
+            }
+        }
+        /* no broadcast, there is nothing to read back */
+        if (v[0] < 1 || v[0] > 247 ||
+            (v[1] != MB_FC_READ_HOLDING && v[1] != MB_FC_READ_INPUT) ||
+            v[2] > 0xffff || v[3] < 1 || v[3] > MB_RTU_MAX_READ ||
+            nregs + v[3] > MB_BATCH_MAX_REGS) {
+            return MB_ERR_ARG;
+        }
+        op = &b->op[i];
+        op->slave = v[0];
+        op->fc = v[1];
+        op->addr = v[2];
+        op->count = v[3];
+        op->off = nregs;
+        op->rc = MB_ERR_TIMEOUT;
+        nregs += v[3];
+    }
+    if (!i || cbuf.next != cbuf.tail) {
+        return MB_ERR_ARG;
+    }
+    b->n = i;
+    return i;
+}
+
+
+/* Queue the next read of the batch, or end it past the last */
+static void
+mb_batch_next(struct mb_batch *b)
+{
+    struct mb_batch_op *op;
+
+    for (; b->step < b->n; b->step++) {
+        op = &b->op[b->step];
+        b->req.slave = op->slave;
+        b->req.fc = op->fc;
+        b->req.addr = op->addr;
+        b->req.count = op->count;
+        b->req.regs = &b->regs[op->off];
+        if ((op->rc = mb_rtu_submit(b->mb, &b->req)) == MB_OK) {
+            return;
+        }
+    }
+
+    b->busy = 0;
+    if (b->done) {
+        b->done(b);
+    }
+}
+
+
+static void
+mb_batch_step(struct mb_req *req)
+{
+    struct mb_batch *b = (struct mb_batch *)req->arg;
+
+    b->op[b->step++].rc = req->rc;
+    mb_batch_next(b);
+}
+
+
+int
+mb_batch_start(struct mb_rtu *mb, struct mb_batch *b, mb_batch_fn done)
+{
+    if (b->busy) {
+        return MB_ERR_BUSY;
+    }
+    if (!b->n) {
+        return MB_ERR_ARG;
+    }
+    b->mb = mb;
+    b->step = 0;
+    b->done = done;
+    b->req.done = mb_batch_step;
+    b->req.arg = b;
+    b->req.timeout_ms = b->timeout_ms;
+    b->req.stats = NULL;
+    b->busy = 1;
+    mb_batch_next(b);
+    return MB_OK;
+}
+
+
+int
+mb_batch_encode(const struct mb_batch *b, uint8_t *buf, int len)
+{
+    const struct mb_batch_op *op;
+    struct cbor_buf cbuf;
+    int rc;
+    int i, k;
+
+    cbor_enc_init(&cbuf, buf, len);
+    rc = cbor_enc_array(&cbuf, b->n);
+    for (i = 0; i < b->n && !rc; i++) {
+        op = &b->op[i];
+        if (op->rc != MB_OK) {
+            rc = cbor_enc_int(&cbuf, op->rc);
+            continue;
+        }
+        rc = cbor_enc_array(&cbuf, op->count);
+        for (k = 0; k < op->count && !rc; k++) {
+            rc = cbor_enc_uint(&cbuf, b->regs[op->off + k]);
+        }
+    }
+    return rc ? MB_ERR_ARG : (int)cbor_buf_get_len(&cbuf);
+}
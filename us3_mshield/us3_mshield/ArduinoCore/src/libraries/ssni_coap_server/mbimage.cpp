@@ -0,0 +1,122 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+#include "mbimage.h"
+
+
+void
+mb_image_init(struct mb_image *img, uint8_t slave, uint16_t base,
+              uint16_t count, uint16_t *regs, uint32_t *stamp_ms,
+              uint8_t *quality, uint32_t max_age_ms)
+{
+    img->slave = slave;
+    img->base = base;
+    img->count = count;
+    img->regs = regs;
+    img->stamp_ms = stamp_ms;
+    img->quality = quality;
+    img->max_age_ms = max_age_ms;
+    memset(quality, MB_Q_NONE, count);
+}
+
+
+static uint8_t
+mb_image_has(const struct mb_image *img, uint16_t addr, uint16_t count)
+{
+    return addr >= img->base && (uint32_t)addr + count <= (uint32_t)img->base + img->count;
+}
+
+
+uint16_t *
+mb_image_regs(struct mb_image *img, uint16_t addr, uint16_t count)
+{
+    return mb_image_has(img, addr, count) ? &img->regs[addr - img->base] : NULL;
+}
+
+
+void
+mb_image_result(struct mb_image *img, const struct mb_reg_want *want,
+                int n, int rc)
+{
+    uint32_t now = millis();
+    uint16_t i, k;
+    int j;
+
+    for (j = 0; j < n; j++) {
+        if (!mb_image_has(img, want[j].addr, want[j].count)) {
+            continue;
+        }
+        for (i = 0; i < want[j].count; i++) {
+            k = want[j].addr - img->base + i;
+            if (rc == MB_OK) {
+                img->stamp_ms[k] = now;
+                img->quality[k] = MB_Q_GOOD;
+            } else if (img->quality[k] == MB_Q_GOOD) {
+                img->quality[k] = MB_Q_STALE;
+            }
+        }
+    }
+}
+
+
+uint8_t
+mb_image_read(const struct mb_image *img, uint16_t addr, uint16_t count,
+              uint16_t *regs, uint32_t *age_ms)
+{
+    uint32_t now = millis();
+    uint32_t age, oldest = 0;
+    uint8_t q = MB_Q_GOOD;
+    uint16_t i, k;
+
+    if (!count || !mb_image_has(img, addr, count)) {
+        return MB_Q_NONE;
+    }
+    for (i = 0; i < count; i++) {
+        k = addr - img->base + i;
+        if (img->quality[k] == MB_Q_NONE) {
+            return MB_Q_NONE;
+        }
+        age = now - img->stamp_ms[k];
+        if (age > oldest) {
+            oldest = age;
+        }
+        if (img->quality[k] < q) {
+            q = img->quality[k];
+        }
+        regs[i] = img->regs[k];
+    }
+    if (img->max_age_ms && oldest > img->max_age_ms) {
+        q = MB_Q_STALE;
+    }
+    if (age_ms) {
+        *age_ms = oldest;
+    }
+    return q;
+}
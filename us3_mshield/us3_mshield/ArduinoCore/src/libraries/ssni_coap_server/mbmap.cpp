@@ -0,0 +1,125 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+#include "mbmap.h"
+
+
+uint8_t
+mb_point_regs(const struct mb_point *pt)
+{
+    return pt->type <= MB_T_S16 ? 1 : 2;
+}
+
+
+/* The 32-bit raw value, the order only known at run time */
+static uint32_t
+mb_point_u32(const struct mb_point *pt, const uint16_t *regs)
+{
+    switch (pt->order) {
+    case MB_BADC:
+        return mb_regs_u32<MB_BADC>(regs);
+    case MB_CDAB:
+        return mb_regs_u32<MB_CDAB>(regs);
+    case MB_DCBA:
+        return mb_regs_u32<MB_DCBA>(regs);
+    default:
+        return mb_regs_u32<MB_ABCD>(regs);
+    }
+}
+
+
+float
+mb_point_value(const struct mb_point *pt, const uint16_t *regs)
+{
+    uint16_t w = (pt->order & 1) ? mb_reg_u16<MB_BA>(regs) : regs[0];
+    uint32_t u;
+    float f;
+
+    switch (pt->type) {
+    case MB_T_U16:
+        f = w;
+        break;
+    case MB_T_S16:
+        f = (int16_t)w;
+        break;
+    case MB_T_U32:
+        f = mb_point_u32(pt, regs);
+        break;
+    case MB_T_S32:
+        f = (int32_t)mb_point_u32(pt, regs);
+        break;
+    default:
+        u = mb_point_u32(pt, regs);
+        memcpy(&f, &u, sizeof(f));
+        break;
+    }
+    return f * pt->scale + pt->offset;
+}
+
+
+uint8_t
+mb_point_read(const struct mb_point *pt, const struct mb_image *img,
+              float *value, uint32_t *age_ms)
+{
+    uint16_t regs[MB_POINT_MAX_REGS];
+    uint8_t q;
+
+    q = mb_image_read(img, pt->addr, mb_point_regs(pt), regs, age_ms);
+    if (q != MB_Q_NONE) {
+        *value = mb_point_value(pt, regs);
+    }
+    return q;
+}
+
+
+int
+mb_map_wants(const struct mb_point *map, int n, uint8_t fc,
+             struct mb_image *img, struct mb_reg_want *want, int nwant)
+{
+    int cnt = 0;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        if (map[i].slave != img->slave || map[i].fc != fc) {
+            continue;
+        }
+        if (cnt == nwant) {
+            return MB_ERR_ARG;
+        }
+        want[cnt].addr = map[i].addr;
+        want[cnt].count = mb_point_regs(&map[i]);
+        want[cnt].regs = mb_image_regs(img, map[i].addr, want[cnt].count);
+        if (!want[cnt].regs) {
+            return MB_ERR_ARG;
+        }
+        cnt++;
+    }
+    return cnt;
+}
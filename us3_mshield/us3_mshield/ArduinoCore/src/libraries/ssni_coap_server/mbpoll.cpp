@@ -0,0 +1,256 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+#include "mbpoll.h"
+#include "log.h"
+
+
+/* The pollers, one per bus, for the stats */
+static struct mb_poller *mb_poll_owner[MB_RTU_MAX_BUSES];
+
+
+void
+mb_poll_init(struct mb_poller *pl, struct mb_rtu *mb,
+             struct mb_poll *tab, uint8_t n)
+{
+    uint32_t now = millis();
+    uint8_t i, slot;
+
+    memset(pl, 0, sizeof(*pl));
+    pl->mb = mb;
+    pl->tab = tab;
+    pl->n = n;
+    /* the slot of this poller or its bus, on a second init, or a free one */
+    slot = MB_RTU_MAX_BUSES;
+    for (i = 0; i < MB_RTU_MAX_BUSES; i++) {
+        if (mb_poll_owner[i] == pl || (mb_poll_owner[i] && mb_poll_owner[i]->mb == mb)) {
+            slot = i;
+            break;
+        }
+        if (!mb_poll_owner[i] && slot == MB_RTU_MAX_BUSES) {
+            slot = i;
+        }
+    }
+    if (slot < MB_RTU_MAX_BUSES) {
+        mb_poll_owner[slot] = pl;
+    }
+    for (i = 0; i < n; i++) {
+        tab[i].due_ms = now;
+        tab[i].tries = 0;
+        tab[i].backoff = 0;
+    }
+}
+
+
+/* The group of the entry on the bus is done */
+static void
+mb_poll_done(struct mb_group *grp)
+{
+    struct mb_poller *pl = (struct mb_poller *)grp->arg;
+    struct mb_poll *p = pl->cur;
+    uint32_t now = millis();
+    int rc = grp->rc;
+
+    pl->cur = NULL;
+    if (rc < 0 && rc != MB_ERR_ARG && p->tries < p->retries) {
+        /* again as soon as it is its turn */
+        p->tries++;
+        p->stats.retries++;
+        pl->mb->stats.retries++;
+        p->due_ms = now;
+        return;
+    }
+
+    p->polls++;
+    p->tries = 0;
+    p->rc = rc;
+    if (rc != MB_OK) {
+        p->failures++;
+    }
+    if (rc >= 0) {
+        /* it answered, an exception is no reason to back off */
+        p->backoff = 0;
+    } else {
+        if (p->backoff < MB_POLL_BACKOFF_MAX) {
+            p->backoff++;
+        }
+        DLOG_ERR("Modbus slave %d failed %d, next in %lu ms", p->slave, rc,
+             (unsigned long)(p->interval_ms << p->backoff));
+    }
+    /* from when it was due, so the rate does not drift with the bus time */
+    p->due_ms += p->interval_ms << p->backoff;
+    if ((int32_t)(now - p->due_ms) > 0) {
+        p->due_ms = now;
+    }
+    if (p->image) {
+        mb_image_result(p->image, p->want, p->n, rc);
+    }
+    if (p->batch) {
+        p->batch = 0;
+        pwr_domain_release(p->power);
+    }
+    if (p->done) {
+        p->done(p);
+    }
+}
+
+
+/* Power d up for every entry behind it due within its window, as one batch */
+static void
+mb_poll_batch(struct mb_poller *pl, struct pwr_domain *d, uint32_t now)
+{
+    struct mb_poll *p;
+    uint8_t i;
+
+    for (i = 0; i < pl->n; i++) {
+        p = &pl->tab[i];
+        if (p->power != d || p->batch || (int32_t)(p->due_ms - now) > (int32_t)d->window_ms) {
+            continue;
+        }
+        p->batch = 1;
+        pwr_domain_acquire(d);
+        if ((int32_t)(p->due_ms - now) > 0) {
+            p->due_ms = now;
+        }
+    }
+}
+
+
+void
+mb_poll_run(struct mb_poller *pl)
+{
+    struct mb_poll *p, *best = NULL;
+    uint32_t now = millis();
+    int32_t late, best_late = 0;
+    uint8_t i, k;
+    int rc;
+
+    if (pl->cur || !pl->n) {
+        return;
+    }
+
+    /* the most overdue, the scan order breaks ties round-robin */
+    for (i = 0; i < pl->n; i++) {
+        k = (pl->next + i) % pl->n;
+        p = &pl->tab[k];
+        late = (int32_t)(now - p->due_ms);
+        if (late < 0) {
+            continue;
+        }
+        if (p->power) {
+            if (!p->batch) {
+                mb_poll_batch(pl, p->power, now);
+            }
+            if (!pwr_domain_ready(p->power)) {
+                /* warming up, the others go meanwhile */
+                continue;
+            }
+        }
+        if (!best || late > best_late) {
+            best = p;
+            best_late = late;
+        }
+    }
+    if (!best) {
+        return;
+    }
+    pl->next = (best - pl->tab + 1) % pl->n;
+
+    pl->cur = best;
+    pl->grp.arg = pl;
+    pl->grp.timeout_ms = best->timeout_ms;
+    pl->grp.stats = &best->stats;
+    rc = mb_group_start(pl->mb, &pl->grp, best->slave, best->fc, best->want,
+                        best->n, best->gap, mb_poll_done);
+    if (rc != MB_OK) {
+        /* the table entry is wrong, fail it without the bus */
+        pl->grp.rc = rc;
+        mb_poll_done(&pl->grp);
+    }
+}
+
+
+uint32_t
+mb_poll_wait_ms(struct mb_poller *pl)
+{
+    uint32_t now = millis();
+    uint32_t wait = MB_POLL_NEVER;
+    int32_t d;
+    uint8_t i;
+
+    if (pl->cur) {
+        return 0;
+    }
+    for (i = 0; i < pl->n; i++) {
+        /* a cycle warming up its power domain is polled, not waited for */
+        if (pl->tab[i].batch) {
+            return 0;
+        }
+        d = (int32_t)(pl->tab[i].due_ms - now);
+        if (d <= 0) {
+            return 0;
+        }
+        if ((uint32_t)d < wait) {
+            wait = d;
+        }
+    }
+    return wait;
+}
+
+
+uint8_t
+mb_poll_get_stats(uint8_t i, uint8_t *slave, struct mb_stats *st)
+{
+    struct mb_poller *pl = NULL;
+    uint8_t b;
+
+    /* the bus then the entries of each poller in turn */
+    for (b = 0; b < MB_RTU_MAX_BUSES; b++) {
+        pl = mb_poll_owner[b];
+        if (!pl) {
+            continue;
+        }
+        if (i <= pl->n) {
+            break;
+        }
+        i -= pl->n + 1;
+    }
+    if (b == MB_RTU_MAX_BUSES) {
+        return 0;
+    }
+    if (!i) {
+        *slave = 0;
+        *st = pl->mb->stats;
+    } else {
+        *slave = pl->tab[i - 1].slave;
+        *st = pl->tab[i - 1].stats;
+    }
+    return 1;
+}
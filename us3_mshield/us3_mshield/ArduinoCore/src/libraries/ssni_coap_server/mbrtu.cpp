@@ -0,0 +1,804 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+#include "mbrtu.h"
+#include "crc_xmodem.h"
+#include "log.h"
+#include "trace.h"
+
+
+/*
+ * The masters, one per bus. The UART callbacks take no argument, so each
+ * slot has its pair, which hand their bytes to the master of the slot.
+ */
+static struct mb_rtu *mb_rtu_owner[MB_RTU_MAX_BUSES];
+
+
+static void
+mb_rtu_pin(uint8_t pin, uint8_t level)
+{
+    if (pin != MB_RTU_NO_PIN) {
+        digitalWrite(pin, level);
+    }
+}
+
+
+/* The last stop bit is out, from the transmit complete IRQ */
+static void
+mb_rtu_tx_done(struct mb_rtu *mb)
+{
+    if (mb->state != MB_STATE_TX) {
+        return;
+    }
+    mb_rtu_pin(mb->de_pin, LOW);
+    mb_rtu_pin(mb->re_pin, LOW);
+    mb->rx_len = 0;
+    mb->rx_expect = 0;
+    mb->rx_gap = 0;
+    mb->rx_done = 0;
+    mb->idle_us = micros();
+    mb->rx_start_us = mb->idle_us;
+    mb->state = MB_STATE_RX;
+}
+
+
+/*
+ * A reply byte, from the UART receive IRQ. Bytes outside a reply only
+ * keep the bus busy. The length is known from the second or third byte.
+ */
+static void
+mb_rtu_rx_byte(struct mb_rtu *mb, uint8_t c)
+{
+    uint32_t now = micros();
+    uint16_t len = mb->rx_len;
+
+    if (mb->state != MB_STATE_RX || mb->rx_done) {
+        mb->idle_us = now;
+        return;
+    }
+    if (len && (uint32_t)(now - mb->idle_us) > mb->t15_us) {
+        mb->rx_gap = 1;
+    } else if (!len) {
+        mb->rx_first_us = now;
+    }
+    mb->idle_us = now;
+    if (len < MB_RTU_MAX_ADU) {
+        mb->adu[len] = c;
+    }
+    len++;
+
+    if (len == 2 && (mb->adu[1] & MB_FC_EXCEPTION)) {
+        mb->rx_expect = 5;
+    } else if (len == 2 && mb->adu[1] != MB_FC_READ_HOLDING && mb->adu[1] != MB_FC_READ_INPUT) {
+        mb->rx_expect = 8;
+    } else if (len == 3 && !mb->rx_expect) {
+        mb->rx_expect = min(5 + mb->adu[2], 255);
+    }
+    mb->rx_len = len;
+    if (mb->rx_expect && len == mb->rx_expect) {
+        mb->rx_done = 1;
+    }
+}
+
+
+static void mb_rtu_rx_byte0(uint8_t c) { mb_rtu_rx_byte(mb_rtu_owner[0], c); }
+static void mb_rtu_tx_done0(void) { mb_rtu_tx_done(mb_rtu_owner[0]); }
+#if (MB_RTU_MAX_BUSES > 1)
+static void mb_rtu_rx_byte1(uint8_t c) { mb_rtu_rx_byte(mb_rtu_owner[1], c); }
+static void mb_rtu_tx_done1(void) { mb_rtu_tx_done(mb_rtu_owner[1]); }
+#endif
+
+static void (*const mb_rtu_rx_fn[MB_RTU_MAX_BUSES])(uint8_t) = {
+    mb_rtu_rx_byte0,
+#if (MB_RTU_MAX_BUSES > 1)
+    mb_rtu_rx_byte1,
+#endif
+};
+static void (*const mb_rtu_tx_fn[MB_RTU_MAX_BUSES])(void) = {
+    mb_rtu_tx_done0,
+#if (MB_RTU_MAX_BUSES > 1)
+    mb_rtu_tx_done1,
+#endif
+};
+static_assert(MB_RTU_MAX_BUSES <= 2, "one callback pair per bus");
+
+
+/* Bits of one character: start, data, parity, stop. In half bits for 1.5 stop. */
+static uint8_t
+mb_rtu_char_half_bits(uint16_t config)
+{
+    uint8_t hb = 2;
+
+    hb += 2 * (4 + ((config & HARDSER_DATA_MASK) >> 8));
+    if ((config & HARDSER_PARITY_MASK) != HARDSER_PARITY_NONE) {
+        hb += 2;
+    }
+    switch (config & HARDSER_STOP_BIT_MASK) {
+    case HARDSER_STOP_BIT_1_5:
+        hb += 3;
+        break;
+    case HARDSER_STOP_BIT_2:
+        hb += 4;
+        break;
+    default:
+        hb += 2;
+        break;
+    }
+    return hb;
+}
+
+
+void
+mb_rtu_timing(uint32_t baud, uint16_t config, uint16_t *char_us,
+              uint16_t *t15_us, uint16_t *t35_us)
+{
+    uint32_t hb = mb_rtu_char_half_bits(config);
+
+    *char_us = hb * 500000UL / baud;
+    if (baud > 19200) {
+        *t15_us = 750;
+        *t35_us = 1750;
+    } else {
+        *t15_us = hb * 750000UL / baud;
+        *t35_us = hb * 1750000UL / baud;
+    }
+}
+
+
+void
+mb_rtu_init(struct mb_rtu *mb, Uart *port, uint32_t baud, uint16_t config,
+            uint8_t de_pin, uint8_t re_pin)
+{
+    uint8_t i, slot;
+
+    memset(mb, 0, sizeof(*mb));
+    mb->port = port;
+    mb->baud = baud;
+    mb->config = config;
+    mb->de_pin = de_pin;
+    mb->re_pin = re_pin;
+    mb_rtu_timing(baud, config, &mb->char_us, &mb->t15_us, &mb->t35_us);
+    mb->timeout_ms = MB_RTU_TIMEOUT_MS;
+    mb->state = MB_STATE_IDLE;
+    memset(&mb->stats, 0, sizeof(mb->stats));
+
+    if (de_pin != MB_RTU_NO_PIN) {
+        pinMode(de_pin, OUTPUT);
+    }
+    if (re_pin != MB_RTU_NO_PIN) {
+        pinMode(re_pin, OUTPUT);
+    }
+    mb_rtu_pin(de_pin, LOW);
+    mb_rtu_pin(re_pin, LOW);
+
+    /* the slot it had, on a second init, or the first free one */
+    slot = MB_RTU_MAX_BUSES;
+    for (i = 0; i < MB_RTU_MAX_BUSES; i++) {
+        if (mb_rtu_owner[i] == mb) {
+            slot = i;
+            break;
+        }
+        if (!mb_rtu_owner[i] && slot == MB_RTU_MAX_BUSES) {
+            slot = i;
+        }
+    }
+    if (slot == MB_RTU_MAX_BUSES) {
+        DLOG_ERR("RS485: more than %d buses", MB_RTU_MAX_BUSES);
+        return;
+    }
+    mb_rtu_owner[slot] = mb;
+    port->begin(baud, config);
+    port->onReceive(mb_rtu_rx_fn[slot]);
+    port->onTransmitComplete(mb_rtu_tx_fn[slot]);
+    mb->idle_us = micros();
+}
+
+
+static uint8_t *
+mb_put16(uint8_t *p, uint16_t v)
+{
+    *p++ = v >> 8;
+    *p++ = v & 0xff;
+    return p;
+}
+
+
+static uint16_t
+mb_get16(const uint8_t *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+
+/* The request into adu with its CRC, returns its length */
+static int
+mb_rtu_build(struct mb_rtu *mb, const struct mb_req *req)
+{
+    uint8_t *p = mb->adu;
+    uint16_t crc;
+    uint16_t i;
+
+    *p++ = req->slave;
+    *p++ = req->fc;
+    p = mb_put16(p, req->addr);
+    switch (req->fc) {
+    case MB_FC_READ_HOLDING:
+    case MB_FC_READ_INPUT:
+        p = mb_put16(p, req->count);
+        break;
+    case MB_FC_WRITE_SINGLE:
+        p = mb_put16(p, req->regs[0]);
+        break;
+    case MB_FC_WRITE_MULTIPLE:
+        p = mb_put16(p, req->count);
+        *p++ = req->count * 2;
+        for (i = 0; i < req->count; i++) {
+            p = mb_put16(p, req->regs[i]);
+        }
+        break;
+    }
+    crc = crc_modbus(mb->adu, p - mb->adu);
+    *p++ = crc & 0xff;
+    *p++ = crc >> 8;
+    return p - mb->adu;
+}
+
+
+/*
+ * Check the reply in adu against the request. Reads hand their registers
+ * over, writes are checked against the echo of address and value or count.
+ */
+static int
+mb_rtu_check(struct mb_rtu *mb, const struct mb_req *req)
+{
+    uint16_t len = mb->rx_len;
+    uint16_t i;
+
+    if (mb->rx_gap || !mb->rx_expect || len != mb->rx_expect || len > MB_RTU_MAX_ADU) {
+        DLOG_ERR("Modbus frame, %d bytes", len);
+        return MB_ERR_FRAME;
+    }
+    if (crc_modbus(mb->adu, len - 2) != (mb->adu[len - 2] | (mb->adu[len - 1] << 8))) {
+        DLOG_ERR("Modbus CRC");
+        return MB_ERR_CRC;
+    }
+    if (mb->adu[0] != req->slave || (mb->adu[1] & ~MB_FC_EXCEPTION) != req->fc) {
+        return MB_ERR_FRAME;
+    }
+    if (mb->adu[1] & MB_FC_EXCEPTION) {
+        DLOG_ERR("Modbus exception %d", mb->adu[2]);
+        return mb->adu[2];
+    }
+
+    switch (req->fc) {
+    case MB_FC_READ_HOLDING:
+    case MB_FC_READ_INPUT:
+        if (mb->adu[2] != req->count * 2) {
+            break;
+        }
+        for (i = 0; i < req->count; i++) {
+            req->regs[i] = mb_get16(&mb->adu[3 + i * 2]);
+        }
+        return MB_OK;
+    case MB_FC_WRITE_SINGLE:
+        if (mb_get16(&mb->adu[2]) == req->addr && mb_get16(&mb->adu[4]) == req->regs[0]) {
+            return MB_OK;
+        }
+        break;
+    case MB_FC_WRITE_MULTIPLE:
+        if (mb_get16(&mb->adu[2]) == req->addr && mb_get16(&mb->adu[4]) == req->count) {
+            return MB_OK;
+        }
+        break;
+    }
+    return MB_ERR_FRAME;
+}
+
+
+int
+mb_rtu_submit(struct mb_rtu *mb, struct mb_req *req)
+{
+    switch (req->fc) {
+    case MB_FC_READ_HOLDING:
+    case MB_FC_READ_INPUT:
+        if (!req->slave || !req->count || req->count > MB_RTU_MAX_READ) {
+            return MB_ERR_ARG;
+        }
+        break;
+    case MB_FC_WRITE_SINGLE:
+        break;
+    case MB_FC_WRITE_MULTIPLE:
+        if (!req->count || req->count > MB_RTU_MAX_WRITE) {
+            return MB_ERR_ARG;
+        }
+        break;
+    default:
+        return MB_ERR_ARG;
+    }
+    if (req->busy) {
+        return MB_ERR_BUSY;
+    }
+
+    req->busy = 1;
+    req->next = NULL;
+    if (mb->tail) {
+        mb->tail->next = req;
+    } else {
+        mb->head = req;
+    }
+    mb->tail = req;
+    return MB_OK;
+}
+
+
+/* Time since the last bus activity, idle_us first as the IRQ moves it */
+static uint32_t
+mb_rtu_quiet_us(struct mb_rtu *mb)
+{
+    uint32_t idle = mb->idle_us;
+
+    return micros() - idle;
+}
+
+
+/*
+ * A reply latency into the smoothed latency and deviation, gains 1/8 and
+ * 1/4 as RFC 6298, the first sets both
+ */
+static void
+mb_rtt_sample(struct mb_stats *st, uint32_t lat_us)
+{
+    int32_t err;
+
+    st->rto_backoff = 0;
+    if (!st->srtt_us) {
+        st->srtt_us = lat_us ? lat_us : 1;
+        st->rttvar_us = lat_us / 2;
+        return;
+    }
+    err = (int32_t)(lat_us - st->srtt_us);
+    st->srtt_us += err / 8;
+    if ((int32_t)st->srtt_us <= 0) {
+        st->srtt_us = 1;
+    }
+    st->rttvar_us += ((err < 0 ? -err : err) - (int32_t)st->rttvar_us) / 4;
+}
+
+
+/* Reply timeout of req, adaptive from its slave's latency where it has stats */
+static uint32_t
+mb_rtu_rto_us(struct mb_rtu *mb, const struct mb_req *req)
+{
+    uint32_t max_us = (req->timeout_ms ? req->timeout_ms : mb->timeout_ms) * 1000UL;
+    const struct mb_stats *st = req->stats;
+    uint32_t rto;
+
+    if (!st || !st->srtt_us) {
+        return max_us;
+    }
+    rto = max(st->srtt_us + MB_RTO_K * st->rttvar_us, MB_RTO_MIN_MS * 1000UL);
+    if (rto >= max_us >> st->rto_backoff) {
+        return max_us;
+    }
+    return rto << st->rto_backoff;
+}
+
+
+/* Count a transaction done with rc, a reply by its latency */
+static void
+mb_stats_count(struct mb_stats *st, int rc, uint32_t lat_us)
+{
+    uint8_t k;
+
+    st->requests++;
+    switch (rc) {
+    case MB_ERR_TIMEOUT:
+        st->timeouts++;
+        if (st->rto_backoff < MB_RTO_BACKOFF_MAX) {
+            st->rto_backoff++;
+        }
+        return;
+    case MB_ERR_CRC:
+        st->crc_errors++;
+        break;
+    case MB_ERR_FRAME:
+        st->frame_errors++;
+        break;
+    default:
+        if (rc > 0) {
+            st->exceptions++;
+        }
+        break;
+    }
+    for (k = 0; k < MB_LAT_BINS - 1 && lat_us >= (1000UL << k); k++)
+        ;
+    st->latency[k]++;
+    mb_rtt_sample(st, lat_us);
+}
+
+
+/* Take the running request off the queue and tell its owner */
+static void
+mb_rtu_complete(struct mb_rtu *mb, int rc)
+{
+    struct mb_req *req = mb->head;
+    uint32_t lat_us = mb->rx_first_us - mb->rx_start_us;
+
+    if (req->slave) {
+        TRACE_FRAME(TRACE_RS485 | (rc != MB_OK ? TRACE_ERR : 0), mb->rx_len ? mb->rx_first_us : micros(),
+                    mb->adu, mb->rx_len, NULL, 0);
+        if (!req->probe) {
+            mb_stats_count(&mb->stats, rc, lat_us);
+        }
+        if (req->stats) {
+            mb_stats_count(req->stats, rc, lat_us);
+        }
+    }
+
+    mb->head = req->next;
+    if (!mb->head) {
+        mb->tail = NULL;
+    }
+    mb->state = MB_STATE_IDLE;
+    req->rc = rc;
+    req->busy = 0;
+    if (req->done) {
+        req->done(req);
+    }
+}
+
+
+void
+mb_rtu_poll(struct mb_rtu *mb)
+{
+    int len;
+
+    switch (mb->state) {
+    case MB_STATE_IDLE:
+        /* the bus has to be quiet t3.5 before a request goes */
+        if (!mb->head || mb_rtu_quiet_us(mb) < mb->t35_us) {
+            return;
+        }
+        len = mb_rtu_build(mb, mb->head);
+        mb->rto_us = mb_rtu_rto_us(mb, mb->head);
+        mb->state = MB_STATE_TX;
+        mb->tx_us = micros();
+        TRACE_FRAME(TRACE_RS485 | TRACE_TX, mb->tx_us, mb->adu, len, NULL, 0);
+        mb_rtu_pin(mb->de_pin, HIGH);
+        mb_rtu_pin(mb->re_pin, HIGH);
+        /* fits the TX ring, write does not wait. Bound to Uart, no vtable. */
+        (void)mb->port->Uart::write(mb->adu, len);
+        return;
+
+    case MB_STATE_TX:
+        /* the IRQ drops DE, this only bounds a lost interrupt */
+        if ((uint32_t)(micros() - mb->tx_us) > (MB_RTU_MAX_ADU + 2UL) * mb->char_us) {
+            noInterrupts();
+            mb_rtu_tx_done(mb);
+            interrupts();
+        }
+        return;
+
+    case MB_STATE_RX:
+        if (!mb->head->slave) {
+            /* broadcast, no reply, the turnaround is the quiet time */
+            mb_rtu_complete(mb, MB_OK);
+        } else if (mb->rx_done || (mb->rx_len && mb_rtu_quiet_us(mb) > mb->t35_us)) {
+            mb_rtu_complete(mb, mb_rtu_check(mb, mb->head));
+        } else if (!mb->rx_len && mb_rtu_quiet_us(mb) >= mb->rto_us) {
+            mb_rtu_complete(mb, MB_ERR_TIMEOUT);
+        }
+        return;
+    }
+}
+
+
+uint8_t
+mb_rtu_busy(struct mb_rtu *mb)
+{
+    return mb->head != NULL;
+}
+
+
+/* Queue req and poll until it is done */
+static int
+mb_rtu_wait(struct mb_rtu *mb, struct mb_req *req)
+{
+    int rc;
+
+    req->done = NULL;
+    rc = mb_rtu_submit(mb, req);
+    if (rc != MB_OK) {
+        return rc;
+    }
+    while (req->busy) {
+        mb_rtu_poll(mb);
+    }
+    return req->rc;
+}
+
+
+void
+mb_rtu_format(struct mb_rtu *mb, uint32_t baud, uint16_t config)
+{
+    mb->baud = baud;
+    mb->config = config;
+    mb_rtu_timing(baud, config, &mb->char_us, &mb->t15_us, &mb->t35_us);
+    mb->port->end();
+    mb->port->begin(baud, config);
+    mb->idle_us = micros();
+}
+
+
+/* Formats mb_rtu_detect tries, the most common first */
+static const uint32_t mb_detect_bauds[] = { 9600, 19200, 38400, 57600, 115200, 4800, 2400 };
+static const uint16_t mb_detect_configs[] = { SERIAL_8N1, SERIAL_8E1, SERIAL_8N2, SERIAL_8O1 };
+#define MB_DETECT_BAUDS         (sizeof(mb_detect_bauds) / sizeof(mb_detect_bauds[0]))
+#define MB_DETECT_CONFIGS       (sizeof(mb_detect_configs) / sizeof(mb_detect_configs[0]))
+
+
+/* One probe, a reply that checks out in the port's format */
+static uint8_t
+mb_detect_probe(struct mb_rtu *mb, uint8_t slave, uint8_t fc, uint16_t addr)
+{
+    uint16_t reg;
+    struct mb_req req = { NULL, slave, fc, addr, 1, &reg, NULL, NULL, 0, 0, 0, NULL };
+    uint8_t i;
+    int rc;
+
+    req.timeout_ms = MB_DETECT_T35S * mb->t35_us / 1000 + MB_DETECT_TURN_MS;
+    for (i = 0; i < MB_DETECT_TRIES; i++) {
+        rc = mb_rtu_wait(mb, &req);
+        if (rc == MB_OK || rc > 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+int
+mb_rtu_detect(struct mb_rtu *mb, uint8_t slave, uint8_t fc, uint16_t addr)
+{
+    struct mb_stats keep = mb->stats;
+    uint32_t baud = mb->baud;
+    uint16_t config = mb->config;
+    uint8_t found;
+    uint8_t b, c;
+
+    if (mb_rtu_busy(mb)) {
+        return MB_ERR_BUSY;
+    }
+    found = mb_detect_probe(mb, slave, fc, addr);
+    for (b = 0; !found && b < MB_DETECT_BAUDS; b++) {
+        for (c = 0; !found && c < MB_DETECT_CONFIGS; c++) {
+            if (mb_detect_bauds[b] == baud && mb_detect_configs[c] == config) {
+                continue;
+            }
+            mb_rtu_format(mb, mb_detect_bauds[b], mb_detect_configs[c]);
+            found = mb_detect_probe(mb, slave, fc, addr);
+        }
+    }
+    mb->stats = keep;
+    if (!found) {
+        mb_rtu_format(mb, baud, config);
+        DLOG_WARNING("RS485 slave %d: no reply in any format", slave);
+        return MB_ERR_TIMEOUT;
+    }
+    DLOG_INFO("RS485 slave %d: %lu baud, format %04x", slave, mb->baud, mb->config);
+    return MB_OK;
+}
+
+
+int
+mb_read_regs(struct mb_rtu *mb, uint8_t slave, uint8_t fc, uint16_t addr,
+             uint16_t count, uint16_t *regs)
+{
+    struct mb_req req = { NULL, slave, fc, addr, count, regs, NULL, NULL, 0, 0, 0, NULL };
+
+    if (fc != MB_FC_READ_HOLDING && fc != MB_FC_READ_INPUT) {
+        return MB_ERR_ARG;
+    }
+    return mb_rtu_wait(mb, &req);
+}
+
+
+int
+mb_write_reg(struct mb_rtu *mb, uint8_t slave, uint16_t addr, uint16_t value)
+{
+    struct mb_req req = { NULL, slave, MB_FC_WRITE_SINGLE, addr, 1, &value, NULL, NULL, 0, 0, 0, NULL };
+
+    return mb_rtu_wait(mb, &req);
+}
+
+
+int
+mb_write_regs(struct mb_rtu *mb, uint8_t slave, uint16_t addr,
+              uint16_t count, const uint16_t *regs)
+{
+    struct mb_req req = { NULL, slave, MB_FC_WRITE_MULTIPLE, addr, count, (uint16_t *)regs, NULL, NULL, 0, 0, 0, NULL };
+
+    return mb_rtu_wait(mb, &req);
+}
+
+
+/* Wanted ranges by address, small n so an insertion sort of indexes */
+static void
+mb_want_sort(const struct mb_reg_want *want, int n, uint8_t *order)
+{
+    uint8_t t;
+    int i, j;
+
+    for (i = 0; i < n; i++) {
+        order[i] = i;
+    }
+    for (i = 1; i < n; i++) {
+        t = order[i];
+        for (j = i; j > 0 && want[order[j - 1]].addr > want[t].addr; j--) {
+            order[j] = order[j - 1];
+        }
+        order[j] = t;
+    }
+}
+
+
+int
+mb_plan_reads(const struct mb_reg_want *want, int n, uint16_t gap,
+              uint16_t max, struct mb_read_plan *plan, int nplan)
+{
+    uint8_t order[MB_PLAN_MAX];
+    const struct mb_reg_want *w;
+    uint32_t end, wend;
+    int cnt = 0;
+    int i;
+
+    if (n > MB_PLAN_MAX) {
+        return MB_ERR_ARG;
+    }
+    mb_want_sort(want, n, order);
+
+    /* greedy, a read takes each next range while it stays in max */
+    for (i = 0; i < n; i++) {
+        w = &want[order[i]];
+        if (!w->count || w->count > max) {
+            return MB_ERR_ARG;
+        }
+        wend = (uint32_t)w->addr + w->count;
+        if (cnt) {
+            end = (uint32_t)plan[cnt - 1].addr + plan[cnt - 1].count;
+            if (w->addr <= end + gap && wend - plan[cnt - 1].addr <= max) {
+                if (wend > end) {
+                    plan[cnt - 1].count = wend - plan[cnt - 1].addr;
+                }
+                continue;
+            }
+        }
+        if (cnt == nplan) {
+            return MB_ERR_ARG;
+        }
+        plan[cnt].addr = w->addr;
+        plan[cnt].count = w->count;
+        cnt++;
+    }
+    return cnt;
+}
+
+
+/* One read of a group is done, hand its registers over and queue the next */
+static void
+mb_group_step(struct mb_req *req)
+{
+    struct mb_group *grp = (struct mb_group *)req->arg;
+    const struct mb_read_plan *plan = &grp->plan[grp->step];
+    const struct mb_reg_want *w;
+    int j;
+
+    if (req->rc == MB_OK) {
+        for (j = 0; j < grp->n; j++) {
+            w = &grp->want[j];
+            if (w->addr >= plan->addr && w->addr + w->count <= plan->addr + plan->count) {
+                memcpy(w->regs, &grp->regs[w->addr - plan->addr], w->count * sizeof(uint16_t));
+            }
+        }
+        if (++grp->step < grp->nplan) {
+            req->addr = grp->plan[grp->step].addr;
+            req->count = grp->plan[grp->step].count;
+            mb_rtu_submit(grp->mb, req);
+            return;
+        }
+    }
+
+    grp->rc = req->rc;
+    grp->busy = 0;
+    if (grp->done) {
+        grp->done(grp);
+    }
+}
+
+
+int
+mb_group_start(struct mb_rtu *mb, struct mb_group *grp, uint8_t slave,
+               uint8_t fc, const struct mb_reg_want *want, int n,
+               uint16_t gap, mb_group_fn done)
+{
+    int cnt;
+
+    if (grp->busy) {
+        return MB_ERR_BUSY;
+    }
+    cnt = mb_plan_reads(want, n, gap, MB_RTU_MAX_READ, grp->plan, MB_PLAN_MAX);
+    if (cnt <= 0) {
+        return MB_ERR_ARG;
+    }
+    grp->mb = mb;
+    grp->want = want;
+    grp->n = n;
+    grp->nplan = cnt;
+    grp->step = 0;
+    grp->done = done;
+    grp->req.slave = slave;
+    grp->req.fc = fc;
+    grp->req.addr = grp->plan[0].addr;
+    grp->req.count = grp->plan[0].count;
+    grp->req.regs = grp->regs;
+    grp->req.done = mb_group_step;
+    grp->req.arg = grp;
+    grp->req.timeout_ms = grp->timeout_ms;
+    grp->req.stats = grp->stats;
+    grp->busy = 1;
+    cnt = mb_rtu_submit(mb, &grp->req);
+    if (cnt != MB_OK) {
+        grp->busy = 0;
+    }
+    return cnt;
+}
+
+
+int
+mb_read_group(struct mb_rtu *mb, uint8_t slave, uint8_t fc,
+              const struct mb_reg_want *want, int n, uint16_t gap)
+{
+    struct mb_group grp;
+    int rc;
+
+    grp.busy = 0;
+    grp.req.busy = 0;
+    grp.timeout_ms = 0;
+    grp.stats = NULL;
+    rc = mb_group_start(mb, &grp, slave, fc, want, n, gap, NULL);
+    if (rc != MB_OK) {
+        return rc;
+    }
+    while (grp.busy) {
+        mb_rtu_poll(mb);
+    }
+    return grp.rc;
+}
+
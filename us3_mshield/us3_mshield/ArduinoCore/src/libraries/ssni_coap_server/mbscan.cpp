@@ -0,0 +1,148 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+
+#include "mbscan.h"
+#include "log.h"
+
+
+/* Queue the probe of the next address, or end the scan past the last */
+static void
+mb_scan_next(struct mb_scan *s)
+{
+    for (; s->next <= s->last; s->next++) {
+        /* no latency of its own yet, the probe's timeout holds */
+        memset(&s->probe, 0, sizeof(s->probe));
+        s->req.slave = s->next;
+        if (mb_rtu_submit(s->mb, &s->req) == MB_OK) {
+            return;
+        }
+    }
+
+    s->took_ms = millis() - s->start_ms;
+    s->busy = 0;
+    DLOG_INFO("Modbus scan: %d slaves in %lu ms", s->found, (unsigned long)s->took_ms);
+    if (s->done) {
+        s->done(s);
+    }
+}
+
+
+static void
+mb_scan_step(struct mb_req *req)
+{
+    struct mb_scan *s = (struct mb_scan *)req->arg;
+    struct mb_scan_hit *h;
+
+    /* an exception is an answer too, there is a slave */
+    if (req->rc == MB_OK || req->rc > 0) {
+        s->found++;
+        if (s->n < MB_SCAN_MAX) {
+            h = &s->hit[s->n++];
+            h->slave = req->slave;
+            h->rc = req->rc;
+            h->lat_us = s->probe.srtt_us;
+        }
+        DLOG_INFO("Modbus slave %d answered %d in %lu us", req->slave, req->rc,
+                  (unsigned long)s->probe.srtt_us);
+    }
+    s->next++;
+    mb_scan_next(s);
+}
+
+
+int
+mb_scan_start(struct mb_scan *s, struct mb_rtu *mb, uint8_t fc, uint16_t addr,
+              uint8_t first, uint8_t last, mb_scan_fn done)
+{
+    if (s->busy) {
+        return MB_ERR_BUSY;
+    }
+    if (first < MB_SCAN_FIRST || last > MB_SCAN_LAST || first > last ||
+        (fc != MB_FC_READ_HOLDING && fc != MB_FC_READ_INPUT)) {
+        return MB_ERR_ARG;
+    }
+    s->mb = mb;
+    s->fc = fc;
+    s->addr = addr;
+    s->next = first;
+    s->last = last;
+    s->n = 0;
+    s->found = 0;
+    s->start_ms = millis();
+    s->done = done;
+    memset(&s->req, 0, sizeof(s->req));
+    s->req.fc = fc;
+    s->req.addr = addr;
+    s->req.count = 1;
+    s->req.regs = &s->reg;
+    s->req.done = mb_scan_step;
+    s->req.arg = s;
+    s->req.timeout_ms = MB_SCAN_T35S * mb->t35_us / 1000 + MB_SCAN_TURN_MS;
+    s->req.stats = &s->probe;
+    s->req.probe = 1;
+    s->busy = 1;
+    mb_scan_next(s);
+    return MB_OK;
+}
+
+
+uint8_t
+mb_scan_table(struct mb_scan *s, struct mb_poll *tab, uint8_t n, uint8_t max,
+              uint32_t interval_ms)
+{
+    struct mb_scan_hit *h;
+    struct mb_poll *p;
+    uint8_t i, k;
+
+    for (i = 0; i < s->n && n < max; i++) {
+        h = &s->hit[i];
+        for (k = 0; k < n && tab[k].slave != h->slave; k++)
+            ;
+        if (k < n) {
+            continue;
+        }
+        h->want.addr = s->addr;
+        h->want.count = 1;
+        h->want.regs = &h->reg;
+        p = &tab[n++];
+        memset(p, 0, sizeof(*p));
+        p->slave = h->slave;
+        p->fc = s->fc;
+        p->want = &h->want;
+        p->n = 1;
+        p->interval_ms = interval_ms;
+        p->stats.srtt_us = h->lat_us;
+        p->stats.rttvar_us = h->lat_us / 2;
+    }
+    return n;
+}
@@ -0,0 +1,213 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+#include "mbslave.h"
+#include "crc_xmodem.h"
+
+
+static struct mb_slave *mb_slave_owner;
+
+
+static void
+mb_slave_pin(uint8_t pin, uint8_t level)
+{
+    if (pin != MB_RTU_NO_PIN) {
+        digitalWrite(pin, level);
+    }
+}
+
+
+/* The answer is out, from the transmit complete IRQ */
+static void
+mb_slave_tx_done(void)
+{
+    struct mb_slave *s = mb_slave_owner;
+
+    if (s->state != MB_SLAVE_TX) {
+        return;
+    }
+    mb_slave_pin(s->de_pin, LOW);
+    mb_slave_pin(s->re_pin, LOW);
+    s->rx_len = 0;
+    s->rx_gap = 0;
+    s->idle_us = micros();
+    s->state = MB_SLAVE_RX;
+}
+
+
+/* A request byte, from the UART receive IRQ */
+static void
+mb_slave_rx_byte(uint8_t c)
+{
+    struct mb_slave *s = mb_slave_owner;
+    uint32_t now = micros();
+    uint16_t len = s->rx_len;
+
+    if (s->state != MB_SLAVE_RX) {
+        return;
+    }
+    if (len && (uint32_t)(now - s->idle_us) > s->t15_us) {
+        s->rx_gap = 1;
+    }
+    s->idle_us = now;
+    if (len < MB_RTU_MAX_ADU) {
+        s->adu[len] = c;
+    }
+    s->rx_len = len + 1;
+}
+
+
+void
+mb_slave_init(struct mb_slave *s, Uart *port, uint32_t baud, uint16_t config,
+              uint8_t addr, uint8_t de_pin, uint8_t re_pin,
+              mb_slave_read_fn read)
+{
+    memset(s, 0, sizeof(*s));
+    s->port = port;
+    s->addr = addr;
+    s->de_pin = de_pin;
+    s->re_pin = re_pin;
+    s->read = read;
+    mb_rtu_timing(baud, config, &s->char_us, &s->t15_us, &s->t35_us);
+    s->state = MB_SLAVE_RX;
+
+    if (de_pin != MB_RTU_NO_PIN) {
+        pinMode(de_pin, OUTPUT);
+    }
+    if (re_pin != MB_RTU_NO_PIN) {
+        pinMode(re_pin, OUTPUT);
+    }
+    mb_slave_pin(de_pin, LOW);
+    mb_slave_pin(re_pin, LOW);
+
+    mb_slave_owner = s;
+    port->begin(baud, config);
+    port->onReceive(mb_slave_rx_byte);
+    port->onTransmitComplete(mb_slave_tx_done);
+    s->idle_us = micros();
+}
+
+
+/* The answer to the request in adu, built over it. Returns its length, 0 for none. */
+static int
+mb_slave_answer(struct mb_slave *s, uint16_t len)
+{
+    uint16_t regs[MB_RTU_MAX_READ];
+    uint16_t addr, count, crc, i;
+    uint8_t fc, ex = 0;
+    uint8_t *p;
+
+    if (s->rx_gap || len < 4 || len > MB_RTU_MAX_ADU) {
+        s->frame_errors++;
+        return 0;
+    }
+    if (crc_modbus(s->adu, len - 2) != (s->adu[len - 2] | (s->adu[len - 1] << 8))) {
+        s->crc_errors++;
+        return 0;
+    }
+    if (s->adu[0] != s->addr) {
+        /* someone else's, or a broadcast, which reads can not be */
+        return 0;
+    }
+
+    fc = s->adu[1];
+    if (fc != MB_FC_READ_HOLDING && fc != MB_FC_READ_INPUT) {
+        ex = MB_EX_ILLEGAL_FUNCTION;
+    } else if (len != 8) {
+        s->frame_errors++;
+        return 0;
+    } else {
+        addr = mb_u16<MB_AB>(&s->adu[2]);
+        count = mb_u16<MB_AB>(&s->adu[4]);
+        if (!count || count > MB_RTU_MAX_READ) {
+            ex = MB_EX_ILLEGAL_VALUE;
+        } else {
+            ex = s->read(fc, addr, count, regs);
+        }
+    }
+
+    s->requests++;
+    p = &s->adu[2];
+    if (ex) {
+        s->exceptions++;
+        s->adu[1] = fc | MB_FC_EXCEPTION;
+        *p++ = ex;
+    } else {
+        *p++ = count * 2;
+        for (i = 0; i < count; i++) {
+            *p++ = regs[i] >> 8;
+            *p++ = regs[i] & 0xff;
+        }
+    }
+    crc = crc_modbus(s->adu, p - s->adu);
+    *p++ = crc & 0xff;
+    *p++ = crc >> 8;
+    return p - s->adu;
+}
+
+
+void
+mb_slave_poll(struct mb_slave *s)
+{
+    uint32_t idle = s->idle_us;
+    uint16_t len = s->rx_len;
+    int n, i;
+
+    if (s->state == MB_SLAVE_TX) {
+        /* the IRQ drops DE, this only bounds a lost interrupt */
+        if ((uint32_t)(micros() - s->tx_us) > (MB_RTU_MAX_ADU + 2UL) * s->char_us) {
+            noInterrupts();
+            mb_slave_tx_done();
+            interrupts();
+        }
+        return;
+    }
+    if (!len || (uint32_t)(micros() - idle) <= s->t35_us) {
+        return;
+    }
+
+    /* the request has ended, bytes from now wait for the next */
+    s->state = MB_SLAVE_TX;
+    n = mb_slave_answer(s, len);
+    if (!n) {
+        s->state = MB_SLAVE_RX;
+        noInterrupts();
+        s->rx_len = 0;
+        s->rx_gap = 0;
+        interrupts();
+        return;
+    }
+    s->tx_us = micros();
+    mb_slave_pin(s->de_pin, HIGH);
+    mb_slave_pin(s->re_pin, HIGH);
+    for (i = 0; i < n; i++) {
+        s->port->write(s->adu[i]);
+    }
+}
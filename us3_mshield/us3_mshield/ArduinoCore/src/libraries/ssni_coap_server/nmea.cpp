@@ -0,0 +1,343 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+#include "nmea.h"
+
+
+static struct nmea *nmea_owner;
+
+#define NMEA_SEEN_LAT           0x01
+#define NMEA_SEEN_LON           0x02
+
+static const uint32_t nmea_pow10[NMEA_FRAC_MAX + 1] = { 1, 10, 100, 1000, 10000, 100000 };
+
+
+static void
+nmea_rx_byte(uint8_t c)
+{
+    nmea_byte(nmea_owner, c);
+}
+
+
+void
+nmea_init(struct nmea *nm, Uart *port, uint32_t baud, uint16_t config, uint8_t want)
+{
+    memset(nm, 0, sizeof(*nm));
+    nm->want = want;
+    nm->state = NMEA_STATE_IDLE;
+
+    nmea_owner = nm;
+    port->begin(baud, config);
+    port->onReceive(nmea_rx_byte);
+}
+
+
+/* The field as a number of dec decimals, its fraction cut or padded */
+static int32_t
+nmea_fixed(struct nmea *nm, uint8_t dec)
+{
+    uint8_t frac = nm->nfrac == 0xff ? 0 : nm->nfrac;
+    uint32_t v = nm->val;
+
+    if (frac < dec) {
+        v *= nmea_pow10[dec - frac];
+    } else {
+        v /= nmea_pow10[frac - dec];
+    }
+    return nm->neg ? -(int32_t)v : (int32_t)v;
+}
+
+
+/* ddmm.mmmmm or dddmm.mmmmm to 1e-7 degrees */
+static int32_t
+nmea_angle(struct nmea *nm)
+{
+    uint32_t v = (uint32_t)nmea_fixed(nm, NMEA_FRAC_MAX);
+    uint32_t min = v % 10000000UL;  /* 1e-5 minutes */
+
+    return (int32_t)((v / 10000000UL) * 10000000UL + min * 10 / 6);
+}
+
+
+/* hhmmss.sss to ms since midnight */
+static uint32_t
+nmea_time(struct nmea *nm)
+{
+    uint32_t t = (uint32_t)nmea_fixed(nm, 3);
+    uint32_t hms = t / 1000;
+
+    return (hms / 10000) * 3600000UL + (hms / 100 % 100) * 60000UL + (hms % 100) * 1000UL + t % 1000;
+}
+
+
+/* A field of an RMC or GGA has ended, into the work fix */
+static void
+nmea_field(struct nmea *nm)
+{
+    struct nmea_fix *w = &nm->work;
+    uint8_t f = nm->field;
+
+    if (!nm->ndig && !nm->c0) {
+        return;
+    }
+    /* GGA has no status, its fields past the time are one place on */
+    if (nm->type == NMEA_GGA && f >= 2) {
+        f++;
+    }
+    switch (f) {
+    case 1:
+        w->time_ms = nmea_time(nm);
+        w->have |= NMEA_HAVE_TIME;
+        return;
+    case 3:
+        if (nm->ndig) {
+            w->lat = nmea_angle(nm);
+            nm->seen |= NMEA_SEEN_LAT;
+        }
+        return;
+    case 4:
+        if (nm->c0 == 'S' && (nm->seen & NMEA_SEEN_LAT)) {
+            w->lat = -w->lat;
+        }
+        return;
+    case 5:
+        if (nm->ndig) {
+            w->lon = nmea_angle(nm);
+            nm->seen |= NMEA_SEEN_LON;
+        }
+        return;
+    case 6:
+        if (nm->c0 == 'W' && (nm->seen & NMEA_SEEN_LON)) {
+            w->lon = -w->lon;
+        }
+        return;
+    }
+
+    if (nm->type == NMEA_RMC) {
+        switch (f) {
+        case 2:
+            w->valid = nm->c0 == 'A';
+            break;
+        case 7:
+            w->speed = (uint32_t)nmea_fixed(nm, 2);
+            w->have |= NMEA_HAVE_MOTION;
+            break;
+        case 8:
+            w->course = (uint32_t)nmea_fixed(nm, 2);
+            break;
+        case 9:
+            w->day = nm->val / 10000;
+            w->month = nm->val / 100 % 100;
+            w->year = nm->val % 100;
+            w->have |= NMEA_HAVE_DATE;
+            break;
+        }
+    } else {
+        /* GGA, 7 onwards the fix itself */
+        switch (f) {
+        case 7:
+            w->quality = nm->val;
+            break;
+        case 8:
+            w->sats = nm->val;
+            break;
+        case 9:
+            w->hdop = (uint16_t)nmea_fixed(nm, 2);
+            break;
+        case 10:
+            w->alt_cm = nmea_fixed(nm, 2);
+            w->have |= NMEA_HAVE_ALT;
+            break;
+        }
+    }
+}
+
+
+/* The address field has ended, is it a sentence to decode */
+static uint8_t
+nmea_type(struct nmea *nm)
+{
+    const char *id = &nm->addr[2];
+
+    if (nm->len != 6) {
+        return 0;
+    }
+    if ((nm->want & NMEA_RMC) && id[0] == 'R' && id[1] == 'M' && id[2] == 'C') {
+        return NMEA_RMC;
+    }
+    if ((nm->want & NMEA_GGA) && id[0] == 'G' && id[1] == 'G' && id[2] == 'A') {
+        return NMEA_GGA;
+    }
+    return 0;
+}
+
+
+static void
+nmea_field_reset(struct nmea *nm)
+{
+    nm->val = 0;
+    nm->ndig = 0;
+    nm->nfrac = 0xff;
+    nm->neg = 0;
+    nm->c0 = 0;
+}
+
+
+static uint8_t
+nmea_hex(uint8_t c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return 0xff;
+}
+
+
+void
+nmea_byte(struct nmea *nm, uint8_t c)
+{
+    uint8_t h;
+
+    if (c == '$') {
+        nm->state = NMEA_STATE_BODY;
+        nm->type = 0;
+        nm->sum = 0;
+        nm->len = 0;
+        nm->field = 0;
+        nm->seen = 0;
+        nm->start_ms = millis();
+        nm->work = nm->fix;
+        nmea_field_reset(nm);
+        return;
+    }
+
+    switch (nm->state) {
+    case NMEA_STATE_IDLE:
+        return;
+
+    case NMEA_STATE_BODY:
+        if (++nm->len > NMEA_LEN_MAX) {
+            nm->overruns++;
+            nm->state = NMEA_STATE_IDLE;
+            return;
+        }
+        if (c == '\r' || c == '\n') {
+            /* no checksum, nothing taken */
+            nm->state = NMEA_STATE_IDLE;
+            return;
+        }
+        if (c == ',' || c == '*') {
+            if (!nm->field) {
+                nm->type = nmea_type(nm);
+            } else if (nm->type) {
+                nmea_field(nm);
+            }
+            if (c == '*') {
+                nm->state = NMEA_STATE_SUM;
+                nm->sum_rx = 0;
+                nm->ndig = 0;
+                return;
+            }
+            nm->sum ^= c;
+            nm->field++;
+            nmea_field_reset(nm);
+            return;
+        }
+        nm->sum ^= c;
+        if (!nm->field) {
+            if (nm->len <= sizeof(nm->addr)) {
+                nm->addr[nm->len - 1] = c;
+            }
+        } else if (!nm->type) {
+            /* only summed */
+        } else if (c >= '0' && c <= '9') {
+            /* past NMEA_FRAC_MAX, or more than a field holds, dropped */
+            if ((nm->nfrac == 0xff || nm->nfrac < NMEA_FRAC_MAX) && nm->val <= 429496728UL) {
+                nm->val = nm->val * 10 + (c - '0');
+                nm->ndig++;
+                if (nm->nfrac != 0xff) {
+                    nm->nfrac++;
+                }
+            }
+        } else if (c == '.') {
+            nm->nfrac = 0;
+        } else if (c == '-') {
+            nm->neg = 1;
+        } else if (!nm->c0) {
+            nm->c0 = c;
+        }
+        return;
+
+    case NMEA_STATE_SUM:
+        h = nmea_hex(c);
+        if (h == 0xff) {
+            nm->bad_sum++;
+            nm->state = NMEA_STATE_IDLE;
+            return;
+        }
+        nm->sum_rx = (nm->sum_rx << 4) | h;
+        if (++nm->ndig < 2) {
+            return;
+        }
+        nm->state = NMEA_STATE_IDLE;
+        if (nm->sum_rx != nm->sum) {
+            nm->bad_sum++;
+            return;
+        }
+        nm->sentences++;
+        if (nm->type) {
+            if (nm->seen == (NMEA_SEEN_LAT | NMEA_SEEN_LON)) {
+                nm->work.have |= NMEA_HAVE_POS;
+            }
+            nm->work.rx_ms = nm->start_ms;
+            nm->work.sentence = nm->type;
+            nm->work.seq++;
+            nm->fix = nm->work;
+        }
+        return;
+    }
+}
+
+
+uint8_t
+nmea_get(struct nmea *nm, struct nmea_fix *fix)
+{
+    noInterrupts();
+    *fix = nm->fix;
+    interrupts();
+    return fix->seq != 0;
+}
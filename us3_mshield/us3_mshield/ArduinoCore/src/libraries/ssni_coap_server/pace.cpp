@@ -0,0 +1,133 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+
+#include <Arduino.h>
+#include "pace.h"
+#include "log.h"
+
+
+#if PACE
+static struct pace_stats pace;
+static uint16_t pace_skip_q8;       /* skip_pct * 256 */
+static uint8_t pace_resent;         /* since the last change of level */
+static uint8_t pace_timed;          /* srtt_ms has a first sample */
+static uint32_t pace_changed_ms;
+
+
+/* A level slower or faster, on what was seen since the last change */
+static void
+pace_eval(void)
+{
+    uint8_t slow, fast;
+
+    if ((uint32_t)(millis() - pace_changed_ms) < PACE_HOLD_MS) {
+        return;
+    }
+    slow = pace.srtt_ms > PACE_SLOW_MS || pace_resent || pace.skip_pct > PACE_SKIP_PCT;
+    fast = pace.srtt_ms < PACE_FAST_MS && !pace_resent && pace.skip_pct < PACE_SKIP_PCT / 2;
+
+    if (slow && pace.level < PACE_LEVEL_MAX) {
+        pace.level++;
+    } else if (fast && pace.level) {
+        pace.level--;
+    } else {
+        return;
+    }
+    pace.changes++;
+    pace_resent = 0;
+    pace_changed_ms = millis();
+    DLOG_INFO("Link pace %d, ACK rtt %lu ms, %d%% skipped", pace.level, pace.srtt_ms, pace.skip_pct);
+}
+
+
+void
+pace_ack(uint32_t rtt_ms)
+{
+    pace.srtt_ms = pace_timed ? pace.srtt_ms - pace.srtt_ms / 8 + rtt_ms / 8 : rtt_ms;
+    pace_timed = 1;
+    if (rtt_ms > pace.rtt_max_ms) {
+        pace.rtt_max_ms = rtt_ms;
+    }
+    pace.acks++;
+    pace_eval();
+}
+
+
+void
+pace_resend(void)
+{
+    pace.resends++;
+    pace_resent = 1;
+    pace_eval();
+}
+
+
+void
+pace_notify(uint8_t skipped)
+{
+    pace_skip_q8 = pace_skip_q8 - pace_skip_q8 / 8 + (skipped ? 100 * 256 / 8 : 0);
+    pace.skip_pct = pace_skip_q8 / 256;
+    if (skipped) {
+        pace.skipped++;
+    } else {
+        pace.sent++;
+    }
+    pace_eval();
+}
+
+
+uint8_t
+pace_level(void)
+{
+    return pace.level;
+}
+
+
+const struct pace_stats *
+pace_get(void)
+{
+    return &pace;
+}
+
+
+void
+pace_clear(void)
+{
+    pace.rtt_max_ms = 0;
+    pace.acks = 0;
+    pace.resends = 0;
+    pace.sent = 0;
+    pace.skipped = 0;
+    pace.changes = 0;
+}
+#endif
@@ -0,0 +1,294 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+
+#include <Arduino.h>
+#include "perflvl.h"
+#include "sched.h"
+
+
+static uint8_t perf_lvl = PERF_HIGH;
+static uint8_t perf_bursts;
+static uint32_t perf_nswitch;
+
+
+#if defined(SAML21)
+/* Generator 0 rates */
+#define PERF_HIGH_HZ            48000000UL
+#define PERF_LOW_HZ             8000000UL
+
+/* The CPU of PERF_SLOW, 12 MHz */
+#define PERF_SLOW_DIV           MCLK_CPUDIV_CPUDIV_DIV4
+
+/* Every port that may be on, its baud follows generator 0 */
+static Uart * const perf_ports[] = {
+    &PORT_MNIC_UART,
+#if (PORT_RS485_SERIAL != PORT_NONE)
+    &PORT_RS485_UART,
+#endif
+#if (PORT_RS485B_SERIAL != PORT_NONE)
+    &PORT_RS485B_UART,
+#endif
+#if (PORT_RS232_SERIAL != PORT_NONE)
+    &PORT_RS232_UART,
+#endif
+#if (PORT_GPS_SERIAL != PORT_NONE)
+    &PORT_GPS_UART,
+#endif
+};
+
+struct perf_sercom {
+    Sercom *sercom;
+    uint8_t id;
+};
+
+static const struct perf_sercom perf_sercoms[] = {
+    { SERCOM0, SERCOM0_GCLK_ID_CORE },
+    { SERCOM1, SERCOM1_GCLK_ID_CORE },
+    { SERCOM2, SERCOM2_GCLK_ID_CORE },
+    { SERCOM3, SERCOM3_GCLK_ID_CORE },
+    { SERCOM4, SERCOM4_GCLK_ID_CORE },
+    { SERCOM5, SERCOM5_GCLK_ID_CORE },
+};
+
+static uint8_t perf_free[PERF_RATE_FREE_MAX];
+static uint8_t perf_nfree;
+static uint8_t perf_dfll;           /* generator 0 was on the DFLL, PERF_LOW can be */
+
+
+/* Channel id on generator 0 keeps working at PERF_LOW */
+static uint8_t
+perf_chan_ok(uint8_t id)
+{
+    uint8_t i, mode;
+
+    if (id == EIC_GCLK_ID || (id >= EVSYS_GCLK_ID_LSB && id <= EVSYS_GCLK_ID_MSB)) {
+        return 1;
+    }
+    for (i = 0; i < perf_nfree; i++) {
+        if (perf_free[i] == id) {
+            return 1;
+        }
+    }
+    /* a UART gets its baud again, SPI its rate on the next transaction */
+    for (i = 0; i < sizeof(perf_sercoms) / sizeof(perf_sercoms[0]); i++) {
+        if (perf_sercoms[i].id == id) {
+            mode = perf_sercoms[i].sercom->USART.CTRLA.bit.MODE;
+            return !perf_sercoms[i].sercom->USART.CTRLA.bit.ENABLE ||
+                   mode == UART_INT_CLOCK || mode == SPI_MASTER_OPERATION;
+        }
+    }
+    return 0;
+}
+
+
+static uint8_t
+perf_low_ok(void)
+{
+    uint8_t i;
+
+    if (!perf_dfll || ((MCLK->APBBMASK.reg & MCLK_APBBMASK_USB) && USB->DEVICE.CTRLA.bit.ENABLE)) {
+        return 0;
+    }
+    for (i = 0; i < sizeof(perf_ports) / sizeof(perf_ports[0]); i++) {
+        if (perf_ports[i]->isSending()) {
+            return 0;
+        }
+    }
+    for (i = 0; i < GCLK_NUM; i++) {
+        if ((GCLK->PCHCTRL[i].reg & GCLK_PCHCTRL_CHEN) &&
+            (GCLK->PCHCTRL[i].reg & GCLK_PCHCTRL_GEN_Msk) == GCLK_PCHCTRL_GEN_GCLK0 && !perf_chan_ok(i)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+static void
+perf_gclk0(uint8_t src)
+{
+    GCLK->GENCTRL[0].bit.SRC = src;
+    while (GCLK->SYNCBUSY.reg & GCLK_SYNCBUSY_GENCTRL(1u << 0));
+}
+
+
+static void
+perf_plsel(uint8_t pl)
+{
+    PM->INTFLAG.reg = PM_INTFLAG_PLRDY;
+    PM->PLCFG.bit.PLSEL = pl;
+    while (!(PM->INTFLAG.reg & PM_INTFLAG_PLRDY));
+    PM->INTFLAG.reg = PM_INTFLAG_PLRDY;
+}
+
+
+static void
+perf_cpudiv(uint8_t div)
+{
+    MCLK->INTFLAG.reg = MCLK_INTFLAG_CKRDY;
+    MCLK->CPUDIV.reg = div;
+    while (!(MCLK->INTFLAG.reg & MCLK_INTFLAG_CKRDY));
+}
+
+
+/* Switch to level, interrupts off. The order keeps every clock within the
+ * level it runs at: PL2 before the DFLL, the DFLL off before PL0. */
+static void
+perf_set(uint8_t level)
+{
+    uint8_t gclk0 = (perf_lvl == PERF_LOW) != (level == PERF_LOW);
+    uint8_t i;
+
+    if (level == perf_lvl) {
+        return;
+    }
+    if (perf_lvl == PERF_LOW) {
+        perf_plsel(PM_PLCFG_PLSEL_PL2_Val);
+        while (!OSCCTRL->STATUS.bit.DFLLRDY);
+        OSCCTRL->DFLLCTRL.bit.ENABLE = 1;
+        while (!OSCCTRL->STATUS.bit.DFLLRDY);
+        perf_gclk0(GCLK_GENCTRL_SRC_DFLL48M_Val);
+    }
+    perf_cpudiv(level == PERF_SLOW ? PERF_SLOW_DIV : MCLK_CPUDIV_CPUDIV_DIV1);
+    if (level == PERF_LOW) {
+        /* in standby too, as lp_init left the DFLL for the UARTs */
+        OSCCTRL->OSC16MCTRL.bit.RUNSTDBY = GCLK->GENCTRL[0].bit.RUNSTDBY;
+        perf_gclk0(GCLK_GENCTRL_SRC_OSC16M_Val);
+        while (!OSCCTRL->STATUS.bit.DFLLRDY);
+        OSCCTRL->DFLLCTRL.bit.ENABLE = 0;
+        while (!OSCCTRL->STATUS.bit.DFLLRDY);
+        perf_plsel(PM_PLCFG_PLSEL_PL0_Val);
+    }
+
+    SystemCoreClock = (level == PERF_LOW ? PERF_LOW_HZ : PERF_HIGH_HZ) / MCLK->CPUDIV.reg;
+    tickRescale();
+    SERCOM::clockChanged();
+    if (gclk0) {
+        for (i = 0; i < sizeof(perf_ports) / sizeof(perf_ports[0]); i++) {
+            perf_ports[i]->clockChanged();
+        }
+    }
+    perf_lvl = level;
+    perf_nswitch++;
+}
+#endif
+
+
+void
+perf_init(void)
+{
+#if defined(SAML21)
+    perf_dfll = (GCLK->GENCTRL[0].bit.SRC == GCLK_GENCTRL_SRC_DFLL48M_Val &&
+                 GCLK->GENCTRL[0].bit.DIV <= 1 && SystemCoreClock == PERF_HIGH_HZ);
+    if (perf_dfll) {
+        /* at 8 MHz and ready whenever generator 0 is switched to it */
+        OSCCTRL->OSC16MCTRL.bit.FSEL = OSCCTRL_OSC16MCTRL_FSEL_8_Val;
+        OSCCTRL->OSC16MCTRL.bit.ONDEMAND = 0;
+        OSCCTRL->OSC16MCTRL.bit.ENABLE = 1;
+        while (!OSCCTRL->STATUS.bit.OSC16MRDY);
+    }
+    sched_slow(perf_slow, PERF_LOW_MIN_MS);
+#endif
+}
+
+
+int
+perf_rate_free(uint8_t id)
+{
+#if defined(SAML21)
+    uint8_t i;
+
+    for (i = 0; i < perf_nfree; i++) {
+        if (perf_free[i] == id) {
+            return 0;
+        }
+    }
+    if (perf_nfree >= PERF_RATE_FREE_MAX) {
+        return -1;
+    }
+    perf_free[perf_nfree++] = id;
+#endif
+    return 0;
+}
+
+
+void
+perf_slow(uint32_t wait_ms)
+{
+#if defined(SAML21)
+    if (!perf_bursts) {
+        perf_set(perf_low_ok() ? PERF_LOW : PERF_SLOW);
+    }
+#endif
+}
+
+
+void
+perf_burst_begin(void)
+{
+#if defined(SAML21)
+    uint32_t primask = __get_PRIMASK();
+
+    perf_bursts++;
+    if (perf_lvl != PERF_HIGH) {
+        __disable_irq();
+        perf_set(PERF_HIGH);
+        if (!primask) {
+            __enable_irq();
+        }
+    }
+#endif
+}
+
+
+void
+perf_burst_end(void)
+{
+    if (perf_bursts) {
+        perf_bursts--;
+    }
+}
+
+
+uint8_t
+perf_level(void)
+{
+    return perf_lvl;
+}
+
+
+uint32_t
+perf_switches(void)
+{
+    return perf_nswitch;
+}
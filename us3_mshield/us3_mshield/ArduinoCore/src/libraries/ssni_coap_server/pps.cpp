@@ -0,0 +1,187 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+#include "pps.h"
+#include "arduino_time.h"
+#include "lpidle.h"
+#include "log.h"
+
+
+/* The last edge, from the pin interrupt */
+static volatile uint32_t pps_edge_ms;
+static volatile uint32_t pps_edge_us;
+static volatile uint32_t pps_nedges;
+
+static struct nmea *pps_nmea;
+static uint32_t pps_seq;            /* fix seq last looked at */
+static uint8_t pps_lock;
+static uint32_t pps_anchor_edge;    /* edge count at the last anchor */
+static uint32_t pps_nanchors;
+static uint32_t pps_corr_edge;      /* edge count and micros() the measurement began at */
+static uint32_t pps_corr_us;
+
+
+static void
+pps_edge(void)
+{
+    pps_edge_us = micros();
+    pps_edge_ms = millis();
+    pps_nedges++;
+}
+
+
+static uint8_t
+pps_busy(void)
+{
+    return 1;
+}
+
+
+void
+pps_init(uint8_t pin, struct nmea *nm)
+{
+    pps_nmea = nm;
+    pinMode(pin, INPUT);
+    attachInterrupt(digitalPinToInterrupt(pin), pps_edge, RISING);
+    (void)lp_veto(pps_busy);
+}
+
+
+/* Days from 1970-01-01 to the civil date */
+static int32_t
+pps_days(uint16_t y, uint8_t m, uint8_t d)
+{
+    uint32_t years = (m <= 2 ? y - 1 : y) - 1600;
+    uint32_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+
+    /* from 1600-03-01, day -135080, with the leap day at the end of each year */
+    return -135080 + (int32_t)(years * 365 + years / 4 - years / 100 + years / 400 + doy);
+}
+
+
+/* The micros() between edges against the seconds they are, into FREQCORR */
+static void
+pps_freq(uint32_t edges, uint32_t edge_us)
+{
+    uint32_t n = edges - pps_corr_edge;
+    int32_t err;
+
+    if (n < PPS_CORR_S && pps_corr_edge) {
+        return;
+    }
+    if (pps_corr_edge && n <= 2 * PPS_CORR_S) {
+        err = (int32_t)(edge_us - pps_corr_us - n * 1000000UL);
+        if ((uint32_t)abs(err) <= n * PPS_PPM_MAX) {
+            DLOG_DEBUG("PPS %lu s, crystal %ld us", (unsigned long)n, (long)err);
+            set_rtc_corr((int16_t)(((int64_t)err << 20) / ((int64_t)n * 1000000)));
+        } else {
+            DLOG_WARNING("PPS %lu s off by %ld us, remeasuring", (unsigned long)n, (long)err);
+        }
+    }
+    pps_corr_edge = edges;
+    pps_corr_us = edge_us;
+}
+
+
+uint8_t
+pps_poll(void)
+{
+    struct nmea_fix fix;
+    uint32_t edge_ms, edge_us, edges;
+    time_t epoch;
+
+    if (!pps_nmea) {
+        return 0;
+    }
+    noInterrupts();
+    edge_ms = pps_edge_ms;
+    edge_us = pps_edge_us;
+    edges = pps_nedges;
+    interrupts();
+    if (!edges) {
+        return 0;
+    }
+
+    if ((uint32_t)(millis() - edge_ms) >= PPS_LOST_MS) {
+        if (pps_lock) {
+            DLOG_WARNING("PPS lost");
+            pps_lock = 0;
+        }
+        pps_corr_edge = 0;
+        return 0;
+    }
+    pps_freq(edges, edge_us);
+
+    /* the RMC of the second this edge began, whole seconds only */
+    if (!nmea_get(pps_nmea, &fix) || fix.seq == pps_seq) {
+        return 0;
+    }
+    pps_seq = fix.seq;
+    if (fix.sentence != NMEA_RMC || !fix.valid || fix.time_ms % 1000 ||
+        (fix.have & (NMEA_HAVE_TIME | NMEA_HAVE_DATE)) != (NMEA_HAVE_TIME | NMEA_HAVE_DATE) ||
+        (uint32_t)(fix.rx_ms - edge_ms) >= 1000) {
+        return 0;
+    }
+    if (pps_lock && edges - pps_anchor_edge < PPS_ANCHOR_S) {
+        return 0;
+    }
+
+    epoch = (time_t)pps_days(2000 + fix.year, fix.month, fix.day) * 86400 + fix.time_ms / 1000;
+    set_rtc_epoch_at(epoch, edge_ms);
+    pps_anchor_edge = edges;
+    pps_nanchors++;
+    if (!pps_lock) {
+        DLOG_INFO("PPS locked at %lu", (unsigned long)epoch);
+        pps_lock = 1;
+    }
+    return 1;
+}
+
+
+uint8_t
+pps_locked(void)
+{
+    return pps_lock;
+}
+
+
+uint32_t
+pps_edges(void)
+{
+    return pps_nedges;
+}
+
+
+uint32_t
+pps_anchors(void)
+{
+    return pps_nanchors;
+}
@@ -0,0 +1,161 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+
+
+#include <string.h>
+#include <ArduinoUniqueID.h>
+#include "prov.h"
+#include "cfg.h"
+#include "backlog.h"
+#include "crc_xmodem.h"
+#include "fw.h"
+
+
+void
+prov_reply(Print *out, uint8_t *frame, uint8_t cmd, uint8_t status, uint8_t len)
+{
+    uint16_t crc;
+
+    frame[0] = PROV_SOF;
+    frame[1] = cmd | PROV_RSP;
+    frame[2] = len + 1;
+    frame[3] = status;
+    crc = crc_xmodem(crc_xmodem_init(), &frame[1], 3 + len);
+    frame[4 + len] = crc & 0xFF;
+    frame[5 + len] = crc >> 8;
+    out->write(frame, 6 + len);
+}
+
+
+/* Run a command. Writes its data after the status byte of rsp, sets *len
+ * to its length and returns the status. */
+static uint8_t
+prov_run(uint8_t cmd, const uint8_t *data, uint8_t n, uint8_t *rsp, uint8_t *len)
+{
+    uint8_t *out = &rsp[4];
+    uint32_t offset;
+    int32_t value;
+    uint8_t i;
+
+    *len = 0;
+    switch (cmd) {
+    case PROV_GET:
+        if (n > (PROV_MAX - 1) / 5) {
+            return PROV_ST_BAD_PARAM;
+        }
+        for (i = 0; i < (n ? n : (uint8_t)CFG_COUNT); i++) {
+            out[0] = n ? data[i] : i;
+            if (out[0] >= CFG_COUNT) {
+                return PROV_ST_BAD_PARAM;
+            }
+            value = *cfg_params[out[0]].value;
+            memcpy(&out[1], &value, sizeof(value));
+            out += 5;
+        }
+        *len = out - &rsp[4];
+        return PROV_ST_OK;
+
+    case PROV_SET:
+        if (n != 5 || data[0] >= CFG_COUNT) {
+            return PROV_ST_BAD_PARAM;
+        }
+        memcpy(&value, &data[1], sizeof(value));
+        if (*cfg_params[data[0]].value == value) {
+            return PROV_ST_OK;
+        }
+        cfg_apply(data[0], value);
+        cfg_publish();
+        return cfg_log(data[0], value) ? PROV_ST_OK : PROV_ST_FLASH;
+
+    case PROV_BULK:
+        /* All checked before the first is set, then saved as one image */
+        if (n % 5) {
+            return PROV_ST_BAD_PARAM;
+        }
+        for (i = 0; i < n; i += 5) {
+            if (data[i] >= CFG_COUNT) {
+                return PROV_ST_BAD_PARAM;
+            }
+        }
+        for (i = 0; i < n; i += 5) {
+            memcpy(&value, &data[i + 1], sizeof(value));
+            cfg_apply(data[i], value);
+        }
+        cfg_publish();
+        return cfg_save() ? PROV_ST_OK : PROV_ST_FLASH;
+
+    case PROV_ID:
+        memcpy(out, UniqueID, UniqueIDsize);
+        *len = UniqueIDsize;
+        return PROV_ST_OK;
+
+    case PROV_LOG:
+        /* Raw bytes of the sample log, the records of RAM programmed first */
+        if (n != 5) {
+            return PROV_ST_BAD_PARAM;
+        }
+        memcpy(&offset, data, sizeof(offset));
+        if (data[4] > PROV_MAX - 1 || offset > (uint32_t)BACKLOG_SECTORS * BACKLOG_SECTOR - data[4]) {
+            return PROV_ST_BAD_PARAM;
+        }
+        sapi_flush();
+        if (data[4] && sapi_flash_read(BACKLOG_ADDR + offset, out, data[4]) != SAPI_ERR_OK) {
+            return PROV_ST_FLASH;
+        }
+        *len = data[4];
+        return PROV_ST_OK;
+
+    case PROV_KEY:
+        if (n != FW_KEY_SIZE) {
+            return PROV_ST_BAD_PARAM;
+        }
+        return fw_key_set(data) ? PROV_ST_OK : PROV_ST_FLASH;
+    }
+    return PROV_ST_BAD_CMD;
+}
+
+
+void
+prov_frame(Print *out, const uint8_t *frame)
+{
+    uint8_t rsp[4 + PROV_MAX + 2];
+    uint8_t n = frame[2];
+    uint16_t crc = frame[3 + n] | (frame[4 + n] << 8);
+    uint8_t status = PROV_ST_BAD_FRAME;
+    uint8_t len = 0;
+
+    if (crc == crc_xmodem(crc_xmodem_init(), &frame[1], 2 + n)) {
+        status = prov_run(frame[1], &frame[3], n, rsp, &len);
+    }
+    prov_reply(out, rsp, frame[1], status, len);
+}
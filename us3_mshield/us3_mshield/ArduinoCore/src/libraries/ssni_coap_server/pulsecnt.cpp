@@ -0,0 +1,174 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+#include "pulsecnt.h"
+#include "wiring_private.h"
+#include "wiring_evsys.h"
+#include "perflvl.h"
+#include "log.h"
+
+
+#if (SAML21)
+
+static uint8_t pulse_on;
+static uint16_t pulse_last;     /* TC0 count at the last take */
+static uint32_t pulse_last_ms;
+static uint32_t pulse_sum;
+static uint8_t pulse_evsys = EVSYS_NO_CHANNEL;      /* EIC to TC0 */
+
+
+/* attachInterrupt sets up the EIC line, its interrupt is not wanted */
+static void
+pulse_none(void)
+{
+}
+
+
+/* COUNT of TC0, synced in from the counter first */
+static uint16_t
+pulse_count(void)
+{
+    TC0->COUNT16.CTRLBSET.reg = TC_CTRLBSET_CMD_READSYNC;
+    while (TC0->COUNT16.SYNCBUSY.reg & TC_SYNCBUSY_CTRLB);
+    while (TC0->COUNT16.CTRLBSET.reg & TC_CTRLBSET_CMD_Msk);
+    return TC0->COUNT16.COUNT.reg;
+}
+
+
+int
+pulse_init(uint8_t pin, uint8_t filter)
+{
+    uint32_t in = GetExtInt(pin);
+    uint32_t config = (in > EXTERNAL_INT_7) ? 1 : 0;
+    uint32_t pos = (in - (8 * config)) << 2;
+
+    if (in == NOT_AN_INTERRUPT || in == EXTERNAL_INT_NONE) {
+        return PULSE_ERR_ARG;
+    }
+    if (pulse_evsys == EVSYS_NO_CHANNEL && (pulse_evsys = evsysAlloc()) == EVSYS_NO_CHANNEL) {
+        return PULSE_ERR_EVSYS;
+    }
+
+    /* The pin on the EIC, sensing rising edges, then no interrupt */
+    pinMode(pin, INPUT);
+    attachInterrupt(pin, pulse_none, RISING);
+    detachInterrupt(pin);
+
+    /* CONFIG and EVCTRL are enable-protected, as in attachInterrupt */
+    EIC->CTRLA.reg = 0;
+    while (EIC->SYNCBUSY.reg & EIC_SYNCBUSY_MASK);
+    if (filter) {
+        EIC->CONFIG[config].reg |= EIC_CONFIG_FILTEN0 << pos;
+    }
+    EIC->EVCTRL.reg |= EIC_EVCTRL_EXTINTEO(1ul << in);
+    EIC->CTRLA.reg = EIC_CTRLA_ENABLE;
+    while (EIC->SYNCBUSY.reg & EIC_SYNCBUSY_MASK);
+
+    MCLK->APBCMASK.reg |= MCLK_APBCMASK_TC0;
+    GCLK->PCHCTRL[GCM_TC0_TC1].reg = GCLK_PCHCTRL_CHEN | GCLK_PCHCTRL_GEN_GCLK0;
+    while ((GCLK->PCHCTRL[GCM_TC0_TC1].reg & GCLK_PCHCTRL_CHEN) != GCLK_PCHCTRL_CHEN);
+
+    TC0->COUNT16.CTRLA.reg = TC_CTRLA_SWRST;
+    while (TC0->COUNT16.SYNCBUSY.reg & TC_SYNCBUSY_SWRST);
+    TC0->COUNT16.CTRLA.reg = TC_CTRLA_MODE_COUNT16 | TC_CTRLA_RUNSTDBY;
+    TC0->COUNT16.EVCTRL.reg = TC_EVCTRL_EVACT_COUNT | TC_EVCTRL_TCEI;
+    TC0->COUNT16.CTRLA.reg |= TC_CTRLA_ENABLE;
+    while (TC0->COUNT16.SYNCBUSY.reg & TC_SYNCBUSY_ENABLE);
+    /* it only counts events, the core may slow generator 0 */
+    (void)perf_rate_free(TC0_GCLK_ID);
+
+    evsysRoute(pulse_evsys, EVSYS_ID_GEN_EIC_EXTINT_0 + in, EVSYS_ROUTE_ASYNC);
+    evsysConnect(pulse_evsys, EVSYS_ID_USER_TC0_EVU);
+
+    pulse_last = pulse_count();
+    pulse_last_ms = millis();
+    pulse_sum = 0;
+    pulse_on = 1;
+    DLOG_DEBUG("Pulse count on EXTINT %d", in);
+    return PULSE_OK;
+}
+
+
+uint32_t
+pulse_take(uint32_t *ms)
+{
+    uint32_t now = millis();
+    uint16_t count;
+    uint16_t n;
+
+    if (!pulse_on) {
+        return 0;
+    }
+    count = pulse_count();
+    n = count - pulse_last;
+    pulse_last = count;
+    pulse_sum += n;
+    if (ms) {
+        *ms = now - pulse_last_ms;
+    }
+    pulse_last_ms = now;
+    return n;
+}
+
+
+uint32_t
+pulse_total(void)
+{
+    if (!pulse_on) {
+        return 0;
+    }
+    return pulse_sum + (uint16_t)(pulse_count() - pulse_last);
+}
+
+#else
+
+int
+pulse_init(uint8_t pin, uint8_t filter)
+{
+    return PULSE_ERR_CHIP;
+}
+
+
+uint32_t
+pulse_take(uint32_t *ms)
+{
+    return 0;
+}
+
+
+uint32_t
+pulse_total(void)
+{
+    return 0;
+}
+
+#endif
@@ -0,0 +1,79 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+#include "pwrdom.h"
+
+
+void
+pwr_domain_init(struct pwr_domain *d, pwr_set_fn set, uint32_t warmup_ms,
+                uint32_t window_ms)
+{
+    memset(d, 0, sizeof(*d));
+    d->set = set;
+    d->warmup_ms = warmup_ms;
+    d->window_ms = window_ms;
+    d->state = PWR_OFF;
+    set(0);
+}
+
+
+void
+pwr_domain_acquire(struct pwr_domain *d)
+{
+    if (d->users++) {
+        return;
+    }
+    d->set(1);
+    d->on_ms = millis();
+    d->cycles++;
+    d->state = d->warmup_ms ? PWR_WARMING : PWR_ON;
+}
+
+
+uint8_t
+pwr_domain_ready(struct pwr_domain *d)
+{
+    if (d->state == PWR_WARMING && (uint32_t)(millis() - d->on_ms) >= d->warmup_ms) {
+        d->state = PWR_ON;
+    }
+    return d->state == PWR_ON;
+}
+
+
+void
+pwr_domain_release(struct pwr_domain *d)
+{
+    if (!d->users || --d->users) {
+        return;
+    }
+    d->set(0);
+    d->on_total_ms += millis() - d->on_ms;
+    d->state = PWR_OFF;
+}
@@ -0,0 +1,284 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+
+
+#include <Arduino.h>
+#include <string.h>
+#include "relay.h"
+#include "cbor.h"
+#include "coappdu.h"
+#include "arduino_time.h"
+#include "sched.h"
+#include "log.h"
+
+
+/*
+ * State of a rule, checked on each sample of its datatype. A transition
+ * waits out the least time of the state before. The relay is set on the
+ * first sample, then only when the rule switches.
+ */
+struct relay_rule {
+    uint32_t since_ms;          /* millis() the relay last switched */
+    uint8_t held;               /* 1 -> the rule holds */
+    uint8_t primed;             /* 1 -> held and the relay are set */
+};
+
+/* A timed command of /sys/relay */
+struct relay_act {
+    uint32_t epoch;             /* UNIX epoch it runs at */
+    int8_t action;              /* Relay switched on, negative for off */
+};
+
+struct relay_rule_cfg relay_cfg[RELAY_RULES];
+static struct relay_rule relay_rules[RELAY_RULES];
+static struct relay_act relay_q[RELAY_Q_MAX];
+static uint8_t relay_q_count;
+static struct sched_task relay_task;
+
+
+void
+relay_init(void)
+{
+    memset(relay_rules, 0, sizeof(relay_rules));
+    relay_q_count = 0;
+}
+
+
+void
+relay_set(uint8_t relay, uint8_t on)
+{
+    uint8_t a = relay == 1 ? D6 : D8;
+    uint8_t b = relay == 1 ? D7 : D9;
+
+    pinMode(a, OUTPUT);
+    pinMode(b, OUTPUT);
+    digitalWrite(a, on ? HIGH : LOW);
+    digitalWrite(b, on ? LOW : HIGH);
+}
+
+
+void
+relay_rule_reset(uint8_t rule)
+{
+    if (rule < RELAY_RULES) {
+        relay_rules[rule].primed = 0;
+    }
+}
+
+
+/*
+ * The switch waits out the least on or off time of the relay, the rule
+ * holding or not when it is over decides.
+ */
+void
+relay_rule_check(uint8_t sensor_id, const sapi_sample_t *sample, uint32_t now_ms)
+{
+    const struct relay_rule_cfg *c;
+    struct relay_rule *r;
+    float v, limit, hyst;
+    int relay, least_s;
+    uint8_t held, on;
+    uint8_t indx;
+
+    for (indx = 0; indx < RELAY_RULES; indx++) {
+        c = &relay_cfg[indx];
+        r = &relay_rules[indx];
+        relay = c->action < 0 ? -c->action : c->action;
+        if (c->chan != sensor_id * 100 + sample->datatype || (relay != 1 && relay != 2) ||
+            (c->op != SAPI_RULE_ABOVE && c->op != SAPI_RULE_BELOW)) {
+            continue;
+        }
+        v = sample->value;
+        limit = c->limit / 1000.0f;
+        hyst = c->hyst / 1000.0f;
+        if (!r->held) {
+            held = c->op == SAPI_RULE_BELOW ? v < limit : v > limit;
+        } else {
+            held = c->op == SAPI_RULE_BELOW ? v <= limit + hyst : v >= limit - hyst;
+        }
+
+        if (r->primed) {
+            /* The relay is on while held, or off for a negative action */
+            on = r->held == (c->action > 0);
+            least_s = on ? c->min_on : c->min_off;
+            if (held == r->held || (least_s > 0 && (uint32_t)(now_ms - r->since_ms) < (uint32_t)least_s * 1000)) {
+                continue;
+            }
+        }
+        r->held = held;
+        r->primed = 1;
+        r->since_ms = now_ms;
+        on = held == (c->action > 0);
+        relay_set(relay, on);
+        DLOG_DEBUG("Rule %d of sensor: %d relay %d %s", indx + 1, sensor_id, relay, on ? "on" : "off");
+        (void)sapi_post_event(sensor_id, SAPI_DATATYPE_RELAY, on ? relay : -relay);
+    }
+}
+
+
+/* Arm the task for the first command, from the RTC. A wait longer than
+ * RELAY_Q_CHECK_MS is looked at again then. */
+static void
+relay_q_arm(void)
+{
+    uint32_t now = millis();
+    uint32_t epoch;
+    uint32_t wait;
+    uint16_t ms;
+
+    if (!relay_q_count) {
+        sched_stop(&relay_task);
+        return;
+    }
+    epoch = get_rtc_epoch_at(now, &ms);
+    if ((int32_t)(relay_q[0].epoch - epoch) <= 0) {
+        wait = 0;
+    } else if (relay_q[0].epoch - epoch > RELAY_Q_CHECK_MS / 1000) {
+        wait = RELAY_Q_CHECK_MS;
+    } else {
+        wait = (relay_q[0].epoch - epoch) * 1000 - ms;
+    }
+    sched_at(&relay_task, wait);
+}
+
+
+/* Run the commands that are due, in their order, then wait for the next */
+static void
+relay_q_run(struct sched_task *t)
+{
+    uint32_t epoch = get_rtc_epoch_at(millis(), NULL);
+    uint8_t n = 0;
+    int relay;
+
+    while (n < relay_q_count && (int32_t)(relay_q[n].epoch - epoch) <= 0) {
+        relay = relay_q[n].action < 0 ? -relay_q[n].action : relay_q[n].action;
+        relay_set(relay, relay_q[n].action > 0);
+        DLOG_DEBUG("Relay %d %s at %lu", relay, relay_q[n].action > 0 ? "on" : "off", (unsigned long)relay_q[n].epoch);
+        (void)sapi_post_event(0, SAPI_DATATYPE_RELAY, relay_q[n].action);
+        n++;
+    }
+    if (n) {
+        relay_q_count -= n;
+        memmove(&relay_q[0], &relay_q[n], relay_q_count * sizeof(relay_q[0]));
+    }
+    relay_q_arm();
+}
+
+
+void
+relay_start(void)
+{
+    (void)sched_add(&relay_task, "relay", relay_q_run, 0);
+}
+
+
+/* Queue a command behind those of its epoch or sooner */
+static void
+relay_q_add(uint32_t epoch, int8_t action)
+{
+    uint8_t i = relay_q_count;
+
+    while (i && (int32_t)(relay_q[i - 1].epoch - epoch) > 0) {
+        relay_q[i] = relay_q[i - 1];
+        i--;
+    }
+    relay_q[i].epoch = epoch;
+    relay_q[i].action = action;
+    relay_q_count++;
+}
+
+
+int
+relay_q_enc(struct cbor_buf *cbuf)
+{
+    uint8_t i;
+
+    if (cbor_enc_array(cbuf, relay_q_count)) {
+        return CBOR_ERR;
+    }
+    for (i = 0; i < relay_q_count; i++) {
+        if (cbor_enc_array(cbuf, 2) || cbor_enc_uint(cbuf, relay_q[i].epoch) ||
+            cbor_enc_int(cbuf, relay_q[i].action)) {
+            return CBOR_ERR;
+        }
+    }
+    return CBOR_OK;
+}
+
+
+void
+relay_q_clear(void)
+{
+    relay_q_count = 0;
+    relay_q_arm();
+}
+
+
+uint8_t
+relay_q_put(const uint8_t *buf, uint16_t len, uint8_t replace)
+{
+    struct relay_act in[RELAY_Q_MAX];
+    struct cbor_buf cbuf;
+    uint32_t epoch;
+    int action;
+    int n, i;
+
+    cbor_dec_init(&cbuf, (void *)buf, len);
+    if (cbor_dec_well_formed(&cbuf) != CBOR_OK || (n = cbor_dec_array(&cbuf)) == CBOR_ERR) {
+        return COAP_RSP_400_BAD_REQUEST;
+    }
+    for (i = 0; n == CBOR_DEC_INDEF ? !cbor_dec_indef_break(&cbuf) : i < n; i++) {
+        if (i == RELAY_Q_MAX) {
+            return COAP_RSP_413_REQ_TOO_LARGE;
+        }
+        if (cbor_dec_array(&cbuf) != 2 || cbor_dec_uint(&cbuf, &epoch) != CBOR_OK ||
+            cbor_dec_int(&cbuf, &action) != CBOR_OK || !action || action < -2 || action > 2) {
+            return COAP_RSP_400_BAD_REQUEST;
+        }
+        in[i].epoch = epoch;
+        in[i].action = action;
+    }
+    if (cbuf.next != cbuf.tail) {
+        return COAP_RSP_400_BAD_REQUEST;
+    }
+    if (replace) {
+        relay_q_count = 0;
+    } else if (relay_q_count + i > RELAY_Q_MAX) {
+        return COAP_RSP_413_REQ_TOO_LARGE;
+    }
+    for (n = 0; n < i; n++) {
+        relay_q_add(in[n].epoch, in[n].action);
+    }
+    relay_q_arm();
+    return COAP_RSP_204_CHANGED;
+}
@@ -0,0 +1,149 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+#include "reqlat.h"
+#include "coapmsg.h"
+
+
+#if REQLAT
+static struct reqlat_stage reqlat_stages[REQLAT_STAGES + 1];
+static struct reqlat_req reqlat_slowest[REQLAT_SLOW];   /* slowest first */
+static struct reqlat_req reqlat_cur;
+static uint32_t reqlat_start_us;
+static uint32_t reqlat_last_us;     /* micros() of the last mark */
+static uint8_t reqlat_on;
+
+static const char *reqlat_names[REQLAT_STAGES + 1] = { "link", "parse", "handler", "rsp", "send", "total" };
+
+
+void
+reqlat_start(uint32_t rx_us)
+{
+    memset(&reqlat_cur, 0, sizeof(reqlat_cur));
+    reqlat_cur.ms = millis();
+    reqlat_start_us = rx_us;
+    reqlat_last_us = rx_us;
+    reqlat_on = 1;
+    reqlat_mark(REQLAT_LINK);
+}
+
+
+void
+reqlat_mark(uint8_t stage)
+{
+    uint32_t now = micros();
+
+    if (!reqlat_on) {
+        return;
+    }
+    reqlat_cur.stage_us[stage] += now - reqlat_last_us;
+    reqlat_last_us = now;
+}
+
+
+void
+reqlat_path(const struct coap_msg_ctx *ctx)
+{
+    if (reqlat_on && coap_path_copy(ctx, reqlat_cur.path, sizeof(reqlat_cur.path)) < 0) {
+        reqlat_cur.path[0] = '\0';
+    }
+}
+
+
+static void
+reqlat_count(struct reqlat_stage *st, uint32_t us)
+{
+    if (!st->count || us < st->min_us) {
+        st->min_us = us;
+    }
+    if (us > st->max_us) {
+        st->max_us = us;
+    }
+    st->sum_us += us;
+    st->count++;
+}
+
+
+void
+reqlat_end(void)
+{
+    uint8_t i;
+
+    if (!reqlat_on) {
+        return;
+    }
+    reqlat_on = 0;
+    reqlat_cur.total_us = reqlat_last_us - reqlat_start_us;
+    for (i = 0; i < REQLAT_STAGES; i++) {
+        reqlat_count(&reqlat_stages[i], reqlat_cur.stage_us[i]);
+    }
+    reqlat_count(&reqlat_stages[REQLAT_TOTAL], reqlat_cur.total_us);
+
+    /* into the slowest, in order, if it beats the last of them */
+    if (reqlat_cur.total_us <= reqlat_slowest[REQLAT_SLOW - 1].total_us) {
+        return;
+    }
+    for (i = REQLAT_SLOW - 1; i && reqlat_cur.total_us > reqlat_slowest[i - 1].total_us; i--) {
+        reqlat_slowest[i] = reqlat_slowest[i - 1];
+    }
+    reqlat_slowest[i] = reqlat_cur;
+}
+
+
+const struct reqlat_stage *
+reqlat_get(uint8_t stage)
+{
+    return stage <= REQLAT_TOTAL ? &reqlat_stages[stage] : NULL;
+}
+
+
+const char *
+reqlat_name(uint8_t stage)
+{
+    return stage <= REQLAT_TOTAL ? reqlat_names[stage] : "";
+}
+
+
+const struct reqlat_req *
+reqlat_slow(uint8_t n)
+{
+    return n < REQLAT_SLOW && reqlat_slowest[n].total_us ? &reqlat_slowest[n] : NULL;
+}
+
+
+void
+reqlat_clear(void)
+{
+    memset(reqlat_stages, 0, sizeof(reqlat_stages));
+    memset(reqlat_slowest, 0, sizeof(reqlat_slowest));
+}
+#endif
@@ -0,0 +1,143 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+
+#include "retain.h"
+#include "crc_xmodem.h"
+
+
+#if RETAIN
+#define RETAIN_MAGIC            0x5274
+
+struct retain_sect {
+    uint16_t magic;
+    uint16_t len;
+    uint32_t crc;           /* of len and the data */
+};
+
+/* Left as the last run had it by the C runtime */
+static struct {
+    struct retain_sect sect[RETAIN_SECTIONS];
+    struct retain_link link;
+    struct retain_obs obs[MAX_OBSERVERS];
+    struct retain_reg reg[MAX_OBSERVERS];
+} retain_ram __attribute__ ((section (".noinit")));
+
+static uint8_t retain_good;     /* sections good at boot, not taken yet */
+
+
+static void *
+retain_data(uint8_t section, uint16_t *size)
+{
+    switch (section) {
+    case RETAIN_LINK:
+        *size = sizeof(retain_ram.link);
+        return &retain_ram.link;
+    case RETAIN_OBS:
+        *size = sizeof(retain_ram.obs);
+        return retain_ram.obs;
+    case RETAIN_REG:
+        *size = sizeof(retain_ram.reg);
+        return retain_ram.reg;
+    }
+    *size = 0;
+    return NULL;
+}
+
+
+static uint32_t
+retain_crc(const struct retain_sect *s, const void *data)
+{
+    uint32_t crc = crc32_init();
+
+    crc = crc32(crc, &s->len, sizeof(s->len));
+    return crc32_final(crc32(crc, data, s->len));
+}
+
+
+void
+retain_boot(void)
+{
+    struct retain_sect *s;
+    uint16_t size;
+    void *data;
+    uint8_t i;
+
+    retain_good = 0;
+    for (i = 0; i < RETAIN_SECTIONS; i++) {
+        s = &retain_ram.sect[i];
+        data = retain_data(i, &size);
+        if (s->magic == RETAIN_MAGIC && s->len == size && s->crc == retain_crc(s, data)) {
+            retain_good |= 1 << i;
+        } else {
+            /* power up garbage, or a reset in the middle of a put */
+            s->magic = 0;
+        }
+    }
+}
+
+
+int
+retain_get(uint8_t section, void *buf, uint16_t len)
+{
+    uint16_t size;
+    void *data = retain_data(section, &size);
+
+    if (!(retain_good & (1 << section)) || len != size) {
+        return 0;
+    }
+    retain_good &= ~(1 << section);
+    memcpy(buf, data, len);
+    return 1;
+}
+
+
+void
+retain_put(uint8_t section, const void *buf, uint16_t len)
+{
+    struct retain_sect *s = &retain_ram.sect[section];
+    uint16_t size;
+    void *data = retain_data(section, &size);
+
+    if (!data || len != size) {
+        return;
+    }
+    /* invalid until the CRC is in, a reset half way leaves nothing */
+    s->magic = 0;
+    memcpy(data, buf, len);
+    s->len = len;
+    s->crc = retain_crc(s, data);
+    s->magic = RETAIN_MAGIC;
+    retain_good &= ~(1 << section);
+}
+
+#endif
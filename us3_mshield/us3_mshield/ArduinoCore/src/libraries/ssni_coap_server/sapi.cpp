@@ -32,21 +32,43 @@ Networks, Inc.
 #include "sapi_error.h"
 #include "errors.h"
 #include "arduino_pins.h"
+#include "hdlc.h"
+#include "hdlcs.h"
+#include "bufutil.h"
+#include "crc_xmodem.h"
+#include "sched.h"
+#include "lpidle.h"
+#include "duty.h"
+#include "bench.h"
+#include "coapsensorobs.h"
+#include "retain.h"
+#include "pace.h"
+#include "hshrink.h"
+#include "sblk.h"
+#include "irqprio.h"
+#include "perflvl.h"
+#include "mbpoll.h"
+#include "crash.h"
+#include "backlog.h"
+#include "cal.h"
+#include "health.h"
+#include "relay.h"
+#include "cfg.h"
+#include "prov.h"
+#include "total.h"
+#include "fw.h"
+#include "exp_coap.h"
 
 #include <SPIMemory.h>
+#include <Reset.h>
 #include <ArduinoUniqueID.h>
 #define Serial SERIAL_PORT_USBVIRTUAL
 #define BLOCKSIZE 256
 #define debug;
 SPIFlash flash;
-int sendInterval = 0;
-int sampleRate = 0;
-int Digital10 = 0;
-int Digital11 = 0;
-int Relay1 = 0;
-int Relay2 = 0;
-int Analog4 = 0;
-int Analog5 = 0;
+static uint8_t sapi_flash_state = SAPI_FLASH_OFF;
+// The boot profile, read before the configuration loads
+static uint8_t sapi_fast_boot = 0;
 
 // Used to tell CoAP Server to use the SAPI dispatcher and handler
 uint8_t	is_sapi = 1;
@@ -58,8 +80,143 @@ sensor_reg_info_t sensor_info[SAPI_MAX_DEVICES];
 // Next empty slot in the sensor info table
 static	uint8_t sensor_info_index = 0;
 
+// Last read payload of each sensor, the back buffer the next read goes to,
+// and the next ETag value
+static sensor_cache_t sensor_cache[SAPI_MAX_DEVICES];
+static char sensor_cache_bufs[SAPI_MAX_DEVICES + 1][SAPI_MAX_PAYLOAD_LEN];
+static char *sensor_cache_back;
+
+// Split-phase reads under way
+static sensor_read_wait_t sensor_wait[SAPI_MAX_DEVICES];
+
+// Exchange under way
+static sensor_exchange_wait_t sensor_xchg;
+
+// Read stats of each sensor
+static sensor_stats_t sensor_stats[SAPI_MAX_DEVICES];
+
+// Kept in the low power SRAM, see SAPI_KEEP. The C runtime leaves it alone.
+#if SAPI_KEEP && defined(SAML21)
+#define SAPI_KEEP_RAM	__attribute__ ((section (".lpram")))
+#elif SAPI_KEEP
+#define SAPI_KEEP_RAM	__attribute__ ((section (".noinit")))
+#else
+#define SAPI_KEEP_RAM
+#endif
+
+// Sensors sampled apart from their reports
+static sensor_sampler_t sensor_samplers[SAPI_MAX_SAMPLERS] SAPI_KEEP_RAM;
+
+// Sensors reported on change of value, and set while a push is reported
+static sensor_cov_t sensor_covs[SAPI_MAX_COV];
+static uint8_t sensor_cov_force;
+
+// Threshold alarms on sampled values
+static sensor_alarm_t sensor_alarms[SAPI_MAX_ALARMS];
+
+// Statistics of sampled values, per notification
+static sensor_summary_t sensor_summaries[SAPI_MAX_SUMMARIES];
+
+// Spurious readings taken out of sampled values, ahead of the rest
+static sensor_prefilter_t sensor_prefilters[SAPI_MAX_PREFILTERS];
+
+// Schemas of the samples of sensors, see sapi_set_schema
+static sensor_schema_t sensor_schemas[SAPI_MAX_SCHEMAS];
+
+// Samples stored while they could not be forwarded, see backlog.h, and
+// where sending them stands
+static sapi_backlog_t sapi_backlog;
+static uint8_t sapi_backlog_buf[BACKLOG_PAGE] SAPI_KEEP_RAM;
+#if SAPI_KEEP
+static sapi_keep_t sapi_keep SAPI_KEEP_RAM;
+#endif
+static sapi_decim_t sapi_decim;
+
+// The notification being built may take the health heartbeat
+static uint8_t sapi_health_ride;
+
+// Events posted from interrupts. The entries need volatile too, or the
+// compiler may store them after the new tail.
+static volatile sensor_event_t sensor_events[SAPI_EVENT_Q];
+static volatile uint8_t sensor_event_head;
+static volatile uint8_t sensor_event_tail;
+static volatile uint16_t sensor_event_dropped;
+
+// Digital inputs, and the next free one
+static sensor_input_t sensor_inputs[SAPI_MAX_INPUTS];
+static uint8_t sensor_input_index = 0;
+
+// Sensor Id + 1 by hash of the device type, 0 is empty. Sensors are never
+// unregistered, so entries are only ever added.
+static uint8_t sensor_type_idx[SAPI_TYPE_BUCKETS];
+static uint16_t sensor_etag_seq = 0;
+
+// mNIC serial link settings
+static const struct hdlc_link_cfg mnic_link = {
+	HDLC_LINK_BAUD, HDLC_LINK_FAST_BAUD, HDLC_LINK_PIN_RTS, HDLC_LINK_PIN_CTS
+};
+
 extern char		classifier[CLASSIFIER_MAX_LEN];
 
+static void sapi_sampler_spill(sensor_sampler_t *s);
+static void sapi_keep_load();
+static void sapi_keep_seal();
+static void sapi_tasks_init();
+static uint32_t sapi_sample_wait_ms();
+static error_t sapi_exchange_respond(uint8_t code, const uint8_t *payload, uint16_t len);
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Make the SPI flash ready for an access. It is begun the first time,
+// woken from deep power-down after, powerUp() waits tRES1. A reset of the
+// MCU alone leaves it powered down, so a failed begin() wakes it first.
+//
+//////////////////////////////////////////////////////////////////////////
+void sapi_flash_wake()
+{
+	if (sapi_flash_state == SAPI_FLASH_OFF)
+	{
+		if (!flash.begin())
+		{
+			(void)flash.powerUp();
+			(void)flash.begin();
+		}
+		sapi_flash_state = SAPI_FLASH_AWAKE;
+	}
+	else if (sapi_flash_state == SAPI_FLASH_DOWN && flash.powerUp())
+	{
+		sapi_flash_state = SAPI_FLASH_AWAKE;
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Put the SPI flash in deep power-down until the next access. While it
+// is still busy programming or erasing it stays up, for the next pass.
+//
+//////////////////////////////////////////////////////////////////////////
+static void sapi_flash_sleep()
+{
+	if (sapi_flash_state == SAPI_FLASH_AWAKE && flash.powerDown())
+	{
+		sapi_flash_state = SAPI_FLASH_DOWN;
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Read a window of the SPI flash in one fast read, see sapi.h.
+//
+//////////////////////////////////////////////////////////////////////////
+sapi_error_t sapi_flash_read(uint32_t addr, void *buf, uint16_t len)
+{
+	sapi_flash_wake();
+	return flash.readByteArray(addr, (uint8_t *)buf, len, true) ? SAPI_ERR_OK : SAPI_ERR_FAIL;
+}
+
 
 //////////////////////////////////////////////////////////////////////////
 //
@@ -71,6 +228,24 @@ void sapi_initialize(char *url_classifier)
 	
 	is_sapi = 1;
 	sensor_info_index = 0;
+	memset(sensor_type_idx, 0, sizeof(sensor_type_idx));
+	memset(sensor_wait, 0, sizeof(sensor_wait));
+	memset(sensor_stats, 0, sizeof(sensor_stats));
+	for (uint8_t indx = 0; indx < SAPI_MAX_DEVICES; indx++)
+	{
+		sensor_cache[indx].payload = sensor_cache_bufs[indx];
+	}
+	sensor_cache_back = sensor_cache_bufs[SAPI_MAX_DEVICES];
+	memset(sensor_covs, 0, sizeof(sensor_covs));
+	memset(sensor_alarms, 0, sizeof(sensor_alarms));
+	relay_init();
+	total_init();
+	for (uint8_t indx = 0; indx < SAPI_MAX_SUMMARIES; indx++)
+	{
+		sensor_summaries[indx] = sensor_summary_t();
+	}
+	memset(sensor_prefilters, 0, sizeof(sensor_prefilters));
+	memset(sensor_schemas, 0, sizeof(sensor_schemas));
 	
 
 	// Use classifier if provided.
@@ -82,12 +257,32 @@ void sapi_initialize(char *url_classifier)
 	{
 		strncpy(classifier, url_classifier, CLASSIFIER_MAX_LEN);
 	}
+	coap_uri_links_update();
 
 	// Initialize the RTC and set the local time zone
 	rtc_time_init(LOCAL_TIME_ZONE);
 	
-	// Initialize CoAP server logging.
-	log_init(SER_MON_PTR, SER_MON_BAUD_RATE, LOG_LEVEL);
+	// Initialize CoAP server logging, in the background with the fast boot profile
+	sapi_fast_boot = (cfg_peek(CFG_FAST_BOOT) != 0);
+	log_init(SER_MON_PTR, SER_MON_BAUD_RATE, LOG_LEVEL, !sapi_fast_boot);
+
+	// Log and keep a fault before the restart
+	crash_boot();
+
+#if RETAIN
+	// The link and observers from before the restart, for coap_s_init and
+	// sapi_tasks_start
+	retain_boot();
+#endif
+
+	// Install a firmware image staged before the restart
+	fw_boot();
+
+	// Pick up the samples stored before the restart, those kept in RAM
+	// after them, and the calibrations
+	backlog_load(sapi_backlog_buf);
+	sapi_keep_load();
+	cal_load();
 	
 	
 	// Set mNIC wake-up pin to HIGH, so that we can toggle it 0 -> 1
@@ -95,13 +290,15 @@ void sapi_initialize(char *url_classifier)
 	digitalWrite(MNIC_WAKEUP_PIN, HIGH);
 	
 	// Initialize the CoAP Server
-	coap_s_init(UART_PTR, COAP_MSG_MAX_AGE_IN_SECS, HDLC_UART_TIMEOUT_IN_MS, HDLC_MAX_PAYLOAD_LEN, "", NULL);
+	coap_s_init(UART_PTR, &mnic_link, COAP_MSG_MAX_AGE_IN_SECS, HDLC_UART_TIMEOUT_IN_MS, HDLC_MAX_PAYLOAD_LEN, "", NULL);
 	
-	// Send the reboot event to the milli nic
+	// Queue the reboot event for the milli nic, it goes out with the link
 	coap_put_ic_reboot_event();
-	delay(50);
 
 	sapi_log_banner();
+
+	// The boot countdown first, then the CoAP code
+	sapi_tasks_init();
 }
 
 
@@ -115,10 +312,11 @@ void sapi_initialize(char *url_classifier)
 
 
 
+// Erase the configuration, the sectors of the store and of the boot menu text
 bool eraseBlock (){
-	if (! flash . eraseBlock64K (1))
+	if (!cfg_erase())
 	{
-		Serial.println("Erase Failed");
+		println("Erase Failed");
 		return false ;
 	}
 	else
@@ -127,8 +325,8 @@ bool eraseBlock (){
 		return true ;
 	}
 }
-String readSerialStr() {
-	String str = "";
+FixedString<SAPI_SERIAL_STR_MAX> readSerialStr() {
+	FixedString<SAPI_SERIAL_STR_MAX> str;
 	
 	//  Serial.println("Waiting...");
 	char inChar = 0;
@@ -144,13 +342,13 @@ String readSerialStr() {
 	}
 	str += inChar;
 	// Serial.println("end run");
-	str += '\0';
 	return str;
 }
-String getString(int addr){
+FixedString<SAPI_BLOCK_STR_MAX> getString(int addr){
 
-	String output = "";
+	FixedString<SAPI_BLOCK_STR_MAX> output;
 	uint8_t data_buffer[BLOCKSIZE];
+	sapi_flash_wake();
 	flash.readByteArray(addr, &data_buffer[0], BLOCKSIZE);
 	for (int i = 2; i < BLOCKSIZE; i++)
 	{
@@ -161,14 +359,14 @@ String getString(int addr){
 	return "No Data";
 	
 }
-String getID(){
+FixedString<SAPI_ID_STR_MAX> getID(){
 
-	String ID1 = "";
+	FixedString<SAPI_ID_STR_MAX> ID1;
 	//  Serial.println(F("Initialising"));
 	//  UniqueIDdump(Serial);
 	for (size_t i = 0; i < UniqueIDsize; i++)
 	{
-		ID1 += String(UniqueID[i],HEX);
+		ID1.appendHex(UniqueID[i]);
 		if (i%4==3 && i < (UniqueIDsize - 1))
 		{
 			ID1 += ("-");
@@ -178,31 +376,134 @@ String getID(){
 	return ID1;
 }
 
-void GoHere(){
-	// Serial.println("Entering Loop");
-	int addr = 1;
-	String str = readSerialStr();
-	if (str == "$"){
-	Serial.println(getString(addr));
+//////////////////////////////////////////////////////////////////////////
+//
+// A configuration parameter was set, by cfg_apply, set the pins that
+// follow it. A rule that changes starts over from its next sample.
+//
+//////////////////////////////////////////////////////////////////////////
+void sapi_cfg_applied(uint8_t index, int value)
+{
+	switch (index)
+	{
+	case CFG_DIGITAL10:
+		sapi_input_mode(D10, value);
+		break;
+	case CFG_DIGITAL11:
+		sapi_input_mode(D11, value);
+		break;
+	case CFG_RELAY1:
+		if (value == 0 || value == 1)
+			relay_set(1, value);
+		break;
+	case CFG_RELAY2:
+		if (value == 0 || value == 1)
+			relay_set(2, value);
+		break;
+	default:
+		if (index >= CFG_RULE1_CHAN)
+			relay_rule_reset((index - CFG_RULE1_CHAN) / CFG_RULE_PARAMS);
+		break;
 	}
-	else if (str == "#"){
-	Serial.println(getID());
+
+	Serial.print(cfg_params[index].name);
+	Serial.print(": ");
+	Serial.println(value);
+}
+
+
+bool setValue(StrView parameter, StrView value)
+{
+	uint8_t index = cfg_find(parameter.ptr, parameter.length());
+
+	if (index == CFG_COUNT)
+		return false;
+	cfg_apply(index, value.toInt());
+	cfg_publish();
+	return true;
+}
+
+
+// Boot menu input so far, a provisioning frame or a text line, and when
+// its last byte came
+static uint8_t sapi_menu_buf[PROV_FRAME_MAX];
+static uint16_t sapi_menu_len = 0;
+static uint32_t sapi_menu_ms;
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Boot menu, run from sapi_run. Takes only the bytes already received, a
+// provisioning frame when the first is PROV_SOF, else the text menu:
+// "$" lists the parameters, "#" the ID, "<name>:<value>,...,." sets them.
+// With BENCH 1, "!" prints the cycle counts of bench.h.
+//
+//////////////////////////////////////////////////////////////////////////
+void GoHere(){
+	int c;
+
+	if (sapi_menu_len && sapi_menu_buf[0] == PROV_SOF &&
+		(uint32_t)(millis() - sapi_menu_ms) >= PROV_TIMEOUT_MS)
+	{
+		sapi_menu_len = 0;
 	}
-	else
+	while ((c = Serial.read()) >= 0)
 	{
-		eraseBlock();
-		if (flash.writeStr(addr, str)) {
-			Serial.println("complete");
+		sapi_menu_ms = millis();
+		if ((sapi_menu_len ? sapi_menu_buf[0] : c) == PROV_SOF)
+		{
+			sapi_menu_buf[sapi_menu_len++] = c;
+			if (sapi_menu_len == 3 && sapi_menu_buf[2] > PROV_MAX)
+			{
+				prov_reply(&Serial, sapi_menu_buf, sapi_menu_buf[1], PROV_ST_BAD_FRAME, 0);
+				sapi_menu_len = 0;
+			}
+			else if (sapi_menu_len >= 3 && sapi_menu_len == 3 + sapi_menu_buf[2] + 2)
+			{
+				prov_frame(&Serial, sapi_menu_buf);
+				sapi_menu_len = 0;
+			}
+		}
+		else if (c == '$')
+		{
+			sapi_menu_len = 0;
+			cfg_export(&Serial);
+		}
+		else if (c == '#')
+		{
+			sapi_menu_len = 0;
+			Serial.println(getID().c_str());
+		}
+#if BENCH
+		else if (c == '!' && !sapi_menu_len)
+		{
+			bench_run(&Serial);
 		}
-		else {
-			Serial.print("failed");
+#endif
+		else if (c == '.')
+		{
+			// The text is only imported, the image is what loads at boot
+			sapi_menu_buf[sapi_menu_len] = '\0';
+			sapi_menu_len = 0;
+			if (cfg_import((const char *)sapi_menu_buf) && cfg_save()) {
+				Serial.println("complete");
+			}
+			else {
+				Serial.print("failed");
+			}
+			cfg_publish();
+		}
+		else if ((sapi_menu_len || (c != '\r' && c != '\n')) && sapi_menu_len < sizeof(sapi_menu_buf) - 1)
+		{
+			sapi_menu_buf[sapi_menu_len++] = c;
 		}
 	}
 }
 
 //////////////////////////////////////////////////////////////////////////
 //
-// Idle loop run.
+// Tasks of the idle loop. Until the boot countdown is over only the boot
+// task runs, then it hands over to the others and stops.
 //
 //////////////////////////////////////////////////////////////////////////
 char input;
@@ -210,204 +511,321 @@ bool initBoot = true;
 bool init1 = true;
 bool init2 = false;
 int l = 0;
-void sapi_run()
+
+static struct sched_task sapi_boot_task;
+static struct sched_task sapi_link_task;
+static struct sched_task sapi_obs_task;
+static struct sched_task sapi_event_task;
+static struct sched_task sapi_sensor_task;
+static struct sched_task sapi_log_task;
+
+// A frame is ready, from the UART IRQ
+static void sapi_link_kick()
 {
-	if(initBoot){ 
-		if(init1){
-		Serial.println("Enter any key to go to BootProgram before it counts to 10"); 
-		flash.begin(); 
-		init1 = false;
-		}
-		
-		//wait for 10 seconds
-		if (!init2){
-			for (l = 1; l < 11; l++){
-				if(Serial.available()){
-					input = Serial.read();
-					Serial.println(input);
-					init2 = true;
-					break;
-				
-				}
-				Serial.print(l);
-				delay(1000);
-				if(l == 10){
-					initBoot = false;
-					break;
-					
-				}
-			}
-		} 
-		else{
-		GoHere();
-		}
-		//initBoot = false;
-		
-	} 
-	else { 
-		//Coap Code
-	coap_s_run();
-	}
+	sched_kick(&sapi_link_task);
 }
 
-//////////////////////////////////////////////////////////////////////////
-//
-// Load all the parameters from SPI FLASH
-//
-//////////////////////////////////////////////////////////////////////////
-int ParamSendInterval(){
-	return sampleRate*sendInterval;
+static void sapi_link_run(struct sched_task *t)
+{
+	DUTY_ENTER(DUTY_LINK);
+
+	coap_s_poll();
+
+	// A registration or a notice just sent may have moved the next notification
+	sched_within(&sapi_obs_task, observe_wait_ms());
+	DUTY_EXIT();
 }
 
-int ParamSampleRate(){
-	return sampleRate;
+static void sapi_obs_run(struct sched_task *t)
+{
+	DUTY_ENTER(DUTY_LINK);
+
+	// The notifications are built and framed at full speed
+	perf_burst_begin();
+	(void)do_observe();
+	perf_burst_end();
+	sched_at(t, observe_wait_ms());
+	DUTY_EXIT();
+}
+
+static void sapi_event_run(struct sched_task *t)
+{
+	DUTY_ENTER(DUTY_SENSOR);
+
+	sapi_event_poll();
+
+	// Nothing may sit above UART RX, see ports.h
+	(void)irq_prio_check();
+	DUTY_EXIT();
 }
 
-bool setValue(String parameter, String value)
+static void sapi_sensor_run(struct sched_task *t)
 {
-	if (parameter == "SendInterval")
+	DUTY_ENTER(DUTY_SENSOR);
+
+	sapi_read_poll();
+	sapi_sample_poll();
+	sapi_cache_refresh();
+
+	// Run again when the next sample is due, not on the next SAPI_SENSOR_MS
+	sched_within(t, sapi_sample_wait_ms());
+	DUTY_EXIT();
+}
+
+static void sapi_log_run(struct sched_task *t)
+{
+	DUTY_ENTER(DUTY_LOG);
+
+	log_poll();
+
+	// Without a monitor there is nothing to print, only its connection to look for
+	if (!dlog_on(LOG_EMERG))
 	{
-		Serial.println("Send Interval: " + value);
-		//  sendInterval = (int)value;
-		sendInterval = value.toInt();
+		sched_at(t, SAPI_LOG_OFF_MS);
 	}
-	else if (parameter == "SampleRate")
+	// Print the log records unless a frame is waiting
+	else if (!(UART_PTR)->available())
 	{
-		Serial.println("Sample Rate: " + value);
-		//   sampleRate = (int)value;
-		sampleRate = value.toInt();
+		(void)log_drain(LOG_DRAIN_IDLE);
 	}
-	else if (parameter == "Digital10")
+	DUTY_EXIT();
+}
+
+#if SAPI_STANDBY && defined(SAML21)
+// No standby while a frame goes out by DMA, or with the console connected
+static uint8_t sapi_standby_busy()
+{
+	return hdlc_tx_busy() || dlog_on(LOG_EMERG);
+}
+#endif
+
+// The countdown is over, the CoAP code takes over, float switch events first
+static void sapi_tasks_start()
+{
+#if DUTY
+	duty_init();
+#endif
+	sched_stop(&sapi_boot_task);
+
+	// Every sensor is registered by now, the observers from before the
+	// restart notify on the first observe run
+	(void)coap_obs_restore();
+
+	(void)sched_add(&sapi_event_task, "event", sapi_event_run, SAPI_EVENT_MS);
+	(void)sched_add(&sapi_link_task, "link", sapi_link_run, SAPI_LINK_MS);
+	(void)sched_add(&sapi_obs_task, "observe", sapi_obs_run, 0);
+	(void)sched_add(&sapi_sensor_task, "sensor", sapi_sensor_run, SAPI_SENSOR_MS);
+	(void)sched_add(&sapi_log_task, "log", sapi_log_run, SAPI_LOG_MS);
+	sched_at(&sapi_obs_task, 0);
+	sched_budget(&sapi_event_task, SAPI_TASK_BUDGET_MS);
+	sched_budget(&sapi_link_task, SAPI_TASK_BUDGET_MS);
+	sched_budget(&sapi_obs_task, SAPI_TASK_BUDGET_MS);
+	sched_budget(&sapi_sensor_task, SAPI_TASK_BUDGET_MS);
+	sched_budget(&sapi_log_task, SAPI_TASK_BUDGET_MS);
+	hdlc_rx_notify(sapi_link_kick);
+
+	// The drivers have all begun, their IRQs are where they stay
+	(void)irq_prio_check();
+
+#if SAPI_STANDBY && defined(SAML21)
+	if (sapi_fast_boot)
 	{
-		Digital10 = value.toInt();
-		if (Digital10 == 0){
-			//pinMode(D10,INPUT);
+		// The mNIC frames keep coming in, the deframer wakes the core per byte
+		lp_uart(UART_PTR);
+		(void)lp_veto(sapi_standby_busy);
+		lp_init();
+	}
+#endif
+#if SAPI_PERF && defined(SAML21)
+	perf_init();
+#endif
+#if CRASH_WDT && defined(SAML21)
+	crash_wdt_init();
+#endif
+}
+
+// One step of the countdown a second, or of the menu once a key was sent
+static void sapi_boot_run(struct sched_task *t)
+{
+	// The menu writes to Serial itself, after the log gathered so far
+	log_flush();
+
+	if(init1 && sapi_fast_boot){
+		// No countdown, only a key already sent or the menu pin opens the menu
+		init1 = false;
+		init2 = (Serial.available() > 0);
+#ifdef SAPI_BOOT_MENU_PIN
+		pinMode(SAPI_BOOT_MENU_PIN, INPUT_PULLUP);
+		delayMicroseconds(10);
+		init2 = init2 || (digitalRead(SAPI_BOOT_MENU_PIN) == LOW);
+#endif
+		initBoot = init2;
+		if (!init2){
+			sapi_tasks_start();
+			return;
 		}
-		else if(Digital10 == 1){
-			//pinMode(D10,OUTPUT);
-			//digitalWrite(D10, HIGH);
+		while (Serial.available()){
+			input = Serial.read();
 		}
-		Serial.println("Digital10: " + value);
+		Serial.println("BootProgram");
+		t->period_ms = SAPI_MENU_MS;
+		sched_at(t, SAPI_MENU_MS);
+		return;
 	}
-	else if (parameter == "Digital11")
-	{
-		Digital11 = value.toInt();
-		if (Digital11 == 0){
-			//pinMode(D11,INPUT);
+	if(init1){
+		Serial.println("Enter any key to go to BootProgram before it counts to 10");
+		init1 = false;
+	}
+
+	//count to 10, a second a step
+	if (!init2){
+		if(Serial.available()){
+			input = Serial.read();
+			Serial.println(input);
+			init2 = true;
+			t->period_ms = SAPI_MENU_MS;
+			sched_at(t, SAPI_MENU_MS);
+			return;
 		}
-		else if(Digital11 == 1){
-			//pinMode(D11,OUTPUT);
-			//digitalWrite(D11, HIGH);
+		if(l == 10){
+			initBoot = false;
+			sapi_tasks_start();
+			return;
 		}
-		Serial.println("Digital11: " + value);
+		Serial.print(++l);
+		return;
 	}
-	
-	else if (parameter == "Relay1")
+	GoHere();
+}
+
+// From the end of sapi_initialize
+static void sapi_tasks_init()
+{
+	(void)sched_add(&sapi_boot_task, "boot", sapi_boot_run, SAPI_BOOT_MS);
+	relay_start();
+	fw_start();
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Idle loop run.
+//
+//////////////////////////////////////////////////////////////////////////
+void sapi_run()
+{
+	sched_run();
+	sapi_flash_sleep();
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Load all the parameters from SPI FLASH
+//
+//////////////////////////////////////////////////////////////////////////
+int ParamSendInterval(){
+	return cfg_config()->report_s;
+}
+
+int ParamSampleRate(){
+	return cfg_config()->sample_rate;
+}
+
+const sapi_config_t *sapi_config(){
+	return cfg_config();
+}
+
+uint8_t sapi_boot_fast(){
+	return sapi_fast_boot;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Save the Modbus serial format commissioning found, a record each.
+//
+//////////////////////////////////////////////////////////////////////////
+sapi_error_t sapi_set_modbus_format(uint32_t baud, uint16_t config)
+{
+	if (ModbusBaud == (int)baud && ModbusFormat == config)
 	{
-		Relay1 = value.toInt();
-		
-		if (Relay1 == 0){
-			pinMode(D6,OUTPUT);
-			pinMode(D7,OUTPUT);
-			digitalWrite(D6, LOW);
-			digitalWrite(D7, HIGH);
-		}
-		else if (Relay1 == 1){
-			pinMode(D6,OUTPUT);
-			pinMode(D7,OUTPUT);
-			digitalWrite(D6, HIGH);
-			digitalWrite(D7, LOW);
-		}
-		Serial.println("Relay1: " + value);
+		return SAPI_ERR_OK;
 	}
-	else if (parameter == "Relay2")
+	cfg_apply(CFG_MB_BAUD, baud);
+	cfg_apply(CFG_MB_FORMAT, config);
+	cfg_publish();
+	return cfg_log(CFG_MB_BAUD, baud) && cfg_log(CFG_MB_FORMAT, config) ?
+		SAPI_ERR_OK : SAPI_ERR_FAIL;
+}
+
+void loadGlobalVariables() {
+	uint8_t text[BLOCKSIZE];
+	uint8_t *end;
+
+	// The stores are laid out in sectors of the part's smallest erase,
+	// as begin() read it from SFDP
+	sapi_flash_wake();
+	if (flash.getEraseSize() != CFG_SECTOR)
 	{
-		Relay2 = value.toInt();
-		
-		if (Relay2 == 0){
-			pinMode(D8,OUTPUT);
-			pinMode(D9,OUTPUT);
-			digitalWrite(D8, LOW);
-			digitalWrite(D9, HIGH);
-		}
-		else if (Relay2 == 1){
-			pinMode(D8,OUTPUT);
-			pinMode(D9,OUTPUT);
-			digitalWrite(D8, HIGH);
-			digitalWrite(D9, LOW);
-		}
-		Serial.println("Relay2: " + value);
+		DLOG_ERR("SPI flash erases %lu bytes, the stores need %u", (unsigned long)flash.getEraseSize(), CFG_SECTOR);
 	}
-		
-	else if (parameter == "Analog4")
+
+	// The image and what was changed since
+	if (cfg_load())
 	{
-		
-		Analog4 = value.toInt();
-		
-		if (Analog4 == 0){
-			//pinMode(A4,INPUT);
-			
-		}
-		else if(Analog4 == 1){
-			//pinMode(A4,OUTPUT);
-		}
-		Serial.println("Analog4: " + value);
+		cfg_publish();
+		return;
 	}
-	
-	else if (parameter == "Analog5")
+
+	// No image yet, import the boot menu text once. writeStr put a 2 byte
+	// length first, the erased flash ends it.
+	sapi_flash_wake();
+	flash.readByteArray(CFG_TEXT_ADDR, text, BLOCKSIZE);
+	text[BLOCKSIZE - 1] = '\0';
+	if ((end = (uint8_t *)memchr(text, 0xFF, BLOCKSIZE)))
+		*end = '\0';
+	if (cfg_import((const char *)&text[2]))
+		(void)cfg_save();
+	cfg_publish();
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// FNV-1a over a device type, folded to a sensor_type_idx bucket.
+//
+//////////////////////////////////////////////////////////////////////////
+static uint8_t sapi_type_hash(const char *type, int len)
+{
+	uint32_t h = 2166136261UL;
+
+	while (len--)
 	{
-		
-		Analog5 = value.toInt();
-		
-		if (Analog5 == 0){
-			//pinMode(A5,INPUT);
-		}
-		else if(Analog5 == 1){
-			//pinMode(A5,OUTPUT);
-		}
-		Serial.println("Analog5: " + value);
+		h = (h ^ (uint8_t)*type++) * 16777619UL;
 	}
-	
+	return (h ^ (h >> 16)) % SAPI_TYPE_BUCKETS;
 }
 
-void loadGlobalVariables() {
-	flash.begin(); 
-	
-	String parameter = "";
-	String value = "";
-	String strVars = getString(1);
-	
-	String inChar = "";
-	int i = 0;
-	bool readingParam = true;
-	// Serial.println(strVars);
-	while (inChar != ".")
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Find a sensor by device type, not NUL terminated. The first registered
+// wins if a type is registered twice. SAPI_NO_SENSOR if there's none.
+//
+//////////////////////////////////////////////////////////////////////////
+static uint8_t sapi_find_sensor(const char *type, int len)
+{
+	uint8_t b = sapi_type_hash(type, len);
+	uint8_t i;
+
+	while (sensor_type_idx[b])
 	{
-		inChar = strVars[i++];
-		if (inChar != ":" & inChar != ",")
-		{
-			if (readingParam)
-			parameter += inChar;
-			else
-			value += inChar;
-		}
-		else
+		i = sensor_type_idx[b] - 1;
+		if (!strncmp(sensor_info[i].devicetype, type, len) && sensor_info[i].devicetype[len] == '\0')
 		{
-			if (inChar == ":")
-			{
-				readingParam = false;
-			}
-			else
-			{
-				//Serial.println(parameter + ":" + value);
-				setValue(parameter,value);
-				parameter = "";
-				value = "";
-				readingParam = true;
-			}
-			
+			return i;
 		}
+		b = (b + 1) % SAPI_TYPE_BUCKETS;
 	}
+	return SAPI_NO_SENSOR;
 }
 
 
@@ -420,12 +838,28 @@ uint8_t sapi_register_sensor(char *sensor_type, SensorInitFuncPtr sensor_init, S
 							 SensorWriteCfgFuncPtr sensor_writecfg, uint8_t is_observer, uint32_t frequency)
 {
 	uint8_t sensor_id = sensor_info_index;
+	uint8_t b;
 	
+	if (sensor_id >= SAPI_MAX_DEVICES || strlen(sensor_type) >= SAPI_MAX_DEVICE_TYPE_LEN)
+	{
+		DLOG_ERR("Can't register sensor: %s", sensor_type);
+		return SAPI_NO_SENSOR;
+	}
 	strcpy(sensor_info[sensor_id].devicetype, sensor_type);
 	sensor_info[sensor_id].init = sensor_init;
 	sensor_info[sensor_id].read = sensor_read;
 	sensor_info[sensor_id].readcfg = sensor_readcfg;
 	sensor_info[sensor_id].writecfg = sensor_writecfg;
+	sensor_info[sensor_id].readsamples = NULL;
+	sensor_info[sensor_id].readblk = NULL;
+	sensor_info[sensor_id].writeblk = NULL;
+	sensor_info[sensor_id].writeparam = NULL;
+	sensor_info[sensor_id].readquery = NULL;
+	sensor_info[sensor_id].readstart = NULL;
+	sensor_info[sensor_id].exchange = NULL;
+	sensor_info[sensor_id].sampler = 0;
+	sensor_info[sensor_id].cov = 0;
+	sensor_info[sensor_id].blk1_next = 0;
 	sensor_info[sensor_id].frequency = frequency;
 	
 	sensor_info[sensor_id].observer = 0;
@@ -435,79 +869,3671 @@ uint8_t sapi_register_sensor(char *sensor_type, SensorInitFuncPtr sensor_init, S
 		
 		// Set the URI used for obtaining token etc in CoAP Observe response msg and set the observe handler, frequency, sensor id.
 		sensor_info[sensor_id].observer_id = set_observer_sapi(sensor_type, sapi_observation_handler, frequency, sensor_id);
-		dlog(LOG_DEBUG, "Set Observer Id: %d", sensor_info[sensor_id].observer_id);
+		DLOG_DEBUG("Set Observer Id: %d", sensor_info[sensor_id].observer_id);
+		if (sensor_info[sensor_id].observer_id == OBS_Q_NO_OBSERVER)
+		{
+			sensor_info[sensor_id].observer = 0;
+		}
+	}
+	b = sapi_type_hash(sensor_type, strlen(sensor_type));
+	while (sensor_type_idx[b])
+	{
+		b = (b + 1) % SAPI_TYPE_BUCKETS;
 	}
+	sensor_type_idx[b] = sensor_id + 1;
 	sensor_info_index++;
-	dlog(LOG_DEBUG, "Registered sensor: %s", sensor_type);
+	DLOG_DEBUG("Registered sensor: %s", sensor_type);
 	return sensor_id;
 }
 
 
+//////////////////////////////////////////////////////////////////////////
+//
+// Encode a sample as a CBOR [<epoch>,<datatype>,<value>] array.
+//
+//////////////////////////////////////////////////////////////////////////
+static int sapi_sample_enc(struct cbor_buf *cbuf, const sapi_sample_t *sample)
+{
+	return cbor_enc_array(cbuf, 3) || cbor_enc_uint(cbuf, sample->epoch) ||
+		   cbor_enc_uint(cbuf, sample->datatype) || cbor_enc_prim_float32(cbuf, sample->value);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Whether n samples of a ring, from head, go as ms offsets from the
+// oldest: when two in a row fall in the same second at different ms,
+// which whole seconds would run together. Sets *base to the oldest. Not
+// with a sample before it, or more than SAPI_SAMPLES_SPAN_S after.
+//
+//////////////////////////////////////////////////////////////////////////
+static bool sapi_samples_base(const sapi_sample_t *ring, uint8_t ring_n, uint8_t head, uint8_t n, sapi_sample_t *base)
+{
+	const sapi_sample_t *sample;
+	const sapi_sample_t *prev = NULL;
+	bool sub = false;
+
+	for (uint8_t i = 0; i < n; i++)
+	{
+		sample = &ring[(head + i) % ring_n];
+		if (!prev)
+		{
+			*base = *sample;
+		}
+		else if (sample->epoch < base->epoch || (sample->epoch == base->epoch && sample->ms < base->ms) ||
+				 sample->epoch - base->epoch > SAPI_SAMPLES_SPAN_S)
+		{
+			return false;
+		}
+		else if (sample->epoch == prev->epoch && sample->ms != prev->ms)
+		{
+			sub = true;
+		}
+		prev = sample;
+	}
+	return sub;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Schema of a sensor's samples, NULL if none.
+//
+//////////////////////////////////////////////////////////////////////////
+static const sensor_schema_t *sapi_schema_find(uint8_t sensor_id)
+{
+	for (uint8_t indx = 0; indx < SAPI_MAX_SCHEMAS; indx++)
+	{
+		if (sensor_schemas[indx].n && sensor_schemas[indx].sensor_id == sensor_id)
+			return &sensor_schemas[indx];
+	}
+	return NULL;
+}
+
+
+// Field of a datatype in a schema, sc->n if none
+static uint8_t sapi_schema_field(const sensor_schema_t *sc, uint8_t datatype)
+{
+	uint8_t f;
+
+	for (f = 0; f < sc->n && sc->field[f].datatype != datatype; f++)
+		;
+	return f;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Rows of n samples of a ring, from head, in a schema: a run of samples
+// of one epoch and ms, each field once. 0 if a datatype is not in it.
+//
+//////////////////////////////////////////////////////////////////////////
+static uint8_t sapi_schema_rows(const sensor_schema_t *sc, const sapi_sample_t *ring, uint8_t ring_n,
+								uint8_t head, uint8_t n)
+{
+	const sapi_sample_t *sample;
+	const sapi_sample_t *first = NULL;
+	uint8_t rows = 0;
+	uint8_t seen = 0;
+	uint8_t f;
+
+	for (uint8_t i = 0; i < n; i++)
+	{
+		sample = &ring[(head + i) % ring_n];
+		if ((f = sapi_schema_field(sc, sample->datatype)) == sc->n)
+			return 0;
+		if (!first || sample->epoch != first->epoch || sample->ms != first->ms || (seen & (1 << f)))
+		{
+			first = sample;
+			seen = 0;
+			rows++;
+		}
+		seen |= 1 << f;
+	}
+	return rows;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Encode rows of n samples of a ring, from head, in a schema, see
+// sapi_schema_rows: [<epoch>,<value>,...], or [<ms>,<value>,...] past the
+// base, a value per field, undefined for one not sampled.
+//
+//////////////////////////////////////////////////////////////////////////
+static int sapi_schema_enc_rows(struct cbor_buf *cbuf, const sensor_schema_t *sc, const sapi_sample_t *ring,
+								uint8_t ring_n, uint8_t head, uint8_t n, uint8_t rows, const sapi_sample_t *base)
+{
+	const sapi_sample_t *row[SAPI_SCHEMA_FIELDS];
+	const sapi_sample_t *sample;
+	const sapi_sample_t *first;
+	uint8_t i = 0;
+	uint8_t f;
+
+	if (cbor_enc_array(cbuf, rows))
+		return 1;
+	while (i < n)
+	{
+		memset(row, 0, sizeof(row));
+		first = &ring[(head + i) % ring_n];
+		for (; i < n; i++)
+		{
+			sample = &ring[(head + i) % ring_n];
+			f = sapi_schema_field(sc, sample->datatype);
+			if (sample->epoch != first->epoch || sample->ms != first->ms || row[f])
+				break;
+			row[f] = sample;
+		}
+		if (cbor_enc_array(cbuf, 1 + sc->n) ||
+			cbor_enc_uint(cbuf, base ? (first->epoch - base->epoch) * 1000 + first->ms - base->ms : first->epoch))
+		{
+			return 1;
+		}
+		for (f = 0; f < sc->n; f++)
+		{
+			if (!row[f])
+				cbor_enc_prim_undef(cbuf);
+			else if (cbor_enc_prim_float32(cbuf, row[f]->value))
+				return 1;
+		}
+	}
+	return cbuf->err;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Encode the samples of a sensor, n of a ring from head, as the payload
+// {0:"<sensor type>",1:[[<epoch>,<datatype>,<value>],...]}, or with base
+// {0:"<sensor type>",2:<base epoch>,1:[[<ms>,<datatype>,<value>],...]}
+// with the ms past the base, see sapi_samples_base. As rows of values
+// with the schema Id instead when the sensor has one, see sapi_set_schema.
+//
+//////////////////////////////////////////////////////////////////////////
+static int sapi_samples_enc_as(struct cbor_buf *cbuf, uint8_t sensor_id, const sapi_sample_t *ring, uint8_t ring_n,
+							   uint8_t head, uint8_t n, const sapi_sample_t *base, bool health)
+{
+	const sapi_sample_t *sample;
+	char *type = sensor_info[sensor_id].devicetype;
+	const sensor_schema_t *sc = sapi_schema_find(sensor_id);
+	uint8_t *start = cbuf->next;
+	uint8_t rows;
+
+	// As rows of the schema, or in full again if they don't fit
+	if (sc && (rows = sapi_schema_rows(sc, ring, ring_n, head, n)))
+	{
+		if (!cbor_enc_nic_type_schema(cbuf, type, sc->id, base ? &base->epoch : NULL, health) &&
+			!sapi_schema_enc_rows(cbuf, sc, ring, ring_n, head, n, rows, base))
+		{
+			return 0;
+		}
+		cbuf->next = start;
+		cbuf->err = 0;
+	}
+
+	if ((health ? cbor_enc_nic_type_health(cbuf, type, base ? &base->epoch : NULL) :
+		 base ? cbor_enc_nic_type_at(cbuf, type, base->epoch) : cbor_enc_nic_type(cbuf, type)) ||
+		cbor_enc_array(cbuf, n))
+	{
+		return 1;
+	}
+	for (uint8_t i = 0; i < n; i++)
+	{
+		sample = &ring[(head + i) % ring_n];
+		if (!base)
+		{
+			if (sapi_sample_enc(cbuf, sample))
+			{
+				return 1;
+			}
+		}
+		else if (cbor_enc_array(cbuf, 3) ||
+				 cbor_enc_uint(cbuf, (sample->epoch - base->epoch) * 1000 + sample->ms - base->ms) ||
+				 cbor_enc_uint(cbuf, sample->datatype) || cbor_enc_prim_float32(cbuf, sample->value))
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Encode the samples as sapi_samples_enc_as, with the health heartbeat
+// waiting if this is a notification and it fits, see sapi_set_health.
+//
+//////////////////////////////////////////////////////////////////////////
+static int sapi_samples_enc(struct cbor_buf *cbuf, uint8_t sensor_id, const sapi_sample_t *ring, uint8_t ring_n,
+							uint8_t head, uint8_t n, const sapi_sample_t *base)
+{
+	uint8_t *start = cbuf->next;
+
+	if (sapi_health_ride && health_len())
+	{
+		if (!sapi_samples_enc_as(cbuf, sensor_id, ring, ring_n, head, n, base, true))
+		{
+			health_taken();
+			return 0;
+		}
+		// Again without it
+		cbuf->next = start;
+		cbuf->err = 0;
+	}
+	return sapi_samples_enc_as(cbuf, sensor_id, ring, ring_n, head, n, base, false);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Rows of several datatypes at the start of n samples, for a columnar
+// block: the first row a run of one time, distinct datatypes, *cols of
+// them, and each row after the same datatypes in the same order at a time
+// of its own. 0 unless there are two rows of two or more.
+//
+//////////////////////////////////////////////////////////////////////////
+static uint8_t sapi_blk_rows(const sapi_sample_t *samples, uint8_t n, uint8_t *cols)
+{
+	const sapi_sample_t *row;
+	uint8_t k, c, r;
+
+	for (k = 1; k < n && k < SBLK_COLS_MAX; k++)
+	{
+		if (samples[k].epoch != samples[0].epoch || samples[k].ms != samples[0].ms)
+			break;
+		for (c = 0; c < k && samples[c].datatype != samples[k].datatype; c++)
+			;
+		if (c < k)
+			break;
+	}
+	if (k < 2)
+		return 0;
+	for (r = 1; (r + 1) * k <= n && r < 0xFF; r++)
+	{
+		row = &samples[r * k];
+		for (c = 0; c < k; c++)
+		{
+			if (row[c].datatype != samples[c].datatype || row[c].epoch != row[0].epoch || row[c].ms != row[0].ms)
+				break;
+		}
+		if (c < k)
+			break;
+	}
+	*cols = k;
+	return r > 1 ? r : 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Encode rows of samples, see sapi_blk_rows, as a columnar block at blk,
+// size bytes, the columns laid out in the scratch arena. Returns its
+// length, -1 if it doesn't fit or a value can't go in a block.
+//
+//////////////////////////////////////////////////////////////////////////
+static int sapi_blk_cols(uint8_t *blk, uint16_t size, uint8_t flags, const sapi_sample_t *samples, uint8_t rows,
+						 uint8_t cols)
+{
+	int mark = scratch_mark();
+	uint32_t *epoch = (uint32_t *) scratch_alloc(rows * sizeof(uint32_t));
+	uint16_t *ms = (uint16_t *) scratch_alloc(rows * sizeof(uint16_t));
+	float *values = (float *) scratch_alloc(rows * cols * sizeof(float));
+	uint8_t datatype[SBLK_COLS_MAX];
+	int len = -1;
+
+	if (epoch && ms && values)
+	{
+		for (uint8_t c = 0; c < cols; c++)
+		{
+			datatype[c] = samples[c].datatype;
+		}
+		for (uint16_t i = 0; i < rows * cols; i++)
+		{
+			values[i] = samples[i].value;
+		}
+		for (uint8_t r = 0; r < rows; r++)
+		{
+			epoch[r] = samples[r * cols].epoch;
+			ms[r] = samples[r * cols].ms;
+		}
+		len = sblk_cols(blk, size, flags, epoch, ms, rows, datatype, values, cols);
+	}
+	scratch_release(mark);
+	return len;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Encode n samples of a sensor as blocks in a byte string, with ms when at,
+// the values to SAPI_BLK_DECIMALS. Rows of several datatypes sampled
+// together go in columnar blocks, the rest a block per run of a datatype.
+// The blocks are built in the scratch arena and copied in once.
+//
+//////////////////////////////////////////////////////////////////////////
+static sapi_error_t sapi_samples_blk(struct cbor_buf *cbuf, uint8_t sensor_id, const sapi_sample_t *samples, uint8_t n,
+									 bool at, uint8_t *len)
+{
+	int mark = scratch_mark();
+	uint8_t *blk = (uint8_t *) scratch_alloc(SAPI_MAX_PAYLOAD_LEN);
+	uint8_t flags = SAPI_BLK_DECIMALS | (at ? SBLK_MS : 0);
+	uint16_t used = 0;
+	struct sblk b;
+	uint8_t i = 0;
+	uint8_t rows, cols;
+	int blen;
+	sapi_error_t rc = SAPI_ERR_OK;
+
+	if (!blk)
+	{
+		scratch_release(mark);
+		return SAPI_ERR_NO_MEM;
+	}
+	while (i < n && rc == SAPI_ERR_OK)
+	{
+		// Rows while they last, as one block if they fit in one
+		if ((rows = sapi_blk_rows(samples + i, n - i, &cols)) &&
+			(blen = sapi_blk_cols(blk + used, SAPI_MAX_PAYLOAD_LEN - used, flags, samples + i, rows, cols)) > 0)
+		{
+			used += blen;
+			i += rows * cols;
+			continue;
+		}
+		if (sblk_start(&b, blk + used, SAPI_MAX_PAYLOAD_LEN - used, samples[i].datatype, flags,
+					   samples[i].epoch, samples[i].ms, samples[i].value))
+		{
+			rc = SAPI_ERR_NO_MEM;
+			break;
+		}
+		for (i++; i < n && samples[i].datatype == samples[i - 1].datatype; i++)
+		{
+			if (sblk_add(&b, samples[i].epoch, samples[i].ms, samples[i].value))
+				break;
+		}
+		used += sblk_end(&b);
+	}
+	if (rc == SAPI_ERR_OK && (cbor_enc_nic_type(cbuf, sensor_info[sensor_id].devicetype) || cbor_enc_bytes(cbuf, blk, used)))
+	{
+		rc = SAPI_ERR_NO_MEM;
+	}
+	scratch_release(mark);
+	if (rc == SAPI_ERR_OK)
+	{
+		*len = cbor_buf_get_len(cbuf);
+	}
+	return rc;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Encode the samples of a sensor as the whole CBOR payload:
+//   {0:"<sensor type>",1:[[<epoch>,<datatype>,<value>],...]}
+// or with fmt=csv, a "<epoch>,<datatype>,<value>" line per sample, the
+// epoch with .<ms> when seconds would run them together, or with fmt=blk
+//   {0:"<sensor type>",1:h'<block>...'}
+// a block per run of a datatype or of rows of several, see sblk.h. The
+// sample log read back goes the same way. A query, if not NULL, keeps
+// the n latest samples at or after since.
+//
+//////////////////////////////////////////////////////////////////////////
+static sapi_error_t sapi_samples_payload(uint8_t sensor_id, const sapi_query_t *query, sapi_sample_t *samples, uint8_t count,
+										 char *payload, uint8_t *len)
+{
+	uint8_t first = 0;
+	uint8_t kept = 0;
+	struct cbor_buf cbuf;
+	sapi_sample_t base;
+	bool at;
+
+	*len = 0;
+
+	// The slice asked for, in place
+	if (query)
+	{
+		for (uint8_t i = 0; i < count; i++)
+		{
+			if (samples[i].epoch >= query->since)
+			{
+				samples[kept++] = samples[i];
+			}
+		}
+		count = kept;
+		if (query->n && query->n < count)
+		{
+			first = count - query->n;
+		}
+	}
+
+	at = sapi_samples_base(samples + first, count - first, 0, count - first, &base);
+
+	if (query && query->fmt == SAPI_FMT_CSV)
+	{
+		struct txt_buf tb;
+
+		txt_init(&tb, payload, SAPI_MAX_PAYLOAD_LEN);
+		for (uint8_t i = first; i < count; i++)
+		{
+			txt_append_u32(&tb, samples[i].epoch);
+			if (at)
+			{
+				txt_append_char(&tb, '.');
+				txt_append_char(&tb, '0' + samples[i].ms / 100);
+				txt_append_char(&tb, '0' + samples[i].ms / 10 % 10);
+				txt_append_char(&tb, '0' + samples[i].ms % 10);
+			}
+			txt_append_char(&tb, ',');
+			txt_append_u32(&tb, samples[i].datatype);
+			txt_append_char(&tb, ',');
+			txt_append_fixed(&tb, samples[i].value, 2);
+			txt_append_char(&tb, '\n');
+		}
+		if (tb.err)
+		{
+			return SAPI_ERR_NO_MEM;
+		}
+		*len = txt_len(&tb);
+		return SAPI_ERR_OK;
+	}
+
+	// Lengths are a byte
+	cbor_enc_init(&cbuf, payload, SAPI_MAX_PAYLOAD_LEN - 1);
+	if (query && query->fmt == SAPI_FMT_BLK)
+	{
+		return sapi_samples_blk(&cbuf, sensor_id, samples + first, count - first, at, len);
+	}
+	if (sapi_samples_enc(&cbuf, sensor_id, samples + first, count - first, 0, count - first, at ? &base : NULL))
+	{
+		return SAPI_ERR_NO_MEM;
+	}
+	*len = cbor_buf_get_len(&cbuf);
+	return SAPI_ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Read samples from a sensor and encode them, see sapi_samples_payload.
+//
+//////////////////////////////////////////////////////////////////////////
+static sapi_error_t sapi_read_samples(uint8_t sensor_id, const sapi_query_t *query, char *payload, uint8_t *len)
+{
+	sapi_sample_t samples[SAPI_MAX_SAMPLES];
+	uint8_t count = SAPI_MAX_SAMPLES;
+	SensorReadSamplesFuncPtr pReadSamples = sensor_info[sensor_id].readsamples;
+	sapi_error_t rcode;
+
+	memset(samples, 0, sizeof(samples));
+	rcode = (*pReadSamples)(samples, &count);
+
+	*len = 0;
+	if (rcode != SAPI_ERR_OK)
+	{
+		return rcode;
+	}
+	if (count > SAPI_MAX_SAMPLES)
+	{
+		return SAPI_ERR_BAD_DATA;
+	}
+	cal_apply(sensor_id, samples, count);
+	return sapi_samples_payload(sensor_id, query, samples, count, payload, len);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Store a read of a sensor in its cache, swapped in from the back buffer.
+// The ETag only changes with the payload.
+//
+//////////////////////////////////////////////////////////////////////////
+static void sapi_cache_store(uint8_t sensor_id, sapi_error_t rcode, const char *payload, uint8_t payloadlen)
+{
+	sensor_cache_t *c = &sensor_cache[sensor_id];
+	char *front;
+
+	if (payload != sensor_cache_back && payloadlen)
+	{
+		memcpy(sensor_cache_back, payload, payloadlen);
+	}
+	if (!c->valid || payloadlen != c->len || memcmp(sensor_cache_back, c->payload, payloadlen))
+	{
+		sensor_etag_seq++;
+		c->etag[0] = sensor_etag_seq >> 8;
+		c->etag[1] = sensor_etag_seq & 0xFF;
+	}
+	front = c->payload;
+	c->payload = sensor_cache_back;
+	sensor_cache_back = front;
+	c->len = payloadlen;
+	c->valid = (rcode == SAPI_ERR_OK);
+	c->hit = 0;
+	c->read_ms = millis();
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Count a completed read of a sensor, and how long it took.
+//
+//////////////////////////////////////////////////////////////////////////
+static void sapi_stats_read(uint8_t sensor_id, sapi_error_t rcode, uint32_t took_us)
+{
+	sensor_stats_t *st = &sensor_stats[sensor_id];
+
+	if (!st->reads || took_us < st->min_us)
+		st->min_us = took_us;
+	if (took_us > st->max_us)
+		st->max_us = took_us;
+	st->total_us += took_us;
+	st->reads++;
+	if (rcode != SAPI_ERR_OK)
+		st->errors++;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Read stats of a sensor for GET /sys/stats?mod=sens, 0 past the last one.
+//
+//////////////////////////////////////////////////////////////////////////
+uint8_t sapi_read_stats(uint8_t sensor_id, struct coap_sens_stats *ss)
+{
+	sensor_stats_t *st = &sensor_stats[sensor_id];
+
+	if (sensor_id >= sensor_info_index)
+		return 0;
+
+	ss->sensor_id = sensor_id;
+	ss->reads = st->reads;
+	ss->errors = st->errors;
+	ss->timeouts = st->timeouts;
+	ss->min_us = st->min_us;
+	ss->avg_us = st->reads ? (uint32_t)(st->total_us / st->reads) : 0;
+	ss->max_us = st->max_us;
+	return 1;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Start a split-phase read, unless one is already under way.
+//
+//////////////////////////////////////////////////////////////////////////
+static sapi_error_t sapi_read_start(uint8_t sensor_id)
+{
+	sensor_read_wait_t *w = &sensor_wait[sensor_id];
+	uint32_t start_us;
+	sapi_error_t rcode;
+
+	if (!w->busy)
+	{
+		start_us = micros();
+		if ((rcode = (*sensor_info[sensor_id].readstart)()) != SAPI_ERR_OK)
+		{
+			sapi_stats_read(sensor_id, rcode, micros() - start_us);
+			return rcode;
+		}
+		w->busy = 1;
+		w->start_ms = millis();
+		DLOG_DEBUG("Read started for sensor: %s", sensor_info[sensor_id].devicetype);
+	}
+	return SAPI_ERR_IN_PROGRESS;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// The text read of a sensor into payload, SAPI_MAX_PAYLOAD_LEN long. A text
+// write callback writes it there itself, by the writer.
+//
+//////////////////////////////////////////////////////////////////////////
+static sapi_error_t sapi_read_text(uint8_t sensor_id, char *payload, uint8_t *len)
+{
+	struct txt_buf tb;
+	sapi_error_t rcode;
+
+	if (!sensor_info[sensor_id].readtxt)
+	{
+		return (*sensor_info[sensor_id].read)(payload, len);
+	}
+	txt_init(&tb, payload, SAPI_MAX_PAYLOAD_LEN);
+	rcode = (*sensor_info[sensor_id].readtxt)(&tb);
+	if (rcode == SAPI_ERR_OK && tb.err)
+	{
+		rcode = SAPI_ERR_NO_MEM;
+	}
+	*len = txt_len(&tb);
+	return rcode;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Read a sensor into its cache. A split-phase read only starts here, and
+// returns SAPI_ERR_IN_PROGRESS.
+//
+//////////////////////////////////////////////////////////////////////////
+static sapi_error_t sapi_cache_read(uint8_t sensor_id)
+{
+	char *payload = sensor_cache_back;
+	uint8_t payloadlen = 0;
+	uint32_t start_us;
+	sapi_error_t rcode;
+	
+	if (sensor_info[sensor_id].readstart)
+	{
+		return sapi_read_start(sensor_id);
+	}
+
+	// Straight into the back buffer
+	start_us = micros();
+	if (sensor_info[sensor_id].readsamples)
+	{
+		rcode = sapi_read_samples(sensor_id, NULL, payload, &payloadlen);
+	}
+	else
+	{
+		rcode = sapi_read_text(sensor_id, payload, &payloadlen);
+	}
+	sapi_stats_read(sensor_id, rcode, micros() - start_us);
+
+	sapi_cache_store(sensor_id, rcode, payload, payloadlen);
+	return rcode;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Append the cached read of a sensor to a CoAP response. Samples are
+// already CBOR, text is wrapped by build_rsp_msg.
+//
+//////////////////////////////////////////////////////////////////////////
+static error_t sapi_cache_rsp(struct mbuf *m, uint8_t *len, uint8_t sensor_id)
+{
+	sensor_cache_t *c = &sensor_cache[sensor_id];
+	char *p;
+
+	if (!sensor_info[sensor_id].readsamples)
+	{
+		return build_rsp_msg(m, len, c->payload, c->len, sensor_id);
+	}
+
+	if (!c->valid)
+	{
+		return ERR_FAIL;
+	}
+	if (!(p = (char *) m_append(m, c->len)))
+	{
+		return ERR_NO_MEM;
+	}
+	memcpy(p, c->payload, c->len);
+	*len = c->len;
+	return ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Is the cached read of a sensor inside the Max-Age window. A snapshot is
+// always answered from, it is only read by sapi_cache_refresh.
+//
+//////////////////////////////////////////////////////////////////////////
+static uint8_t sapi_cache_fresh(uint8_t sensor_id)
+{
+	sensor_cache_t *c = &sensor_cache[sensor_id];
+
+	if (sensor_info[sensor_id].snap_ms)
+	{
+		return 1;
+	}
+	return c->valid && (uint32_t)(millis() - c->read_ms) < COAP_MSG_MAX_AGE_IN_SECS * 1000UL;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Re-read one stale sensor that was served since its last read, so the
+// next GET is answered from the cache. Called from sapi_run.
+//
+//////////////////////////////////////////////////////////////////////////
+void sapi_cache_refresh()
+{
+	uint32_t now = millis();
+
+	// Snapshots first, they are never read on request
+	for (uint8_t indx = 0 ; indx < sensor_info_index ; indx++)
+	{
+		sensor_reg_info_t *s = &sensor_info[indx];
+
+		if (s->snap_ms && !sensor_wait[indx].busy && (uint32_t)(now - s->snap_last_ms) >= s->snap_ms)
+		{
+			s->snap_last_ms = now;
+			(void)sapi_cache_read(indx);
+			return;
+		}
+	}
+	for (uint8_t indx = 0 ; indx < sensor_info_index ; indx++)
+	{
+		if (sensor_cache[indx].hit && !sensor_wait[indx].busy && !sapi_cache_fresh(indx))
+		{
+			DLOG_DEBUG("Refresh cached read for sensor: %s", sensor_info[indx].devicetype);
+			(void)sapi_cache_read(indx);
+			return;
+		}
+	}
+}
+
+
+#if SAPI_KEEP
+// CRC of where the kept page buffer and rings stand, the header after the
+// CRC then the sensor, head and count of each ring
+static uint16_t sapi_keep_crc()
+{
+	uint16_t crc = crc_xmodem(crc_xmodem_init(), &sapi_keep.seq, sizeof(sapi_keep) - offsetof(sapi_keep_t, seq));
+
+	for (uint8_t indx = 0; indx < SAPI_MAX_SAMPLERS; indx++)
+	{
+		crc = crc_xmodem(crc, &sensor_samplers[indx].sensor_id,
+						 offsetof(sensor_sampler_t, more) - offsetof(sensor_sampler_t, sensor_id));
+	}
+	return crc;
+}
+#endif
+
+
+// Seal where the page buffer and the rings stand, after each change
+static void sapi_keep_seal()
+{
+#if SAPI_KEEP
+	sapi_keep.seq = backlog.seq;
+	sapi_keep.page = backlog.page;
+	sapi_keep.page_from = backlog.page_from;
+	sapi_keep.page_to = backlog.page_to;
+	sapi_keep.crc = sapi_keep_crc();
+	sapi_keep.magic = SAPI_KEEP_MAGIC;
+#endif
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Take over what the last run kept in the low power SRAM, once the sample
+// log is loaded. The records of the page buffer carry on from the flash
+// head, see backlog_resume. The samples left in the rings go to the
+// sample log, then the samplers start over.
+//
+//////////////////////////////////////////////////////////////////////////
+static void sapi_keep_load()
+{
+#if SAPI_KEEP
+	uint16_t n;
+
+	if (sapi_keep.magic == SAPI_KEEP_MAGIC && sapi_keep.crc == sapi_keep_crc())
+	{
+		n = backlog_resume(sapi_keep.seq, sapi_keep.page, sapi_keep.page_from, sapi_keep.page_to);
+		for (uint8_t indx = 0; indx < SAPI_MAX_SAMPLERS; indx++)
+		{
+			if (sensor_samplers[indx].head < SAPI_SAMPLER_RING && sensor_samplers[indx].count <= SAPI_SAMPLER_RING)
+			{
+				n += sensor_samplers[indx].count;
+				sapi_sampler_spill(&sensor_samplers[indx]);
+			}
+		}
+		DLOG_INFO("Kept %u samples over the reset", n);
+	}
+#endif
+	memset(sensor_samplers, 0, sizeof(sensor_samplers));
+	sapi_keep_seal();
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Program what the sample log holds in RAM, see sapi.h.
+//
+//////////////////////////////////////////////////////////////////////////
+void sapi_flush()
+{
+	backlog_flush();
+	sapi_keep_seal();
+	(void)log_drain();
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Decimate the older part of the sample log once it is far behind.
+//
+//////////////////////////////////////////////////////////////////////////
+sapi_error_t sapi_set_backlog_decimation(uint16_t over, uint32_t bucket_s, uint32_t recent_s)
+{
+	sapi_decim.over = over;
+	sapi_decim.bucket_s = bucket_s;
+	sapi_decim.recent_s = recent_s;
+	return SAPI_ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Send a health heartbeat every period_s with the next data notification.
+//
+//////////////////////////////////////////////////////////////////////////
+sapi_error_t sapi_set_health(uint32_t period_s, SensorBattFuncPtr batt_mv)
+{
+	return health_set(period_s, batt_mv);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// The first samples of a sensor at or after since still in the sample
+// log, sent or not, oldest sector first, for GET "sens" with the log
+// query. Up to n or SAPI_MAX_SAMPLES, encoded as sapi_samples_payload.
+//
+//////////////////////////////////////////////////////////////////////////
+static sapi_error_t sapi_backlog_read_log(uint8_t sensor_id, const sapi_query_t *query, char *payload, uint8_t *len)
+{
+	sapi_sample_t samples[SAPI_MAX_SAMPLES];
+	sapi_query_t all;
+	uint8_t want = (query->n && query->n < SAPI_MAX_SAMPLES) ? query->n : SAPI_MAX_SAMPLES;
+	int count = backlog_find(sensor_id, query->since, samples, want);
+
+	if (count < 0)
+	{
+		return SAPI_ERR_NO_MEM;
+	}
+	memset(&all, 0, sizeof(all));
+	all.fmt = query->fmt;
+	return sapi_samples_payload(sensor_id, &all, samples, count, payload, len);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Move the ring of a sampler to the sample log, oldest first.
+//
+//////////////////////////////////////////////////////////////////////////
+static void sapi_sampler_spill(sensor_sampler_t *s)
+{
+	for (; s->count; s->count--)
+	{
+		if (!backlog_put(s->sensor_id, &s->ring[s->head]))
+			s->dropped++;
+		s->head = (s->head + 1) % SAPI_SAMPLER_RING;
+	}
+	s->more = 0;
+	sapi_keep_seal();
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Add a sample to the ring of a sampler, the oldest to the sample log
+// once full.
+//
+//////////////////////////////////////////////////////////////////////////
+static void sapi_sample_put(sensor_sampler_t *s, const sapi_sample_t *sample)
+{
+	if (s->count == SAPI_SAMPLER_RING)
+	{
+		if (!backlog_put(s->sensor_id, &s->ring[s->head]))
+			s->dropped++;
+		s->head = (s->head + 1) % SAPI_SAMPLER_RING;
+		s->count--;
+	}
+	s->ring[(s->head + s->count) % SAPI_SAMPLER_RING] = *sample;
+	s->count++;
+	sapi_keep_seal();
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Put the totals of a sensor in its ring, for the notification.
+//
+//////////////////////////////////////////////////////////////////////////
+static void sapi_total_report(sensor_sampler_t *s, uint8_t sensor_id)
+{
+	sapi_sample_t sample;
+
+	for (uint8_t indx = 0; indx < TOTAL_MAX; indx++)
+	{
+		if (totals[indx].out && totals[indx].sensor_id == sensor_id)
+		{
+			sample.epoch = get_rtc_epoch_at(millis(), &sample.ms);
+			sample.datatype = totals[indx].out;
+			sample.value = totals[indx].total;
+			sapi_sample_put(s, &sample);
+		}
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Median of n values, 3 or 5, by a sorting network: the same compares
+// whatever the values, no branches to mispredict or loops to run.
+//
+//////////////////////////////////////////////////////////////////////////
+#define SAPI_CMPX(v, i, j)	do { if (v[i] > v[j]) { float t_ = v[i]; v[i] = v[j]; v[j] = t_; } } while (0)
+
+static float sapi_median(float *v, uint8_t n)
+{
+	if (n == 3)
+	{
+		SAPI_CMPX(v, 0, 1);
+		SAPI_CMPX(v, 1, 2);
+		SAPI_CMPX(v, 0, 1);
+		return v[1];
+	}
+	SAPI_CMPX(v, 0, 1);
+	SAPI_CMPX(v, 3, 4);
+	SAPI_CMPX(v, 2, 4);
+	SAPI_CMPX(v, 2, 3);
+	SAPI_CMPX(v, 0, 3);
+	SAPI_CMPX(v, 0, 2);
+	SAPI_CMPX(v, 1, 4);
+	SAPI_CMPX(v, 1, 3);
+	SAPI_CMPX(v, 1, 2);
+	return v[2];
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Run the samples of a read through the prefilters on their datatypes,
+// before the ring, alarms, totals and deadbands see them. Until a window
+// is full its samples pass as they are.
+//
+//////////////////////////////////////////////////////////////////////////
+static void sapi_prefilter_apply(uint8_t sensor_id, sapi_sample_t *samples, uint8_t count)
+{
+	sensor_prefilter_t *p;
+	float t[SAPI_PREFILTER_WINDOW];
+	float x, med, mad;
+
+	for (uint8_t indx = 0; indx < SAPI_MAX_PREFILTERS; indx++)
+	{
+		p = &sensor_prefilters[indx];
+		if (!p->size || p->sensor_id != sensor_id)
+		{
+			continue;
+		}
+		for (uint8_t i = 0; i < count; i++)
+		{
+			if (samples[i].datatype != p->datatype)
+			{
+				continue;
+			}
+			x = samples[i].value;
+			p->win[p->next] = x;
+			p->next = (p->next + 1) % p->size;
+			if (p->n < p->size)
+			{
+				p->n++;
+				continue;
+			}
+			memcpy(t, p->win, p->size * sizeof(float));
+			med = sapi_median(t, p->size);
+			if (p->k > 0)
+			{
+				for (uint8_t j = 0; j < p->size; j++)
+				{
+					t[j] = fabsf(p->win[j] - med);
+				}
+				mad = sapi_median(t, p->size);
+				if (fabsf(x - med) <= p->k * SAPI_PREFILTER_MAD_SIGMA * mad)
+				{
+					continue;
+				}
+			}
+			if (x != med)
+			{
+				p->replaced++;
+				samples[i].value = med;
+			}
+		}
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Count a sample into the summaries on its datatype.
+//
+//////////////////////////////////////////////////////////////////////////
+static void sapi_summary_add(uint8_t sensor_id, const sapi_sample_t *sample)
+{
+	sensor_summary_t *m;
+
+	for (uint8_t indx = 0; indx < SAPI_MAX_SUMMARIES; indx++)
+	{
+		m = &sensor_summaries[indx];
+		if (m->out && m->sensor_id == sensor_id && m->datatype == sample->datatype)
+		{
+			m->stats.input(lroundf(sample->value * m->counts));
+		}
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Put the summaries of a sensor in its ring, for the notification, and
+// start their next windows. A window without samples is not reported.
+//
+//////////////////////////////////////////////////////////////////////////
+static void sapi_summary_report(sensor_sampler_t *s, uint8_t sensor_id)
+{
+	sensor_summary_t *m;
+	sapi_sample_t sample;
+	float values[SAPI_SUMMARY_VALUES];
+
+	for (uint8_t indx = 0; indx < SAPI_MAX_SUMMARIES; indx++)
+	{
+		m = &sensor_summaries[indx];
+		if (!m->out || m->sensor_id != sensor_id || !m->stats.count())
+		{
+			continue;
+		}
+		values[0] = m->stats.mean() / m->counts;
+		values[1] = m->stats.sigma() / m->counts;
+		values[2] = m->stats.minimum() / m->counts;
+		values[3] = m->stats.maximum() / m->counts;
+		values[4] = m->stats.count();
+		m->stats.reset();
+
+		sample.epoch = get_rtc_epoch_at(millis(), &sample.ms);
+		for (uint8_t i = 0; i < SAPI_SUMMARY_VALUES; i++)
+		{
+			sample.datatype = m->out + i;
+			sample.value = values[i];
+			sapi_sample_put(s, &sample);
+		}
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Check a sample against the alarms on its datatype, and post the ones
+// that raise or clear, at now_ms.
+//
+//////////////////////////////////////////////////////////////////////////
+static void sapi_alarm_check(uint8_t sensor_id, const sapi_sample_t *sample, uint32_t now_ms)
+{
+	sensor_alarm_t *a;
+	float v;
+	uint8_t past, back;
+
+	for (uint8_t indx = 0; indx < SAPI_MAX_ALARMS; indx++)
+	{
+		a = &sensor_alarms[indx];
+		if (!a->kind || a->sensor_id != sensor_id || a->datatype != sample->datatype)
+		{
+			continue;
+		}
+		v = sample->value;
+		if (a->kind == SAPI_ALARM_RATE)
+		{
+			if (!a->primed || now_ms == a->last_ms)
+			{
+				// No rate before two samples, nor from the samples of one tick
+				if (!a->primed)
+				{
+					a->last = v;
+					a->last_ms = now_ms;
+					a->primed = 1;
+				}
+				continue;
+			}
+			v = fabs(v - a->last) * 60000.0f / (uint32_t)(now_ms - a->last_ms);
+			a->last = sample->value;
+			a->last_ms = now_ms;
+		}
+		if (a->kind == SAPI_ALARM_LOW)
+		{
+			past = v < a->limit;
+			back = v > a->limit + a->hyst;
+		}
+		else
+		{
+			past = v > a->limit;
+			back = v < a->limit - a->hyst;
+		}
+		if (a->raised ? !back : !past)
+		{
+			continue;
+		}
+		a->raised = !a->raised;
+		DLOG_DEBUG("Alarm %d of sensor: %d %s", a->datatype * 10 + a->kind, sensor_id, a->raised ? "raised" : "cleared");
+		(void)sapi_post_event(sensor_id, SAPI_DATATYPE_ALARM, (a->raised ? 1 : -1) * (a->datatype * 10 + a->kind));
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Sample a sensor now, into its ring, and check its alarms and relay
+// rules. A failed read is no sample.
+//
+//////////////////////////////////////////////////////////////////////////
+static void sapi_sample_take(uint8_t sensor_id)
+{
+	sensor_sampler_t *s = &sensor_samplers[sensor_info[sensor_id].sampler - 1];
+	int mark = scratch_mark();
+	sapi_sample_t *samples = (sapi_sample_t *) scratch_alloc(SAPI_MAX_SAMPLES * sizeof(sapi_sample_t));
+	uint8_t count = SAPI_MAX_SAMPLES;
+	uint32_t now = millis();
+	uint32_t start_us;
+	sapi_error_t rcode;
+
+	// Keep to the grid the sampler is on, unless a whole period was missed
+	s->last_ms = (uint32_t)(now - s->last_ms) < 2 * s->period_ms ? s->last_ms + s->period_ms : now;
+	if (!samples)
+	{
+		return;
+	}
+	memset(samples, 0, SAPI_MAX_SAMPLES * sizeof(sapi_sample_t));
+	start_us = micros();
+	rcode = (*sensor_info[sensor_id].readsamples)(samples, &count);
+	sapi_stats_read(sensor_id, rcode, micros() - start_us);
+	if (rcode != SAPI_ERR_OK || count > SAPI_MAX_SAMPLES)
+	{
+		scratch_release(mark);
+		return;
+	}
+	cal_apply(sensor_id, samples, count);
+	sapi_prefilter_apply(sensor_id, samples, count);
+	for (uint8_t i = 0; i < count; i++)
+	{
+		sapi_sample_put(s, &samples[i]);
+		sapi_alarm_check(sensor_id, &samples[i], now);
+		relay_rule_check(sensor_id, &samples[i], now);
+		total_add(sensor_id, &samples[i], now);
+		sapi_summary_add(sensor_id, &samples[i]);
+	}
+	scratch_release(mark);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Encoded length of a sample, [<epoch>,<datatype>,<value>].
+//
+//////////////////////////////////////////////////////////////////////////
+static int sapi_sample_len(const sapi_sample_t *sample)
+{
+	uint8_t buf[SAPI_SAMPLE_ENC_MAX];
+	struct cbor_buf cbuf;
+
+	cbor_enc_init(&cbuf, buf, sizeof(buf));
+	return sapi_sample_enc(&cbuf, sample) ? (int)sizeof(buf) : (int)cbor_buf_get_len(&cbuf);
+}
+
+
+// Length the health heartbeat adds to the notification being built, if it takes it
+static int sapi_health_len()
+{
+	return sapi_health_ride && health_len() ? 1 + health_len() : 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Payload room of a notification of samples: one HDLC frame less the
+// CoAP header, twice that each level the link pace slows, see pace.h,
+// and again if the sensor's notifications are compressed, see hshrink.h,
+// as far as the mbuf goes.
+//
+//////////////////////////////////////////////////////////////////////////
+static int sapi_samples_room(struct mbuf *m, uint8_t sensor_id)
+{
+	int room = ((int)hdlcs_max_info_tx() << PACE_LEVEL()) - COAP_RSP_HDR_SZ;
+
+#if HSHRINK
+	if (coap_obs_compress(sensor_info[sensor_id].observer_id))
+	{
+		room <<= HSHRINK_ROOM_SHIFT;
+	}
+#endif
+
+	return min(room, (int)M_TRAILINGSPACE(m));
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Encode the ring of a sampler into a notification, {0:"<sensor type>",
+// 1:[[<epoch>,<datatype>,<value>],...]}. As many whole samples, oldest
+// first, as fit sapi_samples_room, one HDLC frame at full pace, at least
+// one. The rest stay in the ring, and sapi_sample_poll reports them in
+// the next notification once this one is on its way.
+//
+//////////////////////////////////////////////////////////////////////////
+static error_t sapi_sampler_rsp(struct mbuf *m, uint8_t *len, uint8_t sensor_id)
+{
+	sensor_sampler_t *s = &sensor_samplers[sensor_info[sensor_id].sampler - 1];
+	int room = sapi_samples_room(m, sensor_id);
+	struct cbor_buf cbuf;
+	sapi_sample_t base;
+	bool at = sapi_samples_base(s->ring, SAPI_SAMPLER_RING, s->head, s->count, &base);
+	uint8_t *p;
+	uint8_t n;
+	int size, used;
+
+	// Map, type and a 2 byte array head, the base with ms offsets, the heartbeat, the schema Id, then the samples that fit
+	size = 6 + strlen(sensor_info[sensor_id].devicetype) + (at ? SAPI_SAMPLES_BASE_LEN : 0) + sapi_health_len() +
+		   (sapi_schema_find(sensor_id) ? SAPI_SCHEMA_ID_LEN : 0);
+	for (n = 0; n < s->count; n++)
+	{
+		used = sapi_sample_len(&s->ring[(s->head + n) % SAPI_SAMPLER_RING]);
+		if (n && size + used > room)
+		{
+			break;
+		}
+		size += used;
+	}
+
+	if (!(p = (uint8_t *) m_append(m, size)))
+	{
+		return ERR_NO_MEM;
+	}
+	cbor_enc_init(&cbuf, p, size);
+	if (sapi_samples_enc(&cbuf, sensor_id, s->ring, SAPI_SAMPLER_RING, s->head, n, at ? &base : NULL))
+	{
+		m_adj(m, -size);
+		return ERR_NO_MEM;
+	}
+	used = cbor_buf_get_len(&cbuf);
+	m_adj(m, used - size);
+
+	// The notification takes its length from the mbuf
+	*len = used > 0xFF ? 0xFF : used;
+	s->head = (s->head + n) % SAPI_SAMPLER_RING;
+	s->count -= n;
+	s->more = s->count != 0;
+	sapi_keep_seal();
+	return ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Records of the sample log before this epoch are decimated, 0 while it
+// is not far enough behind or decimation is off. About as many records
+// wait as there are slots from the tail to the head.
+//
+//////////////////////////////////////////////////////////////////////////
+static uint32_t sapi_decim_before()
+{
+	uint32_t now;
+	uint16_t ms;
+
+	if (!sapi_decim.bucket_s || backlog_waiting() <= sapi_decim.over)
+		return 0;
+
+	now = get_rtc_epoch_at(millis(), &ms);
+	return now > sapi_decim.recent_s ? now - sapi_decim.recent_s : 0;
+}
+
+
+// Keep a sample of a bucket if it is the min or max of its data type so far
+static uint8_t sapi_decim_add(sapi_sample_t *picks, uint8_t np, const sapi_sample_t *sample)
+{
+	for (uint8_t i = 0; i < np; i += 2)
+	{
+		if (picks[i].datatype == sample->datatype)
+		{
+			if (sample->value < picks[i].value)
+				picks[i] = *sample;
+			if (sample->value > picks[i + 1].value)
+				picks[i + 1] = *sample;
+			return np;
+		}
+	}
+	if (np < 2 * SAPI_DECIM_TYPES)
+	{
+		picks[np] = picks[np + 1] = *sample;
+		np += 2;
+	}
+	return np;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Add the picks of a bucket to the samples of a notification, in the order
+// taken, a single one for a min that is also the max. Returns how many, 0
+// if they don't fit its room, unless the first.
+//
+//////////////////////////////////////////////////////////////////////////
+static uint8_t sapi_decim_emit(const sapi_sample_t *picks, uint8_t np, sapi_sample_t *samples, uint8_t *n,
+							   int *size, int room)
+{
+	sapi_sample_t s;
+	uint8_t k = 0, i, j;
+	int used = 0;
+
+	for (i = 0; i < np && *n + k < SAPI_SAMPLER_RING; i++)
+	{
+		if (i % 2 && picks[i].epoch == picks[i - 1].epoch && picks[i].ms == picks[i - 1].ms &&
+			picks[i].value == picks[i - 1].value)
+			continue;
+		s = picks[i];
+		for (j = *n + k; j > *n && (samples[j - 1].epoch > s.epoch ||
+			 (samples[j - 1].epoch == s.epoch && samples[j - 1].ms > s.ms)); j--)
+			samples[j] = samples[j - 1];
+		samples[j] = s;
+		used += sapi_sample_len(&s);
+		k++;
+	}
+	if (*n && (i < np || *size + used > room))
+		return 0;
+	*n += k;
+	*size += used;
+	return k;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Encode the oldest samples of the sample log into a notification of a
+// sensor, as the ring is by sapi_sampler_rsp. Those in a row of this sensor
+// that fit sapi_samples_room, a bucket's min and max of those decimated,
+// see sapi_set_backlog_decimation. sapi_backlog_poll marks them sent once
+// it is queued.
+//
+//////////////////////////////////////////////////////////////////////////
+static error_t sapi_backlog_rsp(struct mbuf *m, uint8_t *len, uint8_t sensor_id)
+{
+	int room = sapi_samples_room(m, sensor_id);
+	int mark = scratch_mark();
+	sapi_sample_t *samples = (sapi_sample_t *) scratch_alloc(SAPI_SAMPLER_RING * sizeof(sapi_sample_t));
+	struct backlog_rec *recs = (struct backlog_rec *) scratch_alloc(BACKLOG_PAGE);
+	sapi_sample_t picks[2 * SAPI_DECIM_TYPES];
+	struct cbor_buf cbuf;
+	sapi_sample_t sample, base;
+	bool at;
+	uint32_t addr = backlog.tail;
+	uint32_t before = sapi_decim_before();
+	uint32_t bucket = 0;
+	uint8_t *p;
+	uint8_t n = 0, taken = 0, got = 0, r = 0;
+	uint8_t np = 0, k, bucket_taken = 0, bucket_left = 0, left = 0;
+	int size, used;
+
+	if (!samples || !recs)
+	{
+		scratch_release(mark);
+		return ERR_NO_MEM;
+	}
+	// Room for the base too, whether the samples need it is known once read, and the heartbeat
+	size = 6 + strlen(sensor_info[sensor_id].devicetype) + SAPI_SAMPLES_BASE_LEN + sapi_health_len() +
+		   (sapi_schema_find(sensor_id) ? SAPI_SCHEMA_ID_LEN : 0);
+
+	// A page of records at a time, each one burst from the flash
+	while (addr != backlog.head && n < SAPI_SAMPLER_RING && taken < UINT8_MAX)
+	{
+		if (r == got)
+		{
+			if (!(got = backlog_read_run(addr, recs, BACKLOG_PAGE / sizeof(*recs))))
+			{
+				break;
+			}
+			r = 0;
+		}
+		if (backlog_rec_live(&recs[r]))
+		{
+			if (recs[r].sensor_id != sensor_id)
+			{
+				break;
+			}
+			backlog_sample(&recs[r], &sample);
+
+			// A bucket of old records ends at the first record out of it
+			if (np && (sample.epoch >= before || sample.epoch - sample.epoch % sapi_decim.bucket_s != bucket))
+			{
+				if (!(k = sapi_decim_emit(picks, np, samples, &n, &size, room)))
+				{
+					taken = bucket_taken;
+					np = 0;
+					break;
+				}
+				left += bucket_left - k;
+				np = 0;
+			}
+			if (sample.epoch < before)
+			{
+				if (!np)
+				{
+					bucket = sample.epoch - sample.epoch % sapi_decim.bucket_s;
+					bucket_taken = taken;
+					bucket_left = 0;
+				}
+				np = sapi_decim_add(picks, np, &sample);
+				bucket_left++;
+			}
+			else
+			{
+				used = sapi_sample_len(&sample);
+				if (n && size + used > room)
+				{
+					break;
+				}
+				samples[n++] = sample;
+				size += used;
+			}
+		}
+		taken++;
+		r++;
+		addr = backlog_next(addr);
+	}
+	if (np)
+	{
+		if ((k = sapi_decim_emit(picks, np, samples, &n, &size, room)))
+			left += bucket_left - k;
+		else
+			taken = bucket_taken;
+	}
+	if (!n)
+	{
+		scratch_release(mark);
+		return ERR_NO_ENTRY;
+	}
+
+	if (!(p = (uint8_t *) m_append(m, size)))
+	{
+		scratch_release(mark);
+		return ERR_NO_MEM;
+	}
+	cbor_enc_init(&cbuf, p, size);
+	at = sapi_samples_base(samples, n, 0, n, &base);
+	if (sapi_samples_enc(&cbuf, sensor_id, samples, n, 0, n, at ? &base : NULL))
+	{
+		m_adj(m, -size);
+		scratch_release(mark);
+		return ERR_NO_MEM;
+	}
+	used = cbor_buf_get_len(&cbuf);
+	m_adj(m, used - size);
+	scratch_release(mark);
+
+	*len = used > 0xFF ? 0xFF : used;
+	sapi_backlog.taken = taken;
+	sapi_decim.left += left;
+	return ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Send the next frame of the sample log, once the link is up and no
+// sooner than SAPI_BACKLOG_GAP_MS after the last. Its sensor is that of
+// the oldest record, bad ones and those of sensors no longer sampled are
+// passed over. A notification of the sensor that waits goes first. The
+// page buffer is programmed here once its first record is old enough.
+//
+//////////////////////////////////////////////////////////////////////////
+static void sapi_backlog_poll()
+{
+	struct backlog_rec rec;
+	uint8_t sensor_id;
+	uint8_t observer_id;
+
+	if (backlog.page_to != backlog.page_from &&
+		(uint32_t)(millis() - backlog.page_ms) >= SAPI_BACKLOG_FLUSH_MS)
+	{
+		backlog_flush();
+		sapi_keep_seal();
+	}
+	if (backlog.tail == backlog.head || !hdlcs_is_connected() ||
+		(uint32_t)(millis() - sapi_backlog.sent_ms) < SAPI_BACKLOG_GAP_MS)
+	{
+		return;
+	}
+	sapi_backlog.sent_ms = millis();
+
+	for (uint8_t i = 0; i < SAPI_SAMPLER_RING && backlog.tail != backlog.head; i++)
+	{
+		backlog_read(backlog.tail, &rec);
+		sensor_id = rec.sensor_id;
+		if (backlog_rec_live(&rec) && sensor_id < sensor_info_index && sensor_info[sensor_id].sampler)
+		{
+			observer_id = sensor_info[sensor_id].observer_id;
+			if (obs_q_has(observer_id))
+			{
+				return;
+			}
+			sapi_backlog.taken = 0;
+			sapi_backlog.sensor = sensor_id + 1;
+			if (coap_observe_rsp(observer_id) == ERR_OK)
+			{
+				backlog_commit(sapi_backlog.taken);
+			}
+			sapi_backlog.sensor = 0;
+			return;
+		}
+		backlog_commit(1);
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Ms until the next sample is due, 0 if one is, SCHED_NEVER without a sampler.
+//
+//////////////////////////////////////////////////////////////////////////
+static uint32_t sapi_sample_wait_ms()
+{
+	uint32_t wait = SCHED_NEVER;
+	uint32_t since;
+
+	for (uint8_t indx = 0 ; indx < SAPI_MAX_SAMPLERS ; indx++)
+	{
+		if (!sensor_samplers[indx].period_ms)
+			continue;
+
+		since = millis() - sensor_samplers[indx].last_ms;
+		if (since >= sensor_samplers[indx].period_ms)
+			return 0;
+		wait = min(wait, sensor_samplers[indx].period_ms - since);
+	}
+	return wait;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Put a sampler on whole multiples of its period from the epoch, as the
+// samplers of other units on the same time are. last_ms goes back to the
+// grid point before now.
+//
+//////////////////////////////////////////////////////////////////////////
+static void sapi_sample_align(sensor_sampler_t *s, uint32_t now, time_t epoch, uint16_t ms)
+{
+	s->last_ms = now - (uint32_t)(((uint64_t)epoch * 1000 + ms) % s->period_ms);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Realign every sampler on the epoch, once the timebase was set to a
+// second boundary, a GPS PPS.
+//
+//////////////////////////////////////////////////////////////////////////
+void sapi_align_sampling()
+{
+	uint32_t now = millis();
+	uint16_t ms;
+	time_t epoch = get_rtc_epoch_at(now, &ms);
+
+	for (uint8_t indx = 0 ; indx < SAPI_MAX_SAMPLERS ; indx++)
+	{
+		if (sensor_samplers[indx].period_ms)
+			sapi_sample_align(&sensor_samplers[indx], now, epoch, ms);
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Take the samples that are due, report what the last notification had
+// no room for once it is sent, and save the totals due. Called from sapi_run.
+//
+//////////////////////////////////////////////////////////////////////////
+void sapi_sample_poll()
+{
+	sensor_sampler_t *s;
+	uint8_t observer_id;
+
+	for (uint8_t indx = 0 ; indx < SAPI_MAX_SAMPLERS ; indx++)
+	{
+		s = &sensor_samplers[indx];
+		if (s->period_ms && (uint32_t)(millis() - s->last_ms) >= s->period_ms)
+		{
+			sapi_sample_take(s->sensor_id);
+		}
+		// A queued notification would be replaced, not followed. The follow-up
+		// clears more itself, once it has taken its samples.
+		observer_id = sensor_info[s->sensor_id].observer_id;
+		if (s->more && s->count && !obs_q_has(observer_id) && coap_observe_rsp(observer_id) != ERR_OK)
+		{
+			s->more = 0;
+		}
+	}
+	total_poll();
+	sapi_backlog_poll();
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Register a samples read callback for a sensor, CBOR payloads.
+//
+//////////////////////////////////////////////////////////////////////////
+sapi_error_t sapi_register_samples(uint8_t sensor_id, SensorReadSamplesFuncPtr sensor_readsamples)
+{
+	if (sensor_id >= sensor_info_index)
+		return SAPI_ERR_NO_ENTRY;
+
+	sensor_info[sensor_id].readsamples = sensor_readsamples;
+	sensor_cache[sensor_id].valid = 0;
+	if (sensor_info[sensor_id].observer)
+	{
+		coap_obs_set_cf(sensor_info[sensor_id].observer_id, 
+						sensor_readsamples ? COAP_CF_APPLICATION_CBOR : COAP_CF_CSV);
+	}
+	return SAPI_ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Register block-wise transfer callbacks for a sensor.
+//
+//////////////////////////////////////////////////////////////////////////
+sapi_error_t sapi_register_block(uint8_t sensor_id, SensorReadBlockFuncPtr sensor_readblk, 
+								 SensorWriteBlockFuncPtr sensor_writeblk)
+{
+	if (sensor_id >= sensor_info_index)
+		return SAPI_ERR_NO_ENTRY;
+
+	sensor_info[sensor_id].readblk = sensor_readblk;
+	sensor_info[sensor_id].writeblk = sensor_writeblk;
+	sensor_info[sensor_id].blk1_next = 0;
+	return SAPI_ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Register a query read callback for a sensor, GET sens with n= or since=.
+//
+//////////////////////////////////////////////////////////////////////////
+sapi_error_t sapi_register_query(uint8_t sensor_id, SensorReadQueryFuncPtr sensor_readquery)
+{
+	if (sensor_id >= sensor_info_index)
+		return SAPI_ERR_NO_ENTRY;
+
+	sensor_info[sensor_id].readquery = sensor_readquery;
+	return SAPI_ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Register a read start callback for a sensor, split-phase reads.
+//
+//////////////////////////////////////////////////////////////////////////
+sapi_error_t sapi_register_read_start(uint8_t sensor_id, SensorReadStartFuncPtr sensor_readstart)
+{
+	if (sensor_id >= sensor_info_index)
+		return SAPI_ERR_NO_ENTRY;
+
+	sensor_info[sensor_id].readstart = sensor_readstart;
+	return SAPI_ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Register text write callbacks for a sensor, its sens and cfg text
+// written in place instead of into a payload buffer.
+//
+//////////////////////////////////////////////////////////////////////////
+sapi_error_t sapi_register_txt(uint8_t sensor_id, SensorWriteTxtFuncPtr sensor_read,
+							   SensorWriteTxtFuncPtr sensor_readcfg)
+{
+	if (sensor_id >= sensor_info_index)
+		return SAPI_ERR_NO_ENTRY;
+
+	sensor_info[sensor_id].readtxt = sensor_read;
+	sensor_info[sensor_id].readcfgtxt = sensor_readcfg;
+	return SAPI_ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Register an exchange start callback for a sensor, requests passed
+// through to its device.
+//
+//////////////////////////////////////////////////////////////////////////
+sapi_error_t sapi_register_exchange(uint8_t sensor_id, SensorExchangeFuncPtr sensor_exchange)
+{
+	if (sensor_id >= sensor_info_index)
+		return SAPI_ERR_NO_ENTRY;
+
+	sensor_info[sensor_id].exchange = sensor_exchange;
+	return SAPI_ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Register a parameter write callback for a sensor, CBOR config PUTs.
+//
+//////////////////////////////////////////////////////////////////////////
+sapi_error_t sapi_register_params(uint8_t sensor_id, SensorWriteParamFuncPtr sensor_writeparam)
+{
+	if (sensor_id >= sensor_info_index)
+		return SAPI_ERR_NO_ENTRY;
+
+	sensor_info[sensor_id].writeparam = sensor_writeparam;
+	return SAPI_ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Send a sensor's periodic notifications NON, with a periodic CON.
+//
+//////////////////////////////////////////////////////////////////////////
+sapi_error_t sapi_set_observe_non(uint8_t sensor_id, uint8_t con_every_n, uint32_t con_every_s)
+{
+	if (sensor_id >= sensor_info_index || !sensor_info[sensor_id].observer)
+		return SAPI_ERR_NO_ENTRY;
+
+	if (coap_obs_set_non(sensor_info[sensor_id].observer_id, con_every_n, con_every_s) != ERR_OK)
+		return SAPI_ERR_NO_ENTRY;
+
+	return SAPI_ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Compress a sensor's notifications, see hshrink.h.
+//
+//////////////////////////////////////////////////////////////////////////
+sapi_error_t sapi_set_observe_compress(uint8_t sensor_id, uint8_t on)
+{
+	if (sensor_id >= sensor_info_index || !sensor_info[sensor_id].observer)
+		return SAPI_ERR_NO_ENTRY;
+
+	if (coap_obs_set_compress(sensor_info[sensor_id].observer_id, on) != ERR_OK)
+		return SAPI_ERR_NO_ENTRY;
+
+	return SAPI_ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Change a sensor's notification frequency, re-armed from now.
+//
+//////////////////////////////////////////////////////////////////////////
+sapi_error_t sapi_set_frequency(uint8_t sensor_id, uint32_t frequency)
+{
+	if (sensor_id >= sensor_info_index || !sensor_info[sensor_id].observer)
+		return SAPI_ERR_NO_ENTRY;
+
+	if (coap_obs_set_freq(sensor_info[sensor_id].observer_id, frequency) != ERR_OK)
+		return SAPI_ERR_NO_ENTRY;
+
+	sensor_info[sensor_id].frequency = frequency;
+	DLOG_DEBUG("Sensor: %s reported every %lu s", sensor_info[sensor_id].devicetype, frequency);
+	return SAPI_ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Keep a snapshot of a sensor, read by sapi_run every refresh_s.
+//
+//////////////////////////////////////////////////////////////////////////
+sapi_error_t sapi_set_snapshot(uint8_t sensor_id, uint32_t refresh_s)
+{
+	if (sensor_id >= sensor_info_index || sensor_info[sensor_id].sampler || sensor_info[sensor_id].cov)
+		return SAPI_ERR_NO_ENTRY;
+
+	sensor_info[sensor_id].snap_ms = refresh_s * 1000UL;
+	// The first read is due now
+	sensor_info[sensor_id].snap_last_ms = millis() - sensor_info[sensor_id].snap_ms;
+	return SAPI_ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Re-arm a sensor with SendInterval and SampleRate when they change.
+//
+//////////////////////////////////////////////////////////////////////////
+sapi_error_t sapi_follow_config(uint8_t sensor_id)
+{
+	if (sensor_id >= sensor_info_index || !sensor_info[sensor_id].observer)
+		return SAPI_ERR_NO_ENTRY;
+
+	sensor_info[sensor_id].cfgtiming = 1;
+	return SAPI_ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// SendInterval or SampleRate changed, re-arm the sensors following them.
+//
+//////////////////////////////////////////////////////////////////////////
+static void sapi_cfg_retime()
+{
+	for (uint8_t sensor_id = 0; sensor_id < sensor_info_index; sensor_id++)
+	{
+		if (!sensor_info[sensor_id].cfgtiming)
+			continue;
+		(void)sapi_set_frequency(sensor_id, ParamSendInterval());
+		if (sensor_info[sensor_id].sampler)
+			(void)sapi_set_sampling(sensor_id, ParamSampleRate());
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Sample a sensor on its own schedule, reported by its notifications.
+//
+//////////////////////////////////////////////////////////////////////////
+sapi_error_t sapi_set_sampling(uint8_t sensor_id, uint32_t sample_s)
+{
+	return sapi_set_sampling_ms(sensor_id, sample_s * 1000UL);
+}
+
+sapi_error_t sapi_set_sampling_ms(uint8_t sensor_id, uint32_t sample_ms)
+{
+	sensor_sampler_t *s;
+	uint8_t indx;
+	uint32_t now = millis();
+	uint16_t ms;
+	time_t epoch;
+
+	if (sensor_id >= sensor_info_index || !sensor_info[sensor_id].observer || !sensor_info[sensor_id].readsamples ||
+		sensor_info[sensor_id].cov || sensor_info[sensor_id].snap_ms)
+		return SAPI_ERR_NO_ENTRY;
+
+	if (sensor_info[sensor_id].sampler)
+	{
+		indx = sensor_info[sensor_id].sampler - 1;
+	}
+	else
+	{
+		if (!sample_ms)
+			return SAPI_ERR_OK;
+
+		for (indx = 0; indx < SAPI_MAX_SAMPLERS && sensor_samplers[indx].period_ms; indx++)
+			;
+		if (indx == SAPI_MAX_SAMPLERS)
+			return SAPI_ERR_NO_MEM;
+	}
+
+	s = &sensor_samplers[indx];
+	memset(s, 0, sizeof(sensor_sampler_t));
+	if (!sample_ms)
+	{
+		sensor_info[sensor_id].sampler = 0;
+		sapi_keep_seal();
+		return SAPI_ERR_OK;
+	}
+	s->period_ms = sample_ms;
+	epoch = get_rtc_epoch_at(now, &ms);
+	sapi_sample_align(s, now, epoch, ms);
+	s->sensor_id = sensor_id;
+	sensor_info[sensor_id].sampler = indx + 1;
+	sapi_keep_seal();
+	DLOG_DEBUG("Sampling sensor: %s every %lu ms", sensor_info[sensor_id].devicetype, sample_ms);
+	return SAPI_ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Report a sensor on change of value, checked at each notification.
+//
+//////////////////////////////////////////////////////////////////////////
+sapi_error_t sapi_set_deadband(uint8_t sensor_id, float band, uint8_t percent, uint32_t min_s, uint32_t max_s)
+{
+	sensor_cov_t *v;
+	uint8_t indx;
+
+	if (sensor_id >= sensor_info_index || !sensor_info[sensor_id].observer || !sensor_info[sensor_id].readsamples ||
+		sensor_info[sensor_id].sampler || sensor_info[sensor_id].snap_ms)
+		return SAPI_ERR_NO_ENTRY;
+
+	if (sensor_info[sensor_id].cov)
+	{
+		indx = sensor_info[sensor_id].cov - 1;
+	}
+	else
+	{
+		if (band <= 0)
+			return SAPI_ERR_OK;
+
+		for (indx = 0; indx < SAPI_MAX_COV && sensor_covs[indx].band > 0; indx++)
+			;
+		if (indx == SAPI_MAX_COV)
+			return SAPI_ERR_NO_MEM;
+	}
+
+	v = &sensor_covs[indx];
+	memset(v, 0, sizeof(sensor_cov_t));
+	if (band <= 0)
+	{
+		sensor_info[sensor_id].cov = 0;
+		return SAPI_ERR_OK;
+	}
+	v->band = band;
+	v->percent = (percent != 0);
+	v->min_ms = min_s * 1000UL;
+	v->max_ms = max_s * 1000UL;
+	sensor_info[sensor_id].cov = indx + 1;
+	return SAPI_ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Find the alarm of a sensor, datatype and kind, else NULL.
+//
+//////////////////////////////////////////////////////////////////////////
+static sensor_alarm_t *sapi_alarm_find(uint8_t sensor_id, uint8_t datatype, uint8_t kind)
+{
+	for (uint8_t indx = 0; indx < SAPI_MAX_ALARMS; indx++)
+	{
+		sensor_alarm_t *a = &sensor_alarms[indx];
+		if (a->kind == kind && a->sensor_id == sensor_id && a->datatype == datatype)
+			return a;
+	}
+	return NULL;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Raise an alarm when a sampled value crosses a limit, checked at each sample.
+//
+//////////////////////////////////////////////////////////////////////////
+sapi_error_t sapi_set_alarm(uint8_t sensor_id, uint8_t datatype, uint8_t kind, float limit, float hyst)
+{
+	sensor_alarm_t *a;
+
+	if (sensor_id >= sensor_info_index || !sensor_info[sensor_id].readsamples ||
+		kind < SAPI_ALARM_HIGH || kind > SAPI_ALARM_RATE || hyst < 0)
+		return SAPI_ERR_NO_ENTRY;
+
+	if (!(a = sapi_alarm_find(sensor_id, datatype, kind)) && !(a = sapi_alarm_find(0, 0, 0)))
+		return SAPI_ERR_NO_MEM;
+
+	memset(a, 0, sizeof(sensor_alarm_t));
+	a->limit = limit;
+	a->hyst = hyst;
+	a->sensor_id = sensor_id;
+	a->datatype = datatype;
+	a->kind = kind;
+	return SAPI_ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Remove an alarm.
+//
+//////////////////////////////////////////////////////////////////////////
+sapi_error_t sapi_clear_alarm(uint8_t sensor_id, uint8_t datatype, uint8_t kind)
+{
+	sensor_alarm_t *a;
+
+	if (!kind || !(a = sapi_alarm_find(sensor_id, datatype, kind)))
+		return SAPI_ERR_NO_ENTRY;
+
+	memset(a, 0, sizeof(sensor_alarm_t));
+	return SAPI_ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Integrate a sampled value, resumed from its last save.
+//
+//////////////////////////////////////////////////////////////////////////
+sapi_error_t sapi_set_total(uint8_t sensor_id, uint8_t datatype, uint8_t total_datatype, float scale)
+{
+	if (sensor_id >= sensor_info_index || !sensor_info[sensor_id].readsamples || !total_datatype)
+		return SAPI_ERR_NO_ENTRY;
+
+	return total_set(sensor_id, datatype, total_datatype, scale);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Restart a total from 0.
+//
+//////////////////////////////////////////////////////////////////////////
+sapi_error_t sapi_reset_total(uint8_t sensor_id, uint8_t total_datatype)
+{
+	return total_reset(sensor_id, total_datatype);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Summarise the samples of a datatype in each notification.
+//
+//////////////////////////////////////////////////////////////////////////
+sapi_error_t sapi_set_summary(uint8_t sensor_id, uint8_t datatype, uint8_t summary_datatype, float resolution)
+{
+	sensor_summary_t *m;
+	uint8_t indx;
+
+	if (sensor_id >= sensor_info_index || !sensor_info[sensor_id].readsamples || !summary_datatype || resolution <= 0)
+		return SAPI_ERR_NO_ENTRY;
+
+	for (indx = 0; indx < SAPI_MAX_SUMMARIES && sensor_summaries[indx].out &&
+		 (sensor_summaries[indx].sensor_id != sensor_id || sensor_summaries[indx].out != summary_datatype); indx++)
+		;
+	if (indx == SAPI_MAX_SUMMARIES)
+		return SAPI_ERR_NO_MEM;
+
+	m = &sensor_summaries[indx];
+	m->stats.reset();
+	m->counts = 1.0f / resolution;
+	m->sensor_id = sensor_id;
+	m->datatype = datatype;
+	m->out = summary_datatype;
+	return SAPI_ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Take spurious readings out of a sampled value, see sapi.h.
+//
+//////////////////////////////////////////////////////////////////////////
+sapi_error_t sapi_set_prefilter(uint8_t sensor_id, uint8_t datatype, uint8_t window, float k)
+{
+	sensor_prefilter_t *p;
+	uint8_t indx;
+
+	if (sensor_id >= sensor_info_index || !sensor_info[sensor_id].readsamples || (window != 3 && window != 5) || k < 0)
+		return SAPI_ERR_NO_ENTRY;
+
+	for (indx = 0; indx < SAPI_MAX_PREFILTERS && sensor_prefilters[indx].size &&
+		 (sensor_prefilters[indx].sensor_id != sensor_id || sensor_prefilters[indx].datatype != datatype); indx++)
+		;
+	if (indx == SAPI_MAX_PREFILTERS)
+		return SAPI_ERR_NO_MEM;
+
+	p = &sensor_prefilters[indx];
+	memset(p, 0, sizeof(*p));
+	p->k = k;
+	p->size = window;
+	p->sensor_id = sensor_id;
+	p->datatype = datatype;
+	return SAPI_ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Calibrate the samples of a datatype, saved once changed, see sapi.h.
+//
+//////////////////////////////////////////////////////////////////////////
+sapi_error_t sapi_set_calibration(uint8_t sensor_id, uint8_t datatype, const sapi_cal_point_t *points, uint8_t n)
+{
+	sapi_error_t rc;
+
+	if (sensor_id >= sensor_info_index || !sensor_info[sensor_id].readsamples || n > SAPI_CAL_POINTS)
+		return SAPI_ERR_NO_ENTRY;
+
+	rc = cal_set(sensor_id, datatype, points, n);
+	if (rc == SAPI_ERR_OK || rc == SAPI_ERR_FAIL)
+		sensor_cache[sensor_id].valid = 0;
+	return rc;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Encode the fields of a schema, [[<datatype>,"<unit>"],...].
+//
+//////////////////////////////////////////////////////////////////////////
+static int sapi_schema_enc_fields(struct cbor_buf *cbuf, const sapi_field_t *fields, uint8_t n)
+{
+	if (cbor_enc_array(cbuf, n))
+		return 1;
+	for (uint8_t f = 0; f < n; f++)
+	{
+		if (cbor_enc_array(cbuf, 2) || cbor_enc_uint(cbuf, fields[f].datatype) ||
+			cbor_enc_text(cbuf, fields[f].unit, strnlen(fields[f].unit, SAPI_SCHEMA_UNIT_LEN - 1)))
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Publish the schema of a sensor's samples, its Id the crc_xmodem of its
+// encoded fields, see sapi.h.
+//
+//////////////////////////////////////////////////////////////////////////
+sapi_error_t sapi_set_schema(uint8_t sensor_id, const sapi_field_t *fields, uint8_t n, uint16_t *id)
+{
+	uint8_t buf[SAPI_SCHEMA_ENC_MAX];
+	struct cbor_buf cbuf;
+	sensor_schema_t sc;
+	sensor_schema_t *slot = NULL;
+
+	if (sensor_id >= sensor_info_index || !sensor_info[sensor_id].readsamples || n > SAPI_SCHEMA_FIELDS)
+		return SAPI_ERR_NO_ENTRY;
+
+	for (uint8_t indx = 0; indx < SAPI_MAX_SCHEMAS; indx++)
+	{
+		if (sensor_schemas[indx].n && sensor_schemas[indx].sensor_id == sensor_id)
+		{
+			slot = &sensor_schemas[indx];
+			break;
+		}
+		if (!sensor_schemas[indx].n && !slot)
+			slot = &sensor_schemas[indx];
+	}
+	if (!n)
+	{
+		if (slot && slot->sensor_id == sensor_id)
+			slot->n = 0;
+		sensor_cache[sensor_id].valid = 0;
+		return SAPI_ERR_OK;
+	}
+	if (!slot)
+		return SAPI_ERR_NO_MEM;
+
+	memset(&sc, 0, sizeof(sc));
+	for (uint8_t f = 0; f < n; f++)
+	{
+		for (uint8_t g = 0; g < f; g++)
+		{
+			if (fields[g].datatype == fields[f].datatype)
+				return SAPI_ERR_BAD_DATA;
+		}
+		sc.field[f].datatype = fields[f].datatype;
+		strncpy(sc.field[f].unit, fields[f].unit, SAPI_SCHEMA_UNIT_LEN - 1);
+	}
+	cbor_enc_init(&cbuf, buf, sizeof(buf));
+	if (sapi_schema_enc_fields(&cbuf, sc.field, n))
+		return SAPI_ERR_FAIL;
+	sc.id = crc_xmodem(crc_xmodem_init(), buf, cbor_buf_get_len(&cbuf));
+	sc.n = n;
+	sc.sensor_id = sensor_id;
+	*slot = sc;
+	sensor_cache[sensor_id].valid = 0;
+	if (id)
+		*id = sc.id;
+	DLOG_DEBUG("Sensor: %s schema %04x, %d fields", sensor_info[sensor_id].devicetype, sc.id, n);
+	return SAPI_ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Map a Q16.16 raw value with the calibration of a datatype, see sapi.h.
+//
+//////////////////////////////////////////////////////////////////////////
+int32_t sapi_calibrate_q16(uint8_t sensor_id, uint8_t datatype, int32_t raw)
+{
+	const struct cal *c = cal_find(sensor_id, datatype);
+
+	return c ? cal_eval(c, raw) : raw;
+}
+
+
 //////////////////////////////////////////////////////////////////////////
 //
 // Initialize a sensor (hardware) and sensor related code.
 //
 //////////////////////////////////////////////////////////////////////////
-sapi_error_t sapi_init_sensor(uint8_t sensor_id)
+sapi_error_t sapi_init_sensor(uint8_t sensor_id)
+{
+	// Initialize Sensor
+	SensorInitFuncPtr pInitFunc = sensor_info[sensor_id].init;
+	sapi_error_t rcode = (*pInitFunc)();
+	
+	return rcode;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Function used to push a notification.
+//
+//////////////////////////////////////////////////////////////////////////
+sapi_error_t sapi_push_notification(uint8_t sensor_id)
+{
+	// A sampled sensor reports the ring, with a sample of the moment
+	if (sensor_id < sensor_info_index && sensor_info[sensor_id].sampler)
+	{
+		sapi_sample_take(sensor_id);
+	}
+
+	// Simple here. Just make the call. Heavy lifting is done in the CoAP Server
+	// Does the milli hardware handshake if needed. Reported whatever the deadband.
+	sensor_cov_force = 1;
+	error_t rc = coap_observe_alarm(sensor_info[sensor_id].observer_id);
+	sensor_cov_force = 0;
+
+	if (rc == ERR_NO_ENTRY)
+		return SAPI_ERR_NO_ENTRY;
+	if (rc == ERR_NO_MEM)
+		return SAPI_ERR_NO_MEM;
+	
+	return SAPI_ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Function used to post an event from an interrupt. Only the tail moves.
+//
+//////////////////////////////////////////////////////////////////////////
+sapi_error_t sapi_post_event(uint8_t sensor_id, uint8_t datatype, float value)
+{
+	uint8_t tail = sensor_event_tail;
+	volatile sensor_event_t *e;
+
+	if ((uint8_t)(tail - sensor_event_head) == SAPI_EVENT_Q)
+	{
+		sensor_event_dropped++;
+		return SAPI_ERR_NO_MEM;
+	}
+	e = &sensor_events[tail % SAPI_EVENT_Q];
+	e->ms = millis();
+	e->value = value;
+	e->sensor_id = sensor_id;
+	e->datatype = datatype;
+	sensor_event_tail = tail + 1;
+	sched_kick(&sapi_event_task);
+	return SAPI_ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Report the posted events, oldest first. Called from sapi_run ahead of
+// the periodic notifications. Only the head moves.
+//
+//////////////////////////////////////////////////////////////////////////
+void sapi_event_poll()
+{
+	volatile sensor_event_t *e;
+	sapi_sample_t sample;
+	uint8_t sensor_id;
+
+	while (sensor_event_head != sensor_event_tail)
+	{
+		e = &sensor_events[sensor_event_head % SAPI_EVENT_Q];
+		sensor_id = e->sensor_id;
+		sample.epoch = get_rtc_epoch_at(e->ms, &sample.ms);
+		sample.datatype = e->datatype;
+		sample.value = e->value;
+		DLOG_DEBUG("Event for sensor: %d posted %lu ms ago", sensor_id, millis() - e->ms);
+		sensor_event_head++;
+
+		if (sensor_id >= sensor_info_index)
+		{
+			continue;
+		}
+		if (sensor_info[sensor_id].sampler)
+		{
+			sapi_sample_put(&sensor_samplers[sensor_info[sensor_id].sampler - 1], &sample);
+		}
+		(void)sapi_push_notification(sensor_id);
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Transition of a digital input, in its interrupt.
+//
+//////////////////////////////////////////////////////////////////////////
+static void sapi_input_edge(uint8_t indx)
+{
+	sensor_input_t *in = &sensor_inputs[indx];
+
+	in->level = digitalRead(in->pin);
+	in->edge_ms = millis();
+	in->edges++;
+	(void)sapi_post_event(in->sensor_id, SAPI_DATATYPE_DI, in->level);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Samples of a digital input, the level since the last transition.
+//
+//////////////////////////////////////////////////////////////////////////
+static sapi_error_t sapi_input_samples(uint8_t indx, sapi_sample_t *samples, uint8_t *count)
+{
+	sensor_input_t *in = &sensor_inputs[indx];
+
+	samples[0].epoch = get_rtc_epoch_at(in->edge_ms, &samples[0].ms);
+	samples[0].datatype = SAPI_DATATYPE_DI;
+	samples[0].value = in->level;
+	*count = 1;
+	return SAPI_ERR_OK;
+}
+
+
+// The callbacks take no context, one of each per input
+static void sapi_input_isr0() { sapi_input_edge(0); }
+static void sapi_input_isr1() { sapi_input_edge(1); }
+static sapi_error_t sapi_input_samples0(sapi_sample_t *samples, uint8_t *count) { return sapi_input_samples(0, samples, count); }
+static sapi_error_t sapi_input_samples1(sapi_sample_t *samples, uint8_t *count) { return sapi_input_samples(1, samples, count); }
+
+static voidFuncPtr const sapi_input_isrs[SAPI_MAX_INPUTS] = { sapi_input_isr0, sapi_input_isr1 };
+static const SensorReadSamplesFuncPtr sapi_input_readsamples[SAPI_MAX_INPUTS] = { sapi_input_samples0, sapi_input_samples1 };
+
+// An input has no text read nor configuration
+static sapi_error_t sapi_input_init() { return SAPI_ERR_OK; }
+static sapi_error_t sapi_input_none(char *payload, uint8_t *len) { *len = 0; return SAPI_ERR_NOT_IMPLEMENTED; }
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Turn on the EIC majority filter of a pin, 3 samples must agree. The
+// CONFIG registers are enable-protected on the SAML21, as in attachInterrupt.
+//
+//////////////////////////////////////////////////////////////////////////
+static void sapi_input_filter(uint32_t pin)
+{
+	uint32_t in = GetExtInt(pin);
+	uint32_t config = (in > EXTERNAL_INT_7) ? 1 : 0;
+	uint32_t pos = (in - (8 * config)) << 2;
+
+#if (SAML21 || SAMC21)
+	EIC->CTRLA.reg = 0;
+	while (EIC->SYNCBUSY.reg & EIC_SYNCBUSY_MASK) { }
+#endif
+	EIC->CONFIG[config].reg |= (EIC_CONFIG_FILTEN0 << pos);
+#if (SAML21 || SAMC21)
+	EIC->CTRLA.reg = EIC_CTRLA_ENABLE;
+	while (EIC->SYNCBUSY.reg & EIC_SYNCBUSY_MASK) { }
+#endif
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Register a digital input as a sensor, interrupt on both edges.
+//
+//////////////////////////////////////////////////////////////////////////
+uint8_t sapi_register_input(char *sensor_type, uint32_t pin, uint32_t mode, uint32_t frequency)
+{
+	sensor_input_t *in;
+	uint8_t indx = sensor_input_index;
+	uint8_t sensor_id;
+
+	if (indx >= SAPI_MAX_INPUTS || GetExtInt(pin) == NOT_AN_INTERRUPT)
+	{
+		DLOG_ERR("Can't register input: %s", sensor_type);
+		return SAPI_NO_SENSOR;
+	}
+	sensor_id = sapi_register_sensor(sensor_type, sapi_input_init, sapi_input_none, sapi_input_none,
+									 sapi_input_none, 1, frequency);
+	if (sensor_id == SAPI_NO_SENSOR)
+	{
+		return SAPI_NO_SENSOR;
+	}
+	sapi_register_samples(sensor_id, sapi_input_readsamples[indx]);
+
+	in = &sensor_inputs[indx];
+	in->pin = pin;
+	in->sensor_id = sensor_id;
+	in->edges = 0;
+	pinMode(pin, mode);
+	in->level = digitalRead(pin);
+	in->edge_ms = millis();
+	sensor_input_index++;
+
+	attachInterrupt(digitalPinToInterrupt(pin), sapi_input_isrs[indx], CHANGE);
+	sapi_input_filter(pin);
+	return sensor_id;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Register D10 and D11 if the configuration makes them inputs.
+//
+//////////////////////////////////////////////////////////////////////////
+void sapi_register_config_inputs(uint32_t frequency)
+{
+	if (Digital10 == 0)
+	{
+		(void)sapi_follow_config(sapi_register_input((char *)"DI10", D10, INPUT_PULLUP, frequency));
+	}
+	if (Digital11 == 0)
+	{
+		(void)sapi_follow_config(sapi_register_input((char *)"DI11", D11, INPUT_PULLUP, frequency));
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Switch D10 or D11 between output and input, from setValue. A pin
+// registered as an input only reports again once it is back to input.
+//
+//////////////////////////////////////////////////////////////////////////
+void sapi_input_mode(uint32_t pin, int mode)
+{
+	sensor_input_t *in = NULL;
+	uint8_t indx;
+
+	for (indx = 0; indx < sensor_input_index; indx++)
+	{
+		if (sensor_inputs[indx].pin == pin)
+		{
+			in = &sensor_inputs[indx];
+			break;
+		}
+	}
+
+	if (mode == 1)
+	{
+		if (in)
+			detachInterrupt(pin);
+		pinMode(pin, OUTPUT);
+		digitalWrite(pin, HIGH);
+	}
+	else if (mode == 0)
+	{
+		pinMode(pin, INPUT_PULLUP);
+		if (in)
+		{
+			in->level = digitalRead(pin);
+			in->edge_ms = millis();
+			attachInterrupt(pin, sapi_input_isrs[indx], CHANGE);
+			sapi_input_filter(pin);
+		}
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Park a GET "sens" on a split-phase read. A CON gets an empty ACK now, a
+// NON nothing, and the reading follows in a separate response.
+//
+//////////////////////////////////////////////////////////////////////////
+static error_t sapi_read_defer(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, uint8_t sensor_id)
+{
+	sensor_read_wait_t *w = &sensor_wait[sensor_id];
+
+	// One waiting GET per sensor
+	if (w->req)
+	{
+		rsp->code = COAP_RSP_503_SERV_UNAVAILABLE;
+		rsp->plen = 0;
+		return ERR_OK;
+	}
+	w->req = 1;
+	w->con = (req->type == COAP_T_CONF_VAL);
+	w->tkl = req->tkl;
+	memcpy(w->token, req->token, sizeof(w->token));
+
+	rsp->code = w->con ? COAP_EMPTY_MESSAGE : COAP_RSP_101_SILENT_IGN;
+	rsp->plen = 0;
+	return ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// ACK of a separate response, nothing to do but stop the retransmissions.
+//
+//////////////////////////////////////////////////////////////////////////
+static error_t sapi_read_acked(void *cbctx, struct mbuf *m)
+{
+	return ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Start a separate response to the request with token tkl/token, in a new
+// message.
+//
+//////////////////////////////////////////////////////////////////////////
+static error_t sapi_separate_init(struct coap_msg_ctx *rsp, uint8_t con, uint8_t tkl, const uint8_t *token)
+{
+	struct mbuf *m;
+
+	memset(rsp, 0, sizeof(*rsp));
+	copt_init((sl_co*)&(rsp->oh));
+
+	if (!(m = m_gethdr()))
+	{
+		return ERR_NO_MEM;
+	}
+	m_reserve(m, COAP_RSP_HEADROOM);
+
+	rsp->msg = m;
+	rsp->type = con ? COAP_T_CONF_VAL : COAP_T_NCONF_VAL;
+	rsp->mid = get_mid_val();
+	rsp->tkl = tkl;
+	memcpy(rsp->token, token, sizeof(rsp->token));
+	rsp->final = 1;
+	return ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Queue a separate response for the mNIC like a notification. The caller
+// frees rsp->msg if it fails.
+//
+//////////////////////////////////////////////////////////////////////////
+static error_t sapi_separate_send(struct coap_msg_ctx *rsp)
+{
+	coap_ack_cb_info_t cbi;
+	error_t rc;
+
+	if ((rc = coap_msg_response(rsp)) != ERR_OK)
+	{
+		return rc;
+	}
+	if (rsp->type == COAP_T_CONF_VAL)
+	{
+		cbi.cb = sapi_read_acked;
+		cbi.cbctx = NULL;
+		coap_con_add(rsp->mid, &cbi, rsp->msg, OBS_Q_NO_OBSERVER);
+	}
+	if ((rc = obs_q_add(rsp->msg, OBS_Q_NO_OBSERVER, 0)) != ERR_OK)
+	{
+		return rc;
+	}
+	copt_del_all((sl_co*)&(rsp->oh));
+
+	/* Notify milli nic of the response, with the others queued */
+	obs_q_wake(0);
+	return ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Send the separate response to the GET parked on a split-phase read.
+//
+//////////////////////////////////////////////////////////////////////////
+static error_t sapi_read_respond(uint8_t sensor_id, uint8_t fail_code)
+{
+	sensor_read_wait_t *w = &sensor_wait[sensor_id];
+	sensor_cache_t *c = &sensor_cache[sensor_id];
+	struct optlv etag = { COAP_OPTION_ETAG, sizeof(c->etag), c->etag };
+	struct coap_msg_ctx rsp;
+	struct mbuf *m;
+	uint8_t len = 0;
+	error_t rc;
+
+	w->req = 0;
+	if ((rc = sapi_separate_init(&rsp, w->con, w->tkl, w->token)) != ERR_OK)
+	{
+		return rc;
+	}
+	m = rsp.msg;
+
+	if (c->valid && sapi_cache_rsp(m, &len, sensor_id) == ERR_OK)
+	{
+		c->hit = 1;
+		(void)copt_add_opt((sl_co*)&(rsp.oh), &etag);
+		rsp.plen = len;
+		rsp.cf = sensor_info[sensor_id].readsamples ? COAP_CF_APPLICATION_CBOR : COAP_CF_CSV;
+		rsp.code = COAP_RSP_205_CONTENT;
+	}
+	else
+	{
+		rsp.code = fail_code;
+	}
+
+	if ((rc = sapi_separate_send(&rsp)) != ERR_OK)
+	{
+		DLOG_ERR("Separate response failed for sensor: %s", sensor_info[sensor_id].devicetype);
+		copt_del_all((sl_co*)&(rsp.oh));
+		m_free(rsp.msg);
+	}
+	return rc;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// End a split-phase read, into the cache and out to whoever waits for it.
+//
+//////////////////////////////////////////////////////////////////////////
+static void sapi_read_done(uint8_t sensor_id, sapi_error_t rcode, const char *payload, uint8_t len, uint8_t fail_code)
+{
+	sensor_read_wait_t *w = &sensor_wait[sensor_id];
+
+	if (fail_code == COAP_RSP_504_GATEWAY_TIMEOUT)
+	{
+		sensor_stats[sensor_id].timeouts++;
+	}
+	else
+	{
+		sapi_stats_read(sensor_id, rcode, (millis() - w->start_ms) * 1000UL);
+	}
+	w->busy = 0;
+	sapi_cache_store(sensor_id, rcode, payload, len);
+	if (w->req)
+	{
+		(void)sapi_read_respond(sensor_id, fail_code);
+	}
+	if (w->obs)
+	{
+		// Served from the cache by sapi_observation_handler
+		(void)coap_observe_rsp(sensor_info[sensor_id].observer_id);
+		w->obs = 0;
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Function used to report the end of a split-phase read.
+//
+//////////////////////////////////////////////////////////////////////////
+sapi_error_t sapi_read_complete(uint8_t sensor_id, sapi_error_t rcode, const char *payload, uint16_t len)
+{
+	if (sensor_id >= sensor_info_index || !sensor_wait[sensor_id].busy)
+		return SAPI_ERR_NO_ENTRY;
+
+	// The cache length is a byte
+	if (len >= SAPI_MAX_PAYLOAD_LEN || (len && !payload))
+	{
+		rcode = SAPI_ERR_BAD_DATA;
+		len = 0;
+	}
+	DLOG_DEBUG("Read complete for sensor: %s status: %d", sensor_info[sensor_id].devicetype, rcode);
+	sapi_read_done(sensor_id, rcode, payload, len, COAP_RSP_500_INTERNAL_ERROR);
+	return SAPI_ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Fail split-phase reads and the exchange the sensor never completed.
+// Called from sapi_run.
+//
+//////////////////////////////////////////////////////////////////////////
+void sapi_read_poll()
+{
+	for (uint8_t indx = 0 ; indx < sensor_info_index ; indx++)
+	{
+		if (sensor_wait[indx].busy && (uint32_t)(millis() - sensor_wait[indx].start_ms) >= SAPI_READ_TIMEOUT_MS)
+		{
+			DLOG_ERR("Read timed out for sensor: %s", sensor_info[indx].devicetype);
+			sapi_read_done(indx, SAPI_ERR_FAIL, NULL, 0, COAP_RSP_504_GATEWAY_TIMEOUT);
+		}
+	}
+	if (sensor_xchg.busy && (uint32_t)(millis() - sensor_xchg.start_ms) >= SAPI_EXCHANGE_TIMEOUT_MS)
+	{
+		DLOG_ERR("Exchange timed out for sensor: %s", sensor_info[sensor_xchg.sensor_id].devicetype);
+		(void)sapi_exchange_respond(COAP_RSP_504_GATEWAY_TIMEOUT, NULL, 0);
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// POST, or PUT ?xchg, {classifier}/<sensor> with a CBOR request for the
+// device behind the sensor. Started by its exchange callback, a CON gets
+// an empty ACK now, a NON nothing, and the answer follows in a separate
+// response.
+//
+//////////////////////////////////////////////////////////////////////////
+static error_t sapi_exchange_start(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, uint8_t sensor_id)
+{
+	SensorExchangeFuncPtr pExchange = sensor_info[sensor_id].exchange;
+	sensor_exchange_wait_t *w = &sensor_xchg;
+	sapi_error_t rcode;
+
+	if (!pExchange)
+	{
+		rsp->code = COAP_RSP_501_NOT_IMPLEMENTED;
+		goto err;
+	}
+	if (req->cf != COAP_CF_APPLICATION_CBOR || !req->plen)
+	{
+		rsp->code = COAP_RSP_415_UNSUPPORTED_CFORMAT;
+		goto err;
+	}
+	if (w->busy)
+	{
+		rsp->code = COAP_RSP_503_SERV_UNAVAILABLE;
+		goto err;
+	}
+
+	rcode = (*pExchange)(mtod(req->msg, uint8_t *) + req->hdrlen, req->plen);
+	DLOG_DEBUG("Exchange for sensor: %s status: %d", sensor_info[sensor_id].devicetype, rcode);
+	if (rcode != SAPI_ERR_OK)
+	{
+		rsp->code = (rcode == SAPI_ERR_BAD_DATA) ? COAP_RSP_400_BAD_REQUEST :
+		            (rcode == SAPI_ERR_IN_PROGRESS) ? COAP_RSP_503_SERV_UNAVAILABLE : COAP_RSP_500_INTERNAL_ERROR;
+		goto err;
+	}
+	w->busy = 1;
+	w->sensor_id = sensor_id;
+	w->start_ms = millis();
+	w->con = (req->type == COAP_T_CONF_VAL);
+	w->tkl = req->tkl;
+	memcpy(w->token, req->token, sizeof(w->token));
+
+	rsp->code = w->con ? COAP_EMPTY_MESSAGE : COAP_RSP_101_SILENT_IGN;
+err:
+	rsp->plen = 0;
+	return ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// End the exchange, its answer or code in a separate response.
+//
+//////////////////////////////////////////////////////////////////////////
+static error_t sapi_exchange_respond(uint8_t code, const uint8_t *payload, uint16_t len)
+{
+	sensor_exchange_wait_t *w = &sensor_xchg;
+	struct coap_msg_ctx rsp;
+	uint8_t *p;
+	error_t rc;
+
+	w->busy = 0;
+	if ((rc = sapi_separate_init(&rsp, w->con, w->tkl, w->token)) != ERR_OK)
+	{
+		return rc;
+	}
+	rsp.code = code;
+	if (len)
+	{
+		if (!(p = (uint8_t *) m_append(rsp.msg, len)))
+		{
+			rc = ERR_NO_MEM;
+			goto error;
+		}
+		memcpy(p, payload, len);
+		rsp.plen = len;
+		rsp.cf = COAP_CF_APPLICATION_CBOR;
+	}
+
+	if ((rc = sapi_separate_send(&rsp)) == ERR_OK)
+	{
+		return rc;
+	}
+error:
+	DLOG_ERR("Exchange response failed for sensor: %s", sensor_info[w->sensor_id].devicetype);
+	copt_del_all((sl_co*)&(rsp.oh));
+	m_free(rsp.msg);
+	return rc;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Function used to report the answer to an exchange.
+//
+//////////////////////////////////////////////////////////////////////////
+sapi_error_t sapi_exchange_complete(sapi_error_t rcode, const uint8_t *payload, uint16_t len)
+{
+	if (!sensor_xchg.busy)
+		return SAPI_ERR_NO_ENTRY;
+
+	if (len > SAPI_MAX_PAYLOAD_LEN || (len && !payload))
+	{
+		rcode = SAPI_ERR_BAD_DATA;
+	}
+	DLOG_DEBUG("Exchange complete for sensor: %s status: %d", sensor_info[sensor_xchg.sensor_id].devicetype, rcode);
+	if (rcode != SAPI_ERR_OK)
+	{
+		(void)sapi_exchange_respond(COAP_RSP_500_INTERNAL_ERROR, NULL, 0);
+	}
+	else
+	{
+		(void)sapi_exchange_respond(COAP_RSP_204_CHANGED, payload, len);
+	}
+	return SAPI_ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// GET {classifier}/all?sens. Every registered sensor in one CBOR response,
+// {0:"all",1:{"<type>":<reading>,...}}, one round trip instead of one per
+// sensor. A reading is the sensor's CBOR samples map or its text, from the
+// cache inside Max-Age, undefined if the read failed.
+//
+//////////////////////////////////////////////////////////////////////////
+static error_t crsapi_aggregate(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, void *it)
+{
+	struct optlv *o;
+	struct cbor_buf cbuf;
+	sensor_cache_t *c;
+	uint8_t indx;
+	int rc;
+
+	if (copt_get_next_opt_type((const sl_co*)&(req->oh), COAP_OPTION_URI_PATH, &it))
+	{
+		rsp->code = COAP_RSP_404_NOT_FOUND;
+		goto err;
+	}
+	if (req->code != COAP_REQUEST_GET)
+	{
+		rsp->code = COAP_RSP_405_METHOD_NOT_ALLOWED;
+		goto err;
+	}
+	o = copt_get_next_opt_type((const sl_co*)&(req->oh), COAP_OPTION_URI_QUERY, NULL);
+	if (!o || coap_opt_strcmp(o, "sens"))
+	{
+		rsp->code = COAP_RSP_501_NOT_IMPLEMENTED;
+		goto err;
+	}
+
+	// Not observable, observe each sensor instead
+	copt_del_opt_type((sl_co*)&(rsp->oh), COAP_OPTION_OBSERVE);
+
+	// Encode straight into the response mbuf
+	cbor_enc_init(&cbuf, mtod(rsp->msg, uint8_t *) + rsp->msg->len, M_TRAILINGSPACE(rsp->msg));
+	rc = cbor_enc_nic_type(&cbuf, (char *)SAPI_AGGREGATE_URI) || cbor_enc_map(&cbuf, sensor_info_index);
+	for (indx = 0; indx < sensor_info_index && !rc; indx++)
+	{
+		c = &sensor_cache[indx];
+		if (!sapi_cache_fresh(indx))
+		{
+			(void)sapi_cache_read(indx);
+		}
+		c->hit = 1;
+
+		rc = cbor_enc_text(&cbuf, sensor_info[indx].devicetype, strlen(sensor_info[indx].devicetype));
+		if (rc)
+		{
+			break;
+		}
+		if (!c->valid)
+		{
+			cbor_enc_prim_undef(&cbuf);
+			rc = cbuf.err ? CBOR_ERR : CBOR_OK;
+		}
+		else if (sensor_info[indx].readsamples)
+		{
+			// Already a CBOR item
+			if (c->len > cbuf.tail - cbuf.next)
+			{
+				rc = CBOR_ERR;
+				break;
+			}
+			memcpy(cbuf.next, c->payload, c->len);
+			cbuf.next += c->len;
+		}
+		else
+		{
+			rc = cbor_enc_text(&cbuf, c->payload, c->len);
+		}
+	}
+	if (rc)
+	{
+		DLOG_ERR("Aggregate read over %d bytes", M_TRAILINGSPACE(rsp->msg));
+		rsp->code = COAP_RSP_500_INTERNAL_ERROR;
+		goto err;
+	}
+
+	rsp->plen = cbor_buf_get_len(&cbuf);
+	(void)m_append(rsp->msg, rsp->plen);
+	rsp->cf = COAP_CF_APPLICATION_CBOR;
+	rsp->code = COAP_RSP_205_CONTENT;
+	return ERR_OK;
+
+err:
+	rsp->plen = 0;
+	return ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Sensor CoAP Server Dispatcher.
+//
+//////////////////////////////////////////////////////////////////////////
+error_t crsapi( struct coap_msg_ctx *req, struct coap_msg_ctx *rsp )
+{
+	struct optlv *o;
+	void *it = NULL;
+	error_t rc;
+
+	// Isolate the leaf of the URI. Do this by skipping the first part of the URI.
+	copt_get_next_opt_type((const sl_co*) & (req->oh), COAP_OPTION_URI_PATH, &it);
+	if ((o = copt_get_next_opt_type((const sl_co*) & (req->oh), COAP_OPTION_URI_PATH, &it)))
+	{
+		// Look the device type up in the sensor registration table.
+		// When found dispatch its resource handler.
+		uint8_t indx = sapi_find_sensor((const char *)o->ov, o->ol);
+		if (indx != SAPI_NO_SENSOR)
+		{
+			rc = crresourcehandler(req, rsp, it, indx);
+			return rc;
+		}
+		if (!coap_opt_strcmp(o, SAPI_AGGREGATE_URI))
+		{
+			return crsapi_aggregate(req, rsp, it);
+		}
+
+		// No URI path is supported, so reject with not found
+		rsp->code = COAP_RSP_404_NOT_FOUND;
+	}
+
+	rsp->plen = 0;
+	return ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Parse the Uri-Query options after the first ("sens"): n=<count>,
+// since=<epoch>, fmt=csv|cbor, log. Returns how many there are, -1 for an
+// unknown key or a bad value.
+//
+//////////////////////////////////////////////////////////////////////////
+static int sapi_parse_query(struct coap_msg_ctx *req, sapi_query_t *query)
+{
+	struct coap_query q;
+	void *it = NULL;
+	uint32_t v;
+	int nq = 0;
+
+	memset(query, 0, sizeof(sapi_query_t));
+	if (!coap_query_next(req, &it, &q))
+	{
+		return 0;
+	}
+	while (coap_query_next(req, &it, &q))
+	{
+		if (!coap_query_key(&q, "n"))
+		{
+			if (coap_query_uint(&q, &v) || v > UINT16_MAX)
+				return -1;
+			query->n = v;
+		}
+		else if (!coap_query_key(&q, "since"))
+		{
+			if (coap_query_uint(&q, &v))
+				return -1;
+			query->since = v;
+		}
+		else if (!coap_query_key(&q, "log"))
+		{
+			if (q.val)
+				return -1;
+			query->log = 1;
+		}
+		else if (!coap_query_key(&q, "fmt"))
+		{
+			if (!coap_query_val(&q, "csv"))
+				query->fmt = SAPI_FMT_CSV;
+			else if (!coap_query_val(&q, "cbor"))
+				query->fmt = SAPI_FMT_CBOR;
+			else if (!coap_query_val(&q, "blk"))
+				query->fmt = SAPI_FMT_BLK;
+			else
+				return -1;
+		}
+		else
+		{
+			return -1;
+		}
+		nq++;
+	}
+	return nq;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// GET "sens" with query parameters. Samples sensors are sliced here, others
+// need a query read callback for n= and since=. Not cached, and not
+// observable.
+//
+//////////////////////////////////////////////////////////////////////////
+static error_t sapi_read_query(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, const sapi_query_t *query, uint8_t sensor_id)
+{
+	char *payload = (char *) scratch_alloc(SAPI_MAX_PAYLOAD_LEN);
+	uint8_t payloadlen = 0;
+	uint8_t len = 0;
+	uint8_t cbor = false;
+	char *p;
+	uint32_t start_us;
+	sapi_error_t rcode;
+	error_t rc;
+
+	copt_del_opt_type((sl_co*)&(rsp->oh), COAP_OPTION_OBSERVE);
+
+	if (!payload)
+	{
+		rsp->code = COAP_RSP_500_INTERNAL_ERROR;
+		goto err;
+	}
+
+	start_us = micros();
+	if (query->log)
+	{
+		rcode = sensor_info[sensor_id].sampler ? sapi_backlog_read_log(sensor_id, query, payload, &payloadlen) :
+				SAPI_ERR_NOT_IMPLEMENTED;
+		cbor = (query->fmt != SAPI_FMT_CSV);
+	}
+	else if (sensor_info[sensor_id].readsamples)
+	{
+		rcode = sapi_read_samples(sensor_id, query, payload, &payloadlen);
+		cbor = (query->fmt != SAPI_FMT_CSV);
+	}
+	else if (query->fmt == SAPI_FMT_BLK)
+	{
+		// Only samples go in blocks
+		rcode = SAPI_ERR_BAD_DATA;
+	}
+	else if (sensor_info[sensor_id].readquery)
+	{
+		rcode = (*sensor_info[sensor_id].readquery)(query, payload, &payloadlen);
+	}
+	else if (!query->n && !query->since)
+	{
+		rcode = sapi_read_text(sensor_id, payload, &payloadlen);
+	}
+	else
+	{
+		rsp->code = COAP_RSP_501_NOT_IMPLEMENTED;
+		goto err;
+	}
+	sapi_stats_read(sensor_id, rcode, micros() - start_us);
+
+	if (rcode != SAPI_ERR_OK)
+	{
+		rsp->code = (rcode == SAPI_ERR_BAD_DATA) ? COAP_RSP_406_NOT_ACCEPTABLE : 
+					(rcode == SAPI_ERR_NOT_IMPLEMENTED) ? COAP_RSP_501_NOT_IMPLEMENTED : COAP_RSP_500_INTERNAL_ERROR;
+		goto err;
+	}
+
+	if (cbor || query->fmt == SAPI_FMT_CSV)
+	{
+		// CBOR samples or plain text, as is
+		if (!(p = (char *) m_append(rsp->msg, payloadlen)))
+		{
+			rsp->code = COAP_RSP_500_INTERNAL_ERROR;
+			goto err;
+		}
+		memcpy(p, payload, payloadlen);
+		len = payloadlen;
+	}
+	else
+	{
+		// Text in the CBOR wrapper, as without a query
+		rc = build_rsp_msg(rsp->msg, &len, payload, payloadlen, sensor_id);
+		if (rc != ERR_OK)
+		{
+			rsp->code = COAP_RSP_500_INTERNAL_ERROR;
+			goto err;
+		}
+		cbor = (query->fmt == SAPI_FMT_CBOR);
+	}
+
+	rsp->plen = len;
+	rsp->cf = cbor ? COAP_CF_APPLICATION_CBOR : COAP_CF_CSV;
+	rsp->code = COAP_RSP_205_CONTENT;
+	return ERR_OK;
+
+err:
+	rsp->plen = 0;
+	return ERR_OK;
+}
+
+
+// Data type of a cal=<datatype> query, -1 for a bad one
+static int sapi_cal_query(struct coap_msg_ctx *req)
+{
+	struct coap_query q;
+	void *it = NULL;
+	uint32_t v;
+
+	if (!coap_query_next(req, &it, &q) || coap_query_key(&q, SAPI_CAL_QUERY) || coap_query_uint(&q, &v) || v > 0xFF)
+		return -1;
+	return v;
+}
+
+
+// A breakpoint value of a calibration PUT, an integer or a float, to Q16.16
+static int sapi_cal_dec(struct cbor_buf *cbuf, int32_t *q16)
+{
+	float f;
+	int i;
+
+	switch (cbor_dec_major_type(cbuf))
+	{
+	case CBOR_TYPE_UINT:
+	case CBOR_TYPE_NINT:
+		if (cbor_dec_int(cbuf, &i) != CBOR_OK)
+			return -1;
+		f = i;
+		break;
+	case CBOR_TYPE_PRIMITIVE:
+		if (cbor_dec_prim_float32(cbuf, &f) != CBOR_OK)
+			return -1;
+		break;
+	default:
+		return -1;
+	}
+	if (!(f > -32768.0f && f < 32768.0f))
+		return -1;
+	*q16 = (int32_t)(f * 65536.0f + (f < 0 ? -0.5f : 0.5f));
+	return 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// GET cal=<datatype>, the calibration table of a datatype as a CBOR array
+// of [raw, eng] pairs, floats.
+//
+//////////////////////////////////////////////////////////////////////////
+static error_t sapi_read_cal(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, uint8_t sensor_id)
 {
-	// Initialize Sensor
-	SensorInitFuncPtr pInitFunc = sensor_info[sensor_id].init;
-	sapi_error_t rcode = (*pInitFunc)();
-	
-	return rcode;
+	int datatype = sapi_cal_query(req);
+	int size = 1 + SAPI_CAL_POINTS * 11;
+	const struct cal *c;
+	struct cbor_buf cbuf;
+	uint8_t *p;
+	int used;
+
+	copt_del_opt_type((sl_co*)&(rsp->oh), COAP_OPTION_OBSERVE);
+
+	if (datatype < 0)
+	{
+		rsp->code = COAP_RSP_400_BAD_REQUEST;
+		goto err;
+	}
+	if (!(c = cal_find(sensor_id, datatype)))
+	{
+		rsp->code = COAP_RSP_404_NOT_FOUND;
+		goto err;
+	}
+	if (!(p = (uint8_t *) m_append(rsp->msg, size)))
+	{
+		rsp->code = COAP_RSP_500_INTERNAL_ERROR;
+		goto err;
+	}
+	cbor_enc_init(&cbuf, p, size);
+	(void)cbor_enc_array(&cbuf, c->n);
+	for (uint8_t i = 0; i < c->n; i++)
+	{
+		(void)cbor_enc_array(&cbuf, 2);
+		(void)cbor_enc_prim_float32(&cbuf, c->pt[i].raw / 65536.0f);
+		(void)cbor_enc_prim_float32(&cbuf, c->pt[i].eng / 65536.0f);
+	}
+	used = cbor_buf_get_len(&cbuf);
+	m_adj(rsp->msg, used - size);
+
+	rsp->plen = used;
+	rsp->cf = COAP_CF_APPLICATION_CBOR;
+	rsp->code = COAP_RSP_205_CONTENT;
+	return ERR_OK;
+
+err:
+	rsp->plen = 0;
+	return ERR_OK;
 }
 
 
 //////////////////////////////////////////////////////////////////////////
 //
-// Function used to push a notification.
+// GET schema, the schema document of a sensor's samples, {0:"<sensor
+// type>",4:<Id>,1:[[<datatype>,"<unit>"],...]}, see sapi_set_schema.
 //
 //////////////////////////////////////////////////////////////////////////
-sapi_error_t sapi_push_notification(uint8_t sensor_id)
+static error_t sapi_read_schema(struct coap_msg_ctx *rsp, uint8_t sensor_id)
 {
-	// Simple here. Just make the call. Heavy lifting is done in the CoAP Server
-	// Does the milli hardware handshake if needed.
-	error_t rc = coap_observe_rsp(sensor_info[sensor_id].observer_id);
+	const sensor_schema_t *sc = sapi_schema_find(sensor_id);
+	char *type = sensor_info[sensor_id].devicetype;
+	int size = 8 + strlen(type) + SAPI_SCHEMA_ID_LEN + SAPI_SCHEMA_ENC_MAX;
+	struct cbor_buf cbuf;
+	uint8_t *p;
+	int used;
 
-	if (rc == ERR_NO_ENTRY)
-		return SAPI_ERR_NO_ENTRY;
-	if (rc == ERR_NO_MEM)
-		return SAPI_ERR_NO_MEM;
-	
+	copt_del_opt_type((sl_co*)&(rsp->oh), COAP_OPTION_OBSERVE);
+
+	if (!sc)
+	{
+		rsp->code = COAP_RSP_404_NOT_FOUND;
+		goto err;
+	}
+	if (!(p = (uint8_t *) m_append(rsp->msg, size)))
+	{
+		rsp->code = COAP_RSP_500_INTERNAL_ERROR;
+		goto err;
+	}
+	cbor_enc_init(&cbuf, p, size);
+	if (cbor_enc_nic_type_schema(&cbuf, type, sc->id, NULL, false) || sapi_schema_enc_fields(&cbuf, sc->field, sc->n))
+	{
+		m_adj(rsp->msg, -size);
+		rsp->code = COAP_RSP_500_INTERNAL_ERROR;
+		goto err;
+	}
+	used = cbor_buf_get_len(&cbuf);
+	m_adj(rsp->msg, used - size);
+
+	rsp->plen = used;
+	rsp->cf = COAP_CF_APPLICATION_CBOR;
+	rsp->code = COAP_RSP_205_CONTENT;
+	return ERR_OK;
+
+err:
+	rsp->plen = 0;
+	return ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// PUT cal=<datatype> with a CBOR array of [raw, eng] pairs, raw ascending,
+// sets the calibration of a datatype, see sapi_set_calibration. An empty
+// array removes it.
+//
+//////////////////////////////////////////////////////////////////////////
+static error_t sapi_write_cal(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, uint8_t sensor_id)
+{
+	sapi_cal_point_t pt[SAPI_CAL_POINTS];
+	int datatype = sapi_cal_query(req);
+	struct cbor_buf cbuf;
+	sapi_error_t rcode;
+	int n, i;
+
+	cbor_dec_init(&cbuf, mtod(req->msg, char *) + req->hdrlen, req->plen);
+	if (datatype < 0 || req->cf != COAP_CF_APPLICATION_CBOR || cbor_dec_well_formed(&cbuf) != CBOR_OK)
+	{
+		rsp->code = COAP_RSP_400_BAD_REQUEST;
+		goto err;
+	}
+	cbor_dec_init(&cbuf, mtod(req->msg, char *) + req->hdrlen, req->plen);
+	n = cbor_dec_array(&cbuf);
+	if (n == CBOR_ERR || n == CBOR_DEC_INDEF || n > SAPI_CAL_POINTS)
+	{
+		rsp->code = COAP_RSP_406_NOT_ACCEPTABLE;
+		goto err;
+	}
+	for (i = 0; i < n; i++)
+	{
+		if (cbor_dec_array(&cbuf) != 2 || sapi_cal_dec(&cbuf, &pt[i].raw) || sapi_cal_dec(&cbuf, &pt[i].eng))
+		{
+			rsp->code = COAP_RSP_406_NOT_ACCEPTABLE;
+			goto err;
+		}
+	}
+
+	rcode = sapi_set_calibration(sensor_id, datatype, pt, n);
+	rsp->code = (rcode == SAPI_ERR_OK) ? COAP_RSP_204_CHANGED :
+				(rcode == SAPI_ERR_BAD_DATA) ? COAP_RSP_406_NOT_ACCEPTABLE :
+				(rcode == SAPI_ERR_NO_ENTRY) ? COAP_RSP_501_NOT_IMPLEMENTED : COAP_RSP_500_INTERNAL_ERROR;
+
+err:
+	rsp->plen = 0;
+	return ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// GET "sens" of a sensor with a block read callback, one Block2 block per
+// request. The block is read straight into the response, unwrapped.
+//
+//////////////////////////////////////////////////////////////////////////
+static error_t sapi_read_block(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, uint8_t sensor_id)
+{
+	struct coap_block blk = { 0, 0, COAP_BLOCK_SZX_MAX };
+	uint16_t size;
+	uint16_t len;
+	uint8_t szx;
+	char *p;
+	SensorReadBlockFuncPtr pReadBlock = sensor_info[sensor_id].readblk;
+	sapi_error_t rcode;
+
+	if (coap_block_get(req, COAP_OPTION_BLOCK2, &blk) < 0)
+	{
+		rsp->code = COAP_RSP_400_BAD_REQUEST;
+		goto err;
+	}
+
+	// Use smaller blocks than asked for if they don't fit a message, same offset
+	szx = coap_block_szx(blk.szx);
+	blk.num <<= blk.szx - szx;
+	blk.szx = szx;
+	size = COAP_BLOCK_SIZE(szx);
+
+	if (!(p = (char *) m_append(rsp->msg, size)))
+	{
+		rsp->code = COAP_RSP_500_INTERNAL_ERROR;
+		goto err;
+	}
+	len = size;
+	blk.m = 0;
+	rcode = (*pReadBlock)(p, blk.num * size, &len, &blk.m);
+	if (rcode != SAPI_ERR_OK || len > size)
+	{
+		m_adj(rsp->msg, -size);
+		rsp->code = (rcode == SAPI_ERR_BAD_DATA) ? COAP_RSP_406_NOT_ACCEPTABLE : COAP_RSP_500_INTERNAL_ERROR;
+		goto err;
+	}
+	m_adj(rsp->msg, -(size - len));
+
+	// Past the end of the payload
+	if (!len && blk.num)
+	{
+		rsp->code = COAP_RSP_402_BAD_OPTION;
+		goto err;
+	}
+	// Only the last block may be short
+	if (len < size)
+	{
+		blk.m = 0;
+	}
+	if (coap_block_set(rsp, COAP_OPTION_BLOCK2, &blk) != ERR_OK)
+	{
+		m_adj(rsp->msg, -len);
+		rsp->code = COAP_RSP_500_INTERNAL_ERROR;
+		goto err;
+	}
+
+	DLOG_DEBUG("sapi_read_block: num: %lu szx: %d len: %d more: %d", blk.num, blk.szx, len, blk.m);
+	rsp->plen = len;
+	rsp->cf = COAP_CF_CSV;
+	rsp->code = COAP_RSP_205_CONTENT;
+	return ERR_OK;
+
+err:
+	rsp->plen = 0;
+	return ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// PUT with a Block1 option, the request payload is handed to the sensor's
+// block write callback block by block, in order.
+//
+//////////////////////////////////////////////////////////////////////////
+static error_t sapi_write_block(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, struct coap_block *blk, uint8_t sensor_id)
+{
+	SensorWriteBlockFuncPtr pWriteBlock = sensor_info[sensor_id].writeblk;
+	uint32_t off = blk->num * COAP_BLOCK_SIZE(blk->szx);
+	sapi_error_t rcode;
+
+	if (!pWriteBlock)
+	{
+		rsp->code = COAP_RSP_501_NOT_IMPLEMENTED;
+		goto err;
+	}
+
+	// A transfer starts at block 0 and must not skip blocks
+	if (blk->num && off != sensor_info[sensor_id].blk1_next)
+	{
+		rsp->code = COAP_RSP_408_REQ_INCOMPLETE;
+		goto err;
+	}
+	if (blk->m && req->plen != COAP_BLOCK_SIZE(blk->szx))
+	{
+		rsp->code = COAP_RSP_400_BAD_REQUEST;
+		goto err;
+	}
+
+	rcode = (*pWriteBlock)(mtod(req->msg, char *) + req->hdrlen, off, req->plen, blk->m);
+	sensor_info[sensor_id].blk1_next = 0;
+	if (rcode == SAPI_ERR_NOT_IMPLEMENTED)
+	{
+		rsp->code = COAP_RSP_501_NOT_IMPLEMENTED;
+		goto err;
+	}
+	else if (rcode == SAPI_ERR_BAD_DATA)
+	{
+		rsp->code = COAP_RSP_406_NOT_ACCEPTABLE;
+		goto err;
+	}
+	else if (rcode != SAPI_ERR_OK)
+	{
+		rsp->code = COAP_RSP_500_INTERNAL_ERROR;
+		goto err;
+	}
+
+	// Echo the block, 2.31 Continue asks for the next one
+	if (blk->m)
+	{
+		sensor_info[sensor_id].blk1_next = off + req->plen;
+	}
+	if (coap_block_set(rsp, COAP_OPTION_BLOCK1, blk) != ERR_OK)
+	{
+		rsp->code = COAP_RSP_500_INTERNAL_ERROR;
+		goto err;
+	}
+	rsp->code = blk->m ? COAP_RSP_231_CONTINUE : COAP_RSP_204_CHANGED;
+
+err:
+	rsp->plen = 0;
+	return ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Timed relay commands, /sys/relay. The payload is a CBOR array of
+// [<epoch>,<action>], action the relay switched on, 1 or 2, or negative
+// for off. POST adds them to the queue, PUT replaces it, DELETE empties
+// it and GET gives it, soonest first. One that is late runs at once.
+// A batch that does not fit is refused whole with 4.13.
+//
+//////////////////////////////////////////////////////////////////////////
+error_t sapi_relay_rsp(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, void *it)
+{
+	struct cbor_buf cbuf;
+
+	rsp->plen = 0;
+	switch (req->code)
+	{
+	case COAP_REQUEST_GET:
+		cbor_enc_init(&cbuf, mtod(rsp->msg, uint8_t *) + rsp->msg->len, M_TRAILINGSPACE(rsp->msg));
+		if (relay_q_enc(&cbuf) != CBOR_OK)
+		{
+			rsp->code = COAP_RSP_500_INTERNAL_ERROR;
+			return ERR_OK;
+		}
+		rsp->plen = cbor_buf_get_len(&cbuf);
+		(void)m_append(rsp->msg, rsp->plen);
+		rsp->cf = COAP_CF_APPLICATION_CBOR;
+		rsp->code = COAP_RSP_205_CONTENT;
+		return ERR_OK;
+
+	case COAP_REQUEST_DELETE:
+		relay_q_clear();
+		rsp->code = COAP_RSP_202_DELETED;
+		return ERR_OK;
+
+	case COAP_REQUEST_PUT:
+	case COAP_REQUEST_POST:
+		rsp->code = relay_q_put(mtod(req->msg, uint8_t *) + req->hdrlen, req->plen, req->code == COAP_REQUEST_PUT);
+		return ERR_OK;
+
+	default:
+		rsp->code = COAP_RSP_405_METHOD_NOT_ALLOWED;
+		return ERR_OK;
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Decode one "<name>":<value> entry of a CBOR configuration map.
+//
+//////////////////////////////////////////////////////////////////////////
+static sapi_error_t sapi_param_decode(struct cbor_buf *cbuf, sapi_param_t *param)
+{
+	const char *s;
+	int len;
+	int ival;
+
+	memset(param, 0, sizeof(sapi_param_t));
+	s = cbor_dec_text(cbuf, &len);
+	if (!s || len == 0 || len >= SAPI_PARAM_NAME_LEN)
+		return SAPI_ERR_BAD_DATA;
+	memcpy(param->name, s, len);
+
+	switch (cbor_dec_major_type(cbuf))
+	{
+	case CBOR_TYPE_UINT:
+	case CBOR_TYPE_NINT:
+		if (cbor_dec_int(cbuf, &ival) != CBOR_OK)
+			return SAPI_ERR_BAD_DATA;
+		param->type = SAPI_PARAM_INT;
+		param->v.i = ival;
+		break;
+	case CBOR_TYPE_TEXT:
+		s = cbor_dec_text(cbuf, &len);
+		if (!s || len >= SAPI_PARAM_TEXT_LEN)
+			return SAPI_ERR_BAD_DATA;
+		param->type = SAPI_PARAM_TEXT;
+		memcpy(param->text, s, len);
+		break;
+	case CBOR_TYPE_PRIMITIVE:
+		if (cbor_dec_prim_float32(cbuf, &param->v.f) == CBOR_OK)
+		{
+			param->type = SAPI_PARAM_FLOAT;
+			break;
+		}
+		ival = cbor_dec_primitive(cbuf);
+		if (ival != CBOR_PRIM_BOOL_FALSE && ival != CBOR_PRIM_BOOL_TRUE)
+			return SAPI_ERR_BAD_DATA;
+		param->type = SAPI_PARAM_BOOL;
+		param->v.i = (ival == CBOR_PRIM_BOOL_TRUE);
+		break;
+	default:
+		return SAPI_ERR_BAD_DATA;
+	}
 	return SAPI_ERR_OK;
 }
 
 
 //////////////////////////////////////////////////////////////////////////
 //
-// Sensor CoAP Server Dispatcher.
+// Check, or apply, a configuration parameter of a sensor without a write
+// callback. Applied through setValue, and logged to the flash, only if it
+// changes. Sets *retime when the sensor timing must follow.
 //
 //////////////////////////////////////////////////////////////////////////
-error_t crsapi( struct coap_msg_ctx *req, struct coap_msg_ctx *rsp )
+static sapi_error_t sapi_param_set(const sapi_param_t *param, uint8_t apply, uint8_t *retime)
 {
-	struct optlv *o;
-	void *it = NULL;
-	error_t rc;
+	uint8_t index = cfg_find(param->name, strlen(param->name));
 
-	// Isolate the leaf of the URI. Do this by skipping the first part of the URI.
-	copt_get_next_opt_type((const sl_co*) & (req->oh), COAP_OPTION_URI_PATH, &it);
-	if ((o = copt_get_next_opt_type((const sl_co*) & (req->oh), COAP_OPTION_URI_PATH, &it)))
+	if (index == CFG_COUNT || (param->type != SAPI_PARAM_INT && param->type != SAPI_PARAM_BOOL))
+		return SAPI_ERR_BAD_DATA;
+
+	if (!apply || *cfg_params[index].value == param->v.i)
+		return SAPI_ERR_OK;
+
+	cfg_apply(index, param->v.i);
+	*retime |= cfg_params[index].timing;
+	if (!cfg_log(index, param->v.i))
 	{
-		// Look through the sensor registration table looking for a match. Match on device type.
-		// When found dispatch its resource handler.
-		for (uint8_t indx = 0 ; indx < sensor_info_index ; indx++)
+		DLOG_ERR("Config not saved: %s", param->name);
+		return SAPI_ERR_FAIL;
+	}
+	return SAPI_ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// PUT "cfg" with a CBOR map payload, {"<name>":<value>,...}. Several
+// parameters are set in one message. The map is checked in full before the
+// first parameter is applied.
+//
+//////////////////////////////////////////////////////////////////////////
+static error_t sapi_write_params(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, uint8_t sensor_id)
+{
+	SensorWriteParamFuncPtr pWriteParam = sensor_info[sensor_id].writeparam;
+	struct cbor_buf cbuf;
+	sapi_param_t param;
+	sapi_error_t rcode = SAPI_ERR_OK;
+	uint8_t retime = 0;
+	uint8_t apply;
+	int n, i;
+
+	for (apply = 0; apply < 2 && rcode == SAPI_ERR_OK; apply++)
+	{
+		cbor_dec_init(&cbuf, mtod(req->msg, char *) + req->hdrlen, req->plen);
+		if (cbor_dec_well_formed(&cbuf) != CBOR_OK)
+		{
+			rsp->code = COAP_RSP_400_BAD_REQUEST;
+			goto err;
+		}
+		n = cbor_dec_map(&cbuf);
+		if (n == CBOR_ERR)
+		{
+			rsp->code = COAP_RSP_400_BAD_REQUEST;
+			goto err;
+		}
+		for (i = 0; rcode == SAPI_ERR_OK; i++)
 		{
-			if (!coap_opt_strcmp(o, sensor_info[indx].devicetype))
+			if (n == CBOR_DEC_INDEF ? cbor_dec_indef_break(&cbuf) : i >= n)
+				break;
+			rcode = sapi_param_decode(&cbuf, &param);
+			if (rcode == SAPI_ERR_OK && !pWriteParam)
+			{
+				rcode = sapi_param_set(&param, apply, &retime);
+			}
+			else if (rcode == SAPI_ERR_OK && apply)
 			{
-				rc = crresourcehandler(req, rsp, it, indx);
-				return rc;
+				rcode = (*pWriteParam)(&param);
 			}
+			if (apply)
+			{
+				DLOG_DEBUG("SAPI param %s: %d", param.name, rcode);
+			}
+		}
+		if (rcode == SAPI_ERR_OK && cbuf.next != cbuf.tail)
+		{
+			// Trailing data after the map
+			rcode = SAPI_ERR_BAD_DATA;
 		}
+	}
+	cfg_publish();
+	if (retime)
+	{
+		sapi_cfg_retime();
+	}
 
-		// No URI path is supported, so reject with not found
-		rsp->code = COAP_RSP_404_NOT_FOUND;
+	if (rcode == SAPI_ERR_OK)
+	{
+		// Config may change the reading
+		sensor_cache[sensor_id].valid = 0;
+		sensor_cache[sensor_id].hit = 0;
+		rsp->code = COAP_RSP_204_CHANGED;
+	}
+	else if (rcode == SAPI_ERR_NOT_IMPLEMENTED)
+	{
+		rsp->code = COAP_RSP_501_NOT_IMPLEMENTED;
+	}
+	else if (rcode == SAPI_ERR_BAD_DATA)
+	{
+		rsp->code = COAP_RSP_406_NOT_ACCEPTABLE;
+	}
+	else
+	{
+		rsp->code = COAP_RSP_500_INTERNAL_ERROR;
 	}
 
+err:
 	rsp->plen = 0;
 	return ERR_OK;
 }
@@ -518,10 +4544,44 @@ error_t crsapi( struct coap_msg_ctx *req, struct coap_msg_ctx *rsp )
 // SAPI CoAP Server resource handler.
 //
 //////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////////////////
+//
+// GET "cfg" of a sensor with a text write callback, the text written
+// straight into the response.
+//
+//////////////////////////////////////////////////////////////////////////
+static error_t sapi_read_cfg_txt(struct coap_msg_ctx *rsp, uint8_t sensor_id)
+{
+	uint16_t len = 0;
+
+	switch (build_rsp_txt(rsp->msg, &len, sensor_info[sensor_id].readcfgtxt, sensor_id))
+	{
+	case ERR_OK:
+		break;
+	case ERR_BAD_DATA:
+		rsp->code = COAP_RSP_406_NOT_ACCEPTABLE;
+		goto err;
+	default:
+		rsp->code = COAP_RSP_500_INTERNAL_ERROR;
+		goto err;
+	}
+
+	rsp->plen = len;
+	rsp->cf = sensor_info[sensor_id].readsamples ? COAP_CF_APPLICATION_CBOR : COAP_CF_CSV;
+	rsp->code = COAP_RSP_205_CONTENT;
+	return ERR_OK;
+
+err:
+	rsp->plen = 0;
+	return ERR_OK;
+}
+
+
 error_t crresourcehandler(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, void *it, uint8_t sensor_id)
 {
     struct optlv *o;
 	uint8_t obs = false;
+	uint8_t etag_match = false;
 
 
     /* No URI path beyond /temp is supported, so reject if present. */
@@ -532,12 +4592,21 @@ error_t crresourcehandler(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, vo
         goto err;
     }
 
-    /* All methods require a query, so return an error if missing. */
-    if (!(o = copt_get_next_opt_type((const sl_co*)&(req->oh), COAP_OPTION_URI_QUERY, NULL))) 
+    /* All methods require a query, so return an error if missing. A CBOR PUT carries its parameters in the payload. */
+    if (!(o = copt_get_next_opt_type((const sl_co*)&(req->oh), COAP_OPTION_URI_QUERY, NULL)) &&
+        !(req->code == COAP_REQUEST_PUT && req->cf == COAP_CF_APPLICATION_CBOR) &&
+        req->code != COAP_REQUEST_POST) 
     {
         rsp->code = COAP_RSP_405_METHOD_NOT_ALLOWED;
         goto err;
     }
+
+    /* A request passed through to the device, see sapi_exchange_start */
+    if (req->code == COAP_REQUEST_POST || 
+        (req->code == COAP_REQUEST_PUT && o && !coap_opt_strcmp(o, SAPI_EXCHANGE_QUERY)))
+    {
+        return sapi_exchange_start(req, rsp, sensor_id);
+    }
     
     /*
      * GET for reading sensor or config information
@@ -547,20 +4616,56 @@ error_t crresourcehandler(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, vo
         uint8_t rc;
         uint8_t len = 0;
 
+        // Get Config values - cfg query, written in place
+        if (!coap_opt_strcmp(o, "cfg") && sensor_info[sensor_id].readcfgtxt)
+        {
+            return sapi_read_cfg_txt(rsp, sensor_id);
+        }
         // Get Config values - cfg query
-        if (!coap_opt_strcmp(o, "cfg"))
+        else if (!coap_opt_strcmp(o, "cfg"))
         {
-            char payload[SAPI_MAX_PAYLOAD_LEN];
+            char *payload = (char *) scratch_alloc(SAPI_MAX_PAYLOAD_LEN);
             uint8_t payloadlen = 0;
             SensorReadCfgFuncPtr pReadCfgFunc = sensor_info[sensor_id].readcfg;
-            sapi_error_t rcode = (*pReadCfgFunc)(payload, &payloadlen);
+            sapi_error_t rcode = (payload && pReadCfgFunc) ? (*pReadCfgFunc)(payload, &payloadlen) :
+                                 payload ? SAPI_ERR_NOT_IMPLEMENTED : SAPI_ERR_NO_MEM;
             
+            if (rcode != SAPI_ERR_OK)
+            {
+                rsp->code = (rcode == SAPI_ERR_BAD_DATA) ? COAP_RSP_406_NOT_ACCEPTABLE :
+                            (rcode == SAPI_ERR_NOT_IMPLEMENTED) ? COAP_RSP_501_NOT_IMPLEMENTED : COAP_RSP_500_INTERNAL_ERROR;
+                goto err;
+            }
+
             // Assemble the CoAP response message
             rc = build_rsp_msg(rsp->msg, &len, payload, payloadlen, sensor_id);
         }
+		// Get the schema of the samples - schema query
+		else if (!coap_opt_strcmp(o, SAPI_SCHEMA_QUERY))
+		{
+			return sapi_read_schema(rsp, sensor_id);
+		}
+		// Get a calibration table - cal=<datatype> query
+		else if (!coap_opt_strncmp(o, SAPI_CAL_QUERY "=", strlen(SAPI_CAL_QUERY "=")))
+		{
+			return sapi_read_cal(req, rsp, sensor_id);
+		}
 		// Get Sensor values - sens query
         else if (!coap_opt_strcmp(o, "sens"))
         {
+			sapi_query_t query;
+			int nq = sapi_parse_query(req, &query);
+
+			if (nq < 0)
+			{
+				rsp->code = COAP_RSP_400_BAD_REQUEST;
+				goto err;
+			}
+			// A slice of the samples, sens&n=..&since=..&fmt=..
+			if (nq > 0)
+			{
+				return sapi_read_query(req, rsp, &query, sensor_id);
+			}
 			// Handle observation options
 			if ((o = copt_get_next_opt_type((sl_co*)&(req->oh), COAP_OPTION_OBSERVE, NULL))) 
 			{
@@ -569,29 +4674,55 @@ error_t crresourcehandler(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, vo
 				{
 					case COAP_OBS_REG:
 						rc = coap_obs_reg_sapi(sensor_info[sensor_id].observer_id);
-						//dlog(LOG_DEBUG, "Reg sensor observe for Id: %d", sensor_info[sensor_id].observer_id);
+						//DLOG_DEBUG("Reg sensor observe for Id: %d", sensor_info[sensor_id].observer_id);
 						obs = true;
 						break;
 					
 					case COAP_OBS_DEREG:
 						rc = coap_obs_dereg_sapi(sensor_info[sensor_id].observer_id);
-						//dlog(LOG_DEBUG, "Dereg sensor observe for Id: %d", sensor_info[sensor_id].observer_id);
+						//DLOG_DEBUG("Dereg sensor observe for Id: %d", sensor_info[sensor_id].observer_id);
 						break;
 					
 					default:
 						rc = ERR_INVAL;
 				}
 			}
-			// Get sensor value. Package as CoAP response.
+			// Stream a large sensor value, a block per request.
+			else if (sensor_info[sensor_id].readblk)
+			{
+				return sapi_read_block(req, rsp, sensor_id);
+			}
+			// Get sensor value, from the cache inside Max-Age. Package as CoAP response.
 			else
 			{
-				char payload[SAPI_MAX_PAYLOAD_LEN];
-				uint8_t payloadlen = 0;
-				SensorReadFuncPtr pReadSensor = sensor_info[sensor_id].read;
-				sapi_error_t rcode = (*pReadSensor)(payload, &payloadlen);
+				sensor_cache_t *c = &sensor_cache[sensor_id];
+
+				// A split-phase read answers separately
+				if (!sapi_cache_fresh(sensor_id) && sapi_cache_read(sensor_id) == SAPI_ERR_IN_PROGRESS)
+				{
+					return sapi_read_defer(req, rsp, sensor_id);
+				}
+				if (c->valid)
+				{
+					struct optlv etag = { COAP_OPTION_ETAG, sizeof(c->etag), c->etag };
+					void *eit = NULL;
+
+					c->hit = 1;
+					(void)copt_add_opt((sl_co*)&(rsp->oh), &etag);
+
+					// Client already has this payload
+					while ((o = copt_get_next_opt_type((sl_co*)&(req->oh), COAP_OPTION_ETAG, &eit)))
+					{
+						if (o->ol == sizeof(c->etag) && !memcmp(o->ov, c->etag, sizeof(c->etag)))
+						{
+							etag_match = true;
+							break;
+						}
+					}
+				}
 				
 				// Assemble the CoAP response message
-				rc = build_rsp_msg(rsp->msg, &len, payload, payloadlen, sensor_id);
+				rc = etag_match ? ERR_OK : sapi_cache_rsp(rsp->msg, &len, sensor_id);
 			}
         }
         // Don't support other queries
@@ -601,10 +4732,10 @@ error_t crresourcehandler(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, vo
             goto err;
         }
 		
-        dlog(LOG_DEBUG, "crresourcehandler: GET status: %d len: %d bytes", rc, len);
+        DLOG_DEBUG("crresourcehandler: GET status: %d len: %d bytes", rc, len);
         if (!rc)
 		{
-			if (obs)
+			if (obs || etag_match)
 			{                        
 			/* Good code, but no content. */
 				rsp->code = COAP_RSP_203_VALID;
@@ -613,7 +4744,7 @@ error_t crresourcehandler(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, vo
 			else
 			{
 				rsp->plen = len;
-				rsp->cf = COAP_CF_CSV;
+				rsp->cf = sensor_info[sensor_id].readsamples ? COAP_CF_APPLICATION_CBOR : COAP_CF_CSV;
 				rsp->code = COAP_RSP_205_CONTENT;
 			}
         }
@@ -637,10 +4768,44 @@ error_t crresourcehandler(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, vo
      */
     else if (req->code == COAP_REQUEST_PUT) 
     {
-	    char payload[SAPI_MAX_PAYLOAD_LEN];
+	    char *payload;
         uint8_t len = 0;
         error_t rc = ERR_OK;
+		struct coap_block blk;
+		
+		// Block-wise payload, see sapi_write_block
+		switch (coap_block_get(req, COAP_OPTION_BLOCK1, &blk))
+		{
+		case 0:
+			break;
+		case 1:
+			return sapi_write_block(req, rsp, &blk, sensor_id);
+		default:
+			rsp->code = COAP_RSP_400_BAD_REQUEST;
+			goto err;
+		}
 		
+		// A calibration table, see sapi_write_cal
+		if (o && !coap_opt_strncmp(o, SAPI_CAL_QUERY "=", strlen(SAPI_CAL_QUERY "=")))
+		{
+			return sapi_write_cal(req, rsp, sensor_id);
+		}
+		// CBOR map of typed parameters, see sapi_write_params
+		if (req->cf == COAP_CF_APPLICATION_CBOR && req->plen)
+		{
+			return sapi_write_params(req, rsp, sensor_id);
+		}
+		if (!o)
+		{
+			rsp->code = COAP_RSP_405_METHOD_NOT_ALLOWED;
+			goto err;
+		}
+		
+		if (!(payload = (char *) scratch_alloc(SAPI_MAX_PAYLOAD_LEN)))
+		{
+			rsp->code = COAP_RSP_500_INTERNAL_ERROR;
+			goto err;
+		}
 		SensorWriteCfgFuncPtr pSetCfgSensor = sensor_info[sensor_id].writecfg;
 		len = o->ol;
 		strncpy(payload, (char*)o->ov, len);
@@ -649,6 +4814,9 @@ error_t crresourcehandler(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp, vo
 		sapi_error_t rcode = (*pSetCfgSensor)(payload, &len);
 		if (rcode == SAPI_ERR_OK)
 		{
+			// Config may change the reading
+			sensor_cache[sensor_id].valid = 0;
+			sensor_cache[sensor_id].hit = 0;
 			rsp->code = COAP_RSP_204_CHANGED;
 			rsp->plen = 0;
 		}
@@ -686,21 +4854,152 @@ err:
 
 //////////////////////////////////////////////////////////////////////////
 //
-// Callback to handle generation of an observation notification.
-// Called by coap_observe_rsp (the CoAP Server observation handler).
+// Notification of a change-of-value sensor. Read the samples, and report
+// them only if the newest moved out of the deadband, or max_ms is up.
 //
 //////////////////////////////////////////////////////////////////////////
-error_t sapi_observation_handler(struct mbuf *m, uint8_t *len, uint8_t sensor_id)
+static error_t sapi_cov_rsp(struct mbuf *m, uint8_t *len, uint8_t sensor_id)
 {
-	char payload[SAPI_MAX_PAYLOAD_LEN];
+	sensor_cov_t *v = &sensor_covs[sensor_info[sensor_id].cov - 1];
+	int mark = scratch_mark();
+	sapi_sample_t *samples = (sapi_sample_t *) scratch_alloc(SAPI_MAX_SAMPLES * sizeof(sapi_sample_t));
+	char *payload = sensor_cache_back;
+	uint8_t count = SAPI_MAX_SAMPLES;
 	uint8_t payloadlen = 0;
+	uint32_t since = millis() - v->last_ms;
+	float value, delta, band;
+	uint32_t start_us;
+	sapi_error_t rcode;
+	error_t rc = ERR_NO_ENTRY;
+
+	if (!samples)
+	{
+		return ERR_NO_MEM;
+	}
+	memset(samples, 0, SAPI_MAX_SAMPLES * sizeof(sapi_sample_t));
+	start_us = micros();
+	rcode = (*sensor_info[sensor_id].readsamples)(samples, &count);
+	sapi_stats_read(sensor_id, rcode, micros() - start_us);
+	if (rcode != SAPI_ERR_OK || !count || count > SAPI_MAX_SAMPLES)
+	{
+		scratch_release(mark);
+		return ERR_FAIL;
+	}
+	cal_apply(sensor_id, samples, count);
+	sapi_prefilter_apply(sensor_id, samples, count);
+
+	value = samples[count - 1].value;
+	delta = value > v->last ? value - v->last : v->last - value;
+	band = v->percent ? v->band * (v->last < 0 ? -v->last : v->last) / 100 : v->band;
+	if (sensor_cov_force || !v->reported || (v->max_ms && since >= v->max_ms) ||
+		(since >= v->min_ms && delta > band))
+	{
+		// Into the cache too, a GET right after gets the same
+		rcode = sapi_samples_payload(sensor_id, NULL, samples, count, payload, &payloadlen);
+		sapi_cache_store(sensor_id, rcode, payload, payloadlen);
+		rc = rcode == SAPI_ERR_OK ? sapi_cache_rsp(m, len, sensor_id) : ERR_FAIL;
+		if (rc == ERR_OK)
+		{
+			v->last = value;
+			v->last_ms = millis();
+			v->reported = 1;
+		}
+	}
+	else
+	{
+		DLOG_DEBUG("Inside deadband, no report for sensor: %s", sensor_info[sensor_id].devicetype);
+	}
+	scratch_release(mark);
+	return rc;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Build an observation notification, see sapi_observation_handler.
+//
+//////////////////////////////////////////////////////////////////////////
+static error_t sapi_observation_rsp(struct mbuf *m, uint8_t *len, uint8_t sensor_id)
+{
+	DLOG_DEBUG("SAPI observe for sensor: %s", sensor_info[sensor_id].devicetype);
 	
-	dlog(LOG_DEBUG, "SAPI observe for sensor: %s", sensor_info[sensor_id].devicetype);
-	SensorReadFuncPtr pReadFunc = sensor_info[sensor_id].read;
-	sapi_error_t rcode = (*pReadFunc)(payload, &payloadlen);
+	// A sampled sensor reports its ring, nothing if no sample since the last,
+	// and its totals with it unless this follows up the last notification
+	if (sensor_info[sensor_id].sampler)
+	{
+		sensor_sampler_t *s = &sensor_samplers[sensor_info[sensor_id].sampler - 1];
+
+		if (sapi_backlog.sensor == sensor_id + 1)
+		{
+			return sapi_backlog_rsp(m, len, sensor_id);
+		}
+		if (!s->count)
+		{
+			return ERR_NO_ENTRY;
+		}
+		// With the link down the notification would be lost, the samples go
+		// to the sample log. One that waits would be replaced, these follow
+		// it instead, unless pushed.
+		if (!hdlcs_is_connected())
+		{
+			sapi_sampler_spill(s);
+			return ERR_NO_ENTRY;
+		}
+		if (!sensor_cov_force && obs_q_has(sensor_info[sensor_id].observer_id))
+		{
+			s->more = 1;
+			PACE_NOTIFY(1);
+			return ERR_NO_ENTRY;
+		}
+		PACE_NOTIFY(0);
+		if (!s->more)
+		{
+			sapi_total_report(s, sensor_id);
+			sapi_summary_report(s, sensor_id);
+		}
+		return sapi_sampler_rsp(m, len, sensor_id);
+	}
+	if (sensor_info[sensor_id].cov)
+	{
+		return sapi_cov_rsp(m, len, sensor_id);
+	}
+
+	// A snapshot is only reported, once there is a good one
+	if (sensor_info[sensor_id].snap_ms)
+	{
+		return sensor_cache[sensor_id].valid ? sapi_cache_rsp(m, len, sensor_id) : ERR_NO_ENTRY;
+	}
+
+	// Observations always read the sensor, and refresh the cache on the way.
+	// A split-phase read sends the notification from sapi_read_done.
+	if (!sensor_wait[sensor_id].obs && sapi_cache_read(sensor_id) == SAPI_ERR_IN_PROGRESS)
+	{
+		sensor_wait[sensor_id].obs = 1;
+		return ERR_INPROGRESS;
+	}
 	
 	// Assemble the CoAP response message
-	error_t rc = build_rsp_msg(m, len, payload, payloadlen, sensor_id);
+	error_t rc = sapi_cache_rsp(m, len, sensor_id);
+	return rc;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Callback to handle generation of an observation notification.
+// Called by coap_observe_rsp (the CoAP Server observation handler).
+// A health heartbeat due is encoded here, and the notification of
+// samples built next takes it, if it has room.
+//
+//////////////////////////////////////////////////////////////////////////
+error_t sapi_observation_handler(struct mbuf *m, uint8_t *len, uint8_t sensor_id)
+{
+	error_t rc;
+
+	health_poll();
+	sapi_health_ride = 1;
+	rc = sapi_observation_rsp(m, len, sensor_id);
+	sapi_health_ride = 0;
 	return rc;
 }
 
@@ -742,6 +5041,143 @@ uint8_t cbor_enc_nic_type(struct cbor_buf *cbuf, char *sensor_type)
 }
 
 
+//////////////////////////////////////////////////////////////////////////
+//
+// Add sensor type, the base epoch of ms offsets if any, and the health
+// heartbeat waiting to a CBOR payload wrapper
+//
+//////////////////////////////////////////////////////////////////////////
+uint8_t cbor_enc_nic_type_health(struct cbor_buf *cbuf, char *sensor_type, const uint32_t *base)
+{
+	uint8_t rcode;
+
+	if ((rcode = cbor_enc_map(cbuf, base ? 4 : 3)))
+	{
+		return rcode;
+	}
+	if ((rcode = cbor_enc_int(cbuf, NAMESPACE_NIC_TYPE_KEY)))
+	{
+		return rcode;
+	}
+	if ((rcode = cbor_enc_text(cbuf, sensor_type, strlen(sensor_type))))
+	{
+		return rcode;
+	}
+	if (base && ((rcode = cbor_enc_int(cbuf, SAPI_SAMPLES_BASE_KEY)) || (rcode = cbor_enc_uint(cbuf, *base))))
+	{
+		return rcode;
+	}
+
+	// Already CBOR, as it is
+	if ((rcode = cbor_enc_int(cbuf, SAPI_HEALTH_KEY)) || (rcode = health_enc(cbuf)))
+	{
+		return rcode;
+	}
+
+	rcode = cbor_enc_int(cbuf, NAMESPACE_DEVICE_SPECIFIC_KEY);
+	return rcode;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Add sensor type, the schema Id, the base epoch of ms offsets if any,
+// and the health heartbeat if it goes to a CBOR payload wrapper
+//
+//////////////////////////////////////////////////////////////////////////
+uint8_t cbor_enc_nic_type_schema(struct cbor_buf *cbuf, char *sensor_type, uint16_t id, const uint32_t *base,
+								 bool health)
+{
+	uint8_t rcode;
+
+	if ((rcode = cbor_enc_map(cbuf, 3 + (base ? 1 : 0) + (health ? 1 : 0))))
+	{
+		return rcode;
+	}
+	if ((rcode = cbor_enc_int(cbuf, NAMESPACE_NIC_TYPE_KEY)))
+	{
+		return rcode;
+	}
+	if ((rcode = cbor_enc_text(cbuf, sensor_type, strlen(sensor_type))))
+	{
+		return rcode;
+	}
+	if ((rcode = cbor_enc_int(cbuf, SAPI_SCHEMA_KEY)) || (rcode = cbor_enc_uint(cbuf, id)))
+	{
+		return rcode;
+	}
+	if (base && ((rcode = cbor_enc_int(cbuf, SAPI_SAMPLES_BASE_KEY)) || (rcode = cbor_enc_uint(cbuf, *base))))
+	{
+		return rcode;
+	}
+	if (health)
+	{
+		if ((rcode = cbor_enc_int(cbuf, SAPI_HEALTH_KEY)) || (rcode = health_enc(cbuf)))
+		{
+			return rcode;
+		}
+	}
+	rcode = cbor_enc_int(cbuf, NAMESPACE_DEVICE_SPECIFIC_KEY);
+	return rcode;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Add sensor type and the base epoch of ms offsets to a CBOR payload wrapper
+//
+//////////////////////////////////////////////////////////////////////////
+uint8_t cbor_enc_nic_type_at(struct cbor_buf *cbuf, char *sensor_type, uint32_t base)
+{
+	uint8_t rcode;
+
+	if ((rcode = cbor_enc_map(cbuf, 3)))
+	{
+		return rcode;
+	}
+	if ((rcode = cbor_enc_int(cbuf, NAMESPACE_NIC_TYPE_KEY)))
+	{
+		return rcode;
+	}
+	if ((rcode = cbor_enc_text(cbuf, sensor_type, strlen(sensor_type))))
+	{
+		return rcode;
+	}
+	if ((rcode = cbor_enc_int(cbuf, SAPI_SAMPLES_BASE_KEY)) || (rcode = cbor_enc_uint(cbuf, base)))
+	{
+		return rcode;
+	}
+	rcode = cbor_enc_int(cbuf, NAMESPACE_DEVICE_SPECIFIC_KEY);
+	return rcode;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// The shortest CBOR text string header for n bytes, written to p.
+// Returns its length.
+//
+//////////////////////////////////////////////////////////////////////////
+static uint8_t sapi_txt_hdr(uint8_t *p, uint16_t n)
+{
+	if (n < 24)
+	{
+		p[0] = CBOR_TYPE_TEXT | n;
+		return 1;
+	}
+	if (n <= UINT8_MAX)
+	{
+		p[0] = CBOR_TYPE_TEXT | 24;
+		p[1] = n;
+		return 2;
+	}
+	p[0] = CBOR_TYPE_TEXT | 25;
+	p[1] = n >> 8;
+	p[2] = n;
+	return 3;
+}
+
+
 //////////////////////////////////////////////////////////////////////////
 //
 // Build the CoAP response message for a sensor. Called on these CoAP requests:
@@ -757,45 +5193,110 @@ uint8_t cbor_enc_nic_type(struct cbor_buf *cbuf, char *sensor_type)
 //////////////////////////////////////////////////////////////////////////
 error_t build_rsp_msg(struct mbuf *m, uint8_t *len, char *payload, uint32_t payloadlen, uint8_t sensor_id)
 {
-	char		cbor_payload[SAPI_MAX_PAYLOAD_LEN];
+	uint8_t		head[SAPI_MAX_DEVICE_TYPE_LEN + 8];
 	char  		*p;
-	uint8_t 	l;
+	uint8_t 	h;
 	
-	// If payload needs to be in CBOR format we add the CBOR wrapper.
-	error_t	rcode = ERR_FAIL;
+	// Only the wrapper is encoded here, the text is copied once, into the response
 	struct cbor_buf cbuf;
 		
-	cbor_enc_init(&cbuf, cbor_payload, SAPI_MAX_PAYLOAD_LEN);
-	
-	if (!cbor_enc_nic_type(&cbuf, sensor_info[sensor_id].devicetype))
+	cbor_enc_init(&cbuf, head, sizeof(head));
+	if (cbor_enc_nic_type(&cbuf, sensor_info[sensor_id].devicetype))
 	{
-		if (!cbor_enc_text(&cbuf, payload, payloadlen))
-		{
-			rcode = ERR_OK;
-		}
+		return ERR_FAIL;
 	}
-	if (rcode == ERR_FAIL)
+	if (payloadlen > UINT8_MAX)
 	{
-		return rcode;
+		return ERR_FAIL;
+	}
+	h = cbor_buf_get_len(&cbuf);
+	h += sapi_txt_hdr(head + h, payloadlen);
+	if (h + payloadlen > UINT8_MAX)
+	{
+		return ERR_FAIL;
 	}
 		
-	// Get CBOR payload length and allocate memory for the CBOR payload
-	l = cbor_buf_get_len(&cbuf);
-	p = (char *) m_append(m, l);
+	// Allocate memory for the CBOR payload
+	p = (char *) m_append(m, h + payloadlen);
 	if (!p)
 	{
 		return ERR_NO_MEM;
 	}
 
 	// Copy CBOR payload to response
-	memcpy(p, cbor_payload, l);
-	*len = l;
+	memcpy(p, head, h);
+	memcpy(p + h, payload, payloadlen);
+	*len = h + payloadlen;
 		
-	dlog(LOG_DEBUG, "CBOR Payload Dump:");
-	ddump(LOG_DEBUG, "Payload", cbor_payload, l);
+	DLOG_DEBUG("CBOR Payload Dump:");
+	DDUMP_DEBUG("Payload", p, *len);
 	
 	int freeram = free_ram();
-	dlog(LOG_DEBUG, "Free Ram: %d", freeram);
+	DLOG_DEBUG("Free Ram: %d", freeram);
+	return ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Build a response whose text a write callback writes straight into the
+// mbuf, after the CBOR wrapper. The text header is only known at the end,
+// so room is left for the longest one and the text moved up to the one
+// that fits. Nothing is left appended on failure.
+//
+//////////////////////////////////////////////////////////////////////////
+error_t build_rsp_txt(struct mbuf *m, uint16_t *len, SensorWriteTxtFuncPtr fn, uint8_t sensor_id)
+{
+	struct cbor_buf cbuf;
+	struct txt_buf tb;
+	struct mbuf *last;
+	char 		*p;
+	uint16_t 	room, n;
+	uint8_t 	h, t;
+	sapi_error_t rc;
+
+	// The contiguous room left in the last buffer, or a new one
+	for (last = m; last->next; last = last->next)
+		;
+	room = M_TRAILINGSPACE(last);
+	if (room < SAPI_MAX_DEVICE_TYPE_LEN + 8 + SAPI_MAX_PAYLOAD_LEN)
+	{
+		room = SAPI_MAX_DEVICE_TYPE_LEN + 8 + SAPI_MAX_PAYLOAD_LEN;
+	}
+	p = (char *) m_append(m, room);
+	if (!p)
+	{
+		return ERR_NO_MEM;
+	}
+
+	cbor_enc_init(&cbuf, p, SAPI_MAX_DEVICE_TYPE_LEN + 8);
+	if (cbor_enc_nic_type(&cbuf, sensor_info[sensor_id].devicetype))
+	{
+		m_adj(m, -room);
+		return ERR_FAIL;
+	}
+	h = cbor_buf_get_len(&cbuf);
+
+	// The text after room for a 3 byte header, and its NUL
+	txt_init(&tb, p + h + 3, room - h - 3);
+	rc = (*fn)(&tb);
+	if (rc != SAPI_ERR_OK || tb.err)
+	{
+		m_adj(m, -room);
+		return rc == SAPI_ERR_OK ? ERR_NO_MEM : ERR_BAD_DATA;
+	}
+	n = txt_len(&tb);
+
+	t = sapi_txt_hdr((uint8_t *)p + h, n);
+	if (t < 3)
+	{
+		memmove(p + h + t, p + h + 3, n);
+	}
+	m_adj(m, -(room - h - t - n));
+	*len = h + t + n;
+
+	DLOG_DEBUG("CBOR Payload Dump:");
+	DDUMP_DEBUG("Payload", p, *len);
 	return ERR_OK;
 }
 
@@ -838,5 +5339,5 @@ void sapi_log_banner()
 	
 	// Log free memory
 	int freeram = free_ram();
-	dlog(LOG_DEBUG, "Free Ram: %d", freeram);
+	DLOG_DEBUG("Free Ram: %d", freeram);
 }
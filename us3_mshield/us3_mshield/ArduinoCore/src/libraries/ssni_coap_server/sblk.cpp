@@ -0,0 +1,444 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+
+#include <Arduino.h>
+#include <string.h>
+#include <math.h>
+#include "sblk.h"
+#include "crc_xmodem.h"
+
+
+static const float sblk_scale[SBLK_DECIMALS_MAX + 1] = {
+    1.0f, 10.0f, 100.0f, 1000.0f, 10000.0f, 100000.0f, 1000000.0f
+};
+
+
+static void
+sblk_put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+
+static uint32_t
+sblk_get32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+
+/* The value times 10^decimals, -1 if it doesn't fit in 32 bits */
+static int
+sblk_fixed(float value, uint8_t flags, int32_t *fixed)
+{
+    float v = value * sblk_scale[flags & SBLK_DECIMALS];
+
+    /* NaN fails both */
+    if (!(v > -2147483520.0f && v < 2147483520.0f)) {
+        return -1;
+    }
+    *fixed = lroundf(v);
+    return 0;
+}
+
+
+/* v zigzag LEB128 coded at p, if it fits before end. Returns its bytes, 0 if not. */
+static uint8_t
+sblk_varint(uint8_t *p, const uint8_t *end, int32_t v)
+{
+    uint32_t z = ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+    uint8_t n = 0;
+
+    do {
+        if (p + n >= end) {
+            return 0;
+        }
+        p[n++] = (z & 0x7F) | (z > 0x7F ? 0x80 : 0);
+        z >>= 7;
+    } while (z);
+    return n;
+}
+
+
+/* The zigzag LEB128 at *p, before end. Returns -1 if it runs past it. */
+static int
+sblk_unvarint(const uint8_t **p, const uint8_t *end, int32_t *v)
+{
+    uint32_t z = 0;
+    uint8_t shift = 0;
+    uint8_t c;
+
+    do {
+        if (*p >= end || shift > 28) {
+            return -1;
+        }
+        c = *(*p)++;
+        z |= (uint32_t)(c & 0x7F) << shift;
+        shift += 7;
+    } while (c & 0x80);
+    *v = (int32_t)(z >> 1) ^ -(int32_t)(z & 1);
+    return 0;
+}
+
+
+int
+sblk_start(struct sblk *b, uint8_t *buf, uint16_t size, uint8_t datatype, uint8_t flags,
+           uint32_t epoch, uint16_t ms, float value)
+{
+    uint8_t hdr = SBLK_HDR_LEN + ((flags & SBLK_MS) ? 2 : 0);
+
+    if ((flags & SBLK_DECIMALS) > SBLK_DECIMALS_MAX) {
+        return -1;
+    }
+    if (size > SBLK_MAX_LEN) {
+        size = SBLK_MAX_LEN;
+    }
+    if (size < hdr + SBLK_CRC_LEN) {
+        return -1;
+    }
+    memset(b, 0, sizeof(*b));
+    if (sblk_fixed(value, flags, &b->value)) {
+        return -1;
+    }
+    b->buf = buf;
+    b->size = size;
+    b->flags = flags;
+    b->epoch = epoch;
+    b->ms = (flags & SBLK_MS) ? ms : 0;
+    b->count = 1;
+
+    buf[2] = datatype;
+    buf[3] = flags;
+    sblk_put32(&buf[4], epoch);
+    sblk_put32(&buf[8], (uint32_t)b->value);
+    if (flags & SBLK_MS) {
+        buf[12] = b->ms >> 8;
+        buf[13] = b->ms;
+    }
+    b->len = hdr;
+    return 0;
+}
+
+
+int
+sblk_add(struct sblk *b, uint32_t epoch, uint16_t ms, float value)
+{
+    const uint8_t *end = b->buf + b->size - SBLK_CRC_LEN;
+    uint8_t *p = b->buf + b->len;
+    int32_t dt, fixed;
+    int64_t dms;
+    uint8_t n, m;
+
+    if (b->count == 0xFF || sblk_fixed(value, b->flags, &fixed)) {
+        return -1;
+    }
+    if (b->flags & SBLK_MS) {
+        dms = ((int64_t)epoch - b->epoch) * 1000 + ms - b->ms;
+        if (dms > INT32_MAX || dms < INT32_MIN) {
+            return -1;
+        }
+        dt = (int32_t)dms;
+    }
+    else {
+        dt = (int32_t)(epoch - b->epoch);
+    }
+    /* the difference of two values in range can overflow, widened it can't */
+    if ((int64_t)fixed - b->value > INT32_MAX || (int64_t)fixed - b->value < INT32_MIN) {
+        return -1;
+    }
+    if (!(n = sblk_varint(p, end, dt)) || !(m = sblk_varint(p + n, end, fixed - b->value))) {
+        return -1;
+    }
+    b->len += n + m;
+    b->count++;
+    b->epoch = epoch;
+    b->ms = (b->flags & SBLK_MS) ? ms : 0;
+    b->value = fixed;
+    return 0;
+}
+
+
+uint8_t
+sblk_end(struct sblk *b)
+{
+    uint16_t crc;
+
+    b->buf[0] = b->len + SBLK_CRC_LEN;
+    b->buf[1] = b->count;
+    crc = crc_xmodem(crc_xmodem_init(), b->buf, b->len);
+    b->buf[b->len] = crc >> 8;
+    b->buf[b->len + 1] = crc;
+    return b->len + SBLK_CRC_LEN;
+}
+
+
+int
+sblk_rd_init(struct sblk_rd *rd, const uint8_t *blk, uint16_t len)
+{
+    uint8_t n, hdr;
+
+    if (len < SBLK_HDR_LEN + SBLK_CRC_LEN || (n = blk[0]) > len) {
+        return -1;
+    }
+    hdr = SBLK_HDR_LEN + ((blk[3] & SBLK_MS) ? 2 : 0);
+    if (n < hdr + SBLK_CRC_LEN || !blk[1] || (blk[3] & SBLK_DECIMALS) > SBLK_DECIMALS_MAX || (blk[3] & SBLK_COLS) ||
+        crc_xmodem(crc_xmodem_init(), blk, n - SBLK_CRC_LEN) != (((uint16_t)blk[n - 2] << 8) | blk[n - 1])) {
+        return -1;
+    }
+    memset(rd, 0, sizeof(*rd));
+    rd->next = blk + hdr;
+    rd->end = blk + n - SBLK_CRC_LEN;
+    rd->left = blk[1];
+    rd->datatype = blk[2];
+    rd->flags = blk[3];
+    rd->epoch = sblk_get32(&blk[4]);
+    rd->value = (int32_t)sblk_get32(&blk[8]);
+    if (rd->flags & SBLK_MS) {
+        rd->ms = ((uint16_t)blk[12] << 8) | blk[13];
+    }
+    return n;
+}
+
+
+int
+sblk_rd_next(struct sblk_rd *rd, uint32_t *epoch, uint16_t *ms, float *value)
+{
+    int32_t dt, dv;
+    int64_t t;
+
+    if (!rd->left) {
+        return 0;
+    }
+    /* the first sample is the header's, the others deltas from the one before */
+    if (rd->started) {
+        if (sblk_unvarint(&rd->next, rd->end, &dt) || sblk_unvarint(&rd->next, rd->end, &dv)) {
+            return -1;
+        }
+        if (rd->flags & SBLK_MS) {
+            t = (int64_t)rd->epoch * 1000 + rd->ms + dt;
+            rd->epoch = (uint32_t)(t / 1000);
+            rd->ms = t % 1000;
+        }
+        else {
+            rd->epoch += dt;
+        }
+        rd->value += dv;
+    }
+    rd->started = 1;
+    rd->left--;
+    *epoch = rd->epoch;
+    *ms = rd->ms;
+    *value = rd->value / sblk_scale[rd->flags & SBLK_DECIMALS];
+    return 1;
+}
+
+
+/* The time of a row less that of the one before, -1 if it doesn't fit */
+static int
+sblk_dt(uint8_t flags, uint32_t epoch, uint16_t ms, uint32_t epoch0, uint16_t ms0, int32_t *dt)
+{
+    int64_t d;
+
+    if (flags & SBLK_MS) {
+        d = ((int64_t)epoch - epoch0) * 1000 + ms - ms0;
+    }
+    else {
+        d = (int64_t)epoch - epoch0;
+    }
+    if (d > INT32_MAX || d < INT32_MIN) {
+        return -1;
+    }
+    *dt = (int32_t)d;
+    return 0;
+}
+
+
+int
+sblk_cols(uint8_t *buf, uint16_t size, uint8_t flags, const uint32_t *epoch, const uint16_t *ms,
+          uint8_t rows, const uint8_t *datatype, const float *values, uint8_t cols)
+{
+    uint8_t hdr = SBLK_COLS_HDR_LEN + ((flags & SBLK_MS) ? 2 : 0);
+    const uint8_t *end;
+    uint8_t *p;
+    int32_t dt, fixed, prev;
+    uint16_t crc;
+    uint8_t r, c, n;
+
+    flags |= SBLK_COLS;
+    if ((flags & SBLK_DECIMALS) > SBLK_DECIMALS_MAX || !rows || !cols || cols > SBLK_COLS_MAX) {
+        return -1;
+    }
+    if (size > SBLK_MAX_LEN) {
+        size = SBLK_MAX_LEN;
+    }
+    if (size < hdr + SBLK_CRC_LEN) {
+        return -1;
+    }
+    end = buf + size - SBLK_CRC_LEN;
+
+    buf[1] = rows;
+    buf[2] = cols;
+    buf[3] = flags;
+    sblk_put32(&buf[4], epoch[0]);
+    if (flags & SBLK_MS) {
+        buf[8] = ms[0] >> 8;
+        buf[9] = ms[0];
+    }
+    p = buf + hdr;
+
+    /* the times, then each column in turn, every one a run of deltas */
+    for (r = 1; r < rows; r++) {
+        if (sblk_dt(flags, epoch[r], (flags & SBLK_MS) ? ms[r] : 0, epoch[r - 1],
+                    (flags & SBLK_MS) ? ms[r - 1] : 0, &dt) ||
+            !(n = sblk_varint(p, end, dt))) {
+            return -1;
+        }
+        p += n;
+    }
+    for (c = 0; c < cols; c++) {
+        if (end - p < 5 || sblk_fixed(values[c], flags, &prev)) {
+            return -1;
+        }
+        *p++ = datatype[c];
+        sblk_put32(p, (uint32_t)prev);
+        p += 4;
+        for (r = 1; r < rows; r++) {
+            if (sblk_fixed(values[r * cols + c], flags, &fixed) ||
+                (int64_t)fixed - prev > INT32_MAX || (int64_t)fixed - prev < INT32_MIN ||
+                !(n = sblk_varint(p, end, fixed - prev))) {
+                return -1;
+            }
+            p += n;
+            prev = fixed;
+        }
+    }
+
+    n = p - buf;
+    buf[0] = n + SBLK_CRC_LEN;
+    crc = crc_xmodem(crc_xmodem_init(), buf, n);
+    buf[n] = crc >> 8;
+    buf[n + 1] = crc;
+    return n + SBLK_CRC_LEN;
+}
+
+
+int
+sblk_cols_rd_init(struct sblk_cols_rd *rd, const uint8_t *blk, uint16_t len)
+{
+    const uint8_t *p;
+    int32_t skip;
+    uint8_t n, hdr, r, c;
+
+    if (len < SBLK_COLS_HDR_LEN + SBLK_CRC_LEN || (n = blk[0]) > len) {
+        return -1;
+    }
+    hdr = SBLK_COLS_HDR_LEN + ((blk[3] & SBLK_MS) ? 2 : 0);
+    if (n < hdr + SBLK_CRC_LEN || !blk[1] || !blk[2] || blk[2] > SBLK_COLS_MAX || !(blk[3] & SBLK_COLS) ||
+        (blk[3] & SBLK_DECIMALS) > SBLK_DECIMALS_MAX ||
+        crc_xmodem(crc_xmodem_init(), blk, n - SBLK_CRC_LEN) != (((uint16_t)blk[n - 2] << 8) | blk[n - 1])) {
+        return -1;
+    }
+    memset(rd, 0, sizeof(*rd));
+    rd->end = blk + n - SBLK_CRC_LEN;
+    rd->left = blk[1];
+    rd->cols = blk[2];
+    rd->flags = blk[3];
+    rd->epoch = sblk_get32(&blk[4]);
+    if (rd->flags & SBLK_MS) {
+        rd->ms = ((uint16_t)blk[8] << 8) | blk[9];
+    }
+
+    /* where each column starts, past the deltas before it */
+    p = rd->times = blk + hdr;
+    for (c = 0; c <= rd->cols; c++) {
+        if (c) {
+            if (rd->end - p < 5) {
+                return -1;
+            }
+            rd->datatype[c - 1] = p[0];
+            rd->value[c - 1] = (int32_t)sblk_get32(p + 1);
+            p += 5;
+            rd->col[c - 1] = p;
+        }
+        for (r = 1; r < rd->left; r++) {
+            if (sblk_unvarint(&p, rd->end, &skip)) {
+                return -1;
+            }
+        }
+    }
+    return n;
+}
+
+
+int
+sblk_cols_rd_next(struct sblk_cols_rd *rd, uint32_t *epoch, uint16_t *ms, float *values)
+{
+    int32_t dt, dv;
+    int64_t t;
+    uint8_t c;
+
+    if (!rd->left) {
+        return 0;
+    }
+    /* the first row is the header's and the heads of the columns, the others deltas */
+    if (rd->started) {
+        if (sblk_unvarint(&rd->times, rd->end, &dt)) {
+            return -1;
+        }
+        if (rd->flags & SBLK_MS) {
+            t = (int64_t)rd->epoch * 1000 + rd->ms + dt;
+            rd->epoch = (uint32_t)(t / 1000);
+            rd->ms = t % 1000;
+        }
+        else {
+            rd->epoch += dt;
+        }
+        for (c = 0; c < rd->cols; c++) {
+            if (sblk_unvarint(&rd->col[c], rd->end, &dv)) {
+                return -1;
+            }
+            rd->value[c] += dv;
+        }
+    }
+    rd->started = 1;
+    rd->left--;
+    *epoch = rd->epoch;
+    *ms = rd->ms;
+    for (c = 0; c < rd->cols; c++) {
+        values[c] = rd->value[c] / sblk_scale[rd->flags & SBLK_DECIMALS];
+    }
+    return 1;
+}
@@ -0,0 +1,404 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+#include "sched.h"
+#include "log.h"
+#include "duty.h"
+#include "cpuload.h"
+
+
+static struct sched_task *sched_tasks[SCHED_MAX_TASKS];
+static uint8_t sched_ntasks;
+static struct sched_task *sched_heap[SCHED_MAX_TASKS];
+static uint8_t sched_nheap;
+static volatile uint8_t sched_kicks;
+static uint8_t sched_pass;
+static uint8_t sched_running;
+static sched_sleep_fn sched_sleep_hook;
+static uint32_t sched_sleep_min;
+static sched_sleep_fn sched_slow_hook;
+static uint32_t sched_slow_min;
+static sched_feed_fn sched_feed_hook;
+static uint32_t sched_feed_max;
+
+#define SCHED_BEFORE(a, b)      ((int32_t)((a) - (b)) < 0)
+
+
+static void
+sched_set(uint8_t i, struct sched_task *t)
+{
+    sched_heap[i] = t;
+    t->slot = i;
+}
+
+
+static void
+sched_up(uint8_t i)
+{
+    struct sched_task *t = sched_heap[i];
+    uint8_t parent;
+
+    while (i) {
+        parent = (i - 1) / 2;
+        if (!SCHED_BEFORE(t->due_ms, sched_heap[parent]->due_ms)) {
+            break;
+        }
+        sched_set(i, sched_heap[parent]);
+        i = parent;
+    }
+    sched_set(i, t);
+}
+
+
+static void
+sched_down(uint8_t i)
+{
+    struct sched_task *t = sched_heap[i];
+    uint8_t child;
+
+    for (;;) {
+        child = 2 * i + 1;
+        if (child >= sched_nheap) {
+            break;
+        }
+        if (child + 1 < sched_nheap &&
+            SCHED_BEFORE(sched_heap[child + 1]->due_ms, sched_heap[child]->due_ms)) {
+            child++;
+        }
+        if (!SCHED_BEFORE(sched_heap[child]->due_ms, t->due_ms)) {
+            break;
+        }
+        sched_set(i, sched_heap[child]);
+        i = child;
+    }
+    sched_set(i, t);
+}
+
+
+/* The last entry fills the hole, then finds its place either way */
+static void
+sched_remove(struct sched_task *t)
+{
+    struct sched_task *last;
+    uint8_t i = t->slot;
+
+    t->slot = -1;
+    if (--sched_nheap == i) {
+        return;
+    }
+    last = sched_heap[sched_nheap];
+    sched_set(i, last);
+    sched_up(i);
+    sched_down(last->slot);
+}
+
+
+static void
+sched_insert(struct sched_task *t)
+{
+    sched_set(sched_nheap++, t);
+    sched_up(t->slot);
+}
+
+
+int
+sched_add(struct sched_task *t, const char *name, sched_fn run, uint32_t period_ms)
+{
+    if (sched_ntasks >= SCHED_MAX_TASKS) {
+        DLOG_ERR("No room for task %s", name);
+        return -1;
+    }
+    t->name = name;
+    t->run = run;
+    t->period_ms = period_ms;
+    t->slot = -1;
+    t->pass = sched_pass - 1;
+    t->runs = 0;
+    t->max_us = 0;
+    t->budget_ms = 0;
+    t->late_ms = 0;
+    t->misses = 0;
+    sched_tasks[sched_ntasks++] = t;
+    if (period_ms) {
+        sched_at(t, 0);
+    }
+    return 0;
+}
+
+
+void
+sched_at(struct sched_task *t, uint32_t ms)
+{
+    if (t->slot >= 0) {
+        sched_remove(t);
+    }
+    t->due_ms = millis() + ms;
+    sched_insert(t);
+}
+
+
+void
+sched_within(struct sched_task *t, uint32_t ms)
+{
+    if (t->slot < 0 || SCHED_BEFORE(millis() + ms, t->due_ms)) {
+        sched_at(t, ms);
+    }
+}
+
+
+void
+sched_budget(struct sched_task *t, uint32_t budget_ms)
+{
+    t->budget_ms = budget_ms;
+}
+
+
+void
+sched_stop(struct sched_task *t)
+{
+    if (t->slot >= 0) {
+        sched_remove(t);
+    }
+}
+
+
+void
+sched_kick(struct sched_task *t)
+{
+    t->kicked = 1;
+    sched_kicks = 1;
+}
+
+
+static void
+sched_exec(struct sched_task *t)
+{
+    uint32_t us = micros();
+
+    t->pass = sched_pass;
+    t->run(t);
+    us = micros() - us;
+    if (us > t->max_us) {
+        t->max_us = us;
+    }
+    t->runs++;
+}
+
+
+/* Note how late t runs, 0 if it ran later than its budget */
+static uint8_t
+sched_late(struct sched_task *t)
+{
+    uint32_t late = millis() - t->due_ms;
+
+    if (late > t->late_ms) {
+        t->late_ms = late;
+    }
+    if (t->budget_ms && late > t->budget_ms) {
+        t->misses++;
+        return 0;
+    }
+    return 1;
+}
+
+
+/* No supervised task waiting longer than its budget */
+static uint8_t
+sched_on_time(void)
+{
+    struct sched_task *t;
+    uint32_t now = millis();
+    uint8_t i;
+
+    for (i = 0; i < sched_nheap; i++) {
+        t = sched_heap[i];
+        if (t->budget_ms && !SCHED_BEFORE(now, t->due_ms) && now - t->due_ms > t->budget_ms) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+void
+sched_run(void)
+{
+    struct sched_task *t;
+    uint32_t now;
+    uint8_t ok = 1;
+    uint8_t i;
+
+    /* a task waiting on the line may run the others, not itself */
+    if (sched_running) {
+        return;
+    }
+    sched_running = 1;
+    sched_pass++;
+
+    if (sched_kicks) {
+        sched_kicks = 0;
+        for (i = 0; i < sched_ntasks; i++) {
+            t = sched_tasks[i];
+            if (t->kicked) {
+                t->kicked = 0;
+                sched_exec(t);
+            }
+        }
+    }
+
+    now = millis();
+    while (sched_nheap) {
+        t = sched_heap[0];
+        if (SCHED_BEFORE(now, t->due_ms) || t->pass == sched_pass) {
+            break;
+        }
+        sched_remove(t);
+        ok &= sched_late(t);
+        if (t->period_ms) {
+            /* the next period from this deadline, from now if it fell behind */
+            t->due_ms += t->period_ms;
+            if (SCHED_BEFORE(t->due_ms, now)) {
+                t->due_ms = now + t->period_ms;
+            }
+            sched_insert(t);
+        }
+        sched_exec(t);
+    }
+    if (sched_feed_hook && ok && sched_on_time()) {
+        sched_feed_hook();
+    }
+    sched_running = 0;
+}
+
+
+uint32_t
+sched_wait_ms(void)
+{
+    int32_t d;
+
+    if (sched_kicks) {
+        return 0;
+    }
+    if (!sched_nheap) {
+        return SCHED_NEVER;
+    }
+    d = (int32_t)(sched_heap[0]->due_ms - millis());
+    return d > 0 ? (uint32_t)d : 0;
+}
+
+
+void
+sched_sleep(sched_sleep_fn sleep, uint32_t min_ms)
+{
+    sched_sleep_hook = sleep;
+    sched_sleep_min = min_ms;
+}
+
+
+void
+sched_slow(sched_sleep_fn slow, uint32_t min_ms)
+{
+    sched_slow_hook = slow;
+    sched_slow_min = min_ms;
+}
+
+
+void
+sched_watchdog(sched_feed_fn feed, uint32_t max_wait_ms)
+{
+    sched_feed_hook = feed;
+    sched_feed_max = max_wait_ms;
+}
+
+
+void
+sched_idle(void)
+{
+#if defined(ARDUINO_ARCH_SAMD)
+    uint32_t wait;
+
+    CPULOAD_ENTER();
+
+    /* a kick pended while they are off still wakes the WFI */
+    noInterrupts();
+    wait = sched_wait_ms();
+    if (sched_feed_hook && wait > sched_feed_max) {
+        wait = sched_feed_max;
+    }
+    if (wait) {
+        if (sched_slow_hook && wait >= sched_slow_min) {
+            sched_slow_hook(wait);
+        }
+        DUTY_ENTER(DUTY_IDLE);
+        if (sched_sleep_hook && wait >= sched_sleep_min) {
+            sched_sleep_hook(wait);
+        } else {
+            __WFI();
+        }
+        DUTY_EXIT();
+    }
+    /* before the interrupt that woke it runs, to count that busy */
+    CPULOAD_EXIT(wait != 0);
+    interrupts();
+#endif
+}
+
+
+const struct sched_task *
+sched_get(uint8_t i)
+{
+    return i < sched_ntasks ? sched_tasks[i] : NULL;
+}
+
+
+void
+sched_dump(void)
+{
+    struct sched_task *t;
+    char line[96];
+    uint32_t now = millis();
+    uint8_t i;
+
+    for (i = 0; i < sched_ntasks; i++) {
+        t = sched_tasks[i];
+        if (t->slot >= 0) {
+            snprintf(line, sizeof(line), "%-8s %8ld ms %8lu runs %8lu us max %6lu ms late %4lu misses", t->name,
+                     (long)(int32_t)(t->due_ms - now), (unsigned long)t->runs, (unsigned long)t->max_us,
+                     (unsigned long)t->late_ms, (unsigned long)t->misses);
+        } else {
+            snprintf(line, sizeof(line), "%-8s %8s    %8lu runs %8lu us max %6lu ms late %4lu misses", t->name,
+                     "-", (unsigned long)t->runs, (unsigned long)t->max_us,
+                     (unsigned long)t->late_ms, (unsigned long)t->misses);
+        }
+        println(line);
+    }
+}
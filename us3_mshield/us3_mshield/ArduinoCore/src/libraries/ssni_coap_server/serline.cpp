@@ -0,0 +1,256 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+#include "serline.h"
+#include "log.h"
+#include "trace.h"
+
+
+static struct ser_line *ser_line_owner;
+
+
+/*
+ * A reply byte, from the UART receive IRQ. Bytes outside a reply are
+ * dropped, as are terminators before the first byte of the line. Those
+ * of a raw reply go into the buffer of the request, all of them.
+ */
+static void
+ser_line_rx_byte(uint8_t c)
+{
+    struct ser_line *ln = ser_line_owner;
+    struct ser_req *req = ln->head;
+    uint16_t len = ln->rx_len;
+
+    if (ln->state != SER_STATE_RX || ln->rx_done) {
+        return;
+    }
+    ln->rx_ms = millis();
+    if (ln->rx_raw) {
+        if (!len) {
+            ln->rx_us = micros();
+        }
+        if (len < req->size) {
+            req->buf[len] = c;
+        }
+        if (len < 0xffff) {
+            ln->rx_len = len + 1;
+        }
+        if (c == ln->rx_term) {
+            ln->rx_done = 1;
+        }
+        return;
+    }
+    if (c && strchr(ln->term, c)) {
+        if (len) {
+            ln->rx_done = 1;
+        }
+        return;
+    }
+    if (!len) {
+        ln->rx_us = micros();
+    }
+    if (len < SER_LINE_MAX) {
+        ln->line[len] = c;
+    }
+    if (len < 0xffff) {
+        ln->rx_len = len + 1;
+    }
+}
+
+
+void
+ser_line_init(struct ser_line *ln, Uart *port, uint32_t baud, uint16_t config,
+              const char *eol, const char *term)
+{
+    memset(ln, 0, sizeof(*ln));
+    ln->port = port;
+    ln->eol = eol ? eol : "";
+    ln->term = term ? term : "";
+    ln->timeout_ms = SER_LINE_TIMEOUT_MS;
+    ln->gap_ms = SER_LINE_GAP_MS;
+    ln->state = SER_STATE_IDLE;
+
+    ser_line_owner = ln;
+    port->begin(baud, config);
+    port->onReceive(ser_line_rx_byte);
+}
+
+
+int
+ser_line_submit(struct ser_line *ln, struct ser_req *req)
+{
+    if (!req->cmd || !req->buf || !req->size) {
+        return SER_ERR_ARG;
+    }
+    if (req->busy) {
+        return SER_ERR_BUSY;
+    }
+
+    req->busy = 1;
+    req->next = NULL;
+    if (ln->tail) {
+        ln->tail->next = req;
+    } else {
+        ln->head = req;
+    }
+    ln->tail = req;
+    return SER_OK;
+}
+
+
+/* Take the running request off the queue, with the line taken, and tell its owner */
+static void
+ser_line_complete(struct ser_line *ln, int rc)
+{
+    struct ser_req *req = ln->head;
+    uint16_t len = min(ln->rx_len, SER_LINE_MAX);
+
+    ln->state = SER_STATE_IDLE;
+    if (req->cmd_len) {
+        /* raw, already in buf */
+        if (rc == SER_OK && ln->rx_len > req->size) {
+            rc = SER_ERR_OVERFLOW;
+        }
+        req->len = min(ln->rx_len, req->size);
+    } else {
+        if (rc == SER_OK && (ln->rx_len > SER_LINE_MAX || len >= req->size)) {
+            rc = SER_ERR_OVERFLOW;
+        }
+        len = min(len, req->size - 1);
+        memcpy(req->buf, ln->line, len);
+        req->buf[len] = '\0';
+        req->len = len;
+    }
+
+    TRACE_FRAME(TRACE_RS232 | (rc != SER_OK ? TRACE_ERR : 0), ln->rx_len ? ln->rx_us : micros(),
+                req->cmd_len ? (const uint8_t *)req->buf : (const uint8_t *)ln->line,
+                req->cmd_len ? req->len : min(ln->rx_len, SER_LINE_MAX), NULL, 0);
+
+    if (rc == SER_OK) {
+        ln->lines++;
+    } else if (rc == SER_ERR_TIMEOUT) {
+        ln->timeouts++;
+    } else {
+        ln->errors++;
+    }
+    if (req->cmd_len) {
+        DLOG_DEBUG("RS232 %d bytes -> %d, %d bytes", req->cmd_len, rc, req->len);
+    } else {
+        DLOG_DEBUG("RS232 %s -> %d \"%s\"", req->cmd, rc, req->buf);
+    }
+
+    ln->head = req->next;
+    if (!ln->head) {
+        ln->tail = NULL;
+    }
+    req->rc = rc;
+    req->busy = 0;
+    if (req->done) {
+        req->done(req);
+    }
+}
+
+
+/* Time since the last reply byte, rx_ms first as the IRQ moves it */
+static uint32_t
+ser_line_quiet_ms(struct ser_line *ln)
+{
+    uint32_t last = ln->rx_ms;
+
+    return millis() - last;
+}
+
+
+void
+ser_line_poll(struct ser_line *ln)
+{
+    struct ser_req *req = ln->head;
+
+    switch (ln->state) {
+    case SER_STATE_IDLE:
+        if (!req) {
+            return;
+        }
+        noInterrupts();
+        ln->rx_len = 0;
+        ln->rx_done = 0;
+        ln->rx_raw = req->cmd_len != 0;
+        ln->rx_term = req->term;
+        ln->state = SER_STATE_RX;
+        interrupts();
+        /* a command fits the TX ring, write does not wait */
+        if (ln->rx_raw) {
+            TRACE_FRAME(TRACE_RS232 | TRACE_TX, micros(), (const uint8_t *)req->cmd, req->cmd_len, NULL, 0);
+            ln->port->write((const uint8_t *)req->cmd, req->cmd_len);
+        } else {
+            TRACE_FRAME(TRACE_RS232 | TRACE_TX, micros(), (const uint8_t *)req->cmd, strlen(req->cmd),
+                        (const uint8_t *)ln->eol, strlen(ln->eol));
+            ln->port->write(req->cmd);
+            ln->port->write(ln->eol);
+        }
+        ln->tx_ms = millis();
+        return;
+
+    case SER_STATE_RX:
+        if (ln->rx_done) {
+            ser_line_complete(ln, SER_OK);
+        } else if (ln->rx_len && ser_line_quiet_ms(ln) >= ln->gap_ms) {
+            ser_line_complete(ln, *ln->term && !ln->rx_raw ? SER_ERR_FRAME : SER_OK);
+        } else if (!ln->rx_len && (uint32_t)(millis() - ln->tx_ms) >=
+                   (req->timeout_ms ? req->timeout_ms : ln->timeout_ms)) {
+            ser_line_complete(ln, SER_ERR_TIMEOUT);
+        }
+        return;
+    }
+}
+
+
+uint8_t
+ser_line_busy(struct ser_line *ln)
+{
+    return ln->head != NULL;
+}
+
+
+int
+ser_query(struct ser_line *ln, const char *cmd, char *buf, uint16_t size)
+{
+    struct ser_req req = { NULL, cmd, buf, size, 0, NULL, NULL, 0, 0, 0, 0, 0 };
+    int rc;
+
+    rc = ser_line_submit(ln, &req);
+    if (rc != SER_OK) {
+        return rc;
+    }
+    while (req.busy) {
+        ser_line_poll(ln);
+    }
+    return req.rc;
+}
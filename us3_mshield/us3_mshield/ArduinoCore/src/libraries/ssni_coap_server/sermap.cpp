@@ -0,0 +1,206 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+#include "sermap.h"
+
+
+static const int32_t ser_pow10[SER_MAX_DECIMALS + 1] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000
+};
+
+
+#define SER_IS_SPACE(c)         ((c) == ' ' || (c) == '\t')
+
+
+uint8_t
+ser_split(const char *line, uint16_t len, char sep, struct ser_span *span, uint8_t max)
+{
+    const char *p = line;
+    const char *end = line + len;
+    const char *q;
+    uint8_t n = 0;
+
+    while (n < max) {
+        while (p < end && SER_IS_SPACE(*p)) {
+            p++;
+        }
+        if (p == end && (sep == ' ' || !n || p[-1] != sep)) {
+            /* nothing after the last sep, or a blank line */
+            break;
+        }
+        for (q = p; q < end && *q != sep && !(sep == ' ' && SER_IS_SPACE(*q)); q++)
+            ;
+        span[n].p = p;
+        span[n].len = q - p;
+        while (span[n].len && SER_IS_SPACE(p[span[n].len - 1])) {
+            span[n].len--;
+        }
+        n++;
+        if (q == end) {
+            break;
+        }
+        p = q + 1;
+    }
+    return n;
+}
+
+
+uint8_t
+ser_parse_fixed(const char *p, uint8_t len, uint8_t decimals, int32_t *v)
+{
+    uint8_t i = 0, digits = 0, frac = 0, neg = 0, dot = 0, up = 0;
+    uint32_t n = 0;
+    uint8_t d;
+
+    if (decimals > SER_MAX_DECIMALS) {
+        return 0;
+    }
+    if (i < len && (p[i] == '-' || p[i] == '+')) {
+        neg = (p[i] == '-');
+        i++;
+    }
+    for (; i < len; i++) {
+        if (p[i] == '.' && !dot) {
+            dot = 1;
+            continue;
+        }
+        if (p[i] < '0' || p[i] > '9') {
+            break;
+        }
+        d = p[i] - '0';
+        digits++;
+        if (dot && frac >= decimals) {
+            /* the first digit past the ones kept rounds, the rest go */
+            if (frac++ == decimals) {
+                up = (d >= 5);
+            }
+            continue;
+        }
+        if (n > (0x7fffffffUL - d) / 10) {
+            return 0;
+        }
+        n = n * 10 + d;
+        frac += dot;
+    }
+    if (!digits) {
+        return 0;
+    }
+    if (frac < decimals) {
+        if (n > 0x7fffffffUL / ser_pow10[decimals - frac]) {
+            return 0;
+        }
+        n *= ser_pow10[decimals - frac];
+    }
+    n += up;
+    if (n > 0x7fffffffUL) {
+        return 0;
+    }
+    *v = neg ? -(int32_t)n : (int32_t)n;
+    return i;
+}
+
+
+void
+ser_record_init(struct ser_record *rec, const struct ser_field *map,
+                uint8_t n, float *value, uint32_t *stamp_ms,
+                uint8_t *quality, uint32_t max_age_ms)
+{
+    rec->map = map;
+    rec->n = n;
+    rec->value = value;
+    rec->stamp_ms = stamp_ms;
+    rec->quality = quality;
+    rec->max_age_ms = max_age_ms;
+    memset(value, 0, n * sizeof(value[0]));
+    memset(stamp_ms, 0, n * sizeof(stamp_ms[0]));
+    memset(quality, MB_Q_NONE, n);
+}
+
+
+uint8_t
+ser_record_parse(struct ser_record *rec, const char *line, uint16_t len, char sep)
+{
+    struct ser_span span[SER_MAP_MAX_FIELDS];
+    const struct ser_field *f;
+    uint32_t now = millis();
+    uint8_t nspan, i, taken = 0;
+    int32_t v;
+
+    nspan = ser_split(line, len, sep, span, SER_MAP_MAX_FIELDS);
+    for (i = 0; i < rec->n; i++) {
+        f = &rec->map[i];
+        if (f->index < nspan && ser_parse_fixed(span[f->index].p, span[f->index].len, f->decimals, &v)) {
+            rec->value[i] = (float)v / ser_pow10[f->decimals] * f->scale + f->offset;
+            rec->stamp_ms[i] = now;
+            rec->quality[i] = MB_Q_GOOD;
+            taken++;
+        } else if (rec->quality[i] == MB_Q_GOOD) {
+            rec->quality[i] = MB_Q_STALE;
+        }
+    }
+    return taken;
+}
+
+
+void
+ser_record_fail(struct ser_record *rec)
+{
+    uint8_t i;
+
+    for (i = 0; i < rec->n; i++) {
+        if (rec->quality[i] == MB_Q_GOOD) {
+            rec->quality[i] = MB_Q_STALE;
+        }
+    }
+}
+
+
+uint8_t
+ser_field_read(const struct ser_field *f, const struct ser_record *rec,
+               float *value, uint32_t *age_ms)
+{
+    uint8_t i = f - rec->map;
+    uint32_t age;
+    uint8_t q;
+
+    if (f < rec->map || i >= rec->n || rec->quality[i] == MB_Q_NONE) {
+        return MB_Q_NONE;
+    }
+    age = millis() - rec->stamp_ms[i];
+    q = rec->quality[i];
+    if (rec->max_age_ms && age > rec->max_age_ms) {
+        q = MB_Q_STALE;
+    }
+    *value = rec->value[i];
+    if (age_ms) {
+        *age_ms = age;
+    }
+    return q;
+}
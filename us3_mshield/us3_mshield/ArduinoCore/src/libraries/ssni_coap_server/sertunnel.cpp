@@ -0,0 +1,185 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+#include "sertunnel.h"
+#include "cbor.h"
+
+/* Fields of an exchange */
+#define SER_TUNNEL_FIELDS       3
+
+
+int
+ser_tunnel_parse(struct ser_tunnel *t, const uint8_t *buf, int len)
+{
+    struct cbor_buf cbuf;
+    struct ser_tunnel_op *op;
+    const uint8_t *p;
+    uint16_t ntx = 0;
+    int plen, term, tmo;
+    int n, i;
+
+    if (t->busy) {
+        return SER_ERR_BUSY;
+    }
+    cbor_dec_init(&cbuf, (void *)buf, len);
+    if (cbor_dec_well_formed(&cbuf) != CBOR_OK) {
+        return SER_ERR_ARG;
+    }
+    n = cbor_dec_array(&cbuf);
+    if (n == CBOR_ERR) {
+        return SER_ERR_ARG;
+    }
+    for (i = 0; ; i++) {
+        if (n == CBOR_DEC_INDEF ? cbor_dec_indef_break(&cbuf) : i >= n) {
+            break;
+        }
+        if (i >= SER_TUNNEL_MAX || cbor_dec_array(&cbuf) != SER_TUNNEL_FIELDS) {
+            return SER_ERR_ARG;
+        }
+        if (cbor_dec_major_type(&cbuf) == CBOR_TYPE_TEXT) {
+            p = (const uint8_t *)cbor_dec_text(&cbuf, &plen);
+        } else {
+            p = cbor_dec_bytes(&cbuf, &plen);
+        }
+        if (!p || cbor_dec_int(&cbuf, &term) != CBOR_OK ||
+            cbor_dec_int(&cbuf, &tmo) != CBOR_OK) {
+            return SER_ERR_ARG;
+        }
+        /* nothing to send is not an exchange */
+        if (plen < 1 || plen > SER_TUNNEL_CMD_MAX || ntx + plen > SER_TUNNEL_TX_MAX ||
+            term > 0xff || tmo < 0 || tmo > SER_TUNNEL_TIMEOUT_MAX) {
+            return SER_ERR_ARG;
+        }
+        op = &t->op[i];
+        memcpy(&t->tx[ntx], p, plen);
+        op->off = ntx;
+        op->len = plen;
+        op->term = term < 0 ? SER_TERM_NONE : term;
+        op->timeout_ms = tmo;
+        op->rx_off = 0;
+        op->rx_len = 0;
+        op->rc = SER_ERR_TIMEOUT;
+        ntx += plen;
+    }
+    if (!i || cbuf.next != cbuf.tail) {
+        return SER_ERR_ARG;
+    }
+    t->n = i;
+    return i;
+}
+
+
+/* Queue the next exchange of the tunnel, or end it past the last */
+static void
+ser_tunnel_next(struct ser_tunnel *t)
+{
+    struct ser_tunnel_op *op;
+
+    for (; t->step < t->n; t->step++) {
+        op = &t->op[t->step];
+        op->rx_off = t->rx_used;
+        op->rx_len = 0;
+        if (t->rx_used >= SER_TUNNEL_RX_MAX) {
+            /* the answers before took all the room */
+            op->rc = SER_ERR_OVERFLOW;
+            continue;
+        }
+        t->req.cmd = (const char *)&t->tx[op->off];
+        t->req.cmd_len = op->len;
+        t->req.term = op->term;
+        t->req.timeout_ms = op->timeout_ms;
+        t->req.buf = (char *)&t->rx[op->rx_off];
+        t->req.size = SER_TUNNEL_RX_MAX - op->rx_off;
+        if ((op->rc = ser_line_submit(t->ln, &t->req)) == SER_OK) {
+            return;
+        }
+    }
+
+    t->busy = 0;
+    if (t->done) {
+        t->done(t);
+    }
+}
+
+
+static void
+ser_tunnel_step(struct ser_req *req)
+{
+    struct ser_tunnel *t = (struct ser_tunnel *)req->arg;
+    struct ser_tunnel_op *op = &t->op[t->step++];
+
+    op->rc = req->rc;
+    op->rx_len = req->len;
+    t->rx_used += req->len;
+    ser_tunnel_next(t);
+}
+
+
+int
+ser_tunnel_start(struct ser_line *ln, struct ser_tunnel *t, ser_tunnel_fn done)
+{
+    if (t->busy) {
+        return SER_ERR_BUSY;
+    }
+    if (!t->n) {
+        return SER_ERR_ARG;
+    }
+    t->ln = ln;
+    t->step = 0;
+    t->rx_used = 0;
+    t->done = done;
+    t->req.done = ser_tunnel_step;
+    t->req.arg = t;
+    t->busy = 1;
+    ser_tunnel_next(t);
+    return SER_OK;
+}
+
+
+int
+ser_tunnel_encode(const struct ser_tunnel *t, uint8_t *buf, int len)
+{
+    const struct ser_tunnel_op *op;
+    struct cbor_buf cbuf;
+    int rc;
+    int i;
+
+    cbor_enc_init(&cbuf, buf, len);
+    rc = cbor_enc_array(&cbuf, t->n);
+    for (i = 0; i < t->n && !rc; i++) {
+        op = &t->op[i];
+        if (op->rc != SER_OK) {
+            rc = cbor_enc_int(&cbuf, op->rc);
+        } else {
+            rc = cbor_enc_bytes(&cbuf, &t->rx[op->rx_off], op->rx_len);
+        }
+    }
+    return rc ? SER_ERR_ARG : (int)cbor_buf_get_len(&cbuf);
+}
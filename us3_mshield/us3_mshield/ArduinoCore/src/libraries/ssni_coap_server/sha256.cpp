@@ -0,0 +1,201 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+
+
+#include <string.h>
+#include "sha256.h"
+
+
+#define SHA256_ROR(x, n)        (((x) >> (n)) | ((x) << (32 - (n))))
+
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+
+/* One block into the state. The schedule is kept 16 words at a time. */
+static void
+sha256_block(struct sha256 *s, const uint8_t *p)
+{
+    uint32_t w[16];
+    uint32_t v[8];
+    uint32_t t1, t2;
+    uint8_t i;
+
+    for (i = 0; i < 16; i++) {
+        w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 |
+                (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+    }
+    memcpy(v, s->h, sizeof(v));
+
+    for (i = 0; i < 64; i++) {
+        if (i >= 16) {
+            t1 = w[(i + 1) & 15];
+            t2 = w[(i + 14) & 15];
+            w[i & 15] += w[(i + 9) & 15] +
+                    (SHA256_ROR(t1, 7) ^ SHA256_ROR(t1, 18) ^ (t1 >> 3)) +
+                    (SHA256_ROR(t2, 17) ^ SHA256_ROR(t2, 19) ^ (t2 >> 10));
+        }
+        t1 = v[7] + (SHA256_ROR(v[4], 6) ^ SHA256_ROR(v[4], 11) ^ SHA256_ROR(v[4], 25)) +
+                ((v[4] & v[5]) ^ (~v[4] & v[6])) + sha256_k[i] + w[i & 15];
+        t2 = (SHA256_ROR(v[0], 2) ^ SHA256_ROR(v[0], 13) ^ SHA256_ROR(v[0], 22)) +
+                ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+        memmove(&v[1], &v[0], 7 * sizeof(v[0]));
+        v[4] += t1;
+        v[0] = t1 + t2;
+    }
+
+    for (i = 0; i < 8; i++) {
+        s->h[i] += v[i];
+    }
+}
+
+
+void
+sha256_init(struct sha256 *s)
+{
+    static const uint32_t h0[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+
+    memcpy(s->h, h0, sizeof(s->h));
+    s->len = 0;
+}
+
+
+void
+sha256_update(struct sha256 *s, const void *data, uint32_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    uint32_t used = s->len % SHA256_BLOCK;
+    uint32_t n;
+
+    s->len += len;
+    while (len) {
+        n = SHA256_BLOCK - used;
+        if (!used && len >= SHA256_BLOCK) {
+            sha256_block(s, p);
+        } else {
+            n = (len < n) ? len : n;
+            memcpy(&s->buf[used], p, n);
+            used = (used + n) % SHA256_BLOCK;
+            if (!used) {
+                sha256_block(s, s->buf);
+            }
+        }
+        p += n;
+        len -= n;
+    }
+}
+
+
+/* The padding and the bit length, big endian, then the digest */
+void
+sha256_final(struct sha256 *s, uint8_t digest[SHA256_SIZE])
+{
+    const uint32_t bits = s->len << 3;
+    uint32_t used = s->len % SHA256_BLOCK;
+    uint8_t i;
+
+    s->buf[used++] = 0x80;
+    if (used > SHA256_BLOCK - 8) {
+        memset(&s->buf[used], 0, SHA256_BLOCK - used);
+        sha256_block(s, s->buf);
+        used = 0;
+    }
+    memset(&s->buf[used], 0, SHA256_BLOCK - 4 - used);
+    s->buf[SHA256_BLOCK - 5] = (uint8_t)(s->len >> 29);
+    for (i = 0; i < 4; i++) {
+        s->buf[SHA256_BLOCK - 1 - i] = (uint8_t)(bits >> (8 * i));
+    }
+    sha256_block(s, s->buf);
+
+    for (i = 0; i < SHA256_SIZE; i++) {
+        digest[i] = (uint8_t)(s->h[i / 4] >> (24 - 8 * (i % 4)));
+    }
+}
+
+
+void
+hmac_sha256_init(struct hmac_sha256 *h, const uint8_t *key, uint32_t len)
+{
+    uint8_t pad[SHA256_BLOCK];
+    uint8_t i;
+
+    memset(pad, 0, sizeof(pad));
+    if (len > SHA256_BLOCK) {
+        sha256_init(&h->inner);
+        sha256_update(&h->inner, key, len);
+        sha256_final(&h->inner, pad);
+    } else {
+        memcpy(pad, key, len);
+    }
+
+    for (i = 0; i < SHA256_BLOCK; i++) {
+        pad[i] ^= 0x36;
+    }
+    sha256_init(&h->inner);
+    sha256_update(&h->inner, pad, sizeof(pad));
+
+    for (i = 0; i < SHA256_BLOCK; i++) {
+        pad[i] ^= 0x36 ^ 0x5c;
+    }
+    sha256_init(&h->outer);
+    sha256_update(&h->outer, pad, sizeof(pad));
+    memset(pad, 0, sizeof(pad));
+}
+
+
+void
+hmac_sha256_update(struct hmac_sha256 *h, const void *data, uint32_t len)
+{
+    sha256_update(&h->inner, data, len);
+}
+
+
+void
+hmac_sha256_final(struct hmac_sha256 *h, uint8_t mac[SHA256_SIZE])
+{
+    uint8_t digest[SHA256_SIZE];
+
+    sha256_final(&h->inner, digest);
+    sha256_update(&h->outer, digest, sizeof(digest));
+    sha256_final(&h->outer, mac);
+}
@@ -0,0 +1,211 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+
+
+
+#include <Arduino.h>
+#include <SPIMemory.h>
+#include <string.h>
+#include "total.h"
+#include "crc_xmodem.h"
+#include "log.h"
+
+
+/* A saved total, a record of the log sector */
+struct total_rec {
+    uint8_t mark;               /* TOTAL_REC_MARK, 0xFF -> end of the log */
+    uint8_t index;              /* Total, in the order set */
+    uint16_t crc;               /* crc_xmodem of index and total */
+    double total;               /* Total when saved */
+};
+
+// SPI flash of SAPI, out of deep power-down before each access
+extern SPIFlash flash;
+void sapi_flash_wake();
+
+struct total totals[TOTAL_MAX];
+
+/* Next free record of the log, 0 until read */
+static uint32_t total_log_next;
+
+
+void
+total_init(void)
+{
+    memset(totals, 0, sizeof(totals));
+}
+
+
+/* CRC of a record, over the index and the total */
+static uint16_t
+total_rec_crc(const struct total_rec *rec)
+{
+    uint16_t crc = crc_xmodem(crc_xmodem_init(), &rec->index, sizeof(rec->index));
+
+    return crc_xmodem(crc, &rec->total, sizeof(rec->total));
+}
+
+
+/* The last saved value of a total, 0 if none, and where the log ends */
+static double
+total_load(uint8_t index)
+{
+    struct total_rec rec;
+    uint32_t addr;
+    double total = 0;
+
+    sapi_flash_wake();
+    for (addr = TOTAL_LOG_ADDR; addr < TOTAL_LOG_ADDR + TOTAL_LOG_SIZE; addr += sizeof(rec)) {
+        flash.readByteArray(addr, (uint8_t *)&rec, sizeof(rec));
+        if (rec.mark == 0xFF) {
+            break;
+        }
+        if (rec.mark == TOTAL_REC_MARK && rec.index == index && rec.crc == total_rec_crc(&rec)) {
+            total = rec.total;
+        }
+    }
+    total_log_next = addr;
+    return total;
+}
+
+
+/* Save a total, one record. Once the log is full it is erased and every
+ * total written at its start instead. */
+static bool
+total_save(uint8_t index)
+{
+    struct total_rec rec;
+    uint8_t i;
+
+    sapi_flash_wake();
+    if (total_log_next + sizeof(rec) > TOTAL_LOG_ADDR + TOTAL_LOG_SIZE) {
+        if (!flash.eraseSector(TOTAL_LOG_ADDR)) {
+            return false;
+        }
+        total_log_next = TOTAL_LOG_ADDR;
+        for (i = 0; i < TOTAL_MAX; i++) {
+            if (i != index && totals[i].out && !total_save(i)) {
+                return false;
+            }
+        }
+    }
+
+    memset(&rec, 0, sizeof(rec));
+    rec.mark = TOTAL_REC_MARK;
+    rec.index = index;
+    rec.total = totals[index].total;
+    rec.crc = total_rec_crc(&rec);
+    if (!flash.writeByteArray(total_log_next, (uint8_t *)&rec, sizeof(rec))) {
+        return false;
+    }
+    total_log_next += sizeof(rec);
+    totals[index].saved_ms = millis();
+    totals[index].dirty = 0;
+    return true;
+}
+
+
+sapi_error_t
+total_set(uint8_t sensor_id, uint8_t datatype, uint8_t out, float scale)
+{
+    struct total *t;
+    uint8_t indx;
+
+    for (indx = 0; indx < TOTAL_MAX && totals[indx].out &&
+            (totals[indx].sensor_id != sensor_id || totals[indx].out != out); indx++) {
+        ;
+    }
+    if (indx == TOTAL_MAX) {
+        return SAPI_ERR_NO_MEM;
+    }
+
+    t = &totals[indx];
+    memset(t, 0, sizeof(*t));
+    t->total = total_load(indx);
+    t->scale = scale;
+    t->saved_ms = millis();
+    t->sensor_id = sensor_id;
+    t->datatype = datatype;
+    t->out = out;
+    DLOG_DEBUG("Total %d of sensor: %d resumed at %ld", indx, sensor_id, (long)t->total);
+    return SAPI_ERR_OK;
+}
+
+
+sapi_error_t
+total_reset(uint8_t sensor_id, uint8_t out)
+{
+    uint8_t indx;
+
+    for (indx = 0; indx < TOTAL_MAX; indx++) {
+        if (out && totals[indx].out == out && totals[indx].sensor_id == sensor_id) {
+            totals[indx].total = 0;
+            return total_save(indx) ? SAPI_ERR_OK : SAPI_ERR_FAIL;
+        }
+    }
+    return SAPI_ERR_NO_ENTRY;
+}
+
+
+void
+total_add(uint8_t sensor_id, const sapi_sample_t *sample, uint32_t now_ms)
+{
+    struct total *t;
+    uint8_t indx;
+
+    for (indx = 0; indx < TOTAL_MAX; indx++) {
+        t = &totals[indx];
+        if (!t->out || t->sensor_id != sensor_id || t->datatype != sample->datatype) {
+            continue;
+        }
+        if (t->primed && now_ms != t->last_ms) {
+            t->total += (t->last + sample->value) / 2.0 * (uint32_t)(now_ms - t->last_ms) / 1000.0 * t->scale;
+            t->dirty = 1;
+        }
+        t->last = sample->value;
+        t->last_ms = now_ms;
+        t->primed = 1;
+    }
+}
+
+
+void
+total_poll(void)
+{
+    uint8_t indx;
+
+    for (indx = 0; indx < TOTAL_MAX; indx++) {
+        if (totals[indx].dirty && (uint32_t)(millis() - totals[indx].saved_ms) >= TOTAL_SAVE_MS) {
+            (void)total_save(indx);
+        }
+    }
+}
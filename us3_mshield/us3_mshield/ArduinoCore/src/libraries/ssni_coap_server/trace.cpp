@@ -0,0 +1,146 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+#include "trace.h"
+#include "log.h"
+
+
+#if TRACE
+static uint8_t trace_ring[TRACE_SIZE];
+static uint16_t trace_head;         /* next byte written */
+static uint16_t trace_used;
+static uint16_t trace_recs;
+
+#define TRACE_AT(i)             trace_ring[(i) % TRACE_SIZE]
+#define TRACE_TAIL()            ((trace_head + TRACE_SIZE - trace_used) % TRACE_SIZE)
+#define TRACE_REC(i)            (TRACE_HDR + TRACE_AT((i) + 1))
+
+static const char *trace_port_name[] = { "hdlc", "rs485", "rs232" };
+#define TRACE_PORTS             (sizeof(trace_port_name) / sizeof(trace_port_name[0]))
+
+
+void
+trace_frame(uint8_t head, uint32_t us, const uint8_t *hdr, uint16_t hdrlen,
+            const uint8_t *data, uint16_t len)
+{
+    uint16_t total;
+    uint8_t kept;
+    uint8_t i;
+
+    if (!hdr) {
+        hdrlen = 0;
+    }
+    if (!data) {
+        len = 0;
+    }
+    total = hdrlen + len;
+    kept = min(total, TRACE_KEEP);
+
+    /* drop the oldest records until this one fits */
+    while (trace_used + TRACE_HDR + kept > TRACE_SIZE) {
+        trace_used -= TRACE_REC(TRACE_TAIL());
+        trace_recs--;
+    }
+    TRACE_AT(trace_head) = head;
+    TRACE_AT(trace_head + 1) = kept;
+    TRACE_AT(trace_head + 2) = total;
+    TRACE_AT(trace_head + 3) = total >> 8;
+    for (i = 0; i < 4; i++) {
+        TRACE_AT(trace_head + 4 + i) = us >> (8 * i);
+    }
+    for (i = 0; i < kept; i++) {
+        TRACE_AT(trace_head + TRACE_HDR + i) = i < hdrlen ? hdr[i] : data[i - hdrlen];
+    }
+    trace_head = (trace_head + TRACE_HDR + kept) % TRACE_SIZE;
+    trace_used += TRACE_HDR + kept;
+    trace_recs++;
+}
+
+
+int
+trace_count(void)
+{
+    return trace_recs;
+}
+
+
+int
+trace_get(int n, uint8_t *buf)
+{
+    uint16_t at = TRACE_TAIL();
+    int rec;
+    int i;
+
+    if (n < 0 || n >= trace_recs) {
+        return 0;
+    }
+    while (n--) {
+        at = (at + TRACE_REC(at)) % TRACE_SIZE;
+    }
+    rec = TRACE_REC(at);
+    for (i = 0; i < rec; i++) {
+        buf[i] = TRACE_AT(at + i);
+    }
+    return rec;
+}
+
+
+void
+trace_clear(void)
+{
+    trace_used = 0;
+    trace_recs = 0;
+}
+
+
+void
+trace_dump(void)
+{
+    uint8_t rec[TRACE_HDR + TRACE_KEEP];
+    char line[48 + TRACE_KEEP * 3];
+    int n;
+    int i;
+
+    for (i = 0; i < trace_recs; i++) {
+        (void)trace_get(i, rec);
+        n = snprintf(line, sizeof(line), "%10lu %-5s %s%s %3u:",
+                     (unsigned long)(rec[4] | rec[5] << 8 | rec[6] << 16 | (uint32_t)rec[7] << 24),
+                     (rec[0] & TRACE_PORT_MASK) < TRACE_PORTS ? trace_port_name[rec[0] & TRACE_PORT_MASK] : "?",
+                     (rec[0] & TRACE_TX) ? "tx" : "rx", (rec[0] & TRACE_ERR) ? " err" : "",
+                     rec[2] | rec[3] << 8);
+        if (n > 0 && n < (int)sizeof(line) - 1 && rec[1]) {
+            line[n++] = ' ';
+            (void)log_hex(&line[n], &rec[TRACE_HDR], rec[1], ' ');
+        }
+        println(line);
+    }
+}
+#endif
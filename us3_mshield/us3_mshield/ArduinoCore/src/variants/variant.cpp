@@ -305,13 +305,19 @@ SERCOM sercom4( SERCOM4 ) ;
 SERCOM sercom5( SERCOM5 ) ;
 
 #if defined(ONE_UART) || defined(TWO_UART) || defined(THREE_UART)
-Uart Serial1( SERCOM_INSTANCE_SERIAL1, PIN_SERIAL1_RX, PIN_SERIAL1_TX, PAD_SERIAL1_RX, PAD_SERIAL1_TX ) ;
+static RingBufferN<SERIAL1_RX_BUFFER_SIZE> rxBufferSerial1;
+static RingBufferN<SERIAL1_TX_BUFFER_SIZE> txBufferSerial1;
+Uart Serial1( SERCOM_INSTANCE_SERIAL1, PIN_SERIAL1_RX, PIN_SERIAL1_TX, PAD_SERIAL1_RX, PAD_SERIAL1_TX, rxBufferSerial1, txBufferSerial1 ) ;
 
   #if (SAMD51)
     void SERCOM4_0_Handler(void) {
       Serial1.dataRegisterEmptyHandler();
     }
 
+    void SERCOM4_1_Handler(void) {
+      Serial1.transmitCompleteHandler();
+    }
+
     void SERCOM4_2_Handler(void) {
       Serial1.availableDataHandler();
     }
@@ -327,13 +333,19 @@ Uart Serial1( SERCOM_INSTANCE_SERIAL1, PIN_SERIAL1_RX, PIN_SERIAL1_TX, PAD_SERIA
 #endif
 
 #if defined(TWO_UART) || defined(THREE_UART)
-Uart Serial2( SERCOM_INSTANCE_SERIAL2, PIN_SERIAL2_RX, PIN_SERIAL2_TX, PAD_SERIAL2_RX, PAD_SERIAL2_TX ) ;
+static RingBufferN<SERIAL2_RX_BUFFER_SIZE> rxBufferSerial2;
+static RingBufferN<SERIAL2_TX_BUFFER_SIZE> txBufferSerial2;
+Uart Serial2( SERCOM_INSTANCE_SERIAL2, PIN_SERIAL2_RX, PIN_SERIAL2_TX, PAD_SERIAL2_RX, PAD_SERIAL2_TX, rxBufferSerial2, txBufferSerial2 ) ;
 
   #if (SAMD51)
     void SERCOM2_0_Handler(void) {
       Serial2.dataRegisterEmptyHandler();
     }
 
+    void SERCOM2_1_Handler(void) {
+      Serial2.transmitCompleteHandler();
+    }
+
     void SERCOM2_2_Handler(void) {
       Serial2.availableDataHandler();
     }
@@ -349,13 +361,19 @@ Uart Serial2( SERCOM_INSTANCE_SERIAL2, PIN_SERIAL2_RX, PIN_SERIAL2_TX, PAD_SERIA
 #endif
 
 #if defined(THREE_UART)
-Uart Serial3( SERCOM_INSTANCE_SERIAL3, PIN_SERIAL3_RX, PIN_SERIAL3_TX, PAD_SERIAL3_RX, PAD_SERIAL3_TX ) ;
+static RingBufferN<SERIAL3_RX_BUFFER_SIZE> rxBufferSerial3;
+static RingBufferN<SERIAL3_TX_BUFFER_SIZE> txBufferSerial3;
+Uart Serial3( SERCOM_INSTANCE_SERIAL3, PIN_SERIAL3_RX, PIN_SERIAL3_TX, PAD_SERIAL3_RX, PAD_SERIAL3_TX, rxBufferSerial3, txBufferSerial3 ) ;
 
   #if (SAMD51)
     void SERCOM3_0_Handler(void) {
       Serial3.dataRegisterEmptyHandler();
     }
 
+    void SERCOM3_1_Handler(void) {
+      Serial3.transmitCompleteHandler();
+    }
+
     void SERCOM3_2_Handler(void) {
       Serial3.availableDataHandler();
     }
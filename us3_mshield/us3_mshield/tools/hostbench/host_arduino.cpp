@@ -0,0 +1,227 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+/*
+ * The core functions the ssni_coap_server sources call, for the host build.
+ * Time is the monotonic clock, or the replay's once it sets one, pins and interrupts do nothing; there is no
+ * IRQ to race with, the bench feeds the deframer from the same thread.
+ */
+
+#include <time.h>
+#include <unistd.h>
+#include "Arduino.h"
+
+Uart Serial1;
+Serial_ SerialUSB;
+
+
+/* Replay time, see host_clock() */
+static bool clock_set;
+static uint64_t clock_us;
+
+
+uint64_t
+host_real_us(void)
+{
+    static uint64_t start;
+    struct timespec ts;
+    uint64_t now;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    now = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    if (!start) {
+        start = now;
+    }
+    return now - start;
+}
+
+
+void
+host_clock(uint64_t us)
+{
+    clock_set = true;
+    clock_us = us;
+}
+
+
+static uint64_t
+host_us(void)
+{
+    return clock_set ? clock_us : host_real_us();
+}
+
+
+unsigned long
+millis(void)
+{
+    return (unsigned long)(uint32_t)(host_us() / 1000);
+}
+
+
+unsigned long
+micros(void)
+{
+    return (unsigned long)(uint32_t)host_us();
+}
+
+
+void
+delay(unsigned long ms)
+{
+    if (clock_set) {
+        clock_us += ms * 1000ull;
+        return;
+    }
+    usleep(ms * 1000);
+}
+
+
+void
+delayMicroseconds(unsigned int us)
+{
+    if (clock_set) {
+        clock_us += us;
+        return;
+    }
+    usleep(us);
+}
+
+
+void pinMode(uint8_t pin, uint8_t mode) { (void)pin; (void)mode; }
+void digitalWrite(uint8_t pin, uint8_t val) { (void)pin; (void)val; }
+int digitalRead(uint8_t pin) { (void)pin; return LOW; }
+
+void noInterrupts(void) {}
+void interrupts(void) {}
+void __WFI(void) {}
+
+
+long
+random(long howbig)
+{
+    return howbig ? rand() % howbig : 0;
+}
+
+
+long
+random(long howsmall, long howbig)
+{
+    return howsmall >= howbig ? howsmall : howsmall + random(howbig - howsmall);
+}
+
+
+size_t
+Print::write(const uint8_t *buffer, size_t size)
+{
+    size_t n = 0;
+
+    while (size-- && write(*buffer++)) {
+        n++;
+    }
+    return n;
+}
+
+
+Uart::Uart() : baud(0), config(0), rxfn(NULL), txdonefn(NULL), txlen(0)
+{
+}
+
+
+void
+Uart::begin(unsigned long rate, uint16_t format)
+{
+    baud = rate;
+    config = format;
+}
+
+
+size_t
+Uart::write(uint8_t c)
+{
+    if (txlen >= sizeof(tx)) {
+        return 0;
+    }
+    tx[txlen++] = c;
+    return 1;
+}
+
+
+/* As the DMAC would, all the segments go out and done runs once they have */
+bool
+Uart::writeDMA(const uint8_t * const *seg, const uint16_t *seglen, uint8_t nseg,
+               void (*done)(void))
+{
+    uint8_t i;
+
+    for (i = 0; i < nseg; i++) {
+        if (seg[i]) {
+            write(seg[i], seglen[i]);
+        }
+    }
+    if (done) {
+        done();
+    }
+    return true;
+}
+
+
+size_t
+Uart::txTake(uint8_t *buf, size_t size)
+{
+    size_t n = min(txlen, size);
+
+    memcpy(buf, tx, n);
+    txlen = 0;
+    return n;
+}
+
+
+void
+Uart::rxFeed(const uint8_t *buf, size_t len)
+{
+    while (rxfn && len--) {
+        rxfn(*buf++);
+    }
+}
+
+
+size_t
+Serial_::write(uint8_t c)
+{
+    return fputc(c, stderr) == EOF ? 0 : 1;
+}
+
+
+size_t
+Serial_::write(const uint8_t *buffer, size_t size)
+{
+    return fwrite(buffer, 1, size, stderr);
+}
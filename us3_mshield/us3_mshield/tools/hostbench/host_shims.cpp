@@ -0,0 +1,171 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+/*
+ * What the benched sources need from log.cpp, arduino_time.cpp and the
+ * sketch, which are too tied to the mShield to build here. The log goes to
+ * stderr, off unless hostbench is run with -v.
+ */
+
+#include <stdarg.h>
+#include <time.h>
+#include "log.h"
+#include "arduino_time.h"
+#include "exp_coap.h"
+
+int host_log_level = -1;
+
+struct coap_stats coap_stats;
+uint8_t is_sapi;
+RTCZero rtc;
+
+static const char log_hexdig[] = "0123456789ABCDEF";
+
+
+int
+dlog_on(int level)
+{
+    return level <= host_log_level;
+}
+
+
+void
+dlog(int level, const char *my_format, ...)
+{
+    va_list args;
+
+    if (!dlog_on(level)) {
+        return;
+    }
+    va_start(args, my_format);
+    fprintf(stderr, "%lu: ", millis());
+    vfprintf(stderr, my_format, args);
+    fputc('\n', stderr);
+    va_end(args);
+}
+
+
+int
+log_hex(char *buf, const void *data, int len, char sep)
+{
+    const uint8_t *b = (const uint8_t *)data;
+    char *p = buf;
+    int i;
+
+    for (i = 0; i < len; i++) {
+        if (sep && i) {
+            *p++ = sep;
+        }
+        *p++ = log_hexdig[b[i] >> 4];
+        *p++ = log_hexdig[b[i] & 0x0f];
+    }
+    *p = 0;
+    return p - buf;
+}
+
+
+void
+ddump(int level, const char *label, const void *data, int datalen)
+{
+    const uint8_t *b = (const uint8_t *)data;
+    int i;
+
+    if (!dlog_on(level)) {
+        return;
+    }
+    fprintf(stderr, "%s:", label ? label : "");
+    for (i = 0; i < datalen; i++) {
+        fprintf(stderr, " %c%c", log_hexdig[b[i] >> 4], log_hexdig[b[i] & 0x0f]);
+    }
+    fputc('\n', stderr);
+}
+
+
+void
+log_msg(const char *label, const void *data, int datalen, int eol)
+{
+    if (!dlog_on(LOG_DEBUG)) {
+        return;
+    }
+    if (label) {
+        fprintf(stderr, "%s:", label);
+    }
+    for (int i = 0; data && i < datalen; i++) {
+        uint8_t c = ((const uint8_t *)data)[i];
+        fprintf(stderr, " %c%c", log_hexdig[c >> 4], log_hexdig[c & 0x0f]);
+    }
+    if (eol) {
+        fputc('\n', stderr);
+    }
+}
+
+
+void
+println(const char *buf)
+{
+    if (host_log_level >= 0) {
+        fprintf(stderr, "%s\n", buf);
+    }
+}
+
+
+int
+free_ram()
+{
+    return 0;
+}
+
+
+void
+mem_paint()
+{
+}
+
+
+time_t
+get_rtc_epoch()
+{
+    return time(NULL);
+}
+
+
+uint32_t
+RTCZero::getEpoch()
+{
+    return (uint32_t)time(NULL);
+}
+
+
+void
+RTCZero::setEpoch(uint32_t ts)
+{
+    (void)ts;
+}
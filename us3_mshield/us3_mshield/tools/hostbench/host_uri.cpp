@@ -0,0 +1,64 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+/*
+ * The resource of the host builds that run the CoAP server, in place of
+ * the sensor URIs of coapsensoruri.cpp: a GET of any path answers 2.05
+ * with a fixed reading, anything else 4.05.
+ */
+
+#include "Arduino.h"
+#include "hbuf.h"
+#include "coapmsg.h"
+#include "coappdu.h"
+#include "coapsensoruri.h"
+
+#define HOST_URI_PAYLOAD    "21.50"
+
+
+error_t
+coap_s_uri_proc(struct coap_msg_ctx *req, struct coap_msg_ctx *rsp)
+{
+    int len = sizeof(HOST_URI_PAYLOAD) - 1;
+
+    if (req->code == COAP_REQUEST_GET) {
+        memcpy(m_append(rsp->msg, len), HOST_URI_PAYLOAD, len);
+        rsp->plen = len;
+        rsp->cf = COAP_CF_TEXT_PLAIN;
+        rsp->code = COAP_RSP_205_CONTENT;
+    }
+    else {
+        rsp->code = COAP_RSP_405_METHOD_NOT_ALLOWED;
+    }
+    rsp->final = 1;
+    rsp->type = req->type == COAP_T_CONF_VAL ? COAP_T_ACK_VAL : COAP_T_NCONF_VAL;
+    return ERR_OK;
+}
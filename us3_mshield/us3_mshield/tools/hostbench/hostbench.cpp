@@ -0,0 +1,418 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+/*
+ * hostbench, times the HDLC framer and deframer, the CoAP parser and
+ * response builder, the CBOR encoder, the sample blocks and the mbuf
+ * pools on a PC, built
+ * from the same sources as the firmware:
+ *
+ *   make && ./hostbench [-v] [-t ms]
+ *
+ * Frames go out through the mock Uart of host_arduino.cpp and come back in
+ * through its onReceive() callback, as the SERCOM IRQ hands them to
+ * hdlc_rx_byte() on the mShield. The numbers are for comparing one change
+ * against another, not the M0+ itself; -v turns the log on at LOG_DEBUG,
+ * -t sets how long each case runs for (default 200 ms).
+ */
+
+#include <time.h>
+#include <unistd.h>
+#include "Arduino.h"
+#include "hdlc.h"
+#include "hbuf.h"
+#include "crc_xmodem.h"
+#include "coapmsg.h"
+#include "coappdu.h"
+#include "cbor.h"
+#include "sblk.h"
+#include "log.h"
+
+extern int host_log_level;
+
+#define BENCH_INFO_LEN      (256)
+#define BENCH_PAYLOAD_LEN   (32)
+#define BENCH_FRAME_MAX     (1 + HDLC_HDR_SIZE + BENCH_INFO_LEN + HDLC_CRC_SIZE + 1)
+
+/* CON GET /sensor/arduino/temp, token abcd */
+static const uint8_t bench_get[] = {
+    0x42, 0x01, 0x12, 0x34, 0xab, 0xcd,
+    0xb6, 's', 'e', 'n', 's', 'o', 'r',
+    0x07, 'a', 'r', 'd', 'u', 'i', 'n', 'o',
+    0x04, 't', 'e', 'm', 'p',
+};
+
+static uint8_t info[BENCH_INFO_LEN];
+static uint8_t hdr[HDLC_HDR_SIZE];
+static uint8_t frame[BENCH_FRAME_MAX];
+static size_t framelen;
+static struct coap_msg_ctx req;
+static volatile uint32_t sink;
+
+
+static uint64_t
+bench_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+static void
+bench_crc16(void)
+{
+    sink += crc16(CRC16_FINAL, info, sizeof(info));
+}
+
+
+static void
+bench_hdlc_send(void)
+{
+    hdlc_send_frame(hdr, info, sizeof(info));
+    sink += Serial1.txTake(frame, sizeof(frame));
+}
+
+
+static void
+bench_hdlc_recv(void)
+{
+    uint8_t rhdr[HDLC_HDR_SIZE];
+    struct mbuf *m;
+
+    Serial1.rxFeed(frame, framelen);
+    sink += hdlc_rx_poll(rhdr, &m);
+    if (m) {
+        m_free(m);
+    }
+}
+
+
+static struct mbuf *
+bench_request(void)
+{
+    struct mbuf *m = m_get();
+
+    memcpy(m_append(m, sizeof(bench_get)), bench_get, sizeof(bench_get));
+    return m;
+}
+
+
+static void
+bench_coap_parse(void)
+{
+    struct coap_msg_ctx cc;
+    struct mbuf *m = bench_request();
+    uint8_t code;
+
+    memset(&cc, 0, sizeof(cc));
+    copt_init((sl_co *)&cc.oh);
+    sink += coap_msg_parse(&cc, m, &code);
+    m_free(m);
+}
+
+
+static void
+bench_coap_response(void)
+{
+    struct coap_msg_ctx rsp;
+    struct mbuf *r = m_get();
+
+    m_reserve(r, COAP_RSP_HEADROOM);
+    memset(m_append(r, BENCH_PAYLOAD_LEN), 0x55, BENCH_PAYLOAD_LEN);
+    coap_init_rsp(&req, &rsp, r);
+    rsp.code = COAP_RSP_205_CONTENT;
+    rsp.plen = BENCH_PAYLOAD_LEN;
+    sink += coap_msg_response(&rsp);
+    m_free(rsp.msg);
+}
+
+
+static void
+bench_cbor(void)
+{
+    static const float vals[8] = { 21.5f, 21.25f, 21.0f, 20.75f, 20.5f, 20.5f, 20.25f, 20.0f };
+    uint8_t buf[128];
+    struct cbor_buf cb;
+
+    cbor_enc_init(&cb, buf, sizeof(buf));
+    cbor_enc_map(&cb, 3);
+    cbor_enc_text(&cb, "t", 1);
+    cbor_enc_uint(&cb, 1700000000);
+    cbor_enc_text(&cb, "id", 2);
+    cbor_enc_text(&cb, "temp", 4);
+    cbor_enc_text(&cb, "v", 1);
+    cbor_enc_typed_float32(&cb, vals, 8);
+    sink += cbor_buf_get_len(&cb);
+}
+
+
+/* A level sampled every 30 s, drifting by a few hundredths */
+static const float bench_levels[8] = { 21.5f, 21.52f, 21.55f, 21.51f, 21.49f, 21.5f, 21.47f, 21.46f };
+
+static uint8_t
+bench_sblk_enc(uint8_t *buf, uint16_t size)
+{
+    struct sblk b;
+    uint8_t i;
+
+    if (sblk_start(&b, buf, size, 1, 2, 1700000000, 0, bench_levels[0])) {
+        return 0;
+    }
+    for (i = 1; i < 8; i++) {
+        if (sblk_add(&b, 1700000000 + i * 30, 0, bench_levels[i])) {
+            return 0;
+        }
+    }
+    return sblk_end(&b);
+}
+
+
+static void
+bench_sblk(void)
+{
+    uint8_t buf[SBLK_MAX_LEN];
+
+    sink += bench_sblk_enc(buf, sizeof(buf));
+}
+
+
+/* Level, velocity, flow and battery sampled together every 30 s, the level above */
+static const float bench_vels[8] = { 0.41f, 0.44f, 0.39f, 0.42f, 0.47f, 0.40f, 0.38f, 0.43f };
+static const float bench_flows[8] = { 12.1f, 12.9f, 11.6f, 12.4f, 13.8f, 11.9f, 11.2f, 12.7f };
+static const uint8_t bench_cols_dt[4] = { 3, 4, 5, 6 };
+
+static int
+bench_sblk_cols_enc(uint8_t *buf, uint16_t size)
+{
+    uint32_t epoch[8];
+    float values[8 * 4];
+    uint8_t i;
+
+    for (i = 0; i < 8; i++) {
+        epoch[i] = 1700000000 + i * 30;
+        values[i * 4] = bench_levels[i];
+        values[i * 4 + 1] = bench_vels[i];
+        values[i * 4 + 2] = bench_flows[i];
+        values[i * 4 + 3] = 3.61f;
+    }
+    return sblk_cols(buf, size, 2, epoch, NULL, 8, bench_cols_dt, values, 4);
+}
+
+
+static void
+bench_sblk_cols(void)
+{
+    uint8_t buf[SBLK_MAX_LEN];
+
+    sink += bench_sblk_cols_enc(buf, sizeof(buf));
+}
+
+
+static void
+bench_mbuf(void)
+{
+    struct mbuf *m = m_get();
+
+    sink += m ? m->size : 0;
+    m_free(m);
+}
+
+
+struct bench {
+    const char *name;
+    void (*fn)(void);
+    uint32_t bytes;     /* per call, for the MB/s column, 0 for none */
+};
+
+static const struct bench benches[] = {
+    { "crc16 256B",              bench_crc16,         BENCH_INFO_LEN },
+    { "hdlc_send_frame 256B",    bench_hdlc_send,     BENCH_INFO_LEN },
+    { "hdlc_rx_byte+poll 256B",  bench_hdlc_recv,     BENCH_INFO_LEN },
+    { "coap_msg_parse GET",      bench_coap_parse,    sizeof(bench_get) },
+    { "coap_msg_response 32B",   bench_coap_response, BENCH_PAYLOAD_LEN },
+    { "cbor map+float32[8]",     bench_cbor,          0 },
+    { "sblk 8 samples",          bench_sblk,          0 },
+    { "sblk_cols 8 rows x 4",    bench_sblk_cols,     0 },
+    { "m_get+m_free",            bench_mbuf,          0 },
+};
+
+
+/* Run fn in doubling batches until a batch takes at least ms */
+static void
+bench_run(const struct bench *b, uint32_t ms)
+{
+    uint64_t iters = 1;
+    uint64_t t0, dt;
+    uint64_t i;
+    double ns;
+
+    for (;;) {
+        t0 = bench_ns();
+        for (i = 0; i < iters; i++) {
+            b->fn();
+        }
+        dt = bench_ns() - t0;
+        if (dt >= (uint64_t)ms * 1000000 || iters >= (1ull << 40)) {
+            break;
+        }
+        iters *= 2;
+    }
+    ns = (double)dt / iters;
+    if (b->bytes) {
+        printf("%-26s %12llu %10.1f %10.1f\n", b->name, (unsigned long long)iters, ns,
+               b->bytes * 1000.0 / ns);
+    }
+    else {
+        printf("%-26s %12llu %10.1f %10s\n", b->name, (unsigned long long)iters, ns, "-");
+    }
+}
+
+
+/* Link and message state the cases share, checked once so a broken build
+ * doesn't get timed */
+static int
+bench_setup(void)
+{
+    struct hdlc_hdr_tmpl t;
+    uint8_t rhdr[HDLC_HDR_SIZE];
+    struct mbuf *m;
+    uint8_t code;
+    size_t i;
+    int rc;
+
+    for (i = 0; i < sizeof(info); i++) {
+        info[i] = (uint8_t)(i * 7 + 1);
+    }
+    hdlc_init(&Serial1, NULL, BENCH_INFO_LEN);
+    hdlc_hdr_tmpl_init(&t, hdlc_addr_encode(0x10), hdlc_addr_encode(0x01));
+    hdlc_hdr_tmpl_fill(&t, 0, hdlc_control_i(0, 0, 1), sizeof(info), hdr);
+
+    if (hdlc_send_frame(hdr, info, sizeof(info))) {
+        fprintf(stderr, "hdlc_send_frame failed\n");
+        return -1;
+    }
+    framelen = Serial1.txTake(frame, sizeof(frame));
+    Serial1.rxFeed(frame, framelen);
+    rc = hdlc_rx_poll(rhdr, &m);
+    if (!m || m_pktlen(m) != (int)sizeof(info) || memcmp(mtod(m, uint8_t *), info, sizeof(info))) {
+        fprintf(stderr, "HDLC loopback failed, %d, %u bytes out\n", rc, (unsigned)framelen);
+        return -1;
+    }
+    m_free(m);
+
+    m = bench_request();
+    memset(&req, 0, sizeof(req));
+    copt_init((sl_co *)&req.oh);
+    if (coap_msg_parse(&req, m, &code) != ERR_OK) {
+        fprintf(stderr, "coap_msg_parse failed, code %u\n", code);
+        return -1;
+    }
+    m_free(m);
+    req.msg = NULL;
+
+    {
+        uint8_t blk[SBLK_MAX_LEN];
+        struct sblk_rd rd;
+        uint32_t epoch;
+        uint16_t bms;
+        float v;
+        uint8_t len = bench_sblk_enc(blk, sizeof(blk));
+
+        rc = sblk_rd_init(&rd, blk, len);
+        for (i = 0; rc == len && i < 8; i++) {
+            if (sblk_rd_next(&rd, &epoch, &bms, &v) != 1 || epoch != 1700000000 + i * 30 ||
+                lroundf(v * 100) != lroundf(bench_levels[i] * 100)) {
+                break;
+            }
+        }
+        if (i != 8 || sblk_rd_next(&rd, &epoch, &bms, &v) != 0) {
+            fprintf(stderr, "sblk round trip failed at %u, %d, %u bytes\n", (unsigned)i, rc, len);
+            return -1;
+        }
+    }
+    {
+        uint8_t blk[SBLK_MAX_LEN];
+        struct sblk_cols_rd rd;
+        struct sblk_rd rd1;
+        uint32_t epoch;
+        uint16_t bms;
+        float v[SBLK_COLS_MAX];
+        int len = bench_sblk_cols_enc(blk, sizeof(blk));
+
+        rc = len > 0 ? sblk_cols_rd_init(&rd, blk, len) : -1;
+        for (i = 0; rc == len && i < 8; i++) {
+            if (sblk_cols_rd_next(&rd, &epoch, &bms, v) != 1 || epoch != 1700000000 + i * 30 ||
+                lroundf(v[0] * 100) != lroundf(bench_levels[i] * 100) ||
+                lroundf(v[2] * 100) != lroundf(bench_flows[i] * 100) || rd.datatype[3] != 6) {
+                break;
+            }
+        }
+        if (i != 8 || sblk_cols_rd_next(&rd, &epoch, &bms, v) != 0 || sblk_rd_init(&rd1, blk, len) != -1) {
+            fprintf(stderr, "sblk_cols round trip failed at %u, %d, %d bytes\n", (unsigned)i, rc, len);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+int
+main(int argc, char **argv)
+{
+    uint32_t ms = 200;
+    size_t i;
+    int c;
+
+    while ((c = getopt(argc, argv, "vt:")) != -1) {
+        switch (c) {
+        case 'v':
+            host_log_level = LOG_DEBUG;
+            break;
+        case 't':
+            ms = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-v] [-t ms]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (bench_setup()) {
+        return 1;
+    }
+    printf("%-26s %12s %10s %10s\n", "case", "calls", "ns/call", "MB/s");
+    for (i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        bench_run(&benches[i], ms);
+    }
+    return 0;
+}
@@ -0,0 +1,682 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+/*
+ * hostreplay, feeds the bytes of a capture from the field back into the
+ * firmware's HDLC deframer and CoAP server and its Modbus RTU master, on
+ * the capture's own timing, and reports what each frame came to and the
+ * host CPU time it took:
+ *
+ *   make hostreplay && ./hostreplay [-b baud] [-m baud] [-p port] [-c] [-q] [-v] file
+ *
+ * The file, - for stdin, may hold any of:
+ *
+ *   trace_dump() lines     10234567 rs485 rx       7: 01 03 02 ...
+ *                          the records of both ports, requests included
+ *   capture_dump() blocks  the hex between the ===== lines, bytes with no
+ *                          time, they follow on from the last ones
+ *   timed chunks           10234567 7E A0 07 ..., micros() of the first
+ *                          byte then the bytes, as cut from a J-Link log
+ *
+ * The last two are for the port -p, hdlc (the default) or rs485. Within
+ * a frame the bytes are a character time apart at -b baud on the mNIC
+ * link (38400) and -m on RS485 (9600 8N2); an HDLC record is timed at its
+ * closing flag, an RS485 one at its first byte. Lines of anything else
+ * are skipped, so a whole console log will do.
+ *
+ * The clock of the firmware is the capture's, host_clock(), moved on a
+ * main loop pass at a time between bytes, so its gap and idle timeouts
+ * see what the unit saw and a replay runs the same every time. HDLC
+ * frames go through Serial1 as hdlc.cpp's IRQ handler takes them, and
+ * coap_s_poll() serves them. A traced RS485 request is queued with the
+ * master at the time it went out; a reply with none queued gets one made
+ * up from it, slave, function and count, for the master to check it
+ * against. The records of frames the unit sent itself are only counted,
+ * and RS232 ones skipped. A record cut at TRACE_KEEP bytes is fed as far
+ * as it goes on RS485 and skipped on HDLC, where it would only be an FCS
+ * error; -c sends an SNRM first, for a capture that starts mid-session.
+ *
+ * Each frame prints its time from the start of the replay, port, length,
+ * the CPU time its bytes took in the receive callback, the time of the
+ * poll that dealt with it, and what came of it: the bytes sent back for
+ * HDLC, the master's result for RS485, with the traced one if they differ.
+ * -q leaves out the frames for the totals only, -v turns the debug log on.
+ */
+
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+#include "Arduino.h"
+#include "hdlc.h"
+#include "bufutil.h"
+#include "mbrtu.h"
+#include "coap_server.h"
+#include "trace.h"
+#include "log.h"
+
+extern int host_log_level;
+
+#define RP_HDLC             0
+#define RP_RS485            1
+#define RP_RS485_BAUD       9600            /* PORT_RS485_* of variants/ports.h */
+#define RP_RS485_CONFIG     SERIAL_8N2
+#define RP_START_US         (1000000ull)    /* the firmware's clock at the first byte */
+#define RP_POLL_US          (1000)          /* a main loop pass, between bytes */
+#define RP_GAP_MAX_US       (10000000ull)   /* longer gaps are cut to this */
+
+#define RP_REC_TRACE        0               /* a trace_dump() record */
+#define RP_REC_CHUNK        1               /* bytes from a time on */
+#define RP_REC_RAW          2               /* bytes with no time */
+
+/* A frame or chunk of bytes, as read from the file */
+struct rp_rec {
+    uint32_t us;
+    uint8_t port;
+    uint8_t tx;
+    uint8_t err;
+    uint8_t kind;
+    uint16_t len;                   /* on the wire, data holds what was kept */
+    std::vector<uint8_t> data;
+};
+
+/* Totals of a port */
+struct rp_sum {
+    uint32_t frames;
+    double isr_us;
+    double poll_us;
+    double poll_max_us;
+    uint32_t traced_tx;
+    uint32_t skipped;
+};
+
+static uint64_t rp_now;             /* the firmware's clock */
+static uint64_t rp_slip;            /* how far the replay has fallen behind the capture */
+static uint32_t rp_hdlc_char_us;
+static bool rp_quiet;
+
+static Uart rp_mbport;
+static struct mb_rtu rp_mb;
+static struct mb_req rp_req;
+static uint16_t rp_regs[MB_RTU_MAX_ADU];
+static uint64_t rp_txdone_at;       /* when the last stop bit of a request is out */
+
+static uint32_t rp_hdlc_out;        /* bytes the secondary sent */
+static uint32_t rp_hdlc_inlen;      /* bytes of the frame coming in */
+static double rp_hdlc_isr_us;
+static struct rp_sum rp_sum[2];
+
+
+static double
+rp_cpu_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+
+static void
+rp_set(uint64_t us)
+{
+    rp_now = us;
+    host_clock(us);
+}
+
+
+/* One pass of the main loop, and the transmit complete IRQ when its time is up */
+static void
+rp_step(void)
+{
+    uint8_t buf[UART_HOST_TX_MAX];
+    size_t n;
+
+    coap_s_poll();
+    mb_rtu_poll(&rp_mb);
+    rp_hdlc_out += Serial1.txTake(buf, sizeof(buf));
+    n = rp_mbport.txTake(buf, sizeof(buf));
+    if (n) {
+        rp_txdone_at = rp_now + n * rp_mb.char_us;
+    }
+    if (rp_txdone_at && rp_now >= rp_txdone_at) {
+        rp_txdone_at = 0;
+        rp_mbport.txDone();
+    }
+}
+
+
+/* Run the main loop up to us */
+static void
+rp_until(uint64_t us)
+{
+    if (us > rp_now + RP_GAP_MAX_US) {
+        rp_set(us - RP_GAP_MAX_US);
+    }
+    while (rp_now < us) {
+        rp_set(min(rp_now + RP_POLL_US, us));
+        rp_step();
+    }
+}
+
+
+/* The firmware's time of a traced micros(), the replay may have slipped */
+static uint64_t
+rp_time(uint32_t us)
+{
+    static bool started;
+    static uint32_t last;
+    static uint64_t t;
+    uint64_t at;
+
+    if (!started) {
+        started = true;
+        t = RP_START_US;
+    }
+    else {
+        t += (uint32_t)(us - last);
+    }
+    last = us;
+    at = t + rp_slip;
+    if (at < rp_now) {
+        rp_slip += rp_now - at;
+        at = rp_now;
+    }
+    return at;
+}
+
+
+/* The time of the first byte of a record, n bytes on the wire at char_us */
+static uint64_t
+rp_first_byte(const struct rp_rec *r, uint32_t n, uint32_t char_us)
+{
+    if (r->kind == RP_REC_RAW) {
+        return rp_now + char_us;
+    }
+    if (r->kind == RP_REC_TRACE && r->port == RP_HDLC) {
+        /* timed at its closing flag */
+        return rp_time(r->us - (n - 1) * char_us);
+    }
+    return rp_time(r->us);
+}
+
+
+static void
+rp_hdlc_frame(void)
+{
+    static struct hdlc_link_stats last;
+    struct hdlc_link_stats hs;
+    uint32_t out = rp_hdlc_out;
+    const char *what;
+    double t0, dt;
+
+    t0 = rp_cpu_us();
+    coap_s_poll();
+    dt = rp_cpu_us() - t0;
+    rp_step();
+
+    hdlc_get_stats(&hs);
+    if (hs.rx_good != last.rx_good) {
+        what = "";
+    }
+    else if (hs.fcs_err != last.fcs_err) {
+        what = " FCS error";
+    }
+    else if (hs.hcs_err != last.hcs_err) {
+        what = " HCS error";
+    }
+    else if (hs.hdr_err != last.hdr_err || hs.len_err != last.len_err) {
+        what = " bad header";
+    }
+    else if (hs.oversize != last.oversize) {
+        what = " oversize";
+    }
+    else {
+        what = " dropped";
+    }
+    last = hs;
+
+    rp_sum[RP_HDLC].frames++;
+    rp_sum[RP_HDLC].isr_us += rp_hdlc_isr_us;
+    rp_sum[RP_HDLC].poll_us += dt;
+    rp_sum[RP_HDLC].poll_max_us = max(rp_sum[RP_HDLC].poll_max_us, dt);
+    if (!rp_quiet) {
+        printf("%10llu hdlc  rx %3u: isr %6.2f us  poll %7.2f us  -> %u bytes%s\n",
+               (unsigned long long)(rp_now - RP_START_US), rp_hdlc_inlen, rp_hdlc_isr_us, dt,
+               rp_hdlc_out - out, what);
+    }
+    rp_hdlc_isr_us = 0;
+}
+
+
+/* A byte into the deframer at us, a closing flag gets its frame served */
+static void
+rp_hdlc_byte(uint64_t us, uint8_t c)
+{
+    double t0;
+
+    rp_until(us);
+    t0 = rp_cpu_us();
+    Serial1.rxFeed(&c, 1);
+    rp_hdlc_isr_us += rp_cpu_us() - t0;
+    if (c != HDLC_FLAG) {
+        rp_hdlc_inlen++;
+        return;
+    }
+    if (rp_hdlc_inlen) {
+        rp_hdlc_frame();
+    }
+    else {
+        /* an opening flag only */
+        rp_hdlc_isr_us = 0;
+    }
+    rp_hdlc_inlen = 0;
+}
+
+
+static void
+rp_hdlc(const struct rp_rec *r)
+{
+    uint64_t us;
+    size_t i;
+
+    if (r->tx) {
+        rp_sum[RP_HDLC].traced_tx++;
+        return;
+    }
+    if (r->kind != RP_REC_TRACE) {
+        /* the line as it was, flags and all */
+        us = rp_first_byte(r, r->data.size(), rp_hdlc_char_us);
+        for (i = 0; i < r->data.size(); i++) {
+            rp_hdlc_byte(us + i * rp_hdlc_char_us, r->data[i]);
+        }
+        return;
+    }
+    if (r->data.size() < r->len) {
+        rp_sum[RP_HDLC].skipped++;
+        return;
+    }
+    /* the frame without its flags */
+    us = rp_first_byte(r, r->len + 2, rp_hdlc_char_us);
+    rp_hdlc_byte(us, HDLC_FLAG);
+    for (i = 0; i < r->data.size(); i++) {
+        rp_hdlc_byte(us + (i + 1) * rp_hdlc_char_us, r->data[i]);
+    }
+    rp_hdlc_byte(us + (i + 1) * rp_hdlc_char_us, HDLC_FLAG);
+}
+
+
+/* Let the running request finish, or time out */
+static void
+rp_mb_idle(void)
+{
+    while (mb_rtu_busy(&rp_mb)) {
+        rp_set(rp_now + RP_POLL_US);
+        rp_step();
+    }
+}
+
+
+/* Queue the request of adu, a traced request or, if reply, the one it answers */
+static void
+rp_mb_submit(const std::vector<uint8_t> &adu, bool reply)
+{
+    uint8_t fc;
+    uint16_t i;
+
+    rp_mb_idle();
+    memset(&rp_req, 0, sizeof(rp_req));
+    rp_req.regs = rp_regs;
+    if (adu.size() < 2) {
+        return;
+    }
+    rp_req.slave = adu[0];
+    rp_req.fc = fc = adu[1] & ~MB_FC_EXCEPTION;
+    rp_req.count = 1;
+    if (reply && (fc == MB_FC_READ_HOLDING || fc == MB_FC_READ_INPUT)) {
+        rp_req.count = adu.size() > 2 ? max(adu[2] / 2, 1) : 1;
+    }
+    else if (adu.size() >= 6) {
+        rp_req.addr = buf_be16(&adu[0], 2);
+        if (fc == MB_FC_WRITE_SINGLE) {
+            rp_regs[0] = buf_be16(&adu[0], 4);
+        }
+        else {
+            rp_req.count = buf_be16(&adu[0], 4);
+        }
+        for (i = 0; fc == MB_FC_WRITE_MULTIPLE && !reply && i < rp_req.count &&
+             9u + i * 2 <= adu.size() && i < MB_RTU_MAX_ADU; i++) {
+            rp_regs[i] = buf_be16(&adu[0], 7 + i * 2);
+        }
+    }
+    rp_req.count = min(rp_req.count, (uint16_t)(fc == MB_FC_WRITE_MULTIPLE ? MB_RTU_MAX_WRITE :
+                                                MB_RTU_MAX_READ));
+    if (mb_rtu_submit(&rp_mb, &rp_req) != MB_OK) {
+        rp_sum[RP_RS485].skipped++;
+        return;
+    }
+    rp_step();
+}
+
+
+static const char *
+rp_mb_rc(int rc, char *buf, size_t size)
+{
+    switch (rc) {
+    case MB_OK:             return "ok";
+    case MB_ERR_TIMEOUT:    return "timeout";
+    case MB_ERR_CRC:        return "CRC error";
+    case MB_ERR_FRAME:      return "bad frame";
+    }
+    snprintf(buf, size, "exception %d", rc);
+    return buf;
+}
+
+
+static void
+rp_rs485(const struct rp_rec *r)
+{
+    char rcbuf[2][16];
+    double isr = 0, t0, dt = 0;
+    uint64_t us;
+    uint8_t c;
+    size_t i;
+
+    if (r->tx) {
+        rp_sum[RP_RS485].traced_tx++;
+        rp_mb_idle();
+        rp_until(rp_time(r->us));
+        rp_mb_submit(r->data, false);
+        return;
+    }
+    if (!mb_rtu_busy(&rp_mb)) {
+        rp_mb_submit(r->data, true);
+    }
+    if (!mb_rtu_busy(&rp_mb)) {
+        return;
+    }
+    /* the request out and the master listening before the reply comes */
+    while (rp_mb.state != MB_STATE_RX && mb_rtu_busy(&rp_mb)) {
+        rp_set(rp_now + rp_mb.char_us);
+        rp_step();
+    }
+
+    us = r->len ? rp_first_byte(r, r->data.size(), rp_mb.char_us) : rp_now;
+    for (i = 0; i < r->data.size(); i++) {
+        rp_until(us + i * rp_mb.char_us);
+        c = r->data[i];
+        t0 = rp_cpu_us();
+        rp_mbport.rxFeed(&c, 1);
+        isr += rp_cpu_us() - t0;
+    }
+    /* the poll that takes the reply, after t3.5 if it fell short */
+    while (mb_rtu_busy(&rp_mb)) {
+        t0 = rp_cpu_us();
+        mb_rtu_poll(&rp_mb);
+        dt = rp_cpu_us() - t0;
+        if (!mb_rtu_busy(&rp_mb)) {
+            break;
+        }
+        rp_set(rp_now + min(rp_mb.t15_us, (uint16_t)RP_POLL_US));
+        rp_step();
+    }
+
+    rp_sum[RP_RS485].frames++;
+    rp_sum[RP_RS485].isr_us += isr;
+    rp_sum[RP_RS485].poll_us += dt;
+    rp_sum[RP_RS485].poll_max_us = max(rp_sum[RP_RS485].poll_max_us, dt);
+    if (!rp_quiet) {
+        printf("%10llu rs485 rx %3u: isr %6.2f us  poll %7.2f us  -> %s", 
+               (unsigned long long)(rp_now - RP_START_US), r->len, isr, dt,
+               rp_mb_rc(rp_req.rc, rcbuf[0], sizeof(rcbuf[0])));
+        if (r->kind == RP_REC_TRACE && !r->err != (rp_req.rc == MB_OK)) {
+            printf(", traced %s", r->err ? "failed" : "ok");
+        }
+        if (r->data.size() < r->len) {
+            printf(", cut at %u", (unsigned)r->data.size());
+        }
+        printf("\n");
+    }
+}
+
+
+/* Hex bytes separated by spaces or commas, up to the first thing that isn't */
+static void
+rp_hex(const char *p, std::vector<uint8_t> &out)
+{
+    unsigned long v;
+    char *end;
+
+    for (;;) {
+        while (*p == ' ' || *p == ',' || *p == '\t') {
+            p++;
+        }
+        v = strtoul(p, &end, 16);
+        if (end == p || end - p > 2 || (*end && !strchr(" ,\t\r\n", *end))) {
+            return;
+        }
+        out.push_back((uint8_t)v);
+        p = end;
+    }
+}
+
+
+static int
+rp_port(const char *name)
+{
+    if (!strcmp(name, "hdlc")) {
+        return RP_HDLC;
+    }
+    if (!strcmp(name, "rs485")) {
+        return RP_RS485;
+    }
+    return -1;
+}
+
+
+/* The records of the file, in order */
+static void
+rp_read(FILE *f, int port, std::vector<struct rp_rec> &recs)
+{
+    char line[1024];
+    char name[8], dir[4];
+    bool in_capture = false;
+    unsigned long us;
+    unsigned len;
+    struct rp_rec r;
+    int n, k;
+
+    while (fgets(line, sizeof(line), f)) {
+        const char *p = line;
+
+        while (*p == ' ' || *p == '\t') {
+            p++;
+        }
+        if (!strncmp(p, "=====", 5)) {
+            in_capture = !in_capture;
+            continue;
+        }
+        r.data.clear();
+        r.port = port;
+        r.tx = r.err = 0;
+        r.kind = RP_REC_RAW;
+        r.us = 0;
+        if (in_capture) {
+            rp_hex(p, r.data);
+            if (r.data.empty()) {
+                continue;
+            }
+            r.len = r.data.size();
+            recs.push_back(r);
+            continue;
+        }
+        if (sscanf(p, "%lu %7s %3s%n", &us, name, dir, &n) == 3 &&
+            (!strcmp(dir, "rx") || !strcmp(dir, "tx"))) {
+            /* trace_dump() */
+            p += n;
+            if (!strncmp(p, " err", 4)) {
+                r.err = 1;
+                p += 4;
+            }
+            if (sscanf(p, "%u:%n", &len, &n) != 1) {
+                continue;
+            }
+            if ((k = rp_port(name)) < 0) {
+                /* rs232 */
+                continue;
+            }
+            r.port = k;
+            r.tx = dir[0] == 't';
+            r.kind = RP_REC_TRACE;
+            r.us = us;
+            r.len = len;
+            rp_hex(p + n, r.data);
+            if (r.data.size() > r.len) {
+                r.data.resize(r.len);
+            }
+            recs.push_back(r);
+            continue;
+        }
+        if (sscanf(p, "%lu%n", &us, &n) == 1 && (p[n] == ' ' || p[n] == '\t')) {
+            /* a timed chunk */
+            rp_hex(p + n, r.data);
+            if (r.data.empty()) {
+                continue;
+            }
+            r.kind = RP_REC_CHUNK;
+            r.us = us;
+            r.len = r.data.size();
+            recs.push_back(r);
+        }
+    }
+}
+
+
+/* An SNRM as the mNIC sends it, for the secondary to be up */
+static void
+rp_connect(void)
+{
+    struct hdlc_hdr_tmpl t;
+    uint8_t f[HDLC_HDR_SIZE];
+    int i;
+
+    hdlc_hdr_tmpl_init(&t, hdlc_addr_encode(1), hdlc_addr_encode(1));
+    hdlc_hdr_tmpl_fill(&t, 0, hdlc_control(HDLC_SNRM, 1), 0, f);
+    rp_hdlc_byte(rp_now, HDLC_FLAG);
+    for (i = 0; i < HDLC_HDR_SIZE; i++) {
+        rp_hdlc_byte(rp_now + rp_hdlc_char_us, f[i]);
+    }
+    rp_hdlc_byte(rp_now + rp_hdlc_char_us, HDLC_FLAG);
+}
+
+
+static void
+rp_print_sum(const char *name, const struct rp_sum *sum)
+{
+    printf("%-5s %6u frames, isr %7.2f us, poll %7.2f us avg %7.2f us max, "
+           "%u sent in the trace, %u skipped\n", name, sum->frames,
+           sum->frames ? sum->isr_us / sum->frames : 0.0,
+           sum->frames ? sum->poll_us / sum->frames : 0.0, sum->poll_max_us,
+           sum->traced_tx, sum->skipped);
+}
+
+
+int
+main(int argc, char **argv)
+{
+    unsigned long baud = 38400, mb_baud = RP_RS485_BAUD;
+    std::vector<struct rp_rec> recs;
+    struct hdlc_link_stats hs;
+    bool connect = false;
+    int port = RP_HDLC;
+    FILE *f;
+    size_t i;
+    int c;
+
+    while ((c = getopt(argc, argv, "b:m:p:cqv")) != -1) {
+        switch (c) {
+        case 'b': baud = strtoul(optarg, NULL, 0); break;
+        case 'm': mb_baud = strtoul(optarg, NULL, 0); break;
+        case 'p': port = rp_port(optarg); break;
+        case 'c': connect = true; break;
+        case 'q': rp_quiet = true; break;
+        case 'v': host_log_level = LOG_DEBUG; break;
+        default:
+            port = -1;
+            break;
+        }
+    }
+    if (port < 0 || optind != argc - 1 || !baud || !mb_baud) {
+        fprintf(stderr, "usage: %s [-b baud] [-m baud] [-p hdlc|rs485] [-c] [-q] [-v] file\n",
+                argv[0]);
+        return 2;
+    }
+    f = strcmp(argv[optind], "-") ? fopen(argv[optind], "r") : stdin;
+    if (!f) {
+        perror(argv[optind]);
+        return 1;
+    }
+    rp_read(f, port, recs);
+    if (f != stdin) {
+        fclose(f);
+    }
+
+    rp_set(RP_START_US);
+    rp_hdlc_char_us = 10000000UL / baud;
+    coap_s_init(&Serial1, NULL, 60, 2000, MNIC_MAX_PAYLOAD_SIZE, "", NULL);
+    mb_rtu_init(&rp_mb, &rp_mbport, mb_baud, RP_RS485_CONFIG, MB_RTU_NO_PIN, MB_RTU_NO_PIN);
+    if (connect) {
+        rp_connect();
+    }
+
+    for (i = 0; i < recs.size(); i++) {
+        if (recs[i].port == RP_HDLC) {
+            rp_hdlc(&recs[i]);
+        }
+        else {
+            rp_rs485(&recs[i]);
+        }
+    }
+    rp_mb_idle();
+    rp_until(rp_now + RP_POLL_US);
+
+    printf("%u records, %.3f s, %.3f s behind the capture\n", (unsigned)recs.size(),
+           (rp_now - RP_START_US) / 1e6, rp_slip / 1e6);
+    rp_print_sum("hdlc", &rp_sum[RP_HDLC]);
+    rp_print_sum("rs485", &rp_sum[RP_RS485]);
+    hdlc_get_stats(&hs);
+    printf("hdlc: %u frames in, %u passed up, %u sent, %u FCS, %u HCS, %u header, "
+           "%u idle discard, %u seqnum errors\n", hs.rx_frames, hs.rx_good, hs.tx_frames,
+           hs.fcs_err, hs.hcs_err, hs.hdr_err + hs.len_err, hs.idle_discard, hs.seqnum_err);
+    printf("rs485: %u requests, %u timeouts, %u CRC, %u frame errors, %u exceptions\n",
+           rp_mb.stats.requests, rp_mb.stats.timeouts, rp_mb.stats.crc_errors,
+           rp_mb.stats.frame_errors, rp_mb.stats.exceptions);
+    return 0;
+}
@@ -0,0 +1,523 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+/*
+ * hostsoak, the HDLC primary the mNIC would be, driving CoAP GETs at a
+ * rising rate for the link's capacity:
+ *
+ *   make hostsoak && ./hostsoak [-d tty] [-b baud] [-f baud] [-u path]
+ *                               [-r rate] [-R rate] [-s s] [-t ms] [-v]
+ *
+ * Without -d the secondary is the firmware's own coap_server and hdlcs,
+ * built into hostsoak and run on the mock Uart of host_arduino.cpp, with
+ * the resource of host_uri.cpp in place of coapsensoruri.cpp. With -d
+ * it is an mShield on the serial port tty, at -b baud (38400), moving to
+ * -f once the UA is in if HDLC_LINK_FAST_BAUD is set on it.
+ *
+ * The primary connects with SNRM, window 1 both ways, then for each rate
+ * from -r (10/s) doubling up to -R (1000/s) sends a CON GET of -u each
+ * 1/rate s for -s s (5) as I frames with P set. The answer is the I frame
+ * with F back; one not in by -t ms (500) is a drop, and an RR with P
+ * brings the sequence numbers back in line. A GET is only sent once the
+ * one before is answered or dropped, so a rate the unit can't keep up
+ * with shows as a lower rate done. Per rate it prints the requests done
+ * per second, the p50, p99 and highest latency, the drops, and without
+ * -d the high-water of the mbuf pools, the option slots and the scratch
+ * arena on the secondary. It ends with a DISC.
+ */
+
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <vector>
+#include <algorithm>
+#include "Arduino.h"
+#include "hdlc.h"
+#include "hbuf.h"
+#include "crc_xmodem.h"
+#include "bufutil.h"
+#include "coapmsg.h"
+#include "coappdu.h"
+#include "coapsensoruri.h"
+#include "coap_server.h"
+#include "log.h"
+
+extern int host_log_level;
+
+#define SOAK_INFO_MAX       (255)
+#define SOAK_FRAME_MAX      (HDLC_HDR_SIZE + SOAK_INFO_MAX + HDLC_CRC_SIZE)
+#define SOAK_TIMEOUT_MS     (500)
+
+/* The link to the secondary, in process or over a tty */
+static int soak_fd = -1;
+static struct hdlc_hdr_tmpl soak_tmpl;
+static uint8_t soak_vs;             /* N(S) of our next I frame */
+static uint8_t soak_vr;             /* N(S) expected from the secondary */
+
+/* Deframer, a frame is flag, soak_frame[0..framelen) and flag */
+static uint8_t soak_frame[SOAK_FRAME_MAX];
+static int soak_fill = -1;          /* -1 hunting for a flag */
+static int soak_framelen;
+
+struct soak_rx {
+    struct hdlc_ctrl hc;
+    const uint8_t *info;
+    int infolen;
+};
+
+static uint32_t soak_crc_err;
+static uint32_t soak_junk;          /* bytes outside frames */
+
+
+static uint64_t
+soak_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+static bool
+soak_tty_open(const char *path, unsigned long baud)
+{
+    struct termios tio;
+
+    soak_fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (soak_fd < 0) {
+        perror(path);
+        return false;
+    }
+    if (tcgetattr(soak_fd, &tio)) {
+        perror(path);
+        return false;
+    }
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    if (cfsetspeed(&tio, baud) || tcsetattr(soak_fd, TCSANOW, &tio)) {
+        fprintf(stderr, "%s: can't set %lu baud\n", path, baud);
+        return false;
+    }
+    tcflush(soak_fd, TCIOFLUSH);
+    return true;
+}
+
+
+static bool
+soak_tty_baud(unsigned long baud)
+{
+    struct termios tio;
+
+    return !tcgetattr(soak_fd, &tio) && !cfsetspeed(&tio, baud) &&
+           !tcsetattr(soak_fd, TCSADRAIN, &tio);
+}
+
+
+static void
+soak_write(const uint8_t *buf, size_t len)
+{
+    ssize_t n;
+
+    if (soak_fd < 0) {
+        Serial1.rxFeed(buf, len);
+        return;
+    }
+    while (len) {
+        n = write(soak_fd, buf, len);
+        if (n < 0) {
+            struct pollfd p = { soak_fd, POLLOUT, 0 };
+            (void)poll(&p, 1, 10);
+            continue;
+        }
+        buf += n;
+        len -= n;
+    }
+}
+
+
+/* What the secondary sent since the last call, waiting up to 1 ms for it */
+static size_t
+soak_read(uint8_t *buf, size_t size)
+{
+    struct pollfd p = { soak_fd, POLLIN, 0 };
+    ssize_t n;
+
+    if (soak_fd < 0) {
+        coap_s_poll();
+        return Serial1.txTake(buf, size);
+    }
+    if (poll(&p, 1, 1) <= 0) {
+        return 0;
+    }
+    n = read(soak_fd, buf, size);
+    return n > 0 ? n : 0;
+}
+
+
+/* An I frame carrying info, or an S or U frame with P set */
+static void
+soak_send(int16_t control, const uint8_t *info, int infolen)
+{
+    uint8_t f[1 + SOAK_FRAME_MAX + 1];
+    int len = HDLC_HDR_SIZE;
+    uint16_t fcs;
+
+    f[0] = HDLC_FLAG;
+    hdlc_hdr_tmpl_fill(&soak_tmpl, 0, control, infolen, &f[1]);
+    if (infolen > 0) {
+        memcpy(&f[1 + len], info, infolen);
+        len += infolen;
+        fcs = crc16(CRC16_FINAL, info, infolen);
+        buf_wle16(f, 1 + len, ~fcs);
+        len += HDLC_CRC_SIZE;
+    }
+    f[1 + len] = HDLC_FLAG;
+    soak_write(f, len + 2);
+}
+
+
+/* Take one byte, 1 once a whole frame with good FCS is in soak_frame */
+static int
+soak_rx_byte(uint8_t c)
+{
+    if (soak_fill < 0) {
+        if (c == HDLC_FLAG) {
+            soak_fill = 0;
+        }
+        else {
+            soak_junk++;
+        }
+        return 0;
+    }
+    if (soak_fill == 0 && c == HDLC_FLAG) {
+        /* back to back flags, the second opens the frame */
+        return 0;
+    }
+    soak_frame[soak_fill++] = c;
+    if (soak_fill < 2) {
+        return 0;
+    }
+    if (soak_fill == 2) {
+        soak_framelen = buf_be16(soak_frame, 0) & 0x07FF;
+        if (soak_framelen < HDLC_HDR_SIZE || soak_framelen > SOAK_FRAME_MAX) {
+            soak_fill = -1;
+            soak_junk += 2;
+        }
+        return 0;
+    }
+    if (soak_fill <= soak_framelen) {
+        return 0;
+    }
+    /* the byte after the frame, the closing flag */
+    soak_fill = -1;
+    if (c != HDLC_FLAG) {
+        soak_junk += soak_framelen + 1;
+        return 0;
+    }
+    if (crc16_validate(soak_frame, soak_framelen)) {
+        soak_crc_err++;
+        return 0;
+    }
+    /* the closing flag may open the next one */
+    soak_fill = 0;
+    return 1;
+}
+
+
+/* Wait up to timeout_us for a frame from the secondary, 0 if none came */
+static int
+soak_rx(struct soak_rx *rx, uint64_t timeout_us)
+{
+    static uint8_t buf[512];
+    static size_t have, used;
+    struct hdlc_hdr_fields hh;
+    uint64_t end = soak_us() + timeout_us;
+
+    do {
+        while (used < have) {
+            if (!soak_rx_byte(buf[used++])) {
+                continue;
+            }
+            if (hdlc_parse_hdr(&hh, soak_frame, soak_framelen) ||
+                hdlc_parse_control(hh.control, &rx->hc)) {
+                soak_junk += soak_framelen;
+                continue;
+            }
+            rx->info = soak_frame + hh.hdrlen;
+            rx->infolen = hh.infolen;
+            return 1;
+        }
+        have = soak_read(buf, sizeof(buf));
+        used = 0;
+    } while (soak_us() < end);
+    return 0;
+}
+
+
+/* A U frame with P, and the UA to it */
+static bool
+soak_unnumbered(uint8_t type, uint32_t timeout_ms)
+{
+    struct soak_rx rx;
+    uint64_t end = soak_us() + timeout_ms * 1000ull;
+
+    soak_send(hdlc_control(type, 1), NULL, 0);
+    while (soak_rx(&rx, 1000)) {
+        if (rx.hc.type == HDLC_UA) {
+            return true;
+        }
+        if (soak_us() >= end) {
+            break;
+        }
+    }
+    while (soak_us() < end) {
+        if (soak_rx(&rx, end - soak_us()) && rx.hc.type == HDLC_UA) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+/* Poll with RR, the N(R) of the RR back is the next N(S) it wants */
+static void
+soak_resync(uint32_t timeout_ms)
+{
+    struct soak_rx rx;
+    uint64_t end = soak_us() + timeout_ms * 1000ull;
+
+    soak_send(hdlc_control_rr(soak_vr, 1), NULL, 0);
+    while (soak_us() < end && soak_rx(&rx, end - soak_us())) {
+        if (rx.hc.type == HDLC_RR) {
+            soak_vs = rx.hc.nr;
+            return;
+        }
+        if (rx.hc.type == HDLC_I && rx.hc.ns == soak_vr) {
+            /* a late answer resent, take it and ask again */
+            soak_vr = (soak_vr + 1) & 7;
+            soak_send(hdlc_control_rr(soak_vr, 1), NULL, 0);
+        }
+    }
+}
+
+
+/* A CON GET of the options opts, mid and token both mid */
+static int
+soak_request(uint8_t *buf, uint16_t mid, const uint8_t *opts, int optlen)
+{
+    buf[0] = 0x42;
+    buf[1] = COAP_REQUEST_GET;
+    buf_wbe16(buf, 2, mid);
+    buf_wbe16(buf, 4, mid);
+    memcpy(buf + 6, opts, optlen);
+    return 6 + optlen;
+}
+
+
+struct soak_step {
+    uint32_t sent;
+    uint32_t answered;
+    uint32_t drops;
+    uint32_t errors;        /* answered with an RR, a 4.xx/5.xx or the wrong MID */
+    std::vector<uint32_t> lat_us;
+};
+
+
+/* One rate for secs, window 1 */
+static void
+soak_run(struct soak_step *st, uint32_t rate, uint32_t secs, uint32_t timeout_ms,
+         const uint8_t *opts, int optlen)
+{
+    uint8_t req[6 + SOAK_INFO_MAX];
+    uint64_t period = 1000000 / rate;
+    uint64_t start = soak_us();
+    uint64_t next = start;
+    uint64_t end = start + secs * 1000000ull;
+    static uint16_t mid;
+    struct soak_rx rx;
+    uint64_t t0, now;
+    int len;
+
+    while ((now = soak_us()) < end) {
+        if (now < next) {
+            if (soak_fd < 0) {
+                coap_s_poll();
+            }
+            else {
+                usleep(min(next - now, (uint64_t)1000));
+            }
+            continue;
+        }
+        next = max(next + period, now);
+
+        len = soak_request(req, ++mid, opts, optlen);
+        t0 = soak_us();
+        soak_send(hdlc_control_i(soak_vr, soak_vs, 1), req, len);
+        soak_vs = (soak_vs + 1) & 7;
+        st->sent++;
+
+        for (;;) {
+            now = soak_us();
+            if (now >= t0 + timeout_ms * 1000ull || !soak_rx(&rx, t0 + timeout_ms * 1000ull - now)) {
+                st->drops++;
+                soak_resync(timeout_ms);
+                break;
+            }
+            if (rx.hc.type == HDLC_RR) {
+                st->errors++;
+                break;
+            }
+            if (rx.hc.type != HDLC_I || rx.hc.ns != soak_vr) {
+                continue;
+            }
+            soak_vr = (soak_vr + 1) & 7;
+            if (rx.infolen < 4 || buf_be16(rx.info, 2) != mid || COAP_CLASS(rx.info[1]) != 2) {
+                st->errors++;
+            }
+            else {
+                st->answered++;
+                st->lat_us.push_back((uint32_t)(soak_us() - t0));
+            }
+            break;
+        }
+    }
+}
+
+
+static void
+soak_print(uint32_t rate, uint32_t secs, struct soak_step *st)
+{
+    std::vector<uint32_t> &l = st->lat_us;
+    uint32_t p50 = 0, p99 = 0, hi = 0;
+
+    if (!l.empty()) {
+        std::sort(l.begin(), l.end());
+        p50 = l[l.size() / 2];
+        p99 = l[l.size() * 99 / 100];
+        hi = l.back();
+    }
+    printf("%7u %8.1f %7u %7u %7u %6u %6u", rate, (double)st->answered / secs, p50, p99, hi,
+           st->drops, st->errors);
+    if (soak_fd < 0) {
+        printf(" %4d %4d %5d %6d", m_pool_peak(1), m_pool_peak(0), copt_peak(), scratch_peak());
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+
+int
+main(int argc, char **argv)
+{
+    const char *tty = NULL;
+    const char *path = "/sensor/arduino/temp";
+    unsigned long baud = 38400;
+    unsigned long fast = 0;
+    uint32_t rate = 10, rate_max = 1000;
+    uint32_t secs = 5;
+    uint32_t timeout_ms = SOAK_TIMEOUT_MS;
+    uint8_t opts[SOAK_INFO_MAX];
+    struct hdlc_link_stats hs;
+    int optlen;
+    int c;
+
+    while ((c = getopt(argc, argv, "d:b:f:u:r:R:s:t:v")) != -1) {
+        switch (c) {
+        case 'd': tty = optarg; break;
+        case 'b': baud = strtoul(optarg, NULL, 0); break;
+        case 'f': fast = strtoul(optarg, NULL, 0); break;
+        case 'u': path = optarg; break;
+        case 'r': rate = strtoul(optarg, NULL, 0); break;
+        case 'R': rate_max = strtoul(optarg, NULL, 0); break;
+        case 's': secs = strtoul(optarg, NULL, 0); break;
+        case 't': timeout_ms = strtoul(optarg, NULL, 0); break;
+        case 'v': host_log_level = LOG_DEBUG; break;
+        default:
+            fprintf(stderr, "usage: %s [-d tty] [-b baud] [-f baud] [-u path] [-r rate] "
+                    "[-R rate] [-s s] [-t ms] [-v]\n", argv[0]);
+            return 2;
+        }
+    }
+    optlen = coap_uristr_to_opt(path, opts, sizeof(opts) - 6);
+    if (optlen < 0 || !rate || !secs) {
+        fprintf(stderr, "bad path, rate or time\n");
+        return 2;
+    }
+
+    if (tty) {
+        if (!soak_tty_open(tty, baud)) {
+            return 1;
+        }
+    }
+    else {
+        coap_s_init(&Serial1, NULL, 60, 2000, MNIC_MAX_PAYLOAD_SIZE, "", NULL);
+    }
+
+    hdlc_hdr_tmpl_init(&soak_tmpl, hdlc_addr_encode(1), hdlc_addr_encode(1));
+    if (!soak_unnumbered(HDLC_SNRM, 2000)) {
+        fprintf(stderr, "no UA to the SNRM\n");
+        return 1;
+    }
+    if (tty && fast && !soak_tty_baud(fast)) {
+        fprintf(stderr, "can't move to %lu baud\n", fast);
+        return 1;
+    }
+    soak_vs = soak_vr = 0;
+
+    printf("%7s %8s %7s %7s %7s %6s %6s", "rate/s", "done/s", "p50 us", "p99 us", "max us",
+           "drops", "errors");
+    if (!tty) {
+        printf(" %4s %4s %5s %6s", "big", "sml", "opts", "scratch");
+    }
+    printf("\n");
+    for (; rate <= rate_max; rate *= 2) {
+        struct soak_step st = { 0, 0, 0, 0, std::vector<uint32_t>() };
+
+        soak_run(&st, rate, secs, timeout_ms, opts, optlen);
+        soak_print(rate, secs, &st);
+    }
+
+    if (!soak_unnumbered(HDLC_DISC, 2000)) {
+        fprintf(stderr, "no UA to the DISC\n");
+    }
+    printf("frames with bad FCS %u, bytes outside frames %u\n", soak_crc_err, soak_junk);
+    if (!tty) {
+        hdlc_get_stats(&hs);
+        printf("secondary: %u frames in, %u out, %u seqnum errors, %u resent\n",
+               hs.rx_good, hs.tx_frames, hs.seqnum_err, hs.rexmit);
+    }
+    return 0;
+}
@@ -0,0 +1,112 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+/*
+ * Just enough of the Arduino core for the ssni_coap_server sources to
+ * build and run on a PC, see ../hostbench.cpp. ARDUINO_ARCH_SAMD and
+ * UART_DMA_TX are defined so hdlc.cpp takes the same path it does on the
+ * mShield: bytes into the deframer through onReceive(), frames out
+ * through writeDMA().
+ */
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifndef ARDUINO_ARCH_SAMD
+#define ARDUINO_ARCH_SAMD
+#endif
+#ifndef UART_DMA_TX
+#define UART_DMA_TX
+#endif
+
+#define RAMFUNC
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH            0x1
+#define LOW             0x0
+#define INPUT           0x0
+#define OUTPUT          0x1
+#define INPUT_PULLUP    0x2
+#define DEC             10
+#define HEX             16
+#define LED_BUILTIN     13
+
+#define A0              14
+#define A1              15
+#define A2              16
+#define A3              17
+#define A4              18
+#define A5              19
+
+#ifndef min
+#define min(a,b)        ((a)<(b)?(a):(b))
+#define max(a,b)        ((a)>(b)?(a):(b))
+#endif
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+#define F(s)            (s)
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+/*
+ * Bench side: from host_clock(us) on, millis() and micros() give us
+ * and delay() moves it on instead of sleeping, for a replay to run on
+ * the time of its capture. host_real_us() is the monotonic clock still.
+ */
+void host_clock(uint64_t us);
+uint64_t host_real_us(void);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+void noInterrupts(void);
+void interrupts(void);
+void __WFI(void);
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+
+#include "HardwareSerial.h"
+
+#endif /* HOST_ARDUINO_H */
@@ -0,0 +1,156 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+
+/*
+ * Print, Stream and HardwareSerial as the core has them, and a Uart that
+ * keeps what is written to it for the bench to read back.
+ */
+
+#ifndef HOST_HARDWARESERIAL_H
+#define HOST_HARDWARESERIAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+class Print
+{
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size);
+    size_t write(const char *str) { return str ? write((const uint8_t *)str, strlen(str)) : 0; }
+    size_t print(const char *str) { return write(str); }
+    size_t println(const char *str = "") { return write(str) + write("\r\n"); }
+};
+
+class Stream : public Print
+{
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+};
+
+#define HARDSER_PARITY_EVEN      (0x1ul)
+#define HARDSER_PARITY_ODD       (0x2ul)
+#define HARDSER_PARITY_NONE      (0x3ul)
+#define HARDSER_PARITY_MASK      (0xFul)
+#define HARDSER_STOP_BIT_1       (0x10ul)
+#define HARDSER_STOP_BIT_1_5     (0x20ul)
+#define HARDSER_STOP_BIT_2       (0x30ul)
+#define HARDSER_STOP_BIT_MASK    (0xF0ul)
+#define HARDSER_DATA_7           (0x300ul)
+#define HARDSER_DATA_8           (0x400ul)
+#define HARDSER_DATA_MASK        (0xF00ul)
+
+#define SERIAL_8N1  (HARDSER_STOP_BIT_1 | HARDSER_PARITY_NONE | HARDSER_DATA_8)
+#define SERIAL_8N2  (HARDSER_STOP_BIT_2 | HARDSER_PARITY_NONE | HARDSER_DATA_8)
+#define SERIAL_8E1  (HARDSER_STOP_BIT_1 | HARDSER_PARITY_EVEN | HARDSER_DATA_8)
+#define SERIAL_8O1  (HARDSER_STOP_BIT_1 | HARDSER_PARITY_ODD  | HARDSER_DATA_8)
+
+class HardwareSerial : public Stream
+{
+  public:
+    virtual void begin(unsigned long baud) = 0;
+    virtual void begin(unsigned long baud, uint16_t config) = 0;
+    virtual void end() = 0;
+    virtual void flush() = 0;
+    using Print::write;
+    virtual operator bool() = 0;
+};
+
+#define UART_HOST_TX_MAX    (4096)
+
+class Uart : public HardwareSerial
+{
+  public:
+    Uart();
+    void begin(unsigned long baud) { begin(baud, 0); }
+    void begin(unsigned long baud, uint16_t config);
+    void end() {}
+    void flush() {}
+    int available() { return 0; }
+    int read() { return -1; }
+    int peek() { return -1; }
+    size_t write(uint8_t c);
+    using Print::write;
+    operator bool() { return true; }
+
+    void onReceive(void (*fn)(uint8_t)) { rxfn = fn; }
+    void onTransmitComplete(void (*fn)(void)) { txdonefn = fn; }
+    bool writeDMA(const uint8_t * const *seg, const uint16_t *seglen, uint8_t nseg,
+                  void (*done)(void));
+    bool isBusyDMA() { return false; }
+    void setFlowControl(uint8_t pinRTS, uint8_t pinCTS) { (void)pinRTS; (void)pinCTS; }
+    void rxReady(bool ready) { (void)ready; }
+    bool ctsReady() { return true; }
+
+    // Bench side: the bytes written since the last txTake(), and bytes
+    // handed to the onReceive() callback as the RX IRQ would, and the
+    // transmit complete IRQ
+    size_t txTake(uint8_t *buf, size_t size);
+    void rxFeed(const uint8_t *buf, size_t len);
+    void txDone() { if (txdonefn) txdonefn(); }
+
+    unsigned long baud;
+    uint16_t config;
+
+  private:
+    void (*rxfn)(uint8_t);
+    void (*txdonefn)(void);
+    uint8_t tx[UART_HOST_TX_MAX];
+    size_t txlen;
+};
+
+// The console, SerialUSB on the mShield, goes to stderr
+class Serial_ : public HardwareSerial
+{
+  public:
+    void begin(unsigned long baud) { (void)baud; }
+    void begin(unsigned long baud, uint16_t config) { (void)baud; (void)config; }
+    void end() {}
+    void flush() {}
+    int available() { return 0; }
+    int read() { return -1; }
+    int peek() { return -1; }
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buffer, size_t size);
+    using Print::write;
+    operator bool() { return true; }
+};
+
+extern Uart Serial1;
+extern Serial_ SerialUSB;
+
+#define Serial SerialUSB
+
+#endif /* HOST_HARDWARESERIAL_H */
@@ -0,0 +1,190 @@
+/*
+
+Copyright (c) Silver Spring Networks, Inc. 
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the ""Software""), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of 
+the Software, and to permit persons to whom the Software is furnished to do so, 
+subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all 
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED AS IS, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+Except as contained in this notice, the name of Silver Spring Networks, Inc. 
+shall not be used in advertising or otherwise to promote the sale, use or other 
+dealings in this Software without prior written authorization from Silver Spring
+Networks, Inc.
+
+*/
+
+
+/*
+ * logdec, turns the console of a LOG_TOKENS build back into text.
+ *
+ *   logdec us3_mshield.elf [capture]
+ *
+ * reads the console bytes from capture, or stdin, and writes them to
+ * stdout. Text goes through as it is, each token frame is printed as its
+ * millis() and the message, the format taken from the .logfmt section of
+ * the ELF the firmware was built as. It is built from the firmware's own
+ * logfmt.cpp, so both read the records alike:
+ *
+ *   g++ -I../../ArduinoCore/include/libraries/ssni_coap_server -o logdec \
+ *       logdec.cpp ../../ArduinoCore/src/libraries/ssni_coap_server/logfmt.cpp
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "logfmt.h"
+
+#define LOGDEC_TEXT_LEN     (256)
+
+static const char *levels[] = {"EMRG", "ALRT", "CRIT", "ERR", "WARN", "NOTE", "INFO", "DEBG"};
+
+
+static uint32_t
+get16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+
+static uint32_t
+get32(const uint8_t *p)
+{
+    return get16(p) | (get16(p + 2) << 16);
+}
+
+
+/* The .logfmt section of a little endian ELF32, empty if there is none */
+static std::vector<char>
+elf_logfmt(const char *path)
+{
+    std::vector<uint8_t> elf;
+    std::vector<char> fmt;
+    const uint8_t *sh;
+    const uint8_t *names;
+    uint32_t shoff, shentsize, shnum, shstrndx;
+    uint32_t i, off, size;
+    FILE *f;
+    int ch;
+
+    if (!(f = fopen(path, "rb"))) {
+        perror(path);
+        return fmt;
+    }
+    while ((ch = getc(f)) != EOF) {
+        elf.push_back(ch);
+    }
+    fclose(f);
+
+    if (elf.size() < 52 || memcmp(&elf[0], "\177ELF", 4) || elf[4] != 1 || elf[5] != 1) {
+        fprintf(stderr, "%s: not a little endian ELF32\n", path);
+        return fmt;
+    }
+    shoff = get32(&elf[32]);
+    shentsize = get16(&elf[46]);
+    shnum = get16(&elf[48]);
+    shstrndx = get16(&elf[50]);
+    if (shoff + shnum * shentsize > elf.size() || shstrndx >= shnum) {
+        fprintf(stderr, "%s: bad section headers\n", path);
+        return fmt;
+    }
+    sh = &elf[shoff + shstrndx * shentsize];
+    names = &elf[get32(sh + 16)];
+
+    for (i = 0; i < shnum; i++) {
+        sh = &elf[shoff + i * shentsize];
+        if (strcmp((const char *)names + get32(sh), ".logfmt")) {
+            continue;
+        }
+        off = get32(sh + 16);
+        size = get32(sh + 20);
+        if (off + size <= elf.size()) {
+            fmt.assign(elf.begin() + off, elf.begin() + off + size);
+        }
+        break;
+    }
+    if (fmt.empty()) {
+        fprintf(stderr, "%s: no .logfmt section, not a LOG_TOKENS build?\n", path);
+    }
+    return fmt;
+}
+
+
+/* Print one frame, buf being what follows its length byte */
+static void
+frame_print(const std::vector<char> &fmt, const uint8_t *buf, int len)
+{
+    char text[LOGDEC_TEXT_LEN];
+    uint8_t level = buf[0] & ~LOG_TOK_CUT;
+    uint32_t token = get16(buf + 1);
+    uint32_t ms = get32(buf + 3);
+
+    printf("[%6lu.%03lu] %s: ", (unsigned long)(ms / 1000), (unsigned long)(ms % 1000),
+           level < sizeof(levels) / sizeof(levels[0]) ? levels[level] : "?");
+    if (token >= fmt.size() || !memchr(&fmt[token], 0, fmt.size() - token)) {
+        printf("<token %04x, not in the ELF>\n", token);
+        return;
+    }
+    log_format(text, sizeof(text), &fmt[token], buf + LOG_TOK_HDR, len - LOG_TOK_HDR);
+    printf("%s%s\n", text, (buf[0] & LOG_TOK_CUT) ? " ..." : "");
+}
+
+
+int
+main(int argc, char **argv)
+{
+    std::vector<char> fmt;
+    uint8_t buf[256];
+    FILE *in = stdin;
+    int ch, len, i;
+
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "usage: %s <elf> [capture]\n", argv[0]);
+        return 2;
+    }
+    fmt = elf_logfmt(argv[1]);
+    if (fmt.empty()) {
+        return 1;
+    }
+    if (argc == 3 && !(in = fopen(argv[2], "rb"))) {
+        perror(argv[2]);
+        return 1;
+    }
+
+    while ((ch = getc(in)) != EOF) {
+        if (ch != LOG_TOK_SOF) {
+            putchar(ch);
+            continue;
+        }
+        if ((len = getc(in)) == EOF) {
+            break;
+        }
+        for (i = 0; i < len && (ch = getc(in)) != EOF; i++) {
+            buf[i] = ch;
+        }
+        if (i < len) {
+            break;
+        }
+        if (len < LOG_TOK_HDR) {
+            printf("<short frame, %d bytes>\n", len);
+            continue;
+        }
+        frame_print(fmt, buf, len);
+        fflush(stdout);
+    }
+    return 0;
+}
@@ -7,33 +7,27 @@
 
 #include "EchoSensor.h"
 #include "sapi.h"
+#include "bufutil.h"
 
 static char		 echostring[32];
 static uint32_t	 echocount;
 
-int sendInterval3 = ParamSendInterval();
-int sampleRate3 =  ParamSampleRate();
-
 sapi_error_t echo_read_sensor(char *payload, uint8_t *len)
 {
-	// Assemble the Payload
-	char    rsendInterval[] = "0";
-	char    rsampleRate[] = "0,"; //if it shows 2, float not connected properly. The value should be 0 or 1.
-	
-	sprintf(rsendInterval, "%d,", sendInterval3);
-	sprintf(rsampleRate, "%d,", sampleRate3);
-	
-	strcpy(payload, "");
-	strcat(payload, "SI:");
-	strcat(payload, rsendInterval);
-	strcat(payload, ";");
-	strcat(payload, "SR:");
-	strcat(payload, rsampleRate);
-	strcat(payload, ";");
-
-	*len = strlen(payload);
+	const sapi_config_t *cfg = sapi_config();
+	struct txt_buf tb;
+
+	// Assemble the Payload, SI:<send interval>,;SR:<sample rate>,;
+	txt_init(&tb, payload, SAPI_MAX_PAYLOAD_LEN);
+	txt_append_str(&tb, "SI:");
+	txt_append_i32(&tb, cfg->report_s);
+	txt_append_str(&tb, ",;SR:");
+	txt_append_i32(&tb, cfg->sample_rate);
+	txt_append_str(&tb, ",;");
+
+	*len = txt_len(&tb);
 	
-	dlog(LOG_DEBUG, "Echo Payload: %s", payload);
+	DLOG_DEBUG("Echo Payload: %s", payload);
     return SAPI_ERR_OK;
 }
 
@@ -60,6 +54,6 @@ sapi_error_t echo_init_sensor()
 	
 	echocount = 1;
 	
-	dlog(LOG_DEBUG, "Initialized Echo Sensor");
+	DLOG_DEBUG("Initialized Echo Sensor");
 	return SAPI_ERR_OK;
 }
\ No newline at end of file
@@ -77,11 +77,78 @@
 #include "sapi.h"
 #include "TempSensor.h"
 #include "EchoSensor.h"
+#include "serline.h"
+#include "sermap.h"
+#include "sertunnel.h"
+#include "sched.h"
+#include "lpidle.h"
+#include "duty.h"
+#include "nmea.h"
+#include "pps.h"
+#include "adcscan.h"
+#include "burst.h"
+#include "pulsecnt.h"
+#include "bufutil.h"
+#include "bootseq.h"
 //Beginning of Auto generated function prototypes by Atmel Studio
 //End of Auto generated function prototypes by Atmel Studio
 
 static uint8_t temp_sensor_id;
 static uint8_t echo_sensor_id;
+
+#if (PORT_GPS_SERIAL != PORT_NONE)
+// GPS receiver, its RMC and GGA decoded from the UART IRQ as they come
+static struct nmea gps;
+
+// Its PPS output, on a pin with an EXTINT, to keep the time and the
+// samples on the GPS second
+//#define GPS_PPS_PIN		A3
+#endif
+
+// A4 and A5 scanned in the background when Analog4 or Analog5 is set, at
+// ANALOG_SCAN_HZ, each conversion the sum of 16 for 14 bits
+#define ANALOG_SCAN_HZ		100
+#define ANALOG_SCAN_AVG		4
+
+// Longest the Sketch tasks may run past their deadlines, see sched_budget
+#define TASK_BUDGET_MS		1000
+
+// The Modbus master, a task of sapi_run, every millisecond for the
+// inter-frame gaps. Between polls it waits for the next one due, up to
+// TEMP_IDLE_MS for a request from the head-end.
+#define TEMP_POLL_MS		1
+#define TEMP_IDLE_MS		100
+static struct sched_task temp_task;
+
+static void temp_task_run(struct sched_task *t)
+{
+	uint32_t wait;
+	DUTY_ENTER(DUTY_SENSOR);
+
+	temp_poll();
+	wait = temp_wait_ms();
+	if (wait)
+	{
+		sched_at(t, min(wait, (uint32_t)TEMP_IDLE_MS));
+	}
+	DUTY_EXIT();
+}
+
+#if (PORT_GPS_SERIAL != PORT_NONE) && defined(GPS_PPS_PIN)
+// The PPS against the RMC sentences, a few times within each second the
+// sentence may take to follow its edge
+#define GPS_POLL_MS			100
+static struct sched_task gps_task;
+
+static void gps_task_run(struct sched_task *t)
+{
+	if (pps_poll())
+	{
+		sapi_align_sampling();
+	}
+}
+#endif
+
 time_t  epoch      = get_rtc_epoch();
 //
 //  Arduino setup function.
@@ -90,63 +157,418 @@ time_t  epoch      = get_rtc_epoch();
 int sendInterval1 = 0;
 int sampleRate1 = 0;
 
-unsigned long lastDebounceTime = 0;  // the last time the output pin was toggled
-unsigned long debounceDelay = 5000;    // the debounce time; increase if the output flickers
-int lastState = LOW;
+#if (PORT_RS232_SERIAL != PORT_NONE) && !defined(TEMP_LOCAL_SLAVE)
+// RS232 instrument, asked once at boot, the reply taken as a line
+// and its fields parsed by rs232_map into rs232_rec
+static struct ser_line rs232;
+static struct ser_req rs232_req;
+static char rs232_reply[SER_LINE_MAX];
+
+static const struct ser_field rs232_map[] =
+{
+	// name			index	decimals	scale	offset	datatype	unit
+	{ "reading",	0,		2,			1.0f,	0.0f,	0,			"" },
+};
+#define RS232_FIELDS		(sizeof(rs232_map) / sizeof(rs232_map[0]))
+static float rs232_value[RS232_FIELDS];
+static uint32_t rs232_stamp[RS232_FIELDS];
+static uint8_t rs232_quality[RS232_FIELDS];
+static struct ser_record rs232_rec;
+
+// The instrument as a sensor, and the exchanges from the head-end
+// tunnelled to it on the same line
+#define RS232_SENSOR_TYPE	"rs232"
+static uint8_t rs232_sensor_id;
+static struct ser_tunnel rs232_tunnel;
 
-volatile uint8_t alert = 0;
+// The line, a task of sapi_run, well inside its SER_LINE_GAP_MS, and
+// every RS232_IDLE_MS for a new request while it is idle
+#define RS232_POLL_MS		5
+#define RS232_IDLE_MS		100
+static struct sched_task rs232_task;
+
+static void rs232_task_run(struct sched_task *t)
+{
+	DUTY_ENTER(DUTY_SENSOR);
+
+	ser_line_poll(&rs232);
+	if (!ser_line_busy(&rs232))
+	{
+		sched_at(t, RS232_IDLE_MS);
+	}
+	DUTY_EXIT();
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Reply of the RS232 instrument, from ser_line_poll.
+//
+//////////////////////////////////////////////////////////////////////////
+static void rs232_done(struct ser_req *req)
+{
+	if (req->rc == SER_OK)
+	{
+		DLOG_DEBUG("RS232 reply %s, %d fields", req->buf, ser_record_parse(&rs232_rec, req->buf, req->len, ','));
+	}
+	else
+	{
+		ser_record_fail(&rs232_rec);
+		DLOG_ERR("Error reading RS232: %d", req->rc);
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Send the RS232 command. The reply comes in through the rs232 task, nothing waits.
+//
+//////////////////////////////////////////////////////////////////////////
 void rs232_write(){
- 
- Serial.println("-----Send Command RS232------");
- Serial2.begin(9600);
- /*
- for(int i=0; i < 8; i++){
-    Serial.print(cmd[i]);
-    Serial.println("");
- }
- */
- 	//pinMode(D0, OUTPUT); //TXD
-	//pinMode(D1, OUTPUT); //RXD
-	/*
-	digitalWrite(D0, HIGH);
-	digitalWrite(D1, LOW);
-	*/
-	//digitalWrite(D0, HIGH);
-	//digitalWrite(D1, HIGH);
-	delay(50); 
-	Serial.println("BEGINNING RS232");
-	Serial.println("i");
-	Serial2.write("i");
-	Serial2.write("test");
-	Serial2.println("m");
-	delay(50);
-	/*
-	digitalWrite(D0, HIGH);
-	digitalWrite(D1, LOW);
-	*/
-	//digitalWrite(D1, LOW);
-	//digitalWrite(D0, LOW);
-	delay(50);
-	if (Serial2.available() > 0){  //Read return data package (NOTE: Demo is just for your reference, the data package haven't be calibrated yet)
-		Serial.println(Serial2.read());
-	}
-	else{
-		Serial.println("Error reading RS232");
-		}
-		
-	Serial.println("------END COMMAND RS232------");
- }
+	DLOG_DEBUG("-----Send Command RS232------");
+	rs232_req.cmd = "itestm";
+	rs232_req.buf = rs232_reply;
+	rs232_req.size = sizeof(rs232_reply);
+	rs232_req.done = rs232_done;
+	(void)ser_line_submit(&rs232, &rs232_req);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// The RS232 sensor. A read is the last reply line, exchanges are tunnelled
+// to the instrument as they are, see sertunnel.h. The line is up from here,
+// the first command goes from the boot steps.
+//
+//////////////////////////////////////////////////////////////////////////
+static sapi_error_t rs232_init_sensor()
+{
+	ser_line_init(&rs232, &PORT_RS232_UART, PORT_RS232_BAUD, PORT_RS232_CONFIG, "\r\n", "\r\n");
+	lp_uart(&PORT_RS232_UART);
+	ser_record_init(&rs232_rec, rs232_map, RS232_FIELDS, rs232_value, rs232_stamp, rs232_quality, 0);
+	// No reply yet, a read fails until the first
+	rs232_req.rc = SER_ERR_TIMEOUT;
+	return SAPI_ERR_OK;
+}
+
+static sapi_error_t rs232_read_sensor(char *payload, uint8_t *len)
+{
+	if (rs232_req.busy || rs232_req.rc != SER_OK)
+	{
+		return SAPI_ERR_FAIL;
+	}
+	strcpy(payload, rs232_reply);
+	*len = rs232_req.len;
+	return SAPI_ERR_OK;
+}
+
+static sapi_error_t rs232_write_cfg(char *payload, uint8_t *len)
+{
+	return SAPI_ERR_NOT_IMPLEMENTED;
+}
+
+static void rs232_exchange_done(struct ser_tunnel *t)
+{
+	uint8_t buf[SAPI_MAX_PAYLOAD_LEN];
+	int len;
+
+	len = ser_tunnel_encode(t, buf, sizeof(buf));
+	if (len < 0)
+	{
+		sapi_exchange_complete(SAPI_ERR_FAIL, NULL, 0);
+		return;
+	}
+	sapi_exchange_complete(SAPI_ERR_OK, buf, len);
+}
+
+static sapi_error_t rs232_exchange(const uint8_t *payload, uint16_t len)
+{
+	int rc;
+
+	if (rs232_tunnel.busy)
+	{
+		return SAPI_ERR_IN_PROGRESS;
+	}
+	if ((rc = ser_tunnel_parse(&rs232_tunnel, payload, len)) < 0)
+	{
+		DLOG_ERR("RS232 tunnel: bad request");
+		return SAPI_ERR_BAD_DATA;
+	}
+	DLOG_DEBUG("RS232 tunnel: %d exchanges", rc);
+	ser_tunnel_start(&rs232, &rs232_tunnel, rs232_exchange_done);
+	return SAPI_ERR_OK;
+}
+#endif
+
+// A burst of BURST_PIN for each notification of the burst sensor, see burst.h.
+// The summary is the payload, a GET the samples, block-wise.
+//#define BURST_PIN			A5
+
+#ifdef BURST_PIN
+#define BURST_SENSOR_TYPE	"burst"
+#define BURST_HZ			500
+#define BURST_SAMPLES		2000
+#define BURST_AVG			2
+static uint8_t burst_sensor_id;
+static uint32_t burst_hz = BURST_HZ;
+static uint16_t burst_samples = BURST_SAMPLES;
+
+// The end of a burst, looked for while one runs
+#define BURST_POLL_MS		50
+static struct sched_task burst_task;
+
+//////////////////////////////////////////////////////////////////////////
+//
+// The last burst, N:<samples>,;HZ:<rate>,;MIN:..,;MAX:..,;MEAN:..,;RMS:..,;SD:..,;PK:<peaks>,;
+// in counts of BITS bits.
+//
+//////////////////////////////////////////////////////////////////////////
+static sapi_error_t burst_read_sensor(char *payload, uint8_t *len)
+{
+	struct burst_summary s;
+	struct txt_buf tb;
+
+	if (!burst_summary_get(&s))
+	{
+		return SAPI_ERR_NO_ENTRY;
+	}
+	txt_init(&tb, payload, SAPI_MAX_PAYLOAD_LEN);
+	txt_append_str(&tb, "N:");
+	txt_append_u32(&tb, s.n);
+	txt_append_str(&tb, ",;HZ:");
+	txt_append_u32(&tb, s.rate_hz);
+	txt_append_str(&tb, ",;BITS:");
+	txt_append_u32(&tb, s.bits);
+	txt_append_str(&tb, ",;MIN:");
+	txt_append_u32(&tb, s.min);
+	txt_append_str(&tb, ",;MAX:");
+	txt_append_u32(&tb, s.max);
+	txt_append_str(&tb, ",;MEAN:");
+	txt_append_fixed(&tb, s.mean, 1);
+	txt_append_str(&tb, ",;RMS:");
+	txt_append_fixed(&tb, s.rms, 1);
+	txt_append_str(&tb, ",;SD:");
+	txt_append_fixed(&tb, s.sigma, 1);
+	txt_append_str(&tb, ",;PK:");
+	txt_append_u32(&tb, s.peaks);
+	txt_append_str(&tb, ",;");
+	if (tb.err)
+	{
+		return SAPI_ERR_NO_MEM;
+	}
+	*len = txt_len(&tb);
+	return SAPI_ERR_OK;
+}
+
+static void burst_task_run(struct sched_task *t)
+{
+	char payload[SAPI_MAX_PAYLOAD_LEN];
+	uint8_t len;
+	sapi_error_t rc;
 
-// ISR function executes when push button at pin D5 is pressed
-void floatTrigger()
+	DUTY_ENTER(DUTY_SENSOR);
+	if (burst_poll())
+	{
+		rc = burst_read_sensor(payload, &len);
+		(void)sapi_read_complete(burst_sensor_id, rc == SAPI_ERR_OK ? rc : SAPI_ERR_FAIL, payload,
+								 rc == SAPI_ERR_OK ? len : 0);
+	}
+	DUTY_EXIT();
+}
+
+static sapi_error_t burst_init_sensor()
+{
+	return SAPI_ERR_OK;
+}
+
+static sapi_error_t burst_read_start()
+{
+	int rc = burst_start(BURST_PIN, burst_hz, burst_samples, BURST_AVG, 0);
+
+	if (rc != BURST_OK)
+	{
+		DLOG_ERR("Burst not started: %d", rc);
+		return SAPI_ERR_FAIL;
+	}
+	return SAPI_ERR_OK;
+}
+
+static sapi_error_t burst_read_block(char *payload, uint32_t offset, uint16_t *len, uint8_t *more)
+{
+	if (burst_busy())
+	{
+		return SAPI_ERR_IN_PROGRESS;
+	}
+	*len = burst_csv(payload, offset, *len, more);
+	return SAPI_ERR_OK;
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// burst=<hz>,<samples> for the bursts that follow.
+//
+//////////////////////////////////////////////////////////////////////////
+static sapi_error_t burst_write_cfg(char *payload, uint8_t *len)
+{
+	uint32_t hz;
+	uint32_t n;
+	char *p;
+
+	if (strncmp(payload, "burst=", 6) != 0)
+	{
+		return SAPI_ERR_NOT_IMPLEMENTED;
+	}
+	hz = strtoul(&payload[6], &p, 10);
+	if (*p != ',')
+	{
+		return SAPI_ERR_BAD_DATA;
+	}
+	n = strtoul(p + 1, &p, 10);
+	if (!hz || !n || n > BURST_MAX_SAMPLES)
+	{
+		return SAPI_ERR_BAD_DATA;
+	}
+	burst_hz = hz;
+	burst_samples = n;
+	return SAPI_ERR_OK;
+}
+#endif
+
+// The pulses of a flow meter at PULSE_PIN, counted by TC0 in hardware, see pulsecnt.h.
+// Each sample is the count since the one before and the rate of it per minute.
+//#define PULSE_PIN			D9
+
+#ifdef PULSE_PIN
+#define PULSE_SENSOR_TYPE	"pulse"
+#define PULSE_DATATYPE_COUNT	1
+#define PULSE_DATATYPE_RATE		2
+static uint8_t pulse_sensor_id;
+
+static sapi_error_t pulse_init_sensor()
+{
+	// Meters with a reed contact bounce, the EIC filter takes that out
+	return pulse_init(PULSE_PIN, 1) == PULSE_OK ? SAPI_ERR_OK : SAPI_ERR_FAIL;
+}
+
+// P:<pulses since boot>,;
+static sapi_error_t pulse_read_sensor(char *payload, uint8_t *len)
+{
+	sprintf(payload, "P:%lu,;", (unsigned long)pulse_total());
+	*len = strlen(payload);
+	return SAPI_ERR_OK;
+}
+
+static sapi_error_t pulse_read_samples(sapi_sample_t *samples, uint8_t *count)
+{
+	uint32_t ms;
+	uint32_t n = pulse_take(&ms);
+
+	if (*count < 2)
+	{
+		return SAPI_ERR_NO_MEM;
+	}
+	samples[0].epoch = get_rtc_epoch_at(millis(), &samples[0].ms);
+	samples[0].datatype = PULSE_DATATYPE_COUNT;
+	samples[0].value = n;
+	samples[1] = samples[0];
+	samples[1].datatype = PULSE_DATATYPE_RATE;
+	samples[1].value = ms ? n * 60000.0f / ms : 0;
+	*count = 2;
+	return SAPI_ERR_OK;
+}
+#endif
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Boot steps, run by the init task once setup() returns, in between the
+// passes of the mNIC link coming up. Every sensor a request may read is
+// initialized by setup() itself, these are the rest.
+//
+//////////////////////////////////////////////////////////////////////////
+#if (PORT_RS232_SERIAL != PORT_NONE) && !defined(TEMP_LOCAL_SLAVE)
+static uint32_t boot_rs232()
+{
+	rs232_write();
+	return BOOT_STEP_DONE;
+}
+#endif
+
+#if (PORT_GPS_SERIAL != PORT_NONE)
+static uint32_t boot_gps()
 {
-	alert = 1;                //Change Output value to LOW
-	dlog(LOG_DEBUG, "Interrupt Float");
+	nmea_init(&gps, &PORT_GPS_UART, PORT_GPS_BAUD, PORT_GPS_CONFIG, NMEA_RMC | NMEA_GGA);
+	lp_uart(&PORT_GPS_UART);
+	return BOOT_STEP_DONE;
+}
+
+#ifdef GPS_PPS_PIN
+// After the receiver, the PPS takes its time from the sentences
+static uint32_t boot_pps()
+{
+	pps_init(GPS_PPS_PIN, &gps);
+	(void)sched_add(&gps_task, "gps", gps_task_run, GPS_POLL_MS);
+	sched_budget(&gps_task, TASK_BUDGET_MS);
+	return BOOT_STEP_DONE;
+}
+#endif
+#endif
+
+static uint32_t boot_adc()
+{
+	DLOG_DEBUG("Analog 5: %d", analogRead(A4));
+	if (sapi_config()->analog4 || sapi_config()->analog5)
+	{
+		uint8_t pins[2];
+		uint8_t n = 0;
+		int rc;
+
+		if (sapi_config()->analog4)
+		{
+			pins[n++] = A4;
+		}
+		if (sapi_config()->analog5)
+		{
+			pins[n++] = A5;
+		}
+		rc = adc_scan_start(pins, n, ANALOG_SCAN_HZ, ANALOG_SCAN_AVG);
+		if (rc != ADC_SCAN_OK)
+		{
+			DLOG_WARNING("ADC scan not started: %d", rc);
+		}
+	}
+	return BOOT_STEP_DONE;
 }
+
+enum
+{
+#if (PORT_RS232_SERIAL != PORT_NONE) && !defined(TEMP_LOCAL_SLAVE)
+	BOOT_RS232,
+#endif
+#if (PORT_GPS_SERIAL != PORT_NONE)
+	BOOT_GPS,
+#ifdef GPS_PPS_PIN
+	BOOT_PPS,
+#endif
+#endif
+	BOOT_ADC,
+	BOOT_STEPS
+};
+
+static const struct boot_step boot_steps[BOOT_STEPS] =
+{
+#if (PORT_RS232_SERIAL != PORT_NONE) && !defined(TEMP_LOCAL_SLAVE)
+	{ "rs232", boot_rs232, 0 },
+#endif
+#if (PORT_GPS_SERIAL != PORT_NONE)
+	{ "gps", boot_gps, 0 },
+#ifdef GPS_PPS_PIN
+	{ "pps", boot_pps, BOOT_AFTER(BOOT_GPS) },
+#endif
+#endif
+	{ "adc", boot_adc, 0 },
+};
+
 void setup()
 {
 	Serial.begin(9600);
-	Serial3.begin(9600,SERIAL_8N2); //RS485 Baud Rate 8 Bits, NONE, 2 STOP Bits
+	// The RS485 port is begun by the temp sensor's Modbus master
 	sapi_error_t rcode;
 	// Initialize Sensor API
 	sapi_initialize(NULL);
@@ -162,30 +584,70 @@ void setup()
 	
 	//Test
 	pinMode(A5, INPUT);
-	delay(1000);
 	analogWriteResolution(12);
 	analogReadResolution(12);
-	delay(1000);
 	//analogWrite(A5, 4095); 
-	delay(1000);
-	Serial.print("Analog 5: ");
-	Serial.println(analogRead(A4));
 	
-	pinMode(D10,INPUT_PULLUP);
 	//pinMode(A5,INPUT);
 	//pinMode(D11,OUTPUT);
-	rs232_write();
 	loadGlobalVariables();
 	sampleRate1 = ParamSampleRate();
 	sendInterval1 = ParamSendInterval();
 	//logging array
 
-	// Register temp sensor
-	temp_sensor_id = sapi_register_sensor(TEMP_SENSOR_TYPE, temp_init_sensor, temp_read_sensor, temp_read_cfg, temp_write_cfg, 1, sampleRate1);
+	// Register temp sensor, reported every SendInterval and sampled every SampleRate
+	temp_sensor_id = sapi_register_sensor(TEMP_SENSOR_TYPE, temp_init_sensor, temp_read_sensor, temp_read_cfg, temp_write_cfg, 1, sendInterval1);
+	sapi_register_samples(temp_sensor_id, temp_read_samples);
+	sapi_register_txt(temp_sensor_id, temp_read_txt, temp_read_cfg_txt);
+	sapi_register_exchange(temp_sensor_id, temp_exchange);
+	sapi_set_sampling(temp_sensor_id, sampleRate1);
+	sapi_follow_config(temp_sensor_id);
+#ifdef TEMP_LEVEL_WINDOW
+	sapi_set_prefilter(temp_sensor_id, TEMP_DATATYPE_LEVEL, TEMP_LEVEL_WINDOW, TEMP_LEVEL_REJECT);
+#endif
+#ifdef TEMP_LEVEL_HIGH
+	sapi_set_alarm(temp_sensor_id, TEMP_DATATYPE_LEVEL, SAPI_ALARM_HIGH, TEMP_LEVEL_HIGH, TEMP_LEVEL_HYST);
+#endif
+#ifdef TEMP_LEVEL_LOW
+	sapi_set_alarm(temp_sensor_id, TEMP_DATATYPE_LEVEL, SAPI_ALARM_LOW, TEMP_LEVEL_LOW, TEMP_LEVEL_HYST);
+#endif
+#ifdef TEMP_LEVEL_RATE
+	sapi_set_alarm(temp_sensor_id, TEMP_DATATYPE_LEVEL, SAPI_ALARM_RATE, TEMP_LEVEL_RATE, TEMP_LEVEL_HYST);
+#endif
+#ifdef TEMP_FLOW_TOTAL
+	sapi_set_total(temp_sensor_id, TEMP_DATATYPE_FLOW, TEMP_DATATYPE_VOLUME, TEMP_FLOW_SCALE);
+#endif
 
 	// Initialize temp sensor
 	rcode = sapi_init_sensor(temp_sensor_id);
 
+#if (PORT_RS232_SERIAL != PORT_NONE) && !defined(TEMP_LOCAL_SLAVE)
+	// The RS232 instrument, read on request, with its tunnel
+	rs232_sensor_id = sapi_register_sensor(RS232_SENSOR_TYPE, rs232_init_sensor, rs232_read_sensor, NULL, rs232_write_cfg, 0, 0);
+	sapi_register_exchange(rs232_sensor_id, rs232_exchange);
+	rcode = sapi_init_sensor(rs232_sensor_id);
+#endif
+
+#ifdef BURST_PIN
+	// The burst sensor, a split-phase read for each notification
+	burst_sensor_id = sapi_register_sensor(BURST_SENSOR_TYPE, burst_init_sensor, burst_read_sensor, NULL, burst_write_cfg, 1, sendInterval1);
+	sapi_register_read_start(burst_sensor_id, burst_read_start);
+	sapi_register_block(burst_sensor_id, burst_read_block, NULL);
+	rcode = sapi_init_sensor(burst_sensor_id);
+#endif
+
+#ifdef PULSE_PIN
+	// The flow meter pulses, sampled with the temp sensor
+	pulse_sensor_id = sapi_register_sensor(PULSE_SENSOR_TYPE, pulse_init_sensor, pulse_read_sensor, NULL, NULL, 1, sendInterval1);
+	sapi_register_samples(pulse_sensor_id, pulse_read_samples);
+	sapi_set_sampling(pulse_sensor_id, sampleRate1);
+	rcode = sapi_init_sensor(pulse_sensor_id);
+#endif
+
+	// The daily health heartbeat goes with the data notifications, in place of
+	// the echo sensor's status message. No battery is measured on this board.
+	sapi_set_health(86400, NULL);
+
 	/*
 	// Register status message , send every 24 hours
 	echo_sensor_id = sapi_register_sensor(ECHO_SENSOR_TYPE, echo_init_sensor, echo_read_sensor, NULL, echo_write_cfg, 1, 86400);
@@ -196,11 +658,26 @@ void setup()
 	//Send both data in the beginning
 	sapi_push_notification(echo_sensor_id); //Status Message
 	*/
-	//  function for creating external interrupts at pin2 on Rising (LOW to HIGH)
-	alert = 0;
+	// The float switch at D10, and D11, are their own sensors when configured as inputs,
+	// filtered by the EIC and reported on both edges
+	sapi_register_config_inputs(sendInterval1);
 	//pinMode(PIN_A4, INPUT_PULLUP);
-	
 
+	// Move the Modbus transaction and the RS232 line along, neither waits,
+	// under the watchdog as the SAPI tasks are
+	(void)sched_add(&temp_task, "modbus", temp_task_run, TEMP_POLL_MS);
+	sched_budget(&temp_task, TASK_BUDGET_MS);
+#if (PORT_RS232_SERIAL != PORT_NONE) && !defined(TEMP_LOCAL_SLAVE)
+	(void)sched_add(&rs232_task, "rs232", rs232_task_run, RS232_POLL_MS);
+	sched_budget(&rs232_task, TASK_BUDGET_MS);
+#endif
+#ifdef BURST_PIN
+	(void)sched_add(&burst_task, "burst", burst_task_run, BURST_POLL_MS);
+	sched_budget(&burst_task, TASK_BUDGET_MS);
+#endif
+
+	// The rest overlaps the link coming up
+	(void)boot_seq_start(boot_steps, BOOT_STEPS);
 }
 
 
@@ -209,24 +686,9 @@ void setup()
 //
 void loop()
 {
-	int reading = digitalRead(D10);
-	attachInterrupt(digitalPinToInterrupt(D10), floatTrigger, RISING);
-	// Call SAPI run to do the heavy lifting
+	// Call SAPI run to run the tasks that are due, float switch events first
 	sapi_run();
-	
-	if (reading != lastState){
-		lastDebounceTime = millis();
-	}
-	
-	if ((millis() - lastDebounceTime) > debounceDelay) {
-		// whatever the reading is at, it's been there for longer than the debounce
-		// delay, so take it as the actual current state:
-		
-		if (alert == 1)
-		{
-		dlog(LOG_DEBUG, "Push Notification");
-		sapi_push_notification(temp_sensor_id);
-		alert = 0;
-		}
-	}
+
+	// Then sleep until the next interrupt, unless one is due already
+	sched_idle();
 }
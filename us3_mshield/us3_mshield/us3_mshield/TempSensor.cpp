@@ -29,6 +29,8 @@ Networks, Inc.
 #include "TempSensor.h"
 #include <Filters.h>
 #include "sapi.h"
+#include "bufutil.h"
+#include "lpidle.h"
 
 // DHT11 Sensor Object
 #define DHT_TYPE           DHT11
@@ -37,8 +39,53 @@ DHT_Unified dht(A1, DHT_TYPE);
 // Sensor Context. Contains the unit of measure and alert state.
 static temp_ctx_t context;
 
-int counter1 = 0;
-char 		payloadFinal[128];
+// Sensor working set
+static temp_state_t temp_state;
+
+static void temp_dht_take(bool ok);
+static uint8_t temp_dht_busy(void);
+
+//////////////////////////////////////////////////////////////////////////
+//
+// FL900 register map, one row per value in temp_fl900_t order. The reads,
+// their decoding, the samples and the payload all follow it. Datatype 0
+// is read but not published.
+//
+//////////////////////////////////////////////////////////////////////////
+static const struct mb_point temp_map[TEMP_FL900_COUNT] =
+{
+	// name			slave				fc					addr				type		order	scale	offset	datatype				unit
+	{ "battery",	TEMP_MODBUS_SLAVE,	MB_FC_READ_HOLDING,	TEMP_REG_BATTERY,	MB_T_FLOAT,	MB_CDAB, 1.0f,	0.0f,	0,						"V" },
+	{ "level",		TEMP_MODBUS_SLAVE,	MB_FC_READ_HOLDING,	TEMP_REG_LEVEL,		MB_T_FLOAT,	MB_CDAB, 1.0f,	0.0f,	TEMP_DATATYPE_LEVEL,	"In" },
+	{ "velocity",	TEMP_MODBUS_SLAVE,	MB_FC_READ_HOLDING,	TEMP_REG_VELOCITY,	MB_T_FLOAT,	MB_CDAB, 1.0f,	0.0f,	0,						"" },
+	{ "flow",		TEMP_MODBUS_SLAVE,	MB_FC_READ_HOLDING,	TEMP_REG_FLOW,		MB_T_FLOAT,	MB_CDAB, 1.0f,	0.0f,	0,						"" },
+	{ "quality",	TEMP_MODBUS_SLAVE,	MB_FC_READ_HOLDING,	TEMP_REG_QUALITY,	MB_T_FLOAT,	MB_CDAB, 1.0f,	0.0f,	0,						"" },
+};
+
+#ifndef TEMP_LEVEL_MODBUS
+static uint8_t temp_level_standin(const struct chan *c, float *value, uint32_t *age_ms);
+#endif
+
+// Published channels, a sample and a payload value each
+static const struct chan temp_chans[] =
+{
+	// name		source			datatype				unit	pin	flags	scale	offset	point							image				fn
+#ifdef TEMP_LEVEL_MODBUS
+	{ "level",	CHAN_MODBUS,	TEMP_DATATYPE_LEVEL,	"In",	0,	0,		1.0f,	0.0f,	&temp_map[TEMP_FL900_LEVEL],	&temp_state.image,	NULL },
+#else
+	{ "level",	CHAN_COMPUTED,	TEMP_DATATYPE_LEVEL,	"In",	0,	0,		1.0f,	0.0f,	NULL,							NULL,				temp_level_standin },
+#endif
+#ifdef TEMP_FLOW_TOTAL
+	{ "flow",	CHAN_MODBUS,	TEMP_DATATYPE_FLOW,		"",		0,	0,		1.0f,	0.0f,	&temp_map[TEMP_FL900_FLOW],		&temp_state.image,	NULL },
+#endif
+};
+#define TEMP_CHANS			(sizeof(temp_chans) / sizeof(temp_chans[0]))
+
+static void temp_fl900_init(void);
+static void temp_exchange_done(struct mb_batch *b);
+#ifdef TEMP_LOCAL_SLAVE
+static uint8_t temp_local_read(uint8_t fc, uint16_t addr, uint16_t count, uint16_t *regs);
+#endif
 
 
 //////////////////////////////////////////////////////////////////////////
@@ -59,23 +106,38 @@ sapi_error_t temp_init_sensor()
 	context.alertstate = tsat_disabled;
 	temp_sensor_enable();
 
-	// Initialize temperature/humidity sensor
+	// Modbus master on the RS485 port, in the format commissioning saved if any
+	mb_rtu_init(&temp_state.bus, &PORT_RS485_UART,
+		sapi_config()->mb_baud ? sapi_config()->mb_baud : TEMP_MODBUS_BAUD,
+		sapi_config()->mb_format ? sapi_config()->mb_format : TEMP_MODBUS_CONFIG, D4, D5);
+	// Replies keep coming in while the core is in standby
+	lp_uart(&PORT_RS485_UART);
+#if (PORT_RS485B_SERIAL != PORT_NONE)
+	// The second bus, a master of its own on its own port
+	mb_rtu_init(&temp_state.bus2, &PORT_RS485B_UART, PORT_RS485B_BAUD, PORT_RS485B_CONFIG,
+		TEMP_BUS2_DE_PIN, TEMP_BUS2_RE_PIN);
+	lp_uart(&PORT_RS485B_UART);
+#endif
+	temp_fl900_init();
+	chan_init(temp_chans, TEMP_CHANS);
+#ifdef TEMP_LOCAL_SLAVE
+	mb_slave_init(&temp_state.local, &PORT_RS232_UART, TEMP_LOCAL_BAUD, TEMP_LOCAL_CONFIG, TEMP_LOCAL_ADDR,
+		MB_RTU_NO_PIN, MB_RTU_NO_PIN, temp_local_read);
+#endif
+
+	// Initialize temperature/humidity sensor. Its reads all come from
+	// temp_poll, with the pin interrupt timing the bits, the first once it
+	// has warmed up, so the boot does not wait on it.
 	dht.begin();
+	(void)lp_veto(temp_dht_busy);
+	temp_state.dht_start_ms = millis() - TEMP_DHT_POLL_MS + TEMP_DHT_WARM_MS;
 
-	// Log a banner for the sensor with sensor details
-	println("DHT11 Sensor Initialized!");
-
+	// Log a banner for the sensor with sensor details, in the background
 	sensor_t sensor;
 	dht.temperature().getSensor(&sensor);
-	println("");
-	println("------------------------------------");
-	print  ("Sensor:       "); println(sensor.name);
-	print  ("Driver Ver:   "); printnum(sensor.version);    println("");
-	print  ("Unique ID:    "); printnum(sensor.sensor_id);  println("");
-	print  ("Max Value:    "); printnum(sensor.max_value);  println(" C");
-	print  ("Min Value:    "); printnum(sensor.min_value);  println(" C");
-	print  ("Resolution:   "); printnum(sensor.resolution); println(" C");
-	println("------------------------------------");        println("");
+	DLOG_INFO("DHT11 Sensor Initialized! %s ver %ld id %ld", sensor.name, (long)sensor.version, (long)sensor.sensor_id);
+	DLOG_INFO("DHT11 %d to %d C, resolution %d C, first read in %d ms", (int)sensor.min_value, (int)sensor.max_value,
+		(int)sensor.resolution, TEMP_DHT_WARM_MS);
 
 	return SAPI_ERR_OK;
 }
@@ -92,7 +154,6 @@ sapi_error_t temp_read_sensor(char *payload, uint8_t *len)
 {
 	float reading = 0.0;
 	sapi_error_t rc;
-	char buffer[128];
 
 	// Read temp sensor, already in network order
 	rc = read_dht11(&reading);
@@ -102,18 +163,42 @@ sapi_error_t temp_read_sensor(char *payload, uint8_t *len)
 	}
 	//sendInterval1;
 	//sampleRate1;
-	// Assemble the Payload
-	rc = temp_build_payload(buffer, &reading);
-	if (rc != SAPI_ERR_OK)
+	// Assemble the Payload, bounded by the writer
+	rc = temp_build_payload(payload, &reading);
+	if (rc == SAPI_ERR_OK)
 	{
-		return rc;
+		*len = strlen(payload);
 	}
-	strcpy(payload, buffer);
-	*len = strlen(buffer);
 	return rc;
 }
 
 
+//////////////////////////////////////////////////////////////////////////
+//
+// Samples the level. Callback called on
+//  SAPI sampler, every SampleRate
+//  CoAP Get sensor value
+//
+//////////////////////////////////////////////////////////////////////////
+#ifndef TEMP_LEVEL_MODBUS
+// Level until the FL900 is wired up
+static uint8_t temp_level_standin(const struct chan *c, float *value, uint32_t *age_ms)
+{
+	(void)c;
+	*value = TEMP_LEVEL_STANDIN;
+	*age_ms = 0;
+	return MB_Q_GOOD;
+}
+#endif
+
+sapi_error_t temp_read_samples(sapi_sample_t *samples, uint8_t *count)
+{
+	// A sample per published channel, stamped when it was read. The Modbus
+	// ones come from the register image, which temp_poll keeps current.
+	return chan_samples(temp_chans, TEMP_CHANS, samples, count);
+}
+
+
 //////////////////////////////////////////////////////////////////////////
 //
 // Reads a DHT11 sensor. Read sensor configuration. Builds and returns the payload. Callback called on
@@ -125,13 +210,46 @@ sapi_error_t temp_read_cfg(char *payload, uint8_t *len)
 	// Assemble the Payload
 	// Trick - if sensor value is NULL than the payload builder just returns the UOM.
 	sapi_error_t rc = temp_build_payload(payload, NULL);
-	strcpy(payload, payload);
 	*len = strlen(payload);
 
     return rc;
 }
 
 
+//////////////////////////////////////////////////////////////////////////
+//
+// Reads a DHT11 sensor, the payload written by tb where it is sent from.
+// Callback called on
+//   CoAP Get sensor value
+//
+//////////////////////////////////////////////////////////////////////////
+sapi_error_t temp_read_txt(struct txt_buf *tb)
+{
+	float reading = 0.0;
+	sapi_error_t rc;
+
+	rc = read_dht11(&reading);
+	if (rc != SAPI_ERR_OK)
+	{
+		return rc;
+	}
+	return chan_payload(temp_chans, TEMP_CHANS, get_rtc_epoch(), tb, 0);
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Read sensor configuration, the UOMs written by tb straight into the
+// response. Callback called on
+//   CoAP Get configuration value
+//
+//////////////////////////////////////////////////////////////////////////
+sapi_error_t temp_read_cfg_txt(struct txt_buf *tb)
+{
+	return chan_payload(temp_chans, TEMP_CHANS, get_rtc_epoch(), tb, 1);
+}
+
+
 //////////////////////////////////////////////////////////////////////////
 //
 // Write sensor configuration. Processes payload sent from client. Callback called on
@@ -148,6 +266,14 @@ sapi_error_t temp_write_cfg(char *payload, uint8_t *len)
 	{
 		context.scalecfg = FAHRENHEIT_SCALE;
 	}
+	else if (!strcmp(payload, "cfg=detect"))
+	{
+		return temp_detect_modbus();
+	}
+	else if (!strcmp(payload, "cfg=scan"))
+	{
+		return temp_scan_modbus();
+	}
 	// Config not supported
 	else
 	{
@@ -171,179 +297,476 @@ sapi_error_t temp_write_cfg(char *payload, uint8_t *len)
 // RS485_TX = B		--->		Connect to RT- (White)
 // RS485_RX = A		--->		Connect to RT+ (Green)
 //////////////////////////////////////////////////////////////////////////
-float resultTemp = 0;
-float resultUltra = 0;
-
-byte temp_data[30];
-byte sendRequestBattery[8]={0x01,0x03,0x00,0x0C,0x00,0x02,0x04,0x08};				//Send Request for Manufacturer ID
-byte sendRequestLevel[8]={0x01,0x03,0x00,0x0E,0x00,0x02,0xA5,0xC8};				//Send Request for Manufacturer ID
-byte sendRequestVelocity[8]={0x01,0x03,0x00,0x10,0x00,0x02,0xC5,0xCE};				//Send Request for Manufacturer ID
-byte sendRequestFlow[8]={0x01,0x03,0x00,0x12,0x00,0x02,0x64,0x0E};				//Send Request for Manufacturer ID
-byte sendRequestQuality[8]={0x01,0x03,0x00,0x14,0x00,0x02,0x84,0x0F};				//Send Request for Manufacturer ID	
-int w = 0;
-char		motorola_payload[128];
-char		temp_result[128];
-char		temp_tempdata[128];
-char		temp_battery[128];
-char		temp_level[128];
-char		temp_velocity[128];
-char		temp_flow[128];
-char		temp_quality[128];
-size_t bytes;
-
-char* Send(byte * cmd, byte* ret) {
-	// use default send function
-	//turn on relay
-	/*
-	digitalWrite(D6, HIGH);
-	digitalWrite(D7, LOW);
-	delay(100);
-	*/
-	sendCommand(cmd);
-	int h = 0;
-	// receive answer
-	if (Serial3.available()){  //Read return data package (NOTE: Demo is just for your reference, the data package haven't be calibrated yet)
-	while(Serial3.read() != 0x01 && h < 1000){
-		h = h + 1;
-	}
-	h = 0;
-	ret[0] = 0x01;
-	for(int j=2; j < 24; j++){
-		ret[j++]=(Serial3.read());
-	}
-	
-    Serial.println("Data Begin");
-    Serial.println(ret[0],HEX); //byte 1     //Slave ID
-    Serial.println(ret[2],HEX); //byte 2     //Function Code
-    Serial.println(ret[4],HEX); //byte 3     //How many bytes send
-    Serial.println(ret[6],HEX); //byte 4     //Hex High bytes First Register
-    Serial.println(ret[8],HEX); //byte 5     //Hex Low bytes First Register
-    Serial.println(ret[10],HEX); //byte 6    //2nd Register
-	Serial.println(ret[12],HEX); //byte 7    //
-	Serial.println(ret[14],HEX); //byte 8    //3rd Register
-	Serial.println(ret[16],HEX); //byte 9    //
-	Serial.println(ret[18],HEX); //byte 10   //4th Register
-	Serial.println(ret[20],HEX); //byte 11   //
-	Serial.println(ret[22],HEX); //byte 12   //5th Register
-	Serial.println(ret[24],HEX); //byte 13	 //
-	/*
-	Serial.println(ret[26],HEX); //byte 14   //6th Register
-	Serial.println(ret[28],HEX); //byte 15	 //
-	Serial.println(ret[30],HEX); //byte 16   //7th Register
-	Serial.println(ret[32],HEX); //byte 17	 //
-	Serial.println(ret[34],HEX); //byte 18   //8th Register
-	Serial.println(ret[36],HEX); //byte 19	 //
-	Serial.println(ret[38],HEX); //byte 20   //9th Register
-	Serial.println(ret[39],HEX); //byte 21	 //
-	Serial.println(ret[40],HEX); //byte 21	 //
-	Serial.println(ret[41],HEX); //byte 19	 //
-	Serial.println(ret[42],HEX); //byte 18   //10th Register
-	Serial.println(ret[43],HEX); //byte 19	 //
-	Serial.println(ret[44],HEX); //byte 19	 //
-	*/
-	strcpy(temp_result, "");
-	strcpy(temp_tempdata, "");
-	//put everything in the String (all the rs485 data from Motorola ACE)
-	//for (int y = 0; y < 16; y = y + 2){
-		for (int y = 6; y < 14; y = y + 2){
-		sprintf(motorola_payload, "%X", ret[y]);
-		
-		strcat(temp_tempdata, motorola_payload);
-		strcat(temp_result,motorola_payload);
-	};
-	Serial.print("Temp Data :");
-	Serial.println(temp_tempdata);
-	//convertCDAB(temp_battery);
-	Serial.print("Temp Data is : ");
-	Serial.println(convertCDAB(temp_tempdata));
-	
-	/*sprintf(motorola_payload, "%X;", ret[44]);
-	strcat(temp_result,motorola_payload);
-	Serial.println(temp_result);
-	
-	sprintf(motorola_payload, "%X;", ret[44]);
-	*/
-	Serial.println();
-
-    Serial.println("Data End");
-
-    Serial3.flush();
-    Serial.println("Received data Done");
-	
-  }
-  else{
-    Serial.println("Error reading RS485");
-  }
-    delay(1000);
-	//turn off relay
-	digitalWrite(D6, LOW);
-	digitalWrite(D7, HIGH);
-	
-	return temp_result;
-}
-
-// Convert Hex value to float.
-//Float -> Mid-Little Endian (CDAB)
-float convertCDAB(char * test) {
-	//char *hex_in = "F2584135";
-	char *hex_in = test;
-	printf("hex_in: %s\n", hex_in);
-
-	// Flip: 0x________\0
-	char hex_flip[] = "0x________";
-	memcpy(&hex_flip[2], hex_in+4, 4);
-	memcpy(&hex_flip[6], hex_in, 4);
-	printf("hex_flip: %s\n", hex_flip);
-
-	// Convert
-
-	uint32_t uint_value;
-	float float_value;
-	sscanf(hex_flip, "%x", &uint_value);
-	printf("uint_value: 0x%x\n", uint_value);
-
-	float_value = *((float *)&uint_value);
-	printf("float_value: %f\n", float_value);
-
-	return float_value;
-
-}
-
-
-/*sendCommand(...)******************************************************************************
- * General function that sends command to RS485 peripheral device
- * <CR> is added to all commands
- * For RS485 communication, RTS pin has to be HIGH to allow writing to peripheral
- **********************************************************************************************/
-void sendCommand(byte *cmd) {
-
-//check if transmit the correct data
-/*
- Serial.println("Send Command");
- for(int i=0; i < 8; i++){
-    Serial.print(cmd[i]);
-    Serial.println("");
- }
- */
- 
-	// set RTS to HIGH to allow writing to MAX485
- 	digitalWrite(D4, HIGH);
- 	digitalWrite(D5, HIGH); 
-	delay(100);
-
-	for(int i=0; i < 8; i++){
-		Serial3.write(cmd[i]); 
-  //Serial.print(cmd[i]);
-	}	
- // send command
-	Serial3.flush(); // Make sure message is fully transferred
-	// set RTS to LOW to receive answer
-	digitalWrite(D4, LOW);
-	digitalWrite(D5, LOW);
- 
-	delay(50);
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Read one FL900 value, by the row of the register map for addr, from the
+// register image. No bus transaction, the poller keeps the image current.
+//
+//////////////////////////////////////////////////////////////////////////
+static sapi_error_t temp_modbus_rc(int rc, uint16_t addr)
+{
+	if (rc == MB_ERR_TIMEOUT)
+	{
+		DLOG_ERR("RS485 no reply, reg %04X", addr);
+		return SAPI_ERR_FAIL;
+	}
+	if (rc != MB_OK)
+	{
+		DLOG_ERR("RS485 read error %d, reg %04X", rc, addr);
+		return SAPI_ERR_BAD_DATA;
+	}
+	return SAPI_ERR_OK;
 }
- 
+
+sapi_error_t temp_read_register(uint16_t addr, float *reading, uint8_t *quality, uint32_t *age_ms)
+{
+	const struct mb_point *pt;
+
+	for (pt = temp_map; pt < temp_map + TEMP_FL900_COUNT && pt->addr != addr; pt++)
+		;
+	if (pt == temp_map + TEMP_FL900_COUNT)
+	{
+		return SAPI_ERR_NO_ENTRY;
+	}
+	*quality = mb_point_read(pt, &temp_state.image, reading, age_ms);
+	return *quality == MB_Q_NONE ? SAPI_ERR_FAIL : SAPI_ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Read all the FL900 values. The planner merges the contiguous registers
+// of the map into one transaction instead of one per value.
+//
+//////////////////////////////////////////////////////////////////////////
+static void temp_fl900_done(struct mb_poll *p);
+
+// Relay 1 is latching, one coil each way
+static void temp_power_set(uint8_t on)
+{
+	digitalWrite(D6, on ? HIGH : LOW);
+	digitalWrite(D7, on ? LOW : HIGH);
+}
+
+static void temp_fl900_init(void)
+{
+	struct mb_poll *p = &temp_state.poll[0];
+
+	mb_image_init(&temp_state.image, TEMP_MODBUS_SLAVE, TEMP_IMAGE_BASE, TEMP_IMAGE_COUNT,
+		temp_state.img_regs, temp_state.img_stamp, temp_state.img_quality, TEMP_FL900_MAX_AGE_MS);
+	mb_map_wants(temp_map, TEMP_FL900_COUNT, MB_FC_READ_HOLDING, &temp_state.image,
+		temp_state.want, TEMP_FL900_COUNT);
+
+	// More slaves on the bus get their own entries
+	p->slave = TEMP_MODBUS_SLAVE;
+	p->fc = MB_FC_READ_HOLDING;
+	p->want = temp_state.want;
+	p->n = TEMP_FL900_COUNT;
+	p->gap = TEMP_MODBUS_GAP;
+	p->interval_ms = TEMP_FL900_POLL_MS;
+	p->timeout_ms = TEMP_FL900_TIMEOUT_MS;
+	p->retries = TEMP_FL900_RETRIES;
+	p->done = temp_fl900_done;
+	p->image = &temp_state.image;
+#ifdef TEMP_POWER_RELAY
+	pwr_domain_init(&temp_state.power, temp_power_set, TEMP_POWER_WARMUP_MS, TEMP_FL900_POLL_MS);
+	p->power = &temp_state.power;
+#else
+	(void)temp_power_set;
+#endif
+	mb_poll_init(&temp_state.poller, &temp_state.bus, temp_state.poll, 1);
+
+#if (PORT_RS485B_SERIAL != PORT_NONE)
+	// The second FL900, the same registers into its own image
+	p = &temp_state.poll2[0];
+	mb_image_init(&temp_state.image2, TEMP_BUS2_SLAVE, TEMP_IMAGE_BASE, TEMP_IMAGE_COUNT,
+		temp_state.img2_regs, temp_state.img2_stamp, temp_state.img2_quality, TEMP_FL900_MAX_AGE_MS);
+	mb_map_wants(temp_map, TEMP_FL900_COUNT, MB_FC_READ_HOLDING, &temp_state.image2,
+		temp_state.want2, TEMP_FL900_COUNT);
+	p->slave = TEMP_BUS2_SLAVE;
+	p->fc = MB_FC_READ_HOLDING;
+	p->want = temp_state.want2;
+	p->n = TEMP_FL900_COUNT;
+	p->gap = TEMP_MODBUS_GAP;
+	p->interval_ms = TEMP_FL900_POLL_MS;
+	p->timeout_ms = TEMP_FL900_TIMEOUT_MS;
+	p->retries = TEMP_FL900_RETRIES;
+	p->done = temp_fl900_done;
+	p->image = &temp_state.image2;
+	mb_poll_init(&temp_state.poller2, &temp_state.bus2, temp_state.poll2, 1);
+#endif
+}
+
+sapi_error_t temp_read_fl900(void)
+{
+	int rc;
+
+#ifdef TEMP_POWER_RELAY
+	pwr_domain_acquire(&temp_state.power);
+	while (!pwr_domain_ready(&temp_state.power))
+	{
+		temp_poll();
+	}
+#endif
+	rc = mb_read_group(&temp_state.bus, TEMP_MODBUS_SLAVE, MB_FC_READ_HOLDING,
+		temp_state.want, TEMP_FL900_COUNT, TEMP_MODBUS_GAP);
+	mb_image_result(&temp_state.image, temp_state.want, TEMP_FL900_COUNT, rc);
+#ifdef TEMP_POWER_RELAY
+	pwr_domain_release(&temp_state.power);
+#endif
+	return temp_modbus_rc(rc, temp_map[0].addr);
+}
+
+sapi_error_t temp_detect_modbus(void)
+{
+	int rc;
+
+#ifdef TEMP_POWER_RELAY
+	pwr_domain_acquire(&temp_state.power);
+	while (!pwr_domain_ready(&temp_state.power))
+	{
+		temp_poll();
+	}
+#endif
+	// What the poller has on the bus finishes first
+	while (mb_rtu_busy(&temp_state.bus))
+	{
+		mb_rtu_poll(&temp_state.bus);
+	}
+	rc = mb_rtu_detect(&temp_state.bus, TEMP_MODBUS_SLAVE, MB_FC_READ_HOLDING, TEMP_REG_BATTERY);
+#ifdef TEMP_POWER_RELAY
+	pwr_domain_release(&temp_state.power);
+#endif
+	if (rc != MB_OK)
+	{
+		return temp_modbus_rc(rc, TEMP_REG_BATTERY);
+	}
+	return sapi_set_modbus_format(temp_state.bus.baud, temp_state.bus.config);
+}
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Bus scan. The probes take their turns with the poll table, the slaves
+// found join it from temp_poll once no poll is on the bus.
+//
+//////////////////////////////////////////////////////////////////////////
+static void temp_scan_done(struct mb_scan *s)
+{
+#ifdef TEMP_POWER_RELAY
+	pwr_domain_release(&temp_state.power);
+#endif
+	temp_state.scan_table = 1;
+}
+
+static void temp_scan_begin(void)
+{
+	(void)mb_scan_start(&temp_state.scan, &temp_state.bus, MB_FC_READ_HOLDING, TEMP_REG_BATTERY,
+		MB_SCAN_FIRST, MB_SCAN_LAST, temp_scan_done);
+}
+
+sapi_error_t temp_scan_modbus(void)
+{
+	if (temp_state.scan.busy || temp_state.scan_wait || temp_state.scan_table)
+	{
+		return SAPI_ERR_IN_PROGRESS;
+	}
+	DLOG_INFO("Modbus scan of %d to %d", MB_SCAN_FIRST, MB_SCAN_LAST);
+#ifdef TEMP_POWER_RELAY
+	// Started from temp_poll once the supply is up
+	pwr_domain_acquire(&temp_state.power);
+	temp_state.scan_wait = 1;
+#else
+	temp_scan_begin();
+#endif
+	return SAPI_ERR_OK;
+}
+
+static void temp_scan_take(void)
+{
+	uint8_t n, i;
+
+	temp_state.scan_table = 0;
+	n = mb_scan_table(&temp_state.scan, temp_state.poll, temp_state.poller.n, TEMP_MODBUS_POLLS,
+		TEMP_FL900_POLL_MS);
+	if (n != temp_state.poller.n)
+	{
+#ifdef TEMP_POWER_RELAY
+		// Behind the FL900's supply, as they answered
+		for (i = temp_state.poller.n; i < n; i++)
+		{
+			temp_state.poll[i].power = &temp_state.power;
+		}
+#else
+		(void)i;
+#endif
+		mb_poll_init(&temp_state.poller, &temp_state.bus, temp_state.poll, n);
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// DHT11. One read every TEMP_DHT_POLL_MS gives both its values, and all
+// the readers share its record. The pin interrupt times the bits with
+// micros(), which stops in standby, so the core only idles during a read.
+//
+//////////////////////////////////////////////////////////////////////////
+static void temp_dht_take(bool ok)
+{
+	temp_dht_t *d = &temp_state.dht;
+	DHT &s = dht.dht();
+
+	d->reads++;
+	d->valid = ok;
+	if (!ok)
+	{
+		d->fails++;
+		return;
+	}
+	d->temp_c = s.temperature(false);
+	d->temp_f = s.convertCtoF(d->temp_c);
+	d->humidity = s.humidity();
+	d->stamp_ms = millis();
+	d->epoch = get_rtc_epoch();
+}
+
+static void temp_dht_poll(void)
+{
+	DHT &s = dht.dht();
+	int8_t rc;
+
+	if (!s.busy())
+	{
+		if ((uint32_t)(millis() - temp_state.dht_start_ms) >= TEMP_DHT_POLL_MS)
+		{
+			temp_state.dht_start_ms = millis();
+			(void)s.start();
+		}
+		return;
+	}
+	rc = s.poll();
+	if (rc != DHT_BUSY)
+	{
+		temp_dht_take(rc == DHT_OK);
+	}
+}
+
+static uint8_t temp_dht_busy(void)
+{
+	return dht.dht().busy();
+}
+
+static uint32_t temp_dht_wait_ms(void)
+{
+	uint32_t since = millis() - temp_state.dht_start_ms;
+
+	if (dht.dht().busy())
+	{
+		return 0;
+	}
+	return since < TEMP_DHT_POLL_MS ? TEMP_DHT_POLL_MS - since : 0;
+}
+
+const temp_dht_t *temp_dht(void)
+{
+	return &temp_state.dht;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Background reads. The poll table runs from mb_rtu_poll, one request at
+// a time, so the loop keeps serving HDLC frames and alarms meanwhile.
+//
+//////////////////////////////////////////////////////////////////////////
+static void temp_fl900_done(struct mb_poll *p)
+{
+	// The poller has marked the image, this only logs a failure
+	temp_modbus_rc(p->rc, temp_map[0].addr);
+}
+
+void temp_poll(void)
+{
+	temp_dht_poll();
+	mb_rtu_poll(&temp_state.bus);
+	if (temp_state.scan_table && !temp_state.poller.cur)
+	{
+		temp_scan_take();
+	}
+#ifdef TEMP_LEVEL_MODBUS
+	mb_poll_run(&temp_state.poller);
+#endif
+#if (PORT_RS485B_SERIAL != PORT_NONE)
+	// Each bus has its transaction on the line at once
+	mb_rtu_poll(&temp_state.bus2);
+	mb_poll_run(&temp_state.poller2);
+#endif
+#ifdef TEMP_POWER_RELAY
+	if (temp_state.batch_wait && pwr_domain_ready(&temp_state.power))
+	{
+		temp_state.batch_wait = 0;
+		mb_batch_start(&temp_state.bus, &temp_state.batch, temp_exchange_done);
+	}
+	if (temp_state.scan_wait && pwr_domain_ready(&temp_state.power))
+	{
+		temp_state.scan_wait = 0;
+		temp_scan_begin();
+	}
+#endif
+#ifdef TEMP_LOCAL_SLAVE
+	mb_slave_poll(&temp_state.local);
+#endif
+}
+
+uint32_t temp_wait_ms(void)
+{
+	uint32_t wait = temp_dht_wait_ms();
+
+#ifdef TEMP_LOCAL_SLAVE
+	// A request to the local slave may come in at any time
+	(void)wait;
+	return 0;
+#else
+	if (!wait || mb_rtu_busy(&temp_state.bus))
+	{
+		return 0;
+	}
+#if (PORT_RS485B_SERIAL != PORT_NONE)
+	if (mb_rtu_busy(&temp_state.bus2))
+	{
+		return 0;
+	}
+	wait = min(wait, mb_poll_wait_ms(&temp_state.poller2));
+#endif
+#ifdef TEMP_POWER_RELAY
+	if (temp_state.batch_wait || temp_state.scan_wait)
+	{
+		return 0;
+	}
+#endif
+	if (temp_state.scan_table)
+	{
+		return 0;
+	}
+#ifdef TEMP_LEVEL_MODBUS
+	return min(wait, mb_poll_wait_ms(&temp_state.poller));
+#else
+	return wait;
+#endif
+#endif
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Passthrough. The batch takes its turns on the bus with the poll table,
+// and its answers go back in one response when the last read is done.
+//
+//////////////////////////////////////////////////////////////////////////
+static void temp_exchange_done(struct mb_batch *b)
+{
+	uint8_t buf[SAPI_MAX_PAYLOAD_LEN];
+	int len;
+
+#ifdef TEMP_POWER_RELAY
+	pwr_domain_release(&temp_state.power);
+#endif
+	len = mb_batch_encode(b, buf, sizeof(buf));
+	if (len < 0)
+	{
+		sapi_exchange_complete(SAPI_ERR_FAIL, NULL, 0);
+		return;
+	}
+	sapi_exchange_complete(SAPI_ERR_OK, buf, len);
+}
+
+sapi_error_t temp_exchange(const uint8_t *payload, uint16_t len)
+{
+	struct mb_batch *b = &temp_state.batch;
+	int rc;
+
+	if (b->busy || temp_state.batch_wait)
+	{
+		return SAPI_ERR_IN_PROGRESS;
+	}
+	if ((rc = mb_batch_parse(b, payload, len)) < 0)
+	{
+		DLOG_ERR("Modbus passthrough: bad request");
+		return SAPI_ERR_BAD_DATA;
+	}
+	DLOG_DEBUG("Modbus passthrough: %d reads", rc);
+#ifdef TEMP_POWER_RELAY
+	// Started from temp_poll once the FL900 is up
+	pwr_domain_acquire(&temp_state.power);
+	temp_state.batch_wait = 1;
+#else
+	mb_batch_start(&temp_state.bus, b, temp_exchange_done);
+#endif
+	return SAPI_ERR_OK;
+}
+
+
+//////////////////////////////////////////////////////////////////////////
+//
+// Local Modbus slave. Reads are served from the register image, never the
+// field bus, so a panel polling us costs the FL900 nothing.
+//
+//////////////////////////////////////////////////////////////////////////
+#ifdef TEMP_LOCAL_SLAVE
+static uint8_t temp_local_read(uint8_t fc, uint16_t addr, uint16_t count, uint16_t *regs)
+{
+	uint16_t r, row;
+	uint32_t age_ms, u;
+	uint8_t q;
+	float v;
+
+	if (fc == MB_FC_READ_HOLDING)
+	{
+		// The FL900's registers as last read
+		if (!mb_image_regs(&temp_state.image, addr, count))
+		{
+			return MB_EX_ILLEGAL_ADDRESS;
+		}
+		q = mb_image_read(&temp_state.image, addr, count, regs, NULL);
+		return q == MB_Q_NONE ? MB_EX_DEVICE_FAILURE : 0;
+	}
+
+	// Input registers, each row of the map decoded
+	if ((uint32_t)addr + count > TEMP_FL900_COUNT * TEMP_LOCAL_ROW_REGS)
+	{
+		return MB_EX_ILLEGAL_ADDRESS;
+	}
+	for (r = addr; r < addr + count; r++)
+	{
+		row = r / TEMP_LOCAL_ROW_REGS;
+		q = mb_point_read(&temp_map[row], &temp_state.image, &v, &age_ms);
+		if (q == MB_Q_NONE)
+		{
+			v = 0.0f;
+			age_ms = 0;
+		}
+		memcpy(&u, &v, sizeof(u));
+		switch (r % TEMP_LOCAL_ROW_REGS)
+		{
+		case 0:
+			*regs++ = u & 0xffff;
+			break;
+		case 1:
+			*regs++ = u >> 16;
+			break;
+		case 2:
+			*regs++ = q;
+			break;
+		default:
+			*regs++ = min(age_ms / 1000, 0xffffUL);
+			break;
+		}
+	}
+	return 0;
+}
+#endif
+
  /*
  void rs232_write(){
  
@@ -366,104 +789,32 @@ void sendCommand(byte *cmd) {
 	Serial.println("------END COMMAND RS232------");
  }
  */
-  //Float Code
-  int temp_float = 0;
-  int calculate_Float(){
-	  pinMode(D10, INPUT_PULLUP);
-	  temp_float = digitalRead(D10);
-	  
-	  if (temp_float == 1){
-		  temp_float = 0;
-	  }
-	  else if (temp_float == 0){
-		  temp_float = 1;
-	  }
-	  
-	  return temp_float;
-  }
-//////////////////////////////////////////////////////////////////////////
-//
-// Code to build the sensor payload. Temp payload is text with this format:
-//   <epoch>,<temp>,<uom>
-//     <epoch> is a 4 byte (8 hex char) timestamp
-//     <temp> is a decimal number
-//     <uom> is a char: C or F
+//////////////////////////////////////////////////////////////////////////
+//
+// Code to build the sensor payload. Payload is text with this format:
+//   <epoch>,<value>,...
+//     <epoch> is the UNIX epoch, decimal
+//     <value> is a decimal number, one per published channel of temp_chans
+//   or with no reading, the units of the same channels:
+//   <unit>,...
 //
 //  Note that the payload is text. Payloads can also be a byte array of binary data.
 //
 //////////////////////////////////////////////////////////////////////////
 sapi_error_t temp_build_payload(char *buf, float *reading)
 {
-	int sendInterval2 = ParamSendInterval();
-	int sampleRate2 =  ParamSampleRate();
-	char 		payload[128]; // REMEMBER!! maximum payload 118 character payload character
-	char		temp_payload[128];
-	char		reading_buf[32];
-	char        datatype_Ultra[] = "3,"; //datatype for LEVEL is 3
-	char		datatype_Float[] = "7,"; //datatype for DI state is 7
-	char		unitUltra[] = "In";
-	char		unitFloat[] = "Al";
-	char		unit_buf[4];
-	char		motorola_temp[] = "10.00";
-	time_t     	epoch;
-	uint32_t	indx;
-	char    rmotorola1[128] = "12.00,";
-	char    rfloat[] = "2,"; //if it shows 2, float not connected properly. The value should be 0 or 1.
-	char    temp_epoch[20];
-	
-	strcpy(temp_payload, "");
-	strcpy(payload, "");
-
-	Serial3.flush();
-	//Send(sendRequest10Data, temp_data);
-	//* motorola_temp = Send(sendRequest10Data, temp_data); // RT //WRONG HERE, HARDFAULT
-	/*
-	sprintf(rmotorola1, "%s", Send(sendRequestBattery, temp_data)); //RT
-	delay(1000);
-	sprintf(rmotorola1, "%s", Send(sendRequestBattery, temp_data)); //RT
-	
-	delay(1000);
-	sprintf(rmotorola1, "%s", Send(sendRequestLevel, temp_data)); //RT
-	delay(1000);
-	sprintf(rmotorola1, "%s", Send(sendRequestVelocity, temp_data)); //RT
-	delay(1000);
-	sprintf(rmotorola1, "%s", Send(sendRequestFlow, temp_data)); //RT
-	delay(1000);
-	sprintf(rmotorola1, "%s", Send(sendRequestQuality, temp_data)); //RT
-	*/
-	
-	//rs232_write();
-	// Create string containing the UNIX epoch
-	epoch = get_rtc_epoch();
-	sprintf(temp_epoch, "%d,", epoch);
-	
-	//construct ultrasonic data payload
-	sprintf(temp_payload, "%d,", epoch);
-	
-	strcat(temp_payload, rmotorola1);
-
-	strcpy(payload, temp_payload);
-	/*
-	dlog(LOG_DEBUG, "Temp Payload: %s", payload);
-	return SAPI_ERR_OK;
-	*/
+	struct txt_buf tb;
+	sapi_error_t rc;
 
-	if ((counter1 >= (sendInterval2 / sampleRate2 - 1)) || (temp_float == 1) ){
-		strcat(payloadFinal, payload);
-		strcpy(buf, payloadFinal); //copy to final buf and ready to be sent
-		counter1= 0;
-		dlog(LOG_DEBUG, "Temp Payload Final: %s", payloadFinal);
-		//empty the final payload
-		strcpy(payloadFinal, "");
-		return SAPI_ERR_OK;
-	}
-	else {
-		counter1 = counter1 + 1; //+1 counter
-		strcat(payloadFinal, payload);
-		//dlog(LOG_DEBUG, "Temp Payload: %s", payload);
-		return SAPI_ERR_OK;
+	txt_init(&tb, buf, TEMP_PAYLOAD_LEN);
+	rc = chan_payload(temp_chans, TEMP_CHANS, get_rtc_epoch(), &tb, !reading);
+	if (rc != SAPI_ERR_OK)
+	{
+		return rc;
 	}
-	
+
+	DLOG_DEBUG("Temp Payload: %s", buf);
+	return SAPI_ERR_OK;
 }
 
 
@@ -481,36 +832,19 @@ sapi_error_t temp_build_payload(char *buf, float *reading)
 //////////////////////////////////////////////////////////////////////////
 sapi_error_t read_dht11(float *reading)
 {
-	sapi_error_t rc = SAPI_ERR_OK;
-	float re = INVALID_TEMP;
+	const temp_dht_t *d = temp_dht();
 
-	// Get temperature event
-	sensors_event_t event;
-	dht.temperature().getEvent(&event);
-
-	// Check for NaN
-	if (isnan(event.temperature))
+	// The last background read, converted to F when it was taken. No good
+	// read reads as NO_SENSOR_TEMP, as a NaN did.
+	if (context.scalecfg == FAHRENHEIT_SCALE)
 	{
-		re = NO_SENSOR_TEMP;
-		rc = SAPI_ERR_OK;
+		*reading = d->valid ? d->temp_f : NO_SENSOR_TEMP * 1.8 + 32;
 	}
 	else
 	{
-		re = event.temperature;
-		rc = SAPI_ERR_OK;
+		*reading = d->valid ? d->temp_c : NO_SENSOR_TEMP;
 	}
-
-	// Reading is in C. Convert to F if needed.
-	if (context.scalecfg == FAHRENHEIT_SCALE)
-	{
-		// Convert from Celsius to Fahrenheit
-		re *= 1.8;
-		re += 32;
-	}
-
-	// Assign output
-	*reading = re;
-	return rc;
+	return SAPI_ERR_OK;
 }
 
 